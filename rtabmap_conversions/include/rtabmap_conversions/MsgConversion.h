@@ -36,6 +36,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <sensor_msgs/CameraInfo.h>
 #include <sensor_msgs/LaserScan.h>
 #include <sensor_msgs/Image.h>
+#include <sensor_msgs/CompressedImage.h>
 #include <sensor_msgs/PointCloud2.h>
 
 #include <opencv2/opencv.hpp>
@@ -61,6 +62,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap_msgs/RGBDImage.h>
 #include <rtabmap_msgs/UserData.h>
 
+#include "rtabmap_conversions/ThreadPool.h"
+
 namespace rtabmap_conversions {
 
 void transformToTF(const rtabmap::Transform & transform, tf::Transform & tfTransform);
@@ -76,7 +79,19 @@ void toCvCopy(const rtabmap_msgs::RGBDImage & image, cv_bridge::CvImagePtr & rgb
 void toCvShare(const rtabmap_msgs::RGBDImageConstPtr & image, cv_bridge::CvImageConstPtr & rgb, cv_bridge::CvImageConstPtr & depth);
 void toCvShare(const rtabmap_msgs::RGBDImage & image, const boost::shared_ptr<void const>& trackedObject, cv_bridge::CvImageConstPtr & rgb, cv_bridge::CvImageConstPtr & depth);
 void rgbdImageToROS(const rtabmap::SensorData & data, rtabmap_msgs::RGBDImage & msg, const std::string & sensorFrameId);
-rtabmap::SensorData rgbdImageFromROS(const rtabmap_msgs::RGBDImageConstPtr & image);
+// By default, images are not copied: the returned SensorData references the
+// message buffers and is valid only while the message (or trackedObject) is alive.
+// Set copy=true if the data should outlive the message or will be modified.
+rtabmap::SensorData rgbdImageFromROS(const rtabmap_msgs::RGBDImageConstPtr & image, bool copy = false);
+rtabmap::SensorData rgbdImageFromROS(const rtabmap_msgs::RGBDImage & image, const boost::shared_ptr<void const>& trackedObject, bool copy = false);
+
+// Depth of RGBDImage::depth_compressed, format is "png" (rtabmap::compressImage())
+// or "rvl": fast lossless run-length/variable-length coding of 16UC1 depth
+// images (Wilson, 2017). 32FC1 depth images are always compressed in png.
+void compressDepth(const cv::Mat & depth, const std::string & format, sensor_msgs::CompressedImage & msg);
+cv::Mat uncompressDepth(const sensor_msgs::CompressedImage & msg);
+std::vector<unsigned char> compressDepthRVL(const cv::Mat & depth);
+cv::Mat uncompressDepthRVL(const std::vector<unsigned char> & data);
 
 // copy data
 void compressedMatToBytes(const cv::Mat & compressed, std::vector<unsigned char> & bytes);
@@ -85,6 +100,17 @@ cv::Mat compressedMatFromBytes(const std::vector<unsigned char> & bytes, bool co
 void infoFromROS(const rtabmap_msgs::Info & info, rtabmap::Statistics & stat);
 void infoToROS(const rtabmap::Statistics & stats, rtabmap_msgs::Info & info);
 
+// Compact Info: statistics names are replaced by numeric ids (statsIds), new
+// names are added to "statsIds" table. Returns true if the table has changed
+// (it should then be published again). If withHypotheses=false,
+// posterior, likelihood, raw likelihood and weights maps are not filled.
+bool infoToROSCompact(const rtabmap::Statistics & stats, rtabmap_msgs::Info & info, std::map<std::string, int> & statsIds, bool withHypotheses = true);
+// Same as above but ids in info.statsIds are resolved with "statsNames".
+void infoFromROS(const rtabmap_msgs::Info & info, rtabmap::Statistics & stat, const std::map<int, std::string> & statsNames);
+// The id->name table is sent as an Info message with only statsKeys and statsIds set.
+void statsNamesToROS(const std::map<std::string, int> & statsIds, rtabmap_msgs::Info & info);
+std::map<int, std::string> statsNamesFromROS(const rtabmap_msgs::Info & info);
+
 rtabmap::Link linkFromROS(const rtabmap_msgs::Link & msg);
 void linkToROS(const rtabmap::Link & link, rtabmap_msgs::Link & msg);
 
@@ -94,6 +120,9 @@ void keypointToROS(const cv::KeyPoint & kpt, rtabmap_msgs::KeyPoint & msg);
 std::vector<cv::KeyPoint> keypointsFromROS(const std::vector<rtabmap_msgs::KeyPoint> & msg);
 void keypointsFromROS(const std::vector<rtabmap_msgs::KeyPoint> & msg, std::vector<cv::KeyPoint> & kpts, int xShift=0);
 void keypointsToROS(const std::vector<cv::KeyPoint> & kpts, std::vector<rtabmap_msgs::KeyPoint> & msg);
+// Packed arrays (see KeyPoint layout in OdomInfo.msg), copied in bulk
+void keypointsFromROSPacked(const std::vector<float> & msg, std::vector<cv::KeyPoint> & kpts);
+void keypointsToROSPacked(const std::vector<cv::KeyPoint> & kpts, std::vector<float> & msg);
 
 rtabmap::GlobalDescriptor globalDescriptorFromROS(const rtabmap_msgs::GlobalDescriptor & msg);
 void globalDescriptorToROS(const rtabmap::GlobalDescriptor & desc, rtabmap_msgs::GlobalDescriptor & msg);
@@ -111,6 +140,8 @@ void point2fToROS(const cv::Point2f & kpt, rtabmap_msgs::Point2f & msg);
 
 std::vector<cv::Point2f> points2fFromROS(const std::vector<rtabmap_msgs::Point2f> & msg);
 void points2fToROS(const std::vector<cv::Point2f> & kpts, std::vector<rtabmap_msgs::Point2f> & msg);
+void points2fFromROSPacked(const std::vector<float> & msg, std::vector<cv::Point2f> & pts);
+void points2fToROSPacked(const std::vector<cv::Point2f> & pts, std::vector<float> & msg);
 
 cv::Point3f point3fFromROS(const rtabmap_msgs::Point3f & msg);
 void point3fToROS(const cv::Point3f & pt, rtabmap_msgs::Point3f & msg);
@@ -118,6 +149,8 @@ void point3fToROS(const cv::Point3f & pt, rtabmap_msgs::Point3f & msg);
 std::vector<cv::Point3f> points3fFromROS(const std::vector<rtabmap_msgs::Point3f> & msg, const rtabmap::Transform & transform = rtabmap::Transform());
 void points3fFromROS(const std::vector<rtabmap_msgs::Point3f> & msg, std::vector<cv::Point3f> & points3, const rtabmap::Transform & transform = rtabmap::Transform());
 void points3fToROS(const std::vector<cv::Point3f> & pts, std::vector<rtabmap_msgs::Point3f> & msg, const rtabmap::Transform & transform = rtabmap::Transform());
+void points3fFromROSPacked(const std::vector<float> & msg, std::vector<cv::Point3f> & pts);
+void points3fToROSPacked(const std::vector<cv::Point3f> & pts, std::vector<float> & msg);
 
 rtabmap::CameraModel cameraModelFromROS(
 		const sensor_msgs::CameraInfo & camInfo,
@@ -149,7 +182,9 @@ void mapDataToROS(
 		const std::multimap<int, rtabmap::Link> & links,
 		const std::map<int, rtabmap::Signature> & signatures,
 		const rtabmap::Transform & mapToOdom,
-		rtabmap_msgs::MapData & msg);
+		rtabmap_msgs::MapData & msg,
+		bool packed = false,
+		bool scanFloat16 = false);
 
 void mapGraphFromROS(
 		const rtabmap_msgs::MapGraph & msg,
@@ -163,14 +198,20 @@ void mapGraphToROS(
 		rtabmap_msgs::MapGraph & msg);
 
 rtabmap::Signature nodeDataFromROS(const rtabmap_msgs::NodeData & msg);
-void nodeDataToROS(const rtabmap::Signature & signature, rtabmap_msgs::NodeData & msg);
+// Convert all nodes (mostly the descriptors decompression), threads<=0 means one per core.
+// If pool is set, its threads are used instead.
+void nodesDataFromROS(const std::vector<rtabmap_msgs::NodeData> & msgs, std::map<int, rtabmap::Signature> & signatures, int threads = 0, ThreadPool * pool = 0);
+// scanFloat16: the laser scan is sent in half precision (see NodeData::laserScanFloat16)
+void nodeDataToROS(const rtabmap::Signature & signature, rtabmap_msgs::NodeData & msg, bool packed = false, bool scanFloat16 = false);
+// Convert all signatures (in id order), threads<=0 means one per core
+void nodesDataToROS(const std::map<int, rtabmap::Signature> & signatures, std::vector<rtabmap_msgs::NodeData> & msgs, bool packed = false, int threads = 0, bool scanFloat16 = false, ThreadPool * pool = 0);
 
 rtabmap::Signature nodeInfoFromROS(const rtabmap_msgs::NodeData & msg);
 void nodeInfoToROS(const rtabmap::Signature & signature, rtabmap_msgs::NodeData & msg);
 
 std::map<std::string, float> odomInfoToStatistics(const rtabmap::OdometryInfo & info);
 rtabmap::OdometryInfo odomInfoFromROS(const rtabmap_msgs::OdomInfo & msg, bool ignoreData = false);
-void odomInfoToROS(const rtabmap::OdometryInfo & info, rtabmap_msgs::OdomInfo & msg, bool ignoreData = false);
+void odomInfoToROS(const rtabmap::OdometryInfo & info, rtabmap_msgs::OdomInfo & msg, bool ignoreData = false, bool packed = false);
 
 cv::Mat userDataFromROS(const rtabmap_msgs::UserData & dataMsg);
 void userDataToROS(const cv::Mat & data, rtabmap_msgs::UserData & dataMsg, bool compress);
@@ -195,6 +236,14 @@ rtabmap::Transform getTransform(
 		tf::TransformListener & listener,
 		double waitForTransform);
 
+// Cache of the transforms returned by getTransform() above, shared by all
+// nodelets of the process. Transforms linked only by static TFs are kept
+// until cleared, the others are memoized per stamp (last maxStampedTransforms).
+void setTransformCacheEnabled(bool enabled, int maxStampedTransforms = 100);
+bool isTransformCacheEnabled();
+void clearTransformCache();
+void getTransformCacheStatistics(unsigned long & hits, unsigned long & misses);
+
 
 // get moving transform accordingly to a fixed frame. For example get
 // transform of /base_link between two stamps accordingly to /odom frame.
@@ -251,7 +300,8 @@ bool convertScanMsg(
 		rtabmap::LaserScan & scan,
 		tf::TransformListener & listener,
 		double waitForTransform,
-		bool outputInFrameId = false);
+		bool outputInFrameId = false,
+		float quantization = 0.0f);
 
 bool convertScan3dMsg(
 		const sensor_msgs::PointCloud2 & scan3dMsg,
@@ -263,7 +313,13 @@ bool convertScan3dMsg(
 		double waitForTransform,
 		int maxPoints = 0,
 		float maxRange = 0.0f,
-		bool is2D = false);
+		bool is2D = false,
+		float quantization = 0.0f);
+
+// Round the point coordinates of the scan (in place) to a multiple of
+// quantization (m), rounded to a power of two. The values then have
+// trailing zero mantissa bits and the scan compresses much better.
+void quantizeScan(rtabmap::LaserScan & scan, float quantization);
 
 bool deskew(
 		const sensor_msgs::PointCloud2 & input,
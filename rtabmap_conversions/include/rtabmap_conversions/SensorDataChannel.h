@@ -0,0 +1,61 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SENSORDATACHANNEL_H_
+#define SENSORDATACHANNEL_H_
+
+#include <string>
+#include <boost/function.hpp>
+#include <nav_msgs/Odometry.h>
+#include <rtabmap/core/SensorData.h>
+#include <rtabmap/core/OdometryInfo.h>
+
+namespace rtabmap_conversions {
+
+/**
+ * In-process hand-off of odometry results between nodelets loaded in the
+ * same nodelet manager: the SensorData already converted by the odometry
+ * nodelet is given directly to the subscribers, without ROS serialization,
+ * re-synchronization and re-conversion. Channels are identified by name,
+ * use the resolved topic name so that remapping works like for topics.
+ * Callbacks are called in the publisher's thread and should return quickly.
+ */
+class SensorDataChannel
+{
+public:
+	typedef boost::function<void(const rtabmap::SensorData &, const nav_msgs::Odometry &, const rtabmap::OdometryInfo &)> Callback;
+
+	static void subscribe(const std::string & name, const void * owner, const Callback & callback);
+	static void unsubscribe(const std::string & name, const void * owner);
+	static bool hasSubscribers(const std::string & name);
+	// data should own its buffers (not referencing ROS messages), subscribers may keep it
+	static void publish(const std::string & name, const rtabmap::SensorData & data, const nav_msgs::Odometry & odom, const rtabmap::OdometryInfo & info);
+};
+
+}
+
+#endif /* SENSORDATACHANNEL_H_ */
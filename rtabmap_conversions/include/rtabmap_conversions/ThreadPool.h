@@ -0,0 +1,104 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+
+#include <string>
+#include <vector>
+#include <list>
+#include <set>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <ros/node_handle.h>
+
+namespace rtabmap_conversions {
+
+/**
+ * Placement of a thread: CPU affinity and real-time priority. Threads
+ * created afterwards by the thread inherit them (Linux).
+ */
+struct ThreadSettings
+{
+	ThreadSettings() : priority(0) {}
+	bool isDefault() const {return cpus.empty() && priority <= 0;}
+	// Apply to the calling thread. Real-time priorities need
+	// CAP_SYS_NICE or an rtprio limit, a warning is shown if refused.
+	bool apply() const;
+	std::string toString() const;
+
+	// "<prefix>cpus": CPU list like "0 1 4-7" (empty for all),
+	// "<prefix>priority": SCHED_FIFO priority 1-99 (0 for default policy)
+	static ThreadSettings fromParams(const ros::NodeHandle & pnh, const std::string & prefix);
+	static std::vector<int> parseCpus(const std::string & cpus);
+
+	std::vector<int> cpus;
+	int priority;
+};
+
+/**
+ * Named pool of worker threads, shared by the nodelets of the same
+ * process using the same name. The first nodelet creating a pool sets its
+ * size and placement. The pool is destroyed with its last user.
+ */
+class ThreadPool
+{
+public:
+	static boost::shared_ptr<ThreadPool> get(const std::string & name, int threads, const ThreadSettings & settings);
+	// Pool set by "thread_pool" (name, empty for none), "thread_pool_size"
+	// (0 for one thread per core), "thread_pool_cpus" and "thread_pool_priority"
+	static boost::shared_ptr<ThreadPool> fromParams(const ros::NodeHandle & pnh);
+
+	~ThreadPool();
+	const std::string & name() const {return name_;}
+	int size() const {return (int)workers_.size();}
+	const ThreadSettings & settings() const {return settings_;}
+
+	// Call job(offset, step) for all offsets in [0, step) with
+	// step=min(size(), jobs), and wait until they are all done.
+	// Called from a worker of the pool, jobs are done in the calling thread.
+	void parallelFor(int jobs, const boost::function<void(int, int)> & job);
+
+private:
+	ThreadPool(const std::string & name, int threads, const ThreadSettings & settings);
+	void workerLoop();
+
+private:
+	std::string name_;
+	ThreadSettings settings_;
+	std::vector<boost::thread*> workers_;
+	std::set<boost::thread::id> workerIds_;
+	std::list<boost::function<void()> > jobs_;
+	boost::mutex mutex_;
+	boost::condition_variable condition_;
+	bool running_;
+};
+
+}
+
+#endif /* THREADPOOL_H_ */
@@ -46,6 +46,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <sensor_msgs/point_cloud2_iterator.h>
 #include <laser_geometry/laser_geometry.h>
 #include <rtabmap/core/util3d_surface.h>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <list>
 
 namespace rtabmap_conversions {
 
@@ -156,7 +159,7 @@ void toCvCopy(const rtabmap_msgs::RGBDImage & image, cv_bridge::CvImagePtr & rgb
 	{
 		cv_bridge::CvImagePtr ptr = boost::make_shared<cv_bridge::CvImage>();
 		ptr->header = image.depth_compressed.header;
-		ptr->image = rtabmap::uncompressImage(image.depth_compressed.data);
+		ptr->image = uncompressDepth(image.depth_compressed);
 		ROS_ASSERT(ptr->image.empty() || ptr->image.type() == CV_32FC1 || ptr->image.type() == CV_16UC1);
 		ptr->encoding = ptr->image.empty()?"":ptr->image.type() == CV_32FC1?sensor_msgs::image_encodings::TYPE_32FC1:sensor_msgs::image_encodings::TYPE_16UC1;
 		depth = ptr;
@@ -201,7 +204,7 @@ void toCvShare(const rtabmap_msgs::RGBDImage & image, const boost::shared_ptr<vo
 		{
 			cv_bridge::CvImagePtr ptr = boost::make_shared<cv_bridge::CvImage>();
 			ptr->header = image.depth_compressed.header;
-			ptr->image = rtabmap::uncompressImage(image.depth_compressed.data);
+			ptr->image = uncompressDepth(image.depth_compressed);
 			ROS_ASSERT(ptr->image.empty() || ptr->image.type() == CV_32FC1 || ptr->image.type() == CV_16UC1);
 			ptr->encoding = ptr->image.empty()?"":ptr->image.type() == CV_32FC1?sensor_msgs::image_encodings::TYPE_32FC1:sensor_msgs::image_encodings::TYPE_16UC1;
 			depth = ptr;
@@ -285,14 +288,25 @@ void rgbdImageToROS(const rtabmap::SensorData & data, rtabmap_msgs::RGBDImage &
 	}
 }
 
-rtabmap::SensorData rgbdImageFromROS(const rtabmap_msgs::RGBDImageConstPtr & image)
+rtabmap::SensorData rgbdImageFromROS(const rtabmap_msgs::RGBDImageConstPtr & image, bool copy)
+{
+	return rgbdImageFromROS(*image, image, copy);
+}
+
+// Returns true if the matrix points directly in the message buffer (no conversion done)
+static bool isSharedWithMsg(const cv::Mat & mat, const sensor_msgs::Image & msg)
+{
+	return !mat.empty() && !msg.data.empty() && mat.data == &msg.data[0];
+}
+
+rtabmap::SensorData rgbdImageFromROS(const rtabmap_msgs::RGBDImage & image, const boost::shared_ptr<void const>& trackedObject, bool copy)
 {
 	rtabmap::SensorData data;
 	cv_bridge::CvImageConstPtr imageMsg;
 	cv_bridge::CvImageConstPtr depthMsg;
-	toCvShare(image, imageMsg, depthMsg);
+	toCvShare(image, trackedObject, imageMsg, depthMsg);
 
-	rtabmap::StereoCameraModel stereoModel = stereoCameraModelFromROS(image->rgb_camera_info, image->depth_camera_info, rtabmap::Transform::getIdentity());
+	rtabmap::StereoCameraModel stereoModel = stereoCameraModelFromROS(image.rgb_camera_info, image.depth_camera_info, rtabmap::Transform::getIdentity());
 
 	if(stereoModel.isValidForProjection())
 	{
@@ -352,6 +366,12 @@ rtabmap::SensorData rgbdImageFromROS(const rtabmap_msgs::RGBDImageConstPtr & ima
 			{
 				right = cv_bridge::cvtColor(imageRectRight, "mono8")->image;
 			}
+			if(copy)
+			{
+				// only buffers still pointing in the message need to be copied
+				left = isSharedWithMsg(left, image.rgb)?left.clone():left;
+				right = isSharedWithMsg(right, image.depth)?right.clone():right;
+			}
 
 			//
 
@@ -360,7 +380,7 @@ rtabmap::SensorData rgbdImageFromROS(const rtabmap_msgs::RGBDImageConstPtr & ima
 					right,
 					stereoModel,
 					0,
-					rtabmap_conversions::timestampFromROS(image->header.stamp));
+					rtabmap_conversions::timestampFromROS(image.header.stamp));
 		}
 		else
 		{
@@ -418,18 +438,222 @@ rtabmap::SensorData rgbdImageFromROS(const rtabmap_msgs::RGBDImageConstPtr & ima
 			ptrImage = cv_bridge::cvtColor(imageMsg, "bgr8");
 		}
 
-		cv_bridge::CvImageConstPtr ptrDepth = depthMsg;
+		cv::Mat rgbMat = ptrImage->image;
+		cv::Mat depthMat = depthMsg->image;
+		if(copy)
+		{
+			// only buffers still pointing in the message need to be copied
+			rgbMat = isSharedWithMsg(rgbMat, image.rgb)?rgbMat.clone():rgbMat;
+			depthMat = isSharedWithMsg(depthMat, image.depth)?depthMat.clone():depthMat;
+		}
 		data = rtabmap::SensorData(
-				ptrImage->image,
-				ptrDepth->image,
-				rtabmap_conversions::cameraModelFromROS(image->rgb_camera_info),
+				rgbMat,
+				depthMat,
+				rtabmap_conversions::cameraModelFromROS(image.rgb_camera_info),
 				0,
-				rtabmap_conversions::timestampFromROS(image->header.stamp));
+				rtabmap_conversions::timestampFromROS(image.header.stamp));
 	}
 
 	return data;
 }
 
+// RVL: zero runs and non-zero runs lengths, then the zigzag-coded
+// deltas of the non-zero values, all variable-length coded with 3 bits
+// nibbles (the 4th bit tells if more nibbles follow) packed in 32 bits words.
+class RVLEncoder
+{
+public:
+	RVLEncoder(uint32_t * buffer) : buffer_(buffer), word_(0), nibbles_(0) {}
+	void encode(uint32_t value)
+	{
+		do
+		{
+			uint32_t nibble = value & 0x7;
+			if(value >>= 3)
+			{
+				nibble |= 0x8;
+			}
+			word_ = (word_ << 4) | nibble;
+			if(++nibbles_ == 8)
+			{
+				*buffer_++ = word_;
+				nibbles_ = 0;
+				word_ = 0;
+			}
+		}
+		while(value);
+	}
+	uint32_t * flush()
+	{
+		if(nibbles_)
+		{
+			*buffer_++ = word_ << 4*(8-nibbles_);
+		}
+		return buffer_;
+	}
+private:
+	uint32_t * buffer_;
+	uint32_t word_;
+	int nibbles_;
+};
+
+class RVLDecoder
+{
+public:
+	RVLDecoder(const uint32_t * buffer, const uint32_t * end) : buffer_(buffer), end_(end), word_(0), nibbles_(0) {}
+	bool decode(uint32_t & value)
+	{
+		uint32_t nibble;
+		int bits = 29;
+		value = 0;
+		do
+		{
+			if(bits < 0)
+			{
+				return false;
+			}
+			if(!nibbles_)
+			{
+				if(buffer_ == end_)
+				{
+					return false;
+				}
+				word_ = *buffer_++;
+				nibbles_ = 8;
+			}
+			nibble = word_ & 0xf0000000;
+			value |= (nibble << 1) >> bits;
+			word_ <<= 4;
+			--nibbles_;
+			bits -= 3;
+		}
+		while(nibble & 0x80000000);
+		return true;
+	}
+private:
+	const uint32_t * buffer_;
+	const uint32_t * end_;
+	uint32_t word_;
+	int nibbles_;
+};
+
+std::vector<unsigned char> compressDepthRVL(const cv::Mat & depth)
+{
+	UASSERT(depth.type() == CV_16UC1);
+	cv::Mat input = depth.isContinuous()?depth:depth.clone();
+	int numPixels = input.rows*input.cols;
+	// header (rows, cols), worst case (noisy depth) is less than 8 nibbles
+	// per pixel, the buffer is shrunk to the actual size after encoding
+	std::vector<unsigned char> out(2*sizeof(int32_t) + (numPixels+16)*sizeof(uint32_t));
+	((int32_t*)out.data())[0] = input.rows;
+	((int32_t*)out.data())[1] = input.cols;
+	uint32_t * buffer = (uint32_t*)(out.data()+2*sizeof(int32_t));
+	RVLEncoder encoder(buffer);
+	const unsigned short * it = input.ptr<unsigned short>();
+	const unsigned short * end = it + numPixels;
+	int previous = 0;
+	while(it != end)
+	{
+		uint32_t zeros = 0;
+		for(; it != end && !*it; ++it, ++zeros);
+		encoder.encode(zeros);
+		uint32_t nonzeros = 0;
+		for(const unsigned short * p = it; p != end && *p; ++p, ++nonzeros);
+		encoder.encode(nonzeros);
+		for(uint32_t i=0; i<nonzeros; ++i)
+		{
+			int current = *it++;
+			int delta = current - previous;
+			encoder.encode((uint32_t)((delta << 1) ^ (delta >> 31)));
+			previous = current;
+		}
+	}
+	uint32_t * bufferEnd = encoder.flush();
+	out.resize((unsigned char*)bufferEnd - out.data());
+	return out;
+}
+
+cv::Mat uncompressDepthRVL(const std::vector<unsigned char> & data)
+{
+	if(data.size() < 2*sizeof(int32_t) || (data.size() - 2*sizeof(int32_t)) % sizeof(uint32_t) != 0)
+	{
+		UERROR("Invalid RVL data (size=%d)", (int)data.size());
+		return cv::Mat();
+	}
+	int rows = ((const int32_t*)data.data())[0];
+	int cols = ((const int32_t*)data.data())[1];
+	if(rows <= 0 || cols <= 0)
+	{
+		UERROR("Invalid RVL data (rows=%d cols=%d)", rows, cols);
+		return cv::Mat();
+	}
+	cv::Mat depth(rows, cols, CV_16UC1);
+	const uint32_t * buffer = (const uint32_t*)(data.data()+2*sizeof(int32_t));
+	RVLDecoder decoder(buffer, buffer + (data.size() - 2*sizeof(int32_t))/sizeof(uint32_t));
+	unsigned short * it = depth.ptr<unsigned short>();
+	int remaining = rows*cols;
+	int previous = 0;
+	while(remaining)
+	{
+		uint32_t zeros, nonzeros;
+		if(!decoder.decode(zeros) || (int)zeros > remaining)
+		{
+			UERROR("Corrupted RVL data");
+			return cv::Mat();
+		}
+		memset(it, 0, zeros*sizeof(unsigned short));
+		it += zeros;
+		remaining -= zeros;
+		if(!decoder.decode(nonzeros) || (int)nonzeros > remaining)
+		{
+			UERROR("Corrupted RVL data");
+			return cv::Mat();
+		}
+		remaining -= nonzeros;
+		for(; nonzeros; --nonzeros)
+		{
+			uint32_t positive;
+			if(!decoder.decode(positive))
+			{
+				UERROR("Corrupted RVL data");
+				return cv::Mat();
+			}
+			int delta = (int)(positive >> 1) ^ -(int)(positive & 1);
+			previous += delta;
+			*it++ = (unsigned short)previous;
+		}
+	}
+	return depth;
+}
+
+void compressDepth(const cv::Mat & depth, const std::string & format, sensor_msgs::CompressedImage & msg)
+{
+	if(format.compare("rvl") == 0 && depth.type() == CV_16UC1)
+	{
+		msg.data = compressDepthRVL(depth);
+		msg.format = "rvl";
+	}
+	else
+	{
+		if(format.compare("rvl") == 0)
+		{
+			ROS_WARN_ONCE("RVL depth compression is only supported for 16UC1 depth images, "
+					"png is used instead. This message is only printed once.");
+		}
+		msg.data = rtabmap::compressImage(depth, ".png");
+		msg.format = "png";
+	}
+}
+
+cv::Mat uncompressDepth(const sensor_msgs::CompressedImage & msg)
+{
+	if(msg.format.compare("rvl") == 0)
+	{
+		return uncompressDepthRVL(msg.data);
+	}
+	return rtabmap::uncompressImage(msg.data);
+}
+
 void compressedMatToBytes(const cv::Mat & compressed, std::vector<unsigned char> & bytes)
 {
 	UASSERT(compressed.empty() || compressed.type() == CV_8UC1);
@@ -456,6 +680,11 @@ cv::Mat compressedMatFromBytes(const std::vector<unsigned char> & bytes, bool co
 }
 
 void infoFromROS(const rtabmap_msgs::Info & info, rtabmap::Statistics & stat)
+{
+	infoFromROS(info, stat, std::map<int, std::string>());
+}
+
+void infoFromROS(const rtabmap_msgs::Info & info, rtabmap::Statistics & stat, const std::map<int, std::string> & statsNames)
 {
 	stat.setExtended(true); // Extended
 
@@ -521,6 +750,17 @@ void infoFromROS(const rtabmap_msgs::Info & info, rtabmap::Statistics & stat)
 	{
 		stat.addStatistic(info.statsKeys.at(i), info.statsValues.at(i));
 	}
+	if(info.statsKeys.empty())
+	{
+		for(unsigned int i=0; i<info.statsIds.size() && i<info.statsValues.size(); i++)
+		{
+			std::map<int, std::string>::const_iterator iter = statsNames.find(info.statsIds.at(i));
+			if(iter != statsNames.end())
+			{
+				stat.addStatistic(iter->second, info.statsValues.at(i));
+			}
+		}
+	}
 }
 
 void infoToROS(const rtabmap::Statistics & stats, rtabmap_msgs::Info & info)
@@ -559,6 +799,73 @@ void infoToROS(const rtabmap::Statistics & stats, rtabmap_msgs::Info & info)
 	}
 }
 
+bool infoToROSCompact(const rtabmap::Statistics & stats, rtabmap_msgs::Info & info, std::map<std::string, int> & statsIds, bool withHypotheses)
+{
+	info.refId = stats.refImageId();
+	info.loopClosureId = stats.loopClosureId();
+	info.proximityDetectionId = stats.proximityDetectionId();
+	info.landmarkId =  static_cast<int>(uValue(stats.data(), rtabmap::Statistics::kLoopLandmark_detected(), 0.0f));
+
+	rtabmap_conversions::transformToGeometryMsg(stats.loopClosureTransform(), info.loopClosureTransform);
+
+	bool tableChanged = false;
+	if(stats.extended())
+	{
+		info.wmState = stats.wmState();
+
+		if(withHypotheses)
+		{
+			info.posteriorKeys = uKeys(stats.posterior());
+			info.posteriorValues = uValues(stats.posterior());
+			info.likelihoodKeys = uKeys(stats.likelihood());
+			info.likelihoodValues = uValues(stats.likelihood());
+			info.rawLikelihoodKeys = uKeys(stats.rawLikelihood());
+			info.rawLikelihoodValues = uValues(stats.rawLikelihood());
+			info.weightsKeys = uKeys(stats.weights());
+			info.weightsValues = uValues(stats.weights());
+		}
+		info.labelsKeys = uKeys(stats.labels());
+		info.labelsValues = uValues(stats.labels());
+		info.localPath = stats.localPath();
+		info.currentGoalId = stats.currentGoalId();
+		mapGraphToROS(stats.odomCachePoses(), stats.odomCacheConstraints(), stats.mapCorrection(), info.odom_cache);
+
+		// Statistics data, names are replaced by their id
+		info.statsIds.resize(stats.data().size());
+		info.statsValues.resize(stats.data().size());
+		int i=0;
+		for(std::map<std::string, float>::const_iterator iter=stats.data().begin(); iter!=stats.data().end(); ++iter)
+		{
+			std::map<std::string, int>::iterator jter = statsIds.find(iter->first);
+			if(jter == statsIds.end())
+			{
+				jter = statsIds.insert(std::make_pair(iter->first, (int)statsIds.size())).first;
+				tableChanged = true;
+			}
+			info.statsIds[i] = jter->second;
+			info.statsValues[i] = iter->second;
+			++i;
+		}
+	}
+	return tableChanged;
+}
+
+void statsNamesToROS(const std::map<std::string, int> & statsIds, rtabmap_msgs::Info & info)
+{
+	info.statsKeys = uKeys(statsIds);
+	info.statsIds = uValues(statsIds);
+}
+
+std::map<int, std::string> statsNamesFromROS(const rtabmap_msgs::Info & info)
+{
+	std::map<int, std::string> statsNames;
+	for(unsigned int i=0; i<info.statsKeys.size() && i<info.statsIds.size(); ++i)
+	{
+		statsNames.insert(std::make_pair(info.statsIds[i], info.statsKeys[i]));
+	}
+	return statsNames;
+}
+
 rtabmap::Link linkFromROS(const rtabmap_msgs::Link & msg)
 {
 	cv::Mat information = cv::Mat(6,6,CV_64FC1, (void*)msg.information.data()).clone();
@@ -623,6 +930,27 @@ void keypointsToROS(const std::vector<cv::KeyPoint> & kpts, std::vector<rtabmap_
 	}
 }
 
+void keypointsFromROSPacked(const std::vector<float> & msg, std::vector<cv::KeyPoint> & kpts)
+{
+	UASSERT(sizeof(cv::KeyPoint) == 7*sizeof(float));
+	UASSERT(msg.size() % 7 == 0);
+	kpts.resize(msg.size()/7);
+	if(!kpts.empty())
+	{
+		memcpy(kpts.data(), msg.data(), msg.size()*sizeof(float));
+	}
+}
+
+void keypointsToROSPacked(const std::vector<cv::KeyPoint> & kpts, std::vector<float> & msg)
+{
+	UASSERT(sizeof(cv::KeyPoint) == 7*sizeof(float));
+	msg.resize(kpts.size()*7);
+	if(!kpts.empty())
+	{
+		memcpy(msg.data(), kpts.data(), msg.size()*sizeof(float));
+	}
+}
+
 rtabmap::GlobalDescriptor globalDescriptorFromROS(const rtabmap_msgs::GlobalDescriptor & msg)
 {
 	return rtabmap::GlobalDescriptor(msg.type, rtabmap::uncompressData(msg.data), rtabmap::uncompressData(msg.info));
@@ -732,6 +1060,25 @@ void points2fToROS(const std::vector<cv::Point2f> & kpts, std::vector<rtabmap_ms
 	}
 }
 
+void points2fFromROSPacked(const std::vector<float> & msg, std::vector<cv::Point2f> & pts)
+{
+	UASSERT(msg.size() % 2 == 0);
+	pts.resize(msg.size()/2);
+	if(!pts.empty())
+	{
+		memcpy(pts.data(), msg.data(), msg.size()*sizeof(float));
+	}
+}
+
+void points2fToROSPacked(const std::vector<cv::Point2f> & pts, std::vector<float> & msg)
+{
+	msg.resize(pts.size()*2);
+	if(!pts.empty())
+	{
+		memcpy(msg.data(), pts.data(), msg.size()*sizeof(float));
+	}
+}
+
 cv::Point3f point3fFromROS(const rtabmap_msgs::Point3f & msg)
 {
 	return cv::Point3f(msg.x, msg.y, msg.z);
@@ -792,6 +1139,25 @@ void points3fToROS(const std::vector<cv::Point3f> & pts, std::vector<rtabmap_msg
 	}
 }
 
+void points3fFromROSPacked(const std::vector<float> & msg, std::vector<cv::Point3f> & pts)
+{
+	UASSERT(msg.size() % 3 == 0);
+	pts.resize(msg.size()/3);
+	if(!pts.empty())
+	{
+		memcpy(pts.data(), msg.data(), msg.size()*sizeof(float));
+	}
+}
+
+void points3fToROSPacked(const std::vector<cv::Point3f> & pts, std::vector<float> & msg)
+{
+	msg.resize(pts.size()*3);
+	if(!pts.empty())
+	{
+		memcpy(msg.data(), pts.data(), msg.size()*sizeof(float));
+	}
+}
+
 rtabmap::CameraModel cameraModelFromROS(
 		const sensor_msgs::CameraInfo & camInfo,
 		const rtabmap::Transform & localTransform)
@@ -995,20 +1361,15 @@ void mapDataToROS(
 		const std::multimap<int, rtabmap::Link> & links,
 		const std::map<int, rtabmap::Signature> & signatures,
 		const rtabmap::Transform & mapToOdom,
-		rtabmap_msgs::MapData & msg)
+		rtabmap_msgs::MapData & msg,
+		bool packed,
+		bool scanFloat16)
 {
 	//Optimized graph
 	mapGraphToROS(poses, links, mapToOdom, msg.graph);
 
 	//Data
-	msg.nodes.resize(signatures.size());
-	int index=0;
-	for(std::multimap<int, rtabmap::Signature>::const_iterator iter = signatures.begin();
-		iter!=signatures.end();
-		++iter)
-	{
-		nodeDataToROS(iter->second, msg.nodes[index++]);
-	}
+	nodesDataToROS(signatures, msg.nodes, packed, 0, scanFloat16);
 }
 
 void mapGraphFromROS(
@@ -1081,6 +1442,24 @@ rtabmap::Signature nodeDataFromROS(const rtabmap_msgs::NodeData & msg)
 	{
 		ROS_ERROR("Word IDs and 3D points should be the same size (%d, %d)!", (int)msg.wordIdKeys.size(), (int)msg.wordPts.size());
 	}
+	if(!msg.wordKptsPacked.empty())
+	{
+		keypointsFromROSPacked(msg.wordKptsPacked, wordsKpts);
+		if(wordsKpts.size() != msg.wordIdKeys.size())
+		{
+			ROS_ERROR("Word IDs and packed 2D keypoints should be the same size (%d, %d)!", (int)msg.wordIdKeys.size(), (int)wordsKpts.size());
+			wordsKpts.clear();
+		}
+	}
+	if(!msg.wordPtsPacked.empty())
+	{
+		points3fFromROSPacked(msg.wordPtsPacked, words3D);
+		if(words3D.size() != msg.wordIdKeys.size())
+		{
+			ROS_ERROR("Word IDs and packed 3D points should be the same size (%d, %d)!", (int)msg.wordIdKeys.size(), (int)words3D.size());
+			words3D.clear();
+		}
+	}
 	if(!wordsDescriptors.empty() && wordsDescriptors.rows != (int)msg.wordIdKeys.size())
 	{
 		ROS_ERROR("Word IDs and descriptors should be the same size (%d, %d)!", (int)msg.wordIdKeys.size(), wordsDescriptors.rows);
@@ -1092,7 +1471,7 @@ rtabmap::Signature nodeDataFromROS(const rtabmap_msgs::NodeData & msg)
 		for(unsigned int i=0; i<msg.wordIdKeys.size(); ++i)
 		{
 			words.insert(std::make_pair(msg.wordIdKeys.at(i), msg.wordIdValues.at(i))); // ID to index
-			if(msg.wordIdKeys.size() == msg.wordKpts.size())
+			if(msg.wordKptsPacked.empty() && msg.wordIdKeys.size() == msg.wordKpts.size())
 			{
 				if(wordsKpts.empty())
 				{
@@ -1100,7 +1479,7 @@ rtabmap::Signature nodeDataFromROS(const rtabmap_msgs::NodeData & msg)
 				}
 				wordsKpts.push_back(keypointFromROS(msg.wordKpts.at(i)));
 			}
-			if(msg.wordIdKeys.size() == msg.wordPts.size())
+			if(msg.wordPtsPacked.empty() && msg.wordIdKeys.size() == msg.wordPts.size())
 			{
 				if(words3D.empty())
 				{
@@ -1167,6 +1546,19 @@ rtabmap::Signature nodeDataFromROS(const rtabmap_msgs::NodeData & msg)
 		}
 	}
 
+	cv::Mat laserScan;
+	if(msg.laserScanFloat16 && !msg.laserScan.empty())
+	{
+		cv::Mat half = rtabmap::uncompressData(msg.laserScan);
+		cv::Mat data;
+		cv::convertFp16(half.reshape(1), data);
+		laserScan = rtabmap::compressData2(data.reshape(half.channels()));
+	}
+	else
+	{
+		laserScan = compressedMatFromBytes(msg.laserScan);
+	}
+
 	rtabmap::Signature s(
 			msg.id,
 			msg.mapId,
@@ -1177,7 +1569,7 @@ rtabmap::Signature nodeDataFromROS(const rtabmap_msgs::NodeData & msg)
 			transformFromPoseMsg(msg.groundTruthPose),
 			stereoModels.size()?
 				rtabmap::SensorData(
-					rtabmap::LaserScan(compressedMatFromBytes(msg.laserScan),
+					rtabmap::LaserScan(laserScan,
 							msg.laserScanMaxPts,
 							msg.laserScanMaxRange,
 							(rtabmap::LaserScan::Format)msg.laserScanFormat,
@@ -1189,7 +1581,7 @@ rtabmap::Signature nodeDataFromROS(const rtabmap_msgs::NodeData & msg)
 					msg.stamp,
 					compressedMatFromBytes(msg.userData)):
 				rtabmap::SensorData(
-					rtabmap::LaserScan(compressedMatFromBytes(msg.laserScan),
+					rtabmap::LaserScan(laserScan,
 							msg.laserScanMaxPts,
 							msg.laserScanMaxRange,
 							(rtabmap::LaserScan::Format)msg.laserScanFormat,
@@ -1212,7 +1604,7 @@ rtabmap::Signature nodeDataFromROS(const rtabmap_msgs::NodeData & msg)
 	s.sensorData().setGPS(rtabmap::GPS(msg.gps.stamp, msg.gps.longitude, msg.gps.latitude, msg.gps.altitude, msg.gps.error, msg.gps.bearing));
 	return s;
 }
-void nodeDataToROS(const rtabmap::Signature & signature, rtabmap_msgs::NodeData & msg)
+void nodeDataToROS(const rtabmap::Signature & signature, rtabmap_msgs::NodeData & msg, bool packed, bool scanFloat16)
 {
 	// add data
 	msg.id = signature.id();
@@ -1230,7 +1622,27 @@ void nodeDataToROS(const rtabmap::Signature & signature, rtabmap_msgs::NodeData
 	msg.gps.bearing = signature.sensorData().gps().bearing();
 	compressedMatToBytes(signature.sensorData().imageCompressed(), msg.image);
 	compressedMatToBytes(signature.sensorData().depthOrRightCompressed(), msg.depth);
-	compressedMatToBytes(signature.sensorData().laserScanCompressed().data(), msg.laserScan);
+	msg.laserScanFloat16 = false;
+	if(scanFloat16 && !signature.sensorData().laserScanCompressed().isEmpty())
+	{
+		cv::Mat data = signature.sensorData().laserScanCompressed().data();
+		if(data.type() == CV_8UC1)
+		{
+			data = rtabmap::uncompressData(data);
+		}
+		if(!data.empty() && data.depth() == CV_32F)
+		{
+			// half precision floats stored in CV_16S, same channels
+			cv::Mat half;
+			cv::convertFp16(data.reshape(1), half);
+			msg.laserScan = rtabmap::compressData(half.reshape(data.channels()));
+			msg.laserScanFloat16 = true;
+		}
+	}
+	if(!msg.laserScanFloat16)
+	{
+		compressedMatToBytes(signature.sensorData().laserScanCompressed().data(), msg.laserScan);
+	}
 	compressedMatToBytes(signature.sensorData().userDataCompressed(), msg.userData);
 	compressedMatToBytes(signature.sensorData().gridGroundCellsCompressed(), msg.grid_ground);
 	compressedMatToBytes(signature.sensorData().gridObstacleCellsCompressed(), msg.grid_obstacles);
@@ -1309,7 +1721,7 @@ void nodeDataToROS(const rtabmap::Signature & signature, rtabmap_msgs::NodeData
 	{
 		msg.wordIdKeys.at(i) = iter->first;
 		msg.wordIdValues.at(i) = iter->second;
-		if(signature.getWordsKpts().size() == signature.getWords().size())
+		if(!packed && signature.getWordsKpts().size() == signature.getWords().size())
 		{
 			if(msg.wordKpts.empty())
 			{
@@ -1317,7 +1729,7 @@ void nodeDataToROS(const rtabmap::Signature & signature, rtabmap_msgs::NodeData
 			}
 			keypointToROS(signature.getWordsKpts().at(i), msg.wordKpts.at(i));
 		}
-		if(signature.getWords3().size() == signature.getWords().size())
+		if(!packed && signature.getWords3().size() == signature.getWords().size())
 		{
 			if(msg.wordPts.empty())
 			{
@@ -1327,6 +1739,17 @@ void nodeDataToROS(const rtabmap::Signature & signature, rtabmap_msgs::NodeData
 		}
 		++i;
 	}
+	if(packed)
+	{
+		if(signature.getWordsKpts().size() == signature.getWords().size())
+		{
+			keypointsToROSPacked(signature.getWordsKpts(), msg.wordKptsPacked);
+		}
+		if(signature.getWords3().size() == signature.getWords().size())
+		{
+			points3fToROSPacked(signature.getWords3(), msg.wordPtsPacked);
+		}
+	}
 
 	if(!signature.getWordsDescriptors().empty())
 	{
@@ -1346,6 +1769,94 @@ void nodeDataToROS(const rtabmap::Signature & signature, rtabmap_msgs::NodeData
 	rtabmap_conversions::envSensorsToROS(signature.sensorData().envSensors(), msg.env_sensors);
 }
 
+static void nodesDataToROSThread(
+		const std::vector<const rtabmap::Signature *> * signatures,
+		std::vector<rtabmap_msgs::NodeData> * msgs,
+		bool packed,
+		bool scanFloat16,
+		int offset,
+		int step)
+{
+	// Each worker converts every step-th node, mostly the descriptors compression
+	for(size_t i=offset; i<signatures->size(); i+=step)
+	{
+		nodeDataToROS(*signatures->at(i), msgs->at(i), packed, scanFloat16);
+	}
+}
+
+void nodesDataToROS(const std::map<int, rtabmap::Signature> & signatures, std::vector<rtabmap_msgs::NodeData> & msgs, bool packed, int threads, bool scanFloat16, ThreadPool * pool)
+{
+	std::vector<const rtabmap::Signature *> signaturesVector;
+	signaturesVector.reserve(signatures.size());
+	for(std::map<int, rtabmap::Signature>::const_iterator iter = signatures.begin();
+		iter!=signatures.end();
+		++iter)
+	{
+		signaturesVector.push_back(&iter->second);
+	}
+	msgs.resize(signaturesVector.size());
+
+	if(pool)
+	{
+		pool->parallelFor((int)signaturesVector.size(), boost::bind(&nodesDataToROSThread, &signaturesVector, &msgs, packed, scanFloat16, boost::placeholders::_1, boost::placeholders::_2));
+		return;
+	}
+	if(threads <= 0)
+	{
+		threads = (int)boost::thread::hardware_concurrency();
+	}
+	threads = std::max(1, std::min(threads, (int)signaturesVector.size()));
+	boost::thread_group workers;
+	for(int i=1; i<threads; ++i)
+	{
+		workers.create_thread(boost::bind(&nodesDataToROSThread, &signaturesVector, &msgs, packed, scanFloat16, i, threads));
+	}
+	nodesDataToROSThread(&signaturesVector, &msgs, packed, scanFloat16, 0, threads);
+	workers.join_all();
+}
+
+static void nodesDataFromROSThread(
+		const std::vector<rtabmap_msgs::NodeData> * msgs,
+		std::vector<rtabmap::Signature> * signatures,
+		int offset,
+		int step)
+{
+	for(size_t i=offset; i<msgs->size(); i+=step)
+	{
+		signatures->at(i) = nodeDataFromROS(msgs->at(i));
+	}
+}
+
+void nodesDataFromROS(const std::vector<rtabmap_msgs::NodeData> & msgs, std::map<int, rtabmap::Signature> & signatures, int threads, ThreadPool * pool)
+{
+	std::vector<rtabmap::Signature> signaturesVector(msgs.size());
+
+	if(pool)
+	{
+		pool->parallelFor((int)msgs.size(), boost::bind(&nodesDataFromROSThread, &msgs, &signaturesVector, boost::placeholders::_1, boost::placeholders::_2));
+	}
+	else
+	{
+		if(threads <= 0)
+		{
+			threads = (int)boost::thread::hardware_concurrency();
+		}
+		threads = std::max(1, std::min(threads, (int)msgs.size()));
+		boost::thread_group workers;
+		for(int i=1; i<threads; ++i)
+		{
+			workers.create_thread(boost::bind(&nodesDataFromROSThread, &msgs, &signaturesVector, i, threads));
+		}
+		nodesDataFromROSThread(&msgs, &signaturesVector, 0, threads);
+		workers.join_all();
+	}
+
+	for(size_t i=0; i<signaturesVector.size(); ++i)
+	{
+		signatures.insert(std::make_pair(msgs[i].id, signaturesVector[i]));
+	}
+}
+
 rtabmap::Signature nodeInfoFromROS(const rtabmap_msgs::NodeData & msg)
 {
 	rtabmap::Signature s(
@@ -1508,14 +2019,35 @@ rtabmap::OdometryInfo odomInfoFromROS(const rtabmap_msgs::OdomInfo & msg, bool i
 
 	if(!ignoreData)
 	{
-		UASSERT(msg.wordsKeys.size() == msg.wordsValues.size());
-		for(unsigned int i=0; i<msg.wordsKeys.size(); ++i)
+		if(!msg.wordsValuesPacked.empty())
+		{
+			std::vector<cv::KeyPoint> kpts;
+			keypointsFromROSPacked(msg.wordsValuesPacked, kpts);
+			UASSERT(msg.wordsKeys.size() == kpts.size());
+			for(unsigned int i=0; i<msg.wordsKeys.size(); ++i)
+			{
+				info.words.insert(info.words.end(), std::make_pair(msg.wordsKeys[i], kpts[i]));
+			}
+		}
+		else
 		{
-			info.words.insert(std::make_pair(msg.wordsKeys[i], keypointFromROS(msg.wordsValues[i])));
+			UASSERT(msg.wordsKeys.size() == msg.wordsValues.size());
+			for(unsigned int i=0; i<msg.wordsKeys.size(); ++i)
+			{
+				info.words.insert(std::make_pair(msg.wordsKeys[i], keypointFromROS(msg.wordsValues[i])));
+			}
 		}
 
-		info.refCorners = points2fFromROS(msg.refCorners);
-		info.newCorners = points2fFromROS(msg.newCorners);
+		if(!msg.refCornersPacked.empty() || !msg.newCornersPacked.empty())
+		{
+			points2fFromROSPacked(msg.refCornersPacked, info.refCorners);
+			points2fFromROSPacked(msg.newCornersPacked, info.newCorners);
+		}
+		else
+		{
+			info.refCorners = points2fFromROS(msg.refCorners);
+			info.newCorners = points2fFromROS(msg.newCorners);
+		}
 		info.cornerInliers = msg.cornerInliers;
 
 		info.transform = transformFromGeometryMsg(msg.transform);
@@ -1523,10 +2055,23 @@ rtabmap::OdometryInfo odomInfoFromROS(const rtabmap_msgs::OdomInfo & msg, bool i
 		info.transformGroundTruth = transformFromGeometryMsg(msg.transformGroundTruth);
 		info.guess = transformFromGeometryMsg(msg.guess);
 
-		UASSERT(msg.localMapKeys.size() == msg.localMapValues.size());
-		for(unsigned int i=0; i<msg.localMapKeys.size(); ++i)
+		if(!msg.localMapValuesPacked.empty())
+		{
+			std::vector<cv::Point3f> pts;
+			points3fFromROSPacked(msg.localMapValuesPacked, pts);
+			UASSERT(msg.localMapKeys.size() == pts.size());
+			for(unsigned int i=0; i<msg.localMapKeys.size(); ++i)
+			{
+				info.localMap.insert(info.localMap.end(), std::make_pair(msg.localMapKeys[i], pts[i]));
+			}
+		}
+		else
 		{
-			info.localMap.insert(std::make_pair(msg.localMapKeys[i], point3fFromROS(msg.localMapValues[i])));
+			UASSERT(msg.localMapKeys.size() == msg.localMapValues.size());
+			for(unsigned int i=0; i<msg.localMapKeys.size(); ++i)
+			{
+				info.localMap.insert(std::make_pair(msg.localMapKeys[i], point3fFromROS(msg.localMapValues[i])));
+			}
 		}
 
 		pcl::PCLPointCloud2 cloud;
@@ -1536,7 +2081,7 @@ rtabmap::OdometryInfo odomInfoFromROS(const rtabmap_msgs::OdomInfo & msg, bool i
 	return info;
 }
 
-void odomInfoToROS(const rtabmap::OdometryInfo & info, rtabmap_msgs::OdomInfo & msg, bool ignoreData)
+void odomInfoToROS(const rtabmap::OdometryInfo & info, rtabmap_msgs::OdomInfo & msg, bool ignoreData, bool packed)
 {
 	msg.lost = info.lost;
 	msg.matches = info.reg.matches;
@@ -1600,21 +2145,43 @@ void odomInfoToROS(const rtabmap::OdometryInfo & info, rtabmap_msgs::OdomInfo &
 	if(!ignoreData)
 	{
 		msg.wordsKeys = uKeys(info.words);
-		keypointsToROS(uValues(info.words), msg.wordsValues);
+		if(packed)
+		{
+			keypointsToROSPacked(uValues(info.words), msg.wordsValuesPacked);
+		}
+		else
+		{
+			keypointsToROS(uValues(info.words), msg.wordsValues);
+		}
 
 		msg.wordMatches = info.reg.matchesIDs;
 		msg.wordInliers = info.reg.inliersIDs;
 
-		points2fToROS(info.refCorners, msg.refCorners);
-		points2fToROS(info.newCorners, msg.newCorners);
+		if(packed)
+		{
+			points2fToROSPacked(info.refCorners, msg.refCornersPacked);
+			points2fToROSPacked(info.newCorners, msg.newCornersPacked);
+		}
+		else
+		{
+			points2fToROS(info.refCorners, msg.refCorners);
+			points2fToROS(info.newCorners, msg.newCorners);
+		}
 		msg.cornerInliers = info.cornerInliers;
 
 		msg.localMapKeys = uKeys(info.localMap);
-		points3fToROS(uValues(info.localMap), msg.localMapValues);
-
-		pcl_conversions::moveFromPCL(*rtabmap::util3d::laserScanToPointCloud2(info.localScanMap, info.localScanMap.localTransform()), msg.localScanMap);
-	}
-}
+		if(packed)
+		{
+			points3fToROSPacked(uValues(info.localMap), msg.localMapValuesPacked);
+		}
+		else
+		{
+			points3fToROS(uValues(info.localMap), msg.localMapValues);
+		}
+
+		pcl_conversions::moveFromPCL(*rtabmap::util3d::laserScanToPointCloud2(info.localScanMap, info.localScanMap.localTransform()), msg.localScanMap);
+	}
+}
 
 cv::Mat userDataFromROS(const rtabmap_msgs::UserData & dataMsg)
 {
@@ -1674,6 +2241,8 @@ rtabmap::Landmarks landmarksFromROS(
 {
 	//tag detections
 	rtabmap::Landmarks landmarks;
+	// Detections of the same message share frame and stamp, look up TF only once per group
+	std::map<std::pair<std::string, ros::Time>, std::pair<rtabmap::Transform, rtabmap::Transform> > transforms; // <baseToCamera, correction>
 	for(std::map<int, std::pair<geometry_msgs::PoseWithCovarianceStamped, float> >::const_iterator iter=tags.begin(); iter!=tags.end(); ++iter)
 	{
 		if(iter->first <=0)
@@ -1681,17 +2250,41 @@ rtabmap::Landmarks landmarksFromROS(
 			ROS_ERROR("Invalid landmark received! IDs should be > 0 (it is %d). Ignoring this landmark.", iter->first);
 			continue;
 		}
-		rtabmap::Transform baseToCamera = rtabmap_conversions::getTransform(
-				frameId,
-				iter->second.first.header.frame_id,
-				iter->second.first.header.stamp,
-				listener,
-				waitForTransform);
+		std::pair<std::string, ros::Time> key(iter->second.first.header.frame_id, iter->second.first.header.stamp);
+		std::map<std::pair<std::string, ros::Time>, std::pair<rtabmap::Transform, rtabmap::Transform> >::iterator jter = transforms.find(key);
+		bool cached = jter != transforms.end();
+		if(!cached)
+		{
+			rtabmap::Transform baseToCamera = rtabmap_conversions::getTransform(
+					frameId,
+					key.first,
+					key.second,
+					listener,
+					waitForTransform);
+			rtabmap::Transform correction;
+			if(!baseToCamera.isNull())
+			{
+				// Correction of the global pose accounting the odometry movement since we received it
+				correction = rtabmap_conversions::getTransform(
+						frameId,
+						odomFrameId,
+						key.second,
+						odomStamp,
+						listener,
+						waitForTransform);
+			}
+			jter = transforms.insert(std::make_pair(key, std::make_pair(baseToCamera, correction))).first;
+		}
+		const rtabmap::Transform & baseToCamera = jter->second.first;
+		const rtabmap::Transform & correction = jter->second.second;
 
 		if(baseToCamera.isNull())
 		{
-			ROS_ERROR("Cannot transform tag pose from \"%s\" frame to \"%s\" frame!",
-					iter->second.first.header.frame_id.c_str(), frameId.c_str());
+			if(!cached)
+			{
+				ROS_ERROR("Cannot transform tag pose from \"%s\" frame to \"%s\" frame!",
+						key.first.c_str(), frameId.c_str());
+			}
 			continue;
 		}
 
@@ -1699,19 +2292,11 @@ rtabmap::Landmarks landmarksFromROS(
 
 		if(!baseToTag.isNull())
 		{
-			// Correction of the global pose accounting the odometry movement since we received it
-			rtabmap::Transform correction = rtabmap_conversions::getTransform(
-					frameId,
-					odomFrameId,
-					iter->second.first.header.stamp,
-					odomStamp,
-					listener,
-					waitForTransform);
 			if(!correction.isNull())
 			{
 				baseToTag = correction * baseToTag;
 			}
-			else
+			else if(!cached)
 			{
 				ROS_WARN("Could not adjust tag pose accordingly to latest odometry pose. "
 						"If odometry is small since it received the tag pose and "
@@ -1730,6 +2315,103 @@ rtabmap::Landmarks landmarksFromROS(
 	return landmarks;
 }
 
+typedef std::pair<const tf::TransformListener*, std::pair<std::string, std::string> > TransformCacheKey;
+static boost::mutex g_transformCacheMutex;
+static bool g_transformCacheEnabled = false;
+static size_t g_transformCacheMaxStamped = 100;
+static std::map<TransformCacheKey, rtabmap::Transform> g_staticTransforms;
+static std::map<std::pair<TransformCacheKey, ros::Time>, rtabmap::Transform> g_stampedTransforms;
+static std::list<std::pair<TransformCacheKey, ros::Time> > g_stampedTransformsOrder; // oldest first
+static unsigned long g_transformCacheHits = 0;
+static unsigned long g_transformCacheMisses = 0;
+
+void setTransformCacheEnabled(bool enabled, int maxStampedTransforms)
+{
+	boost::mutex::scoped_lock lock(g_transformCacheMutex);
+	g_transformCacheEnabled = enabled;
+	g_transformCacheMaxStamped = maxStampedTransforms>0?maxStampedTransforms:0;
+	g_staticTransforms.clear();
+	g_stampedTransforms.clear();
+	g_stampedTransformsOrder.clear();
+}
+
+bool isTransformCacheEnabled()
+{
+	boost::mutex::scoped_lock lock(g_transformCacheMutex);
+	return g_transformCacheEnabled;
+}
+
+void clearTransformCache()
+{
+	boost::mutex::scoped_lock lock(g_transformCacheMutex);
+	g_staticTransforms.clear();
+	g_stampedTransforms.clear();
+	g_stampedTransformsOrder.clear();
+	g_transformCacheHits = 0;
+	g_transformCacheMisses = 0;
+}
+
+void getTransformCacheStatistics(unsigned long & hits, unsigned long & misses)
+{
+	boost::mutex::scoped_lock lock(g_transformCacheMutex);
+	hits = g_transformCacheHits;
+	misses = g_transformCacheMisses;
+}
+
+static bool getCachedTransform(const TransformCacheKey & key, const ros::Time & stamp, rtabmap::Transform & transform)
+{
+	boost::mutex::scoped_lock lock(g_transformCacheMutex);
+	if(!g_transformCacheEnabled)
+	{
+		return false;
+	}
+	std::map<TransformCacheKey, rtabmap::Transform>::iterator iter = g_staticTransforms.find(key);
+	if(iter != g_staticTransforms.end())
+	{
+		transform = iter->second;
+		++g_transformCacheHits;
+		return true;
+	}
+	if(!stamp.isZero())
+	{
+		std::map<std::pair<TransformCacheKey, ros::Time>, rtabmap::Transform>::iterator jter = g_stampedTransforms.find(std::make_pair(key, stamp));
+		if(jter != g_stampedTransforms.end())
+		{
+			transform = jter->second;
+			++g_transformCacheHits;
+			return true;
+		}
+	}
+	++g_transformCacheMisses;
+	return false;
+}
+
+static void addCachedTransform(const TransformCacheKey & key, const ros::Time & stamp, const rtabmap::Transform & transform)
+{
+	// Latest common time is 0 if all links between the frames are static
+	ros::Time latest;
+	bool isStatic = key.first->getLatestCommonTime(key.second.first, key.second.second, latest, 0) == tf::NO_ERROR && latest.isZero();
+
+	boost::mutex::scoped_lock lock(g_transformCacheMutex);
+	if(isStatic)
+	{
+		g_staticTransforms[key] = transform;
+	}
+	else if(!stamp.isZero() && g_transformCacheMaxStamped > 0)
+	{
+		std::pair<TransformCacheKey, ros::Time> stampedKey(key, stamp);
+		if(g_stampedTransforms.insert(std::make_pair(stampedKey, transform)).second)
+		{
+			g_stampedTransformsOrder.push_back(stampedKey);
+			while(g_stampedTransformsOrder.size() > g_transformCacheMaxStamped)
+			{
+				g_stampedTransforms.erase(g_stampedTransformsOrder.front());
+				g_stampedTransformsOrder.pop_front();
+			}
+		}
+	}
+}
+
 rtabmap::Transform getTransform(
 		const std::string & fromFrameId,
 		const std::string & toFrameId,
@@ -1739,6 +2421,11 @@ rtabmap::Transform getTransform(
 {
 	// TF ready?
 	rtabmap::Transform transform;
+	TransformCacheKey cacheKey(&listener, std::make_pair(fromFrameId, toFrameId));
+	if(getCachedTransform(cacheKey, stamp, transform))
+	{
+		return transform;
+	}
 	try
 	{
 		if(waitForTransform > 0.0 && !stamp.isZero())
@@ -1756,6 +2443,10 @@ rtabmap::Transform getTransform(
 		tf::StampedTransform tmp;
 		listener.lookupTransform(fromFrameId, toFrameId, stamp, tmp);
 		transform = rtabmap_conversions::transformFromTF(tmp);
+		if(isTransformCacheEnabled())
+		{
+			addCachedTransform(cacheKey, stamp, transform);
+		}
 	}
 	catch(tf::TransformException & ex)
 	{
@@ -1801,6 +2492,123 @@ rtabmap::Transform getTransform(
 	return transform;
 }
 
+static int convertedImageType(const cv_bridge::CvImageConstPtr & image)
+{
+	// type of the image after conversion in convertRGBDMsgsThread()
+	if(image->encoding.compare(sensor_msgs::image_encodings::BGR8) == 0)
+	{
+		return image->image.type();
+	}
+	if(image->encoding.compare(sensor_msgs::image_encodings::TYPE_8UC1)==0 ||
+	   image->encoding.compare(sensor_msgs::image_encodings::MONO8) == 0 ||
+	   image->encoding.compare(sensor_msgs::image_encodings::MONO16) == 0)
+	{
+		return CV_8UC1;
+	}
+	return CV_8UC3;
+}
+
+static int convertedRightImageType(const cv_bridge::CvImageConstPtr & image)
+{
+	if(image->encoding.compare(sensor_msgs::image_encodings::TYPE_8UC1)==0 ||
+	   image->encoding.compare(sensor_msgs::image_encodings::MONO8) == 0)
+	{
+		return image->image.type();
+	}
+	return CV_8UC1;
+}
+
+struct RGBDConversionJob
+{
+	const std::vector<cv_bridge::CvImageConstPtr> * imageMsgs;
+	const std::vector<cv_bridge::CvImageConstPtr> * depthMsgs;
+	const std::vector<sensor_msgs::CameraInfo> * cameraInfoMsgs;
+	const std::string * frameId;
+	const std::string * odomFrameId;
+	ros::Time odomStamp;
+	tf::TransformListener * listener;
+	double waitForTransform;
+	bool isDepth;
+	cv::Mat * rgb;
+	cv::Mat * depth;
+	std::vector<ros::Time> stamps;
+	std::vector<rtabmap::Transform> localTransforms; // output
+};
+
+static void convertRGBDMsgsThread(RGBDConversionJob * job, int offset, int step)
+{
+	// Each worker handles every step-th camera, writing directly in its slice of the concatenated images
+	for(size_t i=offset; i<job->cameraInfoMsgs->size(); i+=step)
+	{
+		const ros::Time & stamp = job->stamps[i];
+
+		// use depth's stamp so that geometry is sync to odom, use rgb frame as we assume depth is registered (normally depth msg should have same frame than rgb)
+		rtabmap::Transform localTransform = rtabmap_conversions::getTransform(*job->frameId, !job->imageMsgs->empty()?job->imageMsgs->at(i)->header.frame_id:job->cameraInfoMsgs->at(i).header.frame_id, stamp, *job->listener, job->waitForTransform);
+		if(localTransform.isNull())
+		{
+			continue;
+		}
+		// sync with odometry stamp
+		if(!job->odomFrameId->empty() && job->odomStamp != stamp)
+		{
+			rtabmap::Transform sensorT = getTransform(
+					*job->frameId,
+					*job->odomFrameId,
+					job->odomStamp,
+					stamp,
+					*job->listener,
+					job->waitForTransform);
+			if(sensorT.isNull())
+			{
+				ROS_WARN("Could not get odometry value for image stamp (%fs). Latest odometry "
+						"stamp is %fs. The image pose will not be synchronized with odometry.", stamp.toSec(), job->odomStamp.toSec());
+			}
+			else
+			{
+				//ROS_WARN("RGBD correction = %s (time diff=%fs)", sensorT.prettyPrint().c_str(), fabs(stamp.toSec()-odomStamp.toSec()));
+				localTransform = sensorT * localTransform;
+			}
+		}
+		job->localTransforms[i] = localTransform;
+
+		if(!job->imageMsgs->empty())
+		{
+			const cv_bridge::CvImageConstPtr & imageMsg = job->imageMsgs->at(i);
+			cv_bridge::CvImageConstPtr ptrImage = imageMsg;
+			if(imageMsg->encoding.compare(sensor_msgs::image_encodings::TYPE_8UC1)==0 ||
+			   imageMsg->encoding.compare(sensor_msgs::image_encodings::MONO8) == 0 ||
+			   imageMsg->encoding.compare(sensor_msgs::image_encodings::BGR8) == 0)
+			{
+				// do nothing
+			}
+			else if(imageMsg->encoding.compare(sensor_msgs::image_encodings::MONO16) == 0)
+			{
+				ptrImage = cv_bridge::cvtColor(imageMsg, "mono8");
+			}
+			else
+			{
+				ptrImage = cv_bridge::cvtColor(imageMsg, "bgr8");
+			}
+			int width = ptrImage->image.cols;
+			ptrImage->image.copyTo(cv::Mat(*job->rgb, cv::Rect(i*width, 0, width, ptrImage->image.rows)));
+		}
+
+		if(!job->depthMsgs->empty())
+		{
+			const cv_bridge::CvImageConstPtr & depthMsg = job->depthMsgs->at(i);
+			cv_bridge::CvImageConstPtr ptrImage = depthMsg;
+			if(!job->isDepth &&
+			   depthMsg->encoding.compare(sensor_msgs::image_encodings::TYPE_8UC1)!=0 &&
+			   depthMsg->encoding.compare(sensor_msgs::image_encodings::MONO8) != 0)
+			{
+				ptrImage = cv_bridge::cvtColor(depthMsg, "mono8");
+			}
+			int width = ptrImage->image.cols;
+			ptrImage->image.copyTo(cv::Mat(*job->depth, cv::Rect(i*width, 0, width, ptrImage->image.rows)));
+		}
+	}
+}
+
 bool convertRGBDMsgs(
 		const std::vector<cv_bridge::CvImageConstPtr> & imageMsgs,
 		const std::vector<cv_bridge::CvImageConstPtr> & depthMsgs,
@@ -1865,6 +2673,20 @@ bool convertRGBDMsgs(
 	}
 
 	int cameraCount = cameraInfoMsgs.size();
+	RGBDConversionJob job;
+	job.imageMsgs = &imageMsgs;
+	job.depthMsgs = &depthMsgs;
+	job.cameraInfoMsgs = &cameraInfoMsgs;
+	job.frameId = &frameId;
+	job.odomFrameId = &odomFrameId;
+	job.odomStamp = odomStamp;
+	job.listener = &listener;
+	job.waitForTransform = waitForTransform;
+	job.isDepth = isDepth;
+	job.rgb = &rgb;
+	job.depth = &depth;
+	job.stamps.resize(cameraCount);
+	job.localTransforms.resize(cameraCount);
 	for(unsigned int i=0; i<cameraInfoMsgs.size(); ++i)
 	{
 		if(!imageMsgs.empty())
@@ -1918,7 +2740,6 @@ bool convertRGBDMsgs(
 		}
 
 
-		ros::Time stamp;
 		if(isDepth && !depthMsgs.empty())
 		{
 			UASSERT_MSG(depthMsgs[i]->image.cols == depthWidth && depthMsgs[i]->image.rows == depthHeight,
@@ -1927,131 +2748,64 @@ bool convertRGBDMsgs(
 							depthMsgs[i]->image.cols,
 							depthHeight,
 							depthMsgs[i]->image.rows).c_str());
-			stamp = depthMsgs[i]->header.stamp;
+			job.stamps[i] = depthMsgs[i]->header.stamp;
 		}
 		else if(!imageMsgs.empty())
 		{
-			stamp = imageMsgs[i]->header.stamp;
+			job.stamps[i] = imageMsgs[i]->header.stamp;
 		}
 		else
 		{
-			stamp = cameraInfoMsgs[i].header.stamp;
-		}
-
-		// use depth's stamp so that geometry is sync to odom, use rgb frame as we assume depth is registered (normally depth msg should have same frame than rgb)
-		rtabmap::Transform localTransform = rtabmap_conversions::getTransform(frameId, !imageMsgs.empty()?imageMsgs[i]->header.frame_id:cameraInfoMsgs[i].header.frame_id, stamp, listener, waitForTransform);
-		if(localTransform.isNull())
-		{
-			ROS_ERROR("TF of received image %d at time %fs is not set!", i, stamp.toSec());
-			return false;
-		}
-		// sync with odometry stamp
-		if(!odomFrameId.empty() && odomStamp != stamp)
-		{
-			rtabmap::Transform sensorT = getTransform(
-					frameId,
-					odomFrameId,
-					odomStamp,
-					stamp,
-					listener,
-					waitForTransform);
-			if(sensorT.isNull())
-			{
-				ROS_WARN("Could not get odometry value for image stamp (%fs). Latest odometry "
-						"stamp is %fs. The image pose will not be synchronized with odometry.", stamp.toSec(), odomStamp.toSec());
-			}
-			else
-			{
-				//ROS_WARN("RGBD correction = %s (time diff=%fs)", sensorT.prettyPrint().c_str(), fabs(stamp.toSec()-odomStamp.toSec()));
-				localTransform = sensorT * localTransform;
-			}
+			job.stamps[i] = cameraInfoMsgs[i].header.stamp;
 		}
 
+		// initialize the concatenated images, so that each camera can be converted in its own slice
 		if(!imageMsgs.empty())
 		{
-			cv_bridge::CvImageConstPtr ptrImage = imageMsgs[i];
-			if(imageMsgs[i]->encoding.compare(sensor_msgs::image_encodings::TYPE_8UC1)==0 ||
-			   imageMsgs[i]->encoding.compare(sensor_msgs::image_encodings::MONO8) == 0 ||
-			   imageMsgs[i]->encoding.compare(sensor_msgs::image_encodings::BGR8) == 0)
-			{
-				// do nothing
-			}
-			else if(imageMsgs[i]->encoding.compare(sensor_msgs::image_encodings::MONO16) == 0)
-			{
-				ptrImage = cv_bridge::cvtColor(imageMsgs[i], "mono8");
-			}
-			else
-			{
-				ptrImage = cv_bridge::cvtColor(imageMsgs[i], "bgr8");
-			}
-
-			// initialize
+			int type = convertedImageType(imageMsgs[i]);
 			if(rgb.empty())
 			{
-				rgb = cv::Mat(imageHeight, imageWidth*cameraCount, ptrImage->image.type());
+				rgb = cv::Mat(imageHeight, imageWidth*cameraCount, type);
 			}
-			if(ptrImage->image.type() == rgb.type())
-			{
-				ptrImage->image.copyTo(cv::Mat(rgb, cv::Rect(i*imageWidth, 0, imageWidth, imageHeight)));
-			}
-			else
+			if(type != rgb.type())
 			{
 				ROS_ERROR("Some RGB/left images are not the same type!");
 				return false;
 			}
 		}
-
 		if(!depthMsgs.empty())
 		{
-			if(isDepth)
+			int type = isDepth?depthMsgs[i]->image.type():convertedRightImageType(depthMsgs[i]);
+			if(depth.empty())
 			{
-				cv_bridge::CvImageConstPtr ptrDepth = depthMsgs[i];
-				cv::Mat subDepth = ptrDepth->image;
-
-				if(depth.empty())
-				{
-					depth = cv::Mat(depthHeight, depthWidth*cameraCount, subDepth.type());
-				}
-
-				if(subDepth.type() == depth.type())
-				{
-					subDepth.copyTo(cv::Mat(depth, cv::Rect(i*depthWidth, 0, depthWidth, depthHeight)));
-				}
-				else
-				{
-					ROS_ERROR("Some Depth images are not the same type!");
-					return false;
-				}
+				depth = cv::Mat(depthHeight, depthWidth*cameraCount, type);
 			}
-			else
+			if(type != depth.type())
 			{
-				cv_bridge::CvImageConstPtr ptrImage = depthMsgs[i];
-				if( depthMsgs[i]->encoding.compare(sensor_msgs::image_encodings::TYPE_8UC1)==0 ||
-					depthMsgs[i]->encoding.compare(sensor_msgs::image_encodings::MONO8) == 0)
-				{
-					// do nothing
-				}
-				else
-				{
-					ptrImage = cv_bridge::cvtColor(depthMsgs[i], "mono8");
-				}
-
-				// initialize
-				if(depth.empty())
-				{
-					depth = cv::Mat(depthHeight, depthWidth*cameraCount, ptrImage->image.type());
-				}
-				if(ptrImage->image.type() == depth.type())
-				{
-					ptrImage->image.copyTo(cv::Mat(depth, cv::Rect(i*depthWidth, 0, depthWidth, depthHeight)));
-				}
-				else
-				{
-					ROS_ERROR("Some right images are not the same type!");
-					return false;
-				}
+				ROS_ERROR(isDepth?"Some Depth images are not the same type!":"Some right images are not the same type!");
+				return false;
 			}
 		}
+	}
+
+	// TF lookups, color conversions and copies of each camera in parallel
+	int threads = std::max(1, std::min(cameraCount, (int)boost::thread::hardware_concurrency()));
+	boost::thread_group workers;
+	for(int i=1; i<threads; ++i)
+	{
+		workers.create_thread(boost::bind(&convertRGBDMsgsThread, &job, i, threads));
+	}
+	convertRGBDMsgsThread(&job, 0, threads);
+	workers.join_all();
+
+	for(unsigned int i=0; i<cameraInfoMsgs.size(); ++i)
+	{
+		const rtabmap::Transform & localTransform = job.localTransforms[i];
+		if(localTransform.isNull())
+		{
+			ROS_ERROR("TF of received image %d at time %fs is not set!", i, job.stamps[i].toSec());
+			return false;
+		}
 
 		if(isDepth)
 		{
@@ -2359,7 +3113,8 @@ bool convertScanMsg(
 		rtabmap::LaserScan & scan,
 		tf::TransformListener & listener,
 		double waitForTransform,
-		bool outputInFrameId)
+		bool outputInFrameId,
+		float quantization)
 {
 	// make sure the frame of the laser is updated during the whole scan time
 	rtabmap::Transform tmpT = getTransform(
@@ -2488,6 +3243,10 @@ bool convertScanMsg(
 			scan2dMsg.angle_max,
 			scan2dMsg.angle_increment,
 			outputInFrameId?rtabmap::Transform::getIdentity():scanLocalTransform);
+	if(quantization > 0.0f)
+	{
+		quantizeScan(scan, quantization);
+	}
 
 	return true;
 }
@@ -2502,7 +3261,8 @@ bool convertScan3dMsg(
 		double waitForTransform,
 		int maxPoints,
 		float maxRange,
-		bool is2D)
+		bool is2D,
+		float quantization)
 {
 	UASSERT_MSG(scan3dMsg.data.size() == scan3dMsg.row_step*scan3dMsg.height,
 			uFormat("data=%d row_step=%d height=%d", scan3dMsg.data.size(), scan3dMsg.row_step, scan3dMsg.height).c_str());
@@ -2536,9 +3296,37 @@ bool convertScan3dMsg(
 	}
 	scan = rtabmap::util3d::laserScanFromPointCloud(scan3dMsg, true, is2D);
 	scan = rtabmap::LaserScan(scan, maxPoints, maxRange, scanLocalTransform);
+	if(quantization > 0.0f)
+	{
+		quantizeScan(scan, quantization);
+	}
 	return true;
 }
 
+void quantizeScan(rtabmap::LaserScan & scan, float quantization)
+{
+	if(scan.isEmpty() || quantization <= 0.0f || scan.data().depth() != CV_32F)
+	{
+		return;
+	}
+	// Power of two step, so that rounded values are exact in float
+	float step = (float)pow(2.0, std::floor(log2(quantization) + 0.5));
+	int coordinates = scan.is2d()?2:3;
+	cv::Mat data = scan.data(); // shared, modified in place
+	for(int i=0; i<data.rows; ++i)
+	{
+		float * row = data.ptr<float>(i);
+		for(int j=0; j<data.cols; ++j)
+		{
+			float * pt = row + j*data.channels();
+			for(int k=0; k<coordinates; ++k)
+			{
+				pt[k] = std::floor(pt[k]/step + 0.5f)*step;
+			}
+		}
+	}
+}
+
 bool deskew_impl(
 		const sensor_msgs::PointCloud2 & input,
 		sensor_msgs::PointCloud2 & output,
@@ -2783,150 +3571,97 @@ bool deskew_impl(
 					input.header.stamp.toSec());
 			return false;
 		}
-		scanTime = lastStamp.toSec() - firstStamp.toSec();
 	}
 	//else tf will be used to get more accurate transforms
+	scanTime = lastStamp.toSec() - firstStamp.toSec();
 
-	output = input;
-	ros::Time stamp;
 	UTimer processingTime;
-	if(timeOnColumns)
+
+	// Pose lookup table over the scan duration: the transforms (slerp or tf)
+	// are computed once per time bin instead of once per column/point, which
+	// matters for unorganized clouds where each column is a single point.
+	size_t timeUnits = timeOnColumns?input.width:input.height;
+	size_t bins = std::max((size_t)2, std::min(timeUnits, (size_t)1024));
+	std::vector<float> lut(bins*12);
+	for(size_t i=0; i<bins; ++i)
 	{
-		// ouster point cloud:
-		// t1     t2    ...
-		// ring1  ring1 ...
-		// ring2  ring2 ...
-		// ring3  ring4 ...
-		// ring4  ring3 ...
-		for(size_t u=0; u<output.width; ++u)
+		double ratio = double(i)/double(bins-1);
+		rtabmap::Transform transform;
+		if(slerp)
 		{
-			if(timeDatatype == 6) // UINT32
-			{
-				unsigned int nsec = *((const unsigned int*)(&output.data[u*output.point_step]+offsetTime));
-				stamp = input.header.stamp+ros::Duration(0, nsec);
-			}
-			else
-			{
-				float sec = *((const float*)(&output.data[u*output.point_step]+offsetTime));
-				stamp = input.header.stamp+ros::Duration().fromSec(sec);
-			}
-
-			rtabmap::Transform transform;
-			if(slerp)
-			{
-				transform = firstPose.interpolate((stamp-firstStamp).toSec() / scanTime, lastPose);
-			}
-			else
-			{
-				transform = rtabmap_conversions::getTransform(
-						output.header.frame_id,
-						fixedFrameId,
-						stamp,
-						output.header.stamp,
-						*listener,
-						0);
-				if(transform.isNull())
-				{
-					ROS_ERROR("Could not get transform of %s accordingly to %s between stamps %f and %f!",
-							output.header.frame_id.c_str(),
-							fixedFrameId.c_str(),
-							stamp.toSec(),
-							output.header.stamp.toSec());
-					return false;
-				}
-			}
-
-			for(size_t v=0; v<input.height; ++v)
+			transform = firstPose.interpolate(ratio, lastPose);
+		}
+		else
+		{
+			ros::Time stamp = firstStamp + ros::Duration().fromSec(scanTime*ratio);
+			transform = rtabmap_conversions::getTransform(
+					input.header.frame_id,
+					fixedFrameId,
+					stamp,
+					input.header.stamp,
+					*listener,
+					0);
+			if(transform.isNull())
 			{
-				unsigned char * dataPtr = &output.data[v*output.row_step + u*output.point_step];
-				float & x = *((float*)(dataPtr+offsetX));
-				float & y = *((float*)(dataPtr+offsetY));
-				float & z = *((float*)(dataPtr+offsetZ));
-				pcl::PointXYZ pt(x,y,z);
-				pt = rtabmap::util3d::transformPoint(pt, transform);
-				x = pt.x;
-				y = pt.y;
-				z = pt.z;
-
-				// set delta stamp to zero so that on downstream they know the cloud is deskewed
-				if(timeDatatype == 6) // UINT32
-				{
-					*((unsigned int*)(dataPtr+offsetTime)) = 0;
-				}
-				else
-				{
-					*((float*)(dataPtr+offsetTime)) = 0;
-				}
+				ROS_ERROR("Could not get transform of %s accordingly to %s between stamps %f and %f!",
+						input.header.frame_id.c_str(),
+						fixedFrameId.c_str(),
+						stamp.toSec(),
+						input.header.stamp.toSec());
+				return false;
 			}
 		}
+		memcpy(&lut[i*12], transform.data(), 12*sizeof(float));
 	}
-	else // time on rows
-	{
-		// velodyne point cloud:
-		// t1     ring1 ring2 ring3 ring4
-		// t2     ring1 ring2 ring3 ring4
-		// t3     ring1 ring2 ring3 ring4
-		// t4     ring1 ring2 ring3 ring4
-		// ...    ...   ...   ...   ...
-		for(size_t v=0; v<output.height; ++v)
+
+	output = input;
+	double firstOffset = (firstStamp - input.header.stamp).toSec();
+	// ouster point cloud (time on columns):
+	// t1     t2    ...
+	// ring1  ring1 ...
+	// ring2  ring2 ...
+	// ...    ...
+	// velodyne point cloud (time on rows):
+	// t1     ring1 ring2 ring3 ring4
+	// t2     ring1 ring2 ring3 ring4
+	// ...    ...   ...   ...   ...
+	size_t unitStep = timeOnColumns?output.point_step:output.row_step;
+	size_t pointStep = timeOnColumns?output.row_step:output.point_step;
+	size_t pointsPerUnit = timeOnColumns?output.height:output.width;
+	for(size_t t=0; t<timeUnits; ++t)
+	{
+		unsigned char * unitPtr = &output.data[t*unitStep];
+		double offset;
+		if(timeDatatype == 6) // UINT32
+		{
+			offset = double(*((const unsigned int*)(unitPtr+offsetTime)))*1e-9;
+		}
+		else
 		{
-			if(timeDatatype == 6) // UINT32
-			{
-				unsigned int nsec = *((const unsigned int*)(&output.data[v*output.row_step]+offsetTime));
-				stamp = input.header.stamp+ros::Duration(0, nsec);
-			}
-			else
-			{
-				float sec = *((const float*)(&output.data[v*output.row_step]+offsetTime));
-				stamp = input.header.stamp+ros::Duration().fromSec(sec);
-			}
+			offset = *((const float*)(unitPtr+offsetTime));
+		}
+		int bin = int((offset-firstOffset)/scanTime*double(bins-1) + 0.5);
+		const float * m = &lut[std::max(0, std::min(int(bins)-1, bin))*12];
+
+		for(size_t p=0; p<pointsPerUnit; ++p)
+		{
+			unsigned char * dataPtr = unitPtr + p*pointStep;
+			float * x = (float*)(dataPtr+offsetX);
+			float * y = (float*)(dataPtr+offsetY);
+			float * z = (float*)(dataPtr+offsetZ);
+			float px = *x, py = *y, pz = *z;
+			*x = m[0]*px + m[1]*py + m[2]*pz + m[3];
+			*y = m[4]*px + m[5]*py + m[6]*pz + m[7];
+			*z = m[8]*px + m[9]*py + m[10]*pz + m[11];
 
-			rtabmap::Transform transform;
-			if(slerp)
+			// set delta stamp to zero so that on downstream they know the cloud is deskewed
+			if(timeDatatype == 6) // UINT32
 			{
-				transform = firstPose.interpolate((stamp-firstStamp).toSec() / scanTime, lastPose);
+				*((unsigned int*)(dataPtr+offsetTime)) = 0;
 			}
 			else
 			{
-				transform = rtabmap_conversions::getTransform(
-						output.header.frame_id,
-						fixedFrameId,
-						stamp,
-						output.header.stamp,
-						*listener,
-						0);
-				if(transform.isNull())
-				{
-					ROS_ERROR("Could not get transform of %s accordingly to %s between stamps %f and %f!",
-							output.header.frame_id.c_str(),
-							fixedFrameId.c_str(),
-							stamp.toSec(),
-							output.header.stamp.toSec());
-					return false;
-				}
-			}
-
-			for(size_t u=0; u<input.width; ++u)
-			{
-				unsigned char * dataPtr = &output.data[v*output.row_step + u*output.point_step];
-				float & x = *((float*)(dataPtr+offsetX));
-				float & y = *((float*)(dataPtr+offsetY));
-				float & z = *((float*)(dataPtr+offsetZ));
-				pcl::PointXYZ pt(x,y,z);
-				pt = rtabmap::util3d::transformPoint(pt, transform);
-				x = pt.x;
-				y = pt.y;
-				z = pt.z;
-
-				// set delta stamp to zero so that on downstream they know the cloud is deskewed
-				if(timeDatatype == 6) // UINT32
-				{
-					*((unsigned int*)(dataPtr+offsetTime)) = 0;
-				}
-				else
-				{
-					*((float*)(dataPtr+offsetTime)) = 0;
-				}
+				*((float*)(dataPtr+offsetTime)) = 0;
 			}
 		}
 	}
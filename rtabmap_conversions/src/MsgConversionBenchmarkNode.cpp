@@ -0,0 +1,485 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <ros/ros.h>
+#include "rtabmap_conversions/MsgConversion.h"
+#include <rtabmap_msgs/MapData.h>
+#include <rtabmap_msgs/NodeData.h>
+#include <rtabmap_msgs/OdomInfo.h>
+#include <rtabmap/core/Signature.h>
+#include <rtabmap/core/Link.h>
+#include <rtabmap/core/OdometryInfo.h>
+#include <rtabmap/core/Compression.h>
+#include <rtabmap/utilite/UStl.h>
+#include <rtabmap/utilite/UConversion.h>
+#include <rtabmap/utilite/UMath.h>
+#include <rtabmap/utilite/UTimer.h>
+#include <sensor_msgs/image_encodings.h>
+#include <pcl_conversions/pcl_conversions.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <tf/transform_listener.h>
+#include <boost/function.hpp>
+#include <boost/bind.hpp>
+#include <opencv2/core/core.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+// Allocations made during each call are counted with replaced global
+// new operators.
+static std::atomic<unsigned long> g_allocations(0);
+static std::atomic<unsigned long> g_allocatedBytes(0);
+
+void * operator new(std::size_t size)
+{
+	++g_allocations;
+	g_allocatedBytes += size;
+	void * p = malloc(size?size:1);
+	if(!p)
+	{
+		throw std::bad_alloc();
+	}
+	return p;
+}
+void * operator new[](std::size_t size) {return operator new(size);}
+void operator delete(void * p) noexcept {free(p);}
+void operator delete[](void * p) noexcept {free(p);}
+void operator delete(void * p, std::size_t) noexcept {free(p);}
+void operator delete[](void * p, std::size_t) noexcept {free(p);}
+
+// Time the conversion functions used on every message path with
+// synthetic data of realistic sizes, and report for each case the time
+// and the allocations per call in a JSON file (count, mean, min, p50,
+// p90, p99 and max). Each case is called "warmup" times, then
+// "iterations" times. Cases:
+//  - keypointsToROS/keypointsToROSPacked and points3fToROS/points3fToROSPacked
+//    for each size of "keypoints",
+//  - odomInfoToROS (unpacked and packed) with as many words and local map
+//    points as each size of "keypoints",
+//  - convertScan3dMsg with a "scan_points" XYZ cloud,
+//  - convertRGBDMsgs with a "image_width"x"image_height" bgr8 + 16UC1 pair,
+//  - nodeDataToROS of a node with compressed images, scan and words,
+//  - mapDataToROS of a "graph_nodes" graph (nodes with compressed scan and words).
+// Example:
+//   msg_conversion_benchmark _keypoints:="1000 10000 50000" _scan_points:=100000 _graph_nodes:=2000
+class MsgConversionBenchmark
+{
+public:
+	MsgConversionBenchmark() :
+		outputPath_("msg_conversion_benchmark.json"),
+		iterations_(100),
+		warmup_(5),
+		scanPoints_(100000),
+		imageWidth_(640),
+		imageHeight_(480),
+		graphNodes_(2000),
+		graphIterations_(10),
+		nodeWords_(500),
+		rng_(0)
+	{
+		ros::NodeHandle pnh("~");
+		std::string keypoints = "1000 10000 50000";
+		pnh.param("output", outputPath_, outputPath_);
+		pnh.param("iterations", iterations_, iterations_);
+		pnh.param("warmup", warmup_, warmup_);
+		pnh.param("keypoints", keypoints, keypoints); // space-separated sizes
+		pnh.param("scan_points", scanPoints_, scanPoints_);
+		pnh.param("image_width", imageWidth_, imageWidth_);
+		pnh.param("image_height", imageHeight_, imageHeight_);
+		pnh.param("graph_nodes", graphNodes_, graphNodes_);
+		pnh.param("graph_iterations", graphIterations_, graphIterations_);
+		pnh.param("node_words", nodeWords_, nodeWords_);
+		std::list<std::string> keypointsList = uSplit(keypoints, ' ');
+		for(std::list<std::string>::iterator iter=keypointsList.begin(); iter!=keypointsList.end(); ++iter)
+		{
+			if(uStr2Int(*iter) > 0)
+			{
+				keypointSizes_.push_back(uStr2Int(*iter));
+			}
+		}
+
+		ROS_INFO("msg_conversion_benchmark: output           = %s", outputPath_.c_str());
+		ROS_INFO("msg_conversion_benchmark: iterations       = %d (warmup=%d)", iterations_, warmup_);
+		ROS_INFO("msg_conversion_benchmark: keypoints        = %s", keypoints.c_str());
+		ROS_INFO("msg_conversion_benchmark: scan_points      = %d", scanPoints_);
+		ROS_INFO("msg_conversion_benchmark: image            = %dx%d", imageWidth_, imageHeight_);
+		ROS_INFO("msg_conversion_benchmark: graph_nodes      = %d (iterations=%d)", graphNodes_, graphIterations_);
+		ROS_INFO("msg_conversion_benchmark: node_words       = %d", nodeWords_);
+	}
+
+	void run()
+	{
+		for(size_t i=0; i<keypointSizes_.size() && ros::ok(); ++i)
+		{
+			runKeypoints(keypointSizes_[i]);
+		}
+		if(scanPoints_ > 0 && ros::ok())
+		{
+			runScan3d();
+		}
+		if(imageWidth_ > 0 && imageHeight_ > 0 && ros::ok())
+		{
+			runRGBD();
+		}
+		if(ros::ok())
+		{
+			runNodeData();
+		}
+		if(graphNodes_ > 0 && ros::ok())
+		{
+			runMapData();
+		}
+	}
+
+	void write()
+	{
+		FILE * file = fopen(outputPath_.c_str(), "w");
+		if(!file)
+		{
+			ROS_ERROR("msg_conversion_benchmark: cannot write \"%s\"", outputPath_.c_str());
+			return;
+		}
+		fprintf(file, "{\n  \"cases\": [");
+		for(size_t i=0; i<results_.size(); ++i)
+		{
+			fprintf(file, "%s\n    %s", i==0?"":",", results_[i].c_str());
+		}
+		fprintf(file, "\n  ]\n}\n");
+		fclose(file);
+		ROS_INFO("msg_conversion_benchmark: %d cases, report written to \"%s\"", (int)results_.size(), outputPath_.c_str());
+	}
+
+private:
+	void measure(const std::string & name, int size, int iterations, const boost::function<void()> & call)
+	{
+		std::vector<double> timesMs;
+		std::vector<double> allocationsPerCall;
+		std::vector<double> allocatedKbPerCall;
+		for(int i=0; i<warmup_+iterations && ros::ok(); ++i)
+		{
+			unsigned long allocations = g_allocations;
+			unsigned long allocatedBytes = g_allocatedBytes;
+			UTimer timer;
+			call();
+			double time = timer.ticks();
+			if(i >= warmup_)
+			{
+				timesMs.push_back(time*1000.0);
+				allocationsPerCall.push_back(double(g_allocations - allocations));
+				allocatedKbPerCall.push_back(double(g_allocatedBytes - allocatedBytes)/1024.0);
+			}
+		}
+		ROS_INFO("msg_conversion_benchmark: %s (%d): mean=%fms", name.c_str(), size, timesMs.empty()?0.0:uMean(timesMs));
+		results_.push_back(uFormat("{\"name\": \"%s\", \"size\": %d, \"time_ms\": %s, \"allocations\": %s, \"allocated_kb\": %s}",
+				name.c_str(), size,
+				statsToJson(timesMs).c_str(),
+				statsToJson(allocationsPerCall).c_str(),
+				statsToJson(allocatedKbPerCall).c_str()));
+	}
+
+	std::vector<cv::KeyPoint> randomKeypoints(int size)
+	{
+		std::vector<cv::KeyPoint> kpts(size);
+		for(int i=0; i<size; ++i)
+		{
+			kpts[i] = cv::KeyPoint(rng_.uniform(0.0f, float(imageWidth_)), rng_.uniform(0.0f, float(imageHeight_)), 31.0f, rng_.uniform(0.0f, 360.0f), rng_.uniform(0.0f, 0.01f), rng_.uniform(0, 8));
+		}
+		return kpts;
+	}
+
+	std::vector<cv::Point3f> randomPoints(int size)
+	{
+		std::vector<cv::Point3f> pts(size);
+		for(int i=0; i<size; ++i)
+		{
+			pts[i] = cv::Point3f(rng_.uniform(-10.0f, 10.0f), rng_.uniform(-10.0f, 10.0f), rng_.uniform(0.0f, 3.0f));
+		}
+		return pts;
+	}
+
+	static void keypointsToROS(const std::vector<cv::KeyPoint> * kpts, bool packed)
+	{
+		if(packed)
+		{
+			std::vector<float> msg;
+			rtabmap_conversions::keypointsToROSPacked(*kpts, msg);
+		}
+		else
+		{
+			std::vector<rtabmap_msgs::KeyPoint> msg;
+			rtabmap_conversions::keypointsToROS(*kpts, msg);
+		}
+	}
+
+	static void points3fToROS(const std::vector<cv::Point3f> * pts, bool packed)
+	{
+		if(packed)
+		{
+			std::vector<float> msg;
+			rtabmap_conversions::points3fToROSPacked(*pts, msg);
+		}
+		else
+		{
+			std::vector<rtabmap_msgs::Point3f> msg;
+			rtabmap_conversions::points3fToROS(*pts, msg);
+		}
+	}
+
+	static void odomInfoToROS(const rtabmap::OdometryInfo * info, bool packed)
+	{
+		rtabmap_msgs::OdomInfo msg;
+		rtabmap_conversions::odomInfoToROS(*info, msg, false, packed);
+	}
+
+	void runKeypoints(int size)
+	{
+		std::vector<cv::KeyPoint> kpts = randomKeypoints(size);
+		std::vector<cv::Point3f> pts = randomPoints(size);
+		measure("keypointsToROS", size, iterations_, boost::bind(&MsgConversionBenchmark::keypointsToROS, &kpts, false));
+		measure("keypointsToROSPacked", size, iterations_, boost::bind(&MsgConversionBenchmark::keypointsToROS, &kpts, true));
+		measure("points3fToROS", size, iterations_, boost::bind(&MsgConversionBenchmark::points3fToROS, &pts, false));
+		measure("points3fToROSPacked", size, iterations_, boost::bind(&MsgConversionBenchmark::points3fToROS, &pts, true));
+
+		// odometry info of a frame with "size" features and local map points
+		rtabmap::OdometryInfo info;
+		info.features = size;
+		for(int i=0; i<size; ++i)
+		{
+			info.words.insert(std::make_pair(i+1, kpts[i]));
+			info.localMap.insert(info.localMap.end(), std::make_pair(i+1, pts[i]));
+			if(i%2 == 0)
+			{
+				info.reg.matchesIDs.push_back(i+1);
+				info.reg.inliersIDs.push_back(i+1);
+			}
+		}
+		info.reg.covariance = cv::Mat::eye(6,6,CV_64FC1);
+		measure("odomInfoToROS", size, iterations_, boost::bind(&MsgConversionBenchmark::odomInfoToROS, &info, false));
+		measure("odomInfoToROSPacked", size, iterations_, boost::bind(&MsgConversionBenchmark::odomInfoToROS, &info, true));
+	}
+
+	static void convertScan3d(const sensor_msgs::PointCloud2 * msg, tf::TransformListener * listener)
+	{
+		rtabmap::LaserScan scan;
+		rtabmap_conversions::convertScan3dMsg(*msg, "base_link", "", ros::Time(), scan, *listener, 0.0);
+	}
+
+	void runScan3d()
+	{
+		pcl::PointCloud<pcl::PointXYZ> cloud;
+		cloud.resize(scanPoints_);
+		for(int i=0; i<scanPoints_; ++i)
+		{
+			cloud.at(i) = pcl::PointXYZ(rng_.uniform(-30.0f, 30.0f), rng_.uniform(-30.0f, 30.0f), rng_.uniform(-2.0f, 5.0f));
+		}
+		sensor_msgs::PointCloud2 msg;
+		pcl::toROSMsg(cloud, msg);
+		msg.header.frame_id = "lidar_link";
+		msg.header.stamp = ros::Time(1.0);
+		setStaticTransform("base_link", msg.header.frame_id, msg.header.stamp);
+		measure("convertScan3dMsg", scanPoints_, iterations_, boost::bind(&MsgConversionBenchmark::convertScan3d, &msg, &listener_));
+	}
+
+	static void convertRGBD(
+			const std::vector<cv_bridge::CvImageConstPtr> * imageMsgs,
+			const std::vector<cv_bridge::CvImageConstPtr> * depthMsgs,
+			const std::vector<sensor_msgs::CameraInfo> * cameraInfoMsgs,
+			tf::TransformListener * listener)
+	{
+		cv::Mat rgb;
+		cv::Mat depth;
+		std::vector<rtabmap::CameraModel> cameraModels;
+		std::vector<rtabmap::StereoCameraModel> stereoCameraModels;
+		rtabmap_conversions::convertRGBDMsgs(
+				*imageMsgs, *depthMsgs, *cameraInfoMsgs, *cameraInfoMsgs,
+				"base_link", "", ros::Time(),
+				rgb, depth, cameraModels, stereoCameraModels,
+				*listener, 0.0, true);
+	}
+
+	void runRGBD()
+	{
+		std_msgs::Header header;
+		header.frame_id = "camera_link";
+		header.stamp = ros::Time(2.0);
+		setStaticTransform("base_link", header.frame_id, header.stamp);
+
+		cv_bridge::CvImagePtr image(new cv_bridge::CvImage(header, sensor_msgs::image_encodings::BGR8, randomImage(CV_8UC3)));
+		cv_bridge::CvImagePtr depth(new cv_bridge::CvImage(header, sensor_msgs::image_encodings::TYPE_16UC1, randomImage(CV_16UC1)));
+		std::vector<cv_bridge::CvImageConstPtr> imageMsgs(1, image);
+		std::vector<cv_bridge::CvImageConstPtr> depthMsgs(1, depth);
+		std::vector<sensor_msgs::CameraInfo> cameraInfoMsgs(1);
+		rtabmap_conversions::cameraModelToROS(cameraModel(), cameraInfoMsgs[0]);
+		cameraInfoMsgs[0].header = header;
+		measure("convertRGBDMsgs", imageWidth_*imageHeight_, iterations_,
+				boost::bind(&MsgConversionBenchmark::convertRGBD, &imageMsgs, &depthMsgs, &cameraInfoMsgs, &listener_));
+	}
+
+	static void nodeDataToROS(const rtabmap::Signature * signature)
+	{
+		rtabmap_msgs::NodeData msg;
+		rtabmap_conversions::nodeDataToROS(*signature, msg);
+	}
+
+	void runNodeData()
+	{
+		rtabmap::Signature s = node(1, rtabmap::Transform::getIdentity(), true);
+		measure("nodeDataToROS", 1, iterations_, boost::bind(&MsgConversionBenchmark::nodeDataToROS, &s));
+	}
+
+	static void mapDataToROS(
+			const std::map<int, rtabmap::Transform> * poses,
+			const std::multimap<int, rtabmap::Link> * links,
+			const std::map<int, rtabmap::Signature> * signatures)
+	{
+		rtabmap_msgs::MapData msg;
+		rtabmap_conversions::mapDataToROS(*poses, *links, *signatures, rtabmap::Transform::getIdentity(), msg);
+	}
+
+	void runMapData()
+	{
+		std::map<int, rtabmap::Transform> poses;
+		std::multimap<int, rtabmap::Link> links;
+		std::map<int, rtabmap::Signature> signatures;
+		for(int id=1; id<=graphNodes_; ++id)
+		{
+			rtabmap::Transform pose(float(id)*0.5f, 0, 0, 0, 0, 0);
+			poses.insert(poses.end(), std::make_pair(id, pose));
+			if(id > 1)
+			{
+				links.insert(std::make_pair(id-1, rtabmap::Link(id-1, id, rtabmap::Link::kNeighbor, poses.at(id-1).inverse()*pose)));
+			}
+			signatures.insert(signatures.end(), std::make_pair(id, node(id, pose, false)));
+		}
+		measure("mapDataToROS", graphNodes_, graphIterations_,
+				boost::bind(&MsgConversionBenchmark::mapDataToROS, &poses, &links, &signatures));
+	}
+
+	// Node as sent by the core: compressed data and visual words
+	rtabmap::Signature node(int id, const rtabmap::Transform & pose, bool withImages)
+	{
+		cv::Mat scan(1, scanPoints_>0?std::min(scanPoints_, 10000):1000, CV_32FC3);
+		rng_.fill(scan, cv::RNG::UNIFORM, cv::Scalar::all(-10.0), cv::Scalar::all(10.0));
+		rtabmap::LaserScan scanCompressed(rtabmap::compressData2(scan), 0, 0.0f, rtabmap::LaserScan::kXYZ);
+		rtabmap::SensorData data(
+				scanCompressed,
+				withImages?rtabmap::compressImage2(randomImage(CV_8UC3), ".jpg"):cv::Mat(),
+				withImages?rtabmap::compressImage2(randomImage(CV_16UC1), ".png"):cv::Mat(),
+				cameraModel(),
+				id,
+				double(id));
+		rtabmap::Signature s(id, 0, 0, double(id), "", pose, rtabmap::Transform(), data);
+		std::multimap<int, int> words;
+		for(int i=0; i<nodeWords_; ++i)
+		{
+			words.insert(words.end(), std::make_pair(i+1, i));
+		}
+		cv::Mat descriptors(nodeWords_, 32, CV_8UC1);
+		rng_.fill(descriptors, cv::RNG::UNIFORM, cv::Scalar::all(0), cv::Scalar::all(255));
+		s.setWords(words, randomKeypoints(nodeWords_), randomPoints(nodeWords_), descriptors);
+		return s;
+	}
+
+	rtabmap::CameraModel cameraModel() const
+	{
+		return rtabmap::CameraModel(
+				double(imageWidth_)*0.8, double(imageWidth_)*0.8,
+				double(imageWidth_)/2.0, double(imageHeight_)/2.0,
+				rtabmap::Transform::getIdentity(), 0.0,
+				cv::Size(imageWidth_, imageHeight_));
+	}
+
+	cv::Mat randomImage(int type)
+	{
+		cv::Mat image(imageHeight_, imageWidth_, type);
+		if(type == CV_16UC1)
+		{
+			rng_.fill(image, cv::RNG::UNIFORM, cv::Scalar::all(500), cv::Scalar::all(5000));
+		}
+		else
+		{
+			rng_.fill(image, cv::RNG::UNIFORM, cv::Scalar::all(0), cv::Scalar::all(255));
+		}
+		return image;
+	}
+
+	void setStaticTransform(const std::string & parent, const std::string & child, const ros::Time & stamp)
+	{
+		// lookups are done at the message stamp, so a single transform at that stamp is enough
+		listener_.setTransform(tf::StampedTransform(tf::Transform(tf::Quaternion(0,0,0,1), tf::Vector3(0.1,0,0.5)), stamp, parent, child));
+	}
+
+	static std::string statsToJson(std::vector<double> values)
+	{
+		if(values.empty())
+		{
+			return "{\"count\": 0}";
+		}
+		std::sort(values.begin(), values.end());
+		return uFormat("{\"count\": %d, \"mean\": %g, \"min\": %g, \"p50\": %g, \"p90\": %g, \"p99\": %g, \"max\": %g}",
+				(int)values.size(),
+				uMean(values),
+				values.front(),
+				percentile(values, 0.5),
+				percentile(values, 0.9),
+				percentile(values, 0.99),
+				values.back());
+	}
+
+	static double percentile(const std::vector<double> & sorted, double p)
+	{
+		size_t index = std::min(sorted.size()-1, size_t(p*double(sorted.size()-1) + 0.5));
+		return sorted[index];
+	}
+
+private:
+	std::string outputPath_;
+	int iterations_;
+	int warmup_;
+	std::vector<int> keypointSizes_;
+	int scanPoints_;
+	int imageWidth_;
+	int imageHeight_;
+	int graphNodes_;
+	int graphIterations_;
+	int nodeWords_;
+	cv::RNG rng_;
+	tf::TransformListener listener_;
+	std::vector<std::string> results_;
+};
+
+int main(int argc, char** argv)
+{
+	ros::init(argc, argv, "msg_conversion_benchmark");
+	MsgConversionBenchmark benchmark;
+	benchmark.run();
+	benchmark.write();
+	return 0;
+}
@@ -0,0 +1,79 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "rtabmap_conversions/SensorDataChannel.h"
+#include <boost/thread/mutex.hpp>
+#include <map>
+
+namespace rtabmap_conversions {
+
+// Static in the library, so shared by all nodelets of the same process
+static boost::mutex g_channelsMutex;
+static std::map<std::string, std::map<const void *, SensorDataChannel::Callback> > g_channels;
+
+void SensorDataChannel::subscribe(const std::string & name, const void * owner, const Callback & callback)
+{
+	boost::mutex::scoped_lock lock(g_channelsMutex);
+	g_channels[name][owner] = callback;
+}
+
+void SensorDataChannel::unsubscribe(const std::string & name, const void * owner)
+{
+	boost::mutex::scoped_lock lock(g_channelsMutex);
+	std::map<std::string, std::map<const void *, Callback> >::iterator iter = g_channels.find(name);
+	if(iter != g_channels.end())
+	{
+		iter->second.erase(owner);
+		if(iter->second.empty())
+		{
+			g_channels.erase(iter);
+		}
+	}
+}
+
+bool SensorDataChannel::hasSubscribers(const std::string & name)
+{
+	boost::mutex::scoped_lock lock(g_channelsMutex);
+	return g_channels.find(name) != g_channels.end();
+}
+
+void SensorDataChannel::publish(const std::string & name, const rtabmap::SensorData & data, const nav_msgs::Odometry & odom, const rtabmap::OdometryInfo & info)
+{
+	// Keep the lock while calling the callbacks, so that a subscriber
+	// cannot be destroyed while it is called.
+	boost::mutex::scoped_lock lock(g_channelsMutex);
+	std::map<std::string, std::map<const void *, Callback> >::iterator iter = g_channels.find(name);
+	if(iter != g_channels.end())
+	{
+		for(std::map<const void *, Callback>::iterator jter=iter->second.begin(); jter!=iter->second.end(); ++jter)
+		{
+			jter->second(data, odom, info);
+		}
+	}
+}
+
+}
@@ -0,0 +1,277 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "rtabmap_conversions/ThreadPool.h"
+#include <ros/ros.h>
+#include <rtabmap/utilite/UStl.h>
+#include <rtabmap/utilite/UConversion.h>
+#include <map>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace rtabmap_conversions {
+
+bool ThreadSettings::apply() const
+{
+	bool success = true;
+#ifdef __linux__
+	if(!cpus.empty())
+	{
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for(size_t i=0; i<cpus.size(); ++i)
+		{
+			CPU_SET(cpus[i], &set);
+		}
+		int err = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set);
+		if(err != 0)
+		{
+			ROS_WARN_ONCE("Cannot set thread CPU affinity to \"%s\" (error=%d).", toString().c_str(), err);
+			success = false;
+		}
+	}
+	if(priority > 0)
+	{
+		sched_param param;
+		param.sched_priority = std::min(priority, sched_get_priority_max(SCHED_FIFO));
+		int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+		if(err != 0)
+		{
+			ROS_WARN_ONCE("Cannot set real-time priority %d (error=%d), CAP_SYS_NICE or "
+					"an rtprio limit is required. Priority is ignored.", priority, err);
+			success = false;
+		}
+	}
+#else
+	if(!isDefault())
+	{
+		ROS_WARN_ONCE("Thread CPU affinity and priority are only supported on Linux.");
+		success = false;
+	}
+#endif
+	return success;
+}
+
+std::string ThreadSettings::toString() const
+{
+	std::string str;
+	for(size_t i=0; i<cpus.size(); ++i)
+	{
+		str += (i==0?"":" ") + uNumber2Str(cpus[i]);
+	}
+	return uFormat("cpus=\"%s\" priority=%d", str.c_str(), priority);
+}
+
+ThreadSettings ThreadSettings::fromParams(const ros::NodeHandle & pnh, const std::string & prefix)
+{
+	ThreadSettings settings;
+	std::string cpus;
+	pnh.param(prefix+"cpus", cpus, cpus);
+	pnh.param(prefix+"priority", settings.priority, settings.priority);
+	settings.cpus = parseCpus(cpus);
+	return settings;
+}
+
+std::vector<int> ThreadSettings::parseCpus(const std::string & cpus)
+{
+	std::vector<int> out;
+	std::list<std::string> items = uSplit(uReplaceChar(cpus, ',', ' '), ' ');
+	for(std::list<std::string>::iterator iter=items.begin(); iter!=items.end(); ++iter)
+	{
+		if(iter->empty())
+		{
+			continue;
+		}
+		std::list<std::string> range = uSplit(*iter, '-');
+		if(range.size() == 2 && uIsInteger(range.front(), false) && uIsInteger(range.back(), false))
+		{
+			for(int i=uStr2Int(range.front()); i<=uStr2Int(range.back()); ++i)
+			{
+				out.push_back(i);
+			}
+		}
+		else if(uIsInteger(*iter, false))
+		{
+			out.push_back(uStr2Int(*iter));
+		}
+		else
+		{
+			ROS_WARN("Invalid CPU \"%s\" in \"%s\", it is ignored.", iter->c_str(), cpus.c_str());
+		}
+	}
+	return out;
+}
+
+// Static in the library, so shared by all nodelets of the same process
+static boost::mutex g_poolsMutex;
+static std::map<std::string, boost::weak_ptr<ThreadPool> > g_pools;
+
+boost::shared_ptr<ThreadPool> ThreadPool::get(const std::string & name, int threads, const ThreadSettings & settings)
+{
+	boost::mutex::scoped_lock lock(g_poolsMutex);
+	boost::shared_ptr<ThreadPool> pool = g_pools[name].lock();
+	if(!pool)
+	{
+		if(threads <= 0)
+		{
+			threads = std::max(1, (int)boost::thread::hardware_concurrency());
+		}
+		pool.reset(new ThreadPool(name, threads, settings));
+		g_pools[name] = pool;
+		ROS_INFO("Created thread pool \"%s\" (%d threads, %s)", name.c_str(), threads, settings.toString().c_str());
+	}
+	else if((threads > 0 && threads != pool->size()) ||
+			settings.cpus != pool->settings().cpus ||
+			settings.priority != pool->settings().priority)
+	{
+		ROS_WARN("Thread pool \"%s\" already exists (%d threads, %s), its configuration is kept.",
+				name.c_str(), pool->size(), pool->settings().toString().c_str());
+	}
+	return pool;
+}
+
+boost::shared_ptr<ThreadPool> ThreadPool::fromParams(const ros::NodeHandle & pnh)
+{
+	std::string name;
+	int threads = 0;
+	pnh.param("thread_pool", name, name);
+	pnh.param("thread_pool_size", threads, threads);
+	if(name.empty())
+	{
+		return boost::shared_ptr<ThreadPool>();
+	}
+	return get(name, threads, ThreadSettings::fromParams(pnh, "thread_pool_"));
+}
+
+ThreadPool::ThreadPool(const std::string & name, int threads, const ThreadSettings & settings) :
+	name_(name),
+	settings_(settings),
+	running_(true)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	for(int i=0; i<threads; ++i)
+	{
+		workers_.push_back(new boost::thread(boost::bind(&ThreadPool::workerLoop, this)));
+		workerIds_.insert(workers_.back()->get_id());
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		running_ = false;
+		condition_.notify_all();
+	}
+	for(size_t i=0; i<workers_.size(); ++i)
+	{
+		workers_[i]->join();
+		delete workers_[i];
+	}
+}
+
+void ThreadPool::workerLoop()
+{
+	settings_.apply();
+	while(true)
+	{
+		boost::function<void()> job;
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			while(running_ && jobs_.empty())
+			{
+				condition_.wait(lock);
+			}
+			if(!running_)
+			{
+				break;
+			}
+			job = jobs_.front();
+			jobs_.pop_front();
+		}
+		job();
+	}
+}
+
+struct ParallelForBatch
+{
+	boost::mutex mutex;
+	boost::condition_variable condition;
+	int remaining;
+};
+
+static void parallelForJob(const boost::function<void(int, int)> * job, int offset, int step, ParallelForBatch * batch)
+{
+	(*job)(offset, step);
+	boost::mutex::scoped_lock lock(batch->mutex);
+	if(--batch->remaining == 0)
+	{
+		batch->condition.notify_all();
+	}
+}
+
+void ThreadPool::parallelFor(int jobs, const boost::function<void(int, int)> & job)
+{
+	if(jobs <= 0)
+	{
+		return;
+	}
+	int step = std::min(size(), jobs);
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		if(workerIds_.find(boost::this_thread::get_id()) != workerIds_.end())
+		{
+			// nested call, the workers may all be waiting
+			step = 0;
+		}
+	}
+	if(step <= 0)
+	{
+		job(0, 1);
+		return;
+	}
+
+	ParallelForBatch batch;
+	batch.remaining = step;
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		for(int i=0; i<step; ++i)
+		{
+			jobs_.push_back(boost::bind(&parallelForJob, &job, i, step, &batch));
+		}
+		condition_.notify_all();
+	}
+	boost::mutex::scoped_lock lock(batch.mutex);
+	while(batch.remaining > 0)
+	{
+		batch.condition.wait(lock);
+	}
+}
+
+}
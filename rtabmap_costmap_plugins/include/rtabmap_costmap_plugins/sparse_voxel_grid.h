@@ -0,0 +1,406 @@
+/*
+Copyright (c) 2010-2022, Mathieu Labbe
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef RTABMAP_ROS_SPARSE_VOXEL_GRID_H_
+#define RTABMAP_ROS_SPARSE_VOXEL_GRID_H_
+
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <climits>
+#include <stdint.h>
+#include <boost/unordered_map.hpp>
+#include <ros/console.h>
+
+namespace rtabmap_costmap_plugins
+{
+
+/**
+ * Column voxel grid with the same encoding as voxel_grid::VoxelGrid (one
+ * uint32_t per column, marked: 11, unknown: 01, free: 00 for the upper
+ * and lower 16 bits), but stored in chunks of chunk_size x chunk_size
+ * columns indexed by world cell coordinates. Chunks not allocated are
+ * unknown. Moving the window (shiftOrigin()) only drops the chunks
+ * leaving the window instead of copying all the columns.
+ */
+class SparseVoxelGrid
+{
+public:
+  SparseVoxelGrid(unsigned int chunk_size = 16) :
+      size_x_(0),
+      size_y_(0),
+      size_z_(0),
+      origin_x_(0),
+      origin_y_(0),
+      chunk_size_(chunk_size)
+  {
+  }
+
+  void resize(unsigned int size_x, unsigned int size_y, unsigned int size_z)
+  {
+    if (size_z > 16)
+    {
+      ROS_INFO("Error, this implementation can only support up to 16 z values (%d)", size_z);
+      size_z = 16;
+    }
+    size_x_ = size_x;
+    size_y_ = size_y;
+    size_z_ = size_z;
+    reset();
+  }
+
+  void reset()
+  {
+    chunks_.clear();
+  }
+
+  unsigned int sizeX() const { return size_x_; }
+  unsigned int sizeY() const { return size_y_; }
+  unsigned int sizeZ() const { return size_z_; }
+  size_t chunks() const { return chunks_.size(); }
+  size_t memoryUsed() const { return chunks_.size() * chunk_size_ * chunk_size_ * sizeof(uint32_t); }
+
+  /**
+   * The window moves by (dx, dy) cells: the old cell (dx, dy) becomes the
+   * new cell (0, 0). Columns are also shifted by dz cells in z, like
+   * VoxelLayer::copyMapRegion3D() does.
+   */
+  void shiftOrigin(int dx, int dy, int dz)
+  {
+    origin_x_ += dx;
+    origin_y_ += dy;
+    for (Chunks::iterator iter = chunks_.begin(); iter != chunks_.end();)
+    {
+      int cx = iter->first.first * (int)chunk_size_;
+      int cy = iter->first.second * (int)chunk_size_;
+      if (cx + (int)chunk_size_ <= origin_x_ || cx >= origin_x_ + (int)size_x_ ||
+          cy + (int)chunk_size_ <= origin_y_ || cy >= origin_y_ + (int)size_y_)
+      {
+        iter = chunks_.erase(iter);
+        continue;
+      }
+      std::vector<uint32_t>& chunk = iter->second;
+      for (unsigned int j = 0; j < chunk_size_; ++j)
+      {
+        bool outside_y = cy + (int)j < origin_y_ || cy + (int)j >= origin_y_ + (int)size_y_;
+        for (unsigned int i = 0; i < chunk_size_; ++i)
+        {
+          uint32_t& col = chunk[j * chunk_size_ + i];
+          if (outside_y || cx + (int)i < origin_x_ || cx + (int)i >= origin_x_ + (int)size_x_)
+          {
+            // will be unknown if the window comes back here
+            col = unknownColumn();
+          }
+          else if (dz != 0)
+          {
+            col = shiftColumn(col, dz);
+          }
+        }
+      }
+      ++iter;
+    }
+  }
+
+  uint32_t getColumn(unsigned int x, unsigned int y) const
+  {
+    int gx = origin_x_ + (int)x;
+    int gy = origin_y_ + (int)y;
+    Chunks::const_iterator iter = chunks_.find(chunkKey(gx, gy));
+    if (iter == chunks_.end())
+      return unknownColumn();
+    return iter->second[chunkIndex(gx, gy)];
+  }
+
+  /**
+   * Copy the grid in a dense array (size_x*size_y), like voxel_grid::VoxelGrid::getData().
+   */
+  void getData(uint32_t* data) const
+  {
+    for (unsigned int i = 0; i < size_x_ * size_y_; ++i)
+    {
+      data[i] = unknownColumn();
+    }
+    for (Chunks::const_iterator iter = chunks_.begin(); iter != chunks_.end(); ++iter)
+    {
+      int cx = iter->first.first * (int)chunk_size_ - origin_x_;
+      int cy = iter->first.second * (int)chunk_size_ - origin_y_;
+      for (unsigned int j = 0; j < chunk_size_; ++j)
+      {
+        int y = cy + (int)j;
+        if (y < 0 || y >= (int)size_y_)
+          continue;
+        for (unsigned int i = 0; i < chunk_size_; ++i)
+        {
+          int x = cx + (int)i;
+          if (x >= 0 && x < (int)size_x_)
+          {
+            data[y * size_x_ + x] = iter->second[j * chunk_size_ + i];
+          }
+        }
+      }
+    }
+  }
+
+  bool markVoxelInMap(unsigned int x, unsigned int y, unsigned int z, unsigned int marked_threshold)
+  {
+    if (x >= size_x_ || y >= size_y_ || z >= size_z_)
+    {
+      ROS_DEBUG("Error, voxel out of bounds.\n");
+      return false;
+    }
+    uint32_t* col = column(x, y);
+    uint32_t full_mask = ((uint32_t)1 << z << 16) | (1 << z);
+    *col |= full_mask;  // clear unknown and mark cell
+
+    unsigned int marked_bits = *col >> 16;
+
+    // make sure the number of bits in each is below our thesholds
+    return !bitsBelowThreshold(marked_bits, marked_threshold);
+  }
+
+  void clearVoxelColumn(unsigned int index)
+  {
+    *column(index % size_x_, index / size_x_) = 0;
+  }
+
+  /**
+   * Same as voxel_grid::VoxelGrid::clearVoxelLineInMap(), the 2D map has
+   * the dense size_x*size_y layout.
+   */
+  void clearVoxelLineInMap(double x0, double y0, double z0, double x1, double y1, double z1,
+                           unsigned char* map_2d, unsigned int unknown_threshold, unsigned int mark_threshold,
+                           unsigned char free_cost = 0, unsigned char unknown_cost = 255,
+                           unsigned int max_length = UINT_MAX)
+  {
+    if ((unsigned int)(x0) >= size_x_ || (unsigned int)(y0) >= size_y_ || (unsigned int)(z0) >= size_z_ ||
+        (unsigned int)(x1) >= size_x_ || (unsigned int)(y1) >= size_y_ || (unsigned int)(z1) >= size_z_)
+    {
+      ROS_DEBUG("Error, line endpoint out of bounds. (%.2f, %.2f, %.2f) to (%.2f, %.2f, %.2f),  size: (%d, %d, %d)",
+                x0, y0, z0, x1, y1, z1, size_x_, size_y_, size_z_);
+      return;
+    }
+
+    int dx = int(x1) - int(x0);
+    int dy = int(y1) - int(y0);
+    int dz = int(z1) - int(z0);
+
+    unsigned int abs_dx = std::abs(dx);
+    unsigned int abs_dy = std::abs(dy);
+    unsigned int abs_dz = std::abs(dz);
+
+    // same traversal as voxel_grid::VoxelGrid::raytraceLine()
+    int x = int(x0);
+    int y = int(y0);
+    uint32_t z_mask = ((1 << 16) | 1) << (unsigned int)z0;
+
+    double dist = std::sqrt((x0 - x1) * (x0 - x1) + (y0 - y1) * (y0 - y1) + (z0 - z1) * (z0 - z1));
+    double scale = std::min(1.0, max_length / dist);
+
+    unsigned int abs_da, abs_db, abs_dc;
+    int* a = 0;
+    int* b = 0;
+    int sign_a, sign_b, sign_c;
+    int dominant;
+    if (abs_dx >= std::max(abs_dy, abs_dz))
+    {
+      dominant = 0;
+      abs_da = abs_dx; abs_db = abs_dy; abs_dc = abs_dz;
+      sign_a = sign(dx); sign_b = sign(dy); sign_c = sign(dz);
+      a = &x; b = &y;
+    }
+    else if (abs_dy >= abs_dz)
+    {
+      dominant = 1;
+      abs_da = abs_dy; abs_db = abs_dx; abs_dc = abs_dz;
+      sign_a = sign(dy); sign_b = sign(dx); sign_c = sign(dz);
+      a = &y; b = &x;
+    }
+    else
+    {
+      dominant = 2;
+      abs_da = abs_dz; abs_db = abs_dx; abs_dc = abs_dy;
+      sign_a = sign(dz); sign_b = sign(dx); sign_c = sign(dy);
+      a = &x; b = &y;  // b and c are x and y
+    }
+    int error_b = abs_da / 2;
+    int error_c = abs_da / 2;
+    unsigned int end = std::min((unsigned int)(scale * abs_da), abs_da);
+
+    ChunkCache cache;
+    for (unsigned int i = 0; i < end; ++i)
+    {
+      clearVoxelInMap(cache, x, y, z_mask, map_2d, unknown_threshold, mark_threshold, free_cost, unknown_cost);
+      error_b += abs_db;
+      error_c += abs_dc;
+      if (dominant == 2)
+      {
+        z_mask = sign_a > 0 ? z_mask << 1 : z_mask >> 1;
+        if ((unsigned int)error_b >= abs_da)
+        {
+          *a += sign_b;
+          error_b -= abs_da;
+        }
+        if ((unsigned int)error_c >= abs_da)
+        {
+          *b += sign_c;
+          error_c -= abs_da;
+        }
+      }
+      else
+      {
+        *a += sign_a;
+        if ((unsigned int)error_b >= abs_da)
+        {
+          *b += sign_b;
+          error_b -= abs_da;
+        }
+        if ((unsigned int)error_c >= abs_da)
+        {
+          z_mask = sign_c > 0 ? z_mask << 1 : z_mask >> 1;
+          error_c -= abs_da;
+        }
+      }
+    }
+    clearVoxelInMap(cache, x, y, z_mask, map_2d, unknown_threshold, mark_threshold, free_cost, unknown_cost);
+  }
+
+  static uint32_t unknownColumn()
+  {
+    return ~((uint32_t)0) >> 16;
+  }
+
+private:
+  typedef std::pair<int, int> ChunkKey;
+  typedef boost::unordered_map<ChunkKey, std::vector<uint32_t> > Chunks;
+
+  // last chunk used while tracing a ray
+  struct ChunkCache
+  {
+    ChunkCache() : chunk(0) {}
+    ChunkKey key;
+    std::vector<uint32_t>* chunk;
+  };
+
+  static int sign(int i)
+  {
+    return i > 0 ? 1 : -1;
+  }
+
+  static bool bitsBelowThreshold(unsigned int bits, unsigned int bit_threshold)
+  {
+    unsigned int bit_count;
+    for (bit_count = 0; bits;)
+    {
+      ++bit_count;
+      if (bit_count > bit_threshold)
+        return false;
+      bits &= bits - 1;  // clear the least significant bit set
+    }
+    return true;
+  }
+
+  static uint32_t shiftColumn(uint32_t col, int z_shift)
+  {
+    // same as VoxelLayer::copyMapRegion3D()
+    uint32_t marked_bits_mask = 0xFFFF0000;
+    uint32_t unknown_bits_mask = 0x0000FFFF;
+    if (z_shift > 0)
+    {
+      return ((col & marked_bits_mask) >> z_shift & marked_bits_mask) |
+             (((col & unknown_bits_mask) >> z_shift | (~((uint32_t)0) << (16 - z_shift))) & unknown_bits_mask);
+    }
+    return (col & marked_bits_mask) << -z_shift |
+           ((col << -z_shift & unknown_bits_mask) | ~(~((uint32_t)0) << -z_shift));
+  }
+
+  static int floorDiv(int a, int b)
+  {
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+  }
+
+  ChunkKey chunkKey(int gx, int gy) const
+  {
+    return ChunkKey(floorDiv(gx, chunk_size_), floorDiv(gy, chunk_size_));
+  }
+
+  unsigned int chunkIndex(int gx, int gy) const
+  {
+    return (gy - floorDiv(gy, chunk_size_) * chunk_size_) * chunk_size_ + (gx - floorDiv(gx, chunk_size_) * chunk_size_);
+  }
+
+  std::vector<uint32_t>& chunk(const ChunkKey& key)
+  {
+    std::vector<uint32_t>& chunk = chunks_[key];
+    if (chunk.empty())
+    {
+      chunk.resize(chunk_size_ * chunk_size_, unknownColumn());
+    }
+    return chunk;
+  }
+
+  uint32_t* column(unsigned int x, unsigned int y)
+  {
+    int gx = origin_x_ + (int)x;
+    int gy = origin_y_ + (int)y;
+    return &chunk(chunkKey(gx, gy))[chunkIndex(gx, gy)];
+  }
+
+  inline void clearVoxelInMap(ChunkCache& cache, int x, int y, uint32_t z_mask, unsigned char* map_2d,
+                              unsigned int unknown_threshold, unsigned int mark_threshold,
+                              unsigned char free_cost, unsigned char unknown_cost)
+  {
+    int gx = origin_x_ + x;
+    int gy = origin_y_ + y;
+    ChunkKey key = chunkKey(gx, gy);
+    if (cache.chunk == 0 || cache.key != key)
+    {
+      cache.key = key;
+      cache.chunk = &chunk(key);
+    }
+    uint32_t* col = &(*cache.chunk)[chunkIndex(gx, gy)];
+    *col &= ~(z_mask);  // clear unknown and clear cell
+
+    unsigned int unknown_bits = uint16_t(*col >> 16) ^ uint16_t(*col);
+    unsigned int marked_bits = *col >> 16;
+
+    // make sure the number of bits in each is below our thesholds
+    if (bitsBelowThreshold(marked_bits, mark_threshold))
+    {
+      map_2d[y * size_x_ + x] = bitsBelowThreshold(unknown_bits, unknown_threshold) ? free_cost : unknown_cost;
+    }
+  }
+
+private:
+  unsigned int size_x_, size_y_, size_z_;
+  int origin_x_, origin_y_;  // window origin in world cells
+  unsigned int chunk_size_;
+  Chunks chunks_;
+};
+
+}  // namespace rtabmap_costmap_plugins
+
+#endif  // RTABMAP_ROS_SPARSE_VOXEL_GRID_H_
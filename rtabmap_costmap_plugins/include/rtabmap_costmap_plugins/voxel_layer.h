@@ -53,6 +53,7 @@
 #include <costmap_2d/VoxelPluginConfig.h>
 #include <costmap_2d/obstacle_layer.h>
 #include <voxel_grid/voxel_grid.h>
+#include "rtabmap_costmap_plugins/sparse_voxel_grid.h"
 
 namespace rtabmap_costmap_plugins
 {
@@ -61,7 +62,10 @@ class VoxelLayer : public costmap_2d::ObstacleLayer
 {
 public:
   VoxelLayer() :
-      voxel_grid_(0, 0, 0)
+      voxel_grid_(0, 0, 0),
+      sparse_voxels_(false),
+      raytrace_threads_(1),
+      raytrace_angular_resolution_(0.0)
   {
     costmap_ = NULL;  // this is the unsigned char* member of parent class's parent class Costmap2D.
   }
@@ -92,16 +96,41 @@ private:
   virtual void raytraceFreespace(const costmap_2d::Observation& clearing_observation, double* min_x, double* min_y,
                                  double* max_x, double* max_y);
 
+  // Rays of one clearing observation traced by a worker thread
+  struct RaytraceJob
+  {
+    const std::vector<geometry_msgs::Point32>* points;
+    size_t begin, end;
+    double ox, oy, oz;
+    double sensor_x, sensor_y, sensor_z;
+    double map_end_x, map_end_y, map_end_z;
+    double raytrace_range;
+    unsigned int cell_raytrace_range;
+    bool publish_clearing_points;
+    // outputs
+    std::vector<unsigned int> cleared_columns;
+    std::vector<geometry_msgs::Point32> endpoints;
+    double min_x, min_y, max_x, max_y;
+  };
+  void raytraceRays(RaytraceJob* job);
+  bool clipRay(double ox, double oy, double oz, double map_end_x, double map_end_y, double map_end_z,
+               double& wpx, double& wpy, double& wpz, double& point_x, double& point_y, double& point_z);
+  void decimateRays(double ox, double oy, double oz, std::vector<geometry_msgs::Point32>& points) const;
+
   dynamic_reconfigure::Server<costmap_2d::VoxelPluginConfig> *voxel_dsrv_;
 
   bool publish_voxel_;
   std::string robot_base_frame_;
   ros::Publisher voxel_pub_;
   voxel_grid::VoxelGrid voxel_grid_;
+  bool sparse_voxels_;
+  SparseVoxelGrid sparse_voxel_grid_;  // used instead of voxel_grid_ if sparse_voxels_ is true
   double z_resolution_, origin_z_;
   unsigned int unknown_threshold_, mark_threshold_, size_z_;
   ros::Publisher clearing_endpoints_pub_;
   sensor_msgs::PointCloud clearing_endpoints_;
+  int raytrace_threads_;
+  double raytrace_angular_resolution_;
 
   inline bool worldToMap3DFloat(double wx, double wy, double wz, double& mx, double& my, double& mz)
   {
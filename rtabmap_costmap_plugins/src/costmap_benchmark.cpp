@@ -0,0 +1,384 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <ros/ros.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <costmap_2d/layered_costmap.h>
+#include <costmap_2d/observation.h>
+#include <tf2_ros/buffer.h>
+#include <tf2/utils.h>
+#include <tf2_sensor_msgs/tf2_sensor_msgs.h>
+#include <tf2_msgs/TFMessage.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <nav_msgs/OccupancyGrid.h>
+#include "rtabmap_costmap_plugins/voxel_layer.h"
+#include "rtabmap_costmap_plugins/static_layer.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <new>
+
+// Allocations of the whole process (including the raytracing threads)
+// are counted with replaced global new operators.
+static std::atomic<unsigned long> g_allocations(0);
+static std::atomic<unsigned long> g_allocatedBytes(0);
+
+void * operator new(std::size_t size)
+{
+  ++g_allocations;
+  g_allocatedBytes += size;
+  void * p = malloc(size?size:1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+void * operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void * p) noexcept { free(p); }
+void operator delete[](void * p) noexcept { free(p); }
+void operator delete(void * p, std::size_t) noexcept { free(p); }
+void operator delete[](void * p, std::size_t) noexcept { free(p); }
+
+// Time and allocations of each call of a measured function
+class CallStats
+{
+public:
+  void start()
+  {
+    allocations_ = g_allocations;
+    allocatedBytes_ = g_allocatedBytes;
+    startTime_ = ros::WallTime::now();
+  }
+  void stop()
+  {
+    ros::WallTime now = ros::WallTime::now();
+    timesMs_.push_back((now - startTime_).toSec() * 1000.0);
+    allocations_count_.push_back(double(g_allocations - allocations_));
+    allocatedKb_.push_back(double(g_allocatedBytes - allocatedBytes_) / 1024.0);
+  }
+  bool empty() const { return timesMs_.empty(); }
+  std::string toJson() const
+  {
+    return "{\"time_ms\": " + statsToJson(timesMs_) +
+           ", \"allocations\": " + statsToJson(allocations_count_) +
+           ", \"allocated_kb\": " + statsToJson(allocatedKb_) + "}";
+  }
+
+private:
+  static std::string statsToJson(std::vector<double> v)
+  {
+    if (v.empty())
+      return "{\"count\": 0}";
+    std::sort(v.begin(), v.end());
+    double sum = 0.0;
+    for (size_t i = 0; i < v.size(); ++i)
+      sum += v[i];
+    char buf[256];
+    snprintf(buf, sizeof(buf), "{\"count\": %d, \"mean\": %g, \"min\": %g, \"p50\": %g, \"p90\": %g, \"p99\": %g, \"max\": %g}",
+             (int)v.size(), sum / double(v.size()), v.front(), percentile(v, 0.5), percentile(v, 0.9),
+             percentile(v, 0.99), v.back());
+    return buf;
+  }
+  static double percentile(const std::vector<double>& sorted, double p)
+  {
+    return sorted[std::min(sorted.size() - 1, size_t(p * double(sorted.size() - 1) + 0.5))];
+  }
+
+  ros::WallTime startTime_;
+  unsigned long allocations_;
+  unsigned long allocatedBytes_;
+  std::vector<double> timesMs_;
+  std::vector<double> allocations_count_;
+  std::vector<double> allocatedKb_;
+};
+
+/**
+ * Replay the clouds and the occupancy grid of a bag through the voxel and
+ * static layers, without subscribing to the bag topics, and write the time
+ * and the allocations of each updateBounds()/updateCosts() call in a JSON
+ * report. The transforms of the bag (/tf and /tf_static) are set directly
+ * in the tf buffer. A master is still required for the parameters of the
+ * layers, which are read from the usual costmap namespaces ("~costmap/voxel"
+ * and "~costmap/static"). Example:
+ *   costmap_benchmark _bag:=recording.bag _cloud_topic:=/obstacles_cloud _map_topic:=/map
+ *      _costmap/voxel/raytrace_threads:=4
+ */
+class CostmapBenchmark
+{
+public:
+  CostmapBenchmark() :
+    globalFrame_("odom"),
+    robotBaseFrame_("base_link"),
+    outputPath_("costmap_benchmark.json"),
+    rollingWindow_(true),
+    width_(10.0),
+    height_(10.0),
+    resolution_(0.05),
+    obstacleRange_(2.5),
+    raytraceRange_(3.0),
+    warmup_(5),
+    staticIterations_(100),
+    tf_(ros::Duration(3600.0))
+  {
+    ros::NodeHandle pnh("~");
+    pnh.param("bag", bagPath_, bagPath_);
+    pnh.param("cloud_topic", cloudTopic_, cloudTopic_);
+    pnh.param("map_topic", mapTopic_, mapTopic_);
+    pnh.param("global_frame", globalFrame_, globalFrame_);
+    pnh.param("robot_base_frame", robotBaseFrame_, robotBaseFrame_);
+    pnh.param("output", outputPath_, outputPath_);
+    pnh.param("rolling_window", rollingWindow_, rollingWindow_);
+    pnh.param("width", width_, width_);
+    pnh.param("height", height_, height_);
+    pnh.param("resolution", resolution_, resolution_);
+    pnh.param("obstacle_range", obstacleRange_, obstacleRange_);
+    pnh.param("raytrace_range", raytraceRange_, raytraceRange_);
+    pnh.param("warmup", warmup_, warmup_);
+    pnh.param("static_iterations", staticIterations_, staticIterations_);
+    // the layers get these from their costmap namespace
+    pnh.setParam("costmap/global_frame", globalFrame_);
+    pnh.setParam("costmap/robot_base_frame", robotBaseFrame_);
+
+    ROS_INFO("costmap_benchmark: bag               = %s", bagPath_.c_str());
+    ROS_INFO("costmap_benchmark: cloud_topic       = %s", cloudTopic_.c_str());
+    ROS_INFO("costmap_benchmark: map_topic         = %s", mapTopic_.c_str());
+    ROS_INFO("costmap_benchmark: global_frame      = %s", globalFrame_.c_str());
+    ROS_INFO("costmap_benchmark: robot_base_frame  = %s", robotBaseFrame_.c_str());
+    ROS_INFO("costmap_benchmark: rolling_window    = %s (%fx%f m, %f m/cell)", rollingWindow_ ? "true" : "false", width_,
+             height_, resolution_);
+    ROS_INFO("costmap_benchmark: obstacle_range    = %f m", obstacleRange_);
+    ROS_INFO("costmap_benchmark: raytrace_range    = %f m", raytraceRange_);
+    ROS_INFO("costmap_benchmark: warmup            = %d", warmup_);
+    ROS_INFO("costmap_benchmark: static_iterations = %d", staticIterations_);
+    ROS_INFO("costmap_benchmark: output            = %s", outputPath_.c_str());
+  }
+
+  bool run()
+  {
+    if (bagPath_.empty() || (cloudTopic_.empty() && mapTopic_.empty()))
+    {
+      ROS_ERROR("costmap_benchmark: \"bag\" and \"cloud_topic\" and/or \"map_topic\" parameters are required.");
+      return false;
+    }
+    rosbag::Bag bag;
+    try
+    {
+      bag.open(bagPath_, rosbag::bagmode::Read);
+    }
+    catch (const rosbag::BagException& e)
+    {
+      ROS_ERROR("costmap_benchmark: cannot open \"%s\": %s", bagPath_.c_str(), e.what());
+      return false;
+    }
+    if (!cloudTopic_.empty())
+      runVoxelLayer(bag);
+    if (!mapTopic_.empty() && ros::ok())
+      runStaticLayer(bag);
+    bag.close();
+    return true;
+  }
+
+  void write()
+  {
+    FILE* file = fopen(outputPath_.c_str(), "w");
+    if (!file)
+    {
+      ROS_ERROR("costmap_benchmark: cannot write \"%s\"", outputPath_.c_str());
+      return;
+    }
+    fprintf(file, "{\n  \"bag\": \"%s\"", bagPath_.c_str());
+    for (std::map<std::string, CallStats>::iterator iter = stats_.begin(); iter != stats_.end(); ++iter)
+    {
+      fprintf(file, ",\n  \"%s\": %s", iter->first.c_str(), iter->second.toJson().c_str());
+    }
+    fprintf(file, "\n}\n");
+    fclose(file);
+    ROS_INFO("costmap_benchmark: report written to \"%s\"", outputPath_.c_str());
+  }
+
+private:
+  void addTransforms(const rosbag::MessageInstance& m)
+  {
+    tf2_msgs::TFMessage::ConstPtr tf = m.instantiate<tf2_msgs::TFMessage>();
+    if (tf.get())
+    {
+      bool isStatic = m.getTopic() == "/tf_static";
+      for (size_t i = 0; i < tf->transforms.size(); ++i)
+        tf_.setTransform(tf->transforms[i], "bag", isStatic);
+    }
+  }
+
+  void runVoxelLayer(rosbag::Bag& bag)
+  {
+    costmap_2d::LayeredCostmap layered(globalFrame_, rollingWindow_, true);
+    boost::shared_ptr<rtabmap_costmap_plugins::VoxelLayer> layer(new rtabmap_costmap_plugins::VoxelLayer);
+    layered.addPlugin(layer);
+    layer->initialize(&layered, "costmap/voxel", &tf_);
+    layered.resizeMap(width_ / resolution_, height_ / resolution_, resolution_, 0.0, 0.0);
+
+    std::vector<std::string> topics;
+    topics.push_back("/tf");
+    topics.push_back("/tf_static");
+    topics.push_back(cloudTopic_);
+    rosbag::View view(bag, rosbag::TopicQuery(topics));
+    int count = 0;
+    for (rosbag::View::iterator iter = view.begin(); iter != view.end() && ros::ok(); ++iter)
+    {
+      if (iter->getTopic() != cloudTopic_)
+      {
+        addTransforms(*iter);
+        continue;
+      }
+      sensor_msgs::PointCloud2::ConstPtr cloud = iter->instantiate<sensor_msgs::PointCloud2>();
+      if (!cloud.get())
+        continue;
+      geometry_msgs::TransformStamped sensorPose, robotPose;
+      try
+      {
+        sensorPose = tf_.lookupTransform(globalFrame_, cloud->header.frame_id, cloud->header.stamp);
+        robotPose = tf_.lookupTransform(globalFrame_, robotBaseFrame_, cloud->header.stamp);
+      }
+      catch (const tf2::TransformException& ex)
+      {
+        ROS_WARN("costmap_benchmark: %s", ex.what());
+        continue;
+      }
+      sensor_msgs::PointCloud2 global;
+      tf2::doTransform(*cloud, global, sensorPose);
+      geometry_msgs::Point origin;
+      origin.x = sensorPose.transform.translation.x;
+      origin.y = sensorPose.transform.translation.y;
+      origin.z = sensorPose.transform.translation.z;
+      costmap_2d::Observation observation(origin, global, obstacleRange_, raytraceRange_);
+      layer->clearStaticObservations(true, true);
+      layer->addStaticObservation(observation, true, true);
+
+      // same steps as LayeredCostmap::updateMap(), timed separately
+      double x = robotPose.transform.translation.x;
+      double y = robotPose.transform.translation.y;
+      double yaw = tf2::getYaw(robotPose.transform.rotation);
+      costmap_2d::Costmap2D* master = layered.getCostmap();
+      if (rollingWindow_)
+        master->updateOrigin(x - master->getSizeInMetersX() / 2, y - master->getSizeInMetersY() / 2);
+      double minX = 1e30, minY = 1e30, maxX = -1e30, maxY = -1e30;
+      bool measured = ++count > warmup_;
+      if (measured)
+        stats_["voxel_layer/updateBounds"].start();
+      layer->updateBounds(x, y, yaw, &minX, &minY, &maxX, &maxY);
+      if (measured)
+        stats_["voxel_layer/updateBounds"].stop();
+      int x0, xn, y0, yn;
+      master->worldToMapEnforceBounds(minX, minY, x0, y0);
+      master->worldToMapEnforceBounds(maxX, maxY, xn, yn);
+      x0 = std::max(0, x0);
+      xn = std::min(int(master->getSizeInCellsX()), xn + 1);
+      y0 = std::max(0, y0);
+      yn = std::min(int(master->getSizeInCellsY()), yn + 1);
+      if (xn < x0 || yn < y0)
+        continue;
+      master->resetMap(x0, y0, xn, yn);
+      if (measured)
+        stats_["voxel_layer/updateCosts"].start();
+      layer->updateCosts(*master, x0, y0, xn, yn);
+      if (measured)
+        stats_["voxel_layer/updateCosts"].stop();
+    }
+    ROS_INFO("costmap_benchmark: %d clouds replayed through the voxel layer", count);
+  }
+
+  void runStaticLayer(rosbag::Bag& bag)
+  {
+    rosbag::View view(bag, rosbag::TopicQuery(mapTopic_));
+    nav_msgs::OccupancyGrid::ConstPtr map;
+    for (rosbag::View::iterator iter = view.begin(); iter != view.end() && !map.get(); ++iter)
+      map = iter->instantiate<nav_msgs::OccupancyGrid>();
+    if (!map.get())
+    {
+      ROS_ERROR("costmap_benchmark: no map found on \"%s\"", mapTopic_.c_str());
+      return;
+    }
+
+    // The static layer waits for its map on a topic, it is published
+    // latched from this process so it is received by pointer.
+    ros::NodeHandle pnh("~");
+    ros::Publisher mapPub = pnh.advertise<nav_msgs::OccupancyGrid>("benchmark_map", 1, true);
+    mapPub.publish(map);
+    pnh.setParam("costmap/static/map_topic", mapPub.getTopic());
+
+    costmap_2d::LayeredCostmap layered(map->header.frame_id, false, true);
+    boost::shared_ptr<rtabmap_costmap_plugins::StaticLayer> layer(new rtabmap_costmap_plugins::StaticLayer);
+    layered.addPlugin(layer);
+    stats_["static_layer/initialize"].start();
+    layer->initialize(&layered, "costmap/static", &tf_);
+    stats_["static_layer/initialize"].stop();
+
+    costmap_2d::Costmap2D* master = layered.getCostmap();
+    for (int i = 0; i < staticIterations_ + warmup_ && ros::ok(); ++i)
+    {
+      double minX = 1e30, minY = 1e30, maxX = -1e30, maxY = -1e30;
+      layer->updateBounds(0, 0, 0, &minX, &minY, &maxX, &maxY);
+      master->resetMap(0, 0, master->getSizeInCellsX(), master->getSizeInCellsY());
+      if (i >= warmup_)
+        stats_["static_layer/updateCosts"].start();
+      layer->updateCosts(*master, 0, 0, master->getSizeInCellsX(), master->getSizeInCellsY());
+      if (i >= warmup_)
+        stats_["static_layer/updateCosts"].stop();
+    }
+    ROS_INFO("costmap_benchmark: %d updates of a %dx%d static map", staticIterations_, (int)master->getSizeInCellsX(),
+             (int)master->getSizeInCellsY());
+  }
+
+private:
+  std::string bagPath_;
+  std::string cloudTopic_;
+  std::string mapTopic_;
+  std::string globalFrame_;
+  std::string robotBaseFrame_;
+  std::string outputPath_;
+  bool rollingWindow_;
+  double width_;
+  double height_;
+  double resolution_;
+  double obstacleRange_;
+  double raytraceRange_;
+  int warmup_;
+  int staticIterations_;
+  tf2_ros::Buffer tf_;
+  std::map<std::string, CallStats> stats_;
+};
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "costmap_benchmark");
+  CostmapBenchmark benchmark;
+  if (!benchmark.run())
+    return 1;
+  benchmark.write();
+  return 0;
+}
@@ -155,6 +155,7 @@ void StaticLayer::incomingMap(const nav_msgs::OccupancyGridConstPtr& new_map)
 
   // resize costmap if size, resolution or origin do not match
   Costmap2D* master = layered_costmap_->getCostmap();
+  bool resized = true;
   if (master->getSizeInCellsX() != size_x ||
       master->getSizeInCellsY() != size_y ||
       master->getResolution() != new_map->info.resolution ||
@@ -171,23 +172,61 @@ void StaticLayer::incomingMap(const nav_msgs::OccupancyGridConstPtr& new_map)
       origin_y_ != new_map->info.origin.position.y){
     matchSize();
   }
+  else
+  {
+    // same geometry, only the cells that changed need to be updated
+    resized = !map_received_;
+  }
 
   unsigned int index = 0;
+  unsigned int min_x = size_x, min_y = size_y, max_x = 0, max_y = 0;
 
   //initialize the costmap with static data
   for (unsigned int i = 0; i < size_y; ++i)
   {
     for (unsigned int j = 0; j < size_x; ++j)
     {
-      unsigned char value = new_map->data[index];
-      costmap_[index] = interpretValue(value);
+      unsigned char value = interpretValue(new_map->data[index]);
+      if (costmap_[index] != value)
+      {
+        costmap_[index] = value;
+        min_x = std::min(min_x, j);
+        min_y = std::min(min_y, i);
+        max_x = std::max(max_x, j);
+        max_y = std::max(max_y, i);
+      }
       ++index;
     }
   }
-  x_ = y_ = 0;
-  width_ = size_x_;
-  height_ = size_y_;
   map_received_ = true;
+
+  if (resized)
+  {
+    x_ = y_ = 0;
+    width_ = size_x_;
+    height_ = size_y_;
+  }
+  else if (min_x <= max_x)
+  {
+    // merge with the region not yet consumed by updateBounds()
+    if (has_updated_data_)
+    {
+      min_x = std::min(min_x, x_);
+      min_y = std::min(min_y, y_);
+      max_x = std::max(max_x, x_ + width_ - 1);
+      max_y = std::max(max_y, y_ + height_ - 1);
+    }
+    x_ = min_x;
+    y_ = min_y;
+    width_ = max_x - min_x + 1;
+    height_ = max_y - min_y + 1;
+    ROS_DEBUG("Static map changed in %d X %d cells at (%d, %d)", width_, height_, x_, y_);
+  }
+  else
+  {
+    ROS_DEBUG("Static map didn't change");
+    return;
+  }
   has_updated_data_ = true;
 
   layered_costmap_->updateMap(0,0,0);
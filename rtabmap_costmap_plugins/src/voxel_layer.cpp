@@ -39,6 +39,7 @@
 #include <pluginlib/class_list_macros.hpp>
 #include <sensor_msgs/point_cloud2_iterator.h>
 #include <boost/thread.hpp>
+#include <boost/unordered_map.hpp>
 #include <pcl_conversions/pcl_conversions.h>
 
 #define VOXEL_BITS 16
@@ -57,13 +58,19 @@ namespace rtabmap_costmap_plugins
 
 void VoxelLayer::onInitialize()
 {
-  ObstacleLayer::onInitialize();
   ros::NodeHandle private_nh("~/" + name_);
+  // should be set before the parent calls matchSize()
+  private_nh.param("sparse_voxels", sparse_voxels_, sparse_voxels_);
+  ObstacleLayer::onInitialize();
   
   std::string costmap_name = name_.substr(0, name_.find("/"));
   ros::NodeHandle pnh("~/" + costmap_name);
 
   private_nh.param("publish_voxel_map", publish_voxel_, false);
+  // 0 means one thread per core
+  private_nh.param("raytrace_threads", raytrace_threads_, raytrace_threads_);
+  // trace only the farthest point per angular bin (rad), 0 to trace all points
+  private_nh.param("raytrace_angular_resolution", raytrace_angular_resolution_, raytrace_angular_resolution_);
   // param from parent costmap group
   pnh.param("robot_base_frame", robot_base_frame_, std::string("base_link"));
 
@@ -104,8 +111,17 @@ void VoxelLayer::reconfigureCB(costmap_2d::VoxelPluginConfig &config, uint32_t l
 void VoxelLayer::matchSize()
 {
   ObstacleLayer::matchSize();
-  voxel_grid_.resize(size_x_, size_y_, size_z_);
-  ROS_ASSERT(voxel_grid_.sizeX() == size_x_ && voxel_grid_.sizeY() == size_y_);
+  if (sparse_voxels_)
+  {
+    voxel_grid_.resize(0, 0, 0);
+    sparse_voxel_grid_.resize(size_x_, size_y_, size_z_);
+    ROS_ASSERT(sparse_voxel_grid_.sizeX() == size_x_ && sparse_voxel_grid_.sizeY() == size_y_);
+  }
+  else
+  {
+    voxel_grid_.resize(size_x_, size_y_, size_z_);
+    ROS_ASSERT(voxel_grid_.sizeX() == size_x_ && voxel_grid_.sizeY() == size_y_);
+  }
 }
 
 void VoxelLayer::reset()
@@ -120,6 +136,7 @@ void VoxelLayer::resetMaps()
 {
   Costmap2D::resetMaps();
   voxel_grid_.reset();
+  sparse_voxel_grid_.reset();
 }
 
 void VoxelLayer::updateBounds(double robot_x, double robot_y, double robot_yaw, double* min_x,
@@ -144,10 +161,17 @@ void VoxelLayer::updateBounds(double robot_x, double robot_y, double robot_yaw,
   current_ = current;
 
   // raytrace freespace
+  ros::WallTime raytrace_start = ros::WallTime::now();
   for (unsigned int i = 0; i < clearing_observations.size(); ++i)
   {
     raytraceFreespace(clearing_observations[i], min_x, min_y, max_x, max_y);
   }
+  if (!clearing_observations.empty())
+  {
+    ROS_DEBUG("%s: raytraced %d clearing observation(s) in %f ms (threads=%d)", name_.c_str(),
+              (int)clearing_observations.size(), (ros::WallTime::now() - raytrace_start).toSec() * 1000.0,
+              raytrace_threads_);
+  }
 
   // place the new obstacles into a priority queue... each with a priority of zero to begin with
   for (std::vector<Observation>::const_iterator it = observations.begin(); it != observations.end(); ++it)
@@ -179,7 +203,9 @@ void VoxelLayer::updateBounds(double robot_x, double robot_y, double robot_yaw,
       if (!worldToMap3D(x, y, z, mx, my, mz))
         continue;
 
-      if (voxel_grid_.markVoxelInMap(mx, my, mz, mark_threshold_))
+      if (sparse_voxels_ ?
+          sparse_voxel_grid_.markVoxelInMap(mx, my, mz, mark_threshold_) :
+          voxel_grid_.markVoxelInMap(mx, my, mz, mark_threshold_))
       {
         unsigned int index = getIndex(mx, my);
 
@@ -192,12 +218,24 @@ void VoxelLayer::updateBounds(double robot_x, double robot_y, double robot_yaw,
   if (publish_voxel_)
   {
     costmap_2d::VoxelGrid grid_msg;
-    unsigned int size = voxel_grid_.sizeX() * voxel_grid_.sizeY();
-    grid_msg.size_x = voxel_grid_.sizeX();
-    grid_msg.size_y = voxel_grid_.sizeY();
-    grid_msg.size_z = voxel_grid_.sizeZ();
-    grid_msg.data.resize(size);
-    memcpy(&grid_msg.data[0], voxel_grid_.getData(), size * sizeof(unsigned int));
+    if (sparse_voxels_)
+    {
+      grid_msg.size_x = sparse_voxel_grid_.sizeX();
+      grid_msg.size_y = sparse_voxel_grid_.sizeY();
+      grid_msg.size_z = sparse_voxel_grid_.sizeZ();
+      grid_msg.data.resize(grid_msg.size_x * grid_msg.size_y);
+      if (!grid_msg.data.empty())
+        sparse_voxel_grid_.getData(&grid_msg.data[0]);
+    }
+    else
+    {
+      unsigned int size = voxel_grid_.sizeX() * voxel_grid_.sizeY();
+      grid_msg.size_x = voxel_grid_.sizeX();
+      grid_msg.size_y = voxel_grid_.sizeY();
+      grid_msg.size_z = voxel_grid_.sizeZ();
+      grid_msg.data.resize(size);
+      memcpy(&grid_msg.data[0], voxel_grid_.getData(), size * sizeof(unsigned int));
+    }
 
     grid_msg.origin.x = origin_x_;
     grid_msg.origin.y = origin_y_;
@@ -254,7 +292,10 @@ void VoxelLayer::clearNonLethal(double wx, double wy, double w_size_x, double w_
         if (clear_no_info || *current != NO_INFORMATION)
         {
           *current = FREE_SPACE;
-          voxel_grid_.clearVoxelColumn(index);
+          if (sparse_voxels_)
+            sparse_voxel_grid_.clearVoxelColumn(index);
+          else
+            voxel_grid_.clearVoxelColumn(index);
         }
       }
       current++;
@@ -265,6 +306,157 @@ void VoxelLayer::clearNonLethal(double wx, double wy, double w_size_x, double w_
   }
 }
 
+namespace
+{
+// Clear voxels with atomic operations so that rays can be traced
+// concurrently in the same grid, the costmap cells of the cleared
+// columns are updated once all rays are traced.
+class ClearVoxelAtomic
+{
+public:
+  ClearVoxelAtomic(uint32_t* data, std::vector<unsigned int>* cleared_columns) :
+      data_(data),
+      cleared_columns_(cleared_columns)
+  {
+  }
+  inline void operator()(unsigned int offset, uint32_t z_mask)
+  {
+    __sync_fetch_and_and(&data_[offset], ~z_mask);
+    if (cleared_columns_->empty() || cleared_columns_->back() != offset)
+      cleared_columns_->push_back(offset);
+  }
+
+private:
+  uint32_t* data_;
+  std::vector<unsigned int>* cleared_columns_;
+};
+
+// same as voxel_grid::ClearVoxelInMap
+inline bool bitsBelowThreshold(unsigned int bits, unsigned int bit_threshold)
+{
+  unsigned int bit_count;
+  for (bit_count = 0; bits;)
+  {
+    ++bit_count;
+    if (bit_count > bit_threshold)
+      return false;
+    bits &= bits - 1;  // clear the least significant bit set
+  }
+  return true;
+}
+}
+
+bool VoxelLayer::clipRay(double ox, double oy, double oz, double map_end_x, double map_end_y, double map_end_z,
+                         double& wpx, double& wpy, double& wpz, double& point_x, double& point_y, double& point_z)
+{
+  double distance = dist(ox, oy, oz, wpx, wpy, wpz);
+  double scaling_fact = 1.0, scaling_fact_z = 1.0;
+  scaling_fact = std::max(std::min(scaling_fact, (distance - 2 * resolution_) / distance), 0.0);
+  scaling_fact_z = std::max(std::min(scaling_fact_z, (distance - 2 * z_resolution_) / distance), 0.0);
+  wpx = scaling_fact * (wpx - ox) + ox;
+  wpy = scaling_fact * (wpy - oy) + oy;
+  wpz = scaling_fact_z * (wpz - oz) + oz;
+
+  double a = wpx - ox;
+  double b = wpy - oy;
+  double c = wpz - oz;
+  double t = 1.0;
+
+  // the minimum value to raytrace from is the origin
+  if (wpz < origin_z_)
+  {
+    t = std::min(t, (origin_z_ - oz) / c);
+  }
+  if (wpx < origin_x_)
+  {
+    t = std::min(t, (origin_x_ - ox) / a);
+  }
+  if (wpy < origin_y_)
+  {
+    t = std::min(t, (origin_y_ - oy) / b);
+  }
+
+  // the maximum value to raytrace to is the end of the map
+  if (wpx > map_end_x)
+  {
+    t = std::min(t, (map_end_x - ox) / a);
+  }
+  if (wpy > map_end_y)
+  {
+    t = std::min(t, (map_end_y - oy) / b);
+  }
+  if (wpz > map_end_z)
+  {
+    t = std::min(t, (map_end_z - oz) / c);
+  }
+
+  wpx = ox + a * t;
+  wpy = oy + b * t;
+  wpz = oz + c * t;
+
+  return worldToMap3DFloat(wpx, wpy, wpz, point_x, point_y, point_z);
+}
+
+void VoxelLayer::decimateRays(double ox, double oy, double oz, std::vector<geometry_msgs::Point32>& points) const
+{
+  // keep only the farthest point per azimuth/elevation bin
+  boost::unordered_map<long long, std::pair<size_t, float> > bins;
+  for (size_t i = 0; i < points.size(); ++i)
+  {
+    double dx = points[i].x - ox;
+    double dy = points[i].y - oy;
+    double dz = points[i].z - oz;
+    int azimuth = (int)std::floor(std::atan2(dy, dx) / raytrace_angular_resolution_);
+    int elevation = (int)std::floor(std::atan2(dz, std::sqrt(dx * dx + dy * dy)) / raytrace_angular_resolution_);
+    long long key = ((long long)azimuth << 32) | (unsigned int)elevation;
+    float distanceSqr = dx * dx + dy * dy + dz * dz;
+    std::pair<boost::unordered_map<long long, std::pair<size_t, float> >::iterator, bool> inserted =
+        bins.insert(std::make_pair(key, std::make_pair(i, distanceSqr)));
+    if (!inserted.second && inserted.first->second.second < distanceSqr)
+    {
+      inserted.first->second = std::make_pair(i, distanceSqr);
+    }
+  }
+  std::vector<geometry_msgs::Point32> decimated;
+  decimated.reserve(bins.size());
+  for (boost::unordered_map<long long, std::pair<size_t, float> >::const_iterator iter = bins.begin();
+       iter != bins.end(); ++iter)
+  {
+    decimated.push_back(points[iter->second.first]);
+  }
+  points.swap(decimated);
+}
+
+void VoxelLayer::raytraceRays(RaytraceJob* job)
+{
+  ClearVoxelAtomic clear(voxel_grid_.getData(), &job->cleared_columns);
+  for (size_t i = job->begin; i < job->end; ++i)
+  {
+    double wpx = job->points->at(i).x;
+    double wpy = job->points->at(i).y;
+    double wpz = job->points->at(i).z;
+    double point_x, point_y, point_z;
+    if (clipRay(job->ox, job->oy, job->oz, job->map_end_x, job->map_end_y, job->map_end_z,
+                wpx, wpy, wpz, point_x, point_y, point_z))
+    {
+      voxel_grid_.raytraceLine(clear, job->sensor_x, job->sensor_y, job->sensor_z, point_x, point_y, point_z,
+                               job->cell_raytrace_range);
+
+      updateRaytraceBounds(job->ox, job->oy, wpx, wpy, job->raytrace_range,
+                           &job->min_x, &job->min_y, &job->max_x, &job->max_y);
+
+      if (job->publish_clearing_points)
+      {
+        geometry_msgs::Point32 point;
+        point.x = wpx;
+        point.y = wpy;
+        point.z = wpz;
+        job->endpoints.push_back(point);
+      }
+    }
+  }
+}
+
 void VoxelLayer::raytraceFreespace(const Observation& clearing_observation, double* min_x, double* min_y,
                                            double* max_x, double* max_y)
 {
@@ -297,89 +489,143 @@ void VoxelLayer::raytraceFreespace(const Observation& clearing_observation, doub
   double map_end_x = origin_x_ + getSizeInMetersX();
   double map_end_y = origin_y_ + getSizeInMetersY();
   double map_end_z = origin_z_ + size_z_ * z_resolution_;
+  unsigned int cell_raytrace_range = cellDistance(clearing_observation.raytrace_range_);
 
+  std::vector<geometry_msgs::Point32> points;
+  points.reserve(clearing_observation_cloud_size);
 #ifdef COSTMAP_2D_POINTCLOUD2
-    sensor_msgs::PointCloud2ConstIterator<float> iter_x(*(clearing_observation.cloud_), "x");
-    sensor_msgs::PointCloud2ConstIterator<float> iter_y(*(clearing_observation.cloud_), "y");
-    sensor_msgs::PointCloud2ConstIterator<float> iter_z(*(clearing_observation.cloud_), "z");
-
-    for (;iter_x != iter_x.end(); ++iter_x, ++iter_y, ++iter_z)
-    {
-    double wpx = *iter_x;
-    double wpy = *iter_y;
-    double wpz = *iter_z;
+  sensor_msgs::PointCloud2ConstIterator<float> iter_x(*(clearing_observation.cloud_), "x");
+  sensor_msgs::PointCloud2ConstIterator<float> iter_y(*(clearing_observation.cloud_), "y");
+  sensor_msgs::PointCloud2ConstIterator<float> iter_z(*(clearing_observation.cloud_), "z");
+  for (;iter_x != iter_x.end(); ++iter_x, ++iter_y, ++iter_z)
+  {
+    geometry_msgs::Point32 point;
+    point.x = *iter_x;
+    point.y = *iter_y;
+    point.z = *iter_z;
+    points.push_back(point);
+  }
 #else
-    pcl::PointCloud<pcl::PointXYZ>::const_iterator point_it = clearing_observation.cloud_->begin();
-    for (;point_it < clearing_observation.cloud_->end(); ++point_it) {
-        double wpx = point_it->x;
-        double wpy = point_it->y;
-        double wpz = point_it->z;
+  pcl::PointCloud<pcl::PointXYZ>::const_iterator point_it = clearing_observation.cloud_->begin();
+  for (;point_it < clearing_observation.cloud_->end(); ++point_it)
+  {
+    geometry_msgs::Point32 point;
+    point.x = point_it->x;
+    point.y = point_it->y;
+    point.z = point_it->z;
+    points.push_back(point);
+  }
 #endif
 
-    double distance = dist(ox, oy, oz, wpx, wpy, wpz);
-    double scaling_fact = 1.0, scaling_fact_z = 1.0;
-    scaling_fact = std::max(std::min(scaling_fact, (distance - 2 * resolution_) / distance), 0.0);
-    scaling_fact_z = std::max(std::min(scaling_fact_z, (distance - 2 * z_resolution_) / distance), 0.0);
-    wpx = scaling_fact * (wpx - ox) + ox;
-    wpy = scaling_fact * (wpy - oy) + oy;
-    wpz = scaling_fact_z * (wpz - oz) + oz;
-
-    double a = wpx - ox;
-    double b = wpy - oy;
-    double c = wpz - oz;
-    double t = 1.0;
-
-    // the minimum value to raytrace from is the origin
-    if (wpz < origin_z_)
-    {
-      t = std::min(t, (origin_z_ - oz) / c);
-    }
-    if (wpx < origin_x_)
-    {
-      t = std::min(t, (origin_x_ - ox) / a);
-    }
-    if (wpy < origin_y_)
-    {
-      t = std::min(t, (origin_y_ - oy) / b);
-    }
+  if (raytrace_angular_resolution_ > 0.0)
+  {
+    decimateRays(ox, oy, oz, points);
+  }
 
-    // the maximum value to raytrace to is the end of the map
-    if (wpx > map_end_x)
+  int threads = raytrace_threads_ > 0 ? raytrace_threads_ : (int)boost::thread::hardware_concurrency();
+  threads = std::max(1, std::min(threads, (int)points.size()));
+  if (sparse_voxels_)
+  {
+    // chunks are allocated while tracing
+    threads = 1;
+  }
+  if (threads == 1)
+  {
+    for (size_t i = 0; i < points.size(); ++i)
     {
-      t = std::min(t, (map_end_x - ox) / a);
+      double wpx = points[i].x;
+      double wpy = points[i].y;
+      double wpz = points[i].z;
+      double point_x, point_y, point_z;
+      if (clipRay(ox, oy, oz, map_end_x, map_end_y, map_end_z, wpx, wpy, wpz, point_x, point_y, point_z))
+      {
+        // voxel_grid_.markVoxelLine(sensor_x, sensor_y, sensor_z, point_x, point_y, point_z);
+        if (sparse_voxels_)
+        {
+          sparse_voxel_grid_.clearVoxelLineInMap(sensor_x, sensor_y, sensor_z, point_x, point_y, point_z, costmap_,
+                                                 unknown_threshold_, mark_threshold_, FREE_SPACE, NO_INFORMATION,
+                                                 cell_raytrace_range);
+        }
+        else
+        {
+          voxel_grid_.clearVoxelLineInMap(sensor_x, sensor_y, sensor_z, point_x, point_y, point_z, costmap_,
+                                          unknown_threshold_, mark_threshold_, FREE_SPACE, NO_INFORMATION,
+                                          cell_raytrace_range);
+        }
+
+        updateRaytraceBounds(ox, oy, wpx, wpy, clearing_observation.raytrace_range_, min_x, min_y, max_x, max_y);
+
+        if (publish_clearing_points)
+        {
+          geometry_msgs::Point32 point;
+          point.x = wpx;
+          point.y = wpy;
+          point.z = wpz;
+          clearing_endpoints_.points.push_back(point);
+        }
+      }
     }
-    if (wpy > map_end_y)
+  }
+  else
+  {
+    std::vector<RaytraceJob> jobs(threads);
+    size_t chunk = (points.size() + threads - 1) / threads;
+    for (int i = 0; i < threads; ++i)
     {
-      t = std::min(t, (map_end_y - oy) / b);
+      RaytraceJob& job = jobs[i];
+      job.points = &points;
+      job.begin = std::min(points.size(), i * chunk);
+      job.end = std::min(points.size(), job.begin + chunk);
+      job.ox = ox;
+      job.oy = oy;
+      job.oz = oz;
+      job.sensor_x = sensor_x;
+      job.sensor_y = sensor_y;
+      job.sensor_z = sensor_z;
+      job.map_end_x = map_end_x;
+      job.map_end_y = map_end_y;
+      job.map_end_z = map_end_z;
+      job.raytrace_range = clearing_observation.raytrace_range_;
+      job.cell_raytrace_range = cell_raytrace_range;
+      job.publish_clearing_points = publish_clearing_points;
+      job.min_x = *min_x;
+      job.min_y = *min_y;
+      job.max_x = *max_x;
+      job.max_y = *max_y;
     }
-    if (wpz > map_end_z)
+    boost::thread_group workers;
+    for (int i = 1; i < threads; ++i)
     {
-      t = std::min(t, (map_end_z - oz) / c);
+      workers.create_thread(boost::bind(&VoxelLayer::raytraceRays, this, &jobs[i]));
     }
+    raytraceRays(&jobs[0]);
+    workers.join_all();
 
-    wpx = ox + a * t;
-    wpy = oy + b * t;
-    wpz = oz + c * t;
-
-    double point_x, point_y, point_z;
-    if (worldToMap3DFloat(wpx, wpy, wpz, point_x, point_y, point_z))
+    // Clearing only removes bits, so the final state of the column gives
+    // the same cost as if the rays were traced sequentially
+    uint32_t* data = voxel_grid_.getData();
+    for (size_t i = 0; i < jobs.size(); ++i)
     {
-      unsigned int cell_raytrace_range = cellDistance(clearing_observation.raytrace_range_);
-
-      // voxel_grid_.markVoxelLine(sensor_x, sensor_y, sensor_z, point_x, point_y, point_z);
-      voxel_grid_.clearVoxelLineInMap(sensor_x, sensor_y, sensor_z, point_x, point_y, point_z, costmap_,
-                                      unknown_threshold_, mark_threshold_, FREE_SPACE, NO_INFORMATION,
-                                      cell_raytrace_range);
-
-      updateRaytraceBounds(ox, oy, wpx, wpy, clearing_observation.raytrace_range_, min_x, min_y, max_x, max_y);
-
+      const std::vector<unsigned int>& cleared_columns = jobs[i].cleared_columns;
+      for (size_t j = 0; j < cleared_columns.size(); ++j)
+      {
+        unsigned int offset = cleared_columns[j];
+        uint32_t col = data[offset];
+        unsigned int unknown_bits = uint16_t(col >> 16) ^ uint16_t(col);
+        unsigned int marked_bits = col >> 16;
+        if (bitsBelowThreshold(marked_bits, mark_threshold_))
+        {
+          costmap_[offset] = bitsBelowThreshold(unknown_bits, unknown_threshold_) ? FREE_SPACE : NO_INFORMATION;
+        }
+      }
+      *min_x = std::min(*min_x, jobs[i].min_x);
+      *min_y = std::min(*min_y, jobs[i].min_y);
+      *max_x = std::max(*max_x, jobs[i].max_x);
+      *max_y = std::max(*max_y, jobs[i].max_y);
       if (publish_clearing_points)
       {
-        geometry_msgs::Point32 point;
-        point.x = wpx;
-        point.y = wpy;
-        point.z = wpz;
-        clearing_endpoints_.points.push_back(point);
+        clearing_endpoints_.points.insert(clearing_endpoints_.points.end(),
+                                          jobs[i].endpoints.begin(), jobs[i].endpoints.end());
       }
     }
   }
@@ -456,16 +702,27 @@ void VoxelLayer::updateOrigin(double new_origin_x, double new_origin_y)
 
   // we need a map to store the obstacles in the window temporarily
   unsigned char* local_map = new unsigned char[cell_size_x * cell_size_y];
-  unsigned int* local_voxel_map = new unsigned int[cell_size_x * cell_size_y];
-  unsigned int* voxel_map = voxel_grid_.getData();
+  unsigned int* local_voxel_map = 0;
+  unsigned int* voxel_map = 0;
 
   // copy the local window in the costmap to the local map
   copyMapRegion(costmap_, lower_left_x, lower_left_y, size_x_, local_map, 0, 0, cell_size_x, cell_size_x, cell_size_y);
-  copyMapRegion(voxel_map, lower_left_x, lower_left_y, size_x_, local_voxel_map, 0, 0, cell_size_x, cell_size_x,
-                cell_size_y);
+  if (sparse_voxels_)
+  {
+    // chunks are kept in world cells, just drop those outside the new window
+    sparse_voxel_grid_.shiftOrigin(cell_ox, cell_oy, cell_oz);
+    Costmap2D::resetMaps();
+  }
+  else
+  {
+    local_voxel_map = new unsigned int[cell_size_x * cell_size_y];
+    voxel_map = voxel_grid_.getData();
+    copyMapRegion(voxel_map, lower_left_x, lower_left_y, size_x_, local_voxel_map, 0, 0, cell_size_x, cell_size_x,
+                  cell_size_y);
 
-  // we'll reset our maps to unknown space if appropriate
-  resetMaps();
+    // we'll reset our maps to unknown space if appropriate
+    resetMaps();
+  }
 
   // update the origin with the appropriate world coordinates
   origin_x_ = new_grid_ox;
@@ -478,7 +735,10 @@ void VoxelLayer::updateOrigin(double new_origin_x, double new_origin_y)
 
   // now we want to copy the overlapping information back into the map, but in its new location
   copyMapRegion(local_map, 0, 0, cell_size_x, costmap_, start_x, start_y, size_x_, cell_size_x, cell_size_y);
-  copyMapRegion3D(local_voxel_map, 0, 0, cell_size_x, voxel_map, start_x, start_y, size_x_, cell_size_x, cell_size_y, cell_oz);
+  if (local_voxel_map)
+  {
+    copyMapRegion3D(local_voxel_map, 0, 0, cell_size_x, voxel_map, start_x, start_y, size_x_, cell_size_x, cell_size_y, cell_oz);
+  }
 
   // make sure to clean up
   delete[] local_map;
@@ -39,12 +39,15 @@
 /**
  * Modified matlabbe:
  * Added option to choose between unknown, free and marked cells
+ * Added differential mode publishing only the tiles that changed
  */
 
 #include <ros/ros.h>
 #include <visualization_msgs/MarkerArray.h>
 #include <costmap_2d/VoxelGrid.h>
 #include <voxel_grid/voxel_grid.h>
+#include <boost/unordered_map.hpp>
+#include <cmath>
 
 struct Cell
 {
@@ -63,6 +66,164 @@ float g_colors_a[] = {0.5f, 0.1f, 0.5f};
 std::string g_marker_ns;
 V_Cell g_cells;
 int g_cell_type;
+
+// Differential mode: the grid is split in tiles of g_tile_size x g_tile_size
+// columns aligned on world cells, each tile is a CUBE_LIST marker that is
+// republished only when its voxels changed.
+bool g_differential = false;
+int g_tile_size = 16;
+typedef std::pair<int, int> TileKey;
+typedef boost::unordered_map<TileKey, std::vector<uint16_t> > Tiles; // voxels of g_cell_type per column
+Tiles g_tiles;
+std::string g_tiles_frame_id;
+double g_tiles_res[3] = {0.0, 0.0, 0.0};
+long g_tiles_z_origin = 0;
+visualization_msgs::Marker g_tile_marker; // reused between callbacks
+
+static uint16_t columnMask(uint32_t column, uint32_t z_size)
+{
+  // known marked: 11, unknown: 01 or 10, known free: 00 (see VoxelGrid::getVoxel())
+  uint16_t hi = column >> 16;
+  uint16_t lo = column & 0xFFFF;
+  uint16_t z_mask = z_size >= 16 ? 0xFFFF : (uint16_t)((1 << z_size) - 1);
+  if (g_cell_type == voxel_grid::MARKED)
+    return hi & lo & z_mask;
+  if (g_cell_type == voxel_grid::UNKNOWN)
+    return (hi ^ lo) & z_mask;
+  return ~(hi | lo) & z_mask;
+}
+
+static int floorDiv(long a, int b)
+{
+  return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+static int tileId(const TileKey& key)
+{
+  return ((key.first & 0xFFFF) << 16) | (key.second & 0xFFFF);
+}
+
+void voxelDifferentialCallback(const ros::Publisher& pub, const costmap_2d::VoxelGridConstPtr& grid)
+{
+  if (grid->data.empty())
+  {
+    ROS_ERROR("Received empty voxel grid");
+    return;
+  }
+
+  ros::WallTime start = ros::WallTime::now();
+
+  const uint32_t* data = &grid->data.front();
+  const double x_res = grid->resolutions.x;
+  const double y_res = grid->resolutions.y;
+  const double z_res = grid->resolutions.z;
+  const uint32_t x_size = grid->size_x;
+  const uint32_t y_size = grid->size_y;
+  const uint32_t z_size = grid->size_z;
+
+  // grid origin in world cells
+  const long x_origin = std::lround(grid->origin.x / x_res);
+  const long y_origin = std::lround(grid->origin.y / y_res);
+  const long z_origin = std::lround(grid->origin.z / z_res);
+
+  g_tile_marker.header = grid->header;
+  g_tile_marker.scale.x = x_res;
+  g_tile_marker.scale.y = y_res;
+  g_tile_marker.scale.z = z_res;
+  if (g_tiles_frame_id != grid->header.frame_id ||
+      g_tiles_res[0] != x_res || g_tiles_res[1] != y_res || g_tiles_res[2] != z_res ||
+      g_tiles_z_origin != z_origin)
+  {
+    // everything changed, clear all markers
+    if (!g_tiles_frame_id.empty())
+    {
+      visualization_msgs::Marker m;
+      m.header = grid->header;
+      m.ns = g_marker_ns;
+      m.action = 3; // DELETEALL
+      pub.publish(m);
+    }
+    g_tiles.clear();
+    g_tiles_frame_id = grid->header.frame_id;
+    g_tiles_res[0] = x_res;
+    g_tiles_res[1] = y_res;
+    g_tiles_res[2] = z_res;
+    g_tiles_z_origin = z_origin;
+  }
+
+  // voxels of each tile in the new grid
+  Tiles tiles;
+  for (uint32_t y_grid = 0; y_grid < y_size; ++y_grid)
+  {
+    long gy = y_origin + y_grid;
+    int ty = floorDiv(gy, g_tile_size);
+    for (uint32_t x_grid = 0; x_grid < x_size; ++x_grid)
+    {
+      uint16_t mask = columnMask(data[y_grid * x_size + x_grid], z_size);
+      if (mask)
+      {
+        long gx = x_origin + x_grid;
+        int tx = floorDiv(gx, g_tile_size);
+        std::vector<uint16_t>& tile = tiles[TileKey(tx, ty)];
+        if (tile.empty())
+        {
+          tile.resize(g_tile_size * g_tile_size, 0);
+        }
+        tile[(gy - (long)ty * g_tile_size) * g_tile_size + (gx - (long)tx * g_tile_size)] = mask;
+      }
+    }
+  }
+
+  int published = 0;
+  int removed = 0;
+  for (Tiles::iterator iter = g_tiles.begin(); iter != g_tiles.end(); ++iter)
+  {
+    if (tiles.find(iter->first) == tiles.end())
+    {
+      g_tile_marker.id = tileId(iter->first);
+      g_tile_marker.action = visualization_msgs::Marker::DELETE;
+      g_tile_marker.points.clear();
+      pub.publish(g_tile_marker);
+      ++removed;
+    }
+  }
+  for (Tiles::iterator iter = tiles.begin(); iter != tiles.end(); ++iter)
+  {
+    Tiles::iterator previous = g_tiles.find(iter->first);
+    if (previous != g_tiles.end() && previous->second == iter->second)
+    {
+      continue;
+    }
+    g_tile_marker.id = tileId(iter->first);
+    g_tile_marker.action = visualization_msgs::Marker::ADD;
+    g_tile_marker.points.clear();
+    for (int j = 0; j < g_tile_size; ++j)
+    {
+      for (int i = 0; i < g_tile_size; ++i)
+      {
+        uint16_t mask = iter->second[j * g_tile_size + i];
+        for (uint32_t z_grid = 0; mask; ++z_grid, mask >>= 1)
+        {
+          if (mask & 1)
+          {
+            geometry_msgs::Point p;
+            p.x = ((double)iter->first.first * g_tile_size + i + 0.5) * x_res;
+            p.y = ((double)iter->first.second * g_tile_size + j + 0.5) * y_res;
+            p.z = grid->origin.z + (z_grid + 0.5) * z_res;
+            g_tile_marker.points.push_back(p);
+          }
+        }
+      }
+    }
+    pub.publish(g_tile_marker);
+    ++published;
+  }
+  g_tiles.swap(tiles);
+
+  ros::WallTime end = ros::WallTime::now();
+  ROS_DEBUG("Published %d tiles (%d removed, %d total) in %f seconds",
+            published, removed, (int)g_tiles.size(), (end - start).toSec());
+}
 void voxelCallback(const ros::Publisher& pub, const costmap_2d::VoxelGridConstPtr& grid)
 {
   if (grid->data.empty())
@@ -149,13 +310,21 @@ ros::Subscriber sub;
 void connectCb()
 {
 	ros::NodeHandle n;
-	sub = n.subscribe < costmap_2d::VoxelGrid > ("voxel_grid", 1, boost::bind(voxelCallback, pub, boost::placeholders::_1));
+	if(g_differential)
+		sub = n.subscribe < costmap_2d::VoxelGrid > ("voxel_grid", 1, boost::bind(voxelDifferentialCallback, pub, boost::placeholders::_1));
+	else
+		sub = n.subscribe < costmap_2d::VoxelGrid > ("voxel_grid", 1, boost::bind(voxelCallback, pub, boost::placeholders::_1));
 }
 
 void disconnectCb()
 {
 	if(pub.getNumSubscribers()==0)
+	{
 		sub.shutdown();
+		// new subscribers should receive all tiles
+		g_tiles.clear();
+		g_tiles_frame_id.clear();
+	}
 }
 
 int main(int argc, char** argv)
@@ -169,14 +338,26 @@ int main(int argc, char** argv)
   pnh.param("g", g_colors_g[g_cell_type], g_colors_g[g_cell_type]);
   pnh.param("b", g_colors_b[g_cell_type], g_colors_b[g_cell_type]);
   pnh.param("a", g_colors_a[g_cell_type], g_colors_a[g_cell_type]);
+  pnh.param("differential", g_differential, g_differential);
+  pnh.param("tile_size", g_tile_size, g_tile_size);
+  g_tile_size = std::max(1, g_tile_size);
 
   ROS_DEBUG("Startup");
 
   ros::SubscriberStatusCallback connect_cb = boost::bind(connectCb);
   ros::SubscriberStatusCallback disconnect_cb = boost::bind(disconnectCb);
 
-  pub = n.advertise < visualization_msgs::Marker > ("visualization_marker", 1, connect_cb, disconnect_cb);
+  // in differential mode, many tile markers can be published at once
+  pub = n.advertise < visualization_msgs::Marker > ("visualization_marker", g_differential?1000:1, connect_cb, disconnect_cb);
   g_marker_ns = n.resolveName("voxel_grid");
 
+  g_tile_marker.ns = g_marker_ns;
+  g_tile_marker.type = visualization_msgs::Marker::CUBE_LIST;
+  g_tile_marker.pose.orientation.w = 1.0;
+  g_tile_marker.color.r = g_colors_r[g_cell_type];
+  g_tile_marker.color.g = g_colors_g[g_cell_type];
+  g_tile_marker.color.b = g_colors_b[g_cell_type];
+  g_tile_marker.color.a = g_colors_a[g_cell_type];
+
   ros::spin();
 }
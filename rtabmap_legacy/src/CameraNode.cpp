@@ -32,6 +32,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <std_msgs/Empty.h>
 #include <image_transport/image_transport.h>
 #include <std_srvs/Empty.h>
+#include <boost/make_shared.hpp>
 
 #include <rtabmap/core/CameraRGB.h>
 #include <rtabmap/core/CameraThread.h>
@@ -227,17 +228,15 @@ protected:
 			const cv::Mat & image = e->data().imageRaw();
 			if(!image.empty() && image.depth() == CV_8U)
 			{
-				cv_bridge::CvImage img;
-				if(image.channels() == 1)
-				{
-					img.encoding = sensor_msgs::image_encodings::MONO8;
-				}
-				else
-				{
-					img.encoding = sensor_msgs::image_encodings::BGR8;
-				}
-				img.image = image;
-				sensor_msgs::ImagePtr rosMsg = img.toImageMsg();
+				// Copy directly in a reused message buffer
+				sensor_msgs::ImagePtr rosMsg = getPooledImage();
+				rosMsg->encoding = image.channels() == 1?sensor_msgs::image_encodings::MONO8:sensor_msgs::image_encodings::BGR8;
+				rosMsg->height = image.rows;
+				rosMsg->width = image.cols;
+				rosMsg->is_bigendian = false;
+				rosMsg->step = image.cols*image.elemSize();
+				rosMsg->data.resize(rosMsg->step*image.rows); // no reallocation if the size didn't change
+				image.copyTo(cv::Mat(image.size(), image.type(), rosMsg->data.data(), rosMsg->step));
 				rosMsg->header.frame_id = frameId_;
 				rosMsg->header.stamp = ros::Time::now();
 				rosPublisher_.publish(rosMsg);
@@ -246,8 +245,29 @@ protected:
 		return false;
 	}
 
+private:
+	// Reuse the messages not referenced anymore (by the publisher's queue
+	// or subscribers), to avoid allocating a new image at each frame.
+	sensor_msgs::ImagePtr getPooledImage()
+	{
+		for(size_t i=0; i<imagePool_.size(); ++i)
+		{
+			if(imagePool_[i].unique())
+			{
+				return imagePool_[i];
+			}
+		}
+		sensor_msgs::ImagePtr msg = boost::make_shared<sensor_msgs::Image>();
+		if(imagePool_.size() < 4)
+		{
+			imagePool_.push_back(msg);
+		}
+		return msg;
+	}
+
 private:
 	image_transport::Publisher rosPublisher_;
+	std::vector<sensor_msgs::ImagePtr> imagePool_;
 	rtabmap::CameraThread * cameraThread_;
 	rtabmap::Camera * camera_;
 	ros::ServiceServer startSrv_;
@@ -34,6 +34,89 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <image_transport/image_transport.h>
 #include <sensor_msgs/CameraInfo.h>
 #include <cv_bridge/cv_bridge.h>
+#include <boost/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/make_shared.hpp>
+
+// Reuse the messages not referenced anymore (by intra-process subscribers
+// or the publisher's queue), to avoid allocating new images at each frame.
+static sensor_msgs::ImagePtr getPooledImage(std::vector<sensor_msgs::ImagePtr> & pool, size_t maxSize)
+{
+	for(size_t i=0; i<pool.size(); ++i)
+	{
+		if(pool[i].unique())
+		{
+			return pool[i];
+		}
+	}
+	sensor_msgs::ImagePtr msg = boost::make_shared<sensor_msgs::Image>();
+	if(pool.size() < maxSize)
+	{
+		pool.push_back(msg);
+	}
+	return msg;
+}
+
+// Resize (or copy) the image directly in the message buffer
+static void toImageMsg(const cv::Mat & image, double scale, const std::string & encoding, const std_msgs::Header & header, sensor_msgs::Image & msg)
+{
+	cv::Size size = scale == 1.0?image.size():cv::Size(cvRound(image.cols*scale), cvRound(image.rows*scale));
+	msg.header = header;
+	msg.encoding = encoding;
+	msg.height = size.height;
+	msg.width = size.width;
+	msg.is_bigendian = false;
+	msg.step = size.width*image.elemSize();
+	msg.data.resize(msg.step*size.height); // no reallocation if the size didn't change
+	cv::Mat wrapped(size, image.type(), msg.data.data(), msg.step);
+	if(scale == 1.0)
+	{
+		image.copyTo(wrapped);
+	}
+	else
+	{
+		cv::resize(image, wrapped, size, 0, 0, CV_INTER_AREA);
+	}
+}
+
+// Latest captured frame, shared between the capture thread and the publishing loop
+struct CaptureBuffer
+{
+	CaptureBuffer() : pending(false), running(true), dropped(0) {}
+	boost::mutex mutex;
+	boost::condition_variable condition;
+	rtabmap::SensorData data;
+	ros::Time stamp;
+	bool pending;
+	bool running;
+	int dropped;
+};
+
+// Capture and rectification (done by the camera) of the next frame
+// while the previous one is converted and published.
+static void captureLoop(rtabmap::CameraStereoVideo * camera, CaptureBuffer * buffer)
+{
+	while(true)
+	{
+		rtabmap::SensorData data = camera->takeImage();
+		ros::Time stamp = ros::Time::now();
+
+		boost::mutex::scoped_lock lock(buffer->mutex);
+		if(!buffer->running)
+		{
+			break;
+		}
+		if(buffer->pending)
+		{
+			++buffer->dropped;
+			ROS_DEBUG("Publishing is too slow, dropping frame %f (%d dropped so far)", buffer->stamp.toSec(), buffer->dropped);
+		}
+		buffer->data = data;
+		buffer->stamp = stamp;
+		buffer->pending = true;
+		buffer->condition.notify_one();
+	}
+}
 
 int main(int argc, char** argv)
 {
@@ -47,10 +130,16 @@ int main(int argc, char** argv)
 	std::string id = "camera";
 	std::string frameId = "camera_link";
 	double scale = 1.0;
+	bool asyncCapture = false;
+	int bufferPoolSize = 4;
 	pnh.param("rate", rate, rate);
 	pnh.param("camera_id", id, id);
 	pnh.param("frame_id", frameId, frameId);
 	pnh.param("scale", scale, scale);
+	pnh.param("async_capture", asyncCapture, asyncCapture);
+	pnh.param("buffer_pool_size", bufferPoolSize, bufferPoolSize);
+	ROS_INFO("stereo_camera: async_capture = %s", asyncCapture?"true":"false");
+	ROS_INFO("stereo_camera: buffer_pool_size = %d", bufferPoolSize);
 
 	rtabmap::CameraStereoVideo camera(0, false, rate);
 
@@ -67,32 +156,73 @@ int main(int argc, char** argv)
 		ros::Publisher infoLeftPub = left_nh.advertise<sensor_msgs::CameraInfo>(left_nh.resolveName("camera_info"), 1);
 		ros::Publisher infoRightPub = right_nh.advertise<sensor_msgs::CameraInfo>(right_nh.resolveName("camera_info"), 1);
 
+		std::vector<sensor_msgs::ImagePtr> leftPool;
+		std::vector<sensor_msgs::ImagePtr> rightPool;
+		// calibration doesn't change, convert it only once
+		sensor_msgs::CameraInfo infoLeft, infoRight;
+		bool infoReady = false;
+
+		CaptureBuffer buffer;
+		boost::thread * captureThread = 0;
+		if(asyncCapture)
+		{
+			captureThread = new boost::thread(boost::bind(&captureLoop, &camera, &buffer));
+		}
+
 		while(ros::ok())
 		{
-			rtabmap::SensorData data = camera.takeImage();
-			
-			ros::Time currentTime = ros::Time::now();
-
-			cv_bridge::CvImage imageLeft;
-			imageLeft.header.frame_id = frameId;
-			imageLeft.header.stamp = currentTime;
-			imageLeft.encoding = "bgr8";
-			cv::resize(data.imageRaw(), imageLeft.image, cv::Size(0,0), scale, scale, CV_INTER_AREA);
-			imageLeftPub.publish(imageLeft.toImageMsg());
-
-			cv_bridge::CvImage imageRight;
-			imageRight.header = imageLeft.header;
-			imageRight.encoding = "mono8";
-			cv::resize(data.rightRaw(), imageRight.image, cv::Size(0,0), scale, scale, CV_INTER_AREA);
-			imageRightPub.publish(imageRight.toImageMsg());
+			rtabmap::SensorData data;
+			ros::Time currentTime;
+			if(captureThread)
+			{
+				boost::mutex::scoped_lock lock(buffer.mutex);
+				while(ros::ok() && !buffer.pending)
+				{
+					buffer.condition.timed_wait(lock, boost::posix_time::milliseconds(100));
+				}
+				if(!buffer.pending)
+				{
+					continue;
+				}
+				data = buffer.data;
+				currentTime = buffer.stamp;
+				buffer.data = rtabmap::SensorData();
+				buffer.pending = false;
+			}
+			else
+			{
+				data = camera.takeImage();
+				currentTime = ros::Time::now();
+			}
+
+			if(data.imageRaw().empty() || data.rightRaw().empty())
+			{
+				ros::spinOnce();
+				continue;
+			}
+
+			std_msgs::Header header;
+			header.frame_id = frameId;
+			header.stamp = currentTime;
+
+			sensor_msgs::ImagePtr imageLeft = getPooledImage(leftPool, bufferPoolSize);
+			toImageMsg(data.imageRaw(), scale, "bgr8", header, *imageLeft);
+			imageLeftPub.publish(imageLeft);
+
+			sensor_msgs::ImagePtr imageRight = getPooledImage(rightPool, bufferPoolSize);
+			toImageMsg(data.rightRaw(), scale, "mono8", header, *imageRight);
+			imageRightPub.publish(imageRight);
 
 			if(data.stereoCameraModels().size())
 			{
-				sensor_msgs::CameraInfo infoLeft, infoRight;
-				rtabmap_conversions::cameraModelToROS(data.stereoCameraModels()[0].left().scaled(scale), infoLeft);
-				rtabmap_conversions::cameraModelToROS(data.stereoCameraModels()[0].right().scaled(scale), infoRight);
-				infoLeft.header = imageLeft.header;
-				infoRight.header = imageLeft.header;
+				if(!infoReady)
+				{
+					rtabmap_conversions::cameraModelToROS(data.stereoCameraModels()[0].left().scaled(scale), infoLeft);
+					rtabmap_conversions::cameraModelToROS(data.stereoCameraModels()[0].right().scaled(scale), infoRight);
+					infoReady = true;
+				}
+				infoLeft.header = header;
+				infoRight.header = header;
 				infoLeftPub.publish(infoLeft);
 				infoRightPub.publish(infoRight);
 			}
@@ -103,6 +233,16 @@ int main(int argc, char** argv)
 
 			ros::spinOnce();
 		}
+
+		if(captureThread)
+		{
+			{
+				boost::mutex::scoped_lock lock(buffer.mutex);
+				buffer.running = false;
+			}
+			captureThread->join();
+			delete captureThread;
+		}
 	}
 	else
 	{
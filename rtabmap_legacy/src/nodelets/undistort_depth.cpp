@@ -94,11 +94,22 @@ private:
 
 		if(pub_.getNumSubscribers())
 		{
-			if(depth->width == model_.getWidth() && depth->width == model_.getWidth())
+			if(depth->width == model_.getWidth() && depth->height == model_.getHeight())
 			{
-				cv_bridge::CvImagePtr imageDepthPtr = cv_bridge::toCvCopy(depth);
-				model_.undistort(imageDepthPtr->image);
-				pub_.publish(imageDepthPtr->toImageMsg());
+				// Undistort directly in the output message buffer, so that
+				// the image is copied only once
+				sensor_msgs::ImagePtr output(new sensor_msgs::Image(*depth));
+				cv::Mat image(
+						output->height,
+						output->width,
+						depth->encoding.compare(sensor_msgs::image_encodings::TYPE_32FC1)==0?CV_32FC1:CV_16UC1,
+						output->data.data(),
+						output->step);
+				// The per-bin multipliers of the model are not accessible
+				// from rtabmap's clams API, so the model is applied as is
+				// (no precomputed remap/scale tables here).
+				model_.undistort(image);
+				pub_.publish(output);
 			}
 			else
 			{
@@ -37,14 +37,19 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <std_srvs/Empty.h>
 #include <std_msgs/Header.h>
 #include <sensor_msgs/Imu.h>
+#include <nav_msgs/Odometry.h>
 
 #include <rtabmap_msgs/ResetPose.h>
 #include <rtabmap/core/SensorData.h>
 #include <rtabmap/core/Parameters.h>
+#include <rtabmap/core/OdometryInfo.h>
 
 #include <boost/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
 
 #include "rtabmap_util/ULogToRosout.h"
+#include "rtabmap_util/TimedRingBuffer.h"
+#include "rtabmap_conversions/ThreadPool.h"
 
 namespace rtabmap {
 class Odometry;
@@ -85,6 +90,9 @@ protected:
 	double waitForTransformDuration() const {return waitForTransform_?waitForTransformDuration_:0.0;}
 	rtabmap::Transform velocityGuess() const;
 	double previousStamp() const {return previousStamp_;}
+	// Called after each processed frame. With async_processing, it is called
+	// from the processing thread, not from the subscriber callbacks: members
+	// also used by the callbacks should be protected by a mutex.
 	virtual void postProcessData(const rtabmap::SensorData & data, const std_msgs::Header & header) const {}
 
 private:
@@ -96,6 +104,13 @@ private:
 	void callbackIMU(const sensor_msgs::ImuConstPtr& msg);
 	void reset(const rtabmap::Transform & pose = rtabmap::Transform::getIdentity());
 
+	void processDataImpl(rtabmap::SensorData & data, const std_msgs::Header & header);
+	void publishOdomInfo(const rtabmap::OdometryInfo & info, const rtabmap::SensorData & data, const std_msgs::Header & header, bool poseValid, bool keyframe = false, const nav_msgs::Odometry & keyframeOdom = nav_msgs::Odometry());
+	bool isKeyframe(const rtabmap::Transform & pose, double stamp);
+	void publishKeyframe(const rtabmap::OdometryInfo & info, const rtabmap::SensorData & data, const std_msgs::Header & header, const nav_msgs::Odometry & odom);
+	void processingLoop();
+	void publishingLoop();
+
 private:
 	rtabmap::Odometry * odometry_;
 	boost::thread * warningThread_;
@@ -114,6 +129,9 @@ private:
 	bool waitForTransform_;
 	double waitForTransformDuration_;
 	bool publishNullWhenLost_;
+	bool odomInfoPacked_;
+	bool publishOdomSensorData_;
+	std::string odomSensorDataChannel_;
 	rtabmap::ParametersMap parameters_;
 
 	ros::Publisher odomPub_;
@@ -123,6 +141,9 @@ private:
 	ros::Publisher odomLocalScanMap_;
 	ros::Publisher odomLastFrame_;
 	ros::Publisher odomRgbdImagePub_;
+	ros::Publisher keyframeRgbdImagePub_;
+	ros::Publisher keyframeOdomPub_;
+	ros::Publisher keyframeOdomInfoPub_;
 	ros::ServiceServer resetSrv_;
 	ros::ServiceServer resetToPoseSrv_;
 	ros::ServiceServer pauseSrv_;
@@ -150,8 +171,54 @@ private:
 	int odomStrategy_;
 	bool waitIMUToinit_;
 	bool imuProcessed_;
-	std::map<double, rtabmap::IMU> imus_;
+	rtabmap_util::TimedRingBuffer<rtabmap::IMU> imus_;
+	std::vector<std::pair<double, rtabmap::IMU> > imuBatch_;
 	std::pair<rtabmap::SensorData, std_msgs::Header > bufferedData_;
+	boost::mutex imuMutex_;
+	boost::mutex odometryMutex_;
+
+	// asynchronous processing (next frame is converted
+	// while the current one is processed)
+	boost::thread * processingThread_;
+	bool processingThreadRunning_;
+	boost::mutex processingMutex_;
+	boost::condition_variable processingCondition_;
+	bool processingPending_;
+	std::pair<rtabmap::SensorData, std_msgs::Header > processingData_;
+	int processingDropped_;
+	double processingLastStamp_; // last frame sent to the processing thread
+
+	// placement of the processing and publishing threads
+	rtabmap_conversions::ThreadSettings threadSettings_;
+
+	// keyframe bundles (compressed rgbd image + odom + odom info)
+	double keyframeMinLinear_;
+	double keyframeMinAngular_;
+	double keyframeMaxInterval_;
+	double keyframeMaxBandwidth_; // KB/s
+	rtabmap::Transform keyframeLastPose_;
+	double keyframeLastStamp_;
+	double keyframeBudget_; // bytes
+	double keyframeBudgetStamp_;
+	size_t keyframeLastBytes_;
+
+	// asynchronous publishing of odom_info, local maps and rgbd image
+	struct PublishingJob
+	{
+		rtabmap::OdometryInfo info;
+		rtabmap::SensorData data;
+		std_msgs::Header header;
+		bool poseValid;
+		bool keyframe;
+		nav_msgs::Odometry keyframeOdom;
+		PublishingJob() : poseValid(false), keyframe(false) {}
+	};
+	boost::thread * publishingThread_;
+	bool publishingThreadRunning_;
+	boost::mutex publishingMutex_;
+	boost::condition_variable publishingCondition_;
+	bool publishingPending_;
+	PublishingJob publishingJob_;
 
 	rtabmap_util::ULogToRosout ulogToRosout_;
 };
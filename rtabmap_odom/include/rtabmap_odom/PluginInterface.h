@@ -3,6 +3,7 @@
 
 #include <ros/ros.h>
 #include <string>
+#include <vector>
 #include <sensor_msgs/PointCloud2.h>
 
 namespace rtabmap_odom
@@ -27,6 +28,13 @@ public:
 
   virtual sensor_msgs::PointCloud2 filterPointCloud(const sensor_msgs::PointCloud2 msg) = 0;
 
+  /** @brief Filter all clouds received for the same odometry update at once
+   * (e.g., one per lidar), so that a plugin can process them as a single batch
+   * on its accelerator. Clouds are returned in the same order. The default
+   * implementation calls filterPointCloud() on each cloud.
+   **/
+  virtual std::vector<sensor_msgs::PointCloud2ConstPtr> filterPointClouds(const std::vector<sensor_msgs::PointCloud2ConstPtr> & msgs);
+
 protected:
   /** @brief This is called at the end of initialize().  Override to
    * implement subclass-specific initialization.
@@ -26,6 +26,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "rtabmap_odom/OdometryROS.h"
+#include "rtabmap_conversions/SensorDataChannel.h"
 
 #include <sensor_msgs/Image.h>
 #include <sensor_msgs/image_encodings.h>
@@ -42,6 +43,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/core/util3d_transforms.h>
 #include <rtabmap/core/Memory.h>
 #include <rtabmap/core/Signature.h>
+#include <rtabmap/core/Compression.h>
 #include "rtabmap_conversions/MsgConversion.h"
 #include "rtabmap_msgs/OdomInfo.h"
 #include "rtabmap/utilite/UConversion.h"
@@ -72,6 +74,8 @@ OdometryROS::OdometryROS(bool stereoParams, bool visParams, bool icpParams) :
 	waitForTransform_(true),
 	waitForTransformDuration_(0.1), // 100 ms
 	publishNullWhenLost_(true),
+	odomInfoPacked_(false),
+	publishOdomSensorData_(false),
 	paused_(false),
 	resetCountdown_(0),
 	resetCurrentCount_(0),
@@ -84,7 +88,23 @@ OdometryROS::OdometryROS(bool stereoParams, bool visParams, bool icpParams) :
 	minUpdateRate_(0.0),
 	odomStrategy_(Parameters::defaultOdomStrategy()),
 	waitIMUToinit_(false),
-	imuProcessed_(false)
+	imuProcessed_(false),
+	processingThread_(0),
+	processingThreadRunning_(false),
+	processingPending_(false),
+	processingDropped_(0),
+	processingLastStamp_(0.0),
+	keyframeMinLinear_(0.0),
+	keyframeMinAngular_(0.0),
+	keyframeMaxInterval_(1.0),
+	keyframeMaxBandwidth_(0.0),
+	keyframeLastStamp_(0.0),
+	keyframeBudget_(0.0),
+	keyframeBudgetStamp_(0.0),
+	keyframeLastBytes_(0),
+	publishingThread_(0),
+	publishingThreadRunning_(false),
+	publishingPending_(false)
 {
 
 }
@@ -98,6 +118,28 @@ OdometryROS::~OdometryROS()
 		delete warningThread_;
 	}
 
+	if(processingThread_)
+	{
+		{
+			boost::mutex::scoped_lock lock(processingMutex_);
+			processingThreadRunning_ = false;
+		}
+		processingCondition_.notify_one();
+		processingThread_->join();
+		delete processingThread_;
+	}
+
+	if(publishingThread_)
+	{
+		{
+			boost::mutex::scoped_lock lock(publishingMutex_);
+			publishingThreadRunning_ = false;
+		}
+		publishingCondition_.notify_one();
+		publishingThread_->join();
+		delete publishingThread_;
+	}
+
 	delete odometry_;
 }
 
@@ -113,6 +155,11 @@ void OdometryROS::onInit()
 	odomLocalScanMap_ = nh.advertise<sensor_msgs::PointCloud2>("odom_local_scan_map", 1);
 	odomLastFrame_ = nh.advertise<sensor_msgs::PointCloud2>("odom_last_frame", 1);
 	odomRgbdImagePub_ = nh.advertise<rtabmap_msgs::RGBDImage>("odom_rgbd_image", 1);
+	// in-process channel, see rtabmap_conversions::SensorDataChannel
+	odomSensorDataChannel_ = nh.resolveName("odom_sensor_data");
+	keyframeRgbdImagePub_ = nh.advertise<rtabmap_msgs::RGBDImage>("odom_keyframe/rgbd_image", 1);
+	keyframeOdomPub_ = nh.advertise<nav_msgs::Odometry>("odom_keyframe/odom", 1);
+	keyframeOdomInfoPub_ = nh.advertise<rtabmap_msgs::OdomInfo>("odom_keyframe/odom_info", 1);
 
 	Transform initialPose = Transform::getIdentity();
 	std::string initialPoseStr;
@@ -126,11 +173,27 @@ void OdometryROS::onInit()
 	}
 	pnh.param("wait_for_transform", waitForTransform_, waitForTransform_);
 	pnh.param("wait_for_transform_duration",  waitForTransformDuration_, waitForTransformDuration_);
+	bool tfCache = false;
+	int tfCacheSize = 100;
+	pnh.param("tf_cache", tfCache, tfCache);
+	pnh.param("tf_cache_size", tfCacheSize, tfCacheSize);
+	if(tfCache)
+	{
+		// shared by all nodelets of the same process
+		NODELET_INFO("Odometry: tf_cache enabled (tf_cache_size=%d)", tfCacheSize);
+		rtabmap_conversions::setTransformCacheEnabled(true, tfCacheSize);
+	}
 	pnh.param("initial_pose", initialPoseStr, initialPoseStr); // "x y z roll pitch yaw"
 	pnh.param("ground_truth_frame_id", groundTruthFrameId_, groundTruthFrameId_);
 	pnh.param("ground_truth_base_frame_id", groundTruthBaseFrameId_, frameId_);
 	pnh.param("config_path", configPath, configPath);
 	pnh.param("publish_null_when_lost", publishNullWhenLost_, publishNullWhenLost_);
+	pnh.param("odom_info_packed", odomInfoPacked_, odomInfoPacked_);
+	pnh.param("publish_odom_sensor_data", publishOdomSensorData_, publishOdomSensorData_);
+	pnh.param("keyframe_min_linear", keyframeMinLinear_, keyframeMinLinear_);
+	pnh.param("keyframe_min_angular", keyframeMinAngular_, keyframeMinAngular_);
+	pnh.param("keyframe_max_interval", keyframeMaxInterval_, keyframeMaxInterval_);
+	pnh.param("keyframe_max_bandwidth", keyframeMaxBandwidth_, keyframeMaxBandwidth_);
 	if(pnh.hasParam("guess_from_tf"))
 	{
 		if(!pnh.hasParam("guess_frame_id"))
@@ -153,10 +216,26 @@ void OdometryROS::onInit()
 
 	pnh.param("wait_imu_to_init", waitIMUToinit_, waitIMUToinit_);
 
+	bool asyncProcessing = false;
+	bool asyncPublishing = false;
+	pnh.param("async_processing", asyncProcessing, asyncProcessing);
+	pnh.param("async_publishing", asyncPublishing, asyncPublishing);
+	// Only the odometry threads can be placed, the callbacks are
+	// called by the threads of the nodelet manager
+	threadSettings_ = rtabmap_conversions::ThreadSettings::fromParams(pnh, "thread_");
+
 	int eventLevel = ULogger::kFatal;
 	pnh.param("log_to_rosout_level", eventLevel, eventLevel);
 	UASSERT(eventLevel >= ULogger::kDebug && eventLevel <= ULogger::kFatal);
 	ULogger::setEventLevel((ULogger::Level)eventLevel);
+	bool logToRosoutAsync = false;
+	double logToRosoutMaxRate = 0.0;
+	pnh.param("log_to_rosout_async", logToRosoutAsync, logToRosoutAsync);
+	pnh.param("log_to_rosout_max_rate", logToRosoutMaxRate, logToRosoutMaxRate);
+	if(logToRosoutAsync)
+	{
+		ulogToRosout_.setAsync(true, logToRosoutMaxRate);
+	}
 
 	if(publishTf_ && !guessFrameId_.empty() && guessFrameId_.compare(odomFrameId_) == 0)
 	{
@@ -171,11 +250,14 @@ void OdometryROS::onInit()
 	NODELET_INFO("Odometry: wait_for_transform     = %s", waitForTransform_?"true":"false");
 	NODELET_INFO("Odometry: wait_for_transform_duration  = %f", waitForTransformDuration_);
 	NODELET_INFO("Odometry: log_to_rosout_level    = %d", eventLevel);
+	NODELET_INFO("Odometry: log_to_rosout_async = %s (max rate=%f Hz)", logToRosoutAsync?"true":"false", logToRosoutMaxRate);
 	NODELET_INFO("Odometry: initial_pose           = %s", initialPose.prettyPrint().c_str());
 	NODELET_INFO("Odometry: ground_truth_frame_id  = %s", groundTruthFrameId_.c_str());
 	NODELET_INFO("Odometry: ground_truth_base_frame_id = %s", groundTruthBaseFrameId_.c_str());
 	NODELET_INFO("Odometry: config_path            = %s", configPath.c_str());
 	NODELET_INFO("Odometry: publish_null_when_lost = %s", publishNullWhenLost_?"true":"false");
+	NODELET_INFO("Odometry: odom_info_packed    = %s", odomInfoPacked_?"true":"false");
+	NODELET_INFO("Odometry: publish_odom_sensor_data = %s", publishOdomSensorData_?"true":"false");
 	NODELET_INFO("Odometry: guess_frame_id         = %s", guessFrameId_.c_str());
 	NODELET_INFO("Odometry: guess_min_translation  = %f", guessMinTranslation_);
 	NODELET_INFO("Odometry: guess_min_rotation     = %f", guessMinRotation_);
@@ -184,6 +266,15 @@ void OdometryROS::onInit()
 	NODELET_INFO("Odometry: max_update_rate        = %f Hz", maxUpdateRate_);
 	NODELET_INFO("Odometry: min_update_rate        = %f Hz", minUpdateRate_);
 	NODELET_INFO("Odometry: wait_imu_to_init       = %s", waitIMUToinit_?"true":"false");
+	NODELET_INFO("Odometry: async_processing       = %s", asyncProcessing?"true":"false");
+	NODELET_INFO("Odometry: async_publishing       = %s", asyncPublishing?"true":"false");
+	NODELET_INFO("Odometry: thread settings        = %s", threadSettings_.toString().c_str());
+	if(!threadSettings_.isDefault() && !asyncProcessing)
+	{
+		NODELET_WARN("Odometry: thread_cpus and thread_priority are used only with async_processing=true.");
+	}
+
+	imuBatch_.reserve(imus_.capacity());
 
 	configPath = uReplaceChar(configPath, '~', UDirectory::homeDir());
 	if(configPath.size() && configPath.at(0) != '/')
@@ -375,6 +466,17 @@ void OdometryROS::onInit()
 		NODELET_INFO("odometry: Subscribing to IMU topic %s", imuSub_.getTopic().c_str());
 	}
 
+	if(asyncProcessing)
+	{
+		processingThreadRunning_ = true;
+		processingThread_ = new boost::thread(boost::bind(&OdometryROS::processingLoop, this));
+	}
+	if(asyncPublishing)
+	{
+		publishingThreadRunning_ = true;
+		publishingThread_ = new boost::thread(boost::bind(&OdometryROS::publishingLoop, this));
+	}
+
 	onOdomInit();
 }
 
@@ -437,31 +539,152 @@ void OdometryROS::callbackIMU(const sensor_msgs::ImuConstPtr& msg)
 				cv::Mat(3,3,CV_64FC1,(void*)msg->linear_acceleration_covariance.data()).clone(),
 				localTransform);
 
-		imus_.insert(std::make_pair(stamp, imu));
-
-		if(bufferedData_.first.isValid() && stamp > bufferedData_.first.stamp())
+		SensorData data;
+		std_msgs::Header header;
 		{
-			SensorData data = bufferedData_.first;
-			bufferedData_.first = SensorData();
-			processData(data, bufferedData_.second);
+			boost::mutex::scoped_lock lock(imuMutex_);
+			if(!imus_.push(stamp, imu))
+			{
+				NODELET_WARN("IMU received (stamp=%f) is older than all buffered IMU data, it is ignored.", stamp);
+			}
+
+			if(bufferedData_.first.isValid() && stamp > bufferedData_.first.stamp())
+			{
+				data = bufferedData_.first;
+				header = bufferedData_.second;
+				bufferedData_.first = SensorData();
+			}
 		}
 
-		if(imus_.size() > 1000)
+		if(data.isValid())
 		{
-			imus_.erase(imus_.begin());
+			processData(data, header);
 		}
 	}
 }
 
+// Images may share the buffers of the input messages, which
+// could be released before the copy is used by another thread.
+static SensorData deepCopy(const SensorData & data)
+{
+	SensorData dataCopy = data;
+	if(!data.stereoCameraModels().empty())
+	{
+		dataCopy.setStereoImage(data.imageRaw().clone(), data.rightRaw().clone(), data.stereoCameraModels(), false);
+	}
+	else if(!data.imageRaw().empty() || !data.depthRaw().empty())
+	{
+		dataCopy.setRGBDImage(data.imageRaw().clone(), data.depthRaw().clone(), data.cameraModels(), false);
+	}
+	if(!data.laserScanRaw().isEmpty())
+	{
+		dataCopy.setLaserScan(data.laserScanRaw().clone(), false);
+	}
+	return dataCopy;
+}
+
 void OdometryROS::processData(SensorData & data, const std_msgs::Header & header)
 {
+	if(processingThread_)
+	{
+		bool sensorData = !data.imageRaw().empty() || !data.laserScanRaw().isEmpty();
+		if(sensorData && maxUpdateRate_ > 0)
+		{
+			// Throttle before copying the frame, based on the last
+			// frame sent to the processing thread (the same check is
+			// done again on previousStamp_ when it is processed).
+			boost::mutex::scoped_lock lock(processingMutex_);
+			if(processingLastStamp_ > 0 &&
+			   header.stamp.toSec() > processingLastStamp_ &&
+			   (header.stamp.toSec()-processingLastStamp_+(expectedUpdateRate_ > 0?1.0/expectedUpdateRate_:0)) < 1.0/maxUpdateRate_)
+			{
+				return;
+			}
+		}
+
+		SensorData dataCopy = deepCopy(data);
+
+		// Latest frame wins: if the processing thread is still
+		// busy, the frame waiting to be processed is replaced.
+		boost::mutex::scoped_lock lock(processingMutex_);
+		if(sensorData)
+		{
+			processingLastStamp_ = header.stamp.toSec();
+		}
+		if(processingPending_)
+		{
+			++processingDropped_;
+			NODELET_DEBUG("Odometry: processing thread is busy, dropping frame %f (%d dropped so far)",
+					processingData_.second.stamp.toSec(), processingDropped_);
+		}
+		processingData_.first = dataCopy;
+		processingData_.second = header;
+		processingPending_ = true;
+		processingCondition_.notify_one();
+		return;
+	}
+	processDataImpl(data, header);
+}
+
+void OdometryROS::processingLoop()
+{
+	threadSettings_.apply();
+	while(true)
+	{
+		std::pair<rtabmap::SensorData, std_msgs::Header > data;
+		{
+			boost::mutex::scoped_lock lock(processingMutex_);
+			while(processingThreadRunning_ && !processingPending_)
+			{
+				processingCondition_.wait(lock);
+			}
+			if(!processingThreadRunning_)
+			{
+				break;
+			}
+			data = processingData_;
+			processingData_.first = SensorData();
+			processingPending_ = false;
+		}
+		processDataImpl(data.first, data.second);
+	}
+}
+
+void OdometryROS::publishingLoop()
+{
+	threadSettings_.apply();
+	while(true)
+	{
+		PublishingJob job;
+		{
+			boost::mutex::scoped_lock lock(publishingMutex_);
+			while(publishingThreadRunning_ && !publishingPending_)
+			{
+				publishingCondition_.wait(lock);
+			}
+			if(!publishingThreadRunning_)
+			{
+				break;
+			}
+			job = publishingJob_;
+			publishingJob_ = PublishingJob();
+			publishingPending_ = false;
+		}
+		publishOdomInfo(job.info, job.data, job.header, job.poseValid, job.keyframe, job.keyframeOdom);
+	}
+}
+
+void OdometryROS::processDataImpl(SensorData & data, const std_msgs::Header & header)
+{
+	boost::mutex::scoped_lock odometryLock(odometryMutex_);
+	boost::mutex::scoped_lock imuLock(imuMutex_);
 	if((waitIMUToinit_ && !imuProcessed_) && odometry_->framesProcessed() == 0 && odometry_->getPose().isIdentity() && imus_.empty())
 	{
 		NODELET_WARN("odometry: waiting imu (%s) to initialize orientation (wait_imu_to_init=true)", imuSub_.getTopic().c_str());
 		return;
 	}
 
-	if(waitIMUToinit_ && (imus_.empty() || imus_.rbegin()->first < header.stamp.toSec()))
+	if(waitIMUToinit_ && (imus_.empty() || imus_.back().first < header.stamp.toSec()))
 	{
 		//NODELET_WARN("No imu received with higher stamp than last image (%f)! Buffering this image until we get more imu msgs...", stamp.toSec());
 
@@ -471,26 +694,29 @@ void OdometryROS::processData(SensorData & data, const std_msgs::Header & header
 			NODELET_ERROR("Overwriting previous data! Make sure IMU is "
 					"published faster than data rate. (last image stamp "
 					"buffered=%f and new one is %f, last imu stamp received=%f)",
-					bufferedData_.first.stamp(), data.stamp(), imus_.empty()?0:imus_.rbegin()->first);
+					bufferedData_.first.stamp(), data.stamp(), imus_.empty()?0:imus_.back().first);
 		}
 		bufferedData_.first = data;
 		bufferedData_.second = header;
 		return;
 	}
 	// process all imu data up to current image stamp (or just after so that underlying odom approach can do interpolation of imu at image stamp)
-	std::map<double, rtabmap::IMU>::iterator iterEnd = imus_.lower_bound(header.stamp.toSec());
-	if(iterEnd!= imus_.end())
+	size_t imuCount = imus_.lowerBound(header.stamp.toSec());
+	if(imuCount < imus_.size())
 	{
-		++iterEnd;
+		++imuCount;
 	}
-	for(std::map<double, rtabmap::IMU>::iterator iter=imus_.begin(); iter!=iterEnd;)
+	imuBatch_.clear();
+	imus_.popFront(imuCount, imuBatch_);
+	imuLock.unlock();
+	for(size_t i=0; i<imuBatch_.size(); ++i)
 	{
-		//NODELET_WARN("img callback: process imu   %f", iter->first);
-		SensorData dataIMU(iter->second, 0, iter->first);
+		//NODELET_WARN("img callback: process imu   %f", imuBatch_[i].first);
+		SensorData dataIMU(imuBatch_[i].second, 0, imuBatch_[i].first);
 		odometry_->process(dataIMU);
-		imus_.erase(iter++);
 		imuProcessed_ = true;
 	}
+	imuBatch_.clear();
 
 	//NODELET_WARN("img callback: process image %f", stamp.toSec());
 
@@ -626,11 +852,18 @@ void OdometryROS::processData(SensorData & data, const std_msgs::Header & header
 	{
 		pose = odometry_->process(data, guess_, &info);
 	}
+	bool keyframe = false;
+	nav_msgs::Odometry keyframeOdom;
 	if(!pose.isNull())
 	{
 		guess_.setNull();
 		resetCurrentCount_ = resetCountdown_;
 
+		if(!data.imageRaw().empty() && keyframeRgbdImagePub_.getNumSubscribers())
+		{
+			keyframe = isKeyframe(pose, header.stamp.toSec());
+		}
+
 		//*********************
 		// Update odometry
 		//*********************
@@ -659,7 +892,11 @@ void OdometryROS::processData(SensorData & data, const std_msgs::Header & header
 			}
 		}
 
-		if(odomPub_.getNumSubscribers())
+		bool sensorDataSubscribed = publishOdomSensorData_ &&
+				(!data.imageRaw().empty() || !data.laserScanRaw().isEmpty()) &&
+				rtabmap_conversions::SensorDataChannel::hasSubscribers(odomSensorDataChannel_);
+
+		if(odomPub_.getNumSubscribers() || keyframe || sensorDataSubscribed)
 		{
 			//next, we'll publish the odometry message over ROS
 			nav_msgs::Odometry odom;
@@ -704,32 +941,20 @@ void OdometryROS::processData(SensorData & data, const std_msgs::Header & header
 			odom.twist.covariance.at(35) = setTwist?info.reg.covariance.at<double>(5,5):BAD_COVARIANCE; // yawyaw
 
 			//publish the message
-			if(setTwist || publishNullWhenLost_)
+			if(odomPub_.getNumSubscribers() && (setTwist || publishNullWhenLost_))
 			{
 				odomPub_.publish(odom);
 			}
-		}
-
-		// local map / reference frame
-		if(odomLocalMap_.getNumSubscribers() && !info.localMap.empty())
-		{
-			pcl::PointCloud<pcl::PointXYZRGB> cloud;
-			for(std::map<int, cv::Point3f>::const_iterator iter=info.localMap.begin(); iter!=info.localMap.end(); ++iter)
+			if(keyframe)
 			{
-				bool inlier = info.words.find(iter->first) != info.words.end();
-				pcl::PointXYZRGB pt;
-				pt.r = inlier?0:255;
-				pt.g = 255;
-				pt.x = iter->second.x;
-				pt.y = iter->second.y;
-				pt.z = iter->second.z;
-				cloud.push_back(pt);
+				keyframeOdom = odom;
+			}
+			if(sensorDataSubscribed)
+			{
+				// Already converted data given directly to rtabmap in the same process,
+				// data owns its buffers if it comes from the processing thread
+				rtabmap_conversions::SensorDataChannel::publish(odomSensorDataChannel_, processingThread_?data:deepCopy(data), odom, info);
 			}
-			sensor_msgs::PointCloud2 cloudMsg;
-			pcl::toROSMsg(cloud, cloudMsg);
-			cloudMsg.header.stamp = header.stamp; // use corresponding time stamp to image
-			cloudMsg.header.frame_id = odomFrameId_;
-			odomLocalMap_.publish(cloudMsg);
 		}
 
 		if(odomLastFrame_.getNumSubscribers())
@@ -777,34 +1002,6 @@ void OdometryROS::processData(SensorData & data, const std_msgs::Header & header
 			}
 		}
 
-		if(odomLocalScanMap_.getNumSubscribers() && !info.localScanMap.isEmpty())
-		{
-			sensor_msgs::PointCloud2 cloudMsg;
-			if(info.localScanMap.hasNormals() && info.localScanMap.hasIntensity())
-			{
-				pcl::PointCloud<pcl::PointXYZINormal>::Ptr cloud = util3d::laserScanToPointCloudINormal(info.localScanMap, info.localScanMap.localTransform());
-				pcl::toROSMsg(*cloud, cloudMsg);
-			}
-			else if(info.localScanMap.hasNormals())
-			{
-				pcl::PointCloud<pcl::PointNormal>::Ptr cloud = util3d::laserScanToPointCloudNormal(info.localScanMap, info.localScanMap.localTransform());
-				pcl::toROSMsg(*cloud, cloudMsg);
-			}
-			else if(info.localScanMap.hasIntensity())
-			{
-				pcl::PointCloud<pcl::PointXYZI>::Ptr cloud = util3d::laserScanToPointCloudI(info.localScanMap, info.localScanMap.localTransform());
-				pcl::toROSMsg(*cloud, cloudMsg);
-			}
-			else
-			{
-				pcl::PointCloud<pcl::PointXYZ>::Ptr cloud = util3d::laserScanToPointCloud(info.localScanMap, info.localScanMap.localTransform());
-				pcl::toROSMsg(*cloud, cloudMsg);
-			}
-
-			cloudMsg.header.stamp = header.stamp; // use corresponding time stamp to image
-			cloudMsg.header.frame_id = odomFrameId_;
-			odomLocalScanMap_.publish(cloudMsg);
-		}
 	}
 	else if(data.imageRaw().empty() && data.laserScanRaw().isEmpty() && !data.imu().empty())
 	{
@@ -893,10 +1090,240 @@ void OdometryROS::processData(SensorData & data, const std_msgs::Header & header
 		}
 	}
 
+	if(publishingThread_)
+	{
+		// Don't copy data that won't be published
+		bool fullInfo = odomInfoPub_.getNumSubscribers() > 0;
+		if(!fullInfo)
+		{
+			if(!odomLocalMap_.getNumSubscribers())
+			{
+				info.words.clear();
+				info.localMap.clear();
+			}
+			if(!odomLocalScanMap_.getNumSubscribers())
+			{
+				info.localScanMap = LaserScan();
+			}
+			info.reg.matchesIDs.clear();
+			info.reg.inliersIDs.clear();
+			info.refCorners.clear();
+			info.newCorners.clear();
+			info.cornerInliers.clear();
+		}
+		// Latest wins, unless the pending job is a keyframe not published yet
+		boost::mutex::scoped_lock lock(publishingMutex_);
+		if(!publishingPending_ || !publishingJob_.keyframe || keyframe)
+		{
+			publishingJob_.info = info;
+			// The images may share the input messages' buffers, copy them
+			// only if they will be published (processing thread data owns them)
+			publishingJob_.data = odomRgbdImagePub_.getNumSubscribers() || keyframe?(processingThread_?data:deepCopy(data)):SensorData();
+			publishingJob_.header = header;
+			publishingJob_.poseValid = !pose.isNull();
+			publishingJob_.keyframe = keyframe;
+			publishingJob_.keyframeOdom = keyframeOdom;
+			publishingPending_ = true;
+			publishingCondition_.notify_one();
+		}
+	}
+	else
+	{
+		publishOdomInfo(info, data, header, !pose.isNull(), keyframe, keyframeOdom);
+	}
+
+	postProcessData(data, header);
+
+	if(!data.imageRaw().empty() || !data.laserScanRaw().isEmpty())
+	{
+		if(visParams_)
+		{
+			if(icpParams_)
+			{
+				NODELET_INFO( "Odom: quality=%d, ratio=%f, std dev=%fm|%frad, update time=%fs", info.reg.inliers, info.reg.icpInliersRatio, pose.isNull()?0.0f:std::sqrt(info.reg.covariance.at<double>(0,0)), pose.isNull()?0.0f:std::sqrt(info.reg.covariance.at<double>(5,5)), (ros::WallTime::now()-time).toSec());
+			}
+			else
+			{
+				NODELET_INFO( "Odom: quality=%d, std dev=%fm|%frad, update time=%fs", info.reg.inliers, pose.isNull()?0.0f:std::sqrt(info.reg.covariance.at<double>(0,0)), pose.isNull()?0.0f:std::sqrt(info.reg.covariance.at<double>(5,5)), (ros::WallTime::now()-time).toSec());
+			}
+		}
+		else // if(icpParams_)
+		{
+			NODELET_INFO( "Odom: ratio=%f, std dev=%fm|%frad, update time=%fs", info.reg.icpInliersRatio, pose.isNull()?0.0f:std::sqrt(info.reg.covariance.at<double>(0,0)), pose.isNull()?0.0f:std::sqrt(info.reg.covariance.at<double>(5,5)), (ros::WallTime::now()-time).toSec());
+		}
+		previousStamp_ = header.stamp.toSec();
+	}
+}
+
+bool OdometryROS::isKeyframe(const Transform & pose, double stamp)
+{
+	bool keyframe = true;
+	if(!keyframeLastPose_.isNull())
+	{
+		bool timeCriteria = keyframeMaxInterval_ > 0.0;
+		bool motionCriteria = keyframeMinLinear_ > 0.0 || keyframeMinAngular_ > 0.0;
+		if(timeCriteria || motionCriteria)
+		{
+			Transform motion = keyframeLastPose_.inverse() * pose;
+			float x,y,z,roll,pitch,yaw;
+			motion.getTranslationAndEulerAngles(x,y,z,roll,pitch,yaw);
+			keyframe =
+					(timeCriteria && stamp - keyframeLastStamp_ >= keyframeMaxInterval_) ||
+					(keyframeMinLinear_ > 0.0 && motion.getNorm() >= keyframeMinLinear_) ||
+					(keyframeMinAngular_ > 0.0 && uMax3(fabs(roll), fabs(pitch), fabs(yaw)) >= keyframeMinAngular_);
+		}
+	}
+
+	if(keyframe && keyframeMaxBandwidth_ > 0.0)
+	{
+		// token bucket refilled at keyframe_max_bandwidth, up to one second of budget
+		double bytesPerSec = keyframeMaxBandwidth_*1000.0;
+		if(keyframeBudgetStamp_ > 0.0 && stamp > keyframeBudgetStamp_)
+		{
+			keyframeBudget_ = std::min(bytesPerSec, keyframeBudget_ + (stamp - keyframeBudgetStamp_)*bytesPerSec);
+		}
+		else if(keyframeBudgetStamp_ == 0.0)
+		{
+			keyframeBudget_ = bytesPerSec;
+		}
+		keyframeBudgetStamp_ = stamp;
+
+		size_t lastBytes;
+		{
+			boost::mutex::scoped_lock lock(publishingMutex_);
+			lastBytes = keyframeLastBytes_;
+		}
+		if(keyframeBudget_ < (double)lastBytes)
+		{
+			NODELET_DEBUG("Odometry: keyframe delayed, bandwidth budget exceeded (%f < %d bytes)", keyframeBudget_, (int)lastBytes);
+			return false;
+		}
+		keyframeBudget_ -= (double)lastBytes;
+	}
+
+	if(keyframe)
+	{
+		keyframeLastPose_ = pose;
+		keyframeLastStamp_ = stamp;
+	}
+	return keyframe;
+}
+
+void OdometryROS::publishKeyframe(const OdometryInfo & info, const SensorData & data, const std_msgs::Header & header, const nav_msgs::Odometry & odom)
+{
+	rtabmap_msgs::RGBDImage msg;
+	msg.header = header;
+	bool stereo = false;
+	if(data.cameraModels().size() == 1)
+	{
+		rtabmap_conversions::cameraModelToROS(data.cameraModels().front(), msg.rgb_camera_info);
+	}
+	else if(data.stereoCameraModels().size() == 1)
+	{
+		rtabmap_conversions::cameraModelToROS(data.stereoCameraModels()[0].left(), msg.rgb_camera_info);
+		rtabmap_conversions::cameraModelToROS(data.stereoCameraModels()[0].right(), msg.depth_camera_info);
+		stereo = true;
+	}
+	else
+	{
+		ROS_WARN_THROTTLE(5, "Odometry: keyframes with multiple cameras are not supported, not publishing them.");
+		return;
+	}
+	msg.rgb_camera_info.header = header;
+	msg.depth_camera_info.header = header;
+
+	// pre-compressed images, decoded by rtabmap_conversions::toCvShare() on the other side
+	msg.rgb_compressed.header = header;
+	msg.rgb_compressed.format = "jpg";
+	msg.rgb_compressed.data = rtabmap::compressImage(data.imageRaw(), ".jpg");
+	if(!data.depthOrRightRaw().empty())
+	{
+		msg.depth_compressed.header = header;
+		msg.depth_compressed.format = stereo?"jpg":"png";
+		msg.depth_compressed.data = rtabmap::compressImage(data.depthOrRightRaw(), stereo?".jpg":".png");
+	}
+	{
+		boost::mutex::scoped_lock lock(publishingMutex_);
+		keyframeLastBytes_ = msg.rgb_compressed.data.size() + msg.depth_compressed.data.size();
+	}
+
+	if(keyframeOdomInfoPub_.getNumSubscribers())
+	{
+		rtabmap_msgs::OdomInfo infoMsg;
+		rtabmap_conversions::odomInfoToROS(info, infoMsg, true, odomInfoPacked_);
+		infoMsg.header.stamp = header.stamp;
+		infoMsg.header.frame_id = odomFrameId_;
+		keyframeOdomInfoPub_.publish(infoMsg);
+	}
+	keyframeOdomPub_.publish(odom);
+	keyframeRgbdImagePub_.publish(msg);
+}
+
+void OdometryROS::publishOdomInfo(const OdometryInfo & info, const SensorData & data, const std_msgs::Header & header, bool poseValid, bool keyframe, const nav_msgs::Odometry & keyframeOdom)
+{
+	if(keyframe && !header.frame_id.empty())
+	{
+		publishKeyframe(info, data, header, keyframeOdom);
+	}
+
+	if(poseValid)
+	{
+		// local map / reference frame
+		if(odomLocalMap_.getNumSubscribers() && !info.localMap.empty())
+		{
+			pcl::PointCloud<pcl::PointXYZRGB> cloud;
+			for(std::map<int, cv::Point3f>::const_iterator iter=info.localMap.begin(); iter!=info.localMap.end(); ++iter)
+			{
+				bool inlier = info.words.find(iter->first) != info.words.end();
+				pcl::PointXYZRGB pt;
+				pt.r = inlier?0:255;
+				pt.g = 255;
+				pt.x = iter->second.x;
+				pt.y = iter->second.y;
+				pt.z = iter->second.z;
+				cloud.push_back(pt);
+			}
+			sensor_msgs::PointCloud2 cloudMsg;
+			pcl::toROSMsg(cloud, cloudMsg);
+			cloudMsg.header.stamp = header.stamp; // use corresponding time stamp to image
+			cloudMsg.header.frame_id = odomFrameId_;
+			odomLocalMap_.publish(cloudMsg);
+		}
+
+		if(odomLocalScanMap_.getNumSubscribers() && !info.localScanMap.isEmpty())
+		{
+			sensor_msgs::PointCloud2 cloudMsg;
+			if(info.localScanMap.hasNormals() && info.localScanMap.hasIntensity())
+			{
+				pcl::PointCloud<pcl::PointXYZINormal>::Ptr cloud = util3d::laserScanToPointCloudINormal(info.localScanMap, info.localScanMap.localTransform());
+				pcl::toROSMsg(*cloud, cloudMsg);
+			}
+			else if(info.localScanMap.hasNormals())
+			{
+				pcl::PointCloud<pcl::PointNormal>::Ptr cloud = util3d::laserScanToPointCloudNormal(info.localScanMap, info.localScanMap.localTransform());
+				pcl::toROSMsg(*cloud, cloudMsg);
+			}
+			else if(info.localScanMap.hasIntensity())
+			{
+				pcl::PointCloud<pcl::PointXYZI>::Ptr cloud = util3d::laserScanToPointCloudI(info.localScanMap, info.localScanMap.localTransform());
+				pcl::toROSMsg(*cloud, cloudMsg);
+			}
+			else
+			{
+				pcl::PointCloud<pcl::PointXYZ>::Ptr cloud = util3d::laserScanToPointCloud(info.localScanMap, info.localScanMap.localTransform());
+				pcl::toROSMsg(*cloud, cloudMsg);
+			}
+
+			cloudMsg.header.stamp = header.stamp; // use corresponding time stamp to image
+			cloudMsg.header.frame_id = odomFrameId_;
+			odomLocalScanMap_.publish(cloudMsg);
+		}
+	}
+
 	if(odomInfoPub_.getNumSubscribers() || odomInfoLitePub_.getNumSubscribers())
 	{
 		rtabmap_msgs::OdomInfo infoMsg;
-		rtabmap_conversions::odomInfoToROS(info, infoMsg, odomInfoPub_.getNumSubscribers()==0);
+		rtabmap_conversions::odomInfoToROS(info, infoMsg, odomInfoPub_.getNumSubscribers()==0, odomInfoPacked_);
 		infoMsg.header.stamp = header.stamp; // use corresponding time stamp to image
 		infoMsg.header.frame_id = odomFrameId_;
 		if(odomInfoPub_.getNumSubscribers()>0) {
@@ -914,6 +1341,10 @@ void OdometryROS::processData(SensorData & data, const std_msgs::Header & header
 			infoMsg.cornerInliers.clear();
 			infoMsg.localMapKeys.clear();
 			infoMsg.localMapValues.clear();
+			infoMsg.wordsValuesPacked.clear();
+			infoMsg.localMapValuesPacked.clear();
+			infoMsg.refCornersPacked.clear();
+			infoMsg.newCornersPacked.clear();
 			infoMsg.localScanMap = sensor_msgs::PointCloud2();
 			odomInfoLitePub_.publish(infoMsg);
 		}
@@ -934,27 +1365,6 @@ void OdometryROS::processData(SensorData & data, const std_msgs::Header & header
 		}
 	}
 
-	postProcessData(data, header);
-
-	if(!data.imageRaw().empty() || !data.laserScanRaw().isEmpty())
-	{
-		if(visParams_)
-		{
-			if(icpParams_)
-			{
-				NODELET_INFO( "Odom: quality=%d, ratio=%f, std dev=%fm|%frad, update time=%fs", info.reg.inliers, info.reg.icpInliersRatio, pose.isNull()?0.0f:std::sqrt(info.reg.covariance.at<double>(0,0)), pose.isNull()?0.0f:std::sqrt(info.reg.covariance.at<double>(5,5)), (ros::WallTime::now()-time).toSec());
-			}
-			else
-			{
-				NODELET_INFO( "Odom: quality=%d, std dev=%fm|%frad, update time=%fs", info.reg.inliers, pose.isNull()?0.0f:std::sqrt(info.reg.covariance.at<double>(0,0)), pose.isNull()?0.0f:std::sqrt(info.reg.covariance.at<double>(5,5)), (ros::WallTime::now()-time).toSec());
-			}
-		}
-		else // if(icpParams_)
-		{
-			NODELET_INFO( "Odom: ratio=%f, std dev=%fm|%frad, update time=%fs", info.reg.icpInliersRatio, pose.isNull()?0.0f:std::sqrt(info.reg.covariance.at<double>(0,0)), pose.isNull()?0.0f:std::sqrt(info.reg.covariance.at<double>(5,5)), (ros::WallTime::now()-time).toSec());
-		}
-		previousStamp_ = header.stamp.toSec();
-	}
 }
 
 bool OdometryROS::reset(std_srvs::Empty::Request&, std_srvs::Empty::Response&)
@@ -974,10 +1384,20 @@ bool OdometryROS::resetToPose(rtabmap_msgs::ResetPose::Request& req, rtabmap_msg
 
 void OdometryROS::reset(const Transform & pose)
 {
+	if(processingThread_)
+	{
+		boost::mutex::scoped_lock lock(processingMutex_);
+		processingData_.first = SensorData();
+		processingPending_ = false;
+		processingLastStamp_ = 0.0;
+	}
+	boost::mutex::scoped_lock odometryLock(odometryMutex_);
+	boost::mutex::scoped_lock imuLock(imuMutex_);
 	odometry_->reset(pose);
 	guess_.setNull();
 	guessPreviousPose_.setNull();
 	previousStamp_ = 0.0;
+	keyframeLastPose_.setNull();
 	resetCurrentCount_ = resetCountdown_;
 	imuProcessed_ = false;
 	bufferedData_.first= SensorData();
@@ -16,6 +16,16 @@ void PluginInterface::initialize(const std::string name, ros::NodeHandle & nh)
     onInitialize();
 }
 
+std::vector<sensor_msgs::PointCloud2ConstPtr> PluginInterface::filterPointClouds(const std::vector<sensor_msgs::PointCloud2ConstPtr> & msgs)
+{
+    std::vector<sensor_msgs::PointCloud2ConstPtr> filtered(msgs.size());
+    for(size_t i=0; i<msgs.size(); ++i)
+    {
+        filtered[i].reset(new sensor_msgs::PointCloud2(filterPointCloud(*msgs[i])));
+    }
+    return filtered;
+}
+
 
 }  // end namespace rtabmap_odom
 
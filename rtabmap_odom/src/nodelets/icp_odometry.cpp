@@ -39,6 +39,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <pcl_conversions/pcl_conversions.h>
 #include <pcl_ros/transforms.h>
 
+#include <message_filters/subscriber.h>
+#include <message_filters/synchronizer.h>
+#include <message_filters/sync_policies/approximate_time.h>
+
 #include "rtabmap_conversions/MsgConversion.h"
 #include "rtabmap_odom/PluginInterface.h"
 
@@ -74,12 +78,19 @@ public:
 		deskewingSlerp_(false),
 		plugin_loader_("rtabmap_odom", "rtabmap_odom::PluginInterface"),
 		scanReceived_(false),
-		cloudReceived_(false)
+		cloudReceived_(false),
+		scanCloudCount_(0),
+		approxCloud2Sync_(0),
+		approxCloud3Sync_(0),
+		approxCloud4Sync_(0)
 	{
 	}
 
 	virtual ~ICPOdometry()
 	{
+		delete approxCloud2Sync_;
+		delete approxCloud3Sync_;
+		delete approxCloud4Sync_;
 		plugins_.clear();
 	}
 
@@ -91,7 +102,10 @@ private:
 		ros::NodeHandle & pnh = getPrivateNodeHandle();
 
 		int queueSize = 1;
+		double approxSyncMaxInterval = 0.0;
 		pnh.param("queue_size",  queueSize, queueSize);
+		pnh.param("scan_cloud_count", scanCloudCount_, scanCloudCount_);
+		pnh.param("approx_sync_max_interval", approxSyncMaxInterval, approxSyncMaxInterval);
 		pnh.param("scan_cloud_max_points",  scanCloudMaxPoints_, scanCloudMaxPoints_);
 		pnh.param("scan_cloud_is_2d",  scanCloudIs2d_, scanCloudIs2d_);
 		pnh.param("scan_downsampling_step", scanDownsamplingStep_, scanDownsamplingStep_);
@@ -152,9 +166,56 @@ private:
 		NODELET_INFO("IcpOdometry: scan_normal_ground_up  = %f", scanNormalGroundUp_);
 		NODELET_INFO("IcpOdometry: deskewing              = %s", deskewing_?"true":"false");
 		NODELET_INFO("IcpOdometry: deskewing_slerp        = %s", deskewingSlerp_?"true":"false");
+		NODELET_INFO("IcpOdometry: scan_cloud_count       = %d", scanCloudCount_);
 
 		scan_sub_ = nh.subscribe("scan", queueSize, &ICPOdometry::callbackScan, this);
-		cloud_sub_ = nh.subscribe("scan_cloud", queueSize, &ICPOdometry::callbackCloud, this);
+		if(scanCloudCount_ >= 2)
+		{
+			// Multiple lidars: clouds are synchronized, deskewed and merged
+			// here instead of using point_cloud_aggregator upstream.
+			if(scanCloudCount_ > 4)
+			{
+				NODELET_WARN("IcpOdometry: scan_cloud_count=%d, only up to 4 clouds are supported, setting to 4.", scanCloudCount_);
+				scanCloudCount_ = 4;
+			}
+			for(int i=0; i<scanCloudCount_; ++i)
+			{
+				cloud_subs_[i].subscribe(nh, uFormat("scan_cloud%d", i+1), 1);
+			}
+			std::string subscribedTopicsMsg = uFormat("\n%s subscribed to (approx sync%s):",
+					getName().c_str(),
+					approxSyncMaxInterval!=0.0?uFormat(", max interval=%fs", approxSyncMaxInterval).c_str():"");
+			if(scanCloudCount_ == 2)
+			{
+				approxCloud2Sync_ = new message_filters::Synchronizer<MyApproxCloud2SyncPolicy>(MyApproxCloud2SyncPolicy(queueSize), cloud_subs_[0], cloud_subs_[1]);
+				if(approxSyncMaxInterval > 0.0)
+					approxCloud2Sync_->setMaxIntervalDuration(ros::Duration(approxSyncMaxInterval));
+				approxCloud2Sync_->registerCallback(boost::bind(&ICPOdometry::callbackClouds2, this, boost::placeholders::_1, boost::placeholders::_2));
+			}
+			else if(scanCloudCount_ == 3)
+			{
+				approxCloud3Sync_ = new message_filters::Synchronizer<MyApproxCloud3SyncPolicy>(MyApproxCloud3SyncPolicy(queueSize), cloud_subs_[0], cloud_subs_[1], cloud_subs_[2]);
+				if(approxSyncMaxInterval > 0.0)
+					approxCloud3Sync_->setMaxIntervalDuration(ros::Duration(approxSyncMaxInterval));
+				approxCloud3Sync_->registerCallback(boost::bind(&ICPOdometry::callbackClouds3, this, boost::placeholders::_1, boost::placeholders::_2, boost::placeholders::_3));
+			}
+			else
+			{
+				approxCloud4Sync_ = new message_filters::Synchronizer<MyApproxCloud4SyncPolicy>(MyApproxCloud4SyncPolicy(queueSize), cloud_subs_[0], cloud_subs_[1], cloud_subs_[2], cloud_subs_[3]);
+				if(approxSyncMaxInterval > 0.0)
+					approxCloud4Sync_->setMaxIntervalDuration(ros::Duration(approxSyncMaxInterval));
+				approxCloud4Sync_->registerCallback(boost::bind(&ICPOdometry::callbackClouds4, this, boost::placeholders::_1, boost::placeholders::_2, boost::placeholders::_3, boost::placeholders::_4));
+			}
+			for(int i=0; i<scanCloudCount_; ++i)
+			{
+				subscribedTopicsMsg += uFormat("\n   %s", cloud_subs_[i].getTopic().c_str());
+			}
+			NODELET_INFO("%s", subscribedTopicsMsg.c_str());
+		}
+		else
+		{
+			cloud_sub_ = nh.subscribe("scan_cloud", queueSize, &ICPOdometry::callbackCloud, this);
+		}
 
 		filtered_scan_pub_ = nh.advertise<sensor_msgs::PointCloud2>("odom_filtered_input_scan", 1);
 	}
@@ -325,7 +386,7 @@ private:
 			ROS_ERROR("%s is already receiving clouds on \"%s\", but also "
 					"just received a scan on \"%s\". Both subscribers cannot be "
 					"used at the same time! Disabling scan subscriber.",
-					this->getName().c_str(), cloud_sub_.getTopic().c_str(), scan_sub_.getTopic().c_str());
+					this->getName().c_str(), scanCloudCount_>=2?cloud_subs_[0].getTopic().c_str():cloud_sub_.getTopic().c_str(), scan_sub_.getTopic().c_str());
 			scan_sub_.shutdown();
 			return;
 		}
@@ -576,90 +637,291 @@ private:
 			return;
 		}
 
-		sensor_msgs::PointCloud2::Ptr cloudMsg(new sensor_msgs::PointCloud2);
-		if (!plugins_.empty())
+		processCloud(pointCloudMsg, false);
+	}
+
+	void callbackClouds2(
+			const sensor_msgs::PointCloud2ConstPtr& cloudMsg1,
+			const sensor_msgs::PointCloud2ConstPtr& cloudMsg2)
+	{
+		std::vector<sensor_msgs::PointCloud2ConstPtr> clouds;
+		clouds.push_back(cloudMsg1);
+		clouds.push_back(cloudMsg2);
+		callbackClouds(clouds);
+	}
+	void callbackClouds3(
+			const sensor_msgs::PointCloud2ConstPtr& cloudMsg1,
+			const sensor_msgs::PointCloud2ConstPtr& cloudMsg2,
+			const sensor_msgs::PointCloud2ConstPtr& cloudMsg3)
+	{
+		std::vector<sensor_msgs::PointCloud2ConstPtr> clouds;
+		clouds.push_back(cloudMsg1);
+		clouds.push_back(cloudMsg2);
+		clouds.push_back(cloudMsg3);
+		callbackClouds(clouds);
+	}
+	void callbackClouds4(
+			const sensor_msgs::PointCloud2ConstPtr& cloudMsg1,
+			const sensor_msgs::PointCloud2ConstPtr& cloudMsg2,
+			const sensor_msgs::PointCloud2ConstPtr& cloudMsg3,
+			const sensor_msgs::PointCloud2ConstPtr& cloudMsg4)
+	{
+		std::vector<sensor_msgs::PointCloud2ConstPtr> clouds;
+		clouds.push_back(cloudMsg1);
+		clouds.push_back(cloudMsg2);
+		clouds.push_back(cloudMsg3);
+		clouds.push_back(cloudMsg4);
+		callbackClouds(clouds);
+	}
+
+	void callbackClouds(const std::vector<sensor_msgs::PointCloud2ConstPtr> & cloudMsgs)
+	{
+		if(scanReceived_)
 		{
-			if (plugins_[0]->isEnabled())
-			{
-				*cloudMsg = plugins_[0]->filterPointCloud(*pointCloudMsg);
-			}
-			else
+			ROS_ERROR_THROTTLE(5, "%s is already receiving scans on \"%s\", but also "
+					"just received clouds on \"%s\". Both subscribers cannot be "
+					"used at the same time! Ignoring clouds.",
+					this->getName().c_str(), scan_sub_.getTopic().c_str(), cloud_subs_[0].getTopic().c_str());
+			return;
+		}
+		cloudReceived_ = true;
+		if(this->isPaused())
+		{
+			return;
+		}
+
+		// Plugins filter all clouds of this update in a single call
+		std::vector<sensor_msgs::PointCloud2ConstPtr> clouds = cloudMsgs;
+		for (size_t i = 0; i < plugins_.size(); i++)
+		{
+			if (plugins_[i]->isEnabled())
 			{
-				*cloudMsg = *pointCloudMsg;
+				clouds = plugins_[i]->filterPointClouds(clouds);
+				if(clouds.size() != cloudMsgs.size())
+				{
+					ROS_ERROR("Plugin %s returned %d clouds (expected %d), aborting odometry update!",
+							plugins_[i]->getName().c_str(), (int)clouds.size(), (int)cloudMsgs.size());
+					return;
+				}
 			}
+		}
 
-			if (plugins_.size() > 1)
+		// Each cloud is deskewed with its own timestamps before being merged
+		if(deskewing_)
+		{
+			for(size_t i=0; i<clouds.size(); ++i)
 			{
-				for (int i = 1; i < plugins_.size(); i++) {
-					if (plugins_[i]->isEnabled()) {
-						*cloudMsg = plugins_[i]->filterPointCloud(*cloudMsg);
-					}
+				clouds[i] = deskewCloud(cloudMsgs[i], clouds[i]);
+				if(!clouds[i])
+				{
+					ROS_ERROR("Failed to deskew input cloud %d, aborting odometry update!", (int)i+1);
+					return;
 				}
 			}
 		}
-		else
+
+		if(!mergeClouds(clouds))
 		{
-			*cloudMsg = *pointCloudMsg;
+			return;
 		}
+		processCloud(mergedCloud_, true, true);
+	}
 
-		Transform localScanTransform = rtabmap_conversions::getTransform(this->frameId(), cloudMsg->header.frame_id, cloudMsg->header.stamp, this->tfListener(), this->waitForTransformDuration());
-		if(localScanTransform.isNull())
+	/**
+	 * Merge the clouds in base frame (at the stamp of the first cloud if
+	 * guess_frame_id is set) in mergedCloud_, which buffer is reused
+	 * between frames. Output fields are x,y,z and intensity if all clouds
+	 * have a float intensity.
+	 */
+	bool mergeClouds(const std::vector<sensor_msgs::PointCloud2ConstPtr> & clouds)
+	{
+		if(!mergedCloud_ || !mergedCloud_.unique())
 		{
-			ROS_ERROR("TF of received scan cloud at time %fs is not set, aborting rtabmap update.", cloudMsg->header.stamp.toSec());
-			return;
+			mergedCloud_.reset(new sensor_msgs::PointCloud2);
 		}
 
-		if(deskewing_)
+		std::vector<Eigen::Matrix4f> transforms(clouds.size());
+		std::vector<int> offsets(clouds.size()*4, -1); // x,y,z,intensity
+		bool hasIntensity = true;
+		size_t totalPoints = 0;
+		const char * names[4] = {"x", "y", "z", "intensity"};
+		const ros::Time & stamp = clouds[0]->header.stamp;
+		for(size_t i=0; i<clouds.size(); ++i)
 		{
-			if(!guessFrameId().empty())
+			for(size_t j=0; j<clouds[i]->fields.size(); ++j)
 			{
-				// deskew with TF
-				if(!rtabmap_conversions::deskew(*pointCloudMsg, *cloudMsg, guessFrameId(), tfListener(), waitForTransformDuration(), deskewingSlerp_))
+				for(int k=0; k<4; ++k)
 				{
-					ROS_ERROR("Failed to deskew input cloud, aborting odometry update!");
-					return;
+					if(clouds[i]->fields[j].name.compare(names[k]) == 0 && clouds[i]->fields[j].datatype == sensor_msgs::PointField::FLOAT32)
+					{
+						offsets[i*4+k] = clouds[i]->fields[j].offset;
+					}
 				}
 			}
-			else if(previousStamp() > 0 && !velocityGuess().isNull())
+			if(offsets[i*4] < 0 || offsets[i*4+1] < 0 || offsets[i*4+2] < 0)
 			{
-				// deskew with constant velocity model
-				bool alreadyInBaseFrame = frameId().compare(pointCloudMsg->header.frame_id) == 0;
-				sensor_msgs::PointCloud2Ptr cloudInBaseFrame;
-				sensor_msgs::PointCloud2Ptr cloudPtr = cloudMsg;
-				if(!alreadyInBaseFrame)
-				{
-					// transform in base frame
-					cloudInBaseFrame.reset(new sensor_msgs::PointCloud2);
-					if(!pcl_ros::transformPointCloud(frameId(), *pointCloudMsg, *cloudInBaseFrame, this->tfListener()))
-					{
-						ROS_ERROR("Cannot transform back projected scan from \"%s\" frame to \"%s\" frame at time %fs.",
-								pointCloudMsg->header.frame_id.c_str(), frameId().c_str(), pointCloudMsg->header.stamp.toSec());
-						return;
-					}
-					cloudPtr = cloudInBaseFrame;
+				ROS_ERROR("Input cloud %d doesn't have float x, y and z fields, aborting odometry update!", (int)i+1);
+				return false;
+			}
+			hasIntensity = hasIntensity && offsets[i*4+3] >= 0;
+
+			Transform t = rtabmap_conversions::getTransform(frameId(), clouds[i]->header.frame_id, clouds[i]->header.stamp, tfListener(), waitForTransformDuration());
+			if(t.isNull())
+			{
+				ROS_ERROR("TF of received scan cloud %d at time %fs is not set, aborting odometry update.", (int)i+1, clouds[i]->header.stamp.toSec());
+				return false;
+			}
+			if(!guessFrameId().empty() && clouds[i]->header.stamp != stamp)
+			{
+				// motion of the base between the clouds
+				Transform displacement = rtabmap_conversions::getTransform(frameId(), guessFrameId(), clouds[i]->header.stamp, stamp, tfListener(), waitForTransformDuration());
+				if(!displacement.isNull())
+				{
+					t = displacement * t;
 				}
+			}
+			transforms[i] = t.toEigen4f();
+			totalPoints += size_t(clouds[i]->width) * size_t(clouds[i]->height);
+		}
+
+		sensor_msgs::PointCloud2 & output = *mergedCloud_;
+		int fields = hasIntensity?4:3;
+		output.fields.resize(fields);
+		for(int k=0; k<fields; ++k)
+		{
+			output.fields[k].name = names[k];
+			output.fields[k].offset = k*sizeof(float);
+			output.fields[k].datatype = sensor_msgs::PointField::FLOAT32;
+			output.fields[k].count = 1;
+		}
+		output.point_step = fields*sizeof(float);
+		output.data.resize(totalPoints*output.point_step);
 
-				sensor_msgs::PointCloud2::Ptr cloudDeskewed(new sensor_msgs::PointCloud2);
-				if(!rtabmap_conversions::deskew(*cloudPtr, *cloudDeskewed, previousStamp(), velocityGuess()))
+		float * out = (float*)output.data.data();
+		size_t n = 0;
+		for(size_t i=0; i<clouds.size(); ++i)
+		{
+			const Eigen::Matrix4f & m = transforms[i];
+			const int * offset = &offsets[i*4];
+			const size_t total = size_t(clouds[i]->width) * size_t(clouds[i]->height);
+			for(size_t p=0; p<total; ++p)
+			{
+				const unsigned char * in = clouds[i]->data.data() + p*clouds[i]->point_step;
+				float x = *((const float*)(in+offset[0]));
+				float y = *((const float*)(in+offset[1]));
+				float z = *((const float*)(in+offset[2]));
+				if(!std::isfinite(x) || !std::isfinite(y) || !std::isfinite(z))
 				{
-					ROS_ERROR("Failed to deskew input cloud, aborting odometry update!");
-					return;
+					continue;
+				}
+				float * pt = out + n*fields;
+				pt[0] = m(0,0)*x + m(0,1)*y + m(0,2)*z + m(0,3);
+				pt[1] = m(1,0)*x + m(1,1)*y + m(1,2)*z + m(1,3);
+				pt[2] = m(2,0)*x + m(2,1)*y + m(2,2)*z + m(2,3);
+				if(hasIntensity)
+				{
+					pt[3] = *((const float*)(in+offset[3]));
 				}
+				++n;
+			}
+		}
+		output.data.resize(n*output.point_step);
+		output.height = 1;
+		output.width = n;
+		output.row_step = output.width * output.point_step;
+		output.is_bigendian = false;
+		output.is_dense = true;
+		output.header.stamp = stamp;
+		output.header.frame_id = frameId();
+		return true;
+	}
 
-				if(!alreadyInBaseFrame)
+	/**
+	 * Deskew "cloudMsg" (the input "pointCloudMsg" after plugin filtering).
+	 * Returns null on failure, or "cloudMsg" if there is no motion estimate yet.
+	 */
+	sensor_msgs::PointCloud2ConstPtr deskewCloud(
+			const sensor_msgs::PointCloud2ConstPtr & pointCloudMsg,
+			const sensor_msgs::PointCloud2ConstPtr & cloudMsg)
+	{
+		if(!guessFrameId().empty())
+		{
+			// deskew with TF
+			sensor_msgs::PointCloud2::Ptr cloudDeskewed(new sensor_msgs::PointCloud2);
+			if(!rtabmap_conversions::deskew(*pointCloudMsg, *cloudDeskewed, guessFrameId(), tfListener(), waitForTransformDuration(), deskewingSlerp_))
+			{
+				return sensor_msgs::PointCloud2ConstPtr();
+			}
+			return cloudDeskewed;
+		}
+		else if(previousStamp() > 0 && !velocityGuess().isNull())
+		{
+			// deskew with constant velocity model
+			bool alreadyInBaseFrame = frameId().compare(pointCloudMsg->header.frame_id) == 0;
+			sensor_msgs::PointCloud2Ptr cloudInBaseFrame;
+			sensor_msgs::PointCloud2ConstPtr cloudPtr = cloudMsg;
+			if(!alreadyInBaseFrame)
+			{
+				// transform in base frame
+				cloudInBaseFrame.reset(new sensor_msgs::PointCloud2);
+				if(!pcl_ros::transformPointCloud(frameId(), *pointCloudMsg, *cloudInBaseFrame, this->tfListener()))
 				{
-					// put back in scan frame
-					if(!pcl_ros::transformPointCloud(pointCloudMsg->header.frame_id.c_str(), *cloudDeskewed, *cloudMsg, this->tfListener()))
-					{
-						ROS_ERROR("Cannot transform back projected scan from \"%s\" frame to \"%s\" frame at time %fs.",
-								frameId().c_str(), pointCloudMsg->header.frame_id.c_str(), pointCloudMsg->header.stamp.toSec());
-						return;
-					}
+					ROS_ERROR("Cannot transform back projected scan from \"%s\" frame to \"%s\" frame at time %fs.",
+							pointCloudMsg->header.frame_id.c_str(), frameId().c_str(), pointCloudMsg->header.stamp.toSec());
+					return sensor_msgs::PointCloud2ConstPtr();
 				}
-				else
+				cloudPtr = cloudInBaseFrame;
+			}
+
+			sensor_msgs::PointCloud2::Ptr cloudDeskewed(new sensor_msgs::PointCloud2);
+			if(!rtabmap_conversions::deskew(*cloudPtr, *cloudDeskewed, previousStamp(), velocityGuess()))
+			{
+				return sensor_msgs::PointCloud2ConstPtr();
+			}
+
+			if(!alreadyInBaseFrame)
+			{
+				// put back in scan frame
+				sensor_msgs::PointCloud2::Ptr cloudInScanFrame(new sensor_msgs::PointCloud2);
+				if(!pcl_ros::transformPointCloud(pointCloudMsg->header.frame_id.c_str(), *cloudDeskewed, *cloudInScanFrame, this->tfListener()))
 				{
-					cloudMsg = cloudDeskewed;
+					ROS_ERROR("Cannot transform back projected scan from \"%s\" frame to \"%s\" frame at time %fs.",
+							frameId().c_str(), pointCloudMsg->header.frame_id.c_str(), pointCloudMsg->header.stamp.toSec());
+					return sensor_msgs::PointCloud2ConstPtr();
 				}
+				return cloudInScanFrame;
+			}
+			return cloudDeskewed;
+		}
+		return cloudMsg;
+	}
+
+	void processCloud(const sensor_msgs::PointCloud2ConstPtr& pointCloudMsg, bool deskewed, bool filtered = false)
+	{
+		// Only copy the input cloud if it is modified by a plugin or deskewing
+		sensor_msgs::PointCloud2ConstPtr cloudMsg = pointCloudMsg;
+		for (size_t i = 0; !filtered && i < plugins_.size(); i++)
+		{
+			if (plugins_[i]->isEnabled())
+			{
+				cloudMsg.reset(new sensor_msgs::PointCloud2(plugins_[i]->filterPointCloud(*cloudMsg)));
+			}
+		}
+
+		Transform localScanTransform = rtabmap_conversions::getTransform(this->frameId(), cloudMsg->header.frame_id, cloudMsg->header.stamp, this->tfListener(), this->waitForTransformDuration());
+		if(localScanTransform.isNull())
+		{
+			ROS_ERROR("TF of received scan cloud at time %fs is not set, aborting rtabmap update.", cloudMsg->header.stamp.toSec());
+			return;
+		}
+
+		if(deskewing_ && !deskewed)
+		{
+			cloudMsg = deskewCloud(pointCloudMsg, cloudMsg);
+			if(!cloudMsg)
+			{
+				ROS_ERROR("Failed to deskew input cloud, aborting odometry update!");
+				return;
 			}
 		}
 
@@ -719,6 +981,7 @@ private:
 		    scanCloudMaxPoints_ = 0;
 		}
 		int maxLaserScans = scanCloudMaxPoints_;
+		bool rangeFiltered = false;
 
 		if(hasNormals && hasIntensity)
 		{
@@ -758,24 +1021,8 @@ private:
 		}
 		else if(hasIntensity)
 		{
-			pcl::PointCloud<pcl::PointXYZI>::Ptr pclScan(new pcl::PointCloud<pcl::PointXYZI>);
-			pcl::fromROSMsg(*cloudMsg, *pclScan);
-			if(pclScan->size() && scanDownsamplingStep_ > 1)
-			{
-				pclScan = util3d::downsample(pclScan, scanDownsamplingStep_);
-				if(pclScan->height>1)
-				{
-					maxLaserScans = pclScan->height * pclScan->width;
-				}
-				else
-				{
-					maxLaserScans /= scanDownsamplingStep_;
-				}
-			}
-			if(!pclScan->is_dense)
-			{
-				pclScan = util3d::removeNaNFromPointCloud(pclScan);
-			}
+			pcl::PointCloud<pcl::PointXYZI>::Ptr pclScan = compactCloud<pcl::PointXYZI>(*cloudMsg, is3D, maxLaserScans);
+			rangeFiltered = true;
 
 			if(pclScan->size())
 			{
@@ -804,24 +1051,8 @@ private:
 		}
 		else
 		{
-			pcl::PointCloud<pcl::PointXYZ>::Ptr pclScan(new pcl::PointCloud<pcl::PointXYZ>);
-			pcl::fromROSMsg(*cloudMsg, *pclScan);
-			if(pclScan->size() && scanDownsamplingStep_ > 1)
-			{
-				pclScan = util3d::downsample(pclScan, scanDownsamplingStep_);
-				if(pclScan->height>1)
-				{
-					maxLaserScans = pclScan->height * pclScan->width;
-				}
-				else
-				{
-					maxLaserScans /= scanDownsamplingStep_;
-				}
-			}
-			if(!pclScan->is_dense)
-			{
-				pclScan = util3d::removeNaNFromPointCloud(pclScan);
-			}
+			pcl::PointCloud<pcl::PointXYZ>::Ptr pclScan = compactCloud<pcl::PointXYZ>(*cloudMsg, is3D, maxLaserScans);
+			rangeFiltered = true;
 
 			if(pclScan->size())
 			{
@@ -853,7 +1084,7 @@ private:
 				maxLaserScans,
 				0,
 				localScanTransform);
-		if(scanRangeMin_ > 0 || scanRangeMax_ > 0)
+		if(!rangeFiltered && (scanRangeMin_ > 0 || scanRangeMax_ > 0))
 		{
 			laserScan = util3d::rangeFiltering(laserScan, scanRangeMin_, scanRangeMax_);
 		}
@@ -873,6 +1104,98 @@ private:
 		this->processData(data, cloudMsg->header);
 	}
 
+	static void setIntensity(pcl::PointXYZ & pt, float intensity) {}
+	static void setIntensity(pcl::PointXYZI & pt, float intensity) {pt.intensity = intensity;}
+
+	// Single pass over the PointCloud2 buffer doing downsampling, NaN and
+	// range filtering, so that only the compact cloud is allocated
+	// instead of full size clouds from pcl::fromROSMsg(),
+	// util3d::downsample() and util3d::removeNaNFromPointCloud().
+	template<typename PointT>
+	typename pcl::PointCloud<PointT>::Ptr compactCloud(const sensor_msgs::PointCloud2 & msg, bool is3D, int & maxLaserScans) const
+	{
+		int offsetX = -1;
+		int offsetY = -1;
+		int offsetZ = -1;
+		int offsetI = -1;
+		for(unsigned int i=0; i<msg.fields.size(); ++i)
+		{
+			if(msg.fields[i].datatype != sensor_msgs::PointField::FLOAT32)
+			{
+				continue;
+			}
+			if(msg.fields[i].name.compare("x") == 0)
+			{
+				offsetX = msg.fields[i].offset;
+			}
+			else if(msg.fields[i].name.compare("y") == 0)
+			{
+				offsetY = msg.fields[i].offset;
+			}
+			else if(msg.fields[i].name.compare("z") == 0)
+			{
+				offsetZ = msg.fields[i].offset;
+			}
+			else if(msg.fields[i].name.compare("intensity") == 0)
+			{
+				offsetI = msg.fields[i].offset;
+			}
+		}
+
+		typename pcl::PointCloud<PointT>::Ptr cloud(new pcl::PointCloud<PointT>);
+		if(offsetX < 0 || offsetY < 0)
+		{
+			ROS_ERROR("Input cloud doesn't have float \"x\" and \"y\" fields!");
+			return cloud;
+		}
+
+		int step = scanDownsamplingStep_>1?scanDownsamplingStep_:1;
+		if(step > 1)
+		{
+			if(msg.height > 1)
+			{
+				maxLaserScans = msg.height * (msg.width/step);
+			}
+			else
+			{
+				maxLaserScans /= step;
+			}
+		}
+		float minRange2 = scanRangeMin_>0?scanRangeMin_*scanRangeMin_:0.0f;
+		float maxRange2 = scanRangeMax_>0?scanRangeMax_*scanRangeMax_:0.0f;
+
+		cloud->reserve(msg.height * (msg.width/step + 1));
+		for(size_t v=0; v<msg.height; ++v)
+		{
+			const uint8_t * row = &msg.data[v*msg.row_step];
+			for(size_t u=0; u<msg.width; u+=step)
+			{
+				const uint8_t * ptr = row + u*msg.point_step;
+				PointT pt;
+				pt.x = *((const float*)(ptr+offsetX));
+				pt.y = *((const float*)(ptr+offsetY));
+				pt.z = offsetZ>=0?*((const float*)(ptr+offsetZ)):0.0f;
+				if(!pcl::isFinite(pt))
+				{
+					continue;
+				}
+				float range2 = pt.x*pt.x + pt.y*pt.y + (is3D?pt.z*pt.z:0.0f); // z ignored for 2D scans, like util3d::rangeFiltering()
+				if((minRange2 > 0.0f && range2 < minRange2) ||
+				   (maxRange2 > 0.0f && range2 > maxRange2))
+				{
+					continue;
+				}
+				if(offsetI >= 0)
+				{
+					setIntensity(pt, *((const float*)(ptr+offsetI)));
+				}
+				cloud->push_back(pt);
+			}
+		}
+		cloud->is_dense = true;
+		return cloud;
+	}
+
 protected:
 	virtual void flushCallbacks()
 	{
@@ -910,6 +1233,17 @@ private:
 	bool scanReceived_ = false;
 	bool cloudReceived_ = false;
 
+	// multiple lidars
+	int scanCloudCount_;
+	message_filters::Subscriber<sensor_msgs::PointCloud2> cloud_subs_[4];
+	typedef message_filters::sync_policies::ApproximateTime<sensor_msgs::PointCloud2, sensor_msgs::PointCloud2> MyApproxCloud2SyncPolicy;
+	typedef message_filters::sync_policies::ApproximateTime<sensor_msgs::PointCloud2, sensor_msgs::PointCloud2, sensor_msgs::PointCloud2> MyApproxCloud3SyncPolicy;
+	typedef message_filters::sync_policies::ApproximateTime<sensor_msgs::PointCloud2, sensor_msgs::PointCloud2, sensor_msgs::PointCloud2, sensor_msgs::PointCloud2> MyApproxCloud4SyncPolicy;
+	message_filters::Synchronizer<MyApproxCloud2SyncPolicy> * approxCloud2Sync_;
+	message_filters::Synchronizer<MyApproxCloud3SyncPolicy> * approxCloud3Sync_;
+	message_filters::Synchronizer<MyApproxCloud4SyncPolicy> * approxCloud4Sync_;
+	sensor_msgs::PointCloud2::Ptr mergedCloud_;
+
 };
 
 PLUGINLIB_EXPORT_CLASS(rtabmap_odom::ICPOdometry, nodelet::Nodelet);
@@ -47,6 +47,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <sensor_msgs/PointCloud2.h>
 #include <pcl_conversions/pcl_conversions.h>
 
+#include <boost/thread.hpp>
+
 #include "rtabmap_conversions/MsgConversion.h"
 
 #include <rtabmap/core/util3d.h>
@@ -77,7 +79,8 @@ public:
 		scanCloudMaxPoints_(0),
 		scanVoxelSize_(0.0),
 		scanNormalK_(0),
-		scanNormalRadius_(0.0)
+		scanNormalRadius_(0.0),
+		parallelScanPreparation_(false)
 	{
 	}
 
@@ -126,6 +129,7 @@ private:
 		}
 		pnh.param("scan_normal_radius", scanNormalRadius_, scanNormalRadius_);
 		pnh.param("keep_color", keepColor_, keepColor_);
+		pnh.param("parallel_scan_preparation", parallelScanPreparation_, parallelScanPreparation_);
 
 		NODELET_INFO("RGBDIcpOdometry: approx_sync           = %s", approxSync?"true":"false");
 		if(approxSync)
@@ -137,6 +141,7 @@ private:
 		NODELET_INFO("RGBDIcpOdometry: scan_normal_k         = %d", scanNormalK_);
 		NODELET_INFO("RGBDIcpOdometry: scan_normal_radius    = %f", scanNormalRadius_);
 		NODELET_INFO("RGBDIcpOdometry: keep_color            = %s", keepColor_?"true":"false");
+		NODELET_INFO("RGBDIcpOdometry: parallel_scan_preparation = %s", parallelScanPreparation_?"true":"false");
 
 		ros::NodeHandle rgb_nh(nh, "rgb");
 		ros::NodeHandle depth_nh(nh, "depth");
@@ -236,6 +241,155 @@ private:
 		callbackCommon(image, depth, cameraInfo, scanMsg, cloudMsg);
 	}
 
+	void convertImages(
+			const sensor_msgs::ImageConstPtr& image,
+			const sensor_msgs::ImageConstPtr& depth,
+			cv_bridge::CvImagePtr & ptrImage,
+			cv_bridge::CvImagePtr & ptrDepth)
+	{
+		ptrImage = cv_bridge::toCvCopy(image,
+				image->encoding.compare(sensor_msgs::image_encodings::TYPE_8UC1)==0 ||
+				image->encoding.compare(sensor_msgs::image_encodings::MONO8)==0?"":
+						keepColor_ && image->encoding.compare(sensor_msgs::image_encodings::MONO16)!=0?"bgr8":"mono8");
+		ptrDepth = cv_bridge::toCvCopy(depth);
+	}
+
+	void prepareScan(
+			const sensor_msgs::LaserScanConstPtr& scanMsg,
+			const sensor_msgs::PointCloud2ConstPtr& cloudMsg,
+			LaserScan * scan,
+			Transform * localScanTransform,
+			int * maxLaserScans,
+			bool * ok)
+	{
+		*ok = true;
+		if(scanMsg.get() != 0)
+		{
+			// make sure the frame of the laser is updated too
+			*localScanTransform = rtabmap_conversions::getTransform(this->frameId(),
+					scanMsg->header.frame_id,
+					scanMsg->header.stamp + ros::Duration().fromSec(scanMsg->ranges.size()*scanMsg->time_increment),
+					this->tfListener(),
+					this->waitForTransformDuration());
+			if(localScanTransform->isNull())
+			{
+				ROS_ERROR("TF of received laser scan topic at time %fs is not set, aborting odometry update.", scanMsg->header.stamp.toSec());
+				*ok = false;
+				return;
+			}
+
+			//transform in frameId_ frame
+			sensor_msgs::PointCloud2 scanOut;
+			laser_geometry::LaserProjection projection;
+			projection.transformLaserScanToPointCloud(scanMsg->header.frame_id, *scanMsg, scanOut, this->tfListener());
+			pcl::PointCloud<pcl::PointXYZ>::Ptr pclScan(new pcl::PointCloud<pcl::PointXYZ>);
+			pcl::fromROSMsg(scanOut, *pclScan);
+			pclScan->is_dense = true;
+
+			*maxLaserScans = (int)scanMsg->ranges.size();
+			if(pclScan->size())
+			{
+				if(scanVoxelSize_ > 0.0f)
+				{
+					float pointsBeforeFiltering = (float)pclScan->size();
+					pclScan = util3d::voxelize(pclScan, scanVoxelSize_);
+					float ratio = float(pclScan->size()) / pointsBeforeFiltering;
+					*maxLaserScans = int(float(*maxLaserScans) * ratio);
+				}
+				if(scanNormalK_ > 0 || scanNormalRadius_>0.0f)
+				{
+					//compute normals
+					pcl::PointCloud<pcl::Normal>::Ptr normals;
+					if(scanVoxelSize_ > 0.0f)
+					{
+						normals = util3d::computeNormals2D(pclScan, scanNormalK_, scanNormalRadius_);
+					}
+					else
+					{
+						normals = util3d::computeFastOrganizedNormals2D(pclScan, scanNormalK_, scanNormalRadius_);
+					}
+					pcl::PointCloud<pcl::PointNormal>::Ptr pclScanNormal(new pcl::PointCloud<pcl::PointNormal>);
+					pcl::concatenateFields(*pclScan, *normals, *pclScanNormal);
+					*scan = util3d::laserScan2dFromPointCloud(*pclScanNormal);
+				}
+				else
+				{
+					*scan = util3d::laserScan2dFromPointCloud(*pclScan);
+				}
+			}
+		}
+		else if(cloudMsg.get() != 0)
+		{
+			UASSERT_MSG(cloudMsg->data.size() == cloudMsg->row_step*cloudMsg->height,
+					uFormat("data=%d row_step=%d height=%d", cloudMsg->data.size(), cloudMsg->row_step, cloudMsg->height).c_str());
+
+
+			bool containNormals = false;
+			if(scanVoxelSize_ == 0.0f)
+			{
+				for(unsigned int i=0; i<cloudMsg->fields.size(); ++i)
+				{
+					if(cloudMsg->fields[i].name.compare("normal_x") == 0)
+					{
+						containNormals = true;
+						break;
+					}
+				}
+			}
+			*localScanTransform = rtabmap_conversions::getTransform(this->frameId(), cloudMsg->header.frame_id, cloudMsg->header.stamp, this->tfListener(), this->waitForTransformDuration());
+			if(localScanTransform->isNull())
+			{
+				ROS_ERROR("TF of received scan cloud at time %fs is not set, aborting rtabmap update.", cloudMsg->header.stamp.toSec());
+				*ok = false;
+				return;
+			}
+
+			*maxLaserScans = scanCloudMaxPoints_;
+			if(containNormals)
+			{
+				pcl::PointCloud<pcl::PointNormal>::Ptr pclScan(new pcl::PointCloud<pcl::PointNormal>);
+				pcl::fromROSMsg(*cloudMsg, *pclScan);
+				if(!pclScan->is_dense)
+				{
+					pclScan = util3d::removeNaNNormalsFromPointCloud(pclScan);
+				}
+				*scan = util3d::laserScanFromPointCloud(*pclScan);
+			}
+			else
+			{
+				pcl::PointCloud<pcl::PointXYZ>::Ptr pclScan(new pcl::PointCloud<pcl::PointXYZ>);
+				pcl::fromROSMsg(*cloudMsg, *pclScan);
+				if(!pclScan->is_dense)
+				{
+					pclScan = util3d::removeNaNFromPointCloud(pclScan);
+				}
+
+				if(pclScan->size())
+				{
+					if(scanVoxelSize_ > 0.0f)
+					{
+						float pointsBeforeFiltering = (float)pclScan->size();
+						pclScan = util3d::voxelize(pclScan, scanVoxelSize_);
+						float ratio = float(pclScan->size()) / pointsBeforeFiltering;
+						*maxLaserScans = int(float(*maxLaserScans) * ratio);
+					}
+					if(scanNormalK_ > 0 || scanNormalRadius_>0.0f)
+					{
+						//compute normals
+						pcl::PointCloud<pcl::Normal>::Ptr normals = util3d::computeNormals(pclScan, scanNormalK_, scanNormalRadius_);
+						pcl::PointCloud<pcl::PointNormal>::Ptr pclScanNormal(new pcl::PointCloud<pcl::PointNormal>);
+						pcl::concatenateFields(*pclScan, *normals, *pclScanNormal);
+						*scan = util3d::laserScanFromPointCloud(*pclScanNormal);
+					}
+					else
+					{
+						*scan = util3d::laserScanFromPointCloud(*pclScan);
+					}
+				}
+			}
+		}
+	}
+
 	void callbackCommon(
 			const sensor_msgs::ImageConstPtr& image,
 			const sensor_msgs::ImageConstPtr& depth,
@@ -302,137 +456,27 @@ private:
 			if(image->data.size() && depth->data.size() && cameraInfo->K[4] != 0)
 			{
 				rtabmap::CameraModel rtabmapModel = rtabmap_conversions::cameraModelFromROS(*cameraInfo, localTransform);
-				cv_bridge::CvImagePtr ptrImage = cv_bridge::toCvCopy(image,
-						image->encoding.compare(sensor_msgs::image_encodings::TYPE_8UC1)==0 ||
-						image->encoding.compare(sensor_msgs::image_encodings::MONO8)==0?"":
-								keepColor_ && image->encoding.compare(sensor_msgs::image_encodings::MONO16)!=0?"bgr8":"mono8");
-				cv_bridge::CvImagePtr ptrDepth = cv_bridge::toCvCopy(depth);
-
+				cv_bridge::CvImagePtr ptrImage;
+				cv_bridge::CvImagePtr ptrDepth;
 				LaserScan scan;
 				Transform localScanTransform = Transform::getIdentity();
 				int maxLaserScans = 0;
-				if(scanMsg.get() != 0)
+				bool scanOk = true;
+				if(parallelScanPreparation_ && (scanMsg.get() != 0 || cloudMsg.get() != 0))
 				{
-					// make sure the frame of the laser is updated too
-					localScanTransform = rtabmap_conversions::getTransform(this->frameId(),
-							scanMsg->header.frame_id,
-							scanMsg->header.stamp + ros::Duration().fromSec(scanMsg->ranges.size()*scanMsg->time_increment),
-							this->tfListener(),
-							this->waitForTransformDuration());
-					if(localScanTransform.isNull())
-					{
-						ROS_ERROR("TF of received laser scan topic at time %fs is not set, aborting odometry update.", scanMsg->header.stamp.toSec());
-						return;
-					}
-
-					//transform in frameId_ frame
-					sensor_msgs::PointCloud2 scanOut;
-					laser_geometry::LaserProjection projection;
-					projection.transformLaserScanToPointCloud(scanMsg->header.frame_id, *scanMsg, scanOut, this->tfListener());
-					pcl::PointCloud<pcl::PointXYZ>::Ptr pclScan(new pcl::PointCloud<pcl::PointXYZ>);
-					pcl::fromROSMsg(scanOut, *pclScan);
-					pclScan->is_dense = true;
-
-					maxLaserScans = (int)scanMsg->ranges.size();
-					if(pclScan->size())
-					{
-						if(scanVoxelSize_ > 0.0f)
-						{
-							float pointsBeforeFiltering = (float)pclScan->size();
-							pclScan = util3d::voxelize(pclScan, scanVoxelSize_);
-							float ratio = float(pclScan->size()) / pointsBeforeFiltering;
-							maxLaserScans = int(float(maxLaserScans) * ratio);
-						}
-						if(scanNormalK_ > 0 || scanNormalRadius_>0.0f)
-						{
-							//compute normals
-							pcl::PointCloud<pcl::Normal>::Ptr normals;
-							if(scanVoxelSize_ > 0.0f)
-							{
-								normals = util3d::computeNormals2D(pclScan, scanNormalK_, scanNormalRadius_);
-							}
-							else
-							{
-								normals = util3d::computeFastOrganizedNormals2D(pclScan, scanNormalK_, scanNormalRadius_);
-							}
-							pcl::PointCloud<pcl::PointNormal>::Ptr pclScanNormal(new pcl::PointCloud<pcl::PointNormal>);
-							pcl::concatenateFields(*pclScan, *normals, *pclScanNormal);
-							scan = util3d::laserScan2dFromPointCloud(*pclScanNormal);
-						}
-						else
-						{
-							scan = util3d::laserScan2dFromPointCloud(*pclScan);
-						}
-					}
+					// filter the scan and compute its normals while the images are converted
+					boost::thread scanThread(boost::bind(&RGBDICPOdometry::prepareScan, this, scanMsg, cloudMsg, &scan, &localScanTransform, &maxLaserScans, &scanOk));
+					convertImages(image, depth, ptrImage, ptrDepth);
+					scanThread.join();
 				}
-				else if(cloudMsg.get() != 0)
+				else
 				{
-					UASSERT_MSG(cloudMsg->data.size() == cloudMsg->row_step*cloudMsg->height,
-							uFormat("data=%d row_step=%d height=%d", cloudMsg->data.size(), cloudMsg->row_step, cloudMsg->height).c_str());
-
-
-					bool containNormals = false;
-					if(scanVoxelSize_ == 0.0f)
-					{
-						for(unsigned int i=0; i<cloudMsg->fields.size(); ++i)
-						{
-							if(cloudMsg->fields[i].name.compare("normal_x") == 0)
-							{
-								containNormals = true;
-								break;
-							}
-						}
-					}
-					localScanTransform = rtabmap_conversions::getTransform(this->frameId(), cloudMsg->header.frame_id, cloudMsg->header.stamp, this->tfListener(), this->waitForTransformDuration());
-					if(localScanTransform.isNull())
-					{
-						ROS_ERROR("TF of received scan cloud at time %fs is not set, aborting rtabmap update.", cloudMsg->header.stamp.toSec());
-						return;
-					}
-
-					maxLaserScans = scanCloudMaxPoints_;
-					if(containNormals)
-					{
-						pcl::PointCloud<pcl::PointNormal>::Ptr pclScan(new pcl::PointCloud<pcl::PointNormal>);
-						pcl::fromROSMsg(*cloudMsg, *pclScan);
-						if(!pclScan->is_dense)
-						{
-							pclScan = util3d::removeNaNNormalsFromPointCloud(pclScan);
-						}
-						scan = util3d::laserScanFromPointCloud(*pclScan);
-					}
-					else
-					{
-						pcl::PointCloud<pcl::PointXYZ>::Ptr pclScan(new pcl::PointCloud<pcl::PointXYZ>);
-						pcl::fromROSMsg(*cloudMsg, *pclScan);
-						if(!pclScan->is_dense)
-						{
-							pclScan = util3d::removeNaNFromPointCloud(pclScan);
-						}
-
-						if(pclScan->size())
-						{
-							if(scanVoxelSize_ > 0.0f)
-							{
-								float pointsBeforeFiltering = (float)pclScan->size();
-								pclScan = util3d::voxelize(pclScan, scanVoxelSize_);
-								float ratio = float(pclScan->size()) / pointsBeforeFiltering;
-								maxLaserScans = int(float(maxLaserScans) * ratio);
-							}
-							if(scanNormalK_ > 0 || scanNormalRadius_>0.0f)
-							{
-								//compute normals
-								pcl::PointCloud<pcl::Normal>::Ptr normals = util3d::computeNormals(pclScan, scanNormalK_, scanNormalRadius_);
-								pcl::PointCloud<pcl::PointNormal>::Ptr pclScanNormal(new pcl::PointCloud<pcl::PointNormal>);
-								pcl::concatenateFields(*pclScan, *normals, *pclScanNormal);
-								scan = util3d::laserScanFromPointCloud(*pclScanNormal);
-							}
-							else
-							{
-								scan = util3d::laserScanFromPointCloud(*pclScan);
-							}
-						}
-					}
+					convertImages(image, depth, ptrImage, ptrDepth);
+					prepareScan(scanMsg, cloudMsg, &scan, &localScanTransform, &maxLaserScans, &scanOk);
+				}
+				if(!scanOk)
+				{
+					return;
 				}
 
 				rtabmap::SensorData data(
@@ -504,6 +548,7 @@ private:
 	double scanVoxelSize_;
 	int scanNormalK_;
 	double scanNormalRadius_;
+	bool parallelScanPreparation_;
 };
 
 PLUGINLIB_EXPORT_CLASS(rtabmap_odom::RGBDICPOdometry, nodelet::Nodelet);
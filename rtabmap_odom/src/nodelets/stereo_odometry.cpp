@@ -37,11 +37,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <image_transport/subscriber_filter.h>
 
 #include <sensor_msgs/Image.h>
+#include <sensor_msgs/CompressedImage.h>
 #include <sensor_msgs/image_encodings.h>
 
 #include <image_geometry/stereo_camera_model.h>
 
 #include <cv_bridge/cv_bridge.h>
+#include <opencv2/highgui/highgui.hpp>
+#include <boost/thread.hpp>
 
 #include "rtabmap_conversions/MsgConversion.h"
 #include <rtabmap_msgs/RGBDImages.h>
@@ -70,6 +73,9 @@ public:
 		exactSync3_(0),
 		approxSync4_(0),
 		exactSync4_(0),
+		approxCompressedSync_(0),
+		exactCompressedSync_(0),
+		decodeDecimation_(1),
 		queueSize_(5),
 		keepColor_(false)
 	{
@@ -85,6 +91,8 @@ public:
 		{
 			delete exactSync_;
 		}
+		delete approxCompressedSync_;
+		delete exactCompressedSync_;
 	}
 
 private:
@@ -248,38 +256,69 @@ private:
 			ros::NodeHandle right_nh(nh, "right");
 			ros::NodeHandle left_pnh(pnh, "left");
 			ros::NodeHandle right_pnh(pnh, "right");
-			image_transport::ImageTransport left_it(left_nh);
-			image_transport::ImageTransport right_it(right_nh);
-			image_transport::TransportHints hintsLeft("raw", ros::TransportHints(), left_pnh);
-			image_transport::TransportHints hintsRight("raw", ros::TransportHints(), right_pnh);
-
-			imageRectLeft_.subscribe(left_it, left_nh.resolveName("image_rect"), 1, hintsLeft);
-			imageRectRight_.subscribe(right_it, right_nh.resolveName("image_rect"), 1, hintsRight);
 			cameraInfoLeft_.subscribe(left_nh, "camera_info", 1);
 			cameraInfoRight_.subscribe(right_nh, "camera_info", 1);
-
-			if(approxSync)
+			if(decodeDecimation_ > 1)
 			{
-				approxSync_ = new message_filters::Synchronizer<MyApproxSyncPolicy>(MyApproxSyncPolicy(queueSize_), imageRectLeft_, imageRectRight_, cameraInfoLeft_, cameraInfoRight_);
-				if(approxSyncMaxInterval>0.0)
-					approxSync_->setMaxIntervalDuration(ros::Duration(approxSyncMaxInterval));
-				approxSync_->registerCallback(boost::bind(&StereoOdometry::callback, this, boost::placeholders::_1, boost::placeholders::_2, boost::placeholders::_3, boost::placeholders::_4));
+				// Decode compressed images directly at the decimated resolution
+				compressedLeft_.subscribe(left_nh, left_nh.resolveName("image_rect")+"/compressed", 1);
+				compressedRight_.subscribe(right_nh, right_nh.resolveName("image_rect")+"/compressed", 1);
+				if(approxSync)
+				{
+					approxCompressedSync_ = new message_filters::Synchronizer<MyApproxCompressedSyncPolicy>(MyApproxCompressedSyncPolicy(queueSize_), compressedLeft_, compressedRight_, cameraInfoLeft_, cameraInfoRight_);
+					if(approxSyncMaxInterval>0.0)
+						approxCompressedSync_->setMaxIntervalDuration(ros::Duration(approxSyncMaxInterval));
+					approxCompressedSync_->registerCallback(boost::bind(&StereoOdometry::callbackCompressed, this, boost::placeholders::_1, boost::placeholders::_2, boost::placeholders::_3, boost::placeholders::_4));
+				}
+				else
+				{
+					exactCompressedSync_ = new message_filters::Synchronizer<MyExactCompressedSyncPolicy>(MyExactCompressedSyncPolicy(queueSize_), compressedLeft_, compressedRight_, cameraInfoLeft_, cameraInfoRight_);
+					exactCompressedSync_->registerCallback(boost::bind(&StereoOdometry::callbackCompressed, this, boost::placeholders::_1, boost::placeholders::_2, boost::placeholders::_3, boost::placeholders::_4));
+				}
+
+				subscribedTopicsMsg = uFormat("\n%s subscribed to (%s sync%s, decoded at 1/%d resolution):\n   %s \\\n   %s \\\n   %s \\\n   %s",
+						getName().c_str(),
+						approxSync?"approx":"exact",
+						approxSync&&approxSyncMaxInterval!=0.0?uFormat(", max interval=%fs", approxSyncMaxInterval).c_str():"",
+						decodeDecimation_,
+						compressedLeft_.getTopic().c_str(),
+						compressedRight_.getTopic().c_str(),
+						cameraInfoLeft_.getTopic().c_str(),
+						cameraInfoRight_.getTopic().c_str());
 			}
 			else
 			{
-				exactSync_ = new message_filters::Synchronizer<MyExactSyncPolicy>(MyExactSyncPolicy(queueSize_), imageRectLeft_, imageRectRight_, cameraInfoLeft_, cameraInfoRight_);
-				exactSync_->registerCallback(boost::bind(&StereoOdometry::callback, this, boost::placeholders::_1, boost::placeholders::_2, boost::placeholders::_3, boost::placeholders::_4));
-			}
+				image_transport::ImageTransport left_it(left_nh);
+				image_transport::ImageTransport right_it(right_nh);
+				image_transport::TransportHints hintsLeft("raw", ros::TransportHints(), left_pnh);
+				image_transport::TransportHints hintsRight("raw", ros::TransportHints(), right_pnh);
+
+				imageRectLeft_.subscribe(left_it, left_nh.resolveName("image_rect"), 1, hintsLeft);
+				imageRectRight_.subscribe(right_it, right_nh.resolveName("image_rect"), 1, hintsRight);
+
+				if(approxSync)
+				{
+					approxSync_ = new message_filters::Synchronizer<MyApproxSyncPolicy>(MyApproxSyncPolicy(queueSize_), imageRectLeft_, imageRectRight_, cameraInfoLeft_, cameraInfoRight_);
+					if(approxSyncMaxInterval>0.0)
+						approxSync_->setMaxIntervalDuration(ros::Duration(approxSyncMaxInterval));
+					approxSync_->registerCallback(boost::bind(&StereoOdometry::callback, this, boost::placeholders::_1, boost::placeholders::_2, boost::placeholders::_3, boost::placeholders::_4));
+				}
+				else
+				{
+					exactSync_ = new message_filters::Synchronizer<MyExactSyncPolicy>(MyExactSyncPolicy(queueSize_), imageRectLeft_, imageRectRight_, cameraInfoLeft_, cameraInfoRight_);
+					exactSync_->registerCallback(boost::bind(&StereoOdometry::callback, this, boost::placeholders::_1, boost::placeholders::_2, boost::placeholders::_3, boost::placeholders::_4));
+				}
 
 
-			subscribedTopicsMsg = uFormat("\n%s subscribed to (%s sync%s):\n   %s \\\n   %s \\\n   %s \\\n   %s",
-					getName().c_str(),
-					approxSync?"approx":"exact",
-					approxSync&&approxSyncMaxInterval!=0.0?uFormat(", max interval=%fs", approxSyncMaxInterval).c_str():"",
-					imageRectLeft_.getTopic().c_str(),
-					imageRectRight_.getTopic().c_str(),
-					cameraInfoLeft_.getTopic().c_str(),
-					cameraInfoRight_.getTopic().c_str());
+				subscribedTopicsMsg = uFormat("\n%s subscribed to (%s sync%s):\n   %s \\\n   %s \\\n   %s \\\n   %s",
+						getName().c_str(),
+						approxSync?"approx":"exact",
+						approxSync&&approxSyncMaxInterval!=0.0?uFormat(", max interval=%fs", approxSyncMaxInterval).c_str():"",
+						imageRectLeft_.getTopic().c_str(),
+						imageRectRight_.getTopic().c_str(),
+						cameraInfoLeft_.getTopic().c_str(),
+						cameraInfoRight_.getTopic().c_str());
+			}
 		}
 
 		this->startWarningThread(subscribedTopicsMsg, approxSync);
@@ -294,6 +333,93 @@ private:
 			ROS_WARN("Stereo odometry works only with \"Reg/Strategy\"=0. Ignoring value %s.", iter->second.c_str());
 		}
 		uInsert(parameters, ParametersPair(Parameters::kRegStrategy(), "0"));
+
+		bool decodeAtImageDecimation = false;
+		getPrivateNodeHandle().param("decode_at_image_decimation", decodeAtImageDecimation, decodeAtImageDecimation);
+		if(decodeAtImageDecimation && !getPrivateNodeHandle().param("subscribe_rgbd", false))
+		{
+			int decimation = Parameters::defaultOdomImageDecimation();
+			Parameters::parse(parameters, Parameters::kOdomImageDecimation(), decimation);
+			if(decimation == 2 || decimation == 4 || decimation == 8)
+			{
+				// images are already decimated when decoded
+				decodeDecimation_ = decimation;
+				uInsert(parameters, ParametersPair(Parameters::kOdomImageDecimation(), "1"));
+				NODELET_INFO("StereoOdometry: decode_at_image_decimation = true (%s=%d)", Parameters::kOdomImageDecimation().c_str(), decimation);
+			}
+			else
+			{
+				NODELET_WARN("StereoOdometry: decode_at_image_decimation is ignored: %s should be 2, 4 or 8 (it is %d).", Parameters::kOdomImageDecimation().c_str(), decimation);
+			}
+		}
+	}
+
+	static void decodeCompressed(const sensor_msgs::CompressedImageConstPtr & msg, int decimation, bool color, cv_bridge::CvImagePtr * image)
+	{
+		int flags = cv::IMREAD_REDUCED_GRAYSCALE_2;
+		if(decimation == 4)
+		{
+			flags = color?cv::IMREAD_REDUCED_COLOR_4:cv::IMREAD_REDUCED_GRAYSCALE_4;
+		}
+		else if(decimation == 8)
+		{
+			flags = color?cv::IMREAD_REDUCED_COLOR_8:cv::IMREAD_REDUCED_GRAYSCALE_8;
+		}
+		else if(color)
+		{
+			flags = cv::IMREAD_REDUCED_COLOR_2;
+		}
+		(*image).reset(new cv_bridge::CvImage);
+		(*image)->header = msg->header;
+		(*image)->image = cv::imdecode(cv::Mat(msg->data), flags);
+		(*image)->encoding = color?sensor_msgs::image_encodings::BGR8:sensor_msgs::image_encodings::MONO8;
+	}
+
+	static sensor_msgs::CameraInfo decimateCameraInfo(const sensor_msgs::CameraInfo & info, int decimation, const cv::Size & size)
+	{
+		sensor_msgs::CameraInfo out = info;
+		out.width = size.width;
+		out.height = size.height;
+		out.K[0] /= decimation; // fx
+		out.K[2] /= decimation; // cx
+		out.K[4] /= decimation; // fy
+		out.K[5] /= decimation; // cy
+		out.P[0] /= decimation; // fx
+		out.P[2] /= decimation; // cx
+		out.P[3] /= decimation; // -fx*baseline
+		out.P[5] /= decimation; // fy
+		out.P[6] /= decimation; // cy
+		return out;
+	}
+
+	void callbackCompressed(
+				const sensor_msgs::CompressedImageConstPtr& imageLeft,
+				const sensor_msgs::CompressedImageConstPtr& imageRight,
+				const sensor_msgs::CameraInfoConstPtr& cameraInfoLeft,
+				const sensor_msgs::CameraInfoConstPtr& cameraInfoRight)
+	{
+		callbackCalled();
+		if(!this->isPaused())
+		{
+			// decode both images in parallel
+			cv_bridge::CvImagePtr left, right;
+			boost::thread rightThread(boost::bind(&StereoOdometry::decodeCompressed, imageRight, decodeDecimation_, false, &right));
+			decodeCompressed(imageLeft, decodeDecimation_, keepColor_, &left);
+			rightThread.join();
+
+			if(left->image.empty() || right->image.empty())
+			{
+				NODELET_ERROR("Failed to decode compressed stereo images (format left=\"%s\" right=\"%s\").",
+						imageLeft->format.c_str(), imageRight->format.c_str());
+				return;
+			}
+
+			std::vector<cv_bridge::CvImageConstPtr> leftMsgs(1, left);
+			std::vector<cv_bridge::CvImageConstPtr> rightMsgs(1, right);
+			std::vector<sensor_msgs::CameraInfo> leftInfoMsgs(1, decimateCameraInfo(*cameraInfoLeft, decodeDecimation_, left->image.size()));
+			std::vector<sensor_msgs::CameraInfo> rightInfoMsgs(1, decimateCameraInfo(*cameraInfoRight, decodeDecimation_, right->image.size()));
+			this->commonCallback(leftMsgs, rightMsgs, leftInfoMsgs, rightInfoMsgs);
+		}
 	}
 
 	void commonCallback(
@@ -837,6 +963,14 @@ private:
 	typedef message_filters::sync_policies::ExactTime<rtabmap_msgs::RGBDImage, rtabmap_msgs::RGBDImage, rtabmap_msgs::RGBDImage, rtabmap_msgs::RGBDImage> MyExactSync4Policy;
 	message_filters::Synchronizer<MyExactSync4Policy> * exactSync4_;
 
+	message_filters::Subscriber<sensor_msgs::CompressedImage> compressedLeft_;
+	message_filters::Subscriber<sensor_msgs::CompressedImage> compressedRight_;
+	typedef message_filters::sync_policies::ApproximateTime<sensor_msgs::CompressedImage, sensor_msgs::CompressedImage, sensor_msgs::CameraInfo, sensor_msgs::CameraInfo> MyApproxCompressedSyncPolicy;
+	message_filters::Synchronizer<MyApproxCompressedSyncPolicy> * approxCompressedSync_;
+	typedef message_filters::sync_policies::ExactTime<sensor_msgs::CompressedImage, sensor_msgs::CompressedImage, sensor_msgs::CameraInfo, sensor_msgs::CameraInfo> MyExactCompressedSyncPolicy;
+	message_filters::Synchronizer<MyExactCompressedSyncPolicy> * exactCompressedSync_;
+	int decodeDecimation_;
+
 	int queueSize_;
 	bool keepColor_;
 };
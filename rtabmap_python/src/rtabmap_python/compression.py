@@ -1,7 +1,17 @@
 
+
+
 import zlib
 import struct
 import numpy as np
+from concurrent.futures import ThreadPoolExecutor
+
+numpy_type_to_cvtype = {'uint8': 0, 'int8': 1, 'uint16': 2,
+                        'int16': 3, 'int32': 4, 'float32': 5,
+                        'float64': 6}
+cvtype_to_numpy_type = {0: 'uint8', 1: 'int8', 2: 'uint16',
+                        3: 'int16', 4: 'int32', 5: 'float32',
+                        6: 'float64'}
 
 def compress(data):
     assert data.ndim == 1 or data.ndim == 2
@@ -14,21 +24,49 @@ def compress(data):
         dim1 = data.shape[0]
         dim2 = data.shape[1]
 
-    numpy_type_to_cvtype = {'uint8': 0, 'int8': 1, 'uint16': 2,
-                            'int16': 3, 'int32': 4, 'float32': 5,
-                            'float64': 6}
-
-    compressed_data = bytearray(zlib.compress(data.tobytes()))
+    # zlib reads the array buffer directly, no intermediate bytes copy
+    compressed_data = bytearray(zlib.compress(memoryview(np.ascontiguousarray(data)).cast('B')))
     compressed_data.extend(struct.pack("iii", dim1, dim2, numpy_type_to_cvtype[data.dtype.name]))
 
     return compressed_data
 
 def uncompress(bytes):
-    cvtype_to_numpy_type = {0: 'uint8', 1: 'int8', 2: 'uint16',
-                            3: 'int16', 4: 'int32', 5: 'float32',
-                            6: 'float64'}
-    out = zlib.decompress(bytes[:len(bytes)-3*4])
-    rows, cols, datatype = struct.unpack_from("iii", bytes, offset=len(bytes)-3*4)
-    data = np.frombuffer(out, dtype=cvtype_to_numpy_type[datatype])
+    # memoryview avoids copying the whole blob to strip the header
+    view = memoryview(bytes)
+    out = zlib.decompress(view[:len(view)-3*4])
+    rows, cols, datatype = struct.unpack_from("iii", view, offset=len(view)-3*4)
+    # OpenCV type: depth in the first 3 bits, channels-1 in the others
+    channels = (datatype >> 3) + 1
+    data = np.frombuffer(out, dtype=cvtype_to_numpy_type[datatype & 7])
+    if channels > 1:
+        return data.reshape((rows, cols, channels))
     return data.reshape((rows, cols))
 
+def uncompress_image(bytes):
+    """Decode an image compressed by rtabmap (JPEG or PNG), like
+    rtabmap::uncompressImage(). 32 bits float depth images saved as
+    4 channels PNG are returned as float32 (a view, not a copy)."""
+    import cv2
+    image = cv2.imdecode(np.frombuffer(bytes, dtype=np.uint8), cv2.IMREAD_UNCHANGED)
+    if image is not None and image.dtype == np.uint8 and image.ndim == 3 and image.shape[2] == 4:
+        image = image.view(np.float32).reshape(image.shape[:2])
+    return image
+
+def _map(function, blobs, threads):
+    # zlib and cv2.imdecode release the GIL, so threads decode in parallel
+    if threads == 1 or len(blobs) <= 1:
+        return [function(b) for b in blobs]
+    with ThreadPoolExecutor(max_workers=threads if threads > 0 else None) as executor:
+        return list(executor.map(function, blobs))
+
+def compress_batch(arrays, threads=0):
+    """compress() on a list of arrays, threads=0 uses all cores."""
+    return _map(compress, arrays, threads)
+
+def uncompress_batch(blobs, threads=0):
+    """uncompress() on a list of blobs, threads=0 uses all cores."""
+    return _map(uncompress, blobs, threads)
+
+def uncompress_image_batch(blobs, threads=0):
+    """uncompress_image() on a list of blobs, threads=0 uses all cores."""
+    return _map(uncompress_image, blobs, threads)
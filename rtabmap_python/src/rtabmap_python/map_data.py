@@ -0,0 +1,121 @@
+
+
+
+import numpy as np
+from concurrent.futures import ThreadPoolExecutor
+from rtabmap_python import compression as cp
+
+# Number of float channels of rtabmap::LaserScan::Format
+laser_scan_format_channels = {1: 2,   # XY
+                              2: 3,   # XYI
+                              3: 5,   # XYNormal
+                              4: 6,   # XYINormal
+                              5: 3,   # XYZ
+                              6: 4,   # XYZI
+                              7: 4,   # XYZRGB
+                              8: 6,   # XYZNormal
+                              9: 7,   # XYZINormal
+                              10: 7,  # XYZRGBNormal
+                              11: 5}  # XYZIT
+
+def _uncompress(bytes):
+    if len(bytes) == 0:
+        return None
+    return cp.uncompress(bytes)
+
+def _uncompress_image(bytes):
+    if len(bytes) == 0:
+        return None
+    return cp.uncompress_image(bytes)
+
+def poses_to_numpy(poses):
+    """geometry_msgs/Pose[] to a Nx7 float64 array (x y z qx qy qz qw)."""
+    return np.array([(p.position.x, p.position.y, p.position.z,
+                      p.orientation.x, p.orientation.y, p.orientation.z, p.orientation.w) for p in poses],
+                    dtype=np.float64).reshape((-1, 7))
+
+def keypoints_to_numpy(node):
+    """Word keypoints of a rtabmap_msgs/NodeData as a structured array
+    (x, y, size, angle, response, octave, class_id)."""
+    dtype = np.dtype([('x', np.float32), ('y', np.float32), ('size', np.float32),
+                      ('angle', np.float32), ('response', np.float32),
+                      ('octave', np.int32), ('class_id', np.int32)])
+    if len(node.wordKptsPacked):
+        # Packed cv::KeyPoint memory layout, octave and class_id are int bits
+        return np.asarray(node.wordKptsPacked, dtype=np.float32).view(dtype)
+    return np.array([(k.pt.x, k.pt.y, k.size, k.angle, k.response, k.octave, k.class_id) for k in node.wordKpts], dtype=dtype)
+
+def points3f_to_numpy(node):
+    """Word 3D points of a rtabmap_msgs/NodeData as a Nx3 float32 array."""
+    if len(node.wordPtsPacked):
+        return np.asarray(node.wordPtsPacked, dtype=np.float32).reshape((-1, 3))
+    return np.array([(p.x, p.y, p.z) for p in node.wordPts], dtype=np.float32).reshape((-1, 3))
+
+def node_data_to_numpy(node, decode_images=True):
+    """Decode a rtabmap_msgs/NodeData in a dictionary of numpy arrays,
+    like nodeDataFromROS() in rtabmap_conversions. Empty fields are None."""
+    out = {'id': node.id,
+           'mapId': node.mapId,
+           'weight': node.weight,
+           'stamp': node.stamp,
+           'label': node.label,
+           'pose': poses_to_numpy([node.pose])[0]}
+
+    if decode_images:
+        out['image'] = _uncompress_image(node.image)
+        out['depth'] = _uncompress_image(node.depth)
+    else:
+        out['image'] = None
+        out['depth'] = None
+
+    out['fx'] = np.asarray(node.fx, dtype=np.float32)
+    out['fy'] = np.asarray(node.fy, dtype=np.float32)
+    out['cx'] = np.asarray(node.cx, dtype=np.float32)
+    out['cy'] = np.asarray(node.cy, dtype=np.float32)
+    out['width'] = np.asarray(node.width, dtype=np.float32)
+    out['height'] = np.asarray(node.height, dtype=np.float32)
+    out['baseline'] = np.asarray(node.baseline, dtype=np.float32)
+
+    scan = _uncompress(node.laserScan)
+    if scan is not None and getattr(node, 'laserScanFloat16', False):
+        # float16 values stored in a CV_16S matrix
+        scan = scan.view(np.float16).astype(np.float32)
+    if scan is not None and node.laserScanFormat in laser_scan_format_channels:
+        scan = scan.reshape((-1, laser_scan_format_channels[node.laserScanFormat]))
+    out['laserScan'] = scan
+    out['laserScanFormat'] = node.laserScanFormat
+    out['laserScanMaxPts'] = node.laserScanMaxPts
+    out['laserScanMaxRange'] = node.laserScanMaxRange
+
+    out['grid_ground'] = _uncompress(node.grid_ground)
+    out['grid_obstacles'] = _uncompress(node.grid_obstacles)
+    out['grid_empty_cells'] = _uncompress(node.grid_empty_cells)
+    out['grid_cell_size'] = node.grid_cell_size
+    out['grid_view_point'] = np.array([node.grid_view_point.x, node.grid_view_point.y, node.grid_view_point.z], dtype=np.float32)
+
+    out['wordIds'] = np.asarray(node.wordIdKeys, dtype=np.int32)
+    out['wordIndices'] = np.asarray(node.wordIdValues, dtype=np.int32)
+    out['wordKpts'] = keypoints_to_numpy(node)
+    out['wordPts'] = points3f_to_numpy(node)
+    out['wordDescriptors'] = _uncompress(node.wordDescriptors)
+    return out
+
+def map_data_to_numpy(map_data, decode_images=True, threads=0):
+    """Decode a rtabmap_msgs/MapData. Returns the optimized graph (ids,
+    Nx7 poses, links as a Nx3 int32 array of from, to, type) and the list
+    of decoded nodes. Nodes are decoded in parallel, threads=0 uses all
+    cores."""
+    graph = {'ids': np.asarray(map_data.graph.posesId, dtype=np.int32),
+             'poses': poses_to_numpy(map_data.graph.poses),
+             'links': np.array([(l.fromId, l.toId, l.type) for l in map_data.graph.links], dtype=np.int32).reshape((-1, 3))}
+
+    def decode(node):
+        return node_data_to_numpy(node, decode_images)
+
+    if threads == 1 or len(map_data.nodes) <= 1:
+        nodes = [decode(n) for n in map_data.nodes]
+    else:
+        # zlib and cv2.imdecode release the GIL
+        with ThreadPoolExecutor(max_workers=threads if threads > 0 else None) as executor:
+            nodes = list(executor.map(decode, map_data.nodes))
+    return graph, nodes
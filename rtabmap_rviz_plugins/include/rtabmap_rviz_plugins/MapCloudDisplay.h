@@ -42,6 +42,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <ros/callback_queue.h>
 
+#include <boost/thread/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
+
 #include <rviz/ogre_helpers/point_cloud.h>
 #include <rviz/message_filter_display.h>
 #include <rviz/default_plugin/point_cloud_transformer.h>
@@ -58,6 +61,8 @@ typedef boost::shared_ptr<PointCloudTransformer> PointCloudTransformerPtr;
 typedef std::vector<std::string> V_string;
 }
 
+class QMessageBox;
+
 using namespace rviz;
 
 namespace rtabmap_rviz_plugins
@@ -90,11 +95,15 @@ public:
 		sensor_msgs::PointCloud2ConstPtr message_;
 		rtabmap::Transform pose_;
 		int id_;
+		size_t params_hash_; // cloud generation parameters, for the disk cache
 
 		Ogre::SceneNode *scene_node_;
 		boost::shared_ptr<rviz::PointCloud> cloud_;
+		boost::shared_ptr<rviz::PointCloud> lod_cloud_; // decimated cloud shown far from the camera
+		bool lod_shown_;
 
 		std::vector<rviz::PointCloud::Point> transformed_points_;
+		std::vector<rviz::PointCloud::Point> lod_points_;
 	};
 	typedef boost::shared_ptr<CloudInfo> CloudInfoPtr;
 
@@ -119,9 +128,12 @@ public:
 	rviz::FloatProperty* cloud_filter_ceiling_height_;
 	rviz::FloatProperty* node_filtering_radius_;
 	rviz::FloatProperty* node_filtering_angle_;
+	rviz::FloatProperty* lod_distance_;
+	rviz::FloatProperty* lod_voxel_size_;
 	rviz::StringProperty * download_namespace;
 	rviz::BoolProperty* download_map_;
 	rviz::BoolProperty* download_graph_;
+	rviz::BoolProperty* disk_cache_;
 
 public Q_SLOTS:
 	void causeRetransform();
@@ -148,12 +160,23 @@ protected:
 
 private:
 	void downloadMap(bool graphOnly);
-	void processMapData(const rtabmap_msgs::MapData& map);
+	bool downloadMapByPages(const std::string & rtabmapNs, QMessageBox * messageBox);
+	bool downloadMapWithDiskCache(const std::string & rtabmapNs, QMessageBox * messageBox);
+	std::string diskCachePath() const;
+	size_t cloudParametersHash() const;
+	std::set<int> loadDiskCache(const std::map<int, size_t> & nodeHashes, const std_msgs::Header & header);
+	void saveDiskCache();
+	void processMapData(const rtabmap_msgs::MapData& map, bool updateGraph = true);
+	CloudInfoPtr createCloud(const rtabmap_msgs::NodeData & node, const std_msgs::Header & header);
+	void cloudWorkerThread();
+	void stopCloudWorkers();
 
 	/**
 	* \brief Transforms the cloud into the correct frame, and sets up our renderable cloud
 	*/
 	bool transformCloud(const CloudInfoPtr& cloud, bool fully_update_transformers);
+	void createLodPoints(const CloudInfoPtr& cloud) const;
+	void setLodShown(const CloudInfoPtr& cloud, bool shown) const;
 
 	rviz::PointCloudTransformerPtr getXYZTransformer(const sensor_msgs::PointCloud2ConstPtr& cloud);
 	rviz::PointCloudTransformerPtr getColorTransformer(const sensor_msgs::PointCloud2ConstPtr& cloud);
@@ -175,7 +198,25 @@ private:
 	std::map<int, CloudInfoPtr> new_cloud_infos_;
 	boost::mutex new_clouds_mutex_;
 
+	// Node data waiting to be decoded into clouds by the worker threads,
+	// so that decompression never runs on the render thread.
+	struct CloudJob
+	{
+		rtabmap_msgs::NodeData node;
+		std_msgs::Header header;
+		unsigned int generation;
+		sensor_msgs::PointCloud2Ptr cloud; // already decoded (disk cache)
+		size_t params_hash;
+	};
+	std::deque<CloudJob> pending_clouds_;
+	boost::mutex pending_clouds_mutex_;
+	boost::condition_variable pending_clouds_cond_;
+	boost::thread_group cloud_workers_;
+	bool cloud_workers_stop_;
+	unsigned int generation_; // incremented on reset, to drop clouds of stale jobs
+
 	std::set<int> nodeDataReceived_;
+	std::map<int, size_t> nodeHashes_; // hash of the odometry links of each node, identifies its data
 	bool fromScan_;
 
 	std::map<int, rtabmap::Transform> current_map_;
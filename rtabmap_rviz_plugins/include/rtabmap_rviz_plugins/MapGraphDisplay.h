@@ -75,6 +75,10 @@ private:
 
   std::vector<Ogre::ManualObject*> manual_objects_;
 
+  // Flat layout (from position, to position, color) of the links
+  // currently in the manual object, to skip rebuilding unchanged graphs.
+  std::vector<float> vertices_;
+
   ColorProperty* color_neighbor_property_;
   ColorProperty* color_neighbor_merged_property_;
   ColorProperty* color_global_property_;
@@ -28,9 +28,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap_rviz_plugins/MapCloudDisplay.h"
 
 #include <QApplication>
+#include <QFile>
 #include <QMessageBox>
 #include <QTimer>
 
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+
 #include <OgreSceneNode.h>
 #include <OgreSceneManager.h>
 
@@ -40,6 +45,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <rviz/display_context.h>
 #include <rviz/frame_manager.h>
+#include <rviz/view_manager.h>
+#include <rviz/view_controller.h>
+#include <OgreCamera.h>
+#include <boost/unordered_set.hpp>
 #include <rviz/ogre_helpers/point_cloud.h>
 #include <rviz/validate_floats.h>
 #include <rviz/properties/int_property.h>
@@ -56,8 +65,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/core/util3d.h>
 #include <rtabmap/core/Compression.h>
 #include <rtabmap/core/Graph.h>
+#include <rtabmap/utilite/UDirectory.h>
+#include <rtabmap/utilite/UStl.h>
+#include <rtabmap/utilite/UTimer.h>
 #include <rtabmap_conversions/MsgConversion.h>
 #include <rtabmap_msgs/GetMap.h>
+#include <rtabmap_msgs/GetMap2.h>
+#include <rtabmap_msgs/GetNodeData.h>
+#include <boost/functional/hash.hpp>
 #include <std_msgs/Int32MultiArray.h>
 
 
@@ -69,7 +84,9 @@ MapCloudDisplay::CloudInfo::CloudInfo() :
 		manager_(0),
 		pose_(rtabmap::Transform::getIdentity()),
 		id_(0),
-		scene_node_(0)
+		params_hash_(0),
+		scene_node_(0),
+		lod_shown_(false)
 {}
 
 MapCloudDisplay::CloudInfo::~CloudInfo()
@@ -93,7 +110,9 @@ MapCloudDisplay::MapCloudDisplay()
     new_color_transformer_(false),
     needs_retransform_(false),
     transformer_class_loader_(NULL),
-	current_map_updated_(false)
+	current_map_updated_(false),
+	cloud_workers_stop_(false),
+	generation_(0)
 {
 	//QIcon icon;
 	//this->setIcon(icon);
@@ -190,6 +209,18 @@ MapCloudDisplay::MapCloudDisplay()
 	node_filtering_angle_->setMin( 0.0f );
 	node_filtering_angle_->setMax( 359.0f );
 
+	lod_distance_ = new rviz::FloatProperty( "LOD distance (m)", 0.0f,
+										 "(Disabled=0) Clouds of nodes farther than this distance from the camera "
+										 "are shown with their decimated version (see LOD voxel size).",
+										 this, SLOT( updateCloudParameters() ), this );
+	lod_distance_->setMin( 0.0f );
+
+	lod_voxel_size_ = new rviz::FloatProperty( "LOD voxel size (m)", 0.1f,
+										 "Voxel size of the decimated clouds shown beyond LOD distance. "
+										 "Takes effect on next generated clouds.",
+										 this, SLOT( updateCloudParameters() ), this );
+	lod_voxel_size_->setMin( 0.001f );
+
 	download_namespace = new rviz::StringProperty("Download namespace", "rtabmap", "Namespace used to call Download services below", this, SLOT( downloadNamespaceChanged() ), this);
 
 	download_map_ = new rviz::BoolProperty( "Download map", false,
@@ -200,6 +231,11 @@ MapCloudDisplay::MapCloudDisplay()
 											 "Download the optimized global graph (without cloud data) using rtabmap/GetMap service.",
 											 this, SLOT( downloadGraph() ), this );
 
+	disk_cache_ = new rviz::BoolProperty( "Disk cache", false,
+										 "Keep the clouds in a file (~/.ros/rtabmap_rviz_clouds_<namespace>.bin) when rviz is closed. With \"Download map\", "
+										 "only the graph is downloaded and only nodes not in the cache are requested with rtabmap/GetNodeData service.",
+										 this );
+
 	downloadNamespaceChanged();
 
 	// PointCloudCommon sets up a callback queue with a thread for each
@@ -209,6 +245,10 @@ MapCloudDisplay::MapCloudDisplay()
 
 MapCloudDisplay::~MapCloudDisplay()
 {
+	stopCloudWorkers();
+
+	saveDiskCache();
+
 	if ( transformer_class_loader_ )
 	{
 		delete transformer_class_loader_;
@@ -263,9 +303,75 @@ void MapCloudDisplay::onInitialize()
 	updateBillboardSize();
 	updateAlpha();
 
+	// Decode clouds in background, keeping one core for rendering
+	int threads = std::max(1, (int)boost::thread::hardware_concurrency()-1);
+	for(int i=0; i<threads; ++i)
+	{
+		cloud_workers_.create_thread(boost::bind(&MapCloudDisplay::cloudWorkerThread, this));
+	}
+
 	spinner_.start();
 }
 
+void MapCloudDisplay::stopCloudWorkers()
+{
+	{
+		boost::mutex::scoped_lock lock(pending_clouds_mutex_);
+		cloud_workers_stop_ = true;
+		pending_clouds_.clear();
+	}
+	pending_clouds_cond_.notify_all();
+	cloud_workers_.join_all();
+}
+
+void MapCloudDisplay::cloudWorkerThread()
+{
+	while(true)
+	{
+		CloudJob job;
+		{
+			boost::mutex::scoped_lock lock(pending_clouds_mutex_);
+			while(!cloud_workers_stop_ && pending_clouds_.empty())
+			{
+				pending_clouds_cond_.wait(lock);
+			}
+			if(cloud_workers_stop_)
+			{
+				return;
+			}
+			job = pending_clouds_.front();
+			pending_clouds_.pop_front();
+		}
+
+		CloudInfoPtr info;
+		if(job.cloud.get())
+		{
+			info.reset(new CloudInfo);
+			info->message_ = job.cloud;
+			info->pose_ = rtabmap::Transform::getIdentity();
+			info->id_ = job.node.id;
+			info->params_hash_ = job.params_hash;
+			if(!transformCloud(info, true))
+			{
+				info.reset();
+			}
+		}
+		else
+		{
+			info = createCloud(job.node, job.header);
+		}
+		if(info.get())
+		{
+			boost::mutex::scoped_lock lock(new_clouds_mutex_);
+			if(job.generation == generation_)
+			{
+				new_cloud_infos_.erase(info->id_);
+				new_cloud_infos_.insert(std::make_pair(info->id_, info));
+			}
+		}
+	}
+}
+
 void MapCloudDisplay::processMessage( const rtabmap_msgs::MapDataConstPtr& msg )
 {
 	processMapData(*msg);
@@ -273,7 +379,7 @@ void MapCloudDisplay::processMessage( const rtabmap_msgs::MapDataConstPtr& msg )
 	this->emitTimeSignal(msg->header.stamp);
 }
 
-void MapCloudDisplay::processMapData(const rtabmap_msgs::MapData& map)
+void MapCloudDisplay::processMapData(const rtabmap_msgs::MapData& map, bool updateGraph)
 {
 	std::map<int, rtabmap::Transform> poses;
 	for(unsigned int i=0; i<map.graph.posesId.size() && i<map.graph.poses.size(); ++i)
@@ -281,15 +387,87 @@ void MapCloudDisplay::processMapData(const rtabmap_msgs::MapData& map)
 		poses.insert(std::make_pair(map.graph.posesId[i], rtabmap_conversions::transformFromPoseMsg(map.graph.poses[i])));
 	}
 
-	// Add new clouds...
-	bool fromDepth = !cloud_from_scan_->getBool();
+	// Odometry links don't change once the node is added, they identify
+	// the node (and its data) for the disk cache
+	std::map<int, size_t> nodeHashes;
+	for(unsigned int i=0; i<map.graph.links.size(); ++i)
+	{
+		const rtabmap_msgs::Link & link = map.graph.links[i];
+		if(link.type == 0) // rtabmap::Link::kNeighbor
+		{
+			size_t hash = 0;
+			boost::hash_combine(hash, link.fromId);
+			boost::hash_combine(hash, link.toId);
+			boost::hash_combine(hash, link.transform.translation.x);
+			boost::hash_combine(hash, link.transform.translation.y);
+			boost::hash_combine(hash, link.transform.translation.z);
+			boost::hash_combine(hash, link.transform.rotation.x);
+			boost::hash_combine(hash, link.transform.rotation.y);
+			boost::hash_combine(hash, link.transform.rotation.z);
+			boost::hash_combine(hash, link.transform.rotation.w);
+			// links can be in any order
+			nodeHashes[link.fromId] += hash;
+			nodeHashes[link.toId] += hash;
+		}
+	}
+
+	// Add new clouds... they are decoded by the worker threads
 	std::set<int> nodeDataReceived;
-	for(unsigned int i=0; i<map.nodes.size() && i<map.nodes.size(); ++i)
 	{
-		int id = map.nodes[i].id;
+		boost::mutex::scoped_lock lock(pending_clouds_mutex_);
+		unsigned int generation;
+		{
+			boost::mutex::scoped_lock lockGeneration(new_clouds_mutex_);
+			generation = generation_;
+		}
+		for(unsigned int i=0; i<map.nodes.size(); ++i)
+		{
+			CloudJob job;
+			job.node = map.nodes[i];
+			job.header = map.header;
+			job.generation = generation;
+			job.params_hash = 0;
+			pending_clouds_.push_back(job);
+			nodeDataReceived.insert(map.nodes[i].id);
+		}
+	}
+	pending_clouds_cond_.notify_all();
+
+	if(!updateGraph)
+	{
+		// only node data (e.g., next pages of get_map_data2), the graph is unchanged
+		boost::mutex::scoped_lock lock(current_map_mutex_);
+		nodeDataReceived_.insert(nodeDataReceived.begin(), nodeDataReceived.end());
+		return;
+	}
+
+	// Update graph
+	if(node_filtering_angle_->getFloat() > 0.0f && node_filtering_radius_->getFloat() > 0.0f)
+	{
+		poses = rtabmap::graph::radiusPosesFiltering(poses,
+				node_filtering_radius_->getFloat(),
+				node_filtering_angle_->getFloat()*CV_PI/180.0);
+	}
+
+	{
+		boost::mutex::scoped_lock lock(current_map_mutex_);
+		current_map_ = poses;
+		current_map_updated_ = true;
+		nodeDataReceived_.insert(nodeDataReceived.begin(), nodeDataReceived.end());
+		for(std::map<int, size_t>::iterator iter=nodeHashes.begin(); iter!=nodeHashes.end(); ++iter)
+		{
+			nodeHashes_[iter->first] = iter->second;
+		}
+	}
+}
 
+MapCloudDisplay::CloudInfoPtr MapCloudDisplay::createCloud(const rtabmap_msgs::NodeData & node, const std_msgs::Header & header)
+{
+	bool fromDepth = !cloud_from_scan_->getBool();
+	int id = node.id;
+	{
 		// Always refresh the cloud if there are data
-		rtabmap::Signature s = rtabmap_conversions::nodeDataFromROS(map.nodes[i]);
+		rtabmap::Signature s = rtabmap_conversions::nodeDataFromROS(node);
 		if((fromDepth &&
 			!s.sensorData().imageCompressed().empty() &&
 		    !s.sensorData().depthOrRightCompressed().empty() &&
@@ -367,37 +545,21 @@ void MapCloudDisplay::processMapData(const rtabmap_msgs::MapData& map)
 
 			if(!cloudMsg->data.empty())
 			{
-				cloudMsg->header = map.header;
+				cloudMsg->header = header;
 				CloudInfoPtr info(new CloudInfo);
 				info->message_ = cloudMsg;
 				info->pose_ = rtabmap::Transform::getIdentity();
 				info->id_ = id;
+				info->params_hash_ = cloudParametersHash();
 
 				if (transformCloud(info, true))
 				{
-					boost::mutex::scoped_lock lock(new_clouds_mutex_);
-					new_cloud_infos_.erase(id);
-					new_cloud_infos_.insert(std::make_pair(id, info));
+					return info;
 				}
 			}
 		}
-		nodeDataReceived.insert(id);
-	}
-
-	// Update graph
-	if(node_filtering_angle_->getFloat() > 0.0f && node_filtering_radius_->getFloat() > 0.0f)
-	{
-		poses = rtabmap::graph::radiusPosesFiltering(poses,
-				node_filtering_radius_->getFloat(),
-				node_filtering_angle_->getFloat()*CV_PI/180.0);
-	}
-
-	{
-		boost::mutex::scoped_lock lock(current_map_mutex_);
-		current_map_ = poses;
-		current_map_updated_ = true;
-		nodeDataReceived_.insert(nodeDataReceived.begin(), nodeDataReceived.end());
 	}
+	return CloudInfoPtr();
 }
 
 void MapCloudDisplay::setPropertiesHidden( const QList<Property*>& props, bool hide )
@@ -492,6 +654,10 @@ void MapCloudDisplay::updateAlpha()
 	for( std::map<int, CloudInfoPtr>::iterator it = cloud_infos_.begin(); it != cloud_infos_.end(); ++it )
 	{
 		it->second->cloud_->setAlpha( alpha_property_->getFloat() );
+		if(it->second->lod_cloud_)
+		{
+			it->second->lod_cloud_->setAlpha( alpha_property_->getFloat() );
+		}
 	}
 }
 
@@ -511,6 +677,10 @@ void MapCloudDisplay::updateStyle()
 	for( std::map<int, CloudInfoPtr>::iterator it = cloud_infos_.begin(); it != cloud_infos_.end(); ++it )
 	{
 		it->second->cloud_->setRenderMode( mode );
+		if(it->second->lod_cloud_)
+		{
+			it->second->lod_cloud_->setRenderMode( mode );
+		}
 	}
 	updateBillboardSize();
 }
@@ -530,6 +700,10 @@ void MapCloudDisplay::updateBillboardSize()
 	 for( std::map<int, CloudInfoPtr>::iterator it = cloud_infos_.begin(); it != cloud_infos_.end(); ++it )
 	{
 		it->second->cloud_->setDimensions( size, size, size );
+		if(it->second->lod_cloud_)
+		{
+			it->second->lod_cloud_->setDimensions( size, size, size );
+		}
 	}
 	context_->queueRender();
 }
@@ -546,6 +720,324 @@ void MapCloudDisplay::updateCloudParameters()
 	fromScan_ = cloud_from_scan_->getBool();
 }
 
+bool MapCloudDisplay::downloadMapByPages(const std::string & rtabmapNs, QMessageBox * messageBox)
+{
+	// Download the map by small pages of nodes to avoid a huge
+	// response (and memory spike) on rtabmap side for large maps.
+	std::string srvName = update_nh_.resolveName(uFormat("%s/get_map_data2", rtabmapNs.c_str()));
+	rtabmap_msgs::GetMap2 getMapSrv;
+	getMapSrv.request.global = false;
+	getMapSrv.request.optimized = true;
+	getMapSrv.request.with_images = true;
+	getMapSrv.request.with_scans = true;
+	getMapSrv.request.with_user_data = true;
+	getMapSrv.request.with_grids = true;
+	getMapSrv.request.with_words = true;
+	getMapSrv.request.with_global_descriptors = true;
+	getMapSrv.request.min_id = 0;
+	getMapSrv.request.max_nodes = 100;
+	getMapSrv.request.skip_graph = false;
+	int totalNodes = 0;
+	int totalPoses = 0;
+	bool first = true;
+	do
+	{
+		if(!ros::service::call(srvName, getMapSrv))
+		{
+			if(first)
+			{
+				// rtabmap may not support this service, fallback to get_map_data
+				return false;
+			}
+			ROS_ERROR("MapCloudDisplay: Cannot call \"%s\" service (at node %d)", srvName.c_str(), getMapSrv.request.min_id);
+			messageBox->setText(tr("MapCloudDisplay: Cannot call \"%1\" service (at node %2)").
+					arg(srvName.c_str()).arg(getMapSrv.request.min_id));
+			return true;
+		}
+		if(first)
+		{
+			this->reset();
+			totalPoses = getMapSrv.response.data.graph.poses.size();
+		}
+		totalNodes += getMapSrv.response.data.nodes.size();
+		messageBox->setText(tr("Creating all clouds (%1 poses and %2 clouds downloaded)...")
+				.arg(totalPoses).arg(totalNodes));
+		QApplication::processEvents();
+		// The graph is sent only with the first page
+		processMapData(getMapSrv.response.data, first);
+		first = false;
+		getMapSrv.request.min_id = getMapSrv.response.next_id;
+		getMapSrv.request.skip_graph = true;
+	}
+	while(getMapSrv.response.next_id > 0);
+
+	messageBox->setText(tr("Creating all clouds (%1 poses and %2 clouds downloaded)... done!")
+			.arg(totalPoses).arg(totalNodes));
+	QTimer::singleShot(1000, messageBox, SLOT(close()));
+	return true;
+}
+
+std::string MapCloudDisplay::diskCachePath() const
+{
+	std::string ns = download_namespace->getStdString();
+	for(size_t i=0; i<ns.size(); ++i)
+	{
+		if(ns[i] == '/')
+		{
+			ns[i] = '_';
+		}
+	}
+	return UDirectory::homeDir() + "/.ros/rtabmap_rviz_clouds_" + ns + ".bin";
+}
+
+size_t MapCloudDisplay::cloudParametersHash() const
+{
+	size_t hash = 0;
+	boost::hash_combine(hash, cloud_from_scan_->getBool());
+	boost::hash_combine(hash, cloud_decimation_->getInt());
+	boost::hash_combine(hash, cloud_max_depth_->getFloat());
+	boost::hash_combine(hash, cloud_min_depth_->getFloat());
+	boost::hash_combine(hash, cloud_voxel_size_->getFloat());
+	boost::hash_combine(hash, cloud_filter_floor_height_->getFloat());
+	boost::hash_combine(hash, cloud_filter_ceiling_height_->getFloat());
+	return hash;
+}
+
+// File layout: "RTCC", version, count, then for each cloud: id, node
+// hash, parameters hash, size and the serialized sensor_msgs/PointCloud2.
+static const char kDiskCacheMagic[4] = {'R','T','C','C'};
+static const uint32_t kDiskCacheVersion = 1;
+
+void MapCloudDisplay::saveDiskCache()
+{
+	if(!disk_cache_->getBool() || cloud_infos_.empty())
+	{
+		return;
+	}
+	std::map<int, size_t> nodeHashes;
+	{
+		boost::mutex::scoped_lock lock(current_map_mutex_);
+		nodeHashes = nodeHashes_;
+	}
+
+	UTimer timer;
+	std::string path = diskCachePath();
+	if(!UDirectory::exists(UDirectory::getDir(path)))
+	{
+		UDirectory::makeDir(UDirectory::getDir(path));
+	}
+	std::string tmpPath = path + ".tmp";
+	std::ofstream file(tmpPath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if(!file.is_open())
+	{
+		ROS_ERROR("MapCloudDisplay: Cannot write the disk cache \"%s\"", tmpPath.c_str());
+		return;
+	}
+	uint32_t count = 0;
+	file.write(kDiskCacheMagic, 4);
+	file.write((const char*)&kDiskCacheVersion, sizeof(uint32_t));
+	file.write((const char*)&count, sizeof(uint32_t));
+	std::vector<uint8_t> buffer;
+	for(std::map<int, CloudInfoPtr>::iterator iter=cloud_infos_.begin(); iter!=cloud_infos_.end(); ++iter)
+	{
+		uint64_t nodeHash = uValue(nodeHashes, iter->first, (size_t)0);
+		if(nodeHash == 0 || !iter->second->message_.get())
+		{
+			continue;
+		}
+		int32_t id = iter->first;
+		uint64_t paramsHash = iter->second->params_hash_;
+		uint32_t size = ros::serialization::serializationLength(*iter->second->message_);
+		buffer.resize(size);
+		ros::serialization::OStream stream(buffer.data(), size);
+		ros::serialization::serialize(stream, *iter->second->message_);
+		file.write((const char*)&id, sizeof(int32_t));
+		file.write((const char*)&nodeHash, sizeof(uint64_t));
+		file.write((const char*)&paramsHash, sizeof(uint64_t));
+		file.write((const char*)&size, sizeof(uint32_t));
+		file.write((const char*)buffer.data(), size);
+		++count;
+	}
+	file.seekp(8);
+	file.write((const char*)&count, sizeof(uint32_t));
+	file.close();
+	if(file.fail() || std::rename(tmpPath.c_str(), path.c_str()) != 0)
+	{
+		ROS_ERROR("MapCloudDisplay: Failed to write the disk cache \"%s\"", path.c_str());
+		std::remove(tmpPath.c_str());
+		return;
+	}
+	ROS_INFO("MapCloudDisplay: %d clouds saved in \"%s\" (%fs)", (int)count, path.c_str(), timer.ticks());
+}
+
+std::set<int> MapCloudDisplay::loadDiskCache(const std::map<int, size_t> & nodeHashes, const std_msgs::Header & header)
+{
+	std::set<int> loaded;
+	QFile file(QString::fromStdString(diskCachePath()));
+	if(!file.exists() || !file.open(QIODevice::ReadOnly) || file.size() < 12)
+	{
+		return loaded;
+	}
+	// Memory-mapped: only the clouds still valid are read
+	const qint64 fileSize = file.size();
+	const uchar * data = file.map(0, fileSize);
+	if(data == 0 || memcmp(data, kDiskCacheMagic, 4) != 0 || *(const uint32_t*)(data+4) != kDiskCacheVersion)
+	{
+		ROS_WARN("MapCloudDisplay: Ignoring invalid disk cache \"%s\"", diskCachePath().c_str());
+		return loaded;
+	}
+	UTimer timer;
+	uint32_t count = *(const uint32_t*)(data+8);
+	uint64_t paramsHash = cloudParametersHash();
+	unsigned int generation;
+	{
+		boost::mutex::scoped_lock lockGeneration(new_clouds_mutex_);
+		generation = generation_;
+	}
+	std::vector<CloudJob> jobs;
+	qint64 offset = 12;
+	for(uint32_t i=0; i<count && offset+24 <= fileSize; ++i)
+	{
+		int32_t id;
+		uint64_t nodeHash, entryParamsHash;
+		uint32_t size;
+		memcpy(&id, data+offset, sizeof(int32_t));
+		memcpy(&nodeHash, data+offset+4, sizeof(uint64_t));
+		memcpy(&entryParamsHash, data+offset+12, sizeof(uint64_t));
+		memcpy(&size, data+offset+20, sizeof(uint32_t));
+		offset += 24;
+		if(offset+size > fileSize)
+		{
+			break;
+		}
+		std::map<int, size_t>::const_iterator iter = nodeHashes.find(id);
+		if(iter != nodeHashes.end() && (uint64_t)iter->second == nodeHash && entryParamsHash == paramsHash)
+		{
+			CloudJob job;
+			job.node.id = id;
+			job.header = header;
+			job.generation = generation;
+			job.params_hash = paramsHash;
+			job.cloud.reset(new sensor_msgs::PointCloud2);
+			ros::serialization::IStream stream((uint8_t*)data+offset, size);
+			ros::serialization::deserialize(stream, *job.cloud);
+			job.cloud->header = header;
+			jobs.push_back(job);
+			loaded.insert(id);
+		}
+		offset += size;
+	}
+	file.unmap((uchar*)data);
+	file.close();
+
+	{
+		boost::mutex::scoped_lock lock(pending_clouds_mutex_);
+		pending_clouds_.insert(pending_clouds_.end(), jobs.begin(), jobs.end());
+	}
+	pending_clouds_cond_.notify_all();
+	ROS_INFO("MapCloudDisplay: %d/%d clouds loaded from the disk cache (%fs)", (int)loaded.size(), (int)count, timer.ticks());
+	return loaded;
+}
+
+bool MapCloudDisplay::downloadMapWithDiskCache(const std::string & rtabmapNs, QMessageBox * messageBox)
+{
+	// Keep the clouds already created before they are cleared
+	saveDiskCache();
+
+	rtabmap_msgs::GetMap getMapSrv;
+	getMapSrv.request.global = false;
+	getMapSrv.request.optimized = true;
+	getMapSrv.request.graphOnly = true;
+	std::string srvName = update_nh_.resolveName(uFormat("%s/get_map_data", rtabmapNs.c_str()));
+	if(!ros::service::call(srvName, getMapSrv))
+	{
+		return false;
+	}
+	this->reset();
+	processMapData(getMapSrv.response.data);
+	const std_msgs::Header & header = getMapSrv.response.data.header;
+
+	std::map<int, size_t> nodeHashes;
+	std::vector<int> ids;
+	{
+		boost::mutex::scoped_lock lock(current_map_mutex_);
+		nodeHashes = nodeHashes_;
+		for(std::map<int, rtabmap::Transform>::iterator iter=current_map_.lower_bound(1); iter!=current_map_.end(); ++iter)
+		{
+			ids.push_back(iter->first);
+		}
+	}
+	std::set<int> loaded = loadDiskCache(nodeHashes, header);
+	std::vector<int> missing;
+	for(size_t i=0; i<ids.size(); ++i)
+	{
+		if(loaded.find(ids[i]) == loaded.end())
+		{
+			missing.push_back(ids[i]);
+		}
+	}
+	{
+		boost::mutex::scoped_lock lock(current_map_mutex_);
+		nodeDataReceived_.insert(loaded.begin(), loaded.end());
+	}
+	messageBox->setText(tr("Creating all clouds (%1 loaded from cache, %2 to download)...")
+			.arg(loaded.size()).arg(missing.size()));
+	QApplication::processEvents();
+
+	// Only the data needed to create the clouds
+	std::string nodeDataSrvName = update_nh_.resolveName(uFormat("%s/get_node_data", rtabmapNs.c_str()));
+	rtabmap_msgs::GetNodeData nodeDataSrv;
+	nodeDataSrv.request.images = !cloud_from_scan_->getBool();
+	nodeDataSrv.request.scan = cloud_from_scan_->getBool();
+	nodeDataSrv.request.grid = false;
+	nodeDataSrv.request.user_data = false;
+	int downloaded = 0;
+	for(size_t i=0; i<missing.size(); i+=100)
+	{
+		nodeDataSrv.request.ids.assign(missing.begin()+i, missing.begin()+std::min(missing.size(), i+100));
+		nodeDataSrv.response.data.clear();
+		if(!ros::service::call(nodeDataSrvName, nodeDataSrv))
+		{
+			ROS_WARN("MapCloudDisplay: Cannot get data of nodes %d to %d with \"%s\" service",
+					nodeDataSrv.request.ids.front(), nodeDataSrv.request.ids.back(), nodeDataSrvName.c_str());
+			continue;
+		}
+		std::set<int> nodeDataReceived;
+		{
+			boost::mutex::scoped_lock lock(pending_clouds_mutex_);
+			unsigned int generation;
+			{
+				boost::mutex::scoped_lock lockGeneration(new_clouds_mutex_);
+				generation = generation_;
+			}
+			for(unsigned int j=0; j<nodeDataSrv.response.data.size(); ++j)
+			{
+				CloudJob job;
+				job.node = nodeDataSrv.response.data[j];
+				job.header = header;
+				job.generation = generation;
+				job.params_hash = 0;
+				pending_clouds_.push_back(job);
+				nodeDataReceived.insert(job.node.id);
+			}
+		}
+		pending_clouds_cond_.notify_all();
+		{
+			boost::mutex::scoped_lock lock(current_map_mutex_);
+			nodeDataReceived_.insert(nodeDataReceived.begin(), nodeDataReceived.end());
+		}
+		downloaded += nodeDataSrv.response.data.size();
+		messageBox->setText(tr("Creating all clouds (%1 loaded from cache, %2/%3 downloaded)...")
+				.arg(loaded.size()).arg(downloaded).arg(missing.size()));
+		QApplication::processEvents();
+	}
+
+	messageBox->setText(tr("Creating all clouds (%1 loaded from cache, %2 downloaded)... done!")
+			.arg(loaded.size()).arg(downloaded));
+	QTimer::singleShot(1000, messageBox, SLOT(close()));
+	return true;
+}
+
 void MapCloudDisplay::downloadMap(bool graphOnly)
 {
 	rtabmap_msgs::GetMap getMapSrv;
@@ -564,7 +1056,15 @@ void MapCloudDisplay::downloadMap(bool graphOnly)
 	QApplication::processEvents();
 	uSleep(100); // hack make sure the text in the QMessageBox is shown...
 	QApplication::processEvents();
-	if(!ros::service::call(srvName, getMapSrv))
+	if(!graphOnly && disk_cache_->getBool() && downloadMapWithDiskCache(rtabmapNs, messageBox))
+	{
+		// done
+	}
+	else if(!graphOnly && downloadMapByPages(rtabmapNs, messageBox))
+	{
+		// done
+	}
+	else if(!ros::service::call(srvName, getMapSrv))
 	{
 		ROS_ERROR("MapCloudDisplay: Cannot call \"%s\" service. "
 				  "Tip: if rtabmap node is not in \"%s\" namespace, you can "
@@ -690,6 +1190,17 @@ void MapCloudDisplay::update( float wall_dt, float ros_dt )
 				cloud_info->scene_node_ = scene_node_->createChildSceneNode();
 
 				cloud_info->scene_node_->attachObject( cloud_info->cloud_.get() );
+				if(!cloud_info->lod_points_.empty())
+				{
+					cloud_info->lod_cloud_.reset( new rviz::PointCloud() );
+					cloud_info->lod_cloud_->addPoints( &(cloud_info->lod_points_.front()), cloud_info->lod_points_.size() );
+					cloud_info->lod_cloud_->setRenderMode( mode );
+					cloud_info->lod_cloud_->setAlpha( alpha_property_->getFloat() );
+					cloud_info->lod_cloud_->setDimensions( size, size, size );
+					cloud_info->lod_cloud_->setAutoSize(false);
+					cloud_info->lod_cloud_->setVisible(false);
+					cloud_info->scene_node_->attachObject( cloud_info->lod_cloud_.get() );
+				}
 				cloud_info->scene_node_->setVisible(false);
 
 				cloud_infos_.erase(it->first);
@@ -732,22 +1243,46 @@ void MapCloudDisplay::update( float wall_dt, float ros_dt )
 		boost::mutex::scoped_lock lock(current_map_mutex_);
 		if(!current_map_.empty())
 		{
+			// Clouds are all in the map frame: look up its latest transform
+			// only once instead of once per node.
+			std::map<std::string, std::pair<bool, Ogre::Matrix4> > frameTransforms;
+			float lodDistance = lod_distance_->getFloat();
+			Ogre::Vector3 cameraPosition = Ogre::Vector3::ZERO;
+			if(lodDistance > 0.0f && context_->getViewManager()->getCurrent() && context_->getViewManager()->getCurrent()->getCamera())
+			{
+				cameraPosition = context_->getViewManager()->getCurrent()->getCamera()->getDerivedPosition();
+			}
+			else
+			{
+				lodDistance = 0.0f;
+			}
+
 			std::vector<int> missingNodes;
 			for (std::map<int, rtabmap::Transform>::iterator it=current_map_.begin(); it != current_map_.end(); ++it)
 			{
 				std::map<int, CloudInfoPtr>::iterator cloudInfoIt = cloud_infos_.find(it->first);
 				if(cloudInfoIt != cloud_infos_.end())
 				{
-					totalPoints += cloudInfoIt->second->transformed_points_.size();
 					cloudInfoIt->second->pose_ = it->second;
-					Ogre::Vector3 framePosition;
-					Ogre::Quaternion frameOrientation;
+					const std::string & frameId = cloudInfoIt->second->message_->header.frame_id;
+					std::map<std::string, std::pair<bool, Ogre::Matrix4> >::iterator frameIt = frameTransforms.find(frameId);
+					if(frameIt == frameTransforms.end())
+					{
+						Ogre::Vector3 framePosition;
+						Ogre::Quaternion frameOrientation;
+						Ogre::Matrix4 frameTransform = Ogre::Matrix4::IDENTITY;
+						bool valid = context_->getFrameManager()->getTransform(frameId, ros::Time(0), framePosition, frameOrientation);
+						if(valid)
+						{
+							frameTransform.makeTransform( framePosition, Ogre::Vector3(1,1,1), frameOrientation);
+						}
+						frameIt = frameTransforms.insert(std::make_pair(frameId, std::make_pair(valid, frameTransform))).first;
+					}
 					std::string error;
-					if (context_->getFrameManager()->getTransform(cloudInfoIt->second->message_->header, framePosition, frameOrientation))
+					if (frameIt->second.first)
 					{
 						// Multiply frame with pose
-						Ogre::Matrix4 frameTransform;
-						frameTransform.makeTransform( framePosition, Ogre::Vector3(1,1,1), frameOrientation);
+						Ogre::Matrix4 frameTransform = frameIt->second.second;
 						const rtabmap::Transform & p = cloudInfoIt->second->pose_;
 						Ogre::Matrix4 pose(p[0], p[1], p[2], p[3],
 										 p[4], p[5], p[6], p[7],
@@ -761,9 +1296,14 @@ void MapCloudDisplay::update( float wall_dt, float ros_dt )
 						cloudInfoIt->second->scene_node_->setPosition(posePosition);
 						cloudInfoIt->second->scene_node_->setOrientation(poseOrientation);
 						cloudInfoIt->second->scene_node_->setVisible(true);
+						bool showLod = lodDistance > 0.0f &&
+								cloudInfoIt->second->lod_cloud_ &&
+								posePosition.squaredDistance(cameraPosition) > lodDistance*lodDistance;
+						setLodShown(cloudInfoIt->second, showLod);
+						totalPoints += showLod?cloudInfoIt->second->lod_points_.size():cloudInfoIt->second->transformed_points_.size();
 						++totalNodesShown;
 					}
-					else if(context_->getFrameManager()->frameHasProblems(cloudInfoIt->second->message_->header.frame_id, cloudInfoIt->second->message_->header.stamp, error))
+					else if(context_->getFrameManager()->frameHasProblems(frameId, ros::Time(0), error))
 					{
 						ROS_ERROR("MapCloudDisplay: Could not update pose of node %d (cannot transform pose in target frame id \"%s\" (reason=%s), set fixed frame in global options to \"%s\")",
 								it->first,
@@ -816,21 +1356,33 @@ void MapCloudDisplay::update( float wall_dt, float ros_dt )
 
 	this->setStatusStd(rviz::StatusProperty::Ok, "Points", tr("%1").arg(totalPoints).toStdString());
 	this->setStatusStd(rviz::StatusProperty::Ok, "Nodes", tr("%1 shown of %2").arg(totalNodesShown).arg(cloud_infos_.size()).toStdString());
+	size_t pendingClouds = 0;
+	{
+		boost::mutex::scoped_lock lock(pending_clouds_mutex_);
+		pendingClouds = pending_clouds_.size();
+	}
+	this->setStatusStd(rviz::StatusProperty::Ok, "Clouds pending", tr("%1").arg(pendingClouds).toStdString());
 }
 
 void MapCloudDisplay::reset()
 {
 	lastCloudAdded_ = -1;
+	{
+		boost::mutex::scoped_lock lock(pending_clouds_mutex_);
+		pending_clouds_.clear();
+	}
 	{
 		boost::mutex::scoped_lock lock(new_clouds_mutex_);
 		cloud_infos_.clear();
 		new_cloud_infos_.clear();
+		++generation_;
 	}
 	{
 		boost::mutex::scoped_lock lock(current_map_mutex_);
 		current_map_.clear();
 		current_map_updated_ = false;
 		nodeDataReceived_.clear();
+		nodeHashes_.clear();
 	}
 	MFDClass::reset();
 }
@@ -935,6 +1487,51 @@ void MapCloudDisplay::retransform()
 		transformCloud(cloud_info, false);
 		cloud_info->cloud_->clear();
 		cloud_info->cloud_->addPoints(&cloud_info->transformed_points_.front(), cloud_info->transformed_points_.size());
+		if(cloud_info->lod_cloud_)
+		{
+			cloud_info->lod_cloud_->clear();
+			if(!cloud_info->lod_points_.empty())
+			{
+				cloud_info->lod_cloud_->addPoints(&cloud_info->lod_points_.front(), cloud_info->lod_points_.size());
+			}
+		}
+	}
+}
+
+void MapCloudDisplay::createLodPoints(const CloudInfoPtr& cloud_info) const
+{
+	// keep the first point of each voxel
+	cloud_info->lod_points_.clear();
+	float voxelSize = lod_voxel_size_->getFloat();
+	if(voxelSize <= 0.0f)
+	{
+		return;
+	}
+	boost::unordered_set<long long> voxels;
+	for(size_t i=0; i<cloud_info->transformed_points_.size(); ++i)
+	{
+		const rviz::PointCloud::Point & pt = cloud_info->transformed_points_[i];
+		if(pt.position.x == 999999.0f)
+		{
+			continue; // invalid
+		}
+		long long x = (long long)std::floor(pt.position.x/voxelSize) & 0x1FFFFF;
+		long long y = (long long)std::floor(pt.position.y/voxelSize) & 0x1FFFFF;
+		long long z = (long long)std::floor(pt.position.z/voxelSize) & 0x1FFFFF;
+		if(voxels.insert((x << 42) | (y << 21) | z).second)
+		{
+			cloud_info->lod_points_.push_back(pt);
+		}
+	}
+}
+
+void MapCloudDisplay::setLodShown(const CloudInfoPtr& cloud_info, bool shown) const
+{
+	if(cloud_info->lod_shown_ != shown && cloud_info->lod_cloud_)
+	{
+		cloud_info->cloud_->setVisible(!shown);
+		cloud_info->lod_cloud_->setVisible(shown);
+		cloud_info->lod_shown_ = shown;
 	}
 }
 
@@ -988,6 +1585,11 @@ bool MapCloudDisplay::transformCloud(const CloudInfoPtr& cloud_info, bool update
 		}
 	}
 
+	if(lod_distance_->getFloat() > 0.0f)
+	{
+		createLodPoints(cloud_info);
+	}
+
 	return true;
 }
 
@@ -93,6 +93,7 @@ void MapGraphDisplay::destroyObjects()
 		scene_manager_->destroyManualObject( manual_objects_[i] );
 	}
 	manual_objects_.clear();
+	vertices_.clear();
 }
 
 void MapGraphDisplay::processMessage( const rtabmap_msgs::MapGraph::ConstPtr& msg )
@@ -103,14 +104,6 @@ void MapGraphDisplay::processMessage( const rtabmap_msgs::MapGraph::ConstPtr& ms
 		return;
 	}
 
-	// Get links
-	std::map<int, rtabmap::Transform> poses;
-	std::multimap<int, rtabmap::Link> links;
-	rtabmap::Transform mapToOdom;
-	rtabmap_conversions::mapGraphFromROS(*msg, poses, links, mapToOdom);
-
-	destroyObjects();
-
 	Ogre::Vector3 position;
 	Ogre::Quaternion orientation;
 	if( !context_->getFrameManager()->getTransform( msg->header, position, orientation ))
@@ -118,66 +111,121 @@ void MapGraphDisplay::processMessage( const rtabmap_msgs::MapGraph::ConstPtr& ms
 		ROS_DEBUG( "Error transforming from frame '%s' to frame '%s'", msg->header.frame_id.c_str(), qPrintable( fixed_frame_ ));
 	}
 
-	Ogre::Matrix4 transform( orientation );
-	transform.setTrans( position );
+	// The frame transform is applied by the scene node, links are in map frame
+	scene_node_->setPosition( position );
+	scene_node_->setOrientation( orientation );
 
-	if(links.size())
+	// Flat id-indexed pose lookup (landmarks have negative ids)
+	std::vector<int> positiveIndices;
+	std::vector<int> negativeIndices;
+	for(unsigned int i=0; i<msg->posesId.size(); ++i)
 	{
-		Ogre::ColourValue color;
-		Ogre::ManualObject* manual_object = scene_manager_->createManualObject();
-		manual_object->setDynamic( true );
-		scene_node_->attachObject( manual_object );
-		manual_objects_.push_back(manual_object);
+		int id = msg->posesId[i];
+		std::vector<int> & indices = id>=0?positiveIndices:negativeIndices;
+		unsigned int index = id>=0?id:-id;
+		if(index >= indices.size())
+		{
+			indices.resize(index+1, -1);
+		}
+		indices[index] = i;
+	}
 
-		manual_object->estimateVertexCount(links.size() * 2);
-		manual_object->begin( "BaseWhiteNoLighting", Ogre::RenderOperation::OT_LINE_LIST );
-		for(std::multimap<int, rtabmap::Link>::iterator iter=links.begin(); iter!=links.end(); ++iter)
+	float alpha = alpha_property_->getFloat();
+	std::vector<float> vertices;
+	vertices.reserve(msg->links.size() * 10);
+	for(unsigned int i=0; i<msg->links.size(); ++i)
+	{
+		const rtabmap_msgs::Link & link = msg->links[i];
+		int from = link.fromId>=0?(link.fromId<(int)positiveIndices.size()?positiveIndices[link.fromId]:-1):(-link.fromId<(int)negativeIndices.size()?negativeIndices[-link.fromId]:-1);
+		int to = link.toId>=0?(link.toId<(int)positiveIndices.size()?positiveIndices[link.toId]:-1):(-link.toId<(int)negativeIndices.size()?negativeIndices[-link.toId]:-1);
+		if(from >= 0 && to >= 0)
 		{
-			std::map<int, rtabmap::Transform>::iterator poseIterFrom = poses.find(iter->second.from());
-			std::map<int, rtabmap::Transform>::iterator poseIterTo = poses.find(iter->second.to());
-			if(poseIterFrom != poses.end() && poseIterTo != poses.end())
+			Ogre::ColourValue color;
+			if(link.type == rtabmap::Link::kNeighbor)
+			{
+				color = color_neighbor_property_->getOgreColor();
+			}
+			else if(link.type == rtabmap::Link::kNeighborMerged)
+			{
+				color = color_neighbor_merged_property_->getOgreColor();
+			}
+			else if(link.type == rtabmap::Link::kVirtualClosure)
+			{
+				color = color_virtual_property_->getOgreColor();
+			}
+			else if(link.type == rtabmap::Link::kUserClosure)
+			{
+				color = color_user_property_->getOgreColor();
+			}
+			else if(link.type == rtabmap::Link::kLocalSpaceClosure || link.type == rtabmap::Link::kLocalTimeClosure)
+			{
+				color = color_local_property_->getOgreColor();
+			}
+			else if(link.type == rtabmap::Link::kLandmark)
 			{
-				if(iter->second.type() == rtabmap::Link::kNeighbor)
-				{
-					color = color_neighbor_property_->getOgreColor();
-				}
-				else if(iter->second.type() == rtabmap::Link::kNeighborMerged)
-				{
-					color = color_neighbor_merged_property_->getOgreColor();
-				}
-				else if(iter->second.type() == rtabmap::Link::kVirtualClosure)
-				{
-					color = color_virtual_property_->getOgreColor();
-				}
-				else if(iter->second.type() == rtabmap::Link::kUserClosure)
-				{
-					color = color_user_property_->getOgreColor();
-				}
-				else if(iter->second.type() == rtabmap::Link::kLocalSpaceClosure || iter->second.type() == rtabmap::Link::kLocalTimeClosure)
-				{
-					color = color_local_property_->getOgreColor();
-				}
-				else if(iter->second.type() == rtabmap::Link::kLandmark)
-				{
-					color = color_landmark_property_->getOgreColor();
-				}
-				else
-				{
-					color = color_global_property_->getOgreColor();
-				}
-				color.a = alpha_property_->getFloat();
-				Ogre::Vector3 pos;
-				pos = transform * Ogre::Vector3( poseIterFrom->second.x(), poseIterFrom->second.y(), poseIterFrom->second.z() );
-				manual_object->position( pos.x, pos.y, pos.z );
-				manual_object->colour( color );
-				pos = transform * Ogre::Vector3( poseIterTo->second.x(), poseIterTo->second.y(), poseIterTo->second.z() );
-				manual_object->position( pos.x, pos.y, pos.z );
-				manual_object->colour( color );
+				color = color_landmark_property_->getOgreColor();
 			}
+			else
+			{
+				color = color_global_property_->getOgreColor();
+			}
+			color.a = alpha;
+			const geometry_msgs::Point & pFrom = msg->poses[from].position;
+			const geometry_msgs::Point & pTo = msg->poses[to].position;
+			vertices.push_back(pFrom.x);
+			vertices.push_back(pFrom.y);
+			vertices.push_back(pFrom.z);
+			vertices.push_back(pTo.x);
+			vertices.push_back(pTo.y);
+			vertices.push_back(pTo.z);
+			vertices.push_back(color.r);
+			vertices.push_back(color.g);
+			vertices.push_back(color.b);
+			vertices.push_back(color.a);
 		}
+	}
 
-		manual_object->end();
+	if(!manual_objects_.empty() && vertices == vertices_)
+	{
+		// Graph didn't change, keep current vertex buffer
+		return;
 	}
+
+	if(vertices.empty())
+	{
+		destroyObjects();
+		return;
+	}
+
+	// Reuse the same manual object (and its hardware buffer when it is
+	// large enough) instead of recreating it on every message.
+	Ogre::ManualObject* manual_object = 0;
+	if(manual_objects_.empty())
+	{
+		manual_object = scene_manager_->createManualObject();
+		manual_object->setDynamic( true );
+		scene_node_->attachObject( manual_object );
+		manual_objects_.push_back(manual_object);
+		manual_object->estimateVertexCount(vertices.size() / 5);
+		manual_object->begin( "BaseWhiteNoLighting", Ogre::RenderOperation::OT_LINE_LIST );
+	}
+	else
+	{
+		manual_object = manual_objects_[0];
+		manual_object->estimateVertexCount(vertices.size() / 5);
+		manual_object->beginUpdate(0);
+	}
+	for(unsigned int i=0; i<vertices.size(); i+=10)
+	{
+		Ogre::ColourValue color(vertices[i+6], vertices[i+7], vertices[i+8], vertices[i+9]);
+		manual_object->position( vertices[i], vertices[i+1], vertices[i+2] );
+		manual_object->colour( color );
+		manual_object->position( vertices[i+3], vertices[i+4], vertices[i+5] );
+		manual_object->colour( color );
+	}
+	manual_object->end();
+
+	vertices_.swap(vertices);
 }
 
 } // namespace rtabmap_rviz_plugins
@@ -30,8 +30,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 
 #include <ros/ros.h>
+#include <ros/callback_queue.h>
 #include <nodelet/nodelet.h>
 
+#include <boost/thread/condition_variable.hpp>
+#include <deque>
+
 #include <std_srvs/Empty.h>
 
 #include <tf/transform_listener.h>
@@ -39,6 +43,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <std_msgs/Empty.h>
 #include <std_msgs/Int32.h>
+#include <std_msgs/String.h>
 #include "std_msgs/Int32MultiArray.h"
 #include <sensor_msgs/NavSatFix.h>
 #include <nav_msgs/GetMap.h>
@@ -49,6 +54,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/core/Parameters.h>
 #include <rtabmap/core/Rtabmap.h>
 #include <rtabmap/core/OdometryInfo.h>
+#include <rtabmap/core/ProgressState.h>
 
 #include "rtabmap_msgs/GetNodeData.h"
 #include "rtabmap_msgs/GetMap.h"
@@ -60,10 +66,16 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap_msgs/RemoveLabel.h"
 #include "rtabmap_msgs/Goal.h"
 #include "rtabmap_msgs/GetPlan.h"
+#include "rtabmap_msgs/GetPlans.h"
 #include "rtabmap_sync/CommonDataSubscriber.h"
+#include "rtabmap_sync/ShmRingBuffer.h"
+#include "rtabmap_conversions/ThreadPool.h"
 #include "rtabmap_msgs/OdomInfo.h"
+#include "rtabmap_msgs/EnvSensor.h"
 #include "rtabmap_msgs/AddLink.h"
+#include "rtabmap_msgs/AddLinks.h"
 #include "rtabmap_msgs/GetNodesInRadius.h"
+#include "rtabmap_msgs/GetNodesByDescriptor.h"
 #include "rtabmap_msgs/LoadDatabase.h"
 #include "rtabmap_msgs/DetectMoreLoopClosures.h"
 #include "rtabmap_msgs/GlobalBundleAdjustment.h"
@@ -71,6 +83,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "rtabmap_util/MapsManager.h"
 #include "rtabmap_util/ULogToRosout.h"
+#include "rtabmap_util/LatencyHistogram.h"
+#include "rtabmap_util/TimedRingBuffer.h"
+#include "rtabmap_util/PoseGridIndex.h"
+#include "rtabmap_util/GlobalDescriptorIndex.h"
+#include "rtabmap_util/NodeDataCache.h"
 
 #ifdef WITH_OCTOMAP_MSGS
 #include <octomap_msgs/GetOctomap.h>
@@ -111,6 +128,8 @@ private:
 
 	bool odomUpdate(const nav_msgs::OdometryConstPtr & odomMsg, ros::Time stamp);
 	bool odomTFUpdate(const ros::Time & stamp); // TF odom
+	bool isFrameThrottled(const ros::Time & stamp, const rtabmap::Transform & pose);
+	void updateAdaptiveRate(double processingTime);
 
 	virtual void commonMultiCameraCallback(
 				const nav_msgs::OdometryConstPtr & odomMsg,
@@ -154,7 +173,14 @@ private:
 
 	void defaultCallback(const sensor_msgs::ImageConstPtr & imageMsg); // no odom
 
+	// in-process odometry data (see subscribe_odom_sensor_data)
+	class OdomSensorDataCallback;
+	void odomSensorDataCallback(const rtabmap::SensorData & data, const nav_msgs::Odometry & odomMsg, const rtabmap::OdometryInfo & odomInfo);
+	void processOdomSensorData();
+
 	void userDataAsyncCallback(const rtabmap_msgs::UserDataConstPtr & dataMsg);
+	void envSensorAsyncCallback(const rtabmap_msgs::EnvSensorConstPtr & msg);
+	rtabmap::EnvSensors takeEnvSensors(double stamp);
 	void globalPoseAsyncCallback(const geometry_msgs::PoseWithCovarianceStampedConstPtr & globalPoseMsg);
 	void gpsFixAsyncCallback(const sensor_msgs::NavSatFixConstPtr & gpsFixMsg);
 #ifdef WITH_APRILTAG_ROS
@@ -169,6 +195,7 @@ private:
 	void interOdomInfoCallback(const nav_msgs::OdometryConstPtr & msg1, const rtabmap_msgs::OdomInfoConstPtr & msg2);
 
 	void initialPoseCallback(const geometry_msgs::PoseWithCovarianceStampedConstPtr & msg);
+	rtabmap::Transform relocalize(const rtabmap::SensorData & data, const rtabmap::Transform & prior);
 
 	void goalCommonCallback(int id,
 			const std::string & label,
@@ -180,6 +207,12 @@ private:
 	void goalNodeCallback(const rtabmap_msgs::GoalConstPtr & msg);
 	void updateGoal(const ros::Time & stamp);
 
+	void processIntermediateNode(
+			const ros::Time & stamp,
+			const rtabmap::Transform & interOdom,
+			const nav_msgs::Odometry & odomMsg,
+			const rtabmap_msgs::OdomInfo & odomInfoMsg);
+	void updateMemoryStats();
 	void process(
 			const ros::Time & stamp,
 			rtabmap::SensorData & data,
@@ -203,6 +236,15 @@ private:
 	bool detectMoreLoopClosuresCallback(rtabmap_msgs::DetectMoreLoopClosures::Request&, rtabmap_msgs::DetectMoreLoopClosures::Response&);
 	bool globalBundleAdjustmentCallback(rtabmap_msgs::GlobalBundleAdjustment::Request&, rtabmap_msgs::GlobalBundleAdjustment::Response&);
 	bool cleanupLocalGridsCallback(rtabmap_msgs::CleanupLocalGrids::Request&, rtabmap_msgs::CleanupLocalGrids::Response&);
+	bool cancelPostProcessingCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&);
+	bool detectMoreLoopClosures(const rtabmap_msgs::DetectMoreLoopClosures::Request&, rtabmap_msgs::DetectMoreLoopClosures::Response&);
+	bool globalBundleAdjustment(const rtabmap_msgs::GlobalBundleAdjustment::Request&, rtabmap_msgs::GlobalBundleAdjustment::Response&);
+	bool cleanupLocalGrids(const rtabmap_msgs::CleanupLocalGrids::Request&, rtabmap_msgs::CleanupLocalGrids::Response&);
+	void detectMoreLoopClosuresJob(rtabmap_msgs::DetectMoreLoopClosures::Request req);
+	void cleanupLocalGridsJob(rtabmap_msgs::CleanupLocalGrids::Request req);
+	bool startPostProcessing(const std::string & name, const boost::function<void()> & job);
+	void postProcessingThread(std::string name, boost::function<void()> job);
+	void backupDatabaseThread(std::string sourcePath, std::string targetPath);
 	bool setModeLocalizationCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&);
 	bool setModeMappingCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&);
 	bool setLogDebug(std_srvs::Empty::Request&, std_srvs::Empty::Response&);
@@ -214,18 +256,26 @@ private:
 	bool getMapData2Callback(rtabmap_msgs::GetMap2::Request& req, rtabmap_msgs::GetMap2::Response& res);
 	bool getMapCallback(nav_msgs::GetMap::Request  &req, nav_msgs::GetMap::Response &res);
 	bool getProbMapCallback(nav_msgs::GetMap::Request  &req, nav_msgs::GetMap::Response &res);
+	bool getCachedGridMap(bool prob, nav_msgs::OccupancyGrid & map);
 	bool getProjMapCallback(nav_msgs::GetMap::Request  &req, nav_msgs::GetMap::Response &res);
 	bool getGridMapCallback(nav_msgs::GetMap::Request  &req, nav_msgs::GetMap::Response &res);
+	bool getGridMapLevelCallback(nav_msgs::GetMap::Request  &req, nav_msgs::GetMap::Response &res, float resolution);
 	bool publishMapCallback(rtabmap_msgs::PublishMap::Request&, rtabmap_msgs::PublishMap::Response&);
 	bool getPlanCallback(nav_msgs::GetPlan::Request  &req, nav_msgs::GetPlan::Response &res);
 	bool getPlanNodesCallback(rtabmap_msgs::GetPlan::Request  &req, rtabmap_msgs::GetPlan::Response &res);
+	bool getPlansCallback(rtabmap_msgs::GetPlans::Request  &req, rtabmap_msgs::GetPlans::Response &res);
 	bool setGoalCallback(rtabmap_msgs::SetGoal::Request& req, rtabmap_msgs::SetGoal::Response& res);
 	bool cancelGoalCallback(std_srvs::Empty::Request& req, std_srvs::Empty::Response& res);
 	bool setLabelCallback(rtabmap_msgs::SetLabel::Request& req, rtabmap_msgs::SetLabel::Response& res);
 	bool listLabelsCallback(rtabmap_msgs::ListLabels::Request& req, rtabmap_msgs::ListLabels::Response& res);
 	bool removeLabelCallback(rtabmap_msgs::RemoveLabel::Request& req, rtabmap_msgs::RemoveLabel::Response& res);
 	bool addLinkCallback(rtabmap_msgs::AddLink::Request&, rtabmap_msgs::AddLink::Response&);
+	bool addLinksCallback(rtabmap_msgs::AddLinks::Request&, rtabmap_msgs::AddLinks::Response&);
 	bool getNodesInRadiusCallback(rtabmap_msgs::GetNodesInRadius::Request&, rtabmap_msgs::GetNodesInRadius::Response&);
+	bool getNodesByDescriptorCallback(rtabmap_msgs::GetNodesByDescriptor::Request&, rtabmap_msgs::GetNodesByDescriptor::Response&);
+	void updateGlobalDescriptorIndex();
+	void updateGraphRevision();
+	bool resyncMapDataDeltaCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&);
 #ifdef WITH_OCTOMAP_MSGS
 	bool octomapBinaryCallback(octomap_msgs::GetOctomap::Request  &req, octomap_msgs::GetOctomap::Response &res);
 	bool octomapFullCallback(octomap_msgs::GetOctomap::Request  &req, octomap_msgs::GetOctomap::Response &res);
@@ -235,6 +285,10 @@ private:
 	void saveParameters(const std::string & configFile);
 
 	void publishLoop(double tfDelay, double tfTolerance);
+	void setMapToOdomTF(const rtabmap::Transform & mapToOdom, const std::string & odomFrameId);
+	void mapsUpdateLoop();
+	void prefetchPathNodes();
+	void pathPrefetchLoop();
 
 	void publishStats(const ros::Time & stamp);
 	void publishCurrentGoal(const ros::Time & stamp);
@@ -244,6 +298,16 @@ private:
 	void publishLocalPath(const ros::Time & stamp);
 	void publishGlobalPath(const ros::Time & stamp);
 	void republishMaps();
+	void saveGridMap();
+	bool isSavedGridMapValid() const;
+	void nodesDataToROS(const std::map<int, rtabmap::Signature> & signatures, std::vector<rtabmap_msgs::NodeData> & msgs);
+	void publishMapDataDelta(
+			const ros::Time & stamp,
+			const std::map<int, rtabmap::Transform> & poses,
+			const std::multimap<int, rtabmap::Link> & constraints,
+			const std::map<int, rtabmap::Signature> & signatures,
+			const rtabmap::Transform & mapToOdom,
+			bool full);
 
 private:
 	rtabmap::Rtabmap rtabmap_;
@@ -275,7 +339,17 @@ private:
 	bool waitForTransform_;
 	double waitForTransformDuration_;
 	bool useActionForGoal_;
+	double pathUpdateTolerance_;
+	double pathUpdateAngleTolerance_;
+	std::vector<std::pair<int, rtabmap::Transform> > lastPublishedLocalPath_;
+	std::vector<std::pair<int, rtabmap::Transform> > lastPublishedGlobalPath_;
+	int lastLocalPathSubscribers_;
+	int lastGlobalPathSubscribers_;
 	bool useSavedMap_;
+	bool mapsCacheSnapshot_;
+	bool compactInfo_;
+	bool infoWithHypotheses_;
+	std::map<std::string, int> infoStatsIds_;
 	bool genScan_;
 	double genScanMaxDepth_;
 	double genScanMinDepth_;
@@ -290,11 +364,91 @@ private:
 	rtabmap::Transform mapToOdom_;
 	boost::mutex mapToOdomMutex_;
 
+	// map->odom transform published by the TF thread. The
+	// snapshot is swapped atomically so that the TF thread
+	// never waits on mapToOdomMutex_.
+	struct MapToOdomTF
+	{
+		rtabmap::Transform transform;
+		std::string odomFrameId;
+	};
+	boost::shared_ptr<const MapToOdomTF> mapToOdomTF_;
+	boost::mutex tfStatsMutex_;
+	int tfStatsCount_;
+	double tfStatsTotalTime_;
+	double tfStatsMaxInterval_;
+
 	rtabmap_util::MapsManager mapsManager_;
 
+	// asynchronous maps update
+	boost::thread * mapsThread_;
+	bool mapsThreadRunning_;
+	boost::mutex mapsMutex_; // mapsManager_
+	boost::mutex memoryMutex_; // rtabmap_'s memory
+	boost::mutex mapsRequestMutex_;
+	boost::condition_variable mapsRequestCondition_;
+	bool mapsRequestPending_;
+	std::map<int, rtabmap::Transform> mapsRequestPoses_;
+	std::map<int, rtabmap::Signature> mapsRequestSignatures_;
+	ros::Time mapsRequestStamp_;
+	unsigned long mapsRequestGraphRevision_;
+	int mapsRequestsDropped_;
+	double mapsLastUpdateTime_;
+	double mapsLastPublishTime_;
+
+	// asynchronous prefetch of upcoming path nodes from the database
+	boost::thread * pathPrefetchThread_;
+	bool pathPrefetchThreadRunning_;
+	int pathPrefetchNodes_;
+	boost::mutex pathPrefetchMutex_;
+	boost::condition_variable pathPrefetchCondition_;
+	std::list<int> pathPrefetchRequest_;
+	std::set<int> pathPrefetched_;
+	std::pair<int, size_t> pathPrefetchPath_; // first node id and size of the prefetched path
+	int pathPrefetchLoaded_;
+
+	// latency percentiles of the processing stages
+	rtabmap_util::LatencyHistogram latencyMsgConversion_;
+	rtabmap_util::LatencyHistogram latencyRtabmap_;
+	rtabmap_util::LatencyHistogram latencyUpdateMaps_;
+	rtabmap_util::LatencyHistogram latencyPublishMaps_;
+	rtabmap_util::LatencyHistogram latencyTotal_;
+	int framesThrottled_;
+	int framesDropped_;
+
+	// delta map data
+	double mapDataDeltaLinearTolerance_;
+	double mapDataDeltaAngularTolerance_;
+	boost::mutex mapDataDeltaMutex_;
+	unsigned int mapDataDeltaSeq_;
+	bool mapDataDeltaResync_;
+	std::map<int, rtabmap::Transform> mapDataDeltaPoses_; // last poses sent
+	std::multimap<int, rtabmap::Link> mapDataDeltaLinks_; // last links sent
+
+	// Last grid maps sent on get_map/get_prob_map services
+	nav_msgs::OccupancyGrid gridMapCache_;
+	nav_msgs::OccupancyGrid gridProbMapCache_;
+	unsigned long gridMapCacheRevision_;
+	unsigned long gridProbMapCacheRevision_;
+	// Graph for which the map caches were last updated by these services
+	unsigned long mapCachesGraphRevision_;
+	size_t mapCachesGraphSize_;
+	int mapCachesGraphLastId_;
+	unsigned long mapCachesGridRevision_;
+
+	// Converted nodes shared by get_node_data and map data publishing
+	rtabmap_util::NodeDataCache nodeDataCache_;
+
+	// Memory accounting per subsystem (see memory_stats and memory_budget_maps)
+	bool memoryStats_;
+	int memoryBudgetMaps_; // MB
+	int mapsCacheEvictions_;
+
 	ros::Publisher infoPub_;
+	ros::Publisher infoStatsNamesPub_;
 	ros::Publisher mapDataPub_;
 	ros::Publisher mapGraphPub_;
+	ros::Publisher mapDataDeltaPub_;
 	ros::Publisher odomCachePub_;
 	ros::Publisher landmarksPub_;
 	ros::Publisher labelsPub_;
@@ -342,16 +496,21 @@ private:
 	ros::ServiceServer getMapSrv_;
 	ros::ServiceServer getProbMapSrv_;
 	ros::ServiceServer getGridMapSrv_;
+	std::vector<ros::ServiceServer> getGridMapLevelSrvs_;
 	ros::ServiceServer publishMapDataSrv_;
 	ros::ServiceServer getPlanSrv_;
 	ros::ServiceServer getPlanNodesSrv_;
+	ros::ServiceServer getPlansSrv_;
 	ros::ServiceServer setGoalSrv_;
 	ros::ServiceServer cancelGoalSrv_;
 	ros::ServiceServer setLabelSrv_;
 	ros::ServiceServer listLabelsSrv_;
 	ros::ServiceServer removeLabelSrv_;
 	ros::ServiceServer addLinkSrv_;
+	ros::ServiceServer addLinksSrv_;
 	ros::ServiceServer getNodesInRadiusSrv_;
+	ros::ServiceServer getNodesByDescriptorSrv_;
+	ros::ServiceServer resyncMapDataDeltaSrv_;
 #ifdef WITH_OCTOMAP_MSGS
 	ros::ServiceServer octomapBinarySrv_;
 	ros::ServiceServer octomapFullSrv_;
@@ -377,12 +536,40 @@ private:
 	ros::Subscriber fiducialTransfromsSub_;
 	std::map<int, std::pair<geometry_msgs::PoseWithCovarianceStamped, float> > tags_; // id, <pose, size>
 	ros::Subscriber imuSub_;
-	std::map<double, rtabmap::Transform> imus_;
+	rtabmap_util::TimedRingBuffer<rtabmap::Transform> imus_;
+	rtabmap_util::PoseGridIndex nodesIndex_;
+	unsigned long graphRevision_; // incremented when poses of existing nodes may have changed
+	rtabmap::Transform graphRevisionMapCorrection_;
+	bool globalDescriptorIndexEnabled_;
+	bool globalDescriptorIndexSynced_;
+	rtabmap_util::GlobalDescriptorIndex globalDescriptorIndex_;
+	int relocalizationCandidates_;
+	double relocalizationRadius_;
+	bool relocalizationPending_;
+	rtabmap::Transform relocalizationPrior_;
 	std::string imuFrameId_;
 	ros::Subscriber republishNodeDataSub_;
+	// Protect global pose, GPS, tags and IMU buffers when async inputs are
+	// received on their own callback queues (see async_inputs_queue).
+	boost::mutex asyncInputsMutex_;
+	ros::CallbackQueue asyncInputsQueue_;
+	ros::CallbackQueue imuQueue_;
+	ros::AsyncSpinner * asyncInputsSpinner_;
+	ros::AsyncSpinner * imuSpinner_;
+
+	// Latest odometry data received from the in-process channel, processed
+	// in the nodelet's callback queue (latest wins if rtabmap is busy).
+	std::string odomSensorDataChannel_;
+	boost::mutex odomSensorDataMutex_;
+	bool odomSensorDataPending_;
+	rtabmap::SensorData odomSensorData_;
+	nav_msgs::Odometry odomSensorDataOdom_;
+	rtabmap::OdometryInfo odomSensorDataInfo_;
 
 	ros::Subscriber interOdomSub_;
-	std::list<std::pair<nav_msgs::Odometry, rtabmap_msgs::OdomInfo> > interOdoms_;
+	std::deque<std::pair<nav_msgs::Odometry, rtabmap_msgs::OdomInfo> > interOdoms_; // ordered by stamp
+	double interOdomRate_;
+	ros::Time interOdomLastStamp_;
 	message_filters::Subscriber<nav_msgs::Odometry> interOdomSyncSub_;
 	message_filters::Subscriber<rtabmap_msgs::OdomInfo> interOdomInfoSyncSub_;
 	typedef message_filters::sync_policies::ExactTime<nav_msgs::Odometry, rtabmap_msgs::OdomInfo> MyExactInterOdomSyncPolicy;
@@ -390,13 +577,60 @@ private:
 
 	bool stereoToDepth_;
 	bool odomSensorSync_;
+	bool mapDataPacked_;
+	bool mapDataScanFloat16_;
+	double scanQuantization_;
+	rtabmap_sync::ShmRingBuffer shmInfoMapData_;
+	rtabmap_conversions::ThreadSettings threadSettings_; // background threads
+	boost::shared_ptr<rtabmap_conversions::ThreadPool> threadPool_; // parallel jobs
+
+	// asynchronous environmental sensors, kept by type and stamp, then
+	// reduced to one value per type when the next node is created
+	ros::Subscriber envSensorAsyncSub_;
+	std::map<int, std::map<double, float> > envSensors_;
+	boost::mutex envSensorsMutex_;
+	double envSensorsBuffer_; // s
+	std::string envSensorsReduction_;
+
+	// asynchronous post-processing services
+	class PostProcessingState : public rtabmap::ProgressState
+	{
+	public:
+		PostProcessingState() : pub_(0) {}
+		void setPublisher(ros::Publisher * pub) {pub_ = pub;}
+		virtual bool callback(const std::string & msg) const;
+	private:
+		ros::Publisher * pub_;
+	};
+	bool postProcessingAsync_;
+	boost::thread * postProcessingThread_;
+	boost::mutex postProcessingMutex_;
+	PostProcessingState postProcessingState_;
+	int cleanupLocalGridsChunkSize_;
+	ros::Publisher postProcessingStatusPub_;
+	ros::ServiceServer cancelPostProcessingSrv_;
+
+	// online database backup
+	bool backupAsync_;
+	int backupPagesPerStep_;
+	double backupStepDelay_;
+	boost::thread * backupThread_;
 	float rate_;
+	bool adaptiveRate_;
+	float adaptiveRateBudget_;
+	float adaptiveRateMin_;
+	float adaptiveRateMax_;
+	float adaptiveRateLinearMotion_;
+	float adaptiveRateAngularMotion_;
+	float adaptiveRateCurrent_;
+	double adaptiveRateProcessingTime_;
 	bool createIntermediateNodes_;
 	int mappingMaxNodes_;
 	double mappingAltitudeDelta_;
 	bool alreadyRectifiedImages_;
 	bool twoDMapping_;
 	ros::Time previousStamp_;
+	rtabmap::Transform previousPose_;
 
 	rtabmap_util::ULogToRosout ulogToRosout_;
 };
@@ -48,6 +48,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/utilite/UConversion.h>
 #include <rtabmap/utilite/UStl.h>
 #include <rtabmap/utilite/UMath.h>
+#include <rtabmap/utilite/UProcessInfo.h>
 
 #include <rtabmap/core/util2d.h>
 #include <rtabmap/core/util3d.h>
@@ -69,20 +70,50 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #endif
 #endif
 
+#ifdef WITH_SQLITE3
+#include <sqlite3.h>
+#endif
+
 #define BAD_COVARIANCE 9999
 
 //msgs
 #include "rtabmap_msgs/Info.h"
 #include "rtabmap_msgs/MapData.h"
 #include "rtabmap_msgs/MapGraph.h"
+#include "rtabmap_msgs/MapDataDelta.h"
 #include "rtabmap_msgs/Path.h"
 
 #include "rtabmap_conversions/MsgConversion.h"
+#include "rtabmap_conversions/SensorDataChannel.h"
+
+#include <fstream>
 
 using namespace rtabmap;
 
 namespace rtabmap_slam {
 
+// Same as Transform::getTransform() but for the ring buffer: interpolate
+// orientation at "stamp" between the two closest buffered values.
+static Transform getImuTransform(const rtabmap_util::TimedRingBuffer<Transform> & imus, double stamp)
+{
+	size_t index = imus.lowerBound(stamp);
+	if(index < imus.size())
+	{
+		if(imus.at(index).first == stamp)
+		{
+			return imus.at(index).second;
+		}
+		else if(index > 0)
+		{
+			const std::pair<double, Transform> & previous = imus.at(index-1);
+			const std::pair<double, Transform> & next = imus.at(index);
+			float t = (stamp - previous.first) / (next.first - previous.first);
+			return previous.second.interpolate(t, next.second);
+		}
+	}
+	return Transform();
+}
+
 CoreWrapper::CoreWrapper() :
 		CommonDataSubscriber(false),
 		paused_(false),
@@ -104,7 +135,14 @@ CoreWrapper::CoreWrapper() :
 		waitForTransform_(true),
 		waitForTransformDuration_(0.2), // 200 ms
 		useActionForGoal_(false),
+		pathUpdateTolerance_(0.0),
+		pathUpdateAngleTolerance_(0.01),
+		lastLocalPathSubscribers_(0),
+		lastGlobalPathSubscribers_(0),
 		useSavedMap_(true),
+		mapsCacheSnapshot_(false),
+		compactInfo_(false),
+		infoWithHypotheses_(true),
 		genScan_(false),
 		genScanMaxDepth_(4.0),
 		genScanMinDepth_(0.0),
@@ -116,18 +154,78 @@ CoreWrapper::CoreWrapper() :
 		scanCloudMaxPoints_(0),
 		scanCloudIs2d_(false),
 		mapToOdom_(rtabmap::Transform::getIdentity()),
+		tfStatsCount_(0),
+		tfStatsTotalTime_(0.0),
+		tfStatsMaxInterval_(0.0),
+		mapsThread_(0),
+		mapsThreadRunning_(false),
+		mapsRequestPending_(false),
+		mapsRequestGraphRevision_(0),
+		mapsRequestsDropped_(0),
+		mapsLastUpdateTime_(0.0),
+		mapsLastPublishTime_(0.0),
+		pathPrefetchThread_(0),
+		pathPrefetchThreadRunning_(false),
+		pathPrefetchNodes_(0),
+		pathPrefetchPath_(0, 0),
+		pathPrefetchLoaded_(0),
+		framesThrottled_(0),
+		framesDropped_(0),
+		mapDataDeltaLinearTolerance_(0.01),
+		mapDataDeltaAngularTolerance_(0.01),
+		mapDataDeltaSeq_(0),
+		mapDataDeltaResync_(true),
+		gridMapCacheRevision_(0),
+		gridProbMapCacheRevision_(0),
+		mapCachesGraphRevision_(0),
+		mapCachesGraphSize_(0),
+		mapCachesGraphLastId_(0),
+		mapCachesGridRevision_(0),
+		memoryStats_(false),
+		memoryBudgetMaps_(0),
+		mapsCacheEvictions_(0),
 		transformThread_(0),
 		tfThreadRunning_(false),
 		stereoToDepth_(false),
 		interOdomSync_(0),
 		odomSensorSync_(false),
+		mapDataPacked_(false),
+		mapDataScanFloat16_(false),
+		scanQuantization_(0.0),
+		envSensorsBuffer_(10.0),
+		envSensorsReduction_("latest"),
+		postProcessingAsync_(false),
+		postProcessingThread_(0),
+		cleanupLocalGridsChunkSize_(100),
+		backupAsync_(false),
+		backupPagesPerStep_(256),
+		backupStepDelay_(0.01),
+		backupThread_(0),
 		rate_(Parameters::defaultRtabmapDetectionRate()),
+		adaptiveRate_(false),
+		adaptiveRateBudget_(0.8f),
+		adaptiveRateMin_(0.2f),
+		adaptiveRateMax_(0.0f),
+		adaptiveRateLinearMotion_(0.0f),
+		adaptiveRateAngularMotion_(0.0f),
+		adaptiveRateCurrent_(0.0f),
+		adaptiveRateProcessingTime_(0.0),
 		createIntermediateNodes_(Parameters::defaultRtabmapCreateIntermediateNodes()),
+		interOdomRate_(0.0),
 		mappingMaxNodes_(Parameters::defaultGridGlobalMaxNodes()),
 		mappingAltitudeDelta_(Parameters::defaultGridGlobalAltitudeDelta()),
 		alreadyRectifiedImages_(Parameters::defaultRtabmapImagesAlreadyRectified()),
 		twoDMapping_(Parameters::defaultRegForce3DoF()),
 		previousStamp_(0),
+		graphRevision_(1),
+		globalDescriptorIndexEnabled_(false),
+		globalDescriptorIndexSynced_(false),
+		relocalizationCandidates_(0),
+		relocalizationRadius_(3.0),
+		relocalizationPending_(false),
+		asyncInputsSpinner_(0),
+		imuSpinner_(0),
+		odomSensorDataPending_(false),
 		mbClient_(0)
 {
 	char * rosHomePath = getenv("ROS_HOME");
@@ -144,6 +242,7 @@ void CoreWrapper::onInit()
 	mapsManager_.init(nh, pnh, getName(), true);
 
 	bool publishTf = true;
+	bool mapAsyncPublishing = false;
 	std::string initialPoseStr;
 	double tfDelay = 0.05; // 20 Hz
 	double tfTolerance = 0.1; // 100 ms
@@ -181,9 +280,38 @@ void CoreWrapper::onInit()
 	pnh.param("log_to_rosout_level", eventLevel, eventLevel);
 	UASSERT(eventLevel >= ULogger::kDebug && eventLevel <= ULogger::kFatal);
 	ULogger::setEventLevel((ULogger::Level)eventLevel);
+	bool logToRosoutAsync = false;
+	double logToRosoutMaxRate = 0.0;
+	pnh.param("log_to_rosout_async", logToRosoutAsync, logToRosoutAsync);
+	pnh.param("log_to_rosout_max_rate", logToRosoutMaxRate, logToRosoutMaxRate);
+	if(logToRosoutAsync)
+	{
+		ulogToRosout_.setAsync(true, logToRosoutMaxRate);
+	}
 
 	pnh.param("publish_tf",          publishTf, publishTf);
 	pnh.param("tf_delay",            tfDelay, tfDelay);
+	pnh.param("map_async_publishing", mapAsyncPublishing, mapAsyncPublishing);
+	pnh.param("path_prefetch_nodes", pathPrefetchNodes_, pathPrefetchNodes_);
+	int latencyStatsWindow = 100;
+	pnh.param("latency_stats_window", latencyStatsWindow, latencyStatsWindow);
+	if(latencyStatsWindow < 0)
+	{
+		NODELET_WARN("rtabmap: latency_stats_window should be >= 0 (%d), set to 100 instead.", latencyStatsWindow);
+		latencyStatsWindow = 100;
+	}
+	int nodeDataCacheSize = 0;
+	pnh.param("node_data_cache_size", nodeDataCacheSize, nodeDataCacheSize); // MB
+	nodeDataCache_.setMaxBytes(nodeDataCacheSize>0?(size_t)nodeDataCacheSize*1024*1024:0);
+	pnh.param("memory_stats", memoryStats_, memoryStats_);
+	pnh.param("memory_budget_maps", memoryBudgetMaps_, memoryBudgetMaps_); // MB
+	latencyMsgConversion_.setWindowSize(latencyStatsWindow);
+	latencyRtabmap_.setWindowSize(latencyStatsWindow);
+	latencyUpdateMaps_.setWindowSize(latencyStatsWindow);
+	latencyPublishMaps_.setWindowSize(latencyStatsWindow);
+	latencyTotal_.setWindowSize(latencyStatsWindow);
+	pnh.param("map_data_delta_linear_tolerance", mapDataDeltaLinearTolerance_, mapDataDeltaLinearTolerance_);
+	pnh.param("map_data_delta_angular_tolerance", mapDataDeltaAngularTolerance_, mapDataDeltaAngularTolerance_);
 	if(pnh.hasParam("tf_prefix"))
 	{
 		ROS_ERROR("tf_prefix parameter has been removed, use directly map_frame_id, odom_frame_id and frame_id parameters.");
@@ -196,9 +324,30 @@ void CoreWrapper::onInit()
 	pnh.param("pub_loc_pose_only_when_localizing", pubLocPoseOnlyWhenLocalizing_,pubLocPoseOnlyWhenLocalizing_);
 	pnh.param("wait_for_transform",  waitForTransform_, waitForTransform_);
 	pnh.param("wait_for_transform_duration",  waitForTransformDuration_, waitForTransformDuration_);
+	bool tfCache = false;
+	int tfCacheSize = 100;
+	pnh.param("tf_cache", tfCache, tfCache);
+	pnh.param("tf_cache_size", tfCacheSize, tfCacheSize);
+	if(tfCache)
+	{
+		// shared by all nodelets of the same process
+		NODELET_INFO("rtabmap: tf_cache enabled (tf_cache_size=%d)", tfCacheSize);
+		rtabmap_conversions::setTransformCacheEnabled(true, tfCacheSize);
+	}
 	pnh.param("initial_pose",          initialPoseStr, initialPoseStr);
+	pnh.param("relocalization_candidates", relocalizationCandidates_, relocalizationCandidates_);
+	pnh.param("relocalization_radius", relocalizationRadius_, relocalizationRadius_);
+	int globalDescriptorIndexProbes = 8;
+	pnh.param("global_descriptor_index", globalDescriptorIndexEnabled_, globalDescriptorIndexEnabled_);
+	pnh.param("global_descriptor_index_probes", globalDescriptorIndexProbes, globalDescriptorIndexProbes);
+	globalDescriptorIndex_.setProbes(std::max(1, globalDescriptorIndexProbes));
 	pnh.param("use_action_for_goal", useActionForGoal_, useActionForGoal_);
+	pnh.param("path_update_tolerance", pathUpdateTolerance_, pathUpdateTolerance_);
+	pnh.param("path_update_angle_tolerance", pathUpdateAngleTolerance_, pathUpdateAngleTolerance_);
 	pnh.param("use_saved_map", useSavedMap_, useSavedMap_);
+	pnh.param("maps_cache_snapshot", mapsCacheSnapshot_, mapsCacheSnapshot_);
+	pnh.param("compact_info", compactInfo_, compactInfo_);
+	pnh.param("info_with_hypotheses", infoWithHypotheses_, infoWithHypotheses_);
 	pnh.param("gen_scan",            genScan_, genScan_);
 	pnh.param("gen_scan_max_depth",  genScanMaxDepth_, genScanMaxDepth_);
 	pnh.param("gen_scan_min_depth",  genScanMinDepth_, genScanMinDepth_);
@@ -221,6 +370,33 @@ void CoreWrapper::onInit()
 	}
 	pnh.param("stereo_to_depth", stereoToDepth_, stereoToDepth_);
 	pnh.param("odom_sensor_sync", odomSensorSync_, odomSensorSync_);
+	pnh.param("map_data_packed", mapDataPacked_, mapDataPacked_);
+	pnh.param("map_data_scan_float16", mapDataScanFloat16_, mapDataScanFloat16_);
+	pnh.param("scan_quantization", scanQuantization_, scanQuantization_);
+	threadSettings_ = rtabmap_conversions::ThreadSettings::fromParams(pnh, "thread_");
+	threadPool_ = rtabmap_conversions::ThreadPool::fromParams(pnh);
+	bool shmTransport = false;
+	int shmTransportSize = 32;
+	pnh.param("shm_transport", shmTransport, shmTransport);
+	pnh.param("shm_transport_size", shmTransportSize, shmTransportSize);
+	pnh.param("post_processing_async", postProcessingAsync_, postProcessingAsync_);
+	pnh.param("cleanup_local_grids_chunk_size", cleanupLocalGridsChunkSize_, cleanupLocalGridsChunkSize_);
+	pnh.param("backup_async", backupAsync_, backupAsync_);
+	pnh.param("backup_pages_per_step", backupPagesPerStep_, backupPagesPerStep_);
+	pnh.param("backup_step_delay", backupStepDelay_, backupStepDelay_);
+#ifndef WITH_SQLITE3
+	if(backupAsync_)
+	{
+		NODELET_WARN("rtabmap: backup_async is true but rtabmap_slam has not been built with SQLite3, backups will be synchronous.");
+		backupAsync_ = false;
+	}
+#endif
+	pnh.param("adaptive_rate", adaptiveRate_, adaptiveRate_);
+	pnh.param("adaptive_rate_budget", adaptiveRateBudget_, adaptiveRateBudget_);
+	pnh.param("adaptive_rate_min", adaptiveRateMin_, adaptiveRateMin_);
+	pnh.param("adaptive_rate_max", adaptiveRateMax_, adaptiveRateMax_);
+	pnh.param("adaptive_rate_linear_motion", adaptiveRateLinearMotion_, adaptiveRateLinearMotion_);
+	pnh.param("adaptive_rate_angular_motion", adaptiveRateAngularMotion_, adaptiveRateAngularMotion_);
 	if(pnh.hasParam("flip_scan"))
 	{
 		NODELET_WARN("Parameter \"flip_scan\" doesn't exist anymore. Rtabmap now "
@@ -241,11 +417,57 @@ void CoreWrapper::onInit()
 	}
 	NODELET_INFO("rtabmap: map_frame_id  = %s", mapFrameId_.c_str());
 	NODELET_INFO("rtabmap: log_to_rosout_level = %d", eventLevel);
+	NODELET_INFO("rtabmap: log_to_rosout_async = %s (max rate=%f Hz)", logToRosoutAsync?"true":"false", logToRosoutMaxRate);
 	NODELET_INFO("rtabmap: initial_pose  = %s", initialPoseStr.c_str());
+	NODELET_INFO("rtabmap: relocalization_candidates = %d (radius=%f m)", relocalizationCandidates_, relocalizationRadius_);
+	if(relocalizationRadius_ > 0.0)
+	{
+		// cells of the size of the relocalization radius
+		nodesIndex_.setCellSize(relocalizationRadius_);
+	}
+	NODELET_INFO("rtabmap: global_descriptor_index = %s (probes=%d)", globalDescriptorIndexEnabled_?"true":"false", globalDescriptorIndexProbes);
 	NODELET_INFO("rtabmap: use_action_for_goal  = %s", useActionForGoal_?"true":"false");
+	NODELET_INFO("rtabmap: path_update_tolerance = %f m, %f rad", pathUpdateTolerance_, pathUpdateAngleTolerance_);
 	NODELET_INFO("rtabmap: tf_delay      = %f", tfDelay);
 	NODELET_INFO("rtabmap: tf_tolerance  = %f", tfTolerance);
 	NODELET_INFO("rtabmap: odom_sensor_sync   = %s", odomSensorSync_?"true":"false");
+	NODELET_INFO("rtabmap: map_data_packed    = %s", mapDataPacked_?"true":"false");
+	NODELET_INFO("rtabmap: map_data_scan_float16 = %s", mapDataScanFloat16_?"true":"false");
+	NODELET_INFO("rtabmap: scan_quantization  = %f m", scanQuantization_);
+	NODELET_INFO("rtabmap: thread settings    = %s", threadSettings_.toString().c_str());
+	NODELET_INFO("rtabmap: thread_pool        = \"%s\" (%d threads)", threadPool_.get()?threadPool_->name().c_str():"", threadPool_.get()?threadPool_->size():0);
+	NODELET_INFO("rtabmap: shm_transport      = %s (%d MB)", shmTransport?"true":"false", shmTransportSize);
+	NODELET_INFO("rtabmap: post_processing_async = %s", postProcessingAsync_?"true":"false");
+	NODELET_INFO("rtabmap: cleanup_local_grids_chunk_size = %d", cleanupLocalGridsChunkSize_);
+	NODELET_INFO("rtabmap: compact_info       = %s (with hypotheses=%s)", compactInfo_?"true":"false", infoWithHypotheses_?"true":"false");
+	NODELET_INFO("rtabmap: backup_async = %s", backupAsync_?"true":"false");
+	if(backupAsync_)
+	{
+		NODELET_INFO("rtabmap: backup_pages_per_step = %d", backupPagesPerStep_);
+		NODELET_INFO("rtabmap: backup_step_delay = %f s", backupStepDelay_);
+	}
+	NODELET_INFO("rtabmap: adaptive_rate = %s", adaptiveRate_?"true":"false");
+	if(adaptiveRate_)
+	{
+		if(adaptiveRateBudget_ <= 0.0f)
+		{
+			NODELET_WARN("rtabmap: adaptive_rate_budget (%f) should be > 0, setting it to 0.8.", adaptiveRateBudget_);
+			adaptiveRateBudget_ = 0.8f;
+		}
+		NODELET_INFO("rtabmap: adaptive_rate_budget = %f", adaptiveRateBudget_);
+		NODELET_INFO("rtabmap: adaptive_rate_min = %f Hz", adaptiveRateMin_);
+		NODELET_INFO("rtabmap: adaptive_rate_max = %f Hz", adaptiveRateMax_);
+		NODELET_INFO("rtabmap: adaptive_rate_linear_motion = %f m", adaptiveRateLinearMotion_);
+		NODELET_INFO("rtabmap: adaptive_rate_angular_motion = %f rad", adaptiveRateAngularMotion_);
+	}
+	NODELET_INFO("rtabmap: map_async_publishing = %s", mapAsyncPublishing?"true":"false");
+	NODELET_INFO("rtabmap: path_prefetch_nodes = %d", pathPrefetchNodes_);
+	NODELET_INFO("rtabmap: latency_stats_window = %d", latencyStatsWindow);
+	NODELET_INFO("rtabmap: node_data_cache_size = %d MB", nodeDataCacheSize);
+	NODELET_INFO("rtabmap: memory_stats = %s", memoryStats_?"true":"false");
+	NODELET_INFO("rtabmap: memory_budget_maps = %d MB", memoryBudgetMaps_);
+	NODELET_INFO("rtabmap: map_data_delta_linear_tolerance = %f", mapDataDeltaLinearTolerance_);
+	NODELET_INFO("rtabmap: map_data_delta_angular_tolerance = %f", mapDataDeltaAngularTolerance_);
 	NODELET_INFO("rtabmap: pub_loc_pose_only_when_localizing = %s", pubLocPoseOnlyWhenLocalizing_?"true":"false");
 	bool subscribeStereo = false;
 	pnh.param("subscribe_stereo",      subscribeStereo, subscribeStereo);
@@ -278,8 +500,24 @@ void CoreWrapper::onInit()
 	}
 
 	infoPub_ = nh.advertise<rtabmap_msgs::Info>("info", 1);
+	if(compactInfo_)
+	{
+		// statistics names of compact info messages
+		infoStatsNamesPub_ = nh.advertise<rtabmap_msgs::Info>("info_stats_names", 1, true);
+	}
 	mapDataPub_ = nh.advertise<rtabmap_msgs::MapData>("mapData", 1);
+	if(shmTransport && shmTransportSize > 0)
+	{
+		// info and mapData are also written in shared memory for
+		// subscribers on the same host (e.g., rtabmap_viz)
+		std::string shmName = rtabmap_sync::ShmRingBuffer::segmentName(nh.resolveName("info"));
+		if(shmInfoMapData_.create(shmName, 4, (size_t)shmTransportSize*1024*1024))
+		{
+			NODELET_INFO("rtabmap: info and mapData are also published in shared memory \"%s\"", shmName.c_str());
+		}
+	}
 	mapGraphPub_ = nh.advertise<rtabmap_msgs::MapGraph>("mapGraph", 1, mapsManager_.isLatching());
+	mapDataDeltaPub_ = nh.advertise<rtabmap_msgs::MapDataDelta>("mapDataDelta", 10);
 	odomCachePub_ = nh.advertise<rtabmap_msgs::MapGraph>("mapOdomCache", 1);
 	landmarksPub_ = nh.advertise<geometry_msgs::PoseArray>("landmarks", 1);
 	labelsPub_ = nh.advertise<visualization_msgs::MarkerArray>("labels", 1);
@@ -580,6 +818,8 @@ void CoreWrapper::onInit()
 			NODELET_INFO("Create intermediate nodes");
 			if(rate_ == 0.0f)
 			{
+				pnh.param("inter_odom_rate", interOdomRate_, interOdomRate_);
+				NODELET_INFO("inter_odom_rate = %f Hz", interOdomRate_);
 				bool interOdomInfo = false;
 				pnh.getParam("subscribe_inter_odom_info", interOdomInfo);
 				if(interOdomInfo)
@@ -654,6 +894,11 @@ void CoreWrapper::onInit()
 
 	if(rtabmap_.getMemory())
 	{
+		if(mapsCacheSnapshot_)
+		{
+			mapsManager_.loadCache(databasePath_ + ".maps", rtabmap_.getLocalOptimizedPoses());
+		}
+
 		if(useSavedMap_)
 		{
 			float xMin, yMin, gridCellSize;
@@ -698,6 +943,9 @@ void CoreWrapper::onInit()
 	detectMoreLoopClosuresSrv_ = nh.advertiseService("detect_more_loop_closures", &CoreWrapper::detectMoreLoopClosuresCallback, this);
 	globalBundleAdjustmentSrv_ = nh.advertiseService("global_bundle_adjustment", &CoreWrapper::globalBundleAdjustmentCallback, this);
 	cleanupLocalGridsSrv_ = nh.advertiseService("cleanup_local_grids", &CoreWrapper::cleanupLocalGridsCallback, this);
+	cancelPostProcessingSrv_ = nh.advertiseService("cancel_post_processing", &CoreWrapper::cancelPostProcessingCallback, this);
+	postProcessingStatusPub_ = nh.advertise<std_msgs::String>("post_processing_status", 10);
+	postProcessingState_.setPublisher(&postProcessingStatusPub_);
 	setModeLocalizationSrv_ = nh.advertiseService("set_mode_localization", &CoreWrapper::setModeLocalizationCallback, this);
 	setModeMappingSrv_ = nh.advertiseService("set_mode_mapping", &CoreWrapper::setModeMappingCallback, this);
 	getNodeDataSrv_ = nh.advertiseService("get_node_data", &CoreWrapper::getNodeDataCallback, this);
@@ -706,17 +954,31 @@ void CoreWrapper::onInit()
 	getMapSrv_ = nh.advertiseService("get_map", &CoreWrapper::getMapCallback, this);
 	getProbMapSrv_ = nh.advertiseService("get_prob_map", &CoreWrapper::getProbMapCallback, this);
 	getGridMapSrv_ = nh.advertiseService("get_grid_map", &CoreWrapper::getGridMapCallback, this);
+	for(size_t i=0; i<mapsManager_.getGridPyramidCellSizes().size(); ++i)
+	{
+		// coarser levels of the grid map, see grid_pyramid_cell_sizes
+		getGridMapLevelSrvs_.push_back(nh.advertiseService<nav_msgs::GetMap::Request, nav_msgs::GetMap::Response>(
+				uFormat("get_grid_map_level%d", (int)i+1),
+				boost::bind(&CoreWrapper::getGridMapLevelCallback, this, boost::placeholders::_1, boost::placeholders::_2, mapsManager_.getGridPyramidCellSizes()[i])));
+	}
 	getProjMapSrv_ = nh.advertiseService("get_proj_map", &CoreWrapper::getProjMapCallback, this);
 	publishMapDataSrv_ = nh.advertiseService("publish_map", &CoreWrapper::publishMapCallback, this);
 	getPlanSrv_ = nh.advertiseService("get_plan", &CoreWrapper::getPlanCallback, this);
 	getPlanNodesSrv_ = nh.advertiseService("get_plan_nodes", &CoreWrapper::getPlanNodesCallback, this);
+	getPlansSrv_ = nh.advertiseService("get_plans", &CoreWrapper::getPlansCallback, this);
 	setGoalSrv_ = nh.advertiseService("set_goal", &CoreWrapper::setGoalCallback, this);
 	cancelGoalSrv_ = nh.advertiseService("cancel_goal", &CoreWrapper::cancelGoalCallback, this);
 	setLabelSrv_ = nh.advertiseService("set_label", &CoreWrapper::setLabelCallback, this);
 	listLabelsSrv_ = nh.advertiseService("list_labels", &CoreWrapper::listLabelsCallback, this);
 	removeLabelSrv_ = nh.advertiseService("remove_label", &CoreWrapper::removeLabelCallback, this);
 	addLinkSrv_ = nh.advertiseService("add_link", &CoreWrapper::addLinkCallback, this);
+	addLinksSrv_ = nh.advertiseService("add_links", &CoreWrapper::addLinksCallback, this);
 	getNodesInRadiusSrv_ = nh.advertiseService("get_nodes_in_radius", &CoreWrapper::getNodesInRadiusCallback, this);
+	if(globalDescriptorIndexEnabled_)
+	{
+		getNodesByDescriptorSrv_ = nh.advertiseService("get_nodes_by_descriptor", &CoreWrapper::getNodesByDescriptorCallback, this);
+	}
+	resyncMapDataDeltaSrv_ = nh.advertiseService("resync_map_data_delta", &CoreWrapper::resyncMapDataDeltaCallback, this);
 #ifdef WITH_OCTOMAP_MSGS
 #ifdef RTABMAP_OCTOMAP
 	octomapBinarySrv_ = nh.advertiseService("octomap_binary", &CoreWrapper::octomapBinaryCallback, this);
@@ -733,6 +995,7 @@ void CoreWrapper::onInit()
 	Parameters::parse(parameters_, Parameters::kOptimizerIterations(), optimizeIterations);
 	if(publishTf && optimizeIterations != 0)
 	{
+		setMapToOdomTF(mapToOdom_, odomFrameId_);
 		tfThreadRunning_ = true;
 		transformThread_ = new boost::thread(boost::bind(&CoreWrapper::publishLoop, this, tfDelay, tfTolerance));
 	}
@@ -742,8 +1005,45 @@ void CoreWrapper::onInit()
 				Parameters::kOptimizerIterations().c_str(), mapFrameId_.c_str());
 	}
 
+	if(mapAsyncPublishing)
+	{
+		mapsThreadRunning_ = true;
+		mapsThread_ = new boost::thread(boost::bind(&CoreWrapper::mapsUpdateLoop, this));
+	}
+
+	if(pathPrefetchNodes_ > 0)
+	{
+		if(databasePath_.empty() || uStr2Bool(parameters_.at(Parameters::kDbSqlite3InMemory())))
+		{
+			NODELET_WARN("rtabmap: path_prefetch_nodes is ignored, the database is not on disk.");
+		}
+		else
+		{
+			pathPrefetchThreadRunning_ = true;
+			pathPrefetchThread_ = new boost::thread(boost::bind(&CoreWrapper::pathPrefetchLoop, this));
+		}
+	}
+
 	setupCallbacks(nh, pnh, getName()); // do it at the end
-	if(!this->isDataSubscribed())
+	bool subscribeOdomSensorData = false;
+	pnh.param("subscribe_odom_sensor_data", subscribeOdomSensorData, subscribeOdomSensorData);
+	NODELET_INFO("rtabmap: subscribe_odom_sensor_data = %s", subscribeOdomSensorData?"true":"false");
+	if(subscribeOdomSensorData)
+	{
+		// Odometry nodelet loaded in the same manager with "publish_odom_sensor_data"
+		// gives us its already converted data, no need to synchronize topics.
+		if(this->isDataSubscribed())
+		{
+			NODELET_WARN("\"subscribe_odom_sensor_data\" is true but other sensor topics are also subscribed, "
+					"the same data may be processed twice. Set subscribe_depth, subscribe_stereo, "
+					"subscribe_rgbd, subscribe_rgb, subscribe_scan, subscribe_scan_cloud and subscribe_odom to false.");
+		}
+		odomSensorDataChannel_ = nh.resolveName("odom_sensor_data");
+		rtabmap_conversions::SensorDataChannel::subscribe(odomSensorDataChannel_, this,
+				boost::bind(&CoreWrapper::odomSensorDataCallback, this, _1, _2, _3));
+		NODELET_INFO("\n%s subscribed to in-process odometry data:\n   %s", getName().c_str(), odomSensorDataChannel_.c_str());
+	}
+	else if(!this->isDataSubscribed())
 	{
 		bool isRGBD = uStr2Bool(parameters_.at(Parameters::kRGBDEnabled()).c_str());
 		if(isRGBD)
@@ -841,21 +1141,125 @@ void CoreWrapper::onInit()
 		pnh.setParam(iter->first, iter->second);
 	}
 
-	userDataAsyncSub_ = nh.subscribe("user_data_async", 1, &CoreWrapper::userDataAsyncCallback, this);
-	globalPoseAsyncSub_ = nh.subscribe("global_pose", 1, &CoreWrapper::globalPoseAsyncCallback, this);
-	gpsFixAsyncSub_ = nh.subscribe("gps/fix", 1, &CoreWrapper::gpsFixAsyncCallback, this);
+	// Async inputs can be received on their own callback queues, so
+	// that a long map update doesn't delay them (IMU has its own queue).
+	bool asyncInputsQueue = false;
+	int asyncInputsThreads = 1;
+	pnh.param("async_inputs_queue", asyncInputsQueue, asyncInputsQueue);
+	pnh.param("async_inputs_threads", asyncInputsThreads, asyncInputsThreads);
+	NODELET_INFO("rtabmap: async_inputs_queue = %s (threads=%d)", asyncInputsQueue?"true":"false", asyncInputsThreads);
+	ros::NodeHandle asyncNh(nh);
+	ros::NodeHandle imuNh(nh);
+	if(asyncInputsQueue)
+	{
+		asyncNh.setCallbackQueue(&asyncInputsQueue_);
+		imuNh.setCallbackQueue(&imuQueue_);
+	}
+
+	userDataAsyncSub_ = asyncNh.subscribe("user_data_async", 1, &CoreWrapper::userDataAsyncCallback, this);
+	bool envSensorsAsync = false;
+	int envSensorsQueueSize = 100;
+	pnh.param("env_sensors_async", envSensorsAsync, envSensorsAsync);
+	pnh.param("env_sensors_queue_size", envSensorsQueueSize, envSensorsQueueSize);
+	pnh.param("env_sensors_buffer", envSensorsBuffer_, envSensorsBuffer_);
+	pnh.param("env_sensors_reduction", envSensorsReduction_, envSensorsReduction_);
+	if(envSensorsReduction_.compare("latest") != 0 &&
+	   envSensorsReduction_.compare("mean") != 0 &&
+	   envSensorsReduction_.compare("min") != 0 &&
+	   envSensorsReduction_.compare("max") != 0)
+	{
+		NODELET_WARN("rtabmap: env_sensors_reduction \"%s\" is not supported (latest, mean, min or max), \"latest\" is used.", envSensorsReduction_.c_str());
+		envSensorsReduction_ = "latest";
+	}
+	if(envSensorsAsync)
+	{
+		NODELET_INFO("rtabmap: env_sensors_async = true (queue=%d, buffer=%f s, reduction=%s)",
+				envSensorsQueueSize, envSensorsBuffer_, envSensorsReduction_.c_str());
+		envSensorAsyncSub_ = asyncNh.subscribe("env_sensor", envSensorsQueueSize, &CoreWrapper::envSensorAsyncCallback, this);
+	}
+	globalPoseAsyncSub_ = asyncNh.subscribe("global_pose", 1, &CoreWrapper::globalPoseAsyncCallback, this);
+	gpsFixAsyncSub_ = asyncNh.subscribe("gps/fix", 1, &CoreWrapper::gpsFixAsyncCallback, this);
 #ifdef WITH_APRILTAG_ROS
-	tagDetectionsSub_ = nh.subscribe("tag_detections", 1, &CoreWrapper::tagDetectionsAsyncCallback, this);
+	tagDetectionsSub_ = asyncNh.subscribe("tag_detections", 1, &CoreWrapper::tagDetectionsAsyncCallback, this);
 #endif
 #ifdef WITH_FIDUCIAL_MSGS
-	fiducialTransfromsSub_ = nh.subscribe("fiducial_transforms", 1, &CoreWrapper::fiducialDetectionsAsyncCallback, this);
+	fiducialTransfromsSub_ = asyncNh.subscribe("fiducial_transforms", 1, &CoreWrapper::fiducialDetectionsAsyncCallback, this);
 #endif
-	imuSub_ = nh.subscribe("imu", 100, &CoreWrapper::imuAsyncCallback, this);
+	imuSub_ = imuNh.subscribe("imu", 100, &CoreWrapper::imuAsyncCallback, this);
+
+	if(asyncInputsQueue)
+	{
+		asyncInputsSpinner_ = new ros::AsyncSpinner(asyncInputsThreads>0?asyncInputsThreads:1, &asyncInputsQueue_);
+		asyncInputsSpinner_->start();
+		imuSpinner_ = new ros::AsyncSpinner(1, &imuQueue_);
+		imuSpinner_->start();
+	}
 	republishNodeDataSub_ = nh.subscribe("republish_node_data", 100, &CoreWrapper::republishNodeDataCallback, this);
 }
 
 CoreWrapper::~CoreWrapper()
 {
+	if(!odomSensorDataChannel_.empty())
+	{
+		rtabmap_conversions::SensorDataChannel::unsubscribe(odomSensorDataChannel_, this);
+		ros::CallbackQueue * queue = dynamic_cast<ros::CallbackQueue*>(getNodeHandle().getCallbackQueue());
+		if(queue)
+		{
+			queue->removeByID((uint64_t)this);
+		}
+	}
+	if(asyncInputsSpinner_)
+	{
+		asyncInputsSpinner_->stop();
+		delete asyncInputsSpinner_;
+	}
+	if(imuSpinner_)
+	{
+		imuSpinner_->stop();
+		delete imuSpinner_;
+	}
+
+	if(rtabmap_conversions::isTransformCacheEnabled())
+	{
+		unsigned long hits=0, misses=0;
+		rtabmap_conversions::getTransformCacheStatistics(hits, misses);
+		printf("rtabmap: TF cache hits=%lu misses=%lu\n", hits, misses);
+	}
+
+	if(backupThread_)
+	{
+		backupThread_->interrupt();
+		backupThread_->join();
+		delete backupThread_;
+	}
+
+	if(postProcessingThread_)
+	{
+		postProcessingState_.setCanceled(true);
+		postProcessingThread_->join();
+		delete postProcessingThread_;
+	}
+
+	if(mapsThread_)
+	{
+		mapsRequestMutex_.lock();
+		mapsThreadRunning_ = false;
+		mapsRequestMutex_.unlock();
+		mapsRequestCondition_.notify_one();
+		mapsThread_->join();
+		delete mapsThread_;
+	}
+
+	if(pathPrefetchThread_)
+	{
+		pathPrefetchMutex_.lock();
+		pathPrefetchThreadRunning_ = false;
+		pathPrefetchMutex_.unlock();
+		pathPrefetchCondition_.notify_one();
+		pathPrefetchThread_->join();
+		delete pathPrefetchThread_;
+	}
+
 	if(transformThread_)
 	{
 		tfThreadRunning_ = false;
@@ -866,17 +1270,7 @@ CoreWrapper::~CoreWrapper()
 	this->saveParameters(configPath_);
 
 	printf("rtabmap: Saving database/long-term memory... (located at %s)\n", databasePath_.c_str());
-	if(rtabmap_.getMemory())
-	{
-		// save the grid map
-		float xMin=0.0f, yMin=0.0f, gridCellSize = 0.05f;
-		cv::Mat pixels = mapsManager_.getGridMap(xMin, yMin, gridCellSize);
-		if(!pixels.empty())
-		{
-			printf("rtabmap: 2D occupancy grid map saved.\n");
-			rtabmap_.getMemory()->save2DMap(pixels, xMin, yMin, gridCellSize);
-		}
-	}
+	saveGridMap();
 
 	rtabmap_.close();
 	printf("rtabmap: Saving database/long-term memory...done! (located at %s, %ld MB)\n", databasePath_.c_str(), UFile::length(databasePath_)/(1024*1024));
@@ -918,27 +1312,206 @@ void CoreWrapper::saveParameters(const std::string & configFile)
 
 void CoreWrapper::publishLoop(double tfDelay, double tfTolerance)
 {
+	threadSettings_.apply();
 	if(tfDelay == 0)
 		return;
 	ros::Rate r(1.0 / tfDelay);
+	ros::WallTime lastSent;
 	while(tfThreadRunning_)
 	{
-		if(!odomFrameId_.empty())
+		boost::shared_ptr<const MapToOdomTF> mapToOdomTF = boost::atomic_load(&mapToOdomTF_);
+		if(mapToOdomTF.get() && !mapToOdomTF->odomFrameId.empty())
 		{
-			mapToOdomMutex_.lock();
 			ros::Time tfExpiration = ros::Time::now() + ros::Duration(tfTolerance);
 			geometry_msgs::TransformStamped msg;
-			msg.child_frame_id = odomFrameId_;
+			msg.child_frame_id = mapToOdomTF->odomFrameId;
 			msg.header.frame_id = mapFrameId_;
 			msg.header.stamp = tfExpiration;
-			rtabmap_conversions::transformToGeometryMsg(mapToOdom_, msg.transform);
+			rtabmap_conversions::transformToGeometryMsg(mapToOdomTF->transform, msg.transform);
 			tfBroadcaster_.sendTransform(msg);
-			mapToOdomMutex_.unlock();
+
+			ros::WallTime now = ros::WallTime::now();
+			if(!lastSent.isZero())
+			{
+				double interval = (now - lastSent).toSec();
+				boost::mutex::scoped_lock lock(tfStatsMutex_);
+				++tfStatsCount_;
+				tfStatsTotalTime_ += interval;
+				if(interval > tfStatsMaxInterval_)
+				{
+					tfStatsMaxInterval_ = interval;
+				}
+			}
+			lastSent = now;
 		}
 		r.sleep();
 	}
 }
 
+void CoreWrapper::setMapToOdomTF(const rtabmap::Transform & mapToOdom, const std::string & odomFrameId)
+{
+	boost::shared_ptr<MapToOdomTF> mapToOdomTF(new MapToOdomTF);
+	mapToOdomTF->transform = mapToOdom;
+	mapToOdomTF->odomFrameId = odomFrameId;
+	boost::atomic_store(&mapToOdomTF_, boost::shared_ptr<const MapToOdomTF>(mapToOdomTF));
+}
+
+void CoreWrapper::mapsUpdateLoop()
+{
+	threadSettings_.apply();
+	while(true)
+	{
+		std::map<int, Transform> poses;
+		std::map<int, Signature> signatures;
+		ros::Time stamp;
+		unsigned long graphRevision = 0;
+		{
+			boost::mutex::scoped_lock lock(mapsRequestMutex_);
+			while(mapsThreadRunning_ && !mapsRequestPending_)
+			{
+				mapsRequestCondition_.wait(lock);
+			}
+			if(!mapsThreadRunning_)
+			{
+				break;
+			}
+			poses.swap(mapsRequestPoses_);
+			signatures.swap(mapsRequestSignatures_);
+			stamp = mapsRequestStamp_;
+			graphRevision = mapsRequestGraphRevision_;
+			mapsRequestPending_ = false;
+		}
+
+		UTimer timer;
+		boost::mutex::scoped_lock mapsLock(mapsMutex_);
+		// Memory is not thread-safe: memoryMutex_ is locked only
+		// while node data are loaded, not while local grids and
+		// clouds are created, so rtabmap can keep processing.
+		const std::map<int, Transform> & mapPoses = mapsManager_.updateMapCaches(
+				poses,
+				rtabmap_.getMemory(),
+				false,
+				false,
+				signatures,
+				&memoryMutex_,
+				graphRevision);
+		double timeUpdateMaps = timer.ticks();
+
+		mapsManager_.publishMaps(mapPoses, stamp, mapFrameId_);
+		double timePublishMaps = timer.ticks();
+
+		mapsRequestMutex_.lock();
+		mapsLastUpdateTime_ = timeUpdateMaps;
+		mapsLastPublishTime_ = timePublishMaps;
+		mapsRequestMutex_.unlock();
+		NODELET_DEBUG("rtabmap: Maps update thread: update=%.4fs pub=%.4fs", timeUpdateMaps, timePublishMaps);
+	}
+}
+
+void CoreWrapper::prefetchPathNodes()
+{
+	if(pathPrefetchThread_ == 0 || rtabmap_.getPath().empty() || rtabmap_.getMemory() == 0)
+	{
+		return;
+	}
+	const std::vector<std::pair<int, Transform> > & path = rtabmap_.getPath();
+	std::pair<int, size_t> pathKey(path.front().first, path.size());
+	if(pathKey != pathPrefetchPath_)
+	{
+		pathPrefetchPath_ = pathKey;
+		pathPrefetched_.clear();
+	}
+
+	// Nodes ahead of the current goal that are not in working memory
+	std::list<int> ids;
+	for(size_t i=rtabmap_.getPathCurrentGoalIndex(); i<path.size() && (int)ids.size()<pathPrefetchNodes_; ++i)
+	{
+		int id = path[i].first;
+		if(pathPrefetched_.find(id) == pathPrefetched_.end() && rtabmap_.getMemory()->getSignature(id) == 0)
+		{
+			pathPrefetched_.insert(id);
+			ids.push_back(id);
+		}
+	}
+	if(ids.size())
+	{
+		boost::mutex::scoped_lock lock(pathPrefetchMutex_);
+		pathPrefetchRequest_.splice(pathPrefetchRequest_.end(), ids);
+		pathPrefetchCondition_.notify_one();
+	}
+}
+
+void CoreWrapper::pathPrefetchLoop()
+{
+	threadSettings_.apply();
+	// Separate read-only connection, Memory is not thread-safe. Reading the
+	// nodes ahead brings their pages in the file system cache, so retrieving
+	// them from long-term memory later doesn't wait on the disk.
+	rtabmap::DBDriver * driver = 0;
+	while(true)
+	{
+		std::list<int> ids;
+		{
+			boost::mutex::scoped_lock lock(pathPrefetchMutex_);
+			while(pathPrefetchThreadRunning_ && pathPrefetchRequest_.empty())
+			{
+				pathPrefetchCondition_.wait(lock);
+			}
+			if(!pathPrefetchThreadRunning_)
+			{
+				break;
+			}
+			ids.swap(pathPrefetchRequest_);
+		}
+
+		if(driver == 0)
+		{
+			driver = rtabmap::DBDriver::create();
+			if(!driver->openConnection(databasePath_))
+			{
+				NODELET_WARN("rtabmap: Path prefetch: cannot open database \"%s\"", databasePath_.c_str());
+				delete driver;
+				driver = 0;
+				continue;
+			}
+		}
+
+		UTimer timer;
+		std::list<Signature*> signatures;
+		driver->loadSignatures(ids, signatures);
+		driver->loadNodeData(signatures);
+		if(nodeDataCache_.enabled())
+		{
+			// Ready for the next map data publication
+			std::map<int, Signature> nodes;
+			for(std::list<Signature*>::iterator iter=signatures.begin(); iter!=signatures.end(); ++iter)
+			{
+				nodes.insert(std::make_pair((*iter)->id(), **iter));
+			}
+			std::vector<rtabmap_msgs::NodeData> msgs;
+			rtabmap_conversions::nodesDataToROS(nodes, msgs, mapDataPacked_, 0, mapDataScanFloat16_, threadPool_.get());
+			for(size_t i=0; i<msgs.size(); ++i)
+			{
+				nodeDataCache_.insert(msgs[i].id, rtabmap_util::NodeDataCache::kAll, msgs[i]);
+			}
+		}
+		int loaded = (int)signatures.size();
+		for(std::list<Signature*>::iterator iter=signatures.begin(); iter!=signatures.end(); ++iter)
+		{
+			delete *iter;
+		}
+		pathPrefetchMutex_.lock();
+		pathPrefetchLoaded_ += loaded;
+		pathPrefetchMutex_.unlock();
+		NODELET_DEBUG("rtabmap: Path prefetch: loaded %d/%d nodes (%.4fs)", loaded, (int)ids.size(), timer.ticks());
+	}
+	if(driver)
+	{
+		driver->closeConnection(false);
+		delete driver;
+	}
+}
+
 void CoreWrapper::defaultCallback(const sensor_msgs::ImageConstPtr & imageMsg)
 {
 	if(!paused_)
@@ -947,15 +1520,14 @@ void CoreWrapper::defaultCallback(const sensor_msgs::ImageConstPtr & imageMsg)
 		if(stamp.toSec() == 0.0)
 		{
 			ROS_WARN("A null stamp has been detected in the input topic. Make sure the stamp is set.");
+			++framesDropped_;
 			return;
 		}
 
-		if(rate_>0.0f)
+		if(isFrameThrottled(stamp, Transform()))
 		{
-			if(previousStamp_.toSec() > 0.0 && stamp.toSec() > previousStamp_.toSec() && stamp - previousStamp_ < ros::Duration(1.0f/rate_))
-			{
-				return;
-			}
+			++framesThrottled_;
+			return;
 		}
 		previousStamp_ = stamp;
 
@@ -983,7 +1555,13 @@ void CoreWrapper::defaultCallback(const sensor_msgs::ImageConstPtr & imageMsg)
 		UTimer timer;
 		if(rtabmap_.isIDsGenerated() || ptrImage->header.seq > 0)
 		{
-			if(!rtabmap_.process(ptrImage->image.clone(), ptrImage->header.seq))
+			bool processed;
+			{
+				boost::mutex::scoped_lock memoryLock(memoryMutex_);
+				processed = rtabmap_.process(ptrImage->image.clone(), ptrImage->header.seq);
+				updateGraphRevision();
+			}
+			if(!processed)
 			{
 				NODELET_WARN("RTAB-Map could not process the data received! (ROS id = %d)", ptrImage->header.seq);
 			}
@@ -1041,7 +1619,10 @@ bool CoreWrapper::odomUpdate(const nav_msgs::OdometryConstPtr & odomMsg, ros::Ti
 		if(!lastPose_.isIdentity() && !odom.isNull() && (odom.isIdentity() || (odomMsg->pose.covariance[0] >= BAD_COVARIANCE && odomMsg->twist.covariance[0] >= BAD_COVARIANCE)))
 		{
 			UWARN("Odometry is reset (identity pose or high variance (%f) detected). Increment map id!", MAX(odomMsg->pose.covariance[0], odomMsg->twist.covariance[0]));
+			memoryMutex_.lock();
 			rtabmap_.triggerNewMap();
+			++graphRevision_;
+			memoryMutex_.unlock();
 			covariance_ = cv::Mat();
 		}
 
@@ -1090,13 +1671,12 @@ bool CoreWrapper::odomUpdate(const nav_msgs::OdometryConstPtr & odomMsg, ros::Ti
 		{
 			ROS_WARN("A null stamp has been detected in the input topics. Make sure the stamp in all input topics is set.");
 			ignoreFrame = true;
+			++framesDropped_;
 		}
-		if(rate_>0.0f)
+		else if(isFrameThrottled(stamp, odom))
 		{
-			if(previousStamp_.toSec() > 0.0 && stamp.toSec() > previousStamp_.toSec() && stamp - previousStamp_ < ros::Duration(1.0f/rate_))
-			{
-				ignoreFrame = true;
-			}
+			ignoreFrame = true;
+			++framesThrottled_;
 		}
 		if(ignoreFrame)
 		{
@@ -1112,6 +1692,7 @@ bool CoreWrapper::odomUpdate(const nav_msgs::OdometryConstPtr & odomMsg, ros::Ti
 		else if(!ignoreFrame)
 		{
 			previousStamp_ = stamp;
+			previousPose_ = odom;
 		}
 
 		return true;
@@ -1133,7 +1714,10 @@ bool CoreWrapper::odomTFUpdate(const ros::Time & stamp)
 		if(!lastPose_.isIdentity() && odom.isIdentity())
 		{
 			UWARN("Odometry is reset (identity pose detected). Increment map id!");
+			memoryMutex_.lock();
 			rtabmap_.triggerNewMap();
+			++graphRevision_;
+			memoryMutex_.unlock();
 			covariance_ = cv::Mat();
 		}
 
@@ -1147,13 +1731,12 @@ bool CoreWrapper::odomTFUpdate(const ros::Time & stamp)
 		{
 			ROS_WARN("A null stamp has been detected in the input topics. Make sure the stamp in all input topics is set.");
 			ignoreFrame = true;
+			++framesDropped_;
 		}
-		if(rate_>0.0f)
+		else if(isFrameThrottled(stamp, odom))
 		{
-			if(previousStamp_.toSec() > 0.0 && stamp.toSec() > previousStamp_.toSec() && stamp - previousStamp_ < ros::Duration(1.0f/rate_))
-			{
-				ignoreFrame = true;
-			}
+			ignoreFrame = true;
+			++framesThrottled_;
 		}
 		if(ignoreFrame)
 		{
@@ -1169,6 +1752,7 @@ bool CoreWrapper::odomTFUpdate(const ros::Time & stamp)
 		else if(!ignoreFrame)
 		{
 			previousStamp_ = stamp;
+			previousPose_ = odom;
 		}
 
 		return true;
@@ -1176,6 +1760,66 @@ bool CoreWrapper::odomTFUpdate(const ros::Time & stamp)
 	return false;
 }
 
+bool CoreWrapper::isFrameThrottled(const ros::Time & stamp, const Transform & pose)
+{
+	if(previousStamp_.toSec() > 0.0 && stamp.toSec() > previousStamp_.toSec())
+	{
+		double interval = (stamp - previousStamp_).toSec();
+		if(adaptiveRate_)
+		{
+			if(adaptiveRateMax_ > 0.0f && interval < 1.0/adaptiveRateMax_)
+			{
+				return true;
+			}
+			if(adaptiveRateCurrent_ > 0.0f && interval < 1.0/adaptiveRateCurrent_)
+			{
+				// Don't skip frames on which we moved a lot since the last processed one
+				if(!pose.isNull() && !previousPose_.isNull() &&
+				   (adaptiveRateLinearMotion_ > 0.0f || adaptiveRateAngularMotion_ > 0.0f))
+				{
+					float x,y,z,roll,pitch,yaw;
+					(previousPose_.inverse() * pose).getTranslationAndEulerAngles(x,y,z,roll,pitch,yaw);
+					if((adaptiveRateLinearMotion_ > 0.0f && sqrt(x*x+y*y+z*z) >= adaptiveRateLinearMotion_) ||
+					   (adaptiveRateAngularMotion_ > 0.0f && std::max(fabs(roll), std::max(fabs(pitch), fabs(yaw))) >= adaptiveRateAngularMotion_))
+					{
+						return false;
+					}
+				}
+				return true;
+			}
+		}
+		else if(rate_>0.0f && stamp - previousStamp_ < ros::Duration(1.0f/rate_))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void CoreWrapper::updateAdaptiveRate(double processingTime)
+{
+	if(adaptiveRateCurrent_ == 0.0f)
+	{
+		adaptiveRateCurrent_ = rate_>0.0f?rate_:1.0f;
+	}
+	if(processingTime > 0.0)
+	{
+		// smooth the processing time to avoid oscillating on spikes
+		adaptiveRateProcessingTime_ = adaptiveRateProcessingTime_ > 0.0?
+				0.8*adaptiveRateProcessingTime_ + 0.2*processingTime:
+				processingTime;
+		adaptiveRateCurrent_ = adaptiveRateBudget_ / adaptiveRateProcessingTime_;
+	}
+	if(adaptiveRateMax_ > 0.0f && adaptiveRateCurrent_ > adaptiveRateMax_)
+	{
+		adaptiveRateCurrent_ = adaptiveRateMax_;
+	}
+	if(adaptiveRateMin_ > 0.0f && adaptiveRateCurrent_ < adaptiveRateMin_)
+	{
+		adaptiveRateCurrent_ = adaptiveRateMin_;
+	}
+}
+
 void CoreWrapper::commonMultiCameraCallback(
 		const nav_msgs::OdometryConstPtr & odomMsg,
 		const rtabmap_msgs::UserDataConstPtr & userDataMsg,
@@ -1404,7 +2048,8 @@ void CoreWrapper::commonMultiCameraCallbackImpl(
 				tfListener_,
 				waitForTransform_?waitForTransformDuration_:0,
 				// backward compatibility, project 2D scan in /base_link frame
-				rtabmap_.getMemory() && uStrNumCmp(rtabmap_.getMemory()->getDatabaseVersion(), "0.11.10") < 0))
+				rtabmap_.getMemory() && uStrNumCmp(rtabmap_.getMemory()->getDatabaseVersion(), "0.11.10") < 0,
+				scanQuantization_))
 		{
 			NODELET_ERROR("Could not convert laser scan msg! Aborting rtabmap update...");
 			return;
@@ -1422,7 +2067,8 @@ void CoreWrapper::commonMultiCameraCallbackImpl(
 				waitForTransform_?waitForTransformDuration_:0,
 				scanCloudMaxPoints_,
 				0,
-				scanCloudIs2d_))
+				scanCloudIs2d_,
+				scanQuantization_))
 		{
 			NODELET_ERROR("Could not convert 3d laser scan msg! Aborting rtabmap update...");
 			return;
@@ -1548,6 +2194,87 @@ void CoreWrapper::commonMultiCameraCallbackImpl(
 	covariance_ = cv::Mat();
 }
 
+class CoreWrapper::OdomSensorDataCallback : public ros::CallbackInterface
+{
+public:
+	OdomSensorDataCallback(CoreWrapper * wrapper) : wrapper_(wrapper) {}
+	virtual CallResult call()
+	{
+		wrapper_->processOdomSensorData();
+		return Success;
+	}
+private:
+	CoreWrapper * wrapper_;
+};
+
+void CoreWrapper::odomSensorDataCallback(
+		const SensorData & data,
+		const nav_msgs::Odometry & odomMsg,
+		const OdometryInfo & odomInfo)
+{
+	// Called from the odometry thread, just keep the latest data and
+	// let the nodelet's callback queue process it like other callbacks.
+	{
+		boost::mutex::scoped_lock lock(odomSensorDataMutex_);
+		bool queued = odomSensorDataPending_;
+		odomSensorData_ = data;
+		odomSensorDataOdom_ = odomMsg;
+		odomSensorDataInfo_ = odomInfo;
+		odomSensorDataPending_ = true;
+		if(queued)
+		{
+			return;
+		}
+	}
+	getNodeHandle().getCallbackQueue()->addCallback(ros::CallbackInterfacePtr(new OdomSensorDataCallback(this)), (uint64_t)this);
+}
+
+void CoreWrapper::processOdomSensorData()
+{
+	callbackCalled();
+	UTimer timerConversion;
+	SensorData data;
+	nav_msgs::OdometryPtr odomMsg(new nav_msgs::Odometry);
+	OdometryInfo odomInfo;
+	{
+		boost::mutex::scoped_lock lock(odomSensorDataMutex_);
+		if(!odomSensorDataPending_)
+		{
+			return;
+		}
+		data = odomSensorData_;
+		*odomMsg = odomSensorDataOdom_;
+		odomInfo = odomSensorDataInfo_;
+		odomSensorData_ = SensorData();
+		odomSensorDataPending_ = false;
+	}
+
+	if(!odomUpdate(odomMsg, odomMsg->header.stamp))
+	{
+		return;
+	}
+
+	{
+		UScopeMutex lock(userDataMutex_);
+		if(!userData_.empty())
+		{
+			data.setUserData(userData_);
+			userData_ = cv::Mat();
+		}
+	}
+	data.setStamp(rtabmap_conversions::timestampFromROS(lastPoseStamp_));
+
+	process(lastPoseStamp_,
+			data,
+			lastPose_,
+			lastPoseVelocity_,
+			odomMsg->header.frame_id,
+			covariance_,
+			odomInfo,
+			timerConversion.ticks());
+	covariance_ = cv::Mat();
+}
+
 void CoreWrapper::commonLaserScanCallback(
 		const nav_msgs::OdometryConstPtr & odomMsg,
 		const rtabmap_msgs::UserDataConstPtr & userDataMsg,
@@ -1611,7 +2338,8 @@ void CoreWrapper::commonLaserScanCallback(
 				tfListener_,
 				waitForTransform_?waitForTransformDuration_:0,
 				// backward compatibility, project 2D scan in /base_link frame
-				rtabmap_.getMemory() && uStrNumCmp(rtabmap_.getMemory()->getDatabaseVersion(), "0.11.10") < 0))
+				rtabmap_.getMemory() && uStrNumCmp(rtabmap_.getMemory()->getDatabaseVersion(), "0.11.10") < 0,
+				scanQuantization_))
 		{
 			NODELET_ERROR("Could not convert laser scan msg! Aborting rtabmap update...");
 			return;
@@ -1629,7 +2357,8 @@ void CoreWrapper::commonLaserScanCallback(
 				waitForTransform_?waitForTransformDuration_:0,
 				scanCloudMaxPoints_,
 				0,
-				scanCloudIs2d_))
+				scanCloudIs2d_,
+				scanQuantization_))
 		{
 			NODELET_ERROR("Could not convert 3d laser scan msg! Aborting rtabmap update...");
 			return;
@@ -1745,120 +2474,169 @@ void CoreWrapper::commonOdomCallback(
 	covariance_ = cv::Mat();
 }
 
-void CoreWrapper::process(
-		const ros::Time & stamp,
-		SensorData & data,
-		const Transform & odom,
-		const std::vector<float> & odomVelocityIn,
-		const std::string & odomFrameId,
-		const cv::Mat & odomCovariance,
-		const OdometryInfo & odomInfo,
-		double timeMsgConversion)
+static bool interOdomStampLess(const std::pair<nav_msgs::Odometry, rtabmap_msgs::OdomInfo> & odom, const ros::Time & stamp)
+{
+	return odom.first.header.stamp < stamp;
+}
+
+void CoreWrapper::processIntermediateNode(
+		const ros::Time & stamp,
+		const Transform & interOdom,
+		const nav_msgs::Odometry & odomMsg,
+		const rtabmap_msgs::OdomInfo & odomInfoMsg)
+{
+	if(interOdom.isNull())
+	{
+		return;
+	}
+
+	cv::Mat covariance;
+	double variance = odomMsg.twist.covariance[0];
+	if(variance == BAD_COVARIANCE || variance <= 0.0f)
+	{
+		//use the one of the pose
+		covariance = cv::Mat(6,6,CV_64FC1, (void*)odomMsg.pose.covariance.data()).clone();
+		covariance /= 2.0;
+	}
+	else
+	{
+		covariance = cv::Mat(6,6,CV_64FC1, (void*)odomMsg.twist.covariance.data()).clone();
+	}
+	if(!uIsFinite(covariance.at<double>(0,0)) || covariance.at<double>(0,0)<=0.0f)
+	{
+		covariance = cv::Mat::eye(6,6,CV_64FC1);
+		if(odomDefaultLinVariance_ > 0.0f)
+		{
+			covariance.at<double>(0,0) = odomDefaultLinVariance_;
+			covariance.at<double>(1,1) = odomDefaultLinVariance_;
+			covariance.at<double>(2,2) = odomDefaultLinVariance_;
+		}
+		if(odomDefaultAngVariance_ > 0.0f)
+		{
+			covariance.at<double>(3,3) = odomDefaultAngVariance_;
+			covariance.at<double>(4,4) = odomDefaultAngVariance_;
+			covariance.at<double>(5,5) = odomDefaultAngVariance_;
+		}
+	}
+	else if(twoDMapping_)
+	{
+		// If 2d mapping, make sure all diagonal values of the covariance that even not used are not null.
+		covariance.at<double>(2,2) = uIsFinite(covariance.at<double>(2,2)) && covariance.at<double>(2,2)!=0?covariance.at<double>(2,2):1;
+		covariance.at<double>(3,3) = uIsFinite(covariance.at<double>(3,3)) && covariance.at<double>(3,3)!=0?covariance.at<double>(3,3):1;
+		covariance.at<double>(4,4) = uIsFinite(covariance.at<double>(4,4)) && covariance.at<double>(4,4)!=0?covariance.at<double>(4,4):1;
+	}
+
+	SensorData interData(cv::Mat(), cv::Mat(), rtabmap::CameraModel(), -1, rtabmap_conversions::timestampFromROS(stamp));
+	Transform gt;
+	if(!groundTruthFrameId_.empty())
+	{
+		gt = rtabmap_conversions::getTransform(groundTruthFrameId_, groundTruthBaseFrameId_, stamp, tfListener_, waitForTransform_?waitForTransformDuration_:0.0);
+	}
+	interData.setGroundTruth(gt);
+
+	std::map<std::string, float> externalStats;
+	std::vector<float> odomVelocity;
+	if(odomInfoMsg.timeEstimation != 0.0f)
+	{
+		OdometryInfo info = rtabmap_conversions::odomInfoFromROS(odomInfoMsg, true);
+		externalStats = rtabmap_conversions::odomInfoToStatistics(info);
+
+		if(info.interval>0.0)
+		{
+			odomVelocity.resize(6);
+			float x,y,z,roll,pitch,yaw;
+			info.transform.getTranslationAndEulerAngles(x,y,z,roll,pitch,yaw);
+			odomVelocity[0] = x/info.interval;
+			odomVelocity[1] = y/info.interval;
+			odomVelocity[2] = z/info.interval;
+			odomVelocity[3] = roll/info.interval;
+			odomVelocity[4] = pitch/info.interval;
+			odomVelocity[5] = yaw/info.interval;
+		}
+	}
+	if(odomVelocity.empty())
+	{
+		odomVelocity.resize(6);
+		odomVelocity[0] = odomMsg.twist.twist.linear.x;
+		odomVelocity[1] = odomMsg.twist.twist.linear.y;
+		odomVelocity[2] = odomMsg.twist.twist.linear.z;
+		odomVelocity[3] = odomMsg.twist.twist.angular.x;
+		odomVelocity[4] = odomMsg.twist.twist.angular.y;
+		odomVelocity[5] = odomMsg.twist.twist.angular.z;
+	}
+
+	boost::mutex::scoped_lock memoryLock(memoryMutex_);
+	rtabmap_.process(interData, interOdom, covariance, odomVelocity, externalStats);
+	updateGraphRevision();
+}
+
+void CoreWrapper::process(
+		const ros::Time & stamp,
+		SensorData & data,
+		const Transform & odom,
+		const std::vector<float> & odomVelocityIn,
+		const std::string & odomFrameId,
+		const cv::Mat & odomCovariance,
+		const OdometryInfo & odomInfo,
+		double timeMsgConversion)
 {
 	UTimer timer;
 	if(rtabmap_.isIDsGenerated() || data.id() > 0)
 	{
 		// Add intermediate nodes?
-		for(std::list<std::pair<nav_msgs::Odometry, rtabmap_msgs::OdomInfo> >::iterator iter=interOdoms_.begin(); iter!=interOdoms_.end();)
+		if(!interOdoms_.empty())
 		{
-			if(iter->first.header.stamp < lastPoseStamp_)
+			// messages are ordered by stamp, find those received before the current frame
+			std::deque<std::pair<nav_msgs::Odometry, rtabmap_msgs::OdomInfo> >::iterator end =
+					std::lower_bound(interOdoms_.begin(), interOdoms_.end(), lastPoseStamp_, interOdomStampLess);
+			// add intermediate poses only if the current local graph is not empty
+			if(end != interOdoms_.begin() && !rtabmap_.getLocalOptimizedPoses().empty())
 			{
-				Transform interOdom;
-				if(!rtabmap_.getLocalOptimizedPoses().empty())
-				{
-					// add intermediate poses only if the current local graph is not empty
-					interOdom = rtabmap_conversions::transformFromPoseMsg(iter->first.pose.pose);
-				}
-				if(!interOdom.isNull())
+				if(interOdomRate_ <= 0.0)
 				{
-					cv::Mat covariance;
-					double variance = iter->first.twist.covariance[0];
-					if(variance == BAD_COVARIANCE || variance <= 0.0f)
+					for(std::deque<std::pair<nav_msgs::Odometry, rtabmap_msgs::OdomInfo> >::iterator iter=interOdoms_.begin(); iter!=end; ++iter)
 					{
-						//use the one of the pose
-						covariance = cv::Mat(6,6,CV_64FC1, (void*)iter->first.pose.covariance.data()).clone();
-						covariance /= 2.0;
+						processIntermediateNode(iter->first.header.stamp, rtabmap_conversions::transformFromPoseMsg(iter->first.pose.pose), iter->first, iter->second);
 					}
-					else
-					{
-						covariance = cv::Mat(6,6,CV_64FC1, (void*)iter->first.twist.covariance.data()).clone();
-					}
-					if(!uIsFinite(covariance.at<double>(0,0)) || covariance.at<double>(0,0)<=0.0f)
+				}
+				else
+				{
+					// Resample the odometry at fixed rate, interpolating between the closest messages
+					ros::Duration period(1.0/interOdomRate_);
+					ros::Time next = interOdomLastStamp_.isZero()?interOdoms_.begin()->first.header.stamp:interOdomLastStamp_ + period;
+					for(std::deque<std::pair<nav_msgs::Odometry, rtabmap_msgs::OdomInfo> >::iterator iter=interOdoms_.begin(); iter!=end; ++iter)
 					{
-						covariance = cv::Mat::eye(6,6,CV_64FC1);
-						if(odomDefaultLinVariance_ > 0.0f)
-						{
-							covariance.at<double>(0,0) = odomDefaultLinVariance_;
-							covariance.at<double>(1,1) = odomDefaultLinVariance_;
-							covariance.at<double>(2,2) = odomDefaultLinVariance_;
-						}
-						if(odomDefaultAngVariance_ > 0.0f)
+						const ros::Time & stamp = iter->first.header.stamp;
+						if(iter == interOdoms_.begin() && next < stamp)
 						{
-							covariance.at<double>(3,3) = odomDefaultAngVariance_;
-							covariance.at<double>(4,4) = odomDefaultAngVariance_;
-							covariance.at<double>(5,5) = odomDefaultAngVariance_;
+							// cannot interpolate before the first message
+							next = stamp;
 						}
-					}
-					else if(twoDMapping_)
-					{
-						// If 2d mapping, make sure all diagonal values of the covariance that even not used are not null.
-						covariance.at<double>(2,2) = uIsFinite(covariance.at<double>(2,2)) && covariance.at<double>(2,2)!=0?covariance.at<double>(2,2):1;
-						covariance.at<double>(3,3) = uIsFinite(covariance.at<double>(3,3)) && covariance.at<double>(3,3)!=0?covariance.at<double>(3,3):1;
-						covariance.at<double>(4,4) = uIsFinite(covariance.at<double>(4,4)) && covariance.at<double>(4,4)!=0?covariance.at<double>(4,4):1;
-					}
-
-					SensorData interData(cv::Mat(), cv::Mat(), rtabmap::CameraModel(), -1, rtabmap_conversions::timestampFromROS(iter->first.header.stamp));
-					Transform gt;
-					if(!groundTruthFrameId_.empty())
-					{
-						gt = rtabmap_conversions::getTransform(groundTruthFrameId_, groundTruthBaseFrameId_, iter->first.header.stamp, tfListener_, waitForTransform_?waitForTransformDuration_:0.0);
-					}
-					interData.setGroundTruth(gt);
-
-					std::map<std::string, float> externalStats;
-					std::vector<float> odomVelocity;
-					if(iter->second.timeEstimation != 0.0f)
-					{
-						OdometryInfo info = rtabmap_conversions::odomInfoFromROS(iter->second, true);
-						externalStats = rtabmap_conversions::odomInfoToStatistics(info);
-
-						if(info.interval>0.0)
+						while(next <= stamp)
 						{
-							odomVelocity.resize(6);
-							float x,y,z,roll,pitch,yaw;
-							info.transform.getTranslationAndEulerAngles(x,y,z,roll,pitch,yaw);
-							odomVelocity[0] = x/info.interval;
-							odomVelocity[1] = y/info.interval;
-							odomVelocity[2] = z/info.interval;
-							odomVelocity[3] = roll/info.interval;
-							odomVelocity[4] = pitch/info.interval;
-							odomVelocity[5] = yaw/info.interval;
+							Transform interOdom = rtabmap_conversions::transformFromPoseMsg(iter->first.pose.pose);
+							if(next < stamp)
+							{
+								std::deque<std::pair<nav_msgs::Odometry, rtabmap_msgs::OdomInfo> >::iterator previous = iter-1;
+								const ros::Time & previousStamp = previous->first.header.stamp;
+								Transform previousOdom = rtabmap_conversions::transformFromPoseMsg(previous->first.pose.pose);
+								if(!previousOdom.isNull() && !interOdom.isNull() && stamp > previousStamp)
+								{
+									interOdom = previousOdom.interpolate(float((next-previousStamp).toSec()/(stamp-previousStamp).toSec()), interOdom);
+								}
+							}
+							processIntermediateNode(next, interOdom, iter->first, iter->second);
+							interOdomLastStamp_ = next;
+							next += period;
 						}
 					}
-					if(odomVelocity.empty())
-					{
-						odomVelocity.resize(6);
-						odomVelocity[0] = iter->first.twist.twist.linear.x;
-						odomVelocity[1] = iter->first.twist.twist.linear.y;
-						odomVelocity[2] = iter->first.twist.twist.linear.z;
-						odomVelocity[3] = iter->first.twist.twist.angular.x;
-						odomVelocity[4] = iter->first.twist.twist.angular.y;
-						odomVelocity[5] = iter->first.twist.twist.angular.z;
-					}
-
-					rtabmap_.process(interData, interOdom, covariance, odomVelocity, externalStats);
 				}
-				interOdoms_.erase(iter++);
 			}
-			else if(iter->first.header.stamp == lastPoseStamp_)
+			if(end != interOdoms_.end() && end->first.header.stamp == lastPoseStamp_)
 			{
-				interOdoms_.erase(iter++);
-				break;
-			}
-			else
-			{
-				break;
+				++end;
 			}
+			interOdoms_.erase(interOdoms_.begin(), end);
 		}
 
 		//Add async stuff
@@ -1869,26 +2647,38 @@ void CoreWrapper::process(
 		}
 		data.setGroundTruth(groundTruthPose);
 
+		geometry_msgs::PoseWithCovarianceStamped globalPoseMsg;
+		rtabmap::GPS gps;
+		std::map<int, std::pair<geometry_msgs::PoseWithCovarianceStamped, float> > tags;
+		{
+			boost::mutex::scoped_lock lock(asyncInputsMutex_);
+			globalPoseMsg = globalPose_;
+			globalPose_.header.stamp = ros::Time(0);
+			gps = gps_;
+			gps_ = rtabmap::GPS();
+			tags.swap(tags_);
+		}
+
 		//global pose
-		if(!globalPose_.header.stamp.isZero())
+		if(!globalPoseMsg.header.stamp.isZero())
 		{
 			// assume sensor is fixed
 			Transform sensorToBase = rtabmap_conversions::getTransform(
-					globalPose_.header.frame_id,
+					globalPoseMsg.header.frame_id,
 					frameId_,
 					lastPoseStamp_,
 					tfListener_,
 					waitForTransform_?waitForTransformDuration_:0.0);
 			if(!sensorToBase.isNull())
 			{
-				Transform globalPose = rtabmap_conversions::transformFromPoseMsg(globalPose_.pose.pose);
+				Transform globalPose = rtabmap_conversions::transformFromPoseMsg(globalPoseMsg.pose.pose);
 				globalPose *= sensorToBase; // transform global pose from sensor frame to robot base frame
 
 				// Correction of the global pose accounting the odometry movement since we received it
 				Transform correction = rtabmap_conversions::getTransform(
 						frameId_,
 						odomFrameId,
-						globalPose_.header.stamp,
+						globalPoseMsg.header.stamp,
 						lastPoseStamp_,
 						tfListener_,
 						waitForTransform_?waitForTransformDuration_:0.0);
@@ -1902,21 +2692,32 @@ void CoreWrapper::process(
 							"If odometry is small since it received the global pose and "
 							"covariance is large, this should not be a problem.");
 				}
-				cv::Mat globalPoseCovariance = cv::Mat(6,6, CV_64FC1, (void*)globalPose_.pose.covariance.data()).clone();
+				cv::Mat globalPoseCovariance = cv::Mat(6,6, CV_64FC1, (void*)globalPoseMsg.pose.covariance.data()).clone();
 				data.setGlobalPose(globalPose, globalPoseCovariance);
 			}
 		}
-		globalPose_.header.stamp = ros::Time(0);
 
-		if(gps_.stamp() > 0.0)
+		if(gps.stamp() > 0.0)
 		{
-			data.setGPS(gps_);
+			data.setGPS(gps);
+		}
+
+		// environmental sensors received since the previous node
+		if(envSensorAsyncSub_)
+		{
+			EnvSensors envSensors = takeEnvSensors(data.stamp());
+			if(!envSensors.empty())
+			{
+				// sensors already in the data are kept
+				EnvSensors merged = data.envSensors();
+				merged.insert(envSensors.begin(), envSensors.end());
+				data.setEnvSensors(merged);
+			}
 		}
-		gps_ = rtabmap::GPS();
 
 		//tag detections
 		Landmarks landmarks = rtabmap_conversions::landmarksFromROS(
-				tags_,
+				tags,
 				frameId_,
 				odomFrameId,
 				lastPoseStamp_,
@@ -1924,23 +2725,34 @@ void CoreWrapper::process(
 				waitForTransform_?waitForTransformDuration_:0,
 				landmarkDefaultLinVariance_,
 				landmarkDefaultAngVariance_);
-		tags_.clear();
 		if(!landmarks.empty())
 		{
 			data.setLandmarks(landmarks);
 		}
 
 		// IMU
-		if(!imus_.empty())
+		Transform imuOrientation;
+		std::string imuFrameId;
+		int imuBufferSize = 0;
+		{
+			boost::mutex::scoped_lock lock(asyncInputsMutex_);
+			imuBufferSize = (int)imus_.size();
+			if(imuBufferSize)
+			{
+				imuOrientation = getImuTransform(imus_, data.stamp());
+				imuFrameId = imuFrameId_;
+			}
+		}
+		if(imuBufferSize)
 		{
-			Transform t = Transform::getTransform(imus_, data.stamp());
+			Transform t = imuOrientation;
 			if(!t.isNull())
 			{
 				// get local transform
 				rtabmap::Transform localTransform;
-				if(frameId_.compare(imuFrameId_) != 0)
+				if(frameId_.compare(imuFrameId) != 0)
 				{
-					localTransform = rtabmap_conversions::getTransform(frameId_, imuFrameId_, ros::Time(data.stamp()), tfListener_, waitForTransform_?waitForTransformDuration_:0.0);
+					localTransform = rtabmap_conversions::getTransform(frameId_, imuFrameId, ros::Time(data.stamp()), tfListener_, waitForTransform_?waitForTransformDuration_:0.0);
 				}
 				else
 				{
@@ -1960,7 +2772,7 @@ void CoreWrapper::process(
 			{
 				ROS_WARN("We are receiving imu data (buffer=%d), but cannot interpolate "
 						"imu transform at time %f. IMU won't be added to graph.",
-						(int)imus_.size(), data.stamp());
+						imuBufferSize, data.stamp());
 			}
 		}
 
@@ -2016,6 +2828,26 @@ void CoreWrapper::process(
 		{
 			odomVelocity = odomVelocityIn;
 		}
+		Transform relocalizationPrior;
+		{
+			boost::mutex::scoped_lock memoryLock(memoryMutex_);
+			if(relocalizationPending_)
+			{
+				relocalizationPrior = relocalizationPrior_;
+				relocalizationPending_ = false;
+			}
+		}
+		if(!relocalizationPrior.isNull())
+		{
+			Transform pose = relocalize(data, relocalizationPrior);
+			if(!pose.isNull())
+			{
+				// pose of this frame, the map correction is computed from it
+				boost::mutex::scoped_lock memoryLock(memoryMutex_);
+				rtabmap_.setInitialPose(pose);
+				++graphRevision_;
+			}
+		}
 		if(rtabmapROSStats_.size())
 		{
 			externalStats.insert(rtabmapROSStats_.begin(), rtabmapROSStats_.end());
@@ -2023,7 +2855,23 @@ void CoreWrapper::process(
 		}
 
 		timeMsgConversion += timer.ticks();
-		if(rtabmap_.process(data, odom, covariance, odomVelocity, externalStats))
+		// Services and background post-processing jobs can modify rtabmap
+		// and the maps between two frames: keep memory locked until the
+		// results of this frame are published, and the maps too if they
+		// are updated in this thread (same lock order than the services).
+		boost::mutex::scoped_lock mapsLock(mapsMutex_, boost::defer_lock);
+		if(!mapsThread_)
+		{
+			mapsLock.lock();
+		}
+		boost::mutex::scoped_lock memoryLock(memoryMutex_);
+		bool processed = rtabmap_.process(data, odom, covariance, odomVelocity, externalStats);
+		updateGraphRevision();
+		if(processed && globalDescriptorIndexSynced_)
+		{
+			updateGlobalDescriptorIndex();
+		}
+		if(processed)
 		{
 			timeRtabmap = timer.ticks();
 			mapToOdomMutex_.lock();
@@ -2038,6 +2886,7 @@ void CoreWrapper::process(
 			}
 
 			odomFrameId_ = odomFrameId;
+			setMapToOdomTF(mapToOdom_, odomFrameId_);
 			mapToOdomMutex_.unlock();
 
 			if(data.id() < 0)
@@ -2094,6 +2943,9 @@ void CoreWrapper::process(
 					filteredPoses.insert(std::make_pair(0, mapToOdom_*odom));
 				}
 
+				// Nodes kept around the robot can change without the graph
+				// changing, so the maps cannot rely on the graph revision.
+				unsigned long mapsGraphRevision = (mappingMaxNodes_ > 0 || mappingAltitudeDelta_>0.0)?0:graphRevision_;
 				if((mappingMaxNodes_ > 0 || mappingAltitudeDelta_>0.0) && filteredPoses.size()>1)
 				{
 					std::map<int, Transform> nearestPoses = filterNodesToAssemble(filteredPoses, mapToOdom_*odom);
@@ -2120,17 +2972,39 @@ void CoreWrapper::process(
 					filteredPoses = nearestPoses;
 				}
 
-				// Update maps
-				filteredPoses = mapsManager_.updateMapCaches(
-						filteredPoses,
-						rtabmap_.getMemory(),
-						false,
-						false,
-						tmpSignature);
+				if(mapsThread_)
+				{
+					// Latest request wins, the maps thread will
+					// update/publish maps with the newest poses.
+					boost::mutex::scoped_lock lock(mapsRequestMutex_);
+					if(mapsRequestPending_)
+					{
+						++mapsRequestsDropped_;
+					}
+					mapsRequestPoses_ = filteredPoses;
+					mapsRequestSignatures_ = tmpSignature;
+					mapsRequestStamp_ = stamp;
+					mapsRequestGraphRevision_ = mapsGraphRevision;
+					mapsRequestPending_ = true;
+					mapsRequestCondition_.notify_one();
+					timeUpdateMaps = timer.ticks();
+				}
+				else
+				{
+					// Update maps
+					const std::map<int, Transform> & mapPoses = mapsManager_.updateMapCaches(
+							filteredPoses,
+							rtabmap_.getMemory(),
+							false,
+							false,
+							tmpSignature,
+							0,
+							mapsGraphRevision);
 
-				timeUpdateMaps = timer.ticks();
+					timeUpdateMaps = timer.ticks();
 
-				mapsManager_.publishMaps(filteredPoses, stamp, mapFrameId_);
+					mapsManager_.publishMaps(mapPoses, stamp, mapFrameId_);
+				}
 
 				// Publish local graph, info
 				this->publishStats(stamp);
@@ -2166,6 +3040,8 @@ void CoreWrapper::process(
 							}
 							currentMetricGoal_.setNull();
 							lastPublishedMetricGoal_.setNull();
+							lastPublishedLocalPath_.clear();
+							lastPublishedGlobalPath_.clear();
 							goalFrameId_.clear();
 							latestNodeWasReached_ = false;
 						}
@@ -2203,6 +3079,8 @@ void CoreWrapper::process(
 
 							// publish global path
 							publishGlobalPath(stamp);
+
+							prefetchPathNodes();
 						}
 						else
 						{
@@ -2217,6 +3095,8 @@ void CoreWrapper::process(
 							}
 							currentMetricGoal_.setNull();
 							lastPublishedMetricGoal_.setNull();
+							lastPublishedLocalPath_.clear();
+							lastPublishedGlobalPath_.clear();
 							goalFrameId_.clear();
 							latestNodeWasReached_ = false;
 						}
@@ -2230,9 +3110,15 @@ void CoreWrapper::process(
 		{
 			timeRtabmap = timer.ticks();
 		}
+		if(adaptiveRate_)
+		{
+			updateAdaptiveRate(timeRtabmap+timeUpdateMaps);
+			rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/AdaptiveRate/Hz"), adaptiveRateCurrent_));
+		}
+		float rate = adaptiveRate_?adaptiveRateCurrent_:rate_;
 		NODELET_INFO("rtabmap (%d): Rate=%.2fs, Limit=%.3fs, Conversion=%.4fs, RTAB-Map=%.4fs, Maps update=%.4fs pub=%.4fs (local map=%d, WM=%d)",
 				rtabmap_.getLastLocationId(),
-				rate_>0?1.0f/rate_:0,
+				rate>0?1.0f/rate:0,
 				rtabmap_.getTimeThreshold()/1000.0f,
 				timeMsgConversion,
 				timeRtabmap,
@@ -2241,11 +3127,66 @@ void CoreWrapper::process(
 				(int)rtabmap_.getLocalOptimizedPoses().size(),
 				rtabmap_.getWMSize()+rtabmap_.getSTMSize());
 		rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/HasSubscribers/"), mapsManager_.hasSubscribers()?1:0));
+		memoryLock.unlock();
+		if(mapsLock.owns_lock())
+		{
+			mapsLock.unlock();
+		}
 		rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/TimeMsgConversion/ms"), timeMsgConversion*1000.0f));
 		rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/TimeRtabmap/ms"), timeRtabmap*1000.0f));
 		rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/TimeUpdatingMaps/ms"), timeUpdateMaps*1000.0f));
 		rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/TimePublishing/ms"), timePublishMaps*1000.0f));
 		rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/TimeTotal/ms"), (timeMsgConversion+timeRtabmap+timeUpdateMaps+timePublishMaps)*1000.0f));
+		latencyMsgConversion_.add(timeMsgConversion);
+		latencyRtabmap_.add(timeRtabmap);
+		latencyUpdateMaps_.add(timeUpdateMaps);
+		latencyPublishMaps_.add(timePublishMaps);
+		latencyTotal_.add(timeMsgConversion+timeRtabmap+timeUpdateMaps+timePublishMaps);
+		latencyMsgConversion_.exportPercentiles("RtabmapROS", "TimeMsgConversion", "ms", rtabmapROSStats_, 1000.0f);
+		latencyRtabmap_.exportPercentiles("RtabmapROS", "TimeRtabmap", "ms", rtabmapROSStats_, 1000.0f);
+		latencyUpdateMaps_.exportPercentiles("RtabmapROS", "TimeUpdatingMaps", "ms", rtabmapROSStats_, 1000.0f);
+		latencyPublishMaps_.exportPercentiles("RtabmapROS", "TimePublishing", "ms", rtabmapROSStats_, 1000.0f);
+		latencyTotal_.exportPercentiles("RtabmapROS", "TimeTotal", "ms", rtabmapROSStats_, 1000.0f);
+		if(memoryStats_ || memoryBudgetMaps_ > 0)
+		{
+			updateMemoryStats();
+		}
+		rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/FramesThrottled/"), framesThrottled_));
+		rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/FramesDropped/"), framesDropped_));
+		rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/SyncDropped/"), syncDropped()));
+		if(nodeDataCache_.enabled())
+		{
+			unsigned long hits, misses;
+			nodeDataCache_.stats(hits, misses);
+			rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/NodeDataCache/MB"), float(nodeDataCache_.bytes())/(1024.0f*1024.0f)));
+			rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/NodeDataCache/nodes"), nodeDataCache_.size()));
+			rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/NodeDataCache/hits"), hits));
+			rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/NodeDataCache/misses"), misses));
+		}
+		if(mapsThread_)
+		{
+			boost::mutex::scoped_lock lock(mapsRequestMutex_);
+			rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/MapsRequestPending/"), mapsRequestPending_?1:0));
+			rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/MapsDropped/"), mapsRequestsDropped_));
+			rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/TimeMapsThreadUpdate/ms"), mapsLastUpdateTime_*1000.0f));
+			rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/TimeMapsThreadPublishing/ms"), mapsLastPublishTime_*1000.0f));
+		}
+		if(pathPrefetchThread_)
+		{
+			boost::mutex::scoped_lock lock(pathPrefetchMutex_);
+			rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/PathPrefetchQueueSize/"), pathPrefetchRequest_.size()));
+			rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/PathPrefetchLoaded/"), pathPrefetchLoaded_));
+		}
+		if(transformThread_)
+		{
+			// TF publishing stats since last update
+			boost::mutex::scoped_lock lock(tfStatsMutex_);
+			rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/TFPublishRate/Hz"), tfStatsTotalTime_>0.0?float(tfStatsCount_)/tfStatsTotalTime_:0.0f));
+			rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/TFMaxInterval/ms"), tfStatsMaxInterval_*1000.0f));
+			tfStatsCount_ = 0;
+			tfStatsTotalTime_ = 0.0;
+			tfStatsMaxInterval_ = 0.0;
+		}
 	}
 	else if(!rtabmap_.isIDsGenerated())
 	{
@@ -2257,6 +3198,58 @@ void CoreWrapper::process(
 	}
 }
 
+void CoreWrapper::updateMemoryStats()
+{
+	// Maps may be updated by the maps thread, don't wait for it
+	boost::unique_lock<boost::mutex> mapsLock(mapsMutex_, boost::try_to_lock);
+	if(mapsLock.owns_lock())
+	{
+		if(memoryBudgetMaps_ > 0 && mapsManager_.trimCaches((unsigned long)memoryBudgetMaps_*1024*1024) > 0)
+		{
+			++mapsCacheEvictions_;
+		}
+		if(memoryStats_)
+		{
+			std::map<std::string, unsigned long> usage = mapsManager_.getMemoryUsage();
+			for(std::map<std::string, unsigned long>::iterator iter=usage.begin(); iter!=usage.end(); ++iter)
+			{
+				rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/Memory/Maps") + iter->first + "/MB", float(iter->second)/(1024.0f*1024.0f)));
+			}
+		}
+	}
+	rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/Memory/MapsEvictions/"), mapsCacheEvictions_));
+	if(!memoryStats_)
+	{
+		return;
+	}
+
+	if(rtabmap_.getMemory())
+	{
+		rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/Memory/Signatures/MB"), float(rtabmap_.getMemory()->getMemoryUsed())/(1024.0f*1024.0f)));
+	}
+
+	size_t bytes = 0;
+	for(std::deque<std::pair<nav_msgs::Odometry, rtabmap_msgs::OdomInfo> >::const_iterator iter=interOdoms_.begin(); iter!=interOdoms_.end(); ++iter)
+	{
+		bytes += ros::serialization::serializationLength(iter->first) + ros::serialization::serializationLength(iter->second);
+	}
+	rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/Memory/InterOdoms/MB"), float(bytes)/(1024.0f*1024.0f)));
+
+	{
+		boost::mutex::scoped_lock lock(asyncInputsMutex_);
+		rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/Memory/Imus/MB"), float(imus_.capacity()*sizeof(std::pair<double, Transform>))/(1024.0f*1024.0f)));
+		bytes = 0;
+		for(std::map<int, std::pair<geometry_msgs::PoseWithCovarianceStamped, float> >::const_iterator iter=tags_.begin(); iter!=tags_.end(); ++iter)
+		{
+			bytes += sizeof(int) + sizeof(float) + ros::serialization::serializationLength(iter->second.first);
+		}
+		rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/Memory/Tags/MB"), float(bytes)/(1024.0f*1024.0f)));
+	}
+
+	rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/Memory/NodeDataCache/MB"), float(nodeDataCache_.bytes())/(1024.0f*1024.0f)));
+	rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/Memory/RSS/MB"), float(UProcessInfo::getMemoryUsage())/(1024.0f*1024.0f)));
+}
+
 std::map<int, Transform> CoreWrapper::filterNodesToAssemble(
 		const std::map<int, Transform> & nodes,
 		const Transform & currentPose)
@@ -2306,10 +3299,74 @@ void CoreWrapper::userDataAsyncCallback(const rtabmap_msgs::UserDataConstPtr & d
 	}
 }
 
+void CoreWrapper::envSensorAsyncCallback(const rtabmap_msgs::EnvSensorConstPtr & msg)
+{
+	if(!paused_)
+	{
+		boost::mutex::scoped_lock lock(envSensorsMutex_);
+		std::map<double, float> & samples = envSensors_[msg->type];
+		samples[rtabmap_conversions::timestampFromROS(msg->header.stamp)] = (float)msg->value;
+		// samples not used by a node after env_sensors_buffer sec are dropped
+		if(envSensorsBuffer_ > 0.0)
+		{
+			samples.erase(samples.begin(), samples.lower_bound(samples.rbegin()->first - envSensorsBuffer_));
+		}
+	}
+}
+
+rtabmap::EnvSensors CoreWrapper::takeEnvSensors(double stamp)
+{
+	// Samples received up to the node stamp are moved out of the buffer,
+	// so the reduction is done without blocking the callback.
+	std::map<int, std::vector<std::pair<double, float> > > samples;
+	{
+		boost::mutex::scoped_lock lock(envSensorsMutex_);
+		for(std::map<int, std::map<double, float> >::iterator iter=envSensors_.begin(); iter!=envSensors_.end(); ++iter)
+		{
+			std::map<double, float>::iterator end = iter->second.upper_bound(stamp);
+			if(end != iter->second.begin())
+			{
+				samples[iter->first].assign(iter->second.begin(), end);
+				iter->second.erase(iter->second.begin(), end);
+			}
+		}
+	}
+
+	rtabmap::EnvSensors sensors;
+	for(std::map<int, std::vector<std::pair<double, float> > >::iterator iter=samples.begin(); iter!=samples.end(); ++iter)
+	{
+		const std::vector<std::pair<double, float> > & v = iter->second;
+		double value = v.back().second;
+		if(envSensorsReduction_.compare("mean") == 0)
+		{
+			value = 0.0;
+			for(size_t i=0; i<v.size(); ++i)
+			{
+				value += v[i].second;
+			}
+			value /= double(v.size());
+		}
+		else if(envSensorsReduction_.compare("min") == 0 || envSensorsReduction_.compare("max") == 0)
+		{
+			bool min = envSensorsReduction_.compare("min") == 0;
+			for(size_t i=0; i<v.size(); ++i)
+			{
+				if(min?v[i].second<value:v[i].second>value)
+				{
+					value = v[i].second;
+				}
+			}
+		}
+		sensors.insert(std::make_pair((EnvSensor::Type)iter->first, EnvSensor((EnvSensor::Type)iter->first, value, v.back().first)));
+	}
+	return sensors;
+}
+
 void CoreWrapper::globalPoseAsyncCallback(const geometry_msgs::PoseWithCovarianceStampedConstPtr & globalPoseMsg)
 {
 	if(!paused_)
 	{
+		boost::mutex::scoped_lock lock(asyncInputsMutex_);
 		globalPose_ = *globalPoseMsg;
 	}
 }
@@ -2327,6 +3384,7 @@ void CoreWrapper::gpsFixAsyncCallback(const sensor_msgs::NavSatFixConstPtr & gps
 				error = sqrt(variance);
 			}
 		}
+		boost::mutex::scoped_lock lock(asyncInputsMutex_);
 		gps_ = rtabmap::GPS(
 				gpsFixMsg->header.stamp.toSec(),
 				gpsFixMsg->longitude,
@@ -2378,6 +3436,7 @@ void CoreWrapper::tagDetectionsAsyncCallback(const apriltag_ros::AprilTagDetecti
 						warned = true;
 					}
 				}
+				boost::mutex::scoped_lock lock(asyncInputsMutex_);
 				uInsert(tags_,
 						std::make_pair(tagDetections.detections[i].id[0],
 								std::make_pair(p, tagDetections.detections[i].size.size()==1?(float)tagDetections.detections[i].size[0]:0.0f)));
@@ -2400,6 +3459,7 @@ void CoreWrapper::fiducialDetectionsAsyncCallback(const fiducial_msgs::FiducialT
 			p.pose.pose.position.y = fiducialDetections.transforms[i].transform.translation.y;
 			p.pose.pose.position.z = fiducialDetections.transforms[i].transform.translation.z;
 			p.header = fiducialDetections.header;
+			boost::mutex::scoped_lock lock(asyncInputsMutex_);
 			uInsert(tags_,
 					std::make_pair(fiducialDetections.transforms[i].fiducial_id,
 							std::make_pair(p, 0.0f)));
@@ -2419,11 +3479,8 @@ void CoreWrapper::imuAsyncCallback(const sensor_msgs::ImuConstPtr & msg)
 		else
 		{
 			Transform orientation(0,0,0, msg->orientation.x, msg->orientation.y, msg->orientation.z, msg->orientation.w);
-			imus_.insert(std::make_pair(msg->header.stamp.toSec(), orientation));
-			if(imus_.size() > 1000)
-			{
-				imus_.erase(imus_.begin());
-			}
+			boost::mutex::scoped_lock lock(asyncInputsMutex_);
+			imus_.push(msg->header.stamp.toSec(), orientation);
 			if(!imuFrameId_.empty() && imuFrameId_.compare(msg->header.frame_id) != 0)
 			{
 				ROS_ERROR("IMU frame_id has changed from %s to %s! Are "
@@ -2452,6 +3509,11 @@ void CoreWrapper::interOdomCallback(const nav_msgs::OdometryConstPtr & msg)
 {
 	if(!paused_)
 	{
+		if(!interOdoms_.empty() && msg->header.stamp <= interOdoms_.back().first.header.stamp)
+		{
+			NODELET_WARN("Intermediate odometry received out of order (%f <= %f), ignoring it.", msg->header.stamp.toSec(), interOdoms_.back().first.header.stamp.toSec());
+			return;
+		}
 		interOdoms_.push_back(std::make_pair(*msg, rtabmap_msgs::OdomInfo()));
 	}
 }
@@ -2460,6 +3522,11 @@ void CoreWrapper::interOdomInfoCallback(const nav_msgs::OdometryConstPtr & msg1,
 {
 	if(!paused_)
 	{
+		if(!interOdoms_.empty() && msg1->header.stamp <= interOdoms_.back().first.header.stamp)
+		{
+			NODELET_WARN("Intermediate odometry received out of order (%f <= %f), ignoring it.", msg1->header.stamp.toSec(), interOdoms_.back().first.header.stamp.toSec());
+			return;
+		}
 		interOdoms_.push_back(std::make_pair(*msg1, *msg2));
 	}
 }
@@ -2467,6 +3534,7 @@ void CoreWrapper::interOdomInfoCallback(const nav_msgs::OdometryConstPtr & msg1,
 
 void CoreWrapper::initialPoseCallback(const geometry_msgs::PoseWithCovarianceStampedConstPtr & msg)
 {
+	boost::mutex::scoped_lock memoryLock(memoryMutex_);
 	Transform intialPose = rtabmap_conversions::transformFromPoseMsg(msg->pose.pose);
 	if(intialPose.isNull())
 	{
@@ -2475,6 +3543,146 @@ void CoreWrapper::initialPoseCallback(const geometry_msgs::PoseWithCovarianceSta
 	}
 
 	rtabmap_.setInitialPose(intialPose);
+	++graphRevision_;
+
+	if(relocalizationCandidates_ > 0)
+	{
+		// refined with the next frame received
+		relocalizationPrior_ = intialPose;
+		relocalizationPending_ = true;
+	}
+}
+
+static void relocalizationWorker(
+		const ParametersMap * parameters,
+		const std::vector<Signature> * candidates,
+		const std::vector<Transform> * guesses,
+		const Signature * current,
+		std::vector<Transform> * transforms,
+		std::vector<RegistrationInfo> * infos,
+		size_t threadId,
+		size_t threads)
+{
+	// Registration objects are not shared between threads
+	Registration * reg = Registration::create(*parameters);
+	for(size_t i=threadId; i<candidates->size(); i+=threads)
+	{
+		transforms->at(i) = reg->computeTransformation(candidates->at(i), *current, guesses->at(i), &infos->at(i));
+	}
+	delete reg;
+}
+
+Transform CoreWrapper::relocalize(const SensorData & data, const Transform & prior)
+{
+	UTimer timer;
+	std::vector<Signature> candidates;
+	std::vector<Transform> guesses;
+	{
+		boost::mutex::scoped_lock memoryLock(memoryMutex_);
+		const std::map<int, Transform> & optimizedPoses = rtabmap_.getLocalOptimizedPoses();
+		nodesIndex_.update(optimizedPoses, graphRevision_);
+		std::map<int, float> dists = nodesIndex_.radiusSearch(prior.x(), prior.y(), prior.z(), relocalizationRadius_, relocalizationCandidates_);
+		candidates.reserve(dists.size());
+		guesses.reserve(dists.size());
+		for(std::map<int, float>::iterator iter=dists.begin(); iter!=dists.end(); ++iter)
+		{
+			Signature s = rtabmap_.getSignatureCopy(iter->first, false, true, false, false, true, false);
+			if(s.id() > 0)
+			{
+				s.sensorData().uncompressData();
+				candidates.push_back(s);
+				guesses.push_back(optimizedPoses.at(iter->first).inverse() * prior);
+			}
+		}
+	}
+	if(candidates.empty())
+	{
+		NODELET_WARN("Relocalization: no nodes in %f m of the pose prior %s", relocalizationRadius_, prior.prettyPrint().c_str());
+		return Transform();
+	}
+
+	ParametersMap parameters = parameters_;
+	Signature current(data);
+	std::vector<Transform> transforms(candidates.size());
+	std::vector<RegistrationInfo> infos(candidates.size());
+
+	// Features of the current frame are extracted only once
+	{
+		Registration * reg = Registration::create(parameters);
+		transforms[0] = reg->computeTransformationMod(candidates[0], current, guesses[0], &infos[0]);
+		delete reg;
+	}
+	if(candidates.size() > 1)
+	{
+		// the first candidate is already done
+		std::vector<Signature> others(candidates.begin()+1, candidates.end());
+		std::vector<Transform> otherGuesses(guesses.begin()+1, guesses.end());
+		std::vector<Transform> otherTransforms(others.size());
+		std::vector<RegistrationInfo> otherInfos(others.size());
+		size_t threads = std::max(1u, std::min(boost::thread::hardware_concurrency(), (unsigned int)others.size()));
+		if(threadPool_.get())
+		{
+			threadPool_->parallelFor((int)others.size(), boost::bind(&relocalizationWorker, &parameters, &others, &otherGuesses, &current, &otherTransforms, &otherInfos, boost::placeholders::_1, boost::placeholders::_2));
+		}
+		else if(threads > 1)
+		{
+			boost::thread_group group;
+			for(size_t t=0; t<threads; ++t)
+			{
+				group.create_thread(boost::bind(&relocalizationWorker, &parameters, &others, &otherGuesses, &current, &otherTransforms, &otherInfos, t, threads));
+			}
+			group.join_all();
+		}
+		else
+		{
+			relocalizationWorker(&parameters, &others, &otherGuesses, &current, &otherTransforms, &otherInfos, 0, 1);
+		}
+		std::copy(otherTransforms.begin(), otherTransforms.end(), transforms.begin()+1);
+		std::copy(otherInfos.begin(), otherInfos.end(), infos.begin()+1);
+	}
+
+	// Keep the candidate with most inliers
+	int best = -1;
+	for(size_t i=0; i<transforms.size(); ++i)
+	{
+		if(!transforms[i].isNull() &&
+		   (best < 0 ||
+			infos[i].inliers > infos[best].inliers ||
+			(infos[i].inliers == infos[best].inliers && infos[i].icpInliersRatio > infos[best].icpInliersRatio)))
+		{
+			best = (int)i;
+		}
+	}
+
+	Transform pose;
+	if(best >= 0)
+	{
+		boost::mutex::scoped_lock memoryLock(memoryMutex_);
+		std::map<int, Transform>::const_iterator iter = rtabmap_.getLocalOptimizedPoses().find(candidates[best].id());
+		if(iter != rtabmap_.getLocalOptimizedPoses().end())
+		{
+			pose = iter->second * transforms[best];
+			if(twoDMapping_)
+			{
+				pose = pose.to3DoF();
+			}
+		}
+	}
+	rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/Relocalization/candidates"), candidates.size()));
+	rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/Relocalization/inliers"), best>=0?infos[best].inliers:0));
+	rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/Relocalization/id"), best>=0?candidates[best].id():0));
+	rtabmapROSStats_.insert(std::make_pair(std::string("RtabmapROS/Relocalization/time/ms"), timer.elapsed()*1000.0f));
+	if(pose.isNull())
+	{
+		NODELET_WARN("Relocalization: none of the %d candidates around %s could be registered (%fs)",
+				(int)candidates.size(), prior.prettyPrint().c_str(), timer.elapsed());
+	}
+	else
+	{
+		NODELET_INFO("Relocalization: %s with node %d (%d inliers, %d candidates, %fs)",
+				pose.prettyPrint().c_str(), candidates[best].id(), infos[best].inliers, (int)candidates.size(), timer.elapsed());
+	}
+	return pose;
 }
 
 void CoreWrapper::goalCommonCallback(
@@ -2485,6 +3693,7 @@ void CoreWrapper::goalCommonCallback(
 		const ros::Time & stamp,
 		double * planningTime)
 {
+	boost::mutex::scoped_lock memoryLock(memoryMutex_);
 	UTimer timer;
 
 	if(id == 0 && !label.empty() && rtabmap_.getMemory())
@@ -2523,6 +3732,8 @@ void CoreWrapper::goalCommonCallback(
 
 		currentMetricGoal_.setNull();
 		lastPublishedMetricGoal_.setNull();
+		lastPublishedLocalPath_.clear();
+		lastPublishedGlobalPath_.clear();
 		goalFrameId_.clear();
 		latestNodeWasReached_ = false;
 		if(poses.size() == 0)
@@ -2568,6 +3779,7 @@ void CoreWrapper::goalCommonCallback(
 				publishCurrentGoal(stamp);
 				publishLocalPath(stamp);
 				publishGlobalPath(stamp);
+				prefetchPathNodes();
 
 				// Just output the path on screen
 				std::stringstream stream;
@@ -2669,6 +3881,8 @@ void CoreWrapper::goalNodeCallback(const rtabmap_msgs::GoalConstPtr & msg)
 
 bool CoreWrapper::updateRtabmapCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&)
 {
+	boost::mutex::scoped_lock mapsLock(mapsMutex_);
+	boost::mutex::scoped_lock memoryLock(memoryMutex_);
 	ros::NodeHandle pnh("~");
 	for(rtabmap::ParametersMap::iterator iter=parameters_.begin(); iter!=parameters_.end(); ++iter)
 	{
@@ -2729,36 +3943,61 @@ bool CoreWrapper::updateRtabmapCallback(std_srvs::Empty::Request&, std_srvs::Emp
 		NODELET_INFO("2D mapping = %s", twoDMapping_?"true":"false");
 	}
 	rtabmap_.parseParameters(parameters_);
+	++graphRevision_;
 	mapsManager_.setParameters(parameters_);
 	return true;
 }
 
 bool CoreWrapper::resetRtabmapCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&)
 {
+	boost::mutex::scoped_lock mapsLock(mapsMutex_);
+	boost::mutex::scoped_lock memoryLock(memoryMutex_);
 	NODELET_INFO("rtabmap: Reset");
 	rtabmap_.resetMemory();
+	++graphRevision_;
+	nodeDataCache_.clear();
+	globalDescriptorIndex_.clear();
+	globalDescriptorIndexSynced_ = false;
 	covariance_ = cv::Mat();
 	lastPose_.setIdentity();
 	lastPoseVelocity_.clear();
 	lastPoseIntermediate_ = false;
 	currentMetricGoal_.setNull();
 	lastPublishedMetricGoal_.setNull();
+	lastPublishedLocalPath_.clear();
+	lastPublishedGlobalPath_.clear();
 	goalFrameId_.clear();
 	latestNodeWasReached_ = false;
 	graphLatched_ = false;
 	mapsManager_.clear();
+	if(mapsCacheSnapshot_ && UFile::exists(databasePath_ + ".maps"))
+	{
+		// node ids restart from 1, the snapshot is not valid anymore
+		UFile::erase(databasePath_ + ".maps");
+	}
+	mapDataDeltaMutex_.lock();
+	mapDataDeltaResync_ = true;
+	mapDataDeltaMutex_.unlock();
 	previousStamp_ = ros::Time(0);
+	previousPose_.setNull();
+	asyncInputsMutex_.lock();
 	globalPose_.header.stamp = ros::Time(0);
 	gps_ = rtabmap::GPS();
 	tags_.clear();
+	imus_.clear();
+	imuFrameId_.clear();
+	asyncInputsMutex_.unlock();
 	userDataMutex_.lock();
 	userData_ = cv::Mat();
 	userDataMutex_.unlock();
-	imus_.clear();
-	imuFrameId_.clear();
+	envSensorsMutex_.lock();
+	envSensors_.clear();
+	envSensorsMutex_.unlock();
 	interOdoms_.clear();
+	interOdomLastStamp_ = ros::Time(0);
 	mapToOdomMutex_.lock();
 	mapToOdom_.setIdentity();
+	setMapToOdomTF(mapToOdom_, odomFrameId_);
 	mapToOdomMutex_.unlock();
 
 	return true;
@@ -2798,6 +4037,8 @@ bool CoreWrapper::resumeRtabmapCallback(std_srvs::Empty::Request&, std_srvs::Emp
 
 bool CoreWrapper::loadDatabaseCallback(rtabmap_msgs::LoadDatabase::Request& req, rtabmap_msgs::LoadDatabase::Response&)
 {
+	boost::mutex::scoped_lock mapsLock(mapsMutex_);
+	boost::mutex::scoped_lock memoryLock(memoryMutex_);
 	NODELET_INFO("LoadDatabase: Loading database (%s, clear=%s)...", req.database_path.c_str(), req.clear?"true":"false");
 	std::string newDatabasePath = uReplaceChar(req.database_path, '~', UDirectory::homeDir());
 	std::string dir = UDirectory::getDir(newDatabasePath);
@@ -2814,17 +4055,7 @@ bool CoreWrapper::loadDatabaseCallback(rtabmap_msgs::LoadDatabase::Request& req,
 
 	// Close old database
 	NODELET_INFO("LoadDatabase: Saving current map (%s)...", databasePath_.c_str());
-	if(rtabmap_.getMemory())
-	{
-		// save the grid map
-		float xMin=0.0f, yMin=0.0f, gridCellSize = 0.05f;
-		cv::Mat pixels = mapsManager_.getGridMap(xMin, yMin, gridCellSize);
-		if(!pixels.empty())
-		{
-			printf("rtabmap: 2D occupancy grid map saved.\n");
-			rtabmap_.getMemory()->save2DMap(pixels, xMin, yMin, gridCellSize);
-		}
-	}
+	saveGridMap();
 	rtabmap_.close();
 	NODELET_INFO("LoadDatabase: Saving current map (%s, %ld MB)... done!", databasePath_.c_str(), UFile::length(databasePath_)/(1024*1024));
 
@@ -2834,22 +4065,35 @@ bool CoreWrapper::loadDatabaseCallback(rtabmap_msgs::LoadDatabase::Request& req,
 	lastPoseIntermediate_ = false;
 	currentMetricGoal_.setNull();
 	lastPublishedMetricGoal_.setNull();
+	lastPublishedLocalPath_.clear();
+	lastPublishedGlobalPath_.clear();
 	goalFrameId_.clear();
 	latestNodeWasReached_ = false;
 	graphLatched_ = false;
 	mapsManager_.clear();
+	mapDataDeltaMutex_.lock();
+	mapDataDeltaResync_ = true;
+	mapDataDeltaMutex_.unlock();
 	previousStamp_ = ros::Time(0);
+	previousPose_.setNull();
+	asyncInputsMutex_.lock();
 	globalPose_.header.stamp = ros::Time(0);
 	gps_ = rtabmap::GPS();
 	tags_.clear();
+	imus_.clear();
+	imuFrameId_.clear();
+	asyncInputsMutex_.unlock();
 	userDataMutex_.lock();
 	userData_ = cv::Mat();
 	userDataMutex_.unlock();
-	imus_.clear();
-	imuFrameId_.clear();
+	envSensorsMutex_.lock();
+	envSensors_.clear();
+	envSensorsMutex_.unlock();
 	interOdoms_.clear();
+	interOdomLastStamp_ = ros::Time(0);
 	mapToOdomMutex_.lock();
 	mapToOdom_.setIdentity();
+	setMapToOdomTF(mapToOdom_, odomFrameId_);
 	mapToOdomMutex_.unlock();
 
 	// Open new database
@@ -2887,12 +4131,23 @@ bool CoreWrapper::loadDatabaseCallback(rtabmap_msgs::LoadDatabase::Request& req,
 	}
 
 	NODELET_INFO("LoadDatabase: Loading database...");
+	nodeDataCache_.clear();
+	globalDescriptorIndex_.clear();
+	globalDescriptorIndexSynced_ = false;
 	rtabmap_.init(parameters_, databasePath_);
+	++graphRevision_;
 	NODELET_INFO("LoadDatabase: Loading database... done!");
 
 	if(rtabmap_.getMemory())
 	{
-		if(useSavedMap_ && !rtabmap_.getMemory()->isIncremental())
+		if(mapsCacheSnapshot_)
+		{
+			mapsManager_.loadCache(databasePath_ + ".maps", rtabmap_.getLocalOptimizedPoses());
+		}
+
+		// In mapping mode, the saved map is reused only if the graph didn't
+		// change since it was saved, avoiding to regenerate it from scratch.
+		if(useSavedMap_ && (!rtabmap_.getMemory()->isIncremental() || isSavedGridMapValid()))
 		{
 			float xMin, yMin, gridCellSize;
 			cv::Mat map = rtabmap_.getMemory()->load2DMap(xMin, yMin, gridCellSize);
@@ -2932,25 +4187,30 @@ bool CoreWrapper::loadDatabaseCallback(rtabmap_msgs::LoadDatabase::Request& req,
 
 bool CoreWrapper::triggerNewMapCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&)
 {
+	boost::mutex::scoped_lock memoryLock(memoryMutex_);
 	NODELET_INFO("rtabmap: Trigger new map");
 	rtabmap_.triggerNewMap();
+	++graphRevision_;
 	return true;
 }
 
 bool CoreWrapper::backupDatabaseCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&)
 {
-	NODELET_INFO("Backup: Saving memory...");
-	if(rtabmap_.getMemory())
+	boost::mutex::scoped_lock mapsLock(mapsMutex_);
+	boost::mutex::scoped_lock memoryLock(memoryMutex_);
+	if(backupThread_)
 	{
-		// save the grid map
-		float xMin=0.0f, yMin=0.0f, gridCellSize = 0.05f;
-		cv::Mat pixels = mapsManager_.getGridMap(xMin, yMin, gridCellSize);
-		if(!pixels.empty())
+		if(!backupThread_->timed_join(boost::posix_time::seconds(0)))
 		{
-			printf("rtabmap: 2D occupancy grid map saved.\n");
-			rtabmap_.getMemory()->save2DMap(pixels, xMin, yMin, gridCellSize);
+			NODELET_ERROR("Backup: previous backup is still running, ignoring request.");
+			return false;
 		}
+		delete backupThread_;
+		backupThread_ = 0;
 	}
+
+	NODELET_INFO("Backup: Saving memory...");
+	saveGridMap();
 	rtabmap_.close();
 	NODELET_INFO("Backup: Saving memory... done!");
 
@@ -2959,27 +4219,112 @@ bool CoreWrapper::backupDatabaseCallback(std_srvs::Empty::Request&, std_srvs::Em
 	lastPoseVelocity_.clear();
 	currentMetricGoal_.setNull();
 	lastPublishedMetricGoal_.setNull();
+	lastPublishedLocalPath_.clear();
+	lastPublishedGlobalPath_.clear();
 	goalFrameId_.clear();
 	latestNodeWasReached_ = false;
 	graphLatched_ = false;
 	userDataMutex_.lock();
 	userData_ = cv::Mat();
 	userDataMutex_.unlock();
+	envSensorsMutex_.lock();
+	envSensors_.clear();
+	envSensorsMutex_.unlock();
+	asyncInputsMutex_.lock();
 	globalPose_.header.stamp = ros::Time(0);
 	gps_ = rtabmap::GPS();
 	tags_.clear();
+	asyncInputsMutex_.unlock();
 
-	NODELET_INFO("Backup: Saving \"%s\" to \"%s\"...", databasePath_.c_str(), (databasePath_+".back").c_str());
-	UFile::copy(databasePath_, databasePath_+".back");
-	NODELET_INFO("Backup: Saving \"%s\" to \"%s\"... done!", databasePath_.c_str(), (databasePath_+".back").c_str());
+	if(!backupAsync_)
+	{
+		NODELET_INFO("Backup: Saving \"%s\" to \"%s\"...", databasePath_.c_str(), (databasePath_+".back").c_str());
+		UFile::copy(databasePath_, databasePath_+".back");
+		NODELET_INFO("Backup: Saving \"%s\" to \"%s\"... done!", databasePath_.c_str(), (databasePath_+".back").c_str());
+	}
 
 	NODELET_INFO("Backup: Reloading memory...");
+	nodeDataCache_.clear();
+	globalDescriptorIndex_.clear();
+	globalDescriptorIndexSynced_ = false;
 	rtabmap_.init(parameters_, databasePath_);
+	++graphRevision_;
 	NODELET_INFO("Backup: Reloading memory... done!");
 
+	if(backupAsync_)
+	{
+		// The database is now flushed, copy it page by page while mapping continues
+		backupThread_ = new boost::thread(boost::bind(&CoreWrapper::backupDatabaseThread, this, databasePath_, databasePath_+".back"));
+	}
+
 	return true;
 }
 
+void CoreWrapper::backupDatabaseThread(std::string sourcePath, std::string targetPath)
+{
+	threadSettings_.apply();
+#ifdef WITH_SQLITE3
+	UTimer timer;
+	std::string tmpPath = targetPath + ".tmp";
+	NODELET_INFO("Backup: Saving \"%s\" to \"%s\" in background...", sourcePath.c_str(), targetPath.c_str());
+	sqlite3 * source = 0;
+	sqlite3 * target = 0;
+	int rc = sqlite3_open_v2(sourcePath.c_str(), &source, SQLITE_OPEN_READONLY, 0);
+	if(rc == SQLITE_OK)
+	{
+		rc = sqlite3_open(tmpPath.c_str(), &target);
+	}
+	if(rc == SQLITE_OK)
+	{
+		sqlite3_backup * backup = sqlite3_backup_init(target, "main", source, "main");
+		if(backup)
+		{
+			try
+			{
+				// The backup restarts by itself if the database is modified
+				// by the core between two steps, so the copy is always consistent.
+				do
+				{
+					rc = sqlite3_backup_step(backup, backupPagesPerStep_);
+					if(rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED)
+					{
+						boost::this_thread::sleep(boost::posix_time::microseconds(long(backupStepDelay_*1000000.0)));
+					}
+				}
+				while(rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED);
+			}
+			catch(const boost::thread_interrupted &)
+			{
+				NODELET_WARN("Backup: interrupted, \"%s\" is not updated.", targetPath.c_str());
+				rc = SQLITE_INTERRUPT;
+			}
+			sqlite3_backup_finish(backup);
+		}
+		else
+		{
+			rc = sqlite3_errcode(target);
+		}
+	}
+	if(rc != SQLITE_DONE && rc != SQLITE_INTERRUPT)
+	{
+		NODELET_ERROR("Backup: Failed to save \"%s\" to \"%s\": %s", sourcePath.c_str(), targetPath.c_str(), sqlite3_errstr(rc));
+	}
+	sqlite3_close(target);
+	sqlite3_close(source);
+
+	if(rc == SQLITE_DONE)
+	{
+		UFile::erase(targetPath);
+		UFile::rename(tmpPath, targetPath);
+		NODELET_INFO("Backup: Saving \"%s\" to \"%s\" in background... done! (%fs)", sourcePath.c_str(), targetPath.c_str(), timer.ticks());
+	}
+	else
+	{
+		UFile::erase(tmpPath);
+	}
+#endif
+}
+
 void CoreWrapper::republishMaps()
 {
 	ros::Time stamp = ros::Time::now();
@@ -2996,7 +4341,9 @@ void CoreWrapper::republishMaps()
 			rtabmap_.getLocalConstraints(),
 			std::map<int, Signature>(),
 			rtabmap_.getMapCorrection(),
-			*msg);
+			*msg,
+			mapDataPacked_,
+			mapDataScanFloat16_);
 
 		mapDataPub_.publish(msg);
 	}
@@ -3017,8 +4364,123 @@ void CoreWrapper::republishMaps()
 	}
 }
 
+bool CoreWrapper::PostProcessingState::callback(const std::string & msg) const
+{
+	if(!msg.empty())
+	{
+		ROS_INFO("Post-Processing: %s", msg.c_str());
+		if(pub_ && pub_->getNumSubscribers())
+		{
+			std_msgs::String status;
+			status.data = msg;
+			pub_->publish(status);
+		}
+	}
+	return !isCanceled();
+}
+
+bool CoreWrapper::startPostProcessing(const std::string & name, const boost::function<void()> & job)
+{
+	boost::mutex::scoped_lock lock(postProcessingMutex_);
+	if(postProcessingThread_)
+	{
+		if(!postProcessingThread_->timed_join(boost::posix_time::seconds(0)))
+		{
+			NODELET_ERROR("Post-Processing: cannot start \"%s\", another post-processing job is still running! "
+					"Call \"cancel_post_processing\" service to stop it.", name.c_str());
+			return false;
+		}
+		delete postProcessingThread_;
+	}
+	postProcessingState_.setCanceled(false);
+	postProcessingThread_ = new boost::thread(boost::bind(&CoreWrapper::postProcessingThread, this, name, job));
+	NODELET_WARN("Post-Processing: \"%s\" started in background, progress is published on \"%s\".",
+			name.c_str(), postProcessingStatusPub_.getTopic().c_str());
+	return true;
+}
+
+void CoreWrapper::postProcessingThread(std::string name, boost::function<void()> job)
+{
+	threadSettings_.apply();
+	postProcessingState_.callback(uFormat("%s started", name.c_str()));
+	UTimer timer;
+	job();
+	postProcessingState_.callback(uFormat("%s %s (%fs)", name.c_str(), postProcessingState_.isCanceled()?"canceled":"finished", timer.ticks()));
+}
+
+// Release the maps and memory locks between two units of post-processing
+// work, so that incoming data can be processed while a long job is running.
+static void yieldLocks(boost::mutex::scoped_lock & mapsLock, boost::mutex::scoped_lock & memoryLock)
+{
+	memoryLock.unlock();
+	mapsLock.unlock();
+	// boost::mutex is not fair, give waiting threads a chance to get the locks
+	boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+	mapsLock.lock();
+	memoryLock.lock();
+}
+
+bool CoreWrapper::cancelPostProcessingCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&)
+{
+	boost::mutex::scoped_lock lock(postProcessingMutex_);
+	if(postProcessingThread_ && !postProcessingThread_->timed_join(boost::posix_time::seconds(0)))
+	{
+		NODELET_WARN("Post-Processing: canceling...");
+		postProcessingState_.setCanceled(true);
+	}
+	return true;
+}
+
 bool CoreWrapper::detectMoreLoopClosuresCallback(rtabmap_msgs::DetectMoreLoopClosures::Request& req, rtabmap_msgs::DetectMoreLoopClosures::Response& res)
 {
+	if(postProcessingAsync_)
+	{
+		res.detected = 0;
+		return startPostProcessing("Detect more loop closures", boost::bind(&CoreWrapper::detectMoreLoopClosuresJob, this, req));
+	}
+	return detectMoreLoopClosures(req, res);
+}
+
+void CoreWrapper::detectMoreLoopClosuresJob(rtabmap_msgs::DetectMoreLoopClosures::Request req)
+{
+	rtabmap_msgs::DetectMoreLoopClosures::Response res;
+	detectMoreLoopClosures(req, res);
+}
+
+bool CoreWrapper::cleanupLocalGridsCallback(rtabmap_msgs::CleanupLocalGrids::Request& req, rtabmap_msgs::CleanupLocalGrids::Response& res)
+{
+	if(postProcessingAsync_)
+	{
+		res.modified = 0;
+		return startPostProcessing("Cleanup local grids", boost::bind(&CoreWrapper::cleanupLocalGridsJob, this, req));
+	}
+	return cleanupLocalGrids(req, res);
+}
+
+void CoreWrapper::cleanupLocalGridsJob(rtabmap_msgs::CleanupLocalGrids::Request req)
+{
+	rtabmap_msgs::CleanupLocalGrids::Response res;
+	cleanupLocalGrids(req, res);
+}
+
+bool CoreWrapper::globalBundleAdjustmentCallback(rtabmap_msgs::GlobalBundleAdjustment::Request& req, rtabmap_msgs::GlobalBundleAdjustment::Response& res)
+{
+	if(postProcessingAsync_)
+	{
+		// This is a single rtabmap call that cannot be split, the memory
+		// would be locked (and SLAM stalled) for the whole adjustment.
+		NODELET_ERROR("Post-Processing: Global bundle adjustment cannot run in background, "
+				"set \"post_processing_async\" to false to run it (incoming data will "
+				"wait until it is done).");
+		return false;
+	}
+	return globalBundleAdjustment(req, res);
+}
+
+bool CoreWrapper::detectMoreLoopClosures(const rtabmap_msgs::DetectMoreLoopClosures::Request& req, rtabmap_msgs::DetectMoreLoopClosures::Response& res)
+{
+	boost::mutex::scoped_lock mapsLock(mapsMutex_);
+	boost::mutex::scoped_lock memoryLock(memoryMutex_);
 	NODELET_WARN("Detect more loop closures service called");
 
 	UTimer timer;
@@ -3060,14 +4522,46 @@ bool CoreWrapper::detectMoreLoopClosuresCallback(rtabmap_msgs::DetectMoreLoopClo
 			iterations,
 			intraSession?"true":"false",
 			interSession?"true":"false");
-	res.detected = rtabmap_.detectMoreLoopClosures(
-			clusterRadiusMax,
-			clusterAngle*M_PI/180.0,
-			iterations,
-			intraSession,
-			interSession,
-			0,
-			clusterRadiusMin);
+	// Iterations are done one at a time, the locks are released
+	// between them so that the map can still be updated.
+	res.detected = 0;
+	for(int i=0; i<iterations; ++i)
+	{
+		if(i>0)
+		{
+			yieldLocks(mapsLock, memoryLock);
+			if(!postProcessingState_.callback(uFormat("Detect more loop closures: iteration %d/%d (%d detected)", i+1, iterations, res.detected)))
+			{
+				break;
+			}
+		}
+		int detected = rtabmap_.detectMoreLoopClosures(
+				clusterRadiusMax,
+				clusterAngle*M_PI/180.0,
+				1,
+				intraSession,
+				interSession,
+				&postProcessingState_,
+				clusterRadiusMin);
+		if(detected<0)
+		{
+			// keep the loop closures added by previous iterations
+			if(res.detected == 0)
+			{
+				res.detected = detected;
+			}
+			break;
+		}
+		res.detected += detected;
+		if(detected > 0)
+		{
+			++graphRevision_;
+		}
+		if(detected == 0)
+		{
+			break; // no more loop closures can be found
+		}
+	}
 	if(res.detected<0)
 	{
 		NODELET_ERROR("Post-Processing: Detecting more loop closures failed!");
@@ -3085,8 +4579,10 @@ bool CoreWrapper::detectMoreLoopClosuresCallback(rtabmap_msgs::DetectMoreLoopClo
 	return false;
 }
 
-bool CoreWrapper::cleanupLocalGridsCallback(rtabmap_msgs::CleanupLocalGrids::Request& req, rtabmap_msgs::CleanupLocalGrids::Response& res)
+bool CoreWrapper::cleanupLocalGrids(const rtabmap_msgs::CleanupLocalGrids::Request& req, rtabmap_msgs::CleanupLocalGrids::Response& res)
 {
+	boost::mutex::scoped_lock mapsLock(mapsMutex_);
+	boost::mutex::scoped_lock memoryLock(memoryMutex_);
 	NODELET_WARN("Cleanup local grids service called");
 	UTimer timer;
 	int radius = 1;
@@ -3107,7 +4603,61 @@ bool CoreWrapper::cleanupLocalGridsCallback(rtabmap_msgs::CleanupLocalGrids::Req
 	NODELET_WARN("Post-Processing: Cleanup local grids... (radius=%d, filter scans=%s)",
 			radius,
 			filterScans?"true":"false");
-	res.modified = rtabmap_.cleanupLocalGrids(poses, map, xMin, yMin, gridCellSize, radius, filterScans);
+	if(cleanupLocalGridsChunkSize_ <= 0 || (int)poses.size() <= cleanupLocalGridsChunkSize_)
+	{
+		res.modified = rtabmap_.cleanupLocalGrids(poses, map, xMin, yMin, gridCellSize, radius, filterScans);
+	}
+	else
+	{
+		// Nodes are independent (the optimized map is read-only), so we can
+		// process them by chunks to report progress, to be able to cancel
+		// and to release the locks between chunks.
+		res.modified = 0;
+		int processed = 0;
+		std::map<int, Transform> chunk;
+		for(std::map<int, Transform>::iterator iter=poses.begin(); iter!=poses.end() && res.modified>=0; ++iter)
+		{
+			chunk.insert(*iter);
+			if((int)chunk.size() == cleanupLocalGridsChunkSize_ || processed+(int)chunk.size() == (int)poses.size())
+			{
+				if(processed > 0)
+				{
+					yieldLocks(mapsLock, memoryLock);
+					// The map was created with the poses at the start, stop if the
+					// graph has been re-optimized or the memory reset meanwhile.
+					const std::map<int, Transform> & currentPoses = rtabmap_.getLocalOptimizedPoses();
+					bool graphChanged = false;
+					for(std::map<int, Transform>::iterator jter=chunk.begin(); jter!=chunk.end() && !graphChanged; ++jter)
+					{
+						std::map<int, Transform>::const_iterator kter = currentPoses.find(jter->first);
+						graphChanged = kter == currentPoses.end() || kter->second.getDistanceSquared(jter->second) > 0.0001f;
+					}
+					if(graphChanged)
+					{
+						NODELET_WARN("Post-Processing: Cleanup local grids stopped after %d/%d nodes, the graph "
+								"changed since it started. Call the service again to process the remaining nodes.",
+								processed, (int)poses.size());
+						break;
+					}
+				}
+				int modified = rtabmap_.cleanupLocalGrids(chunk, map, xMin, yMin, gridCellSize, radius, filterScans);
+				if(modified < 0)
+				{
+					res.modified = modified;
+					break;
+				}
+				res.modified += modified;
+				processed += (int)chunk.size();
+				chunk.clear();
+				if(!postProcessingState_.callback(uFormat("Cleanup local grids: %d/%d nodes processed, %d modified (%fs)",
+						processed, (int)poses.size(), res.modified, timer.elapsed())))
+				{
+					NODELET_WARN("Post-Processing: Cleanup local grids canceled after %d/%d nodes.", processed, (int)poses.size());
+					break;
+				}
+			}
+		}
+	}
 	if(res.modified<0)
 	{
 		NODELET_ERROR("Post-Processing: Cleanup local grids failed!");
@@ -3127,6 +4677,10 @@ bool CoreWrapper::cleanupLocalGridsCallback(rtabmap_msgs::CleanupLocalGrids::Req
 			// We should update MapsManager's cache with the modifications
 			mapsManager_.clear();
 			mapsManager_.set2DMap(map, xMin, yMin, gridCellSize, rtabmap_.getLocalOptimizedPoses(), rtabmap_.getMemory());
+			if(mapsCacheSnapshot_)
+			{
+				mapsManager_.saveCache(databasePath_ + ".maps");
+			}
 
 			republishMaps();
 		}
@@ -3135,8 +4689,10 @@ bool CoreWrapper::cleanupLocalGridsCallback(rtabmap_msgs::CleanupLocalGrids::Req
 
 	return false;
 }
-bool CoreWrapper::globalBundleAdjustmentCallback(rtabmap_msgs::GlobalBundleAdjustment::Request& req, rtabmap_msgs::GlobalBundleAdjustment::Response& res)
+bool CoreWrapper::globalBundleAdjustment(const rtabmap_msgs::GlobalBundleAdjustment::Request& req, rtabmap_msgs::GlobalBundleAdjustment::Response& res)
 {
+	boost::mutex::scoped_lock mapsLock(mapsMutex_);
+	boost::mutex::scoped_lock memoryLock(memoryMutex_);
 	NODELET_WARN("Global bundle adjustment service called");
 
 	UTimer timer;
@@ -3167,6 +4723,7 @@ bool CoreWrapper::globalBundleAdjustmentCallback(rtabmap_msgs::GlobalBundleAdjus
 			pixelVariance,
 			rematchFeatures?"true":"false");
 	bool success = rtabmap_.globalBundleAdjustment((Optimizer::Type)optimizer, rematchFeatures, iterations, pixelVariance);
+	++graphRevision_;
 	if(!success)
 	{
 		NODELET_ERROR("Post-Processing: Global Bundle Adjustment failed!");
@@ -3183,24 +4740,28 @@ bool CoreWrapper::globalBundleAdjustmentCallback(rtabmap_msgs::GlobalBundleAdjus
 
 bool CoreWrapper::setModeLocalizationCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&)
 {
+	boost::mutex::scoped_lock memoryLock(memoryMutex_);
 	NODELET_INFO("rtabmap: Set localization mode");
 	rtabmap::ParametersMap parameters;
 	parameters.insert(rtabmap::ParametersPair(rtabmap::Parameters::kMemIncrementalMemory(), "false"));
 	ros::NodeHandle & nh = getNodeHandle();
 	nh.setParam(rtabmap::Parameters::kMemIncrementalMemory(), "false");
 	rtabmap_.parseParameters(parameters);
+	++graphRevision_;
 	NODELET_INFO("rtabmap: Localization mode enabled!");
 	return true;
 }
 
 bool CoreWrapper::setModeMappingCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&)
 {
+	boost::mutex::scoped_lock memoryLock(memoryMutex_);
 	NODELET_INFO("rtabmap: Set mapping mode");
 	rtabmap::ParametersMap parameters;
 	parameters.insert(rtabmap::ParametersPair(rtabmap::Parameters::kMemIncrementalMemory(), "true"));
 	ros::NodeHandle & nh = getNodeHandle();
 	nh.setParam(rtabmap::Parameters::kMemIncrementalMemory(), "true");
 	rtabmap_.parseParameters(parameters);
+	++graphRevision_;
 	NODELET_INFO("rtabmap: Mapping mode enabled!");
 	return true;
 }
@@ -3243,15 +4804,34 @@ bool CoreWrapper::getNodeDataCallback(rtabmap_msgs::GetNodeData::Request& req, r
 	{
 		req.ids.push_back(rtabmap_.getMemory()->getLastWorkingSignature()->id());
 	}
+	int flags =
+			(req.images?rtabmap_util::NodeDataCache::kImages:0) |
+			(req.scan?rtabmap_util::NodeDataCache::kScan:0) |
+			(req.user_data?rtabmap_util::NodeDataCache::kUserData:0) |
+			(req.grid?rtabmap_util::NodeDataCache::kGrid:0);
 	for(size_t i=0; i<req.ids.size(); ++i)
 	{
 		int id = req.ids[i];
+		rtabmap_msgs::NodeData msg;
+		if(nodeDataCache_.get(id, flags, msg))
+		{
+			// weight and label can change after the node is created
+			const Signature * s = rtabmap_.getMemory()?rtabmap_.getMemory()->getSignature(id):0;
+			if(s)
+			{
+				msg.weight = s->getWeight();
+				msg.label = s->getLabel();
+			}
+			res.data.push_back(msg);
+			continue;
+		}
+
 		Signature s = rtabmap_.getSignatureCopy(id, req.images, req.scan, req.user_data, req.grid, true, true);
 
 		if(s.id()>0)
 		{
-			rtabmap_msgs::NodeData msg;
-			rtabmap_conversions::nodeDataToROS(s, msg);
+			rtabmap_conversions::nodeDataToROS(s, msg, mapDataPacked_, mapDataScanFloat16_);
+			nodeDataCache_.insert(id, flags, msg);
 			res.data.push_back(msg);
 		}
 	}
@@ -3265,6 +4845,7 @@ bool CoreWrapper::getMapDataCallback(rtabmap_msgs::GetMap::Request& req, rtabmap
 			req.global?"true":"false",
 			req.optimized?"true":"false",
 			req.graphOnly?"true":"false");
+	boost::mutex::scoped_lock memoryLock(memoryMutex_);
 	std::map<int, Signature> signatures;
 	std::map<int, Transform> poses;
 	std::multimap<int, rtabmap::Link> constraints;
@@ -3285,7 +4866,9 @@ bool CoreWrapper::getMapDataCallback(rtabmap_msgs::GetMap::Request& req, rtabmap
 		constraints,
 		signatures,
 		mapToOdom_,
-		res.data);
+		res.data,
+		mapDataPacked_,
+		mapDataScanFloat16_);
 
 	res.data.header.stamp = ros::Time::now();
 	res.data.header.frame_id = mapFrameId_;
@@ -3295,36 +4878,87 @@ bool CoreWrapper::getMapDataCallback(rtabmap_msgs::GetMap::Request& req, rtabmap
 
 bool CoreWrapper::getMapData2Callback(rtabmap_msgs::GetMap2::Request& req, rtabmap_msgs::GetMap2::Response& res)
 {
-	NODELET_INFO("rtabmap: Getting map (global=%s optimized=%s with_images=%s with_scans=%s with_user_data=%s with_grids=%s)...",
+	NODELET_INFO("rtabmap: Getting map (global=%s optimized=%s with_images=%s with_scans=%s with_user_data=%s with_grids=%s min_id=%d max_id=%d max_nodes=%d skip_graph=%s)...",
 			req.global?"true":"false",
 			req.optimized?"true":"false",
 			req.with_images?"true":"false",
 			req.with_scans?"true":"false",
 			req.with_user_data?"true":"false",
-			req.with_grids?"true":"false");
+			req.with_grids?"true":"false",
+			req.min_id,
+			req.max_id,
+			req.max_nodes,
+			req.skip_graph?"true":"false");
+	boost::mutex::scoped_lock memoryLock(memoryMutex_);
 	std::map<int, Signature> signatures;
 	std::map<int, Transform> poses;
 	std::multimap<int, rtabmap::Link> constraints;
 
-	rtabmap_.getGraph(
-			poses,
-			constraints,
-			req.optimized,
-			req.global,
-			&signatures,
-			req.with_images,
-			req.with_scans,
-			req.with_user_data,
-			req.with_grids,
-			req.with_words,
-			req.with_global_descriptors);
+	res.next_id = 0;
+	if(req.min_id <= 0 && req.max_id <= 0 && req.max_nodes <= 0)
+	{
+		rtabmap_.getGraph(
+				poses,
+				constraints,
+				req.optimized,
+				req.global,
+				&signatures,
+				req.with_images,
+				req.with_scans,
+				req.with_user_data,
+				req.with_grids,
+				req.with_words,
+				req.with_global_descriptors);
+	}
+	else
+	{
+		// Paginated request: get the whole graph without data, then
+		// load only the data of the nodes in the requested page. This
+		// avoids copying the data of all nodes at the same time.
+		rtabmap_.getGraph(
+				poses,
+				constraints,
+				req.optimized,
+				req.global);
+
+		for(std::map<int, Transform>::iterator iter=poses.lower_bound(req.min_id>0?req.min_id:1);
+			iter!=poses.end() && (req.max_id<=0 || iter->first<=req.max_id);
+			++iter)
+		{
+			if(req.max_nodes > 0 && (int)signatures.size() >= req.max_nodes)
+			{
+				res.next_id = iter->first;
+				break;
+			}
+			Signature s = rtabmap_.getSignatureCopy(
+					iter->first,
+					req.with_images,
+					req.with_scans,
+					req.with_user_data,
+					req.with_grids,
+					req.with_words,
+					req.with_global_descriptors);
+			if(s.id() > 0)
+			{
+				signatures.insert(std::make_pair(s.id(), s));
+			}
+		}
+	}
+
+	if(req.skip_graph)
+	{
+		poses.clear();
+		constraints.clear();
+	}
 
 	//RGB-D SLAM data
 	rtabmap_conversions::mapDataToROS(poses,
 		constraints,
 		signatures,
 		mapToOdom_,
-		res.data);
+		res.data,
+		mapDataPacked_,
+		mapDataScanFloat16_);
 
 	res.data.header.stamp = ros::Time::now();
 	res.data.header.frame_id = mapFrameId_;
@@ -3356,90 +4990,120 @@ bool CoreWrapper::getGridMapCallback(nav_msgs::GetMap::Request  &req, nav_msgs::
 	return getMapCallback(req, res);
 }
 
-bool CoreWrapper::getMapCallback(nav_msgs::GetMap::Request  &req, nav_msgs::GetMap::Response &res)
+bool CoreWrapper::getGridMapLevelCallback(nav_msgs::GetMap::Request  &req, nav_msgs::GetMap::Response &res, float resolution)
 {
+	boost::mutex::scoped_lock mapsLock(mapsMutex_);
+	boost::mutex::scoped_lock memoryLock(memoryMutex_);
+
 	// Make sure grid map cache is up to date (in case there is no subscriber on map topics)
 	std::map<int, Transform> poses = rtabmap_.getLocalOptimizedPoses();
 	mapsManager_.updateMapCaches(poses, rtabmap_.getMemory(), true, false);
 
-	// create the grid map
 	float xMin=0.0f, yMin=0.0f, gridCellSize = 0.05f;
-	cv::Mat pixels = mapsManager_.getGridMap(xMin, yMin, gridCellSize);
-
+	cv::Mat pixels = mapsManager_.getGridMap(xMin, yMin, gridCellSize, resolution);
 	if(!pixels.empty())
 	{
-		//init
 		res.map.info.resolution = gridCellSize;
-		res.map.info.origin.position.x = 0.0;
-		res.map.info.origin.position.y = 0.0;
+		res.map.info.origin.position.x = xMin;
+		res.map.info.origin.position.y = yMin;
 		res.map.info.origin.position.z = 0.0;
 		res.map.info.origin.orientation.x = 0.0;
 		res.map.info.origin.orientation.y = 0.0;
 		res.map.info.origin.orientation.z = 0.0;
 		res.map.info.origin.orientation.w = 1.0;
-
 		res.map.info.width = pixels.cols;
 		res.map.info.height = pixels.rows;
-		res.map.info.origin.position.x = xMin;
-		res.map.info.origin.position.y = yMin;
 		res.map.data.resize(res.map.info.width * res.map.info.height);
-
 		memcpy(res.map.data.data(), pixels.data, res.map.info.width * res.map.info.height);
-
 		res.map.header.frame_id = mapFrameId_;
 		res.map.header.stamp = ros::Time::now();
 		return true;
 	}
-	else
-	{
-		NODELET_WARN("rtabmap: The map is empty!");
-	}
+	NODELET_WARN("rtabmap: The map is empty!");
 	return false;
 }
 
-bool CoreWrapper::getProbMapCallback(nav_msgs::GetMap::Request  &req, nav_msgs::GetMap::Response &res)
+bool CoreWrapper::getCachedGridMap(bool prob, nav_msgs::OccupancyGrid & map)
 {
-	// Make sure grid map cache is up to date (in case there is no subscriber on map topics)
-	std::map<int, Transform> poses = rtabmap_.getLocalOptimizedPoses();
-	mapsManager_.updateMapCaches(poses, rtabmap_.getMemory(), true, false);
-
-	// create the grid map
-	float xMin=0.0f, yMin=0.0f, gridCellSize = 0.05f;
-	cv::Mat pixels = mapsManager_.getGridProbMap(xMin, yMin, gridCellSize);
-
-	if(!pixels.empty())
-	{
-		//init
-		res.map.info.resolution = gridCellSize;
-		res.map.info.origin.position.x = 0.0;
-		res.map.info.origin.position.y = 0.0;
-		res.map.info.origin.position.z = 0.0;
-		res.map.info.origin.orientation.x = 0.0;
-		res.map.info.origin.orientation.y = 0.0;
-		res.map.info.origin.orientation.z = 0.0;
-		res.map.info.origin.orientation.w = 1.0;
+	// Make sure grid map cache is up to date (in case there is no subscriber on map topics),
+	// only if the graph or the grid changed since last time
+	const std::map<int, Transform> & poses = rtabmap_.getLocalOptimizedPoses();
+	int lastId = poses.empty()?0:poses.rbegin()->first;
+	if(mapCachesGraphRevision_ != graphRevision_ ||
+	   mapCachesGraphSize_ != poses.size() ||
+	   mapCachesGraphLastId_ != lastId ||
+	   mapCachesGridRevision_ != mapsManager_.getGridRevision())
+	{
+		mapsManager_.updateMapCaches(poses, rtabmap_.getMemory(), true, false, std::map<int, Signature>(), 0, graphRevision_);
+		mapCachesGraphRevision_ = graphRevision_;
+		mapCachesGraphSize_ = poses.size();
+		mapCachesGraphLastId_ = lastId;
+		mapCachesGridRevision_ = mapsManager_.getGridRevision();
+	}
+
+	nav_msgs::OccupancyGrid & cache = prob?gridProbMapCache_:gridMapCache_;
+	unsigned long & cacheRevision = prob?gridProbMapCacheRevision_:gridMapCacheRevision_;
+	if(cacheRevision != mapsManager_.getGridRevision())
+	{
+		// create the grid map
+		float xMin=0.0f, yMin=0.0f, gridCellSize = 0.05f;
+		cv::Mat pixels = prob?
+				mapsManager_.getGridProbMap(xMin, yMin, gridCellSize):
+				mapsManager_.getGridMap(xMin, yMin, gridCellSize);
 
-		res.map.info.width = pixels.cols;
-		res.map.info.height = pixels.rows;
-		res.map.info.origin.position.x = xMin;
-		res.map.info.origin.position.y = yMin;
-		res.map.data.resize(res.map.info.width * res.map.info.height);
+		cache = nav_msgs::OccupancyGrid();
+		if(!pixels.empty())
+		{
+			//init
+			cache.info.resolution = gridCellSize;
+			cache.info.origin.position.x = 0.0;
+			cache.info.origin.position.y = 0.0;
+			cache.info.origin.position.z = 0.0;
+			cache.info.origin.orientation.x = 0.0;
+			cache.info.origin.orientation.y = 0.0;
+			cache.info.origin.orientation.z = 0.0;
+			cache.info.origin.orientation.w = 1.0;
 
-		memcpy(res.map.data.data(), pixels.data, res.map.info.width * res.map.info.height);
+			cache.info.width = pixels.cols;
+			cache.info.height = pixels.rows;
+			cache.info.origin.position.x = xMin;
+			cache.info.origin.position.y = yMin;
+			cache.data.resize(cache.info.width * cache.info.height);
 
-		res.map.header.frame_id = mapFrameId_;
-		res.map.header.stamp = ros::Time::now();
-		return true;
+			memcpy(cache.data.data(), pixels.data, cache.info.width * cache.info.height);
+		}
+		cacheRevision = mapsManager_.getGridRevision();
 	}
-	else
+
+	if(!cache.data.empty())
 	{
-		NODELET_WARN("rtabmap: The map is empty!");
+		map = cache;
+		map.header.frame_id = mapFrameId_;
+		map.header.stamp = ros::Time::now();
+		return true;
 	}
+	NODELET_WARN("rtabmap: The map is empty!");
 	return false;
 }
 
+bool CoreWrapper::getMapCallback(nav_msgs::GetMap::Request  &req, nav_msgs::GetMap::Response &res)
+{
+	boost::mutex::scoped_lock mapsLock(mapsMutex_);
+	boost::mutex::scoped_lock memoryLock(memoryMutex_);
+	return getCachedGridMap(false, res.map);
+}
+
+bool CoreWrapper::getProbMapCallback(nav_msgs::GetMap::Request  &req, nav_msgs::GetMap::Response &res)
+{
+	boost::mutex::scoped_lock mapsLock(mapsMutex_);
+	boost::mutex::scoped_lock memoryLock(memoryMutex_);
+	return getCachedGridMap(true, res.map);
+}
+
 bool CoreWrapper::publishMapCallback(rtabmap_msgs::PublishMap::Request& req, rtabmap_msgs::PublishMap::Response& res)
 {
+	boost::mutex::scoped_lock mapsLock(mapsMutex_);
+	boost::mutex::scoped_lock memoryLock(memoryMutex_);
 	NODELET_INFO("rtabmap: Publishing map...");
 
 	ros::Time now = ros::Time::now();
@@ -3473,7 +5137,9 @@ bool CoreWrapper::publishMapCallback(rtabmap_msgs::PublishMap::Request& req, rta
 				constraints,
 				signatures,
 				mapToOdom_,
-				*msg);
+				*msg,
+				mapDataPacked_,
+				mapDataScanFloat16_);
 
 			mapDataPub_.publish(msg);
 		}
@@ -3687,6 +5353,7 @@ bool CoreWrapper::publishMapCallback(rtabmap_msgs::PublishMap::Request& req, rta
 
 bool CoreWrapper::getPlanCallback(nav_msgs::GetPlan::Request &req, nav_msgs::GetPlan::Response &res)
 {
+	boost::mutex::scoped_lock memoryLock(memoryMutex_);
 	Transform pose = rtabmap_conversions::transformFromPoseMsg(req.goal.pose, true);
 	UTimer timer;
 	if(!pose.isNull())
@@ -3759,22 +5426,256 @@ bool CoreWrapper::getPlanCallback(nav_msgs::GetPlan::Request &req, nav_msgs::Get
 	return true;
 }
 
-bool CoreWrapper::getPlanNodesCallback(rtabmap_msgs::GetPlan::Request &req, rtabmap_msgs::GetPlan::Response &res)
+struct PlanQuery
 {
-	Transform pose;
-	if(req.goal_node <= 0)
+	PlanQuery() : from(0), to(0) {}
+	int from;
+	int to;
+	Transform goal; // exact goal pose (if set by pose)
+};
+
+// Hash of the optimized graph saved with the grid map (rounded
+// to avoid float noise between save and load)
+static std::string posesChecksum(const std::map<int, Transform> & poses)
+{
+	uint64_t hash = 14695981039346656037ULL; // FNV-1a
+	for(std::map<int, Transform>::const_iterator iter=poses.begin(); iter!=poses.end(); ++iter)
 	{
-		pose = rtabmap_conversions::transformFromPoseMsg(req.goal.pose, true);
+		std::vector<int64_t> values(13);
+		values[0] = iter->first;
+		for(int i=0; i<12; ++i)
+		{
+			values[i+1] = (int64_t)std::floor(iter->second.data()[i]*1000.0f + 0.5f);
+		}
+		const unsigned char * bytes = (const unsigned char *)values.data();
+		for(size_t i=0; i<values.size()*sizeof(int64_t); ++i)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ULL;
+		}
 	}
-	UTimer timer;
-	if(req.goal_node > 0 || !pose.isNull())
+	return uFormat("%016llx %d", (unsigned long long)hash, (int)poses.size());
+}
+
+void CoreWrapper::saveGridMap()
+{
+	if(rtabmap_.getMemory())
 	{
-		Transform coordinateTransform = Transform::getIdentity();
-		// transform goal in /map frame
-		if(!pose.isNull() && !req.goal.header.frame_id.empty() && mapFrameId_.compare(req.goal.header.frame_id) != 0)
-		{
-			coordinateTransform = rtabmap_conversions::getTransform(mapFrameId_, req.goal.header.frame_id, req.goal.header.stamp, tfListener_, waitForTransform_?waitForTransformDuration_:0.0);
-			if(coordinateTransform.isNull())
+		// save the grid map
+		float xMin=0.0f, yMin=0.0f, gridCellSize = 0.05f;
+		cv::Mat pixels = mapsManager_.getGridMap(xMin, yMin, gridCellSize);
+		if(!pixels.empty())
+		{
+			printf("rtabmap: 2D occupancy grid map saved.\n");
+			rtabmap_.getMemory()->save2DMap(pixels, xMin, yMin, gridCellSize);
+
+			// keep the graph used to generate the map alongside the database
+			std::ofstream file((databasePath_ + ".grid").c_str());
+			if(file.is_open())
+			{
+				file << posesChecksum(rtabmap_.getLocalOptimizedPoses()) << std::endl;
+			}
+		}
+
+		// save the local grids used to assemble the maps
+		if(mapsCacheSnapshot_ && !databasePath_.empty())
+		{
+			mapsManager_.saveCache(databasePath_ + ".maps");
+		}
+	}
+}
+
+bool CoreWrapper::isSavedGridMapValid() const
+{
+	std::ifstream file((databasePath_ + ".grid").c_str());
+	std::string line;
+	if(!file.is_open() || !std::getline(file, line))
+	{
+		return false;
+	}
+	bool valid = line.compare(posesChecksum(rtabmap_.getLocalOptimizedPoses())) == 0;
+	if(!valid)
+	{
+		NODELET_INFO("rtabmap: The graph has changed since the 2D occupancy grid map was saved, it will be regenerated.");
+	}
+	return valid;
+}
+
+static void computePlans(
+		const std::map<int, Transform> * poses,
+		const std::multimap<int, int> * links,
+		const std::vector<PlanQuery> * queries,
+		std::vector<rtabmap_msgs::Path> * plans,
+		size_t first,
+		size_t step)
+{
+	for(size_t i=first; i<queries->size(); i+=step)
+	{
+		const PlanQuery & query = queries->at(i);
+		if(query.from <= 0 || query.to <= 0)
+		{
+			continue;
+		}
+		std::list<std::pair<int, Transform> > path;
+		if(query.from == query.to)
+		{
+			path.push_back(*poses->find(query.from));
+		}
+		else
+		{
+			path = graph::computePath(*poses, *links, query.from, query.to);
+		}
+		if(!path.empty())
+		{
+			rtabmap_msgs::Path & plan = plans->at(i);
+			plan.poses.resize(path.size() + (query.goal.isNull()?0:1));
+			plan.nodeIds.resize(plan.poses.size());
+			int oi = 0;
+			for(std::list<std::pair<int, Transform> >::iterator iter=path.begin(); iter!=path.end(); ++iter)
+			{
+				rtabmap_conversions::transformToPoseMsg(iter->second, plan.poses[oi]);
+				plan.nodeIds[oi] = iter->first;
+				++oi;
+			}
+			if(!query.goal.isNull())
+			{
+				rtabmap_conversions::transformToPoseMsg(query.goal, plan.poses[oi]);
+				plan.nodeIds[oi] = 0;
+			}
+		}
+	}
+}
+
+bool CoreWrapper::getPlansCallback(rtabmap_msgs::GetPlans::Request &req, rtabmap_msgs::GetPlans::Response &res)
+{
+	size_t queriesCount = std::max(req.start_nodes.size(), req.starts.size());
+	if(queriesCount != std::max(req.goal_nodes.size(), req.goals.size()))
+	{
+		NODELET_ERROR("Planning: the number of starts (%d) and goals (%d) should be the same!",
+				(int)queriesCount, (int)std::max(req.goal_nodes.size(), req.goals.size()));
+		return false;
+	}
+
+	// Take a snapshot of the graph, then the queries don't need the memory anymore
+	std::map<int, Transform> poses;
+	std::multimap<int, int> links;
+	{
+		boost::mutex::scoped_lock memoryLock(memoryMutex_);
+		poses = rtabmap_.getLocalOptimizedPoses();
+		// remove landmarks
+		poses.erase(poses.begin(), poses.lower_bound(1));
+		const std::multimap<int, Link> & constraints = rtabmap_.getLocalConstraints();
+		for(std::multimap<int, Link>::const_iterator iter=constraints.begin(); iter!=constraints.end(); ++iter)
+		{
+			if(iter->second.from() != iter->second.to() &&
+			   poses.find(iter->second.from()) != poses.end() &&
+			   poses.find(iter->second.to()) != poses.end())
+			{
+				links.insert(std::make_pair(iter->second.from(), iter->second.to()));
+				links.insert(std::make_pair(iter->second.to(), iter->second.from()));
+			}
+		}
+	}
+	UTimer timer;
+	res.plans.resize(queriesCount);
+	std::vector<PlanQuery> queries(queriesCount);
+	for(size_t i=0; i<queriesCount; ++i)
+	{
+		res.plans[i].header.frame_id = mapFrameId_;
+		res.plans[i].header.stamp = ros::Time::now();
+		for(int j=0; j<2; ++j)
+		{
+			const std::vector<int> & nodes = j==0?req.start_nodes:req.goal_nodes;
+			const std::vector<geometry_msgs::PoseStamped> & targets = j==0?req.starts:req.goals;
+			int & id = j==0?queries[i].from:queries[i].to;
+			if(i < nodes.size() && nodes[i] > 0)
+			{
+				if(poses.find(nodes[i]) != poses.end())
+				{
+					id = nodes[i];
+				}
+				else
+				{
+					NODELET_WARN("Planning: query %d: node %d is not in the current graph.", (int)i, nodes[i]);
+				}
+			}
+			else if(i < targets.size())
+			{
+				Transform pose = rtabmap_conversions::transformFromPoseMsg(targets[i].pose, true);
+				if(!pose.isNull() && !targets[i].header.frame_id.empty() && mapFrameId_.compare(targets[i].header.frame_id) != 0)
+				{
+					Transform coordinateTransform = rtabmap_conversions::getTransform(mapFrameId_, targets[i].header.frame_id, targets[i].header.stamp, tfListener_, waitForTransform_?waitForTransformDuration_:0.0);
+					if(coordinateTransform.isNull())
+					{
+						NODELET_ERROR("Cannot transform pose from \"%s\" frame to \"%s\" frame!",
+								targets[i].header.frame_id.c_str(), mapFrameId_.c_str());
+						return false;
+					}
+					pose = coordinateTransform * pose;
+				}
+				if(!pose.isNull())
+				{
+					float distance = 0.0f;
+					int nearestId = graph::findNearestNode(poses, pose, &distance);
+					if(nearestId > 0 && (req.tolerance <= 0.0f || distance <= req.tolerance))
+					{
+						id = nearestId;
+						if(j==1)
+						{
+							queries[i].goal = pose;
+						}
+					}
+					else
+					{
+						NODELET_WARN("Planning: query %d: pose %s is too far from the graph (%f m > tolerance=%f m).",
+								(int)i, pose.prettyPrint().c_str(), distance, req.tolerance);
+					}
+				}
+			}
+		}
+	}
+
+	// The graph snapshot is shared (read-only) by all threads
+	size_t threads = std::max(1u, std::min(boost::thread::hardware_concurrency(), (unsigned int)queriesCount));
+	if(threadPool_.get())
+	{
+		threads = std::min(threadPool_->size(), (int)queriesCount);
+		threadPool_->parallelFor((int)queriesCount, boost::bind(&computePlans, &poses, &links, &queries, &res.plans, boost::placeholders::_1, boost::placeholders::_2));
+	}
+	else if(threads > 1)
+	{
+		boost::thread_group group;
+		for(size_t t=0; t<threads; ++t)
+		{
+			group.create_thread(boost::bind(&computePlans, &poses, &links, &queries, &res.plans, t, threads));
+		}
+		group.join_all();
+	}
+	else
+	{
+		computePlans(&poses, &links, &queries, &res.plans, 0, 1);
+	}
+	NODELET_INFO("Planning: Time computing %d paths = %f s (%d threads)", (int)queriesCount, timer.ticks(), (int)threads);
+	return true;
+}
+
+bool CoreWrapper::getPlanNodesCallback(rtabmap_msgs::GetPlan::Request &req, rtabmap_msgs::GetPlan::Response &res)
+{
+	boost::mutex::scoped_lock memoryLock(memoryMutex_);
+	Transform pose;
+	if(req.goal_node <= 0)
+	{
+		pose = rtabmap_conversions::transformFromPoseMsg(req.goal.pose, true);
+	}
+	UTimer timer;
+	if(req.goal_node > 0 || !pose.isNull())
+	{
+		Transform coordinateTransform = Transform::getIdentity();
+		// transform goal in /map frame
+		if(!pose.isNull() && !req.goal.header.frame_id.empty() && mapFrameId_.compare(req.goal.header.frame_id) != 0)
+		{
+			coordinateTransform = rtabmap_conversions::getTransform(mapFrameId_, req.goal.header.frame_id, req.goal.header.stamp, tfListener_, waitForTransform_?waitForTransformDuration_:0.0);
+			if(coordinateTransform.isNull())
 			{
 				NODELET_ERROR("Cannot transform goal pose from \"%s\" frame to \"%s\" frame!",
 						req.goal.header.frame_id.c_str(), mapFrameId_.c_str());
@@ -3872,6 +5773,8 @@ bool CoreWrapper::cancelGoalCallback(std_srvs::Empty::Request& req, std_srvs::Em
 		rtabmap_.clearPath(0);
 		currentMetricGoal_.setNull();
 		lastPublishedMetricGoal_.setNull();
+		lastPublishedLocalPath_.clear();
+		lastPublishedGlobalPath_.clear();
 		goalFrameId_.clear();
 		latestNodeWasReached_ = false;
 		if(goalReachedPub_.getNumSubscribers())
@@ -3891,6 +5794,7 @@ bool CoreWrapper::cancelGoalCallback(std_srvs::Empty::Request& req, std_srvs::Em
 
 bool CoreWrapper::setLabelCallback(rtabmap_msgs::SetLabel::Request& req, rtabmap_msgs::SetLabel::Response& res)
 {
+	boost::mutex::scoped_lock memoryLock(memoryMutex_);
 	if(rtabmap_.labelLocation(req.node_id, req.node_label))
 	{
 		if(req.node_id > 0)
@@ -3930,6 +5834,7 @@ bool CoreWrapper::listLabelsCallback(rtabmap_msgs::ListLabels::Request& req, rta
 
 bool CoreWrapper::removeLabelCallback(rtabmap_msgs::RemoveLabel::Request& req, rtabmap_msgs::RemoveLabel::Response& res)
 {
+	boost::mutex::scoped_lock memoryLock(memoryMutex_);
 	if(rtabmap_.getMemory())
 	{
 		int id = rtabmap_.getMemory()->getSignatureIdByLabel(req.label, true);
@@ -3951,10 +5856,44 @@ bool CoreWrapper::removeLabelCallback(rtabmap_msgs::RemoveLabel::Request& req, r
 
 bool CoreWrapper::addLinkCallback(rtabmap_msgs::AddLink::Request& req, rtabmap_msgs::AddLink::Response&)
 {
+	boost::mutex::scoped_lock memoryLock(memoryMutex_);
 	if(rtabmap_.getMemory())
 	{
 		ROS_INFO("Adding external link %d -> %d", req.link.fromId, req.link.toId);
 		rtabmap_.addLink(rtabmap_conversions::linkFromROS(req.link));
+		++graphRevision_;
+		return true;
+	}
+	return false;
+}
+
+bool CoreWrapper::addLinksCallback(rtabmap_msgs::AddLinks::Request& req, rtabmap_msgs::AddLinks::Response& res)
+{
+	// Bursts of links from external loop closure detectors: locks are
+	// taken once and maps are republished only once for the whole batch.
+	boost::mutex::scoped_lock mapsLock(mapsMutex_);
+	boost::mutex::scoped_lock memoryLock(memoryMutex_);
+	res.added = 0;
+	if(rtabmap_.getMemory())
+	{
+		UTimer timer;
+		for(size_t i=0; i<req.links.size(); ++i)
+		{
+			if(rtabmap_.addLink(rtabmap_conversions::linkFromROS(req.links[i])))
+			{
+				++graphRevision_;
+				++res.added;
+			}
+			else
+			{
+				NODELET_WARN("Could not add external link %d -> %d", req.links[i].fromId, req.links[i].toId);
+			}
+		}
+		NODELET_INFO("Added %d/%d external links (%fs)", res.added, (int)req.links.size(), timer.ticks());
+		if(res.added > 0)
+		{
+			republishMaps();
+		}
 		return true;
 	}
 	return false;
@@ -3965,7 +5904,34 @@ bool CoreWrapper::getNodesInRadiusCallback(rtabmap_msgs::GetNodesInRadius::Reque
 	ROS_INFO("Get nodes in radius (%f): node_id=%d pose=(%f,%f,%f)", req.radius, req.node_id, req.x, req.y, req.z);
 	std::map<int, Transform> poses;
 	std::map<int, float> dists;
-	if(req.node_id != 0 || (req.x == 0.0f && req.y == 0.0f && req.z == 0.0f))
+	boost::mutex::scoped_lock memoryLock(memoryMutex_);
+	const std::map<int, Transform> & optimizedPoses = rtabmap_.getLocalOptimizedPoses();
+	std::map<int, Transform>::const_iterator nodeIter = optimizedPoses.end();
+	if(req.node_id > 0)
+	{
+		nodeIter = optimizedPoses.find(req.node_id);
+	}
+	if(req.radius > 0.0f &&
+	   (nodeIter != optimizedPoses.end() || (req.node_id == 0 && (req.x != 0.0f || req.y != 0.0f || req.z != 0.0f))))
+	{
+		// Use the spatial index, only rebuilt when the graph is optimized
+		nodesIndex_.update(optimizedPoses, graphRevision_);
+		if(nodeIter != optimizedPoses.end())
+		{
+			// the reference node is not returned
+			dists = nodesIndex_.radiusSearch(nodeIter->second.x(), nodeIter->second.y(), nodeIter->second.z(), req.radius, req.k>0?req.k+1:0);
+			dists.erase(req.node_id);
+		}
+		else
+		{
+			dists = nodesIndex_.radiusSearch(req.x, req.y, req.z, req.radius, req.k);
+		}
+		for(std::map<int, float>::iterator iter=dists.begin(); iter!=dists.end(); ++iter)
+		{
+			poses.insert(poses.end(), *optimizedPoses.find(iter->first));
+		}
+	}
+	else if(req.node_id != 0 || (req.x == 0.0f && req.y == 0.0f && req.z == 0.0f))
 	{
 		poses = rtabmap_.getNodesInRadius(req.node_id, req.radius, req.k, &dists);
 	}
@@ -3993,42 +5959,359 @@ bool CoreWrapper::getNodesInRadiusCallback(rtabmap_msgs::GetNodesInRadius::Reque
 	return true;
 }
 
+// Called with memoryMutex_ locked after rtabmap processed data. The
+// revision changes when poses of nodes already in the graph may have
+// changed, not when nodes are only added to the graph.
+void CoreWrapper::updateGraphRevision()
+{
+	const Statistics & stats = rtabmap_.getStatistics();
+	const Transform & mapCorrection = rtabmap_.getMapCorrection();
+	const Transform & previous = graphRevisionMapCorrection_;
+	bool mapCorrected = mapCorrection.isNull() != previous.isNull() ||
+			(!mapCorrection.isNull() && (
+			mapCorrection.x() != previous.x() || mapCorrection.y() != previous.y() || mapCorrection.z() != previous.z() ||
+			mapCorrection.r11() != previous.r11() || mapCorrection.r12() != previous.r12() || mapCorrection.r13() != previous.r13() ||
+			mapCorrection.r21() != previous.r21() || mapCorrection.r22() != previous.r22() || mapCorrection.r23() != previous.r23() ||
+			mapCorrection.r31() != previous.r31() || mapCorrection.r32() != previous.r32() || mapCorrection.r33() != previous.r33()));
+	if(mapCorrected ||
+	   stats.loopClosureId() != 0 ||
+	   stats.proximityDetectionId() != 0 ||
+	   uValue(stats.data(), Statistics::kLoopLandmark_detected(), 0.0f) != 0.0f ||
+	   uValue(stats.data(), Statistics::kMemorySignatures_retrieved(), 0.0f) != 0.0f)
+	{
+		// graph optimized or nodes retrieved from long-term memory
+		++graphRevision_;
+	}
+	graphRevisionMapCorrection_ = mapCorrection;
+}
+
+void CoreWrapper::updateGlobalDescriptorIndex()
+{
+	// called with memoryMutex_ locked, after rtabmap processed a frame
+	const rtabmap::Statistics & stats = rtabmap_.getStatistics();
+	for(std::map<int, int>::const_iterator iter=stats.reducedIds().begin(); iter!=stats.reducedIds().end(); ++iter)
+	{
+		globalDescriptorIndex_.erase(iter->first);
+	}
+	// In localization mode, the new node is not kept in the map
+	if(rtabmap_.getMemory() && rtabmap_.getMemory()->isIncremental())
+	{
+		const Signature * s = rtabmap_.getMemory()->getLastWorkingSignature();
+		if(s && !s->sensorData().globalDescriptors().empty() && !globalDescriptorIndex_.contains(s->id()))
+		{
+			globalDescriptorIndex_.add(s->id(), s->sensorData().globalDescriptors()[0].data());
+		}
+	}
+}
+
+bool CoreWrapper::getNodesByDescriptorCallback(rtabmap_msgs::GetNodesByDescriptor::Request& req, rtabmap_msgs::GetNodesByDescriptor::Response& res)
+{
+	boost::mutex::scoped_lock memoryLock(memoryMutex_);
+	if(!globalDescriptorIndexSynced_ && rtabmap_.getMemory())
+	{
+		// Indexed once, updated incrementally afterwards
+		UTimer timer;
+		globalDescriptorIndex_.clear();
+		std::set<int> ids = rtabmap_.getMemory()->getAllSignatureIds();
+		for(std::set<int>::iterator iter=ids.begin(); iter!=ids.end(); ++iter)
+		{
+			Signature s = rtabmap_.getSignatureCopy(*iter, false, false, false, false, false, true);
+			if(!s.sensorData().globalDescriptors().empty())
+			{
+				globalDescriptorIndex_.add(s.id(), s.sensorData().globalDescriptors()[0].data());
+			}
+		}
+		globalDescriptorIndexSynced_ = true;
+		NODELET_INFO("Global descriptor index: %d/%d nodes indexed (%d lists, %fs)",
+				(int)globalDescriptorIndex_.size(), (int)ids.size(), (int)globalDescriptorIndex_.lists(), timer.ticks());
+	}
+
+	cv::Mat query;
+	int excludedId = 0;
+	if(!req.descriptor.data.empty())
+	{
+		query = rtabmap_conversions::globalDescriptorFromROS(req.descriptor).data();
+	}
+	else if(req.node_id > 0)
+	{
+		Signature s = rtabmap_.getSignatureCopy(req.node_id, false, false, false, false, false, true);
+		if(!s.sensorData().globalDescriptors().empty())
+		{
+			query = s.sensorData().globalDescriptors()[0].data();
+			excludedId = req.node_id;
+		}
+	}
+	if(query.empty())
+	{
+		NODELET_ERROR("Get nodes by descriptor: no query descriptor (node_id=%d)", req.node_id);
+		return false;
+	}
+
+	int k = req.k>0?req.k:10;
+	std::vector<std::pair<int, float> > results = globalDescriptorIndex_.search(query, excludedId>0?k+1:k);
+	for(size_t i=0; i<results.size() && (int)res.ids.size()<k; ++i)
+	{
+		if(results[i].first != excludedId)
+		{
+			res.ids.push_back(results[i].first);
+			res.distsSqr.push_back(results[i].second);
+		}
+	}
+	return true;
+}
+
+bool CoreWrapper::resyncMapDataDeltaCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&)
+{
+	NODELET_INFO("rtabmap: Resync of mapDataDelta requested");
+	boost::mutex::scoped_lock memoryLock(memoryMutex_);
+	publishMapDataDelta(
+		ros::Time::now(),
+		rtabmap_.getLocalOptimizedPoses(),
+		rtabmap_.getLocalConstraints(),
+		std::map<int, Signature>(),
+		rtabmap_.getMapCorrection(),
+		true);
+	return true;
+}
+
+void CoreWrapper::publishMapDataDelta(
+		const ros::Time & stamp,
+		const std::map<int, Transform> & poses,
+		const std::multimap<int, Link> & constraints,
+		const std::map<int, Signature> & signatures,
+		const Transform & mapToOdom,
+		bool full)
+{
+	boost::mutex::scoped_lock lock(mapDataDeltaMutex_);
+	if(mapDataDeltaResync_)
+	{
+		full = true;
+		mapDataDeltaResync_ = false;
+	}
+
+	rtabmap_msgs::MapDataDeltaPtr msg(new rtabmap_msgs::MapDataDelta);
+	msg->header.stamp = stamp;
+	msg->header.frame_id = mapFrameId_;
+	msg->seq = ++mapDataDeltaSeq_;
+	msg->full = full;
+	rtabmap_conversions::transformToGeometryMsg(mapToOdom, msg->mapToOdom);
+
+	if(full)
+	{
+		mapDataDeltaPoses_.clear();
+		mapDataDeltaLinks_.clear();
+	}
+
+	// removed nodes
+	for(std::map<int, Transform>::iterator iter=mapDataDeltaPoses_.begin(); iter!=mapDataDeltaPoses_.end();)
+	{
+		if(poses.find(iter->first) == poses.end())
+		{
+			msg->removedIds.push_back(iter->first);
+			mapDataDeltaPoses_.erase(iter++);
+		}
+		else
+		{
+			++iter;
+		}
+	}
+
+	// new nodes or nodes that moved more than the tolerance
+	for(std::map<int, Transform>::const_iterator iter=poses.begin(); iter!=poses.end(); ++iter)
+	{
+		std::map<int, Transform>::iterator jter = mapDataDeltaPoses_.find(iter->first);
+		if(jter != mapDataDeltaPoses_.end())
+		{
+			Transform t = jter->second.inverse() * iter->second;
+			float roll, pitch, yaw;
+			t.getEulerAngles(roll, pitch, yaw);
+			if(t.getNorm() <= mapDataDeltaLinearTolerance_ &&
+			   fabs(roll) <= mapDataDeltaAngularTolerance_ &&
+			   fabs(pitch) <= mapDataDeltaAngularTolerance_ &&
+			   fabs(yaw) <= mapDataDeltaAngularTolerance_)
+			{
+				continue;
+			}
+			jter->second = iter->second;
+		}
+		else
+		{
+			mapDataDeltaPoses_.insert(*iter);
+		}
+		msg->posesId.push_back(iter->first);
+		msg->poses.resize(msg->poses.size()+1);
+		rtabmap_conversions::transformToPoseMsg(iter->second, msg->poses.back());
+	}
+
+	// removed links
+	for(std::multimap<int, Link>::iterator iter=mapDataDeltaLinks_.begin(); iter!=mapDataDeltaLinks_.end();)
+	{
+		if(graph::findLink(constraints, iter->second.from(), iter->second.to(), false, iter->second.type()) == constraints.end())
+		{
+			if(poses.find(iter->second.from()) != poses.end() && poses.find(iter->second.to()) != poses.end())
+			{
+				msg->removedLinksFromId.push_back(iter->second.from());
+				msg->removedLinksToId.push_back(iter->second.to());
+			}
+			mapDataDeltaLinks_.erase(iter++);
+		}
+		else
+		{
+			++iter;
+		}
+	}
+
+	// new links
+	for(std::multimap<int, Link>::const_iterator iter=constraints.begin(); iter!=constraints.end(); ++iter)
+	{
+		if(graph::findLink(mapDataDeltaLinks_, iter->second.from(), iter->second.to(), false, iter->second.type()) == mapDataDeltaLinks_.end())
+		{
+			mapDataDeltaLinks_.insert(*iter);
+			msg->links.resize(msg->links.size()+1);
+			rtabmap_conversions::linkToROS(iter->second, msg->links.back());
+		}
+	}
+
+	// data of new nodes
+	nodesDataToROS(signatures, msg->nodes);
+
+	mapDataDeltaPub_.publish(msg);
+}
+
+void CoreWrapper::nodesDataToROS(const std::map<int, Signature> & signatures, std::vector<rtabmap_msgs::NodeData> & msgs)
+{
+	if(!nodeDataCache_.enabled())
+	{
+		rtabmap_conversions::nodesDataToROS(signatures, msgs, mapDataPacked_, 0, mapDataScanFloat16_, threadPool_.get());
+		return;
+	}
+
+	// Published signatures come with all their data
+	std::map<int, Signature> misses;
+	std::map<int, rtabmap_msgs::NodeData> hits;
+	for(std::map<int, Signature>::const_iterator iter=signatures.begin(); iter!=signatures.end(); ++iter)
+	{
+		rtabmap_msgs::NodeData & msg = hits[iter->first];
+		if(nodeDataCache_.get(iter->first, rtabmap_util::NodeDataCache::kAll, msg))
+		{
+			msg.weight = iter->second.getWeight();
+			msg.label = iter->second.getLabel();
+		}
+		else
+		{
+			hits.erase(iter->first);
+			misses.insert(*iter);
+		}
+	}
+
+	std::vector<rtabmap_msgs::NodeData> converted;
+	rtabmap_conversions::nodesDataToROS(misses, converted, mapDataPacked_, 0, mapDataScanFloat16_, threadPool_.get());
+	UASSERT(converted.size() == misses.size());
+
+	msgs.resize(signatures.size());
+	std::map<int, rtabmap_msgs::NodeData>::iterator hter = hits.begin();
+	std::vector<rtabmap_msgs::NodeData>::iterator cter = converted.begin();
+	for(size_t i=0; i<msgs.size(); ++i)
+	{
+		// both are sorted by id
+		if(cter == converted.end() || (hter != hits.end() && hter->first < cter->id))
+		{
+			std::swap(msgs[i], hter->second);
+			++hter;
+		}
+		else
+		{
+			nodeDataCache_.insert(cter->id, rtabmap_util::NodeDataCache::kAll, *cter);
+			std::swap(msgs[i], *cter);
+			++cter;
+		}
+	}
+}
+
 void CoreWrapper::publishStats(const ros::Time & stamp)
 {
 	UDEBUG("Publishing stats...");
 	const rtabmap::Statistics & stats = rtabmap_.getStatistics();
+	// don't serialize for shared memory if nobody reads it
+	bool shm = shmInfoMapData_.isOpen() && shmInfoMapData_.readers() > 0;
 
-	if(infoPub_.getNumSubscribers())
+	rtabmap_msgs::InfoPtr infoMsg;
+	if(infoPub_.getNumSubscribers() || shm)
 	{
 		//NODELET_INFO("Sending RtabmapInfo msg (last_id=%d)...", stat.refImageId());
-		rtabmap_msgs::InfoPtr msg(new rtabmap_msgs::Info);
-		msg->header.stamp = stamp;
-		msg->header.frame_id = mapFrameId_;
+		infoMsg.reset(new rtabmap_msgs::Info);
+		infoMsg->header.stamp = stamp;
+		infoMsg->header.frame_id = mapFrameId_;
 
-		rtabmap_conversions::infoToROS(stats, *msg);
-		infoPub_.publish(msg);
+		if(compactInfo_)
+		{
+			if(rtabmap_conversions::infoToROSCompact(stats, *infoMsg, infoStatsIds_, infoWithHypotheses_))
+			{
+				rtabmap_msgs::InfoPtr namesMsg(new rtabmap_msgs::Info);
+				namesMsg->header = infoMsg->header;
+				rtabmap_conversions::statsNamesToROS(infoStatsIds_, *namesMsg);
+				infoStatsNamesPub_.publish(namesMsg);
+			}
+		}
+		else
+		{
+			rtabmap_conversions::infoToROS(stats, *infoMsg);
+		}
+		if(infoPub_.getNumSubscribers())
+		{
+			infoPub_.publish(infoMsg);
+		}
 	}
 
-	if(mapDataPub_.getNumSubscribers())
+	rtabmap_msgs::MapDataPtr mapDataMsg;
+	if(mapDataPub_.getNumSubscribers() || shm)
 	{
-		rtabmap_msgs::MapDataPtr msg(new rtabmap_msgs::MapData);
-		msg->header.stamp = stamp;
-		msg->header.frame_id = mapFrameId_;
+		mapDataMsg.reset(new rtabmap_msgs::MapData);
+		mapDataMsg->header.stamp = stamp;
+		mapDataMsg->header.frame_id = mapFrameId_;
 
-		rtabmap_conversions::mapDataToROS(
+		rtabmap_conversions::mapGraphToROS(
 			stats.poses(),
 			stats.constraints(),
-			stats.getSignaturesData(),
 			stats.mapCorrection(),
-			*msg);
+			mapDataMsg->graph);
+		nodesDataToROS(stats.getSignaturesData(), mapDataMsg->nodes);
 
-		mapDataPub_.publish(msg);
+		if(mapDataPub_.getNumSubscribers())
+		{
+			mapDataPub_.publish(mapDataMsg);
+		}
+	}
+
+	if(shm)
+	{
+		std::vector<uint8_t> buffer;
+		rtabmap_sync::ShmRingBuffer::serialize(*infoMsg, buffer);
+		rtabmap_sync::ShmRingBuffer::serialize(*mapDataMsg, buffer);
+		if(!shmInfoMapData_.write(buffer))
+		{
+			NODELET_WARN_THROTTLE(5, "rtabmap: info and mapData (%d bytes) are too large for shared memory "
+					"(shm_transport_size=%d MB), they are only published on ROS topics.",
+					(int)buffer.size(), (int)(shmInfoMapData_.slotSize()/(1024*1024)));
+		}
+	}
+
+	if(mapDataDeltaPub_.getNumSubscribers() && !stats.poses().empty())
+	{
+		publishMapDataDelta(
+			stamp,
+			stats.poses(),
+			stats.constraints(),
+			stats.getSignaturesData(),
+			stats.mapCorrection(),
+			false);
 	}
 
 	if(mapGraphPub_.getNumSubscribers())
 	{
-		if(mapsManager_.isMapUpdated())
+		if(mapsThread_ || mapsManager_.isMapUpdated())
 		{
+			// With asynchronous maps update, we cannot know here if the map changed
 			graphLatched_ = false;
 		}
 		if(!(mapsManager_.isLatching() && graphLatched_))
@@ -4355,6 +6638,8 @@ void CoreWrapper::goalDoneCb(const actionlib::SimpleClientGoalState& state,
 		rtabmap_.clearPath(1);
 		currentMetricGoal_.setNull();
 		lastPublishedMetricGoal_.setNull();
+		lastPublishedLocalPath_.clear();
+		lastPublishedGlobalPath_.clear();
 		goalFrameId_.clear();
 		latestNodeWasReached_ = false;
 	}
@@ -4373,6 +6658,48 @@ void CoreWrapper::goalFeedbackCb(const move_base_msgs::MoveBaseFeedbackConstPtr&
 	//NODELET_INFO("Planning: feedback base_position = %s", basePosition.prettyPrint().c_str());
 }
 
+static bool pathChanged(
+		const std::vector<std::pair<int, Transform> > & previous,
+		const std::vector<std::pair<int, Transform> > & poses,
+		double linearTolerance,
+		double angularTolerance)
+{
+	if(previous.size() != poses.size())
+	{
+		return true;
+	}
+	for(size_t i=0; i<poses.size(); ++i)
+	{
+		if(previous[i].first != poses[i].first)
+		{
+			return true;
+		}
+		Transform delta = previous[i].second.inverse() * poses[i].second;
+		if(delta.getNorm() > linearTolerance || delta.getAngle() > angularTolerance)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+static void pathToROS(
+		const std::vector<std::pair<int, Transform> > & poses,
+		nav_msgs::Path & path,
+		rtabmap_msgs::Path & pathNodes)
+{
+	path.poses.resize(poses.size());
+	pathNodes.nodeIds.resize(poses.size());
+	pathNodes.poses.resize(poses.size());
+	for(size_t i=0; i<poses.size(); ++i)
+	{
+		path.poses[i].header = path.header;
+		rtabmap_conversions::transformToPoseMsg(poses[i].second, path.poses[i].pose);
+		pathNodes.poses[i] = path.poses[i].pose;
+		pathNodes.nodeIds[i] = poses[i].first;
+	}
+}
+
 void CoreWrapper::publishLocalPath(const ros::Time & stamp)
 {
 	if(rtabmap_.getPath().size())
@@ -4380,24 +6707,28 @@ void CoreWrapper::publishLocalPath(const ros::Time & stamp)
 		std::vector<std::pair<int, Transform> > poses = rtabmap_.getPathNextPoses();
 		if(poses.size())
 		{
-			if(localPathPub_.getNumSubscribers() || localPathNodesPub_.getNumSubscribers())
+			int subscribers = localPathPub_.getNumSubscribers() + localPathNodesPub_.getNumSubscribers();
+			if(subscribers)
 			{
+				if(pathUpdateTolerance_ > 0.0)
+				{
+					// Skip if the remaining path didn't move more than the tolerance
+					// since last publication (and nobody new is listening)
+					bool newSubscribers = subscribers > lastLocalPathSubscribers_;
+					lastLocalPathSubscribers_ = subscribers;
+					if(!newSubscribers &&
+					   !pathChanged(lastPublishedLocalPath_, poses, pathUpdateTolerance_, pathUpdateAngleTolerance_))
+					{
+						return;
+					}
+					lastPublishedLocalPath_ = poses;
+				}
+
 				nav_msgs::Path path;
 				rtabmap_msgs::Path pathNodes;
 				path.header.frame_id = pathNodes.header.frame_id = mapFrameId_;
 				path.header.stamp = pathNodes.header.stamp = stamp;
-				path.poses.resize(poses.size());
-				pathNodes.nodeIds.resize(poses.size());
-				pathNodes.poses.resize(poses.size());
-				int oi = 0;
-				for(std::vector<std::pair<int, Transform> >::iterator iter=poses.begin(); iter!=poses.end(); ++iter)
-				{
-					path.poses[oi].header = path.header;
-					rtabmap_conversions::transformToPoseMsg(iter->second, path.poses[oi].pose);
-					pathNodes.poses[oi] = path.poses[oi].pose;
-					pathNodes.nodeIds[oi] = iter->first;
-					++oi;
-				}
+				pathToROS(poses, path, pathNodes);
 				if(localPathPub_.getNumSubscribers())
 				{
 					localPathPub_.publish(path);
@@ -4413,7 +6744,8 @@ void CoreWrapper::publishLocalPath(const ros::Time & stamp)
 
 void CoreWrapper::publishGlobalPath(const ros::Time & stamp)
 {
-	if((globalPathPub_.getNumSubscribers() || globalPathNodesPub_.getNumSubscribers()) && rtabmap_.getPath().size())
+	int subscribers = globalPathPub_.getNumSubscribers() + globalPathNodesPub_.getNumSubscribers();
+	if(subscribers && rtabmap_.getPath().size())
 	{
 		Transform pose = uValue(rtabmap_.getLocalOptimizedPoses(), rtabmap_.getPathCurrentGoalId(), Transform());
 		if(!pose.isNull() && rtabmap_.getPathCurrentGoalIndex() < rtabmap_.getPath().size())
@@ -4421,21 +6753,11 @@ void CoreWrapper::publishGlobalPath(const ros::Time & stamp)
 			// transform the global path in the goal referential
 			Transform t = pose * rtabmap_.getPath().at(rtabmap_.getPathCurrentGoalIndex()).second.inverse();
 
-			nav_msgs::Path path;
-			rtabmap_msgs::Path pathNodes;
-			path.header.frame_id = pathNodes.header.frame_id = mapFrameId_;
-			path.header.stamp = pathNodes.header.stamp = stamp;
-			path.poses.resize(rtabmap_.getPath().size());
-			pathNodes.nodeIds.resize(rtabmap_.getPath().size());
-			pathNodes.poses.resize(rtabmap_.getPath().size());
-			int oi = 0;
+			std::vector<std::pair<int, Transform> > poses;
+			poses.reserve(rtabmap_.getPath().size()+1);
 			for(std::vector<std::pair<int, Transform> >::const_iterator iter=rtabmap_.getPath().begin(); iter!=rtabmap_.getPath().end(); ++iter)
 			{
-				path.poses[oi].header = path.header;
-				rtabmap_conversions::transformToPoseMsg(t*iter->second, path.poses[oi].pose);
-				pathNodes.poses[oi] = path.poses[oi].pose;
-				pathNodes.nodeIds[oi] = iter->first;
-				++oi;
+				poses.push_back(std::make_pair(iter->first, t*iter->second));
 			}
 			Transform goalLocalTransform = Transform::getIdentity();
 			if(!goalFrameId_.empty() && goalFrameId_.compare(frameId_) != 0)
@@ -4449,15 +6771,28 @@ void CoreWrapper::publishGlobalPath(const ros::Time & stamp)
 
 			if(!rtabmap_.getPathTransformToGoal().isIdentity() || !goalLocalTransform.isIdentity())
 			{
-				path.poses.resize(path.poses.size()+1);
-				path.poses[path.poses.size()-1].header = path.header;
-				pathNodes.nodeIds.resize(pathNodes.nodeIds.size()+1);
-				pathNodes.poses.resize(pathNodes.poses.size()+1);
-				Transform p = t * rtabmap_.getPath().back().second*rtabmap_.getPathTransformToGoal() * goalLocalTransform;
-				rtabmap_conversions::transformToPoseMsg(p, path.poses[path.poses.size()-1].pose);
-				pathNodes.poses[pathNodes.poses.size()-1] = path.poses[path.poses.size()-1].pose;
-				pathNodes.nodeIds[pathNodes.nodeIds.size()-1] = 0;
+				poses.push_back(std::make_pair(0, t * rtabmap_.getPath().back().second*rtabmap_.getPathTransformToGoal() * goalLocalTransform));
 			}
+
+			if(pathUpdateTolerance_ > 0.0)
+			{
+				// The whole path moves with the current goal's optimized
+				// pose, skip if it didn't move more than the tolerance
+				bool newSubscribers = subscribers > lastGlobalPathSubscribers_;
+				lastGlobalPathSubscribers_ = subscribers;
+				if(!newSubscribers &&
+				   !pathChanged(lastPublishedGlobalPath_, poses, pathUpdateTolerance_, pathUpdateAngleTolerance_))
+				{
+					return;
+				}
+				lastPublishedGlobalPath_ = poses;
+			}
+
+			nav_msgs::Path path;
+			rtabmap_msgs::Path pathNodes;
+			path.header.frame_id = pathNodes.header.frame_id = mapFrameId_;
+			path.header.stamp = pathNodes.header.stamp = stamp;
+			pathToROS(poses, path, pathNodes);
 			if(globalPathPub_.getNumSubscribers())
 			{
 				globalPathPub_.publish(path);
@@ -4476,6 +6811,8 @@ bool CoreWrapper::octomapBinaryCallback(
 		octomap_msgs::GetOctomap::Request  &req,
 		octomap_msgs::GetOctomap::Response &res)
 {
+	boost::mutex::scoped_lock mapsLock(mapsMutex_);
+	boost::mutex::scoped_lock memoryLock(memoryMutex_);
 	NODELET_INFO("Sending binary map data on service request");
 	res.map.header.frame_id = mapFrameId_;
 	res.map.header.stamp = ros::Time::now();
@@ -4488,15 +6825,15 @@ bool CoreWrapper::octomapBinaryCallback(
 
 	mapsManager_.updateMapCaches(poses, rtabmap_.getMemory(), false, true);
 
-	const rtabmap::OctoMap * octomap = mapsManager_.getOctomap();
-	bool success = octomap->octree()->size() && octomap_msgs::binaryMapToMsg(*octomap->octree(), res.map);
-	return success;
+	return mapsManager_.getOctomapBinaryMsg(res.map);
 }
 
 bool CoreWrapper::octomapFullCallback(
 		octomap_msgs::GetOctomap::Request  &req,
 		octomap_msgs::GetOctomap::Response &res)
 {
+	boost::mutex::scoped_lock mapsLock(mapsMutex_);
+	boost::mutex::scoped_lock memoryLock(memoryMutex_);
 	NODELET_INFO("Sending full map data on service request");
 	res.map.header.frame_id = mapFrameId_;
 	res.map.header.stamp = ros::Time::now();
@@ -4509,9 +6846,7 @@ bool CoreWrapper::octomapFullCallback(
 
 	mapsManager_.updateMapCaches(poses, rtabmap_.getMemory(), false, true);
 
-	const rtabmap::OctoMap * octomap = mapsManager_.getOctomap();
-	bool success = octomap->octree()->size() && octomap_msgs::fullMapToMsg(*octomap->octree(), res.map);
-	return success;
+	return mapsManager_.getOctomapFullMsg(res.map);
 }
 #endif
 #endif
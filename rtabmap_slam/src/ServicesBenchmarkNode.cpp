@@ -0,0 +1,265 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <ros/ros.h>
+#include <nodelet/loader.h>
+#include <nav_msgs/GetPlan.h>
+#include "rtabmap_msgs/GetNodesInRadius.h"
+#include <rtabmap/utilite/UStl.h>
+#include <rtabmap/utilite/UConversion.h>
+#include <rtabmap/utilite/UTimer.h>
+#include <opencv2/core/core.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+// Peak resident memory (VmHWM) or current one (VmRSS) of this process in MB
+static double processMemoryMB(const std::string & key)
+{
+	std::ifstream file("/proc/self/status");
+	std::string line;
+	while(std::getline(file, line))
+	{
+		if(line.compare(0, key.size(), key) == 0)
+		{
+			long kb = 0;
+			sscanf(line.c_str()+key.size(), "%ld", &kb);
+			return double(kb)/1024.0;
+		}
+	}
+	return 0.0;
+}
+
+static std::string statsToJson(std::vector<double> values)
+{
+	if(values.empty())
+	{
+		return "{\"count\": 0}";
+	}
+	std::sort(values.begin(), values.end());
+	double sum = 0.0;
+	for(size_t i=0; i<values.size(); ++i)
+	{
+		sum += values[i];
+	}
+	return uFormat("{\"count\": %d, \"mean\": %g, \"min\": %g, \"p50\": %g, \"p90\": %g, \"p99\": %g, \"max\": %g}",
+			(int)values.size(),
+			sum/double(values.size()),
+			values.front(),
+			values[std::min(values.size()-1, size_t(0.5*double(values.size()-1) + 0.5))],
+			values[std::min(values.size()-1, size_t(0.9*double(values.size()-1) + 0.5))],
+			values[std::min(values.size()-1, size_t(0.99*double(values.size()-1) + 0.5))],
+			values.back());
+}
+
+/**
+ * Load a database in a rtabmap nodelet of this process (localization
+ * mode, all nodes in working memory), then time "get_plan" and
+ * "get_nodes_in_radius" requests to random nodes of the graph. The
+ * report gives the loading time, the request times and the peak memory.
+ * With the databases generated by rtabmap_util/map_stress_benchmark, this
+ * shows how the services scale with the graph size. Parameters of the
+ * nodelet can be set in its namespace ("nodelet_name", default "rtabmap").
+ * Example:
+ *   services_benchmark _database_path:=synthetic_100000.db _queries:=200
+ */
+class ServicesBenchmark
+{
+public:
+	ServicesBenchmark() :
+		outputPath_("services_benchmark.json"),
+		nodeletName_("rtabmap"),
+		frameId_("map"),
+		queries_(100),
+		radius_(5.0),
+		k_(0),
+		tolerance_(1.0),
+		seed_(0)
+	{
+		ros::NodeHandle pnh("~");
+		pnh.param("database_path", databasePath_, databasePath_);
+		pnh.param("output", outputPath_, outputPath_);
+		pnh.param("nodelet_name", nodeletName_, nodeletName_);
+		pnh.param("frame_id", frameId_, frameId_);
+		pnh.param("queries", queries_, queries_);
+		pnh.param("radius", radius_, radius_);
+		pnh.param("k", k_, k_);
+		pnh.param("tolerance", tolerance_, tolerance_);
+		pnh.param("seed", seed_, seed_);
+
+		ROS_INFO("services_benchmark: database_path = %s", databasePath_.c_str());
+		ROS_INFO("services_benchmark: output        = %s", outputPath_.c_str());
+		ROS_INFO("services_benchmark: nodelet_name  = %s", nodeletName_.c_str());
+		ROS_INFO("services_benchmark: frame_id      = %s", frameId_.c_str());
+		ROS_INFO("services_benchmark: queries       = %d", queries_);
+		ROS_INFO("services_benchmark: radius        = %f m (k=%d)", radius_, k_);
+		ROS_INFO("services_benchmark: tolerance     = %f m", tolerance_);
+	}
+
+	bool run()
+	{
+		if(databasePath_.empty())
+		{
+			ROS_ERROR("services_benchmark: \"database_path\" parameter is required.");
+			return false;
+		}
+
+		// Localization mode with the whole graph in working memory, no inputs
+		ros::NodeHandle nodeletNh(nodeletName_);
+		setDefaultParam(nodeletNh, "database_path", databasePath_);
+		setDefaultParam(nodeletNh, "Mem/IncrementalMemory", std::string("false"));
+		setDefaultParam(nodeletNh, "Mem/InitWMWithAllNodes", std::string("true"));
+		setDefaultParam(nodeletNh, "subscribe_depth", false);
+		setDefaultParam(nodeletNh, "subscribe_rgb", false);
+		setDefaultParam(nodeletNh, "publish_tf", false);
+
+		double memoryStart = processMemoryMB("VmRSS:");
+		UTimer timer;
+		nodelet::Loader loader(false);
+		nodelet::M_string remappings;
+		nodelet::V_string argv;
+		if(!loader.load(nodeletName_, "rtabmap_slam/rtabmap", remappings, argv))
+		{
+			ROS_ERROR("services_benchmark: cannot load rtabmap nodelet.");
+			return false;
+		}
+		double loadTime = timer.ticks();
+		double memoryLoaded = processMemoryMB("VmRSS:") - memoryStart;
+		ROS_INFO("services_benchmark: database loaded in %f s (%f MB)", loadTime, memoryLoaded);
+
+		ros::NodeHandle nh;
+		ros::ServiceClient radiusClient = nh.serviceClient<rtabmap_msgs::GetNodesInRadius>("get_nodes_in_radius");
+		ros::ServiceClient planClient = nh.serviceClient<nav_msgs::GetPlan>("get_plan");
+		if(!radiusClient.waitForExistence(ros::Duration(10.0)) || !planClient.waitForExistence(ros::Duration(10.0)))
+		{
+			ROS_ERROR("services_benchmark: rtabmap services are not available.");
+			return false;
+		}
+
+		// all nodes of the graph, the goals are chosen among them
+		rtabmap_msgs::GetNodesInRadius all;
+		all.request.x = 1e-3f; // not the latest pose
+		all.request.radius = 1e9f;
+		timer.restart();
+		if(!radiusClient.call(all) || all.response.poses.empty())
+		{
+			ROS_ERROR("services_benchmark: the graph is empty, is the database loaded in localization mode?");
+			return false;
+		}
+		double allNodesTime = timer.ticks();
+		ROS_INFO("services_benchmark: %d nodes in the graph", (int)all.response.poses.size());
+
+		cv::RNG rng(seed_);
+		std::vector<double> radiusTimes, radiusCounts, planTimes, planLengths;
+		int planFailures = 0;
+		for(int i=0; i<queries_ && ros::ok(); ++i)
+		{
+			const geometry_msgs::Pose & target = all.response.poses[rng.uniform(0, (int)all.response.poses.size())];
+
+			rtabmap_msgs::GetNodesInRadius radius;
+			radius.request.x = target.position.x;
+			radius.request.y = target.position.y;
+			radius.request.z = target.position.z==0.0?1e-3f:target.position.z;
+			radius.request.radius = radius_;
+			radius.request.k = k_;
+			timer.restart();
+			if(radiusClient.call(radius))
+			{
+				radiusTimes.push_back(timer.ticks()*1000.0);
+				radiusCounts.push_back(radius.response.ids.size());
+			}
+
+			nav_msgs::GetPlan plan;
+			plan.request.goal.header.frame_id = frameId_;
+			plan.request.goal.pose = target;
+			plan.request.tolerance = tolerance_;
+			timer.restart();
+			if(planClient.call(plan) && !plan.response.plan.poses.empty())
+			{
+				planTimes.push_back(timer.ticks()*1000.0);
+				planLengths.push_back(plan.response.plan.poses.size());
+			}
+			else
+			{
+				++planFailures;
+			}
+		}
+		double peakMemory = processMemoryMB("VmHWM:");
+		loader.unload(nodeletName_);
+
+		FILE * file = fopen(outputPath_.c_str(), "w");
+		if(!file)
+		{
+			ROS_ERROR("services_benchmark: cannot write \"%s\"", outputPath_.c_str());
+			return false;
+		}
+		fprintf(file, "{\n");
+		fprintf(file, "  \"database\": \"%s\",\n", databasePath_.c_str());
+		fprintf(file, "  \"nodes\": %d,\n", (int)all.response.poses.size());
+		fprintf(file, "  \"load_s\": %f,\n", loadTime);
+		fprintf(file, "  \"load_memory_mb\": %f,\n", memoryLoaded);
+		fprintf(file, "  \"peak_memory_mb\": %f,\n", peakMemory);
+		fprintf(file, "  \"get_nodes_in_radius_all_ms\": %f,\n", allNodesTime*1000.0);
+		fprintf(file, "  \"get_nodes_in_radius_ms\": %s,\n", statsToJson(radiusTimes).c_str());
+		fprintf(file, "  \"get_nodes_in_radius_results\": %s,\n", statsToJson(radiusCounts).c_str());
+		fprintf(file, "  \"get_plan_ms\": %s,\n", statsToJson(planTimes).c_str());
+		fprintf(file, "  \"get_plan_poses\": %s,\n", statsToJson(planLengths).c_str());
+		fprintf(file, "  \"get_plan_failures\": %d\n", planFailures);
+		fprintf(file, "}\n");
+		fclose(file);
+		ROS_INFO("services_benchmark: report written to \"%s\" (%d plan failures)", outputPath_.c_str(), planFailures);
+		return true;
+	}
+
+private:
+	template<class T>
+	static void setDefaultParam(ros::NodeHandle & nh, const std::string & name, const T & value)
+	{
+		if(!nh.hasParam(name))
+		{
+			nh.setParam(name, value);
+		}
+	}
+
+private:
+	std::string databasePath_;
+	std::string outputPath_;
+	std::string nodeletName_;
+	std::string frameId_;
+	int queries_;
+	double radius_;
+	int k_;
+	double tolerance_;
+	int seed_;
+};
+
+int main(int argc, char** argv)
+{
+	ros::init(argc, argv, "services_benchmark");
+	ServicesBenchmark benchmark;
+	return benchmark.run()?0:1;
+}
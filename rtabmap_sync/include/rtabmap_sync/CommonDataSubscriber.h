@@ -52,7 +52,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap_msgs/ScanDescriptor.h>
 #include <rtabmap_sync/CommonDataSubscriberDefines.h>
 
+#include <diagnostic_updater/diagnostic_updater.h>
+
 #include <boost/thread.hpp>
+#include <boost/type_traits/remove_const.hpp>
 
 namespace rtabmap_sync {
 
@@ -74,6 +77,9 @@ public:
 	int getQueueSize() const {return queueSize_;}
 	bool isApproxSync() const {return approxSync_;}
 	const std::string & name() const {return name_;}
+	// Input messages received but not synchronized (queue overflow or
+	// rejected by approx_sync_max_interval), summed over all inputs
+	unsigned long syncDropped();
 
 protected:
 	void setupCallbacks(
@@ -123,7 +129,30 @@ protected:
 
 private:
 	void warningLoop();
-	void callbackCalled() {callbackCalled_ = true;}
+	void callbackCalled();
+
+	// Synchronization statistics
+	template<class F>
+	void addInputStats(F & sub)
+	{
+		typedef typename boost::remove_const<typename F::MConstPtr::element_type>::type M;
+		if(!sub.getTopic().empty())
+		{
+			InputStats stats;
+			stats.topic = sub.getTopic();
+			inputStats_.push_back(stats);
+			sub.registerCallback(boost::bind(&CommonDataSubscriber::inputCallback<M>, this, inputStats_.size()-1, boost::placeholders::_1));
+		}
+	}
+	template<class M>
+	void inputCallback(size_t index, const boost::shared_ptr<M const> & msg)
+	{
+		boost::mutex::scoped_lock lock(syncStatsMutex_);
+		++inputStats_[index].received;
+		inputStats_[index].lastStamp = ros::message_traits::TimeStamp<M>::value(*msg);
+	}
+	void syncDiagnostic(diagnostic_updater::DiagnosticStatusWrapper & stat);
+	void diagnosticTimerCallback(const ros::TimerEvent &);
 	void setupDepthCallbacks(
 			ros::NodeHandle & nh,
 			ros::NodeHandle & pnh,
@@ -269,6 +298,22 @@ private:
 	bool subscribedToOdomInfo_;
 	std::string name_;
 
+	struct InputStats
+	{
+		InputStats() : received(0) {}
+		std::string topic;
+		unsigned long received;
+		ros::Time lastStamp;
+	};
+	boost::mutex syncStatsMutex_;
+	std::vector<InputStats> inputStats_;
+	unsigned long syncMatched_;
+	std::vector<unsigned long> syncSkewHistogram_;
+	double syncSkewMax_;
+	double syncSkewSum_;
+	diagnostic_updater::Updater * diagnosticUpdater_;
+	ros::Timer diagnosticTimer_;
+
 	//for depth and rgb-only callbacks
 	image_transport::SubscriberFilter imageSub_;
 	image_transport::SubscriberFilter imageDepthSub_;
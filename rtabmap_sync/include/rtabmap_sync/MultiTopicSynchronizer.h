@@ -0,0 +1,261 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef INCLUDE_RTABMAP_SYNC_MULTITOPICSYNCHRONIZER_H_
+#define INCLUDE_RTABMAP_SYNC_MULTITOPICSYNCHRONIZER_H_
+
+#include <ros/time.h>
+#include <ros/message_traits.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+namespace rtabmap_sync {
+
+/**
+ * Synchronize any number of topics of the same message type. Each input
+ * has a fixed-size buffer (queue_size) of message pointers (messages are
+ * not copied). Matching is linear in the number of inputs and queue size,
+ * instead of the combinatorial search of message_filters' ApproximateTime
+ * policy, so it scales to many cameras.
+ *
+ * Approximate mode: when all inputs have at least one message, the pivot
+ * is the most recent of the oldest messages of each input; the message
+ * closest to the pivot is selected in each input (waiting for a newer
+ * message if the closest one could still be beaten). If the selected
+ * messages span more than the max interval, the oldest one is dropped.
+ * Exact mode: messages must all have the same stamp.
+ */
+template<class M>
+class MultiTopicSynchronizer
+{
+public:
+	typedef boost::shared_ptr<M const> MConstPtr;
+	typedef boost::function<void (const std::vector<MConstPtr> &)> Callback;
+
+	MultiTopicSynchronizer(size_t inputs, size_t queueSize, bool approximate, const Callback & callback) :
+		buffers_(inputs),
+		starts_(inputs, 0),
+		sizes_(inputs, 0),
+		queueSize_(queueSize>0?queueSize:1),
+		approximate_(approximate),
+		maxInterval_(0.0),
+		callback_(callback),
+		dropped_(0)
+	{
+		for(size_t i=0; i<buffers_.size(); ++i)
+		{
+			buffers_[i].resize(queueSize_);
+		}
+	}
+
+	void setMaxIntervalDuration(const ros::Duration & maxInterval) {maxInterval_ = maxInterval.toSec();}
+	size_t inputs() const {return buffers_.size();}
+	// Number of messages dropped without being synchronized
+	unsigned long dropped() const
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		return dropped_;
+	}
+
+	void add(size_t input, const MConstPtr & msg)
+	{
+		// Matched sets are collected under the lock and the callback is
+		// called after releasing it, so that other inputs are not blocked
+		// while the callback processes/publishes them.
+		std::vector<std::vector<MConstPtr> > matchedSets;
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			if(input >= buffers_.size())
+			{
+				return;
+			}
+			if(sizes_[input] == queueSize_)
+			{
+				pop(input);
+				++dropped_;
+			}
+			at(input, sizes_[input]++) = msg;
+
+			std::vector<MConstPtr> matched;
+			while(approximate_?matchApproximate(matched):matchExact(matched))
+			{
+				matchedSets.push_back(matched);
+				matched.clear();
+			}
+		}
+		for(size_t i=0; i<matchedSets.size(); ++i)
+		{
+			callback_(matchedSets[i]);
+		}
+	}
+
+private:
+	static double stampOf(const MConstPtr & msg)
+	{
+		return ros::message_traits::TimeStamp<M>::value(*msg).toSec();
+	}
+
+	MConstPtr & at(size_t input, size_t i)
+	{
+		return buffers_[input][(starts_[input]+i)%queueSize_];
+	}
+
+	void pop(size_t input, size_t count = 1)
+	{
+		for(size_t i=0; i<count && sizes_[input]; ++i)
+		{
+			at(input, 0).reset();
+			starts_[input] = (starts_[input]+1)%queueSize_;
+			--sizes_[input];
+		}
+	}
+
+	bool allInputsReady() const
+	{
+		for(size_t i=0; i<sizes_.size(); ++i)
+		{
+			if(sizes_[i] == 0)
+			{
+				return false;
+			}
+		}
+		return !sizes_.empty();
+	}
+
+	bool matchExact(std::vector<MConstPtr> & matched)
+	{
+		while(allInputsReady())
+		{
+			double pivot = stampOf(at(0,0));
+			for(size_t i=1; i<buffers_.size(); ++i)
+			{
+				pivot = std::max(pivot, stampOf(at(i,0)));
+			}
+			bool allEqual = true;
+			for(size_t i=0; i<buffers_.size(); ++i)
+			{
+				while(sizes_[i] && stampOf(at(i,0)) < pivot)
+				{
+					pop(i);
+					++dropped_;
+				}
+				allEqual = allEqual && sizes_[i] && stampOf(at(i,0)) == pivot;
+			}
+			if(allEqual)
+			{
+				matched.resize(buffers_.size());
+				for(size_t i=0; i<buffers_.size(); ++i)
+				{
+					matched[i] = at(i,0);
+					pop(i);
+				}
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool matchApproximate(std::vector<MConstPtr> & matched)
+	{
+		while(allInputsReady())
+		{
+			double pivot = stampOf(at(0,0));
+			for(size_t i=1; i<buffers_.size(); ++i)
+			{
+				pivot = std::max(pivot, stampOf(at(i,0)));
+			}
+
+			std::vector<size_t> selected(buffers_.size());
+			double minStamp = pivot;
+			double maxStamp = pivot;
+			size_t oldest = 0;
+			for(size_t i=0; i<buffers_.size(); ++i)
+			{
+				size_t best = 0;
+				double bestDiff = fabs(stampOf(at(i,0)) - pivot);
+				for(size_t j=1; j<sizes_[i]; ++j)
+				{
+					double diff = fabs(stampOf(at(i,j)) - pivot);
+					if(diff > bestDiff)
+					{
+						break; // stamps are increasing
+					}
+					best = j;
+					bestDiff = diff;
+				}
+				double stamp = stampOf(at(i,best));
+				if(best == sizes_[i]-1 && stamp < pivot && sizes_[i] < queueSize_)
+				{
+					// a newer message could be closer to pivot
+					return false;
+				}
+				selected[i] = best;
+				if(stamp < minStamp)
+				{
+					minStamp = stamp;
+					oldest = i;
+				}
+				maxStamp = std::max(maxStamp, stamp);
+			}
+
+			if(maxInterval_ > 0.0 && maxStamp - minStamp > maxInterval_)
+			{
+				pop(oldest, selected[oldest]+1);
+				dropped_ += selected[oldest]+1;
+				continue;
+			}
+
+			matched.resize(buffers_.size());
+			for(size_t i=0; i<buffers_.size(); ++i)
+			{
+				matched[i] = at(i, selected[i]);
+				dropped_ += selected[i];
+				pop(i, selected[i]+1);
+			}
+			return true;
+		}
+		return false;
+	}
+
+private:
+	std::vector<std::vector<MConstPtr> > buffers_;
+	std::vector<size_t> starts_;
+	std::vector<size_t> sizes_;
+	size_t queueSize_;
+	bool approximate_;
+	double maxInterval_;
+	Callback callback_;
+	unsigned long dropped_;
+	mutable boost::mutex mutex_;
+};
+
+}
+
+#endif /* INCLUDE_RTABMAP_SYNC_MULTITOPICSYNCHRONIZER_H_ */
@@ -0,0 +1,155 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef INCLUDE_RTABMAP_SYNC_SHMRINGBUFFER_H_
+#define INCLUDE_RTABMAP_SYNC_SHMRINGBUFFER_H_
+
+#include <ros/serialization.h>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace rtabmap_sync {
+
+/**
+ * Ring buffer of serialized messages in a named shared memory segment, used
+ * to exchange large messages between two nodes running on the same host
+ * without going through the ROS TCP transport. There is a single writer,
+ * which owns the segment, and any number of readers. Readers get every
+ * message in order, unless they lag more than the number of slots behind,
+ * in which case the oldest ones are dropped. Messages are copied without
+ * holding the segment's mutex (each slot has a sequence number checked
+ * after the copy), so that a process crashing while copying cannot block
+ * the others.
+ */
+class ShmRingBuffer
+{
+public:
+	ShmRingBuffer();
+	~ShmRingBuffer();
+
+	/**
+	 * Create the segment as writer, replacing any stale segment with the same name.
+	 */
+	bool create(const std::string & name, unsigned int slots, size_t slotSize);
+
+	/**
+	 * Open an existing segment as reader. Fails if there is no segment
+	 * or if the process that created it is not running anymore.
+	 */
+	bool open(const std::string & name);
+
+	void close();
+	bool isOpen() const {return header_ != 0;}
+	bool isWriter() const {return writer_;}
+	const std::string & name() const {return name_;}
+	size_t slotSize() const;
+
+	/**
+	 * Writer: number of readers having the segment open. Readers that
+	 * crashed without closing it are not counted.
+	 */
+	unsigned int readers() const;
+
+	/**
+	 * Writer: copy a message in the next slot and wake up the readers.
+	 * Returns false if the message is larger than a slot.
+	 */
+	bool write(const std::vector<uint8_t> & data);
+
+	/**
+	 * Reader: wait up to timeout (sec) for the next message.
+	 * Returns false on timeout or if the size stored in the slot is invalid.
+	 * If not null, dropped is set to the number of messages that were
+	 * overwritten before they could be read.
+	 */
+	bool read(std::vector<uint8_t> & data, double timeout, unsigned int * dropped = 0);
+
+	bool isWriterAlive() const;
+
+	/**
+	 * Segment name to use for a resolved topic name.
+	 */
+	static std::string segmentName(const std::string & topic);
+
+	/**
+	 * Append a message to a buffer, prefixed by its length.
+	 */
+	template<typename M>
+	static void serialize(const M & msg, std::vector<uint8_t> & buffer)
+	{
+		uint32_t length = ros::serialization::serializationLength(msg);
+		size_t offset = buffer.size();
+		buffer.resize(offset + sizeof(uint32_t) + length);
+		memcpy(&buffer[offset], &length, sizeof(uint32_t));
+		ros::serialization::OStream stream(&buffer[offset+sizeof(uint32_t)], length);
+		ros::serialization::serialize(stream, msg);
+	}
+
+	/**
+	 * Read a message serialized with serialize() at offset, which is
+	 * moved after the message. Returns false if the buffer is too small.
+	 */
+	template<typename M>
+	static bool deserialize(const std::vector<uint8_t> & buffer, size_t & offset, M & msg)
+	{
+		uint32_t length = 0;
+		if(offset + sizeof(uint32_t) > buffer.size())
+		{
+			return false;
+		}
+		memcpy(&length, &buffer[offset], sizeof(uint32_t));
+		offset += sizeof(uint32_t);
+		if(offset + length > buffer.size())
+		{
+			return false;
+		}
+		ros::serialization::IStream stream(const_cast<uint8_t*>(&buffer[offset]), length);
+		ros::serialization::deserialize(stream, msg);
+		offset += length;
+		return true;
+	}
+
+private:
+	struct Header;
+	uint8_t * slot(uint64_t sequence) const;
+
+private:
+	std::string name_;
+	boost::scoped_ptr<boost::interprocess::shared_memory_object> shm_;
+	boost::scoped_ptr<boost::interprocess::mapped_region> region_;
+	Header * header_;
+	bool writer_;
+	uint64_t lastSequence_;
+	int readerSlot_;
+};
+
+}
+
+#endif /* INCLUDE_RTABMAP_SYNC_SHMRINGBUFFER_H_ */
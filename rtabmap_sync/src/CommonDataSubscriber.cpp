@@ -43,6 +43,11 @@ CommonDataSubscriber::CommonDataSubscriber(bool gui) :
 		subscribedToScan3d_(false),
 		subscribedToScanDescriptor_(false),
 		subscribedToOdomInfo_(false),
+		syncMatched_(0),
+		syncSkewHistogram_(7, 0),
+		syncSkewMax_(0.0),
+		syncSkewSum_(0.0),
+		diagnosticUpdater_(0),
 
 		// RGB + Depth
 		SYNC_INIT(depth),
@@ -663,6 +668,31 @@ void CommonDataSubscriber::setupCallbacks(
 	{
 		warningThread_ = new boost::thread(boost::bind(&CommonDataSubscriber::warningLoop, this));
 		ROS_INFO("%s", subscribedTopicsMsg_.c_str());
+
+		// Synchronized inputs
+		addInputStats(imageSub_);
+		addInputStats(imageDepthSub_);
+		addInputStats(cameraInfoSub_);
+		for(size_t i=0; i<rgbdSubs_.size(); ++i)
+		{
+			addInputStats(*rgbdSubs_[i]);
+		}
+		addInputStats(rgbdXSub_);
+		addInputStats(imageRectLeft_);
+		addInputStats(imageRectRight_);
+		addInputStats(cameraInfoLeft_);
+		addInputStats(cameraInfoRight_);
+		addInputStats(odomSub_);
+		addInputStats(userDataSub_);
+		addInputStats(scanSub_);
+		addInputStats(scan3dSub_);
+		addInputStats(scanDescSub_);
+		addInputStats(odomInfoSub_);
+
+		diagnosticUpdater_ = new diagnostic_updater::Updater(nh, pnh);
+		diagnosticUpdater_->setHardwareID("none");
+		diagnosticUpdater_->add(name_ + ": synchronization", this, &CommonDataSubscriber::syncDiagnostic);
+		diagnosticTimer_ = nh.createTimer(ros::Duration(1.0), &CommonDataSubscriber::diagnosticTimerCallback, this);
 	}
 }
 
@@ -670,11 +700,14 @@ CommonDataSubscriber::~CommonDataSubscriber()
 {
 	if(warningThread_)
 	{
-		callbackCalled();
+		callbackCalled_ = true;
 		warningThread_->join();
 		delete warningThread_;
 	}
 
+	diagnosticTimer_.stop();
+	delete diagnosticUpdater_;
+
 	// RGB + Depth
 	SYNC_DEL(depth);
 	SYNC_DEL(depthScan2d);
@@ -1011,6 +1044,90 @@ void CommonDataSubscriber::warningLoop()
 	}
 }
 
+void CommonDataSubscriber::callbackCalled()
+{
+	callbackCalled_ = true;
+
+	boost::mutex::scoped_lock lock(syncStatsMutex_);
+	++syncMatched_;
+	if(inputStats_.size() > 1)
+	{
+		// skew between the latest stamps received on each synchronized input
+		ros::Time minStamp, maxStamp;
+		for(size_t i=0; i<inputStats_.size(); ++i)
+		{
+			const ros::Time & stamp = inputStats_[i].lastStamp;
+			if(!stamp.isZero())
+			{
+				if(minStamp.isZero() || stamp < minStamp) minStamp = stamp;
+				if(maxStamp.isZero() || stamp > maxStamp) maxStamp = stamp;
+			}
+		}
+		double skew = (maxStamp - minStamp).toSec();
+		static const double bins[] = {0.001, 0.005, 0.01, 0.02, 0.05, 0.1};
+		size_t bin = 0;
+		while(bin < 6 && skew >= bins[bin])
+		{
+			++bin;
+		}
+		++syncSkewHistogram_[bin];
+		syncSkewSum_ += skew;
+		syncSkewMax_ = std::max(syncSkewMax_, skew);
+	}
+}
+
+unsigned long CommonDataSubscriber::syncDropped()
+{
+	boost::mutex::scoped_lock lock(syncStatsMutex_);
+	unsigned long dropped = 0;
+	for(size_t i=0; i<inputStats_.size(); ++i)
+	{
+		if(inputStats_[i].received > syncMatched_)
+		{
+			dropped += inputStats_[i].received - syncMatched_;
+		}
+	}
+	return dropped;
+}
+
+void CommonDataSubscriber::diagnosticTimerCallback(const ros::TimerEvent &)
+{
+	diagnosticUpdater_->update();
+}
+
+void CommonDataSubscriber::syncDiagnostic(diagnostic_updater::DiagnosticStatusWrapper & stat)
+{
+	boost::mutex::scoped_lock lock(syncStatsMutex_);
+	if(!callbackCalled_)
+	{
+		stat.summary(diagnostic_msgs::DiagnosticStatus::WARN, "No synchronized data received yet");
+	}
+	else
+	{
+		stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "Synchronizing");
+	}
+	stat.add("Sync", approxSync_?"approximate":"exact");
+	stat.add("Queue size", queueSize_);
+	stat.add("Matched", syncMatched_);
+	for(size_t i=0; i<inputStats_.size(); ++i)
+	{
+		// messages received but not synchronized (queue overflow or
+		// rejected by approx_sync_max_interval)
+		long dropped = (long)inputStats_[i].received - (long)syncMatched_;
+		stat.addf(inputStats_[i].topic + " received/dropped", "%lu/%ld", inputStats_[i].received, dropped>0?dropped:0);
+	}
+	if(inputStats_.size() > 1)
+	{
+		stat.addf("Skew mean (ms)", "%.2f", syncMatched_?syncSkewSum_/double(syncMatched_)*1000.0:0.0);
+		stat.addf("Skew max (ms)", "%.2f", syncSkewMax_*1000.0);
+		const char * labels[] = {"<1", "1-5", "5-10", "10-20", "20-50", "50-100", ">100"};
+		for(size_t i=0; i<syncSkewHistogram_.size(); ++i)
+		{
+			stat.addf(std::string("Skew ") + labels[i] + " ms", "%lu", syncSkewHistogram_[i]);
+		}
+	}
+}
+
 void CommonDataSubscriber::commonSingleCameraCallback(
 		const nav_msgs::OdometryConstPtr & odomMsg,
 		const rtabmap_msgs::UserDataConstPtr & userDataMsg,
@@ -0,0 +1,404 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <rtabmap_sync/ShmRingBuffer.h>
+#include <boost/interprocess/sync/interprocess_mutex.hpp>
+#include <boost/interprocess/sync/interprocess_condition.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <ros/console.h>
+#include <atomic>
+#include <errno.h>
+#ifndef _WIN32
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+namespace rtabmap_sync {
+
+static const uint32_t kShmMagic = 0x52544d32; // "RTM2"
+static const int kShmMaxReaders = 16;
+
+struct ShmRingBuffer::Header
+{
+	// The mutex is only held to wait for/notify new messages
+	boost::interprocess::interprocess_mutex mutex;
+	boost::interprocess::interprocess_condition cond;
+	std::atomic<uint32_t> magic;
+	uint32_t slots;
+	uint64_t slotSize;
+	std::atomic<uint64_t> sequence; // number of messages written
+	int32_t writerPid;
+	std::atomic<int32_t> readerPids[kShmMaxReaders]; // 0 for free entries
+};
+
+// Each slot is a sequence number and a size followed by the data. The
+// slot's sequence number is 0 while the writer is copying in the slot.
+static const size_t kSlotHeaderSize = 2*sizeof(uint64_t);
+
+static size_t align8(size_t size)
+{
+	return (size + 7) & ~size_t(7);
+}
+
+static int32_t processId()
+{
+#ifndef _WIN32
+	return getpid();
+#else
+	return 1;
+#endif
+}
+
+static bool isProcessAlive(int32_t pid)
+{
+#ifndef _WIN32
+	return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+#else
+	return pid > 0;
+#endif
+}
+
+ShmRingBuffer::ShmRingBuffer() :
+	header_(0),
+	writer_(false),
+	lastSequence_(0),
+	readerSlot_(-1)
+{
+}
+
+ShmRingBuffer::~ShmRingBuffer()
+{
+	close();
+}
+
+bool ShmRingBuffer::create(const std::string & name, unsigned int slots, size_t slotSize)
+{
+	close();
+	if(slots == 0 || slotSize == 0)
+	{
+		return false;
+	}
+	slotSize = align8(slotSize);
+	try
+	{
+		boost::interprocess::shared_memory_object::remove(name.c_str());
+		shm_.reset(new boost::interprocess::shared_memory_object(
+				boost::interprocess::create_only, name.c_str(), boost::interprocess::read_write));
+		shm_->truncate(align8(sizeof(Header)) + slots*(kSlotHeaderSize + slotSize));
+		region_.reset(new boost::interprocess::mapped_region(*shm_, boost::interprocess::read_write));
+	}
+	catch(const boost::interprocess::interprocess_exception & e)
+	{
+		ROS_ERROR("Cannot create shared memory segment \"%s\": %s", name.c_str(), e.what());
+		region_.reset();
+		shm_.reset();
+		return false;
+	}
+	header_ = new (region_->get_address()) Header;
+	header_->slots = slots;
+	header_->slotSize = slotSize;
+	header_->sequence.store(0);
+	header_->writerPid = processId();
+	for(int i=0; i<kShmMaxReaders; ++i)
+	{
+		header_->readerPids[i].store(0);
+	}
+	name_ = name;
+	writer_ = true;
+	lastSequence_ = 0;
+	for(unsigned int i=1; i<=slots; ++i)
+	{
+		new (slot(i)) std::atomic<uint64_t>(0);
+	}
+	header_->magic.store(kShmMagic, std::memory_order_release);
+	return true;
+}
+
+bool ShmRingBuffer::open(const std::string & name)
+{
+	close();
+	try
+	{
+		shm_.reset(new boost::interprocess::shared_memory_object(
+				boost::interprocess::open_only, name.c_str(), boost::interprocess::read_write));
+		region_.reset(new boost::interprocess::mapped_region(*shm_, boost::interprocess::read_write));
+	}
+	catch(const boost::interprocess::interprocess_exception & e)
+	{
+		// no segment, the writer is on another host or not started
+		region_.reset();
+		shm_.reset();
+		return false;
+	}
+	Header * header = (Header *)region_->get_address();
+	if(region_->get_size() < align8(sizeof(Header)) || header->magic.load(std::memory_order_acquire) != kShmMagic)
+	{
+		region_.reset();
+		shm_.reset();
+		return false;
+	}
+	// Don't trust the header: the slots should fit in the mapped segment
+	size_t available = region_->get_size() - align8(sizeof(Header));
+	if(header->slots == 0 ||
+	   header->slotSize == 0 ||
+	   header->slotSize > available ||
+	   available / (kSlotHeaderSize + header->slotSize) < header->slots)
+	{
+		ROS_ERROR("Shared memory segment \"%s\" is invalid (slots=%u, slot size=%lu, segment size=%lu).",
+				name.c_str(), header->slots, (unsigned long)header->slotSize, (unsigned long)region_->get_size());
+		region_.reset();
+		shm_.reset();
+		return false;
+	}
+	header_ = header;
+	name_ = name;
+	writer_ = false;
+	if(!isWriterAlive())
+	{
+		close();
+		return false;
+	}
+	int32_t pid = processId();
+	for(int i=0; i<kShmMaxReaders && readerSlot_<0; ++i)
+	{
+		int32_t expected = 0;
+		if(header_->readerPids[i].compare_exchange_strong(expected, pid))
+		{
+			readerSlot_ = i;
+		}
+	}
+	lastSequence_ = header_->sequence.load(std::memory_order_acquire);
+	return true;
+}
+
+void ShmRingBuffer::close()
+{
+	if(header_ && writer_)
+	{
+		header_->magic.store(0);
+		header_->writerPid = 0;
+		{
+			// Don't wait for a process that crashed while holding the mutex
+			boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock(header_->mutex,
+					boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(100));
+		}
+		header_->cond.notify_all();
+	}
+	else if(header_ && readerSlot_ >= 0)
+	{
+		header_->readerPids[readerSlot_].store(0);
+	}
+	header_ = 0;
+	region_.reset();
+	shm_.reset();
+	if(writer_)
+	{
+		boost::interprocess::shared_memory_object::remove(name_.c_str());
+	}
+	writer_ = false;
+	name_.clear();
+	lastSequence_ = 0;
+	readerSlot_ = -1;
+}
+
+size_t ShmRingBuffer::slotSize() const
+{
+	return header_?header_->slotSize:0;
+}
+
+unsigned int ShmRingBuffer::readers() const
+{
+	if(!header_)
+	{
+		return 0;
+	}
+	unsigned int count = 0;
+	for(int i=0; i<kShmMaxReaders; ++i)
+	{
+		int32_t pid = header_->readerPids[i].load();
+		if(pid != 0)
+		{
+			if(isProcessAlive(pid))
+			{
+				++count;
+			}
+			else
+			{
+				// reader crashed without closing the segment
+				header_->readerPids[i].compare_exchange_strong(pid, 0);
+			}
+		}
+	}
+	return count;
+}
+
+uint8_t * ShmRingBuffer::slot(uint64_t sequence) const
+{
+	return (uint8_t*)region_->get_address() +
+			align8(sizeof(Header)) +
+			((sequence-1) % header_->slots) * (kSlotHeaderSize + header_->slotSize);
+}
+
+bool ShmRingBuffer::write(const std::vector<uint8_t> & data)
+{
+	if(!header_ || !writer_ || data.size() > header_->slotSize)
+	{
+		return false;
+	}
+	// Single writer: only this process modifies the sequence
+	uint64_t sequence = header_->sequence.load(std::memory_order_relaxed) + 1;
+	uint8_t * s = slot(sequence);
+	std::atomic<uint64_t> * slotSequence = (std::atomic<uint64_t> *)s;
+	uint64_t size = data.size();
+	slotSequence->store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(s+sizeof(uint64_t), &size, sizeof(uint64_t));
+	if(size)
+	{
+		memcpy(s+kSlotHeaderSize, &data[0], size);
+	}
+	slotSequence->store(sequence, std::memory_order_release);
+	header_->sequence.store(sequence, std::memory_order_release);
+	{
+		// Lock so that a reader cannot miss the notification between its
+		// sequence check and its wait. If a reader crashed while holding
+		// the mutex, readers poll the sequence instead.
+		boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock(header_->mutex,
+				boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(10));
+	}
+	header_->cond.notify_all();
+	return true;
+}
+
+bool ShmRingBuffer::read(std::vector<uint8_t> & data, double timeout, unsigned int * dropped)
+{
+	if(dropped)
+	{
+		*dropped = 0;
+	}
+	if(!header_ || writer_)
+	{
+		return false;
+	}
+	boost::posix_time::ptime deadline = boost::posix_time::microsec_clock::universal_time() +
+			boost::posix_time::microseconds((long)(timeout*1000000.0));
+	while(header_->sequence.load(std::memory_order_acquire) == lastSequence_)
+	{
+		if(header_->magic.load() != kShmMagic ||
+		   boost::posix_time::microsec_clock::universal_time() >= deadline)
+		{
+			return false;
+		}
+		boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock(header_->mutex, boost::interprocess::defer_lock);
+		if(lock.timed_lock(boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(10)))
+		{
+			if(header_->sequence.load(std::memory_order_acquire) == lastSequence_ && header_->magic.load() == kShmMagic)
+			{
+				header_->cond.timed_wait(lock, deadline);
+			}
+		}
+		// else the mutex is held by a process that crashed, poll the sequence
+	}
+
+	unsigned int overwritten = 0;
+	while(true)
+	{
+		uint64_t sequence = header_->sequence.load(std::memory_order_acquire);
+		if(header_->magic.load() != kShmMagic || sequence <= lastSequence_)
+		{
+			return false; // writer closed, or all messages were overwritten while copying
+		}
+
+		uint64_t next = lastSequence_ + 1;
+		uint64_t oldest = sequence > header_->slots?sequence - header_->slots + 1:1;
+		if(next < oldest)
+		{
+			overwritten += (unsigned int)(oldest - next);
+			next = oldest;
+		}
+		lastSequence_ = next;
+
+		// Copy outside the lock, then check that the writer didn't
+		// start to overwrite the slot in the meantime.
+		const uint8_t * s = slot(next);
+		const std::atomic<uint64_t> * slotSequence = (const std::atomic<uint64_t> *)s;
+		if(slotSequence->load(std::memory_order_acquire) != next)
+		{
+			++overwritten;
+			continue;
+		}
+		uint64_t size = 0;
+		memcpy(&size, s+sizeof(uint64_t), sizeof(uint64_t));
+		if(size <= header_->slotSize)
+		{
+			data.resize(size);
+			if(size)
+			{
+				memcpy(&data[0], s+kSlotHeaderSize, size);
+			}
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if(slotSequence->load(std::memory_order_relaxed) != next)
+		{
+			++overwritten;
+			continue;
+		}
+		if(dropped)
+		{
+			*dropped = overwritten;
+		}
+		if(size > header_->slotSize)
+		{
+			ROS_ERROR("Shared memory segment \"%s\": message %lu has an invalid size (%lu > slot size %lu), ignoring it.",
+					name_.c_str(), (unsigned long)next, (unsigned long)size, (unsigned long)header_->slotSize);
+			return false;
+		}
+		return true;
+	}
+}
+
+bool ShmRingBuffer::isWriterAlive() const
+{
+	if(!header_ || header_->magic.load() != kShmMagic)
+	{
+		return false;
+	}
+	return writer_ || isProcessAlive(header_->writerPid);
+}
+
+std::string ShmRingBuffer::segmentName(const std::string & topic)
+{
+	std::string name = "rtabmap";
+	for(size_t i=0; i<topic.size(); ++i)
+	{
+		name += topic[i]=='/'?'_':topic[i];
+	}
+	return name;
+}
+
+}
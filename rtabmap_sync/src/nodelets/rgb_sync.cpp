@@ -62,7 +62,9 @@ public:
 		warningThread_(0),
 		callbackCalled_(false),
 		approxSync_(0),
-		exactSync_(0)
+		exactSync_(0),
+		approxSyncCompressed_(0),
+		exactSyncCompressed_(0)
 	{}
 
 	virtual ~RgbSync()
@@ -71,6 +73,10 @@ public:
 			delete approxSync_;
 		if(exactSync_)
 			delete exactSync_;
+		if(approxSyncCompressed_)
+			delete approxSyncCompressed_;
+		if(exactSyncCompressed_)
+			delete exactSyncCompressed_;
 
 		if(warningThread_)
 		{
@@ -89,21 +95,42 @@ private:
 		int queueSize = 10;
 		bool approxSync = false;
 		double approxSyncMaxInterval = 0.0;
+		bool compressedPassthrough = false;
 		pnh.param("approx_sync", approxSync, approxSync);
 		pnh.param("approx_sync_max_interval", approxSyncMaxInterval, approxSyncMaxInterval);
 		pnh.param("queue_size", queueSize, queueSize);
 		pnh.param("compressed_rate", compressedRate_, compressedRate_);
+		pnh.param("compressed_passthrough", compressedPassthrough, compressedPassthrough);
 
 		NODELET_INFO("%s: approx_sync = %s", getName().c_str(), approxSync?"true":"false");
 		if(approxSync)
 			NODELET_INFO("%s: approx_sync_max_interval = %f", getName().c_str(), approxSyncMaxInterval);
 		NODELET_INFO("%s: queue_size  = %d", getName().c_str(), queueSize);
 		NODELET_INFO("%s: compressed_rate = %f", getName().c_str(), compressedRate_);
+		NODELET_INFO("%s: compressed_passthrough = %s", getName().c_str(), compressedPassthrough?"true":"false");
 
 		rgbdImagePub_ = nh.advertise<rtabmap_msgs::RGBDImage>("rgbd_image", 1);
 		rgbdImageCompressedPub_ = nh.advertise<rtabmap_msgs::RGBDImage>("rgbd_image/compressed", 1);
 
-		if(approxSync)
+		if(compressedPassthrough)
+		{
+			// Subscribe directly to the compressed topic: the compressed bytes
+			// are copied in rgb_compressed, the image is decoded only if
+			// the raw rgbd_image topic is subscribed.
+			if(approxSync)
+			{
+				approxSyncCompressed_ = new message_filters::Synchronizer<MyApproxCompressedSyncPolicy>(MyApproxCompressedSyncPolicy(queueSize), imageCompressedSub_, cameraInfoSub_);
+				if(approxSyncMaxInterval > 0.0)
+					approxSyncCompressed_->setMaxIntervalDuration(ros::Duration(approxSyncMaxInterval));
+				approxSyncCompressed_->registerCallback(boost::bind(&RgbSync::compressedCallback, this, boost::placeholders::_1, boost::placeholders::_2));
+			}
+			else
+			{
+				exactSyncCompressed_ = new message_filters::Synchronizer<MyExactCompressedSyncPolicy>(MyExactCompressedSyncPolicy(queueSize), imageCompressedSub_, cameraInfoSub_);
+				exactSyncCompressed_->registerCallback(boost::bind(&RgbSync::compressedCallback, this, boost::placeholders::_1, boost::placeholders::_2));
+			}
+		}
+		else if(approxSync)
 		{
 			approxSync_ = new message_filters::Synchronizer<MyApproxSyncPolicy>(MyApproxSyncPolicy(queueSize), imageSub_, cameraInfoSub_);
 			if(approxSyncMaxInterval > 0.0)
@@ -121,14 +148,21 @@ private:
 		image_transport::ImageTransport rgb_it(rgb_nh);
 		image_transport::TransportHints hintsRgb("raw", ros::TransportHints(), rgb_pnh);
 
-		imageSub_.subscribe(rgb_it, rgb_nh.resolveName("image_rect"), 1, hintsRgb);
+		if(compressedPassthrough)
+		{
+			imageCompressedSub_.subscribe(rgb_nh, rgb_nh.resolveName("image_rect") + "/compressed", 1);
+		}
+		else
+		{
+			imageSub_.subscribe(rgb_it, rgb_nh.resolveName("image_rect"), 1, hintsRgb);
+		}
 		cameraInfoSub_.subscribe(rgb_nh, "camera_info", 1);
 
 		std::string subscribedTopicsMsg = uFormat("\n%s subscribed to (%s sync%s):\n   %s \\\n   %s",
 							getName().c_str(),
 							approxSync?"approx":"exact",
 							approxSync&&approxSyncMaxInterval!=std::numeric_limits<double>::max()?uFormat(", max interval=%fs", approxSyncMaxInterval).c_str():"",
-							imageSub_.getTopic().c_str(),
+							compressedPassthrough?imageCompressedSub_.getTopic().c_str():imageSub_.getTopic().c_str(),
 							cameraInfoSub_.getTopic().c_str());
 
 		warningThread_ = new boost::thread(boost::bind(&RgbSync::warningLoop, this, subscribedTopicsMsg, approxSync));
@@ -157,15 +191,32 @@ private:
 	void callback(
 			  const sensor_msgs::ImageConstPtr& image,
 			  const sensor_msgs::CameraInfoConstPtr& cameraInfo)
+	{
+		processImage(image, sensor_msgs::CompressedImageConstPtr(), cameraInfo);
+	}
+
+	void compressedCallback(
+			  const sensor_msgs::CompressedImageConstPtr& imageCompressed,
+			  const sensor_msgs::CameraInfoConstPtr& cameraInfo)
+	{
+		processImage(sensor_msgs::ImageConstPtr(), imageCompressed, cameraInfo);
+	}
+
+	// Either image or imageCompressed is set
+	void processImage(
+			  const sensor_msgs::ImageConstPtr& image,
+			  const sensor_msgs::CompressedImageConstPtr& imageCompressed,
+			  const sensor_msgs::CameraInfoConstPtr& cameraInfo)
 	{
 		callbackCalled_ = true;
 		if(rgbdImagePub_.getNumSubscribers() || rgbdImageCompressedPub_.getNumSubscribers())
 		{
-			double stamp = image->header.stamp.toSec();
+			const std_msgs::Header & header = image.get()?image->header:imageCompressed->header;
+			double stamp = header.stamp.toSec();
 
 			rtabmap_msgs::RGBDImage msg;
 			msg.header.frame_id = cameraInfo->header.frame_id;
-			msg.header.stamp = image->header.stamp;
+			msg.header.stamp = header.stamp;
 			msg.rgb_camera_info = *cameraInfo;
 
 			if(rgbdImageCompressedPub_.getNumSubscribers())
@@ -186,8 +237,16 @@ private:
 
 					rtabmap_msgs::RGBDImage msgCompressed = msg;
 
-					cv_bridge::CvImageConstPtr imagePtr = cv_bridge::toCvShare(image);
-					imagePtr->toCompressedImageMsg(msgCompressed.rgb_compressed, cv_bridge::JPG);
+					if(imageCompressed.get())
+					{
+						// already compressed, no decoding/encoding
+						msgCompressed.rgb_compressed = *imageCompressed;
+					}
+					else
+					{
+						cv_bridge::CvImageConstPtr imagePtr = cv_bridge::toCvShare(image);
+						imagePtr->toCompressedImageMsg(msgCompressed.rgb_compressed, cv_bridge::JPG);
+					}
 
 					rgbdImageCompressedPub_.publish(msgCompressed);
 				}
@@ -195,17 +254,24 @@ private:
 
 			if(rgbdImagePub_.getNumSubscribers())
 			{
-				msg.rgb = *image;
+				if(image.get())
+				{
+					msg.rgb = *image;
+				}
+				else
+				{
+					cv_bridge::toCvCopy(imageCompressed)->toImageMsg(msg.rgb);
+				}
 				rgbdImagePub_.publish(msg);
 			}
 
-			if( stamp != image->header.stamp.toSec())
+			if( stamp != header.stamp.toSec())
 			{
 				NODELET_ERROR("Input stamps changed between the beginning and the end of the callback! Make "
 						"sure the node publishing the topics doesn't override the same data after publishing them. A "
 						"solution is to use this node within another nodelet manager. Stamps: "
 						"%f->%f",
-						stamp, image->header.stamp.toSec());
+						stamp, header.stamp.toSec());
 			}
 		}
 	}
@@ -227,6 +293,14 @@ private:
 
 	typedef message_filters::sync_policies::ExactTime<sensor_msgs::Image, sensor_msgs::CameraInfo> MyExactSyncPolicy;
 	message_filters::Synchronizer<MyExactSyncPolicy> * exactSync_;
+
+	message_filters::Subscriber<sensor_msgs::CompressedImage> imageCompressedSub_;
+
+	typedef message_filters::sync_policies::ApproximateTime<sensor_msgs::CompressedImage, sensor_msgs::CameraInfo> MyApproxCompressedSyncPolicy;
+	message_filters::Synchronizer<MyApproxCompressedSyncPolicy> * approxSyncCompressed_;
+
+	typedef message_filters::sync_policies::ExactTime<sensor_msgs::CompressedImage, sensor_msgs::CameraInfo> MyExactCompressedSyncPolicy;
+	message_filters::Synchronizer<MyExactCompressedSyncPolicy> * exactSyncCompressed_;
 };
 
 PLUGINLIB_EXPORT_CLASS(rtabmap_sync::RgbSync, nodelet::Nodelet);
@@ -45,6 +45,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <opencv2/highgui/highgui.hpp>
 
 #include <boost/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
 
 #include "rtabmap_msgs/RGBDImage.h"
 #include "rtabmap_conversions/MsgConversion.h"
@@ -52,6 +53,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/core/Compression.h"
 #include "rtabmap/core/util2d.h"
 #include "rtabmap/utilite/UConversion.h"
+#include "rtabmap/utilite/UTimer.h"
 
 namespace rtabmap_sync
 {
@@ -63,8 +65,17 @@ public:
 		depthScale_(1.0),
 		decimation_(1),
 		compressedRate_(0),
+		compressedAsync_(false),
+		depthCompressedFormat_("png"),
 		warningThread_(0),
 		callbackCalled_(false),
+		compressionThread_(0),
+		compressionThreadRunning_(false),
+		compressionPending_(false),
+		compressionDropped_(0),
+		rgbEncoderThread_(0),
+		rgbEncoderRunning_(false),
+		rgbEncoderJob_(0),
 		approxSyncDepth_(0),
 		exactSyncDepth_(0)
 	{}
@@ -82,6 +93,28 @@ public:
 			warningThread_->join();
 			delete warningThread_;
 		}
+
+		if(compressionThread_)
+		{
+			{
+				boost::mutex::scoped_lock lock(compressionMutex_);
+				compressionThreadRunning_ = false;
+			}
+			compressionCondition_.notify_one();
+			compressionThread_->join();
+			delete compressionThread_;
+		}
+
+		if(rgbEncoderThread_)
+		{
+			{
+				boost::mutex::scoped_lock lock(rgbEncoderMutex_);
+				rgbEncoderRunning_ = false;
+			}
+			rgbEncoderCondition_.notify_all();
+			rgbEncoderThread_->join();
+			delete rgbEncoderThread_;
+		}
 	}
 
 private:
@@ -99,6 +132,8 @@ private:
 		pnh.param("depth_scale", depthScale_, depthScale_);
 		pnh.param("decimation", decimation_, decimation_);
 		pnh.param("compressed_rate", compressedRate_, compressedRate_);
+		pnh.param("compressed_async", compressedAsync_, compressedAsync_);
+		pnh.param("depth_compressed_format", depthCompressedFormat_, depthCompressedFormat_);
 
 		if(decimation_<1)
 		{
@@ -112,6 +147,8 @@ private:
 		NODELET_INFO("%s: depth_scale = %f", getName().c_str(), depthScale_);
 		NODELET_INFO("%s: decimation = %d", getName().c_str(), decimation_);
 		NODELET_INFO("%s: compressed_rate = %f", getName().c_str(), compressedRate_);
+		NODELET_INFO("%s: compressed_async = %s", getName().c_str(), compressedAsync_?"true":"false");
+		NODELET_INFO("%s: depth_compressed_format = %s", getName().c_str(), depthCompressedFormat_.c_str());
 
 		rgbdImagePub_ = nh.advertise<rtabmap_msgs::RGBDImage>("rgbd_image", 1);
 		rgbdImageCompressedPub_ = nh.advertise<rtabmap_msgs::RGBDImage>("rgbd_image/compressed", 1);
@@ -150,6 +187,15 @@ private:
 							imageDepthSub_.getTopic().c_str(),
 							cameraInfoSub_.getTopic().c_str());
 
+		rgbEncoderRunning_ = true;
+		rgbEncoderThread_ = new boost::thread(boost::bind(&RGBDSync::rgbEncoderLoop, this));
+
+		if(compressedAsync_)
+		{
+			compressionThreadRunning_ = true;
+			compressionThread_ = new boost::thread(boost::bind(&RGBDSync::compressionLoop, this));
+		}
+
 		warningThread_ = new boost::thread(boost::bind(&RGBDSync::warningLoop, this, subscribedTopicsMsg, approxSync));
 		NODELET_INFO("%s", subscribedTopicsMsg.c_str());
 	}
@@ -173,6 +219,113 @@ private:
 		}
 	}
 
+	struct CompressionJob
+	{
+		rtabmap_msgs::RGBDImage msg; // header and camera info already set
+		std_msgs::Header rgbHeader;
+		std::string rgbEncoding;
+		std_msgs::Header depthHeader;
+		cv::Mat rgb;
+		cv::Mat depth;
+		// keep a reference on input images so that matrices sharing their buffers stay valid
+		sensor_msgs::ImageConstPtr rgbMsg;
+		sensor_msgs::ImageConstPtr depthMsg;
+		double rgbTime;
+	};
+
+	static void compressRgb(CompressionJob & job)
+	{
+		UTimer timer;
+		cv_bridge::CvImage cvImg;
+		cvImg.header = job.rgbHeader;
+		cvImg.image = job.rgb;
+		cvImg.encoding = job.rgbEncoding;
+		cvImg.toCompressedImageMsg(job.msg.rgb_compressed, cv_bridge::JPG);
+		job.rgbTime = timer.ticks();
+	}
+
+	void rgbEncoderLoop()
+	{
+		boost::mutex::scoped_lock lock(rgbEncoderMutex_);
+		while(true)
+		{
+			while(rgbEncoderRunning_ && rgbEncoderJob_ == 0)
+			{
+				rgbEncoderCondition_.wait(lock);
+			}
+			if(!rgbEncoderRunning_)
+			{
+				break;
+			}
+			CompressionJob * job = rgbEncoderJob_;
+			lock.unlock();
+			compressRgb(*job);
+			lock.lock();
+			rgbEncoderJob_ = 0;
+			rgbEncoderCondition_.notify_all();
+		}
+	}
+
+	void compressAndPublish(CompressionJob & job)
+	{
+		// one frame at a time on the encoder thread
+		boost::mutex::scoped_lock encodeLock(encodeMutex_);
+		UTimer timer;
+		// RGB (jpg) is encoded by the encoder thread while depth
+		// (png or rvl) is encoded on this thread
+		{
+			boost::mutex::scoped_lock lock(rgbEncoderMutex_);
+			rgbEncoderJob_ = &job;
+		}
+		rgbEncoderCondition_.notify_all();
+
+		UTimer depthTimer;
+		job.msg.depth_compressed.header = job.depthHeader;
+		rtabmap_conversions::compressDepth(job.depth, depthCompressedFormat_, job.msg.depth_compressed);
+		double depthTime = depthTimer.ticks();
+
+		{
+			boost::mutex::scoped_lock lock(rgbEncoderMutex_);
+			while(rgbEncoderJob_ != 0)
+			{
+				rgbEncoderCondition_.wait(lock);
+			}
+		}
+
+		rgbdImageCompressedPub_.publish(job.msg);
+
+		int dropped = 0;
+		{
+			boost::mutex::scoped_lock lock(compressionMutex_);
+			dropped = compressionDropped_;
+		}
+		NODELET_DEBUG("%s: compression time = %f s (rgb=%f s, depth=%f s, dropped=%d)",
+				getName().c_str(), timer.ticks(), job.rgbTime, depthTime, dropped);
+	}
+
+	void compressionLoop()
+	{
+		while(true)
+		{
+			CompressionJob job;
+			{
+				boost::mutex::scoped_lock lock(compressionMutex_);
+				while(compressionThreadRunning_ && !compressionPending_)
+				{
+					compressionCondition_.wait(lock);
+				}
+				if(!compressionThreadRunning_)
+				{
+					break;
+				}
+				job = compressionJob_;
+				compressionJob_ = CompressionJob();
+				compressionPending_ = false;
+			}
+			compressAndPublish(job);
+		}
+	}
+
 	void callback(
 			  const sensor_msgs::ImageConstPtr& image,
 			  const sensor_msgs::ImageConstPtr& depth,
@@ -255,23 +408,38 @@ private:
 				{
 					lastCompressedPublished_ = ros::Time::now();
 
-					rtabmap_msgs::RGBDImage msgCompressed;
-					msgCompressed.header = msg.header;
-					msgCompressed.rgb_camera_info = msg.rgb_camera_info;
-					msgCompressed.depth_camera_info = msg.depth_camera_info;
-
-					cv_bridge::CvImage cvImg;
-					cvImg.header = image->header;
-					cvImg.image = rgbMat;
-					cvImg.encoding = image->encoding;
-					cvImg.toCompressedImageMsg(msgCompressed.rgb_compressed, cv_bridge::JPG);
-
-					msgCompressed.depth_compressed.header = imageDepthPtr->header;
-					msgCompressed.depth_compressed.data = rtabmap::compressImage(depthMat, ".png");
-
-					msgCompressed.depth_compressed.format = "png";
-
-					rgbdImageCompressedPub_.publish(msgCompressed);
+					CompressionJob job;
+					job.msg.header = msg.header;
+					job.msg.rgb_camera_info = msg.rgb_camera_info;
+					job.msg.depth_camera_info = msg.depth_camera_info;
+					job.rgbHeader = image->header;
+					job.rgbEncoding = image->encoding;
+					job.depthHeader = imageDepthPtr->header;
+					job.rgb = rgbMat;
+					job.depth = depthMat;
+					job.rgbMsg = image;
+					job.depthMsg = depth;
+					job.rgbTime = 0.0;
+
+					if(compressedAsync_)
+					{
+						// Latest frame wins: if the worker is still busy
+						// with the previous one, the pending frame is replaced.
+						{
+							boost::mutex::scoped_lock lock(compressionMutex_);
+							if(compressionPending_)
+							{
+								++compressionDropped_;
+							}
+							compressionJob_ = job;
+							compressionPending_ = true;
+						}
+						compressionCondition_.notify_one();
+					}
+					else
+					{
+						compressAndPublish(job);
+					}
 				}
 			}
 
@@ -309,9 +477,26 @@ private:
 	double depthScale_;
 	int decimation_;
 	double compressedRate_;
+	bool compressedAsync_;
+	std::string depthCompressedFormat_;
 	boost::thread * warningThread_;
 	bool callbackCalled_;
 
+	boost::thread * compressionThread_;
+	bool compressionThreadRunning_;
+	boost::mutex compressionMutex_;
+	boost::condition_variable compressionCondition_;
+	CompressionJob compressionJob_;
+	bool compressionPending_;
+	int compressionDropped_;
+
+	boost::thread * rgbEncoderThread_;
+	bool rgbEncoderRunning_;
+	boost::mutex rgbEncoderMutex_;
+	boost::condition_variable rgbEncoderCondition_;
+	CompressionJob * rgbEncoderJob_;
+	boost::mutex encodeMutex_;
+
 	ros::Time lastCompressedPublished_;
 
 	ros::Publisher rgbdImagePub_;
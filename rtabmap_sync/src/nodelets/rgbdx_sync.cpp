@@ -29,14 +29,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <pluginlib/class_list_macros.hpp>
 #include <nodelet/nodelet.h>
 
-#include <message_filters/sync_policies/approximate_time.h>
-#include <message_filters/sync_policies/exact_time.h>
-#include <message_filters/subscriber.h>
-
 #include <boost/thread.hpp>
 
+#include <rtabmap/utilite/UConversion.h>
+
 #include "rtabmap_msgs/RGBDImages.h"
-#include "rtabmap_sync/CommonDataSubscriber.h"
+#include "rtabmap_sync/MultiTopicSynchronizer.h"
 
 namespace rtabmap_sync
 {
@@ -47,18 +45,13 @@ public:
 	RGBDXSync() :
 		warningThread_(0),
 		callbackCalled_(false),
-		SYNC_INIT(rgbd2),
-		SYNC_INIT(rgbd3),
-		SYNC_INIT(rgbd4),
-		SYNC_INIT(rgbd5),
-		SYNC_INIT(rgbd6),
-		SYNC_INIT(rgbd7),
-		SYNC_INIT(rgbd8)
+		sync_(0)
 	{}
 
 	virtual ~RGBDXSync()
 	{
-		SYNC_DEL(rgbd2);
+		rgbdSubs_.clear();
+		delete sync_;
 
 		if(warningThread_)
 		{
@@ -92,76 +85,33 @@ private:
 
 		rgbdImagesPub_ = nh.advertise<rtabmap_msgs::RGBDImages>("rgbd_images", 1);
 
-		ROS_ASSERT(rgbdCameras>=2 && rgbdCameras<=8);
+		ROS_ASSERT(rgbdCameras>=2);
 
-		rgbdSubs_.resize(rgbdCameras);
-		for(int i=0; i<rgbdCameras; ++i)
+		sync_ = new MultiTopicSynchronizer<rtabmap_msgs::RGBDImage>(
+				rgbdCameras,
+				queueSize,
+				approxSync,
+				boost::bind(&RGBDXSync::rgbdXCallback, this, boost::placeholders::_1));
+		if(approxSync && approxSyncMaxInterval>0.0)
 		{
-			rgbdSubs_[i] = new message_filters::Subscriber<rtabmap_msgs::RGBDImage>;
-			rgbdSubs_[i]->subscribe(nh, uFormat("rgbd_image%d", i), queueSize);
+			sync_->setMaxIntervalDuration(ros::Duration(approxSyncMaxInterval));
 		}
 
-		std::string name_ = this->getName();
-		std::string subscribedTopicsMsg_;
-		if(rgbdCameras==2)
-		{
-			SYNC_DECL2(RGBDXSync, rgbd2, approxSync, queueSize, (*rgbdSubs_[0]), (*rgbdSubs_[1]));
-			if(approxSync && approxSyncMaxInterval>0.0)
-			{
-				rgbd2ApproximateSync_->setMaxIntervalDuration(ros::Duration(approxSyncMaxInterval));
-			}
-		}
-		else if(rgbdCameras==3)
-		{
-			SYNC_DECL3(RGBDXSync, rgbd3, approxSync, queueSize, (*rgbdSubs_[0]), (*rgbdSubs_[1]), (*rgbdSubs_[2]));
-			if(approxSync && approxSyncMaxInterval>0.0)
-			{
-				rgbd3ApproximateSync_->setMaxIntervalDuration(ros::Duration(approxSyncMaxInterval));
-			}
-		}
-		else if(rgbdCameras==4)
-		{
-			SYNC_DECL4(RGBDXSync, rgbd4, approxSync, queueSize, (*rgbdSubs_[0]), (*rgbdSubs_[1]), (*rgbdSubs_[2]), (*rgbdSubs_[3]));
-			if(approxSync && approxSyncMaxInterval>0.0)
-			{
-				rgbd4ApproximateSync_->setMaxIntervalDuration(ros::Duration(approxSyncMaxInterval));
-			}
-		}
-		else if(rgbdCameras==5)
-		{
-			SYNC_DECL5(RGBDXSync, rgbd5, approxSync, queueSize, (*rgbdSubs_[0]), (*rgbdSubs_[1]), (*rgbdSubs_[2]), (*rgbdSubs_[3]), (*rgbdSubs_[4]));
-			if(approxSync && approxSyncMaxInterval>0.0)
-			{
-				rgbd5ApproximateSync_->setMaxIntervalDuration(ros::Duration(approxSyncMaxInterval));
-			}
-		}
-		else if(rgbdCameras==6)
-		{
-			SYNC_DECL6(RGBDXSync, rgbd6, approxSync, queueSize, (*rgbdSubs_[0]), (*rgbdSubs_[1]), (*rgbdSubs_[2]), (*rgbdSubs_[3]), (*rgbdSubs_[4]), (*rgbdSubs_[5]));
-			if(approxSync && approxSyncMaxInterval>0.0)
-			{
-				rgbd6ApproximateSync_->setMaxIntervalDuration(ros::Duration(approxSyncMaxInterval));
-			}
-		}
-		else if(rgbdCameras==7)
+		std::string subscribedTopicsMsg = uFormat("\n%s subscribed to (%s sync):",
+				getName().c_str(),
+				approxSync?"approx":"exact");
+		rgbdSubs_.resize(rgbdCameras);
+		for(int i=0; i<rgbdCameras; ++i)
 		{
-			SYNC_DECL7(RGBDXSync, rgbd7, approxSync, queueSize, (*rgbdSubs_[0]), (*rgbdSubs_[1]), (*rgbdSubs_[2]), (*rgbdSubs_[3]), (*rgbdSubs_[4]), (*rgbdSubs_[5]), (*rgbdSubs_[6]));
-			if(approxSync && approxSyncMaxInterval>0.0)
-			{
-				rgbd7ApproximateSync_->setMaxIntervalDuration(ros::Duration(approxSyncMaxInterval));
-			}
-		}
-		else if(rgbdCameras==8)
-		{
-			SYNC_DECL8(RGBDXSync, rgbd8, approxSync, queueSize, (*rgbdSubs_[0]), (*rgbdSubs_[1]), (*rgbdSubs_[2]), (*rgbdSubs_[3]), (*rgbdSubs_[4]), (*rgbdSubs_[5]), (*rgbdSubs_[6]), (*rgbdSubs_[7]));
-			if(approxSync && approxSyncMaxInterval>0.0)
-			{
-				rgbd8ApproximateSync_->setMaxIntervalDuration(ros::Duration(approxSyncMaxInterval));
-			}
+			rgbdSubs_[i] = nh.subscribe<rtabmap_msgs::RGBDImage>(
+					uFormat("rgbd_image%d", i),
+					queueSize,
+					boost::bind(&MultiTopicSynchronizer<rtabmap_msgs::RGBDImage>::add, sync_, i, boost::placeholders::_1));
+			subscribedTopicsMsg += uFormat("\n   %s", rgbdSubs_[i].getTopic().c_str());
 		}
 
-		warningThread_ = new boost::thread(boost::bind(&RGBDXSync::warningLoop, this, subscribedTopicsMsg_, approxSync));
-		NODELET_INFO("%s%s", subscribedTopicsMsg_.c_str(),
+		warningThread_ = new boost::thread(boost::bind(&RGBDXSync::warningLoop, this, subscribedTopicsMsg, approxSync));
+		NODELET_INFO("%s%s", subscribedTopicsMsg.c_str(),
 				approxSync&&approxSyncMaxInterval!=0.0?uFormat(" (approx sync max interval=%fs)", approxSyncMaxInterval).c_str():"");
 	}
 
@@ -184,13 +134,18 @@ private:
 		}
 	}
 
-	DATA_SYNCS2(rgbd2, rtabmap_msgs::RGBDImage, rtabmap_msgs::RGBDImage);
-	DATA_SYNCS3(rgbd3, rtabmap_msgs::RGBDImage, rtabmap_msgs::RGBDImage, rtabmap_msgs::RGBDImage);
-	DATA_SYNCS4(rgbd4, rtabmap_msgs::RGBDImage, rtabmap_msgs::RGBDImage, rtabmap_msgs::RGBDImage, rtabmap_msgs::RGBDImage);
-	DATA_SYNCS5(rgbd5, rtabmap_msgs::RGBDImage, rtabmap_msgs::RGBDImage, rtabmap_msgs::RGBDImage, rtabmap_msgs::RGBDImage, rtabmap_msgs::RGBDImage);
-	DATA_SYNCS6(rgbd6, rtabmap_msgs::RGBDImage, rtabmap_msgs::RGBDImage, rtabmap_msgs::RGBDImage, rtabmap_msgs::RGBDImage, rtabmap_msgs::RGBDImage, rtabmap_msgs::RGBDImage);
-	DATA_SYNCS7(rgbd7, rtabmap_msgs::RGBDImage, rtabmap_msgs::RGBDImage, rtabmap_msgs::RGBDImage, rtabmap_msgs::RGBDImage, rtabmap_msgs::RGBDImage, rtabmap_msgs::RGBDImage, rtabmap_msgs::RGBDImage);
-	DATA_SYNCS8(rgbd8, rtabmap_msgs::RGBDImage, rtabmap_msgs::RGBDImage, rtabmap_msgs::RGBDImage, rtabmap_msgs::RGBDImage, rtabmap_msgs::RGBDImage, rtabmap_msgs::RGBDImage, rtabmap_msgs::RGBDImage, rtabmap_msgs::RGBDImage);
+	void rgbdXCallback(const std::vector<rtabmap_msgs::RGBDImageConstPtr> & images)
+	{
+		callbackCalled_ = true;
+		rtabmap_msgs::RGBDImages output;
+		output.header = images[0]->header;
+		output.rgbd_images.resize(images.size());
+		for(size_t i=0; i<images.size(); ++i)
+		{
+			output.rgbd_images[i] = *images[i];
+		}
+		rgbdImagesPub_.publish(output);
+	}
 
 private:
 	boost::thread * warningThread_;
@@ -198,143 +153,9 @@ private:
 
 	ros::Publisher rgbdImagesPub_;
 
-	std::vector<message_filters::Subscriber<rtabmap_msgs::RGBDImage>*> rgbdSubs_;
+	std::vector<ros::Subscriber> rgbdSubs_;
+	MultiTopicSynchronizer<rtabmap_msgs::RGBDImage> * sync_;
 };
 
-
-void RGBDXSync::rgbd2Callback(
-		  const rtabmap_msgs::RGBDImageConstPtr& image0,
-		  const rtabmap_msgs::RGBDImageConstPtr& image1)
-{
-	callbackCalled_ = true;
-	rtabmap_msgs::RGBDImages output;
-	output.header = image0->header;
-	output.rgbd_images.resize(2);
-	output.rgbd_images[0]=(*image0);
-	output.rgbd_images[1]=(*image1);
-	rgbdImagesPub_.publish(output);
-}
-
-void RGBDXSync::rgbd3Callback(
-		  const rtabmap_msgs::RGBDImageConstPtr& image0,
-		  const rtabmap_msgs::RGBDImageConstPtr& image1,
-		  const rtabmap_msgs::RGBDImageConstPtr& image2)
-{
-	callbackCalled_ = true;
-	rtabmap_msgs::RGBDImages output;
-	output.header = image0->header;
-	output.rgbd_images.resize(3);
-	output.rgbd_images[0]=(*image0);
-	output.rgbd_images[1]=(*image1);
-	output.rgbd_images[2]=(*image2);
-	rgbdImagesPub_.publish(output);
-}
-
-void RGBDXSync::rgbd4Callback(
-		  const rtabmap_msgs::RGBDImageConstPtr& image0,
-		  const rtabmap_msgs::RGBDImageConstPtr& image1,
-		  const rtabmap_msgs::RGBDImageConstPtr& image2,
-		  const rtabmap_msgs::RGBDImageConstPtr& image3)
-{
-	callbackCalled_ = true;
-	rtabmap_msgs::RGBDImages output;
-	output.header = image0->header;
-	output.rgbd_images.resize(4);
-	output.rgbd_images[0]=(*image0);
-	output.rgbd_images[1]=(*image1);
-	output.rgbd_images[2]=(*image2);
-	output.rgbd_images[3]=(*image3);
-	rgbdImagesPub_.publish(output);
-}
-
-void RGBDXSync::rgbd5Callback(
-		  const rtabmap_msgs::RGBDImageConstPtr& image0,
-		  const rtabmap_msgs::RGBDImageConstPtr& image1,
-		  const rtabmap_msgs::RGBDImageConstPtr& image2,
-		  const rtabmap_msgs::RGBDImageConstPtr& image3,
-		  const rtabmap_msgs::RGBDImageConstPtr& image4)
-{
-	callbackCalled_ = true;
-	rtabmap_msgs::RGBDImages output;
-	output.header = image0->header;
-	output.rgbd_images.resize(5);
-	output.rgbd_images[0]=(*image0);
-	output.rgbd_images[1]=(*image1);
-	output.rgbd_images[2]=(*image2);
-	output.rgbd_images[3]=(*image3);
-	output.rgbd_images[4]=(*image4);
-	rgbdImagesPub_.publish(output);
-}
-
-void RGBDXSync::rgbd6Callback(
-		  const rtabmap_msgs::RGBDImageConstPtr& image0,
-		  const rtabmap_msgs::RGBDImageConstPtr& image1,
-		  const rtabmap_msgs::RGBDImageConstPtr& image2,
-		  const rtabmap_msgs::RGBDImageConstPtr& image3,
-		  const rtabmap_msgs::RGBDImageConstPtr& image4,
-		  const rtabmap_msgs::RGBDImageConstPtr& image5)
-{
-	callbackCalled_ = true;
-	rtabmap_msgs::RGBDImages output;
-	output.header = image0->header;
-	output.rgbd_images.resize(6);
-	output.rgbd_images[0]=(*image0);
-	output.rgbd_images[1]=(*image1);
-	output.rgbd_images[2]=(*image2);
-	output.rgbd_images[3]=(*image3);
-	output.rgbd_images[4]=(*image4);
-	output.rgbd_images[5]=(*image5);
-	rgbdImagesPub_.publish(output);
-}
-
-void RGBDXSync::rgbd7Callback(
-		  const rtabmap_msgs::RGBDImageConstPtr& image0,
-		  const rtabmap_msgs::RGBDImageConstPtr& image1,
-		  const rtabmap_msgs::RGBDImageConstPtr& image2,
-		  const rtabmap_msgs::RGBDImageConstPtr& image3,
-		  const rtabmap_msgs::RGBDImageConstPtr& image4,
-		  const rtabmap_msgs::RGBDImageConstPtr& image5,
-		  const rtabmap_msgs::RGBDImageConstPtr& image6)
-{
-	callbackCalled_ = true;
-	rtabmap_msgs::RGBDImages output;
-	output.header = image0->header;
-	output.rgbd_images.resize(7);
-	output.rgbd_images[0]=(*image0);
-	output.rgbd_images[1]=(*image1);
-	output.rgbd_images[2]=(*image2);
-	output.rgbd_images[3]=(*image3);
-	output.rgbd_images[4]=(*image4);
-	output.rgbd_images[5]=(*image5);
-	output.rgbd_images[6]=(*image6);
-	rgbdImagesPub_.publish(output);
-}
-
-void RGBDXSync::rgbd8Callback(
-		  const rtabmap_msgs::RGBDImageConstPtr& image0,
-		  const rtabmap_msgs::RGBDImageConstPtr& image1,
-		  const rtabmap_msgs::RGBDImageConstPtr& image2,
-		  const rtabmap_msgs::RGBDImageConstPtr& image3,
-		  const rtabmap_msgs::RGBDImageConstPtr& image4,
-		  const rtabmap_msgs::RGBDImageConstPtr& image5,
-		  const rtabmap_msgs::RGBDImageConstPtr& image6,
-		  const rtabmap_msgs::RGBDImageConstPtr& image7)
-{
-	callbackCalled_ = true;
-	rtabmap_msgs::RGBDImages output;
-	output.header = image0->header;
-	output.rgbd_images.resize(8);
-	output.rgbd_images[0]=(*image0);
-	output.rgbd_images[1]=(*image1);
-	output.rgbd_images[2]=(*image2);
-	output.rgbd_images[3]=(*image3);
-	output.rgbd_images[4]=(*image4);
-	output.rgbd_images[5]=(*image5);
-	output.rgbd_images[6]=(*image6);
-	output.rgbd_images[7]=(*image7);
-	rgbdImagesPub_.publish(output);
-}
-
 PLUGINLIB_EXPORT_CLASS(rtabmap_sync::RGBDXSync, nodelet::Nodelet);
 }
-
@@ -62,7 +62,9 @@ public:
 		warningThread_(0),
 		callbackCalled_(false),
 		approxSync_(0),
-		exactSync_(0)
+		exactSync_(0),
+		approxSyncCompressed_(0),
+		exactSyncCompressed_(0)
 	{}
 
 	virtual ~StereoSync()
@@ -71,6 +73,10 @@ public:
 			delete approxSync_;
 		if(exactSync_)
 			delete exactSync_;
+		if(approxSyncCompressed_)
+			delete approxSyncCompressed_;
+		if(exactSyncCompressed_)
+			delete exactSyncCompressed_;
 
 		if(warningThread_)
 		{
@@ -89,21 +95,42 @@ private:
 		int queueSize = 10;
 		bool approxSync = false;
 		double approxSyncMaxInterval = 0.0;
+		bool compressedPassthrough = false;
 		pnh.param("approx_sync", approxSync, approxSync);
 		if(approxSync)
 			pnh.param("approx_sync_max_interval", approxSyncMaxInterval, approxSyncMaxInterval);
 		pnh.param("queue_size", queueSize, queueSize);
 		pnh.param("compressed_rate", compressedRate_, compressedRate_);
+		pnh.param("compressed_passthrough", compressedPassthrough, compressedPassthrough);
 
 		NODELET_INFO("%s: approx_sync = %s", getName().c_str(), approxSync?"true":"false");
 		NODELET_INFO("%s: approx_sync_max_interval = %f", getName().c_str(), approxSyncMaxInterval);
 		NODELET_INFO("%s: queue_size  = %d", getName().c_str(), queueSize);
 		NODELET_INFO("%s: compressed_rate = %f", getName().c_str(), compressedRate_);
+		NODELET_INFO("%s: compressed_passthrough = %s", getName().c_str(), compressedPassthrough?"true":"false");
 
 		rgbdImagePub_ = nh.advertise<rtabmap_msgs::RGBDImage>("rgbd_image", 1);
 		rgbdImageCompressedPub_ = nh.advertise<rtabmap_msgs::RGBDImage>("rgbd_image/compressed", 1);
 
-		if(approxSync)
+		if(compressedPassthrough)
+		{
+			// Subscribe directly to the compressed topics: the compressed bytes
+			// are copied in rgb_compressed/depth_compressed, the images are decoded
+			// only if the raw rgbd_image topic is subscribed.
+			if(approxSync)
+			{
+				approxSyncCompressed_ = new message_filters::Synchronizer<MyApproxCompressedSyncPolicy>(MyApproxCompressedSyncPolicy(queueSize), imageLeftCompressedSub_, imageRightCompressedSub_, cameraInfoLeftSub_, cameraInfoRightSub_);
+				if(approxSyncMaxInterval>0.0)
+					approxSyncCompressed_->setMaxIntervalDuration(ros::Duration(approxSyncMaxInterval));
+				approxSyncCompressed_->registerCallback(boost::bind(&StereoSync::compressedCallback, this, boost::placeholders::_1, boost::placeholders::_2, boost::placeholders::_3, boost::placeholders::_4));
+			}
+			else
+			{
+				exactSyncCompressed_ = new message_filters::Synchronizer<MyExactCompressedSyncPolicy>(MyExactCompressedSyncPolicy(queueSize), imageLeftCompressedSub_, imageRightCompressedSub_, cameraInfoLeftSub_, cameraInfoRightSub_);
+				exactSyncCompressed_->registerCallback(boost::bind(&StereoSync::compressedCallback, this, boost::placeholders::_1, boost::placeholders::_2, boost::placeholders::_3, boost::placeholders::_4));
+			}
+		}
+		else if(approxSync)
 		{
 			approxSync_ = new message_filters::Synchronizer<MyApproxSyncPolicy>(MyApproxSyncPolicy(queueSize), imageLeftSub_, imageRightSub_, cameraInfoLeftSub_, cameraInfoRightSub_);
 			if(approxSyncMaxInterval>0.0)
@@ -125,8 +152,16 @@ private:
 		image_transport::TransportHints hintsRgb("raw", ros::TransportHints(), left_pnh);
 		image_transport::TransportHints hintsDepth("raw", ros::TransportHints(), right_pnh);
 
-		imageLeftSub_.subscribe(rgb_it, left_nh.resolveName("image_rect"), 1, hintsRgb);
-		imageRightSub_.subscribe(depth_it, right_nh.resolveName("image_rect"), 1, hintsDepth);
+		if(compressedPassthrough)
+		{
+			imageLeftCompressedSub_.subscribe(left_nh, left_nh.resolveName("image_rect") + "/compressed", 1);
+			imageRightCompressedSub_.subscribe(right_nh, right_nh.resolveName("image_rect") + "/compressed", 1);
+		}
+		else
+		{
+			imageLeftSub_.subscribe(rgb_it, left_nh.resolveName("image_rect"), 1, hintsRgb);
+			imageRightSub_.subscribe(depth_it, right_nh.resolveName("image_rect"), 1, hintsDepth);
+		}
 		cameraInfoLeftSub_.subscribe(left_nh, "camera_info", 1);
 		cameraInfoRightSub_.subscribe(right_nh, "camera_info", 1);
 
@@ -134,8 +169,8 @@ private:
 							getName().c_str(),
 							approxSync?"approx":"exact",
 							approxSync&&approxSyncMaxInterval!=0.0?uFormat(", max interval=%fs", approxSyncMaxInterval).c_str():"",
-							imageLeftSub_.getTopic().c_str(),
-							imageRightSub_.getTopic().c_str(),
+							compressedPassthrough?imageLeftCompressedSub_.getTopic().c_str():imageLeftSub_.getTopic().c_str(),
+							compressedPassthrough?imageRightCompressedSub_.getTopic().c_str():imageRightSub_.getTopic().c_str(),
 							cameraInfoLeftSub_.getTopic().c_str(),
 							cameraInfoRightSub_.getTopic().c_str());
 
@@ -167,12 +202,35 @@ private:
 			  const sensor_msgs::ImageConstPtr& imageRight,
 			  const sensor_msgs::CameraInfoConstPtr& cameraInfoLeft,
 			  const sensor_msgs::CameraInfoConstPtr& cameraInfoRight)
+	{
+		processImages(imageLeft, imageRight, sensor_msgs::CompressedImageConstPtr(), sensor_msgs::CompressedImageConstPtr(), cameraInfoLeft, cameraInfoRight);
+	}
+
+	void compressedCallback(
+			  const sensor_msgs::CompressedImageConstPtr& imageLeftCompressed,
+			  const sensor_msgs::CompressedImageConstPtr& imageRightCompressed,
+			  const sensor_msgs::CameraInfoConstPtr& cameraInfoLeft,
+			  const sensor_msgs::CameraInfoConstPtr& cameraInfoRight)
+	{
+		processImages(sensor_msgs::ImageConstPtr(), sensor_msgs::ImageConstPtr(), imageLeftCompressed, imageRightCompressed, cameraInfoLeft, cameraInfoRight);
+	}
+
+	// Either raw or compressed images are set
+	void processImages(
+			  const sensor_msgs::ImageConstPtr& imageLeft,
+			  const sensor_msgs::ImageConstPtr& imageRight,
+			  const sensor_msgs::CompressedImageConstPtr& imageLeftCompressed,
+			  const sensor_msgs::CompressedImageConstPtr& imageRightCompressed,
+			  const sensor_msgs::CameraInfoConstPtr& cameraInfoLeft,
+			  const sensor_msgs::CameraInfoConstPtr& cameraInfoRight)
 	{
 		callbackCalled_ = true;
 		if(rgbdImagePub_.getNumSubscribers() || rgbdImageCompressedPub_.getNumSubscribers())
 		{
-			double leftStamp = imageLeft->header.stamp.toSec();
-			double rightStamp = imageRight->header.stamp.toSec();
+			const std_msgs::Header & leftHeader = imageLeft.get()?imageLeft->header:imageLeftCompressed->header;
+			const std_msgs::Header & rightHeader = imageRight.get()?imageRight->header:imageRightCompressed->header;
+			double leftStamp = leftHeader.stamp.toSec();
+			double rightStamp = rightHeader.stamp.toSec();
 			double leftInfoStamp = cameraInfoLeft->header.stamp.toSec();
 			double rightInfoStamp = cameraInfoRight->header.stamp.toSec();
 
@@ -190,7 +248,7 @@ private:
 
 			rtabmap_msgs::RGBDImage msg;
 			msg.header.frame_id = cameraInfoLeft->header.frame_id;
-			msg.header.stamp = imageLeft->header.stamp>imageRight->header.stamp?imageLeft->header.stamp:imageRight->header.stamp;
+			msg.header.stamp = leftHeader.stamp>rightHeader.stamp?leftHeader.stamp:rightHeader.stamp;
 			msg.rgb_camera_info = *cameraInfoLeft;
 			msg.depth_camera_info = *cameraInfoRight;
 
@@ -212,11 +270,22 @@ private:
 
 					rtabmap_msgs::RGBDImage msgCompressed = msg;
 
-					cv_bridge::CvImageConstPtr imagePtr = cv_bridge::toCvShare(imageLeft);
-					imagePtr->toCompressedImageMsg(msgCompressed.rgb_compressed, cv_bridge::JPG);
+					if(imageLeftCompressed.get())
+					{
+						// already compressed, no decoding/encoding
+						msgCompressed.rgb_compressed = *imageLeftCompressed;
+						msgCompressed.depth_compressed = *imageRightCompressed;
+						// right image is decoded like an image, not like a depth image
+						msgCompressed.depth_compressed.format = "jpg";
+					}
+					else
+					{
+						cv_bridge::CvImageConstPtr imagePtr = cv_bridge::toCvShare(imageLeft);
+						imagePtr->toCompressedImageMsg(msgCompressed.rgb_compressed, cv_bridge::JPG);
 
-					cv_bridge::CvImageConstPtr imageDepthPtr = cv_bridge::toCvShare(imageRight);
-					imageDepthPtr->toCompressedImageMsg(msgCompressed.depth_compressed, cv_bridge::JPG);
+						cv_bridge::CvImageConstPtr imageDepthPtr = cv_bridge::toCvShare(imageRight);
+						imageDepthPtr->toCompressedImageMsg(msgCompressed.depth_compressed, cv_bridge::JPG);
+					}
 
 					rgbdImageCompressedPub_.publish(msgCompressed);
 				}
@@ -224,20 +293,28 @@ private:
 
 			if(rgbdImagePub_.getNumSubscribers())
 			{
-				msg.rgb = *imageLeft;
-				msg.depth = *imageRight;
+				if(imageLeft.get())
+				{
+					msg.rgb = *imageLeft;
+					msg.depth = *imageRight;
+				}
+				else
+				{
+					cv_bridge::toCvCopy(imageLeftCompressed)->toImageMsg(msg.rgb);
+					cv_bridge::toCvCopy(imageRightCompressed)->toImageMsg(msg.depth);
+				}
 				rgbdImagePub_.publish(msg);
 			}
 
-			if( leftStamp != imageLeft->header.stamp.toSec() ||
-				rightStamp != imageRight->header.stamp.toSec())
+			if( leftStamp != leftHeader.stamp.toSec() ||
+				rightStamp != rightHeader.stamp.toSec())
 			{
 				NODELET_ERROR("Input stamps changed between the beginning and the end of the callback! Make "
 						"sure the node publishing the topics doesn't override the same data after publishing them. A "
 						"solution is to use this node within another nodelet manager. Stamps: "
 						"left%f->%f right=%f->%f",
-						leftStamp, imageLeft->header.stamp.toSec(),
-						rightStamp, imageRight->header.stamp.toSec());
+						leftStamp, leftHeader.stamp.toSec(),
+						rightStamp, rightHeader.stamp.toSec());
 			}
 		}
 	}
@@ -261,6 +338,15 @@ private:
 
 	typedef message_filters::sync_policies::ExactTime<sensor_msgs::Image, sensor_msgs::Image, sensor_msgs::CameraInfo, sensor_msgs::CameraInfo> MyExactSyncPolicy;
 	message_filters::Synchronizer<MyExactSyncPolicy> * exactSync_;
+
+	message_filters::Subscriber<sensor_msgs::CompressedImage> imageLeftCompressedSub_;
+	message_filters::Subscriber<sensor_msgs::CompressedImage> imageRightCompressedSub_;
+
+	typedef message_filters::sync_policies::ApproximateTime<sensor_msgs::CompressedImage, sensor_msgs::CompressedImage, sensor_msgs::CameraInfo, sensor_msgs::CameraInfo> MyApproxCompressedSyncPolicy;
+	message_filters::Synchronizer<MyApproxCompressedSyncPolicy> * approxSyncCompressed_;
+
+	typedef message_filters::sync_policies::ExactTime<sensor_msgs::CompressedImage, sensor_msgs::CompressedImage, sensor_msgs::CameraInfo, sensor_msgs::CameraInfo> MyExactCompressedSyncPolicy;
+	message_filters::Synchronizer<MyExactCompressedSyncPolicy> * exactSyncCompressed_;
 };
 
 PLUGINLIB_EXPORT_CLASS(rtabmap_sync::StereoSync, nodelet::Nodelet);
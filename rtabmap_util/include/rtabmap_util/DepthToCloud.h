@@ -0,0 +1,60 @@
+/*
+Copyright (c) 2010-2022, Mathieu Labbe
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef DEPTHTOCLOUD_H_
+#define DEPTHTOCLOUD_H_
+
+#include <rtabmap/core/CameraModel.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <opencv2/core/core.hpp>
+
+namespace rtabmap_util {
+
+/**
+ * Back-project a depth image (CV_16UC1 in mm or CV_32FC1 in m) directly
+ * into a PointCloud2 message with fields x,y,z (and rgb if "rgb" is
+ * set, CV_8UC3 bgr or CV_8UC1), without creating an intermediate pcl
+ * cloud. Same points as rtabmap::util3d::cloudFromDepth()/cloudFromDepthRGB().
+ * If "removeInvalid" is false, the cloud is organized and invalid
+ * points are set to NaN.
+ *
+ * Returns false if the inputs are not supported by this
+ * path (e.g., rgb and depth sizes differ, camera has a local
+ * transform), the caller should then fall back on the util3d functions.
+ */
+bool depthToPointCloud2(
+		const cv::Mat & depth,
+		const cv::Mat & rgb,
+		const rtabmap::CameraModel & model,
+		int decimation,
+		float maxDepth,
+		float minDepth,
+		bool removeInvalid,
+		sensor_msgs::PointCloud2 & cloud);
+
+}
+
+#endif /* DEPTHTOCLOUD_H_ */
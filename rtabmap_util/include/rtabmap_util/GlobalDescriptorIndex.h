@@ -0,0 +1,273 @@
+/*
+Copyright (c) 2010-2022, Mathieu Labbe
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef GLOBALDESCRIPTORINDEX_H_
+#define GLOBALDESCRIPTORINDEX_H_
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <boost/unordered_map.hpp>
+#include <opencv2/core/core.hpp>
+#include <rtabmap/utilite/ULogger.h>
+
+namespace rtabmap_util {
+
+/**
+ * Approximate nearest neighbor index of node global descriptors (IVF):
+ * descriptors are assigned to the nearest of sqrt(N) k-means centroids
+ * and a query only compares the descriptors of the nearest lists. Until
+ * trainSize descriptors are added, queries are exhaustive. Centroids are
+ * retrained on a subset each time the index doubles in size.
+ */
+class GlobalDescriptorIndex
+{
+public:
+	GlobalDescriptorIndex(int probes = 8, size_t trainSize = 1000) :
+		probes_(probes),
+		trainSize_(trainSize),
+		dim_(0),
+		trainedSize_(0)
+	{
+		UASSERT(probes_ > 0);
+	}
+
+	size_t size() const {return ids_.size();}
+	bool empty() const {return ids_.empty();}
+	int dim() const {return dim_;}
+	bool trained() const {return !centroids_.empty();}
+	size_t lists() const {return centroids_.rows;}
+
+	void setProbes(int probes)
+	{
+		UASSERT(probes > 0);
+		probes_ = probes;
+	}
+
+	void clear()
+	{
+		data_.clear();
+		ids_.clear();
+		assignments_.clear();
+		rows_.clear();
+		lists_.clear();
+		centroids_ = cv::Mat();
+		dim_ = 0;
+		trainedSize_ = 0;
+	}
+
+	bool contains(int id) const {return rows_.find(id) != rows_.end();}
+
+	/**
+	 * Add or update the descriptor (1xN, any depth) of a node. Returns
+	 * false if its size doesn't match the descriptors already indexed.
+	 */
+	bool add(int id, const cv::Mat & descriptor)
+	{
+		cv::Mat v = toFloat(descriptor);
+		if(v.empty() || (dim_ > 0 && v.cols != dim_))
+		{
+			return false;
+		}
+		erase(id);
+		dim_ = v.cols;
+		rows_[id] = ids_.size();
+		ids_.push_back(id);
+		data_.insert(data_.end(), v.ptr<float>(), v.ptr<float>()+dim_);
+		if(trained())
+		{
+			int list = nearestCentroid(v.ptr<float>());
+			assignments_.push_back(list);
+			lists_[list].push_back(id);
+		}
+		else
+		{
+			assignments_.push_back(0);
+		}
+		if(ids_.size() >= trainSize_ && ids_.size() >= 2*trainedSize_)
+		{
+			train();
+		}
+		return true;
+	}
+
+	void erase(int id)
+	{
+		boost::unordered_map<int, size_t>::iterator iter = rows_.find(id);
+		if(iter == rows_.end())
+		{
+			return;
+		}
+		size_t row = iter->second;
+		rows_.erase(iter);
+		if(trained())
+		{
+			std::vector<int> & list = lists_[assignments_[row]];
+			list.erase(std::find(list.begin(), list.end(), id));
+		}
+		// move the last descriptor in the freed row
+		size_t last = ids_.size()-1;
+		if(row != last)
+		{
+			std::copy(data_.begin()+last*dim_, data_.begin()+(last+1)*dim_, data_.begin()+row*dim_);
+			ids_[row] = ids_[last];
+			assignments_[row] = assignments_[last];
+			rows_[ids_[row]] = row;
+		}
+		data_.resize(last*dim_);
+		ids_.pop_back();
+		assignments_.pop_back();
+	}
+
+	/**
+	 * k nearest nodes of the query descriptor, sorted by squared L2 distance.
+	 */
+	std::vector<std::pair<int, float> > search(const cv::Mat & descriptor, int k) const
+	{
+		std::vector<std::pair<float, int> > results;
+		cv::Mat v = toFloat(descriptor);
+		if(k <= 0 || v.cols != dim_ || ids_.empty())
+		{
+			return std::vector<std::pair<int, float> >();
+		}
+		const float * q = v.ptr<float>();
+		if(!trained())
+		{
+			results.resize(ids_.size());
+			for(size_t i=0; i<ids_.size(); ++i)
+			{
+				results[i] = std::make_pair(distanceSqr(q, &data_[i*dim_]), ids_[i]);
+			}
+		}
+		else
+		{
+			std::vector<std::pair<float, int> > centroids(centroids_.rows);
+			for(int i=0; i<centroids_.rows; ++i)
+			{
+				centroids[i] = std::make_pair(distanceSqr(q, centroids_.ptr<float>(i)), i);
+			}
+			int probes = std::min(probes_, centroids_.rows);
+			std::nth_element(centroids.begin(), centroids.begin()+(probes-1), centroids.end());
+			for(int i=0; i<probes; ++i)
+			{
+				const std::vector<int> & list = lists_[centroids[i].second];
+				for(size_t j=0; j<list.size(); ++j)
+				{
+					results.push_back(std::make_pair(distanceSqr(q, &data_[rows_.at(list[j])*dim_]), list[j]));
+				}
+			}
+		}
+		if((int)results.size() > k)
+		{
+			std::nth_element(results.begin(), results.begin()+k, results.end());
+			results.resize(k);
+		}
+		std::sort(results.begin(), results.end());
+		std::vector<std::pair<int, float> > output(results.size());
+		for(size_t i=0; i<results.size(); ++i)
+		{
+			output[i] = std::make_pair(results[i].second, results[i].first);
+		}
+		return output;
+	}
+
+private:
+	static cv::Mat toFloat(const cv::Mat & descriptor)
+	{
+		cv::Mat v;
+		if(!descriptor.empty())
+		{
+			descriptor.reshape(1, 1).convertTo(v, CV_32F);
+		}
+		return v;
+	}
+	float distanceSqr(const float * a, const float * b) const
+	{
+		float d = 0.0f;
+		for(int i=0; i<dim_; ++i)
+		{
+			float diff = a[i]-b[i];
+			d += diff*diff;
+		}
+		return d;
+	}
+	int nearestCentroid(const float * v) const
+	{
+		int best = 0;
+		float bestDist = distanceSqr(v, centroids_.ptr<float>(0));
+		for(int i=1; i<centroids_.rows; ++i)
+		{
+			float d = distanceSqr(v, centroids_.ptr<float>(i));
+			if(d < bestDist)
+			{
+				bestDist = d;
+				best = i;
+			}
+		}
+		return best;
+	}
+	void train()
+	{
+		int n = (int)ids_.size();
+		int k = std::max(1, (int)std::sqrt((float)n));
+		// k-means on an evenly spaced subset, 32 samples per list are enough
+		int samplesCount = std::min(n, 32*k);
+		cv::Mat samples(samplesCount, dim_, CV_32F);
+		for(int i=0; i<samplesCount; ++i)
+		{
+			std::copy(data_.begin()+(size_t(i)*n/samplesCount)*dim_,
+					data_.begin()+(size_t(i)*n/samplesCount+1)*dim_,
+					samples.ptr<float>(i));
+		}
+		UDEBUG("Training %d lists with %d/%d descriptors of size %d", k, samplesCount, n, dim_);
+		cv::Mat labels;
+		cv::kmeans(samples, k, labels, cv::TermCriteria(cv::TermCriteria::COUNT+cv::TermCriteria::EPS, 10, 1e-4), 1, cv::KMEANS_PP_CENTERS, centroids_);
+		lists_ = std::vector<std::vector<int> >(k);
+		for(int i=0; i<n; ++i)
+		{
+			assignments_[i] = nearestCentroid(&data_[size_t(i)*dim_]);
+			lists_[assignments_[i]].push_back(ids_[i]);
+		}
+		trainedSize_ = n;
+	}
+
+private:
+	int probes_;
+	size_t trainSize_;
+	int dim_;
+	size_t trainedSize_;
+	std::vector<float> data_; // row major, dim_ floats per node
+	std::vector<int> ids_;
+	std::vector<int> assignments_;
+	boost::unordered_map<int, size_t> rows_;
+	std::vector<std::vector<int> > lists_;
+	cv::Mat centroids_;
+};
+
+}
+
+#endif /* GLOBALDESCRIPTORINDEX_H_ */
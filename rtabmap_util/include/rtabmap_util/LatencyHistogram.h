@@ -0,0 +1,121 @@
+/*
+Copyright (c) 2010-2022, Mathieu Labbe
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef LATENCYHISTOGRAM_H_
+#define LATENCYHISTOGRAM_H_
+
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <map>
+
+namespace rtabmap_util {
+
+/**
+ * Keeps the last samples of a latency (e.g., processing time of a
+ * stage) to compute percentiles over a sliding window.
+ */
+class LatencyHistogram
+{
+public:
+	LatencyHistogram(size_t windowSize = 100) :
+		windowSize_(windowSize)
+	{}
+
+	void setWindowSize(size_t windowSize)
+	{
+		windowSize_ = windowSize;
+		while(windowSize_ > 0 && values_.size() > windowSize_)
+		{
+			values_.pop_front();
+		}
+	}
+
+	void add(float value)
+	{
+		values_.push_back(value);
+		while(windowSize_ > 0 && values_.size() > windowSize_)
+		{
+			values_.pop_front();
+		}
+	}
+
+	void clear() {values_.clear();}
+	size_t size() const {return values_.size();}
+
+	/**
+	 * @param p percentile [0,100]
+	 * @return the value at the percentile (nearest rank), 0 if empty.
+	 */
+	float percentile(float p) const
+	{
+		std::vector<float> sorted(values_.begin(), values_.end());
+		return percentile(sorted, p);
+	}
+
+	/**
+	 * Add p50, p95 and p99 percentiles in the statistics map,
+	 * the name is like "Group/Name/unit": "Group/NameP95/unit".
+	 */
+	void exportPercentiles(const std::string & group, const std::string & name, const std::string & unit, std::map<std::string, float> & stats, float scale = 1.0f) const
+	{
+		if(values_.empty())
+		{
+			return;
+		}
+		std::vector<float> sorted(values_.begin(), values_.end());
+		std::sort(sorted.begin(), sorted.end());
+		stats.insert(std::make_pair(group + "/" + name + "P50/" + unit, scale*percentileSorted(sorted, 50.0f)));
+		stats.insert(std::make_pair(group + "/" + name + "P95/" + unit, scale*percentileSorted(sorted, 95.0f)));
+		stats.insert(std::make_pair(group + "/" + name + "P99/" + unit, scale*percentileSorted(sorted, 99.0f)));
+	}
+
+private:
+	static float percentile(std::vector<float> & values, float p)
+	{
+		std::sort(values.begin(), values.end());
+		return percentileSorted(values, p);
+	}
+	static float percentileSorted(const std::vector<float> & sorted, float p)
+	{
+		if(sorted.empty())
+		{
+			return 0.0f;
+		}
+		p = p<0.0f?0.0f:p>100.0f?100.0f:p;
+		size_t index = size_t(p/100.0f*float(sorted.size()-1) + 0.5f);
+		return sorted[index];
+	}
+
+private:
+	size_t windowSize_;
+	std::deque<float> values_;
+};
+
+}
+
+#endif /* LATENCYHISTOGRAM_H_ */
@@ -35,6 +35,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <pcl/point_types.h>
 #include <ros/time.h>
 #include <ros/publisher.h>
+#include <boost/unordered_set.hpp>
+#include <boost/thread/mutex.hpp>
+#include <rtabmap_conversions/ThreadPool.h>
+#include "rtabmap_util/PoseGridIndex.h"
+
+#ifdef WITH_OCTOMAP_MSGS
+#include <octomap_msgs/Octomap.h>
+#endif
 
 namespace rtabmap {
 class OctoMap;
@@ -54,19 +62,29 @@ public:
 	bool hasSubscribers() const;
 	bool isLatching() const {return latching_;}
 	bool isMapUpdated() const;
+	// Incremented each time the occupancy grid changes
+	unsigned long getGridRevision() const {return gridRevision_;}
 	void backwardCompatibilityParameters(ros::NodeHandle & pnh, rtabmap::ParametersMap & parameters) const;
 	void setParameters(const rtabmap::ParametersMap & parameters);
 	void set2DMap(const cv::Mat & map, float xMin, float yMin, float cellSize, const std::map<int, rtabmap::Transform> & poses, const rtabmap::Memory * memory = 0);
 
+	// Snapshot of the local grids cache, from which the occupancy grid,
+	// the octomap and the cloud maps are assembled without reloading sensor data.
+	bool saveCache(const std::string & path) const;
+	bool loadCache(const std::string & path, const std::map<int, rtabmap::Transform> & poses);
+
 	std::map<int, rtabmap::Transform> getFilteredPoses(
 			const std::map<int, rtabmap::Transform> & poses);
 
-	std::map<int, rtabmap::Transform> updateMapCaches(
+	// Returned filtered poses are valid until next call.
+	const std::map<int, rtabmap::Transform> & updateMapCaches(
 			const std::map<int, rtabmap::Transform> & poses,
 			const rtabmap::Memory * memory,
 			bool updateGrid,
 			bool updateOctomap,
-			const std::map<int, rtabmap::Signature> & signatures = std::map<int, rtabmap::Signature>());
+			const std::map<int, rtabmap::Signature> & signatures = std::map<int, rtabmap::Signature>(),
+			boost::mutex * memoryMutex = 0, // if set, locked only while memory is accessed
+			unsigned long graphRevision = 0); // if set, changed only when poses of existing nodes may have changed
 
 	void publishMaps(
 			const std::map<int, rtabmap::Transform> & poses,
@@ -83,12 +101,69 @@ public:
 			float & yMin,
 			float & gridCellSize);
 
+	// Returns the level of the grid pyramid (see "grid_pyramid_cell_sizes")
+	// with cell size the closest to "resolution". The full resolution grid
+	// is returned if resolution <= Grid/CellSize or if there is no pyramid.
+	cv::Mat getGridMap(
+			float & xMin,
+			float & yMin,
+			float & gridCellSize,
+			float resolution);
+	const std::vector<float> & getGridPyramidCellSizes() const {return gridPyramidCellSizes_;}
+
 	const rtabmap::OctoMap * getOctomap() const {return octomap_;}
+#ifdef WITH_OCTOMAP_MSGS
+	// Serialized octomap (without header), regenerated only if the octree changed
+	bool getOctomapBinaryMsg(octomap_msgs::Octomap & msg);
+	bool getOctomapFullMsg(octomap_msgs::Octomap & msg);
+#endif
 	const rtabmap::OccupancyGrid * getOccupancyGrid() const {return occupancyGrid_;}
 
+	// Estimated bytes used by the caches: <"LocalGrids", "LocalClouds",
+	// "AssembledClouds", "GridMap", "OctoMap">
+	std::map<std::string, unsigned long> getMemoryUsage() const;
+	// Release the caches that can be rebuilt from the local grids (point
+	// clouds, then grid pyramid) until the usage is under maxBytes.
+	// Returns the number of bytes released.
+	unsigned long trimCaches(unsigned long maxBytes);
+
+private:
+	bool getIncrementalPoses(
+			const std::map<int, rtabmap::Transform> & poses,
+			std::map<int, rtabmap::Transform> & addedPoses,
+			unsigned long graphRevision);
+	void resetIncrementalPoses();
+	bool gridPyramidHasSubscribers() const;
+	void appendToAssembledCloud(
+			const pcl::PointCloud<pcl::PointXYZRGB> & cloud,
+			pcl::PointCloud<pcl::PointXYZRGB> & assembled,
+			boost::unordered_set<long long> & voxels) const;
+	void updateGridPyramid(const cv::Mat & pixels, float xMin, float yMin, float gridCellSize);
+	void updateGridProbMap(const std::map<int, rtabmap::Transform> & poses, bool incremental = false);
+	void fuseGridProbNode(
+			const rtabmap::Transform & pose,
+			const std::pair< std::pair<cv::Mat, cv::Mat>, cv::Mat> & cells,
+			int sign);
+	void resetGridProbMap();
+	bool publishGridMapUpdate(
+			const cv::Mat & pixels,
+			float xMin,
+			float yMin,
+			float gridCellSize,
+			const ros::Time & stamp,
+			const std::string & mapFrameId);
+#ifdef WITH_OCTOMAP_MSGS
+	void updateOctomapMsgs(bool binary, bool full);
+	void markOctomapSpaceChanged(const std::map<int, rtabmap::Transform> & previousAddedNodes);
+	void updateOctomapSpace();
+	void resetOctomapSpace(bool notifyRemoved);
+#endif
+
 private:
 	// mapping stuff
 	bool cloudOutputVoxelized_;
+	bool cloudVoxelHash_;
+	double cloudUpdateError_;
 	bool cloudSubtractFiltering_;
 	int cloudSubtractFilteringMinNeighbors_;
 	double mapFilterRadius_;
@@ -96,12 +171,18 @@ private:
 	bool mapCacheCleanup_;
 	bool alwaysUpdateMap_;
 	bool scanEmptyRayTracing_;
+	bool mapIncrementalUpdate_;
+	int mapThreads_;
+	boost::shared_ptr<rtabmap_conversions::ThreadPool> threadPool_;
+	bool gridMapUpdates_;
+	int gridMapUpdatesTileSize_;
 
 	ros::Publisher cloudMapPub_;
 	ros::Publisher cloudGroundPub_;
 	ros::Publisher cloudObstaclesPub_;
 	ros::Publisher projMapPub_;
 	ros::Publisher gridMapPub_;
+	ros::Publisher gridMapUpdatesPub_;
 	ros::Publisher gridProbMapPub_;
 	ros::Publisher scanMapPub_;
 	ros::Publisher octoMapPubBin_;
@@ -112,6 +193,10 @@ private:
 	ros::Publisher octoMapObstacleCloud_;
 	ros::Publisher octoMapEmptySpace_;
 	ros::Publisher octoMapProj_;
+	ros::Publisher octoMapFrontierCloudAdded_;
+	ros::Publisher octoMapFrontierCloudRemoved_;
+	ros::Publisher octoMapEmptySpaceAdded_;
+	ros::Publisher octoMapEmptySpaceRemoved_;
 
 	std::map<int, rtabmap::Transform> assembledGroundPoses_;
 	std::map<int, rtabmap::Transform> assembledObstaclePoses_;
@@ -119,20 +204,81 @@ private:
 	pcl::PointCloud<pcl::PointXYZRGB>::Ptr assembledGround_;
 	rtabmap::FlannIndex assembledGroundIndex_;
 	rtabmap::FlannIndex assembledObstacleIndex_;
+	boost::unordered_set<long long> assembledGroundVoxels_;
+	boost::unordered_set<long long> assembledObstacleVoxels_;
 	std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr > groundClouds_;
 	std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr > obstacleClouds_;
 
 	std::map<int, rtabmap::Transform> gridPoses_;
 	cv::Mat gridMap_;
+	cv::Mat gridMapLastPublished_;
+	float gridMapLastXMin_;
+	float gridMapLastYMin_;
+	float gridMapLastCellSize_;
+	uint32_t gridMapSubscribers_;
 	std::map<int, std::pair< std::pair<cv::Mat, cv::Mat>, cv::Mat> > gridMaps_; // < <ground, obstacles>, empty cells >
 	std::map<int, cv::Point3f> gridMapsViewpoints_;
 
+	// coarser levels of the occupancy grid
+	std::vector<float> gridPyramidCellSizes_;
+	std::vector<ros::Publisher> gridPyramidPubs_;
+	std::vector<cv::Mat> gridPyramid_;
+	std::vector<float> gridPyramidActualCellSizes_;
+	float gridPyramidXMin_;
+	float gridPyramidYMin_;
+	unsigned long gridPyramidRevision_;
+
+	// Persistent log-odds grid for grid_prob_map. Log-odds are additive,
+	// so a moved node is reprojected by subtracting its cells at the old
+	// pose and adding them at the new one.
+	bool gridProbMapIncremental_;
+	double gridProbMapUpdateError_;
+	float gridProbHit_; // log-odds
+	float gridProbMiss_;
+	float gridProbClampingMin_;
+	float gridProbClampingMax_;
+	cv::Mat gridProbLogOdds_; // CV_32FC1
+	cv::Mat gridProbUpdates_; // CV_32SC1, 0 for unknown cells
+	cv::Mat gridProbPixels_; // CV_8SC1, -1 or 0-100
+	int gridProbCellXMin_; // in cells
+	int gridProbCellYMin_;
+	std::map<int, std::pair<rtabmap::Transform, std::pair< std::pair<cv::Mat, cv::Mat>, cv::Mat> > > gridProbNodes_; // <pose, <<ground, obstacles>, empty cells>>
+
 	rtabmap::OccupancyGrid * occupancyGrid_;
 	bool gridUpdated_;
+	unsigned long gridRevision_;
 
 	rtabmap::OctoMap * octomap_;
 	int octomapTreeDepth_;
 	bool octomapUpdated_;
+#ifdef WITH_OCTOMAP_MSGS
+	octomap_msgs::Octomap octomapBinaryMsg_;
+	octomap_msgs::Octomap octomapFullMsg_;
+	bool octomapBinaryMsgUpToDate_;
+	bool octomapFullMsgUpToDate_;
+#endif
+
+	// Empty and frontier cells of the octree, grouped by aligned blocks of
+	// cells so that only the blocks touched by new clouds are recomputed.
+	// <block, <empty cells, frontier cells>>, cells are packed keys+depth
+	bool octomapIncrementalSpace_;
+	bool octomapSpaceValid_;
+	std::map<unsigned long long, std::pair<std::vector<unsigned long long>, std::vector<unsigned long long> > > octomapSpaceBlocks_;
+	std::set<unsigned long long> octomapSpaceChangedBlocks_;
+	// changes since the last publication
+	boost::unordered_set<unsigned long long> octomapEmptyAdded_;
+	boost::unordered_set<unsigned long long> octomapEmptyRemoved_;
+	boost::unordered_set<unsigned long long> octomapFrontierAdded_;
+	boost::unordered_set<unsigned long long> octomapFrontierRemoved_;
+
+	// incremental update stuff
+	std::map<int, rtabmap::Transform> incrementalInputPoses_;
+	std::map<int, rtabmap::Transform> filteredPoses_; // last filtered poses returned by updateMapCaches()
+	PoseGridIndex incrementalFilteredIndex_;
+	unsigned long incrementalGraphRevision_;
+	bool incrementalGridCache_;
+	bool incrementalGrid_;
+	bool incrementalOctomap_;
 
 	rtabmap::ParametersMap parameters_;
 
@@ -0,0 +1,199 @@
+/*
+Copyright (c) 2010-2022, Mathieu Labbe
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef NODEDATACACHE_H_
+#define NODEDATACACHE_H_
+
+#include <map>
+#include <list>
+#include <boost/thread/mutex.hpp>
+#include <ros/serialization.h>
+#include <rtabmap_msgs/NodeData.h>
+
+namespace rtabmap_util {
+
+/**
+ * Thread-safe LRU cache of already converted NodeData messages, bounded
+ * by their serialized size. Entries are keyed by node id and by the kind
+ * of data they contain (see the flags), so a node requested without
+ * images is not returned for a request asking for images.
+ */
+class NodeDataCache
+{
+public:
+	enum Flags {
+		kImages   = 1,
+		kScan     = 2,
+		kUserData = 4,
+		kGrid     = 8,
+		kAll      = 15
+	};
+
+	NodeDataCache(size_t maxBytes = 0) :
+		maxBytes_(maxBytes),
+		bytes_(0),
+		hits_(0),
+		misses_(0)
+	{}
+
+	bool enabled() const {return maxBytes_ > 0;}
+	size_t maxBytes() const {return maxBytes_;}
+
+	void setMaxBytes(size_t maxBytes)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		maxBytes_ = maxBytes;
+		trim();
+	}
+
+	size_t bytes() const
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		return bytes_;
+	}
+
+	size_t size() const
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		return entries_.size();
+	}
+
+	void stats(unsigned long & hits, unsigned long & misses) const
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		hits = hits_;
+		misses = misses_;
+	}
+
+	void clear()
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		entries_.clear();
+		order_.clear();
+		bytes_ = 0;
+	}
+
+	/**
+	 * Copy the cached message to msg and mark it as most recently used.
+	 */
+	bool get(int id, int flags, rtabmap_msgs::NodeData & msg)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		if(maxBytes_ > 0)
+		{
+			Entries::iterator iter = entries_.find(Key(id, flags));
+			if(iter != entries_.end())
+			{
+				order_.splice(order_.begin(), order_, iter->second.order);
+				msg = iter->second.msg;
+				++hits_;
+				return true;
+			}
+			++misses_;
+		}
+		return false;
+	}
+
+	void insert(int id, int flags, const rtabmap_msgs::NodeData & msg)
+	{
+		if(maxBytes_ == 0)
+		{
+			return;
+		}
+		size_t bytes = ros::serialization::serializationLength(msg);
+		boost::mutex::scoped_lock lock(mutex_);
+		if(bytes > maxBytes_)
+		{
+			return;
+		}
+		Key key(id, flags);
+		Entries::iterator iter = entries_.find(key);
+		if(iter != entries_.end())
+		{
+			bytes_ -= iter->second.bytes;
+			order_.erase(iter->second.order);
+			entries_.erase(iter);
+		}
+		order_.push_front(key);
+		Entry & entry = entries_[key];
+		entry.msg = msg;
+		entry.bytes = bytes;
+		entry.order = order_.begin();
+		bytes_ += bytes;
+		trim();
+	}
+
+	/**
+	 * Remove all cached variants of a node.
+	 */
+	void erase(int id)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		Entries::iterator iter = entries_.lower_bound(Key(id, 0));
+		while(iter != entries_.end() && iter->first.first == id)
+		{
+			bytes_ -= iter->second.bytes;
+			order_.erase(iter->second.order);
+			entries_.erase(iter++);
+		}
+	}
+
+private:
+	typedef std::pair<int, int> Key;
+	struct Entry
+	{
+		rtabmap_msgs::NodeData msg;
+		size_t bytes;
+		std::list<Key>::iterator order;
+	};
+	typedef std::map<Key, Entry> Entries;
+
+	// mutex_ should be locked
+	void trim()
+	{
+		while(bytes_ > maxBytes_ && !order_.empty())
+		{
+			Entries::iterator iter = entries_.find(order_.back());
+			bytes_ -= iter->second.bytes;
+			entries_.erase(iter);
+			order_.pop_back();
+		}
+	}
+
+private:
+	size_t maxBytes_;
+	size_t bytes_;
+	unsigned long hits_;
+	unsigned long misses_;
+	Entries entries_;
+	std::list<Key> order_;
+	mutable boost::mutex mutex_;
+};
+
+}
+
+#endif /* NODEDATACACHE_H_ */
@@ -0,0 +1,296 @@
+/*
+Copyright (c) 2010-2022, Mathieu Labbe
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef POSEGRIDINDEX_H_
+#define POSEGRIDINDEX_H_
+
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <iterator>
+#include <boost/unordered_map.hpp>
+#include <rtabmap/core/Transform.h>
+#include <rtabmap/utilite/ULogger.h>
+
+namespace rtabmap_util {
+
+/**
+ * Spatial hash of node positions for fast radius queries. update() adds
+ * new nodes incrementally; the grid is rebuilt only if a position of an
+ * already indexed node changed (e.g., after graph optimization) or if
+ * nodes were removed. If the caller gives a graph revision (incremented
+ * each time poses of existing nodes may have changed), existing nodes
+ * are not compared when the revision didn't change.
+ */
+class PoseGridIndex
+{
+public:
+	PoseGridIndex(float cellSize = 1.0f) :
+		cellSize_(cellSize),
+		revision_(0)
+	{
+		UASSERT(cellSize_ > 0.0f);
+		resetBounds();
+	}
+
+	size_t size() const {return positions_.size();}
+	bool empty() const {return positions_.empty();}
+	float cellSize() const {return cellSize_;}
+
+	/**
+	 * Cells should be about the size of the usual query radius.
+	 */
+	void setCellSize(float cellSize)
+	{
+		UASSERT(cellSize > 0.0f);
+		if(cellSize != cellSize_)
+		{
+			cellSize_ = cellSize;
+			std::map<int, Position> positions;
+			positions.swap(positions_);
+			cells_.clear();
+			resetBounds();
+			for(std::map<int, Position>::iterator iter=positions.begin(); iter!=positions.end(); ++iter)
+			{
+				add(iter->first, iter->second.x, iter->second.y, iter->second.z);
+			}
+		}
+	}
+
+	void clear()
+	{
+		positions_.clear();
+		cells_.clear();
+		resetBounds();
+		revision_ = 0;
+	}
+
+	/**
+	 * Synchronize the index with the poses (ids <= 0 are ignored).
+	 * If revision is not 0 and is the same than on the previous
+	 * update, only nodes with ids greater than the indexed ones are
+	 * added (O(new nodes)), otherwise all poses are compared.
+	 * Returns true if the grid had to be rebuilt.
+	 */
+	bool update(const std::map<int, rtabmap::Transform> & poses, unsigned long revision = 0)
+	{
+		if(revision != 0 && revision == revision_ && !positions_.empty())
+		{
+			std::map<int, rtabmap::Transform>::const_iterator addedIter = poses.upper_bound(positions_.rbegin()->first);
+			size_t known = poses.size() -
+					std::distance(poses.begin(), poses.lower_bound(1)) -
+					std::distance(addedIter, poses.end());
+			if(known == positions_.size())
+			{
+				for(; addedIter!=poses.end(); ++addedIter)
+				{
+					if(!addedIter->second.isNull())
+					{
+						add(addedIter->first, addedIter->second.x(), addedIter->second.y(), addedIter->second.z());
+					}
+				}
+				return false;
+			}
+			// nodes removed or retrieved, compare all poses
+		}
+		revision_ = revision;
+
+		bool rebuild = false;
+		std::map<int, rtabmap::Transform>::const_iterator iter = poses.lower_bound(1);
+		std::map<int, Position>::const_iterator jter = positions_.begin();
+		// Both maps are sorted by id: existing nodes should match exactly
+		for(; jter!=positions_.end(); ++jter, ++iter)
+		{
+			while(iter != poses.end() && iter->second.isNull())
+			{
+				++iter;
+			}
+			if(iter == poses.end() ||
+			   iter->first != jter->first ||
+			   iter->second.x() != jter->second.x ||
+			   iter->second.y() != jter->second.y ||
+			   iter->second.z() != jter->second.z)
+			{
+				rebuild = true;
+				break;
+			}
+		}
+		if(rebuild)
+		{
+			positions_.clear();
+			cells_.clear();
+			resetBounds();
+			iter = poses.lower_bound(1);
+		}
+		for(; iter!=poses.end(); ++iter)
+		{
+			if(!iter->second.isNull())
+			{
+				add(iter->first, iter->second.x(), iter->second.y(), iter->second.z());
+			}
+		}
+		return rebuild;
+	}
+
+	/**
+	 * Add a single node (ignored if the id is already indexed).
+	 */
+	void add(int id, float x, float y, float z)
+	{
+		std::pair<std::map<int, Position>::iterator, bool> inserted = positions_.insert(std::make_pair(id, Position(x,y,z)));
+		if(inserted.second)
+		{
+			int c[3] = {cellIndex(x), cellIndex(y), cellIndex(z)};
+			for(int i=0; i<3; ++i)
+			{
+				minCell_[i] = std::min(minCell_[i], c[i]);
+				maxCell_[i] = std::max(maxCell_[i], c[i]);
+			}
+			cells_[key(c[0], c[1], c[2])].push_back(id);
+		}
+	}
+
+	/**
+	 * Get nodes in a radius (>0) of a position, with their squared distance.
+	 * If k>0, only the k nearest ones are returned.
+	 */
+	std::map<int, float> radiusSearch(float x, float y, float z, float radius, int k = 0) const
+	{
+		UASSERT(radius > 0.0f);
+		std::vector<std::pair<float, int> > results;
+		if(positions_.empty())
+		{
+			return std::map<int, float>();
+		}
+		float radiusSqr = radius*radius;
+		// Only cells inside the bounds of the indexed nodes are visited, so
+		// z is not looked up for 2D graphs (all nodes in the same z cell).
+		int minX = boundedCellIndex(x-radius, 0), maxX = boundedCellIndex(x+radius, 0);
+		int minY = boundedCellIndex(y-radius, 1), maxY = boundedCellIndex(y+radius, 1);
+		int minZ = boundedCellIndex(z-radius, 2), maxZ = boundedCellIndex(z+radius, 2);
+		double cells = double(maxX-minX+1)*double(maxY-minY+1)*double(maxZ-minZ+1);
+		if(cells >= double(positions_.size()))
+		{
+			// The radius is large compared to the cell size, visiting all
+			// nodes is cheaper than looking up all cells.
+			for(std::map<int, Position>::const_iterator iter=positions_.begin(); iter!=positions_.end(); ++iter)
+			{
+				addIfInRadius(iter->first, iter->second, x, y, z, radiusSqr, results);
+			}
+		}
+		else
+		{
+			for(int cx=minX; cx<=maxX; ++cx)
+			{
+				for(int cy=minY; cy<=maxY; ++cy)
+				{
+					for(int cz=minZ; cz<=maxZ; ++cz)
+					{
+						Cells::const_iterator cter = cells_.find(key(cx, cy, cz));
+						if(cter != cells_.end())
+						{
+							for(size_t i=0; i<cter->second.size(); ++i)
+							{
+								addIfInRadius(cter->second[i], positions_.at(cter->second[i]), x, y, z, radiusSqr, results);
+							}
+						}
+					}
+				}
+			}
+		}
+		if(k > 0 && (int)results.size() > k)
+		{
+			std::nth_element(results.begin(), results.begin()+k, results.end());
+			results.resize(k);
+		}
+		std::map<int, float> output;
+		for(size_t i=0; i<results.size(); ++i)
+		{
+			output.insert(output.end(), std::make_pair(results[i].second, results[i].first));
+		}
+		return output;
+	}
+
+private:
+	struct Position
+	{
+		Position(float x=0.0f, float y=0.0f, float z=0.0f) : x(x), y(y), z(z) {}
+		float x;
+		float y;
+		float z;
+	};
+	typedef boost::unordered_map<long long, std::vector<int> > Cells;
+
+	static void addIfInRadius(int id, const Position & p, float x, float y, float z, float radiusSqr, std::vector<std::pair<float, int> > & results)
+	{
+		float dx = p.x-x, dy = p.y-y, dz = p.z-z;
+		float distSqr = dx*dx+dy*dy+dz*dz;
+		if(distSqr <= radiusSqr)
+		{
+			results.push_back(std::make_pair(distSqr, id));
+		}
+	}
+
+	void resetBounds()
+	{
+		for(int i=0; i<3; ++i)
+		{
+			minCell_[i] = std::numeric_limits<int>::max();
+			maxCell_[i] = std::numeric_limits<int>::min();
+		}
+	}
+
+	int cellIndex(float v) const
+	{
+		return (int)std::floor(v/cellSize_);
+	}
+	// Cell index clamped to the bounds of the indexed nodes on that axis
+	int boundedCellIndex(float v, int axis) const
+	{
+		float c = std::floor(v/cellSize_);
+		return c <= (float)minCell_[axis]?minCell_[axis]:c >= (float)maxCell_[axis]?maxCell_[axis]:(int)c;
+	}
+	static long long key(int x, int y, int z)
+	{
+		// 21 bits per axis
+		return ((long long)(x & 0x1FFFFF) << 42) | ((long long)(y & 0x1FFFFF) << 21) | (long long)(z & 0x1FFFFF);
+	}
+
+private:
+	float cellSize_;
+	std::map<int, Position> positions_;
+	Cells cells_;
+	int minCell_[3];
+	int maxCell_[3];
+	unsigned long revision_;
+};
+
+}
+
+#endif /* POSEGRIDINDEX_H_ */
@@ -0,0 +1,190 @@
+/*
+Copyright (c) 2010-2022, Mathieu Labbe
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef TIMEDRINGBUFFER_H_
+#define TIMEDRINGBUFFER_H_
+
+#include <vector>
+#include <utility>
+#include <rtabmap/utilite/ULogger.h>
+
+namespace rtabmap_util {
+
+/**
+ * Fixed-capacity buffer of stamped values kept sorted by stamp. Storage
+ * is allocated once, when the capacity is set: when the buffer is full,
+ * adding a new value overwrites the oldest one. Values are expected to
+ * arrive mostly in order; out of order values are inserted at their
+ * sorted position.
+ */
+template<typename T>
+class TimedRingBuffer
+{
+public:
+	TimedRingBuffer(size_t capacity = 1000) :
+		start_(0),
+		size_(0)
+	{
+		setCapacity(capacity);
+	}
+
+	void setCapacity(size_t capacity)
+	{
+		UASSERT(capacity > 0);
+		buffer_ = std::vector<std::pair<double, T> >(capacity);
+		start_ = 0;
+		size_ = 0;
+	}
+
+	size_t capacity() const {return buffer_.size();}
+	size_t size() const {return size_;}
+	bool empty() const {return size_ == 0;}
+
+	void clear()
+	{
+		for(size_t i=0; i<size_; ++i)
+		{
+			slot(i).second = T();
+		}
+		start_ = 0;
+		size_ = 0;
+	}
+
+	/**
+	 * Add a value. Returns false if the value is older than all values of a
+	 * full buffer (it is then ignored).
+	 */
+	bool push(double stamp, const T & value)
+	{
+		size_t index = size_;
+		if(size_>0 && stamp < back().first)
+		{
+			index = lowerBound(stamp);
+			if(index == 0 && size_ == capacity())
+			{
+				return false;
+			}
+		}
+
+		if(size_ == capacity())
+		{
+			// drop oldest
+			start_ = (start_+1) % capacity();
+			--size_;
+			--index;
+		}
+		++size_;
+		// shift newer values (only when received out of order)
+		for(size_t i=size_-1; i>index; --i)
+		{
+			slot(i) = slot(i-1);
+		}
+		slot(index).first = stamp;
+		slot(index).second = value;
+		return true;
+	}
+
+	/**
+	 * Index of the first value with stamp >= "stamp", or size() if none.
+	 */
+	size_t lowerBound(double stamp) const
+	{
+		size_t first = 0;
+		size_t count = size_;
+		while(count > 0)
+		{
+			size_t step = count/2;
+			if(at(first+step).first < stamp)
+			{
+				first += step+1;
+				count -= step+1;
+			}
+			else
+			{
+				count = step;
+			}
+		}
+		return first;
+	}
+
+	/**
+	 * Remove the "count" oldest values.
+	 */
+	void popFront(size_t count = 1)
+	{
+		if(count > size_)
+		{
+			count = size_;
+		}
+		for(size_t i=0; i<count; ++i)
+		{
+			slot(i).second = T();
+		}
+		start_ = (start_+count) % capacity();
+		size_ -= count;
+	}
+
+	/**
+	 * Copy the "count" oldest values into "out" (appended) and remove them
+	 * from the buffer.
+	 */
+	void popFront(size_t count, std::vector<std::pair<double, T> > & out)
+	{
+		if(count > size_)
+		{
+			count = size_;
+		}
+		for(size_t i=0; i<count; ++i)
+		{
+			out.push_back(at(i));
+		}
+		popFront(count);
+	}
+
+	// 0 is the oldest value
+	const std::pair<double, T> & at(size_t i) const
+	{
+		UASSERT(i < size_);
+		return buffer_[(start_+i) % capacity()];
+	}
+	const std::pair<double, T> & front() const {return at(0);}
+	const std::pair<double, T> & back() const {return at(size_-1);}
+
+private:
+	std::pair<double, T> & slot(size_t i)
+	{
+		return buffer_[(start_+i) % capacity()];
+	}
+
+private:
+	std::vector<std::pair<double, T> > buffer_;
+	size_t start_;
+	size_t size_;
+};
+
+}
+
+#endif /* TIMEDRINGBUFFER_H_ */
@@ -24,52 +24,190 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+
 #include <ros/ros.h>
 #include <rtabmap/utilite/UEventsHandler.h>
+#include <rtabmap/utilite/UConversion.h>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <list>
 
 namespace rtabmap_util {
 
 class ULogToRosout : public UEventsHandler
 {
 public:
-	ULogToRosout()
+	ULogToRosout() :
+		async_(false),
+		maxRate_(0.0),
+		queueSize_(1000),
+		dropped_(0),
+		stop_(false),
+		sinkThread_(0)
 	{
 		registerToEventsManager();
 	}
 	virtual ~ULogToRosout()
 	{
 		unregisterFromEventsManager();
+		stopSink();
+	}
+
+	// When async is true, log messages are only queued in handleEvent() and
+	// forwarded to rosout by a dedicated thread, at most "maxRate"
+	// messages per second (0=no limit). Consecutive identical messages are
+	// coalesced. If more than "queueSize" messages are pending, the new
+	// ones are dropped (a warning tells how many).
+	void setAsync(bool async, double maxRate = 0.0, int queueSize = 1000)
+	{
+		stopSink();
+		boost::mutex::scoped_lock lock(mutex_);
+		maxRate_ = maxRate;
+		queueSize_ = queueSize>0?queueSize:1;
+		async_ = async;
+		if(async_)
+		{
+			stop_ = false;
+			sinkThread_ = new boost::thread(boost::bind(&ULogToRosout::sinkThread, this));
+		}
 	}
+
 protected:
 	virtual bool handleEvent(UEvent * event)
 	{
 		if(event->getClassName().compare("ULogEvent") == 0)
 		{
 			ULogEvent * logEvent = (ULogEvent *)event;
-			if(logEvent->getCode() == ULogger::kDebug)
 			{
-				ROS_DEBUG("%s", logEvent->getMsg().c_str());
+				boost::mutex::scoped_lock lock(mutex_);
+				if(async_)
+				{
+					if((int)queue_.size() < queueSize_)
+					{
+						queue_.push_back(std::make_pair(logEvent->getCode(), logEvent->getMsg()));
+						cond_.notify_one();
+					}
+					else
+					{
+						++dropped_;
+					}
+					return true;
+				}
 			}
-			else if(logEvent->getCode() == ULogger::kInfo)
+			print(logEvent->getCode(), logEvent->getMsg());
+			return true;
+		}
+		return false;
+	}
+
+private:
+	static void print(int code, const std::string & msg)
+	{
+		if(code == ULogger::kDebug)
+		{
+			ROS_DEBUG("%s", msg.c_str());
+		}
+		else if(code == ULogger::kInfo)
+		{
+			ROS_INFO("%s", msg.c_str());
+		}
+		else if(code == ULogger::kWarning)
+		{
+			ROS_WARN("%s", msg.c_str());
+		}
+		else if(code == ULogger::kError)
+		{
+			ROS_ERROR("%s", msg.c_str());
+		}
+		else if(code == ULogger::kFatal)
+		{
+			ROS_FATAL("%s", msg.c_str());
+		}
+	}
+
+	void stopSink()
+	{
+		if(sinkThread_)
+		{
 			{
-				ROS_INFO("%s", logEvent->getMsg().c_str());
+				boost::mutex::scoped_lock lock(mutex_);
+				stop_ = true;
+				cond_.notify_one();
 			}
-			else if(logEvent->getCode() == ULogger::kWarning)
+			sinkThread_->join();
+			delete sinkThread_;
+			sinkThread_ = 0;
+		}
+		boost::mutex::scoped_lock lock(mutex_);
+		async_ = false;
+	}
+
+	void sinkThread()
+	{
+		std::list<std::pair<int, std::string> > msgs;
+		while(true)
+		{
+			int dropped = 0;
+			bool stop = false;
 			{
-				ROS_WARN("%s", logEvent->getMsg().c_str());
+				boost::mutex::scoped_lock lock(mutex_);
+				while(queue_.empty() && !stop_)
+				{
+					cond_.wait(lock);
+				}
+				msgs.swap(queue_);
+				dropped = dropped_;
+				dropped_ = 0;
+				stop = stop_;
 			}
-			else if(logEvent->getCode() == ULogger::kError)
+			if(msgs.empty() && stop)
 			{
-				ROS_ERROR("%s", logEvent->getMsg().c_str());
+				break;
 			}
-			else if(logEvent->getCode() == ULogger::kFatal)
+
+			if(dropped)
 			{
-				ROS_FATAL("%s", logEvent->getMsg().c_str());
+				ROS_WARN("ULogToRosout: %d log messages dropped (queue full, size=%d).", dropped, queueSize_);
+			}
+			while(!msgs.empty())
+			{
+				int repeated = 0;
+				std::list<std::pair<int, std::string> >::iterator iter = msgs.begin();
+				std::list<std::pair<int, std::string> >::iterator jter = iter;
+				for(++jter; jter!=msgs.end() && jter->first == iter->first && jter->second == iter->second; ++jter)
+				{
+					++repeated;
+				}
+				if(repeated)
+				{
+					print(iter->first, iter->second + uFormat(" (repeated %d times)", repeated+1));
+				}
+				else
+				{
+					print(iter->first, iter->second);
+				}
+				msgs.erase(iter, jter);
+
+				if(maxRate_ > 0.0 && !stop)
+				{
+					boost::this_thread::sleep(boost::posix_time::microseconds((long)(1000000.0/maxRate_)));
+				}
 			}
-			return true;
 		}
-		return false;
 	}
+
+private:
+	bool async_;
+	double maxRate_;
+	int queueSize_;
+	int dropped_;
+	bool stop_;
+	std::list<std::pair<int, std::string> > queue_;
+	boost::mutex mutex_;
+	boost::condition_variable cond_;
+	boost::thread * sinkThread_;
 };
 
 }
@@ -0,0 +1,224 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <ros/ros.h>
+#include <rtabmap_msgs/Info.h>
+#include <rtabmap_msgs/OdomInfo.h>
+#include <rtabmap_conversions/MsgConversion.h>
+#include <rtabmap/utilite/UStl.h>
+#include <rtabmap/utilite/UConversion.h>
+#include <rtabmap/utilite/UMath.h>
+#include <algorithm>
+#include <cstdio>
+
+// Accumulate the timing statistics published by rtabmap (info) and
+// odometry (odom_info), then write a JSON report on exit or when no
+// more statistics are received after "idle_timeout" seconds. Combined
+// with data_player ("max_speed" and "prefetch" parameters), this can
+// be used to compare performance between releases on the same data.
+class BenchmarkRecorder
+{
+public:
+	BenchmarkRecorder() :
+		outputPath_("benchmark.json"),
+		idleTimeout_(0.0),
+		infoCount_(0),
+		odomInfoCount_(0),
+		written_(false)
+	{
+		ros::NodeHandle pnh("~");
+		std::string prefixes = "Timing/ RtabmapROS/ Odometry/";
+		pnh.param("output", outputPath_, outputPath_);
+		pnh.param("stats_prefixes", prefixes, prefixes); // space-separated, empty=all
+		pnh.param("idle_timeout", idleTimeout_, idleTimeout_);
+		prefixes_ = uListToVector(uSplit(prefixes, ' '));
+		prefixes_.erase(std::remove(prefixes_.begin(), prefixes_.end(), std::string()), prefixes_.end());
+
+		ROS_INFO("benchmark_recorder: output = %s", outputPath_.c_str());
+		ROS_INFO("benchmark_recorder: stats_prefixes = %s", prefixes.c_str());
+		ROS_INFO("benchmark_recorder: idle_timeout = %f s", idleTimeout_);
+
+		ros::NodeHandle nh;
+		infoSub_ = nh.subscribe("info", 100, &BenchmarkRecorder::infoCallback, this);
+		odomInfoSub_ = nh.subscribe("odom_info", 100, &BenchmarkRecorder::odomInfoCallback, this);
+		if(idleTimeout_ > 0.0)
+		{
+			idleTimer_ = nh.createWallTimer(ros::WallDuration(idleTimeout_/2.0), &BenchmarkRecorder::idleCallback, this);
+		}
+	}
+
+	virtual ~BenchmarkRecorder()
+	{
+		write();
+	}
+
+	void infoCallback(const rtabmap_msgs::InfoConstPtr & msg)
+	{
+		received();
+		++infoCount_;
+		for(size_t i=0; i<msg->statsKeys.size() && i<msg->statsValues.size(); ++i)
+		{
+			add(msg->statsKeys[i], msg->statsValues[i]);
+		}
+	}
+
+	void odomInfoCallback(const rtabmap_msgs::OdomInfoConstPtr & msg)
+	{
+		received();
+		++odomInfoCount_;
+		std::map<std::string, float> stats = rtabmap_conversions::odomInfoToStatistics(rtabmap_conversions::odomInfoFromROS(*msg, true));
+		for(std::map<std::string, float>::iterator iter=stats.begin(); iter!=stats.end(); ++iter)
+		{
+			add(iter->first, iter->second);
+		}
+	}
+
+	void idleCallback(const ros::WallTimerEvent &)
+	{
+		if(!lastReceived_.isZero() && (ros::WallTime::now() - lastReceived_).toSec() > idleTimeout_)
+		{
+			ROS_INFO("benchmark_recorder: no statistics received since %f s, writing report.", idleTimeout_);
+			write();
+			ros::shutdown();
+		}
+	}
+
+	void write()
+	{
+		if(written_ || (infoCount_ == 0 && odomInfoCount_ == 0))
+		{
+			return;
+		}
+		written_ = true;
+
+		FILE * file = fopen(outputPath_.c_str(), "w");
+		if(!file)
+		{
+			ROS_ERROR("benchmark_recorder: cannot write \"%s\"", outputPath_.c_str());
+			return;
+		}
+		double duration = (lastReceived_ - firstReceived_).toSec();
+		fprintf(file, "{\n");
+		fprintf(file, "  \"info_count\": %d,\n", infoCount_);
+		fprintf(file, "  \"odom_info_count\": %d,\n", odomInfoCount_);
+		fprintf(file, "  \"wall_duration_s\": %f,\n", duration);
+		fprintf(file, "  \"info_rate_hz\": %f,\n", duration>0.0?double(infoCount_)/duration:0.0);
+		fprintf(file, "  \"odom_info_rate_hz\": %f,\n", duration>0.0?double(odomInfoCount_)/duration:0.0);
+		fprintf(file, "  \"stats\": {");
+		for(std::map<std::string, std::vector<float> >::iterator iter=values_.begin(); iter!=values_.end(); ++iter)
+		{
+			std::vector<float> & v = iter->second;
+			std::sort(v.begin(), v.end());
+			double sum = 0.0;
+			for(size_t i=0; i<v.size(); ++i)
+			{
+				sum += v[i];
+			}
+			fprintf(file, "%s\n    \"%s\": {\"count\": %d, \"mean\": %g, \"min\": %g, \"p50\": %g, \"p90\": %g, \"p99\": %g, \"max\": %g}",
+					iter==values_.begin()?"":",",
+					escape(iter->first).c_str(),
+					(int)v.size(),
+					sum/double(v.size()),
+					v.front(),
+					percentile(v, 0.5),
+					percentile(v, 0.9),
+					percentile(v, 0.99),
+					v.back());
+		}
+		fprintf(file, "\n  }\n}\n");
+		fclose(file);
+		ROS_INFO("benchmark_recorder: report written to \"%s\" (%d info, %d odom info, %d stats)",
+				outputPath_.c_str(), infoCount_, odomInfoCount_, (int)values_.size());
+	}
+
+private:
+	void received()
+	{
+		lastReceived_ = ros::WallTime::now();
+		if(firstReceived_.isZero())
+		{
+			firstReceived_ = lastReceived_;
+		}
+	}
+
+	void add(const std::string & key, float value)
+	{
+		bool keep = prefixes_.empty();
+		for(size_t i=0; i<prefixes_.size() && !keep; ++i)
+		{
+			keep = key.compare(0, prefixes_[i].size(), prefixes_[i]) == 0;
+		}
+		if(keep && uIsFinite(value))
+		{
+			values_[key].push_back(value);
+		}
+	}
+
+	static float percentile(const std::vector<float> & sorted, float p)
+	{
+		size_t index = std::min(sorted.size()-1, size_t(p*float(sorted.size()-1) + 0.5f));
+		return sorted[index];
+	}
+
+	static std::string escape(const std::string & str)
+	{
+		std::string out;
+		for(size_t i=0; i<str.size(); ++i)
+		{
+			if(str[i] == '"' || str[i] == '\\')
+			{
+				out += '\\';
+			}
+			out += str[i];
+		}
+		return out;
+	}
+
+private:
+	std::string outputPath_;
+	double idleTimeout_;
+	std::vector<std::string> prefixes_;
+	int infoCount_;
+	int odomInfoCount_;
+	bool written_;
+	ros::WallTime firstReceived_;
+	ros::WallTime lastReceived_;
+	std::map<std::string, std::vector<float> > values_;
+
+	ros::Subscriber infoSub_;
+	ros::Subscriber odomInfoSub_;
+	ros::WallTimer idleTimer_;
+};
+
+int main(int argc, char** argv)
+{
+	ros::init(argc, argv, "benchmark_recorder");
+	BenchmarkRecorder recorder;
+	ros::spin();
+	recorder.write();
+	return 0;
+}
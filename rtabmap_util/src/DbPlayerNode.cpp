@@ -45,12 +45,16 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/utilite/ULogger.h>
 #include <rtabmap/utilite/UStl.h>
 #include <rtabmap/utilite/UThread.h>
+#include <rtabmap/utilite/UTimer.h>
 #include <rtabmap/utilite/UDirectory.h>
 #include <rtabmap/utilite/UConversion.h>
 #include <rtabmap/core/util3d.h>
 #include <rtabmap/core/DBReader.h>
 #include <rtabmap/core/OdometryEvent.h>
+#include <boost/thread.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <cmath>
+#include <list>
 
 #ifndef _WIN32
 #include <sys/ioctl.h>
@@ -121,6 +125,84 @@ bool resumeCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&)
 	return true;
 }
 
+// Read and decompress the next nodes of the database in a
+// background thread, up to "queueSize" nodes in advance.
+class DataPrefetcher
+{
+public:
+	DataPrefetcher(rtabmap::DBReader & reader, int queueSize) :
+		reader_(reader),
+		queueSize_(queueSize),
+		running_(true),
+		thread_(boost::bind(&DataPrefetcher::loop, this))
+	{
+	}
+	~DataPrefetcher()
+	{
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			running_ = false;
+		}
+		condition_.notify_all();
+		thread_.join();
+	}
+
+	rtabmap::SensorData take(rtabmap::CameraInfo & cameraInfo)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		while(queue_.empty() && ros::ok())
+		{
+			condition_.timed_wait(lock, boost::posix_time::milliseconds(100));
+		}
+		if(queue_.empty())
+		{
+			return rtabmap::SensorData();
+		}
+		rtabmap::SensorData data = queue_.front().first;
+		cameraInfo = queue_.front().second;
+		queue_.pop_front();
+		condition_.notify_all();
+		return data;
+	}
+
+private:
+	void loop()
+	{
+		bool lastReached = false;
+		while(!lastReached)
+		{
+			{
+				boost::mutex::scoped_lock lock(mutex_);
+				while(running_ && (int)queue_.size() >= queueSize_)
+				{
+					condition_.wait(lock);
+				}
+				if(!running_)
+				{
+					break;
+				}
+			}
+			rtabmap::CameraInfo cameraInfo;
+			rtabmap::SensorData data = reader_.takeImage(&cameraInfo);
+			lastReached = data.id() == 0;
+			{
+				boost::mutex::scoped_lock lock(mutex_);
+				queue_.push_back(std::make_pair(data, cameraInfo));
+			}
+			condition_.notify_all();
+		}
+	}
+
+private:
+	rtabmap::DBReader & reader_;
+	int queueSize_;
+	bool running_;
+	std::list<std::pair<rtabmap::SensorData, rtabmap::CameraInfo> > queue_;
+	boost::mutex mutex_;
+	boost::condition_variable condition_;
+	boost::thread thread_;
+};
+
 int main(int argc, char** argv)
 {
 	ros::init(argc, argv, "data_player");
@@ -150,6 +232,8 @@ int main(int argc, char** argv)
 	bool publishTf = true;
 	int startId = 0;
 	bool useDbStamps = true;
+	int prefetch = 0;
+	bool maxSpeed = false;
 
 	pnh.param("frame_id", frameId, frameId);
 	pnh.param("odom_frame_id", odomFrameId, odomFrameId);
@@ -159,6 +243,8 @@ int main(int argc, char** argv)
 	pnh.param("database", databasePath, databasePath);
 	pnh.param("publish_tf", publishTf, publishTf);
 	pnh.param("start_id", startId, startId);
+	pnh.param("prefetch", prefetch, prefetch); // Number of nodes read in advance (0=disabled)
+	pnh.param("max_speed", maxSpeed, maxSpeed); // Ignore stamps, publish as fast as possible
 
 	// A general 360 lidar with 0.5 deg increment
 	double scanAngleMin, scanAngleMax, scanAngleIncrement, scanRangeMin, scanRangeMax;
@@ -175,6 +261,8 @@ int main(int argc, char** argv)
 	ROS_INFO("rate = %f", rate);
 	ROS_INFO("publish_tf = %s", publishTf?"true":"false");
 	ROS_INFO("start_id = %d", startId);
+	ROS_INFO("prefetch = %d", prefetch);
+	ROS_INFO("max_speed = %s", maxSpeed?"true":"false");
 	ROS_INFO("Publish clock (--clock): %s", publishClock?"true":"false");
 
 	if(databasePath.empty())
@@ -189,7 +277,9 @@ int main(int argc, char** argv)
 	}
 	ROS_INFO("database = %s", databasePath.c_str());
 
-	rtabmap::DBReader reader(databasePath, -rate, false, false, false, startId);
+	// With prefetching, the reader should not wait between nodes, the
+	// publishing loop is throttled instead.
+	rtabmap::DBReader reader(databasePath, maxSpeed||prefetch>0?0.0f:-rate, false, false, false, startId);
 	if(!reader.init())
 	{
 		ROS_ERROR("Cannot open database \"%s\".", databasePath.c_str());
@@ -222,9 +312,17 @@ int main(int argc, char** argv)
 		clockPub = nh.advertise<rosgraph_msgs::Clock>("/clock", 1);
 	}
 
+	boost::scoped_ptr<DataPrefetcher> prefetcher;
+	if(prefetch > 0)
+	{
+		prefetcher.reset(new DataPrefetcher(reader, prefetch));
+	}
+	double firstStamp = 0.0;
+	double firstTime = 0.0;
+
 	UTimer timer;
 	rtabmap::CameraInfo cameraInfo;
-	rtabmap::SensorData data = reader.takeImage(&cameraInfo);
+	rtabmap::SensorData data = prefetcher.get()?prefetcher->take(cameraInfo):reader.takeImage(&cameraInfo);
 	rtabmap::OdometryInfo odomInfo;
 	odomInfo.reg.covariance = cameraInfo.odomCovariance;
 	rtabmap::OdometryEvent odom(data, cameraInfo.odomPose, odomInfo);
@@ -235,6 +333,24 @@ int main(int argc, char** argv)
 
 		ros::Time time(odom.data().stamp());
 
+		if(prefetcher.get() && !maxSpeed && rate > 0.0 && odom.data().stamp() > 0.0)
+		{
+			// Keep the same time ratio than the database stamps
+			if(firstStamp == 0.0)
+			{
+				firstStamp = odom.data().stamp();
+				firstTime = UTimer::now();
+			}
+			else
+			{
+				double delay = firstTime + (odom.data().stamp() - firstStamp)/rate - UTimer::now();
+				if(delay > 0.0)
+				{
+					uSleep(delay*1000.0);
+				}
+			}
+		}
+
 		if(publishClock)
 		{
 			rosgraph_msgs::Clock msg;
@@ -665,13 +781,14 @@ int main(int argc, char** argv)
 				break;
 			}
 
+			firstStamp = 0.0; // restart stamp ratio after pause
 			uSleep(100);
 			ros::spinOnce();
 		}
 
 		timer.restart();
 		cameraInfo = rtabmap::CameraInfo();
-		data = reader.takeImage(&cameraInfo);
+		data = prefetcher.get()?prefetcher->take(cameraInfo):reader.takeImage(&cameraInfo);
 		odomInfo.reg.covariance = cameraInfo.odomCovariance;
 		odom = rtabmap::OdometryEvent(data, cameraInfo.odomPose, odomInfo);
 		acquisitionTime = timer.ticks();
@@ -0,0 +1,199 @@
+/*
+Copyright (c) 2010-2022, Mathieu Labbe
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "rtabmap_util/DepthToCloud.h"
+
+#include <rtabmap/utilite/ULogger.h>
+#include <limits>
+#include <cstring>
+
+namespace rtabmap_util {
+
+template<typename T>
+inline float depthValue(T value);
+template<>
+inline float depthValue<unsigned short>(unsigned short value) {return float(value)*0.001f;}
+template<>
+inline float depthValue<float>(float value) {return value;}
+
+// Inner loops only use precomputed per-column/per-row
+// factors so that the compiler can vectorize them.
+template<typename T>
+static size_t backProject(
+		const cv::Mat & depth,
+		const cv::Mat & rgb,
+		int decimation,
+		const std::vector<float> & xFactors,
+		const std::vector<float> & yFactors,
+		float maxDepth,
+		float minDepth,
+		bool removeInvalid,
+		size_t pointStep,
+		unsigned char * output)
+{
+	const float bad = std::numeric_limits<float>::quiet_NaN();
+	const int cols = (int)xFactors.size();
+	const int rows = (int)yFactors.size();
+	size_t n = 0;
+	for(int v=0; v<rows; ++v)
+	{
+		const T * depthRow = depth.ptr<T>(v*decimation);
+		const unsigned char * rgbRow = rgb.empty()?0:rgb.ptr<unsigned char>(v*decimation);
+		const float yFactor = yFactors[v];
+		for(int u=0; u<cols; ++u)
+		{
+			float z = depthValue<T>(depthRow[u*decimation]);
+			bool valid = z > 0.0f && z == z && (maxDepth <= 0.0f || z <= maxDepth) && z > minDepth;
+			if(!valid && removeInvalid)
+			{
+				continue;
+			}
+			float * pt = (float*)(output + n*pointStep);
+			if(valid)
+			{
+				pt[0] = xFactors[u] * z;
+				pt[1] = yFactor * z;
+				pt[2] = z;
+			}
+			else
+			{
+				pt[0] = pt[1] = pt[2] = bad;
+			}
+			if(rgbRow)
+			{
+				uint32_t color;
+				if(rgb.channels() == 3)
+				{
+					const unsigned char * bgr = rgbRow + u*decimation*3;
+					color = (uint32_t(bgr[2]) << 16) | (uint32_t(bgr[1]) << 8) | uint32_t(bgr[0]);
+				}
+				else
+				{
+					const unsigned char gray = rgbRow[u*decimation];
+					color = (uint32_t(gray) << 16) | (uint32_t(gray) << 8) | uint32_t(gray);
+				}
+				memcpy(pt+3, &color, sizeof(uint32_t));
+			}
+			++n;
+		}
+	}
+	return n;
+}
+
+bool depthToPointCloud2(
+		const cv::Mat & depth,
+		const cv::Mat & rgb,
+		const rtabmap::CameraModel & modelIn,
+		int decimation,
+		float maxDepth,
+		float minDepth,
+		bool removeInvalid,
+		sensor_msgs::PointCloud2 & cloud)
+{
+	if(depth.empty() ||
+	   (depth.type() != CV_16UC1 && depth.type() != CV_32FC1) ||
+	   decimation < 1 ||
+	   depth.cols % decimation != 0 ||
+	   depth.rows % decimation != 0 ||
+	   !modelIn.isValidForProjection() ||
+	   (!modelIn.localTransform().isNull() && !modelIn.localTransform().isIdentity()))
+	{
+		return false;
+	}
+	if(!rgb.empty() &&
+	   ((rgb.type() != CV_8UC3 && rgb.type() != CV_8UC1) ||
+	    rgb.cols != depth.cols ||
+	    rgb.rows != depth.rows))
+	{
+		return false;
+	}
+
+	rtabmap::CameraModel model = modelIn;
+	if(model.imageWidth() > 0 && model.imageWidth() != depth.cols)
+	{
+		// camera info is for a higher resolution rgb image
+		if(model.imageWidth() % depth.cols != 0)
+		{
+			return false;
+		}
+		model = model.scaled(double(depth.cols)/double(model.imageWidth()));
+	}
+
+	const int cols = depth.cols/decimation;
+	const int rows = depth.rows/decimation;
+	std::vector<float> xFactors(cols);
+	std::vector<float> yFactors(rows);
+	for(int u=0; u<cols; ++u)
+	{
+		xFactors[u] = (float(u*decimation) - model.cx()) / model.fx();
+	}
+	for(int v=0; v<rows; ++v)
+	{
+		yFactors[v] = (float(v*decimation) - model.cy()) / model.fy();
+	}
+
+	cloud.fields.resize(rgb.empty()?3:4);
+	const char * names[4] = {"x", "y", "z", "rgb"};
+	for(size_t i=0; i<cloud.fields.size(); ++i)
+	{
+		cloud.fields[i].name = names[i];
+		cloud.fields[i].offset = i*sizeof(float);
+		cloud.fields[i].datatype = sensor_msgs::PointField::FLOAT32;
+		cloud.fields[i].count = 1;
+	}
+	cloud.point_step = cloud.fields.size()*sizeof(float);
+	cloud.is_bigendian = false;
+	cloud.data.resize(size_t(cols)*size_t(rows)*cloud.point_step);
+
+	size_t n;
+	if(depth.type() == CV_16UC1)
+	{
+		n = backProject<unsigned short>(depth, rgb, decimation, xFactors, yFactors, maxDepth, minDepth, removeInvalid, cloud.point_step, cloud.data.data());
+	}
+	else
+	{
+		n = backProject<float>(depth, rgb, decimation, xFactors, yFactors, maxDepth, minDepth, removeInvalid, cloud.point_step, cloud.data.data());
+	}
+
+	if(removeInvalid)
+	{
+		cloud.height = 1;
+		cloud.width = n;
+		cloud.is_dense = true;
+	}
+	else
+	{
+		UASSERT(n == size_t(cols)*size_t(rows));
+		cloud.height = rows;
+		cloud.width = cols;
+		cloud.is_dense = false;
+	}
+	cloud.row_step = cloud.width * cloud.point_step;
+	cloud.data.resize(n*cloud.point_step);
+	return true;
+}
+
+}
@@ -30,6 +30,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap_conversions/MsgConversion.h"
 #include "rtabmap_util/MapsManager.h"
 #include "rtabmap_msgs/GetMap.h"
+#include "rtabmap_msgs/GetMap2.h"
 #include <rtabmap/core/util3d_transforms.h>
 #include <rtabmap/core/util3d.h>
 #include <rtabmap/core/util3d_filtering.h>
@@ -44,6 +45,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <pcl_conversions/pcl_conversions.h>
 #include <nav_msgs/OccupancyGrid.h>
 #include <std_srvs/Empty.h>
+#include <ros/serialization.h>
+#include <fstream>
+#include <unistd.h>
 
 #ifdef WITH_OCTOMAP_MSGS
 #ifdef RTABMAP_OCTOMAP
@@ -55,12 +59,80 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 using namespace rtabmap;
 
+/**
+ * Append-only file of serialized NodeData messages, used to reload
+ * nodes evicted from memory when the maps have to be regenerated.
+ */
+class NodeDataFile
+{
+public:
+	NodeDataFile() {}
+	~NodeDataFile() {close();}
+
+	bool open(const std::string & path)
+	{
+		close();
+		file_.open(path.c_str(), std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+		path_ = path;
+		return file_.is_open();
+	}
+	void close()
+	{
+		if(file_.is_open())
+		{
+			file_.close();
+			std::remove(path_.c_str());
+		}
+		index_.clear();
+	}
+	bool isOpen() const {return file_.is_open();}
+	bool contains(int id) const {return index_.find(id) != index_.end();}
+
+	void write(const rtabmap_msgs::NodeData & msg)
+	{
+		uint32_t size = ros::serialization::serializationLength(msg);
+		std::vector<uint8_t> buffer(size);
+		ros::serialization::OStream stream(buffer.data(), size);
+		ros::serialization::serialize(stream, msg);
+		file_.seekp(0, std::ios::end);
+		index_[msg.id] = std::make_pair((std::streamoff)file_.tellp(), size);
+		file_.write((const char*)buffer.data(), size);
+	}
+
+	bool read(int id, rtabmap_msgs::NodeData & msg)
+	{
+		std::map<int, std::pair<std::streamoff, uint32_t> >::iterator iter = index_.find(id);
+		if(iter == index_.end())
+		{
+			return false;
+		}
+		std::vector<uint8_t> buffer(iter->second.second);
+		file_.seekg(iter->second.first);
+		file_.read((char*)buffer.data(), buffer.size());
+		if(!file_)
+		{
+			file_.clear();
+			return false;
+		}
+		ros::serialization::IStream stream(buffer.data(), buffer.size());
+		ros::serialization::deserialize(stream, msg);
+		return true;
+	}
+
+private:
+	std::fstream file_;
+	std::string path_;
+	std::map<int, std::pair<std::streamoff, uint32_t> > index_; // offset, size
+};
+
 class MapAssembler
 {
 
 public:
 	MapAssembler(int & argc, char** argv) :
-		localGridsRegenerated_(false)
+		localGridsRegenerated_(false),
+		cacheMaxBytes_(0),
+		cacheBytes_(0)
 	{
 		ros::NodeHandle pnh("~");
 		ros::NodeHandle nh;
@@ -68,6 +140,16 @@ public:
 		std::string configPath;
 		pnh.param("config_path", configPath, configPath);
 		pnh.param("regenerate_local_grids", localGridsRegenerated_, localGridsRegenerated_);
+		int cacheMaxSize = 0;
+		std::string cachePath = uFormat("/tmp/map_assembler_%d.bin", (int)getpid());
+		pnh.param("cache_max_size", cacheMaxSize, cacheMaxSize);
+		pnh.param("cache_path", cachePath, cachePath);
+		cacheMaxBytes_ = size_t(std::max(0, cacheMaxSize))*1024*1024;
+		if(cacheMaxBytes_ > 0 && !nodeDataFile_.open(cachePath))
+		{
+			ROS_ERROR("%s: Cannot open \"%s\", nodes are kept in memory (cache_max_size ignored).", ros::this_node::getName().c_str(), cachePath.c_str());
+			cacheMaxBytes_ = 0;
+		}
 
 		//parameters
 		rtabmap::ParametersMap parameters;
@@ -175,6 +257,11 @@ public:
 		}
 
 		ROS_INFO("%s: regenerate_local_grids          = %s", ros::this_node::getName().c_str(), localGridsRegenerated_?"true":"false");
+		ROS_INFO("%s: cache_max_size                  = %d MB (0=unlimited)", ros::this_node::getName().c_str(), cacheMaxSize);
+		if(cacheMaxBytes_ > 0)
+		{
+			ROS_INFO("%s: cache_path                      = %s", ros::this_node::getName().c_str(), cachePath.c_str());
+		}
 		mapsManager_.init(nh, pnh, ros::this_node::getName(), false);
 		mapsManager_.backwardCompatibilityParameters(pnh, parameters);
 		mapsManager_.setParameters(parameters);
@@ -199,22 +286,71 @@ public:
 			rtabmapNs += "/get_map_data";
 		}
 
+		// Initialize the cache by pages of nodes (get_map_data2) to avoid a
+		// huge response for large maps, fallback to get_map_data otherwise.
+		std::string srvName2 = rtabmapNs + "2";
+		rtabmap_msgs::GetMap2 getMap2Srv;
+		getMap2Srv.request.global = false;
+		getMap2Srv.request.optimized = true;
+		getMap2Srv.request.with_images = true;
+		getMap2Srv.request.with_scans = true;
+		getMap2Srv.request.with_user_data = true;
+		getMap2Srv.request.with_grids = true;
+		getMap2Srv.request.with_words = true;
+		getMap2Srv.request.with_global_descriptors = true;
+		getMap2Srv.request.max_nodes = 100;
 		rtabmap_msgs::GetMap getMapSrv;
 		getMapSrv.request.global = false;
 		getMapSrv.request.optimized = true;
 		getMapSrv.request.graphOnly = false;
 		if(ros::service::waitForService(rtabmapNs, 5000))
 		{
-			if(!ros::service::call(rtabmapNs, getMapSrv))
+			bool paged = ros::service::exists(srvName2, false);
+			if(paged)
 			{
-				ROS_WARN("Cannot call \"%s\" service", rtabmapNs.c_str());
+				ROS_INFO("Calling \"%s\" service, initializing cache...", srvName2.c_str());
+				// The graph is requested only with the first page, then reused for the next ones
+				rtabmap_msgs::MapGraph graph;
+				do
+				{
+					getMap2Srv.request.min_id = getMap2Srv.response.next_id;
+					getMap2Srv.request.skip_graph = getMap2Srv.request.min_id > 0;
+					if(!ros::service::call(srvName2, getMap2Srv))
+					{
+						ROS_WARN("Cannot call \"%s\" service (min_id=%d)", srvName2.c_str(), getMap2Srv.request.min_id);
+						paged = getMap2Srv.request.min_id > 0; // if first call failed, fallback to get_map_data
+						break;
+					}
+					if(getMap2Srv.request.skip_graph)
+					{
+						getMap2Srv.response.data.graph = graph;
+					}
+					else
+					{
+						graph = getMap2Srv.response.data.graph;
+					}
+					processMapData(getMap2Srv.response.data);
+				}
+				while(getMap2Srv.response.next_id > 0);
+				if(paged)
+				{
+					ROS_INFO("Called \"%s\" service, initializing cache... done! The map"
+							" will be assembled on next subscriber connection.", srvName2.c_str());
+				}
 			}
-			else
+			if(!paged)
 			{
-				ROS_INFO("Called \"%s\" service, initializing cache...", rtabmapNs.c_str());
-				processMapData(getMapSrv.response.data);
-				ROS_INFO("Called \"%s\" service, initializing cache... done! The map"
-						" will be assembled on next subscriber connection.", rtabmapNs.c_str());
+				if(!ros::service::call(rtabmapNs, getMapSrv))
+				{
+					ROS_WARN("Cannot call \"%s\" service", rtabmapNs.c_str());
+				}
+				else
+				{
+					ROS_INFO("Called \"%s\" service, initializing cache...", rtabmapNs.c_str());
+					processMapData(getMapSrv.response.data);
+					ROS_INFO("Called \"%s\" service, initializing cache... done! The map"
+							" will be assembled on next subscriber connection.", rtabmapNs.c_str());
+				}
 			}
 		}
 		else
@@ -261,14 +397,10 @@ public:
 			   msg.nodes[i].depth.size() ||
 			   msg.nodes[i].laserScan.size())
 			{
-				Signature data = rtabmap_conversions::nodeDataFromROS(msg.nodes[i]);
-				if(localGridsRegenerated_)
-				{
-					data.sensorData().setOccupancyGrid(cv::Mat(), cv::Mat(), cv::Mat(), 0, cv::Point3f());
-				}
-				uInsert(nodes_, std::make_pair(msg.nodes[i].id, data));
+				addNode(msg.nodes[i]);
 			}
 		}
+		reloadNodes(poses, gridIds_);
 
 		// create a tmp signature with latest sensory data
 		if(poses.size() && nodes_.find(poses.rbegin()->first) != nodes_.end())
@@ -289,6 +421,7 @@ public:
 					false,
 					false,
 					nodes_);
+			trimNodes(poses, gridIds_);
 		}
 		double updateTime = timer.ticks();
 
@@ -304,6 +437,8 @@ public:
 	{
 		ROS_INFO("map_assembler: reset!");
 		mapsManager_.clear();
+		gridIds_.clear();
+		octomapIds_.clear();
 		return true;
 	}
 
@@ -317,11 +452,11 @@ public:
 		res.map.header.frame_id = mapFrameId_;
 		res.map.header.stamp = ros::Time::now();
 
+		reloadNodes(optimizedPoses_, octomapIds_);
 		mapsManager_.updateMapCaches(optimizedPoses_, 0, false, true, nodes_);
+		trimNodes(optimizedPoses_, octomapIds_);
 
-		const rtabmap::OctoMap * octomap = mapsManager_.getOctomap();
-		bool success = octomap->octree()->size() && octomap_msgs::binaryMapToMsg(*octomap->octree(), res.map);
-		return success;
+		return mapsManager_.getOctomapBinaryMsg(res.map);
 	}
 
 	bool octomapFullCallback(
@@ -332,15 +467,126 @@ public:
 		res.map.header.frame_id = mapFrameId_;
 		res.map.header.stamp = ros::Time::now();
 
+		reloadNodes(optimizedPoses_, octomapIds_);
 		mapsManager_.updateMapCaches(optimizedPoses_, 0, false, true, nodes_);
+		trimNodes(optimizedPoses_, octomapIds_);
 
-		const rtabmap::OctoMap * octomap = mapsManager_.getOctomap();
-		bool success = octomap->octree()->size() && octomap_msgs::fullMapToMsg(*octomap->octree(), res.map);
-		return success;
+		return mapsManager_.getOctomapFullMsg(res.map);
 	}
 #endif
 #endif
 
+private:
+	void addNode(const rtabmap_msgs::NodeData & msg)
+	{
+		Signature data = rtabmap_conversions::nodeDataFromROS(msg);
+		if(localGridsRegenerated_)
+		{
+			data.sensorData().setOccupancyGrid(cv::Mat(), cv::Mat(), cv::Mat(), 0, cv::Point3f());
+		}
+		bool inMemory = nodes_.find(msg.id) != nodes_.end();
+		uInsert(nodes_, std::make_pair(msg.id, data));
+		if(cacheMaxBytes_ > 0)
+		{
+			// keep a copy on disk to be able to drop it from memory
+			nodeDataFile_.write(msg);
+			size_t bytes = ros::serialization::serializationLength(msg);
+			std::map<int, size_t>::iterator iter = nodeBytes_.find(msg.id);
+			if(iter != nodeBytes_.end() && inMemory)
+			{
+				cacheBytes_ -= iter->second;
+			}
+			nodeBytes_[msg.id] = bytes;
+			cacheBytes_ += bytes;
+			touchNode(msg.id);
+		}
+	}
+
+	void touchNode(int id)
+	{
+		std::map<int, std::list<int>::iterator>::iterator iter = lruIndex_.find(id);
+		if(iter != lruIndex_.end())
+		{
+			lru_.erase(iter->second);
+		}
+		lru_.push_back(id);
+		lruIndex_[id] = --lru_.end();
+	}
+
+	// Reload from disk the nodes not yet in the maps of "processedIds"
+	void reloadNodes(const std::map<int, Transform> & poses, const std::set<int> & processedIds)
+	{
+		if(cacheMaxBytes_ == 0)
+		{
+			return;
+		}
+		int reloaded = 0;
+		for(std::map<int, Transform>::const_iterator iter=poses.begin(); iter!=poses.end(); ++iter)
+		{
+			bool last = iter->first == poses.rbegin()->first;
+			if(iter->first > 0 &&
+			   (last || processedIds.find(iter->first) == processedIds.end()) &&
+			   nodes_.find(iter->first) == nodes_.end() &&
+			   nodeDataFile_.contains(iter->first))
+			{
+				rtabmap_msgs::NodeData msg;
+				if(nodeDataFile_.read(iter->first, msg))
+				{
+					Signature data = rtabmap_conversions::nodeDataFromROS(msg);
+					if(localGridsRegenerated_)
+					{
+						data.sensorData().setOccupancyGrid(cv::Mat(), cv::Mat(), cv::Mat(), 0, cv::Point3f());
+					}
+					nodes_.insert(std::make_pair(iter->first, data));
+					cacheBytes_ += nodeBytes_.at(iter->first);
+					touchNode(iter->first);
+					++reloaded;
+				}
+			}
+		}
+		if(reloaded)
+		{
+			ROS_INFO("map_assembler: Reloaded %d nodes from disk cache", reloaded);
+		}
+	}
+
+	// Mark the nodes as processed, then drop the least recently used ones
+	// from memory until the cache is under its budget. Unprocessed nodes
+	// and the latest one are kept.
+	void trimNodes(const std::map<int, Transform> & poses, std::set<int> & processedIds)
+	{
+		if(cacheMaxBytes_ == 0)
+		{
+			return;
+		}
+		for(std::map<int, Transform>::const_iterator iter=poses.begin(); iter!=poses.end(); ++iter)
+		{
+			if(nodes_.find(iter->first) != nodes_.end())
+			{
+				processedIds.insert(iter->first);
+			}
+		}
+		int latestId = poses.empty()?0:poses.rbegin()->first;
+		std::list<int>::iterator iter=lru_.begin();
+		while(cacheBytes_ > cacheMaxBytes_ && iter!=lru_.end())
+		{
+			int id = *iter;
+			if(id != latestId &&
+			   gridIds_.find(id) != gridIds_.end() &&
+			   (octomapIds_.empty() || octomapIds_.find(id) != octomapIds_.end()))
+			{
+				nodes_.erase(id);
+				cacheBytes_ -= nodeBytes_.at(id);
+				lruIndex_.erase(id);
+				iter = lru_.erase(iter);
+			}
+			else
+			{
+				++iter;
+			}
+		}
+	}
+
 private:
 	rtabmap_util::MapsManager mapsManager_;
 	std::map<int, Signature> nodes_;
@@ -357,6 +603,16 @@ private:
 #endif
 #endif
 	bool localGridsRegenerated_;
+
+	// bounded memory
+	size_t cacheMaxBytes_;
+	size_t cacheBytes_;
+	NodeDataFile nodeDataFile_;
+	std::map<int, size_t> nodeBytes_;
+	std::list<int> lru_;
+	std::map<int, std::list<int>::iterator> lruIndex_;
+	std::set<int> gridIds_;    // nodes already added to the grid/cloud maps
+	std::set<int> octomapIds_; // nodes already added to the octomap
 };
 
 
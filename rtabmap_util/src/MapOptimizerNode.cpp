@@ -29,6 +29,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap_msgs/MapData.h"
 #include "rtabmap_msgs/MapGraph.h"
 #include "rtabmap_conversions/MsgConversion.h"
+#include "rtabmap_conversions/ThreadPool.h"
 #include <rtabmap/core/util3d.h>
 #include <rtabmap/core/Graph.h>
 #include <rtabmap/core/Optimizer.h>
@@ -52,6 +53,8 @@ public:
 		odomFrameId_("odom"),
 		globalOptimization_(true),
 		optimizeFromLastNode_(false),
+		incremental_(false),
+		graphChanged_(true),
 		mapToOdom_(rtabmap::Transform::getIdentity()),
 		transformThread_(0)
 	{
@@ -75,7 +78,8 @@ public:
 		pnh.param("robust", robust, robust);
 		pnh.param("slam_2d", slam2d, slam2d);
 		pnh.param("strategy", strategy, strategy);
-
+		pnh.param("incremental", incremental_, incremental_);
+		ROS_INFO("map_optimizer: incremental = %s", incremental_?"true":"false");
 
 		UASSERT(iterations > 0);
 
@@ -86,12 +90,18 @@ public:
 		parameters.insert(ParametersPair(Parameters::kOptimizerRobust(), uBool2Str(robust)));
 		parameters.insert(ParametersPair(Parameters::kRegForce3DoF(), uBool2Str(slam2d)));
 		parameters.insert(ParametersPair(Parameters::kOptimizerVarianceIgnored(), uBool2Str(ignoreVariance)));
+		if(incremental_ && strategy == Optimizer::kTypeGTSAM)
+		{
+			// iSAM2
+			parameters.insert(ParametersPair(Parameters::kGTSAMIncremental(), "true"));
+		}
 		optimizer_ = Optimizer::create(parameters);
 
 		double tfDelay = 0.05; // 20 Hz
 		bool publishTf = true;
 		pnh.param("publish_tf", publishTf, publishTf);
 		pnh.param("tf_delay", tfDelay, tfDelay);
+		threadSettings_ = rtabmap_conversions::ThreadSettings::fromParams(pnh, "thread_");
 
 		mapDataTopic_ = nh.subscribe("mapData", 1, &MapOptimizer::mapDataReceivedCallback, this);
 		mapDataPub_ = nh.advertise<rtabmap_msgs::MapData>(nh.resolveName("mapData")+"_optimized", 1);
@@ -103,6 +113,7 @@ public:
 			ROS_INFO("map_optimizer: map_frame_id = %s", mapFrameId_.c_str());
 			ROS_INFO("map_optimizer: odom_frame_id = %s", odomFrameId_.c_str());
 			ROS_INFO("map_optimizer: tf_delay = %f", tfDelay);
+			ROS_INFO("map_optimizer: thread settings = %s", threadSettings_.toString().c_str());
 			transformThread_ = new boost::thread(boost::bind(&MapOptimizer::publishLoop, this, tfDelay));
 		}
 	}
@@ -118,6 +129,7 @@ public:
 
 	void publishLoop(double tfDelay)
 	{
+		threadSettings_.apply();
 		if(tfDelay == 0)
 			return;
 		ros::Rate r(1.0 / tfDelay);
@@ -169,6 +181,7 @@ public:
 			if(!edgeAlreadyAdded)
 			{
 				cachedConstraints_.insert(std::make_pair(link.from(), link));
+				graphChanged_ = true;
 			}
 		}
 
@@ -182,7 +195,11 @@ public:
 			newNodeInfos.insert(std::make_pair(id, s));
 
 			std::pair<std::map<int, Signature>::iterator, bool> p = cachedNodeInfos_.insert(std::make_pair(id, s));
-			if(!p.second && pose.getDistanceSquared(cachedNodeInfos_.at(id).getPose()) > 0.0001)
+			if(p.second)
+			{
+				graphChanged_ = true;
+			}
+			else if(pose.getDistanceSquared(p.first->second.getPose()) > 0.0001)
 			{
 				dataChanged = true;
 			}
@@ -193,6 +210,17 @@ public:
 			ROS_WARN("Graph data has changed! Reset cache...");
 			cachedConstraints_ = newConstraints;
 			cachedNodeInfos_ = newNodeInfos;
+			cachedOptimizedPoses_.clear();
+			graphChanged_ = true;
+		}
+
+		if(globalOptimization_ && !graphChanged_ && !lastOutputGraph_.posesId.empty() &&
+			mapGraphPub_.getNumSubscribers() && mapDataPub_.getNumSubscribers() == 0)
+		{
+			// Same graph than last time, republish last result
+			lastOutputGraph_.header = msg->header;
+			mapGraphPub_.publish(lastOutputGraph_);
+			return;
 		}
 
 		//match poses in the graph
@@ -227,6 +255,23 @@ public:
 			poses.insert(std::make_pair(iter->first, iter->second.getPose()));
 		}
 
+		// Poses already optimized are used as initial guess, new ones
+		// are initialized with the last map correction. Only the new part
+		// of the graph should then move, converging in fewer iterations.
+		std::map<int, Transform> initialPoses = poses;
+		if(incremental_ && globalOptimization_ && !cachedOptimizedPoses_.empty())
+		{
+			Transform correction;
+			mapToOdomMutex_.lock();
+			correction = mapToOdom_;
+			mapToOdomMutex_.unlock();
+			for(std::map<int, Transform>::iterator iter=initialPoses.begin(); iter!=initialPoses.end(); ++iter)
+			{
+				std::map<int, Transform>::iterator jter = cachedOptimizedPoses_.find(iter->first);
+				iter->second = jter!=cachedOptimizedPoses_.end()?jter->second:correction*iter->second;
+			}
+		}
+
 		// Optimize only if there is a subscriber
 		if(mapDataPub_.getNumSubscribers() || mapGraphPub_.getNumSubscribers())
 		{
@@ -240,13 +285,22 @@ public:
 				int fromId = optimizeFromLastNode_?poses.rbegin()->first:poses.begin()->first;
 				optimizer_->getConnectedGraph(
 						fromId,
-						poses,
+						initialPoses,
 						constraints,
 						posesOut,
 						linksOut);
 				optimizedPoses = optimizer_->optimize(fromId, posesOut, linksOut);
+				if(optimizedPoses.empty())
+				{
+					ROS_ERROR("map_optimizer: graph optimization failed!");
+					cachedOptimizedPoses_.clear();
+					return;
+				}
+				cachedOptimizedPoses_ = optimizedPoses;
+				graphChanged_ = false;
 				mapToOdomMutex_.lock();
-				mapCorrection = optimizedPoses.at(posesOut.rbegin()->first) * posesOut.rbegin()->second.inverse();
+				// correction relative to odometry pose (not the initial guess)
+				mapCorrection = optimizedPoses.at(posesOut.rbegin()->first) * poses.at(posesOut.rbegin()->first).inverse();
 				mapToOdom_ = mapCorrection;
 				mapToOdomMutex_.unlock();
 			}
@@ -268,9 +322,13 @@ public:
 					mapCorrection,
 					outputGraphMsg);
 
+			outputGraphMsg.header = msg->header;
+			if(globalOptimization_)
+			{
+				lastOutputGraph_ = outputGraphMsg;
+			}
 			if(mapGraphPub_.getNumSubscribers())
 			{
-				outputGraphMsg.header = msg->header;
 				mapGraphPub_.publish(outputGraphMsg);
 			}
 
@@ -318,6 +376,7 @@ private:
 	std::string odomFrameId_;
 	bool globalOptimization_;
 	bool optimizeFromLastNode_;
+	bool incremental_;
 	Optimizer * optimizer_;
 
 	rtabmap::Transform mapToOdom_;
@@ -330,9 +389,13 @@ private:
 
 	std::multimap<int, Link> cachedConstraints_;
 	std::map<int, Signature> cachedNodeInfos_;
+	std::map<int, Transform> cachedOptimizedPoses_;
+	bool graphChanged_;
+	rtabmap_msgs::MapGraph lastOutputGraph_;
 
 	tf2_ros::TransformBroadcaster tfBroadcaster_;
 	boost::thread* transformThread_;
+	rtabmap_conversions::ThreadSettings threadSettings_;
 };
 
 
@@ -0,0 +1,365 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <ros/ros.h>
+#include <nav_msgs/OccupancyGrid.h>
+#include "rtabmap_msgs/MapGraph.h"
+#include "rtabmap_conversions/MsgConversion.h"
+#include "rtabmap_util/MapsManager.h"
+#include <rtabmap/core/Signature.h>
+#include <rtabmap/core/Link.h>
+#include <rtabmap/core/DBDriver.h>
+#include <rtabmap/utilite/UStl.h>
+#include <rtabmap/utilite/UTimer.h>
+#include <rtabmap/utilite/UConversion.h>
+#include <opencv2/core/core.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+// Peak resident memory (VmHWM) or current one (VmRSS) of this process in MB
+static double processMemoryMB(const std::string & key)
+{
+	std::ifstream file("/proc/self/status");
+	std::string line;
+	while(std::getline(file, line))
+	{
+		if(line.compare(0, key.size(), key) == 0)
+		{
+			long kb = 0;
+			sscanf(line.c_str()+key.size(), "%ld", &kb);
+			return double(kb)/1024.0;
+		}
+	}
+	return 0.0;
+}
+
+// Reset VmHWM (Linux >= 4.0), so the peak is measured per graph size
+static bool resetPeakMemory()
+{
+	std::ofstream file("/proc/self/clear_refs");
+	file << "5";
+	return file.good();
+}
+
+/**
+ * Build synthetic graphs of increasing sizes and time the map assembly
+ * and the graph conversion at each size. The graph is a serpentine
+ * path covering a square area, with loop closures between adjacent rows
+ * and a random 2D local grid per node. For each size, the report gives
+ * the time of:
+ *  - MapsManager::updateMapCaches() with all nodes (like after loading a
+ *    map), then with one more node (like a normal update),
+ *  - MapsManager::publishMaps() assembling the occupancy grid,
+ *  - rtabmap_conversions::mapGraphToROS(),
+ * and the peak memory. With "database_prefix" set, a database is written
+ * for each size (<prefix>_<size>.db) with the same graph and the optimized
+ * poses, to benchmark the rtabmap services with rtabmap_slam/services_benchmark.
+ * Example:
+ *   map_stress_benchmark _sizes:="10000 100000 1000000" _grid_ground_cells:=50
+ */
+class MapStressBenchmark
+{
+public:
+	MapStressBenchmark() :
+		outputPath_("map_stress_benchmark.json"),
+		nodeSpacing_(0.5),
+		rowSpacing_(2.0),
+		loopClosureEvery_(10),
+		gridRange_(3.0),
+		gridGroundCells_(100),
+		gridObstacleCells_(20),
+		seed_(0),
+		gridCells_(0)
+	{
+		ros::NodeHandle nh;
+		ros::NodeHandle pnh("~");
+		std::string sizes = "10000 100000";
+		pnh.param("sizes", sizes, sizes); // space-separated node counts
+		pnh.param("output", outputPath_, outputPath_);
+		pnh.param("database_prefix", databasePrefix_, databasePrefix_);
+		pnh.param("node_spacing", nodeSpacing_, nodeSpacing_);
+		pnh.param("row_spacing", rowSpacing_, rowSpacing_);
+		pnh.param("loop_closure_every", loopClosureEvery_, loopClosureEvery_);
+		pnh.param("grid_range", gridRange_, gridRange_);
+		pnh.param("grid_ground_cells", gridGroundCells_, gridGroundCells_);
+		pnh.param("grid_obstacle_cells", gridObstacleCells_, gridObstacleCells_);
+		pnh.param("seed", seed_, seed_);
+		std::list<std::string> sizesList = uSplit(sizes, ' ');
+		for(std::list<std::string>::iterator iter=sizesList.begin(); iter!=sizesList.end(); ++iter)
+		{
+			if(uStr2Int(*iter) > 1)
+			{
+				sizes_.push_back(uStr2Int(*iter));
+			}
+		}
+		std::sort(sizes_.begin(), sizes_.end());
+
+		ROS_INFO("map_stress_benchmark: sizes              = %s", sizes.c_str());
+		ROS_INFO("map_stress_benchmark: output             = %s", outputPath_.c_str());
+		ROS_INFO("map_stress_benchmark: database_prefix    = %s", databasePrefix_.c_str());
+		ROS_INFO("map_stress_benchmark: node_spacing       = %f m", nodeSpacing_);
+		ROS_INFO("map_stress_benchmark: row_spacing        = %f m", rowSpacing_);
+		ROS_INFO("map_stress_benchmark: loop_closure_every = %d", loopClosureEvery_);
+		ROS_INFO("map_stress_benchmark: grid_range         = %f m", gridRange_);
+		ROS_INFO("map_stress_benchmark: grid cells         = %d ground, %d obstacles", gridGroundCells_, gridObstacleCells_);
+
+		parameters_ = rtabmap::Parameters::getDefaultParameters("Grid");
+		uInsert(parameters_, rtabmap::Parameters::getDefaultParameters("GridGlobal"));
+		for(rtabmap::ParametersMap::iterator iter=parameters_.begin(); iter!=parameters_.end(); ++iter)
+		{
+			std::string vStr;
+			if(pnh.getParam(iter->first, vStr))
+			{
+				ROS_INFO("map_stress_benchmark: %s = %s", iter->first.c_str(), vStr.c_str());
+				iter->second = vStr;
+			}
+		}
+		// the synthetic grids are 2D
+		uInsert(parameters_, rtabmap::ParametersPair(rtabmap::Parameters::kGrid3D(), "false"));
+		mapsManager_.init(nh, pnh, "map_stress_benchmark", false);
+		mapsManager_.setParameters(parameters_);
+		// the grid is assembled only if something is subscribed
+		gridMapSub_ = pnh.subscribe("grid_map", 1, &MapStressBenchmark::gridMapCallback, this);
+	}
+
+	void run()
+	{
+		FILE * file = fopen(outputPath_.c_str(), "w");
+		if(!file)
+		{
+			ROS_ERROR("map_stress_benchmark: cannot write \"%s\"", outputPath_.c_str());
+			return;
+		}
+		fprintf(file, "{\n  \"sizes\": [");
+		for(size_t i=0; i<sizes_.size() && ros::ok(); ++i)
+		{
+			fprintf(file, "%s\n    %s", i==0?"":",", runSize(sizes_[i]).c_str());
+			fflush(file);
+		}
+		fprintf(file, "\n  ]\n}\n");
+		fclose(file);
+		ROS_INFO("map_stress_benchmark: report written to \"%s\"", outputPath_.c_str());
+	}
+
+private:
+	void gridMapCallback(const nav_msgs::OccupancyGridConstPtr & msg)
+	{
+		gridCells_ = msg->info.width * msg->info.height;
+	}
+
+	rtabmap::Transform poseAt(int index, int nodesPerRow) const
+	{
+		int row = index / nodesPerRow;
+		int col = index % nodesPerRow;
+		bool forward = row % 2 == 0;
+		return rtabmap::Transform(
+				float((forward?col:nodesPerRow-1-col)*nodeSpacing_),
+				float(row*rowSpacing_),
+				0,
+				0, 0, forward?0:float(M_PI));
+	}
+
+	rtabmap::SensorData localGrid(int id, cv::RNG & rng) const
+	{
+		float cellSize = 0.05f;
+		rtabmap::Parameters::parse(parameters_, rtabmap::Parameters::kGridCellSize(), cellSize);
+		cv::Mat ground(1, gridGroundCells_, CV_32FC2);
+		for(int i=0; i<gridGroundCells_; ++i)
+		{
+			double r = gridRange_*std::sqrt(rng.uniform(0.0, 1.0));
+			double a = rng.uniform(-M_PI, M_PI);
+			ground.at<cv::Vec2f>(i) = cv::Vec2f(float(r*std::cos(a)), float(r*std::sin(a)));
+		}
+		cv::Mat obstacles(1, gridObstacleCells_, CV_32FC2);
+		for(int i=0; i<gridObstacleCells_; ++i)
+		{
+			double a = rng.uniform(-M_PI, M_PI);
+			obstacles.at<cv::Vec2f>(i) = cv::Vec2f(float(gridRange_*std::cos(a)), float(gridRange_*std::sin(a)));
+		}
+		rtabmap::SensorData data;
+		data.setId(id);
+		data.setOccupancyGrid(ground, obstacles, cv::Mat(), cellSize, cv::Point3f(0,0,0));
+		return data;
+	}
+
+	std::string runSize(int size)
+	{
+		ROS_INFO("map_stress_benchmark: generating %d nodes...", size);
+		mapsManager_.clear();
+		bool peakReset = resetPeakMemory();
+		double memoryStart = processMemoryMB("VmRSS:");
+		UTimer timer;
+
+		// graph (ids start at 1)
+		cv::RNG rng(seed_);
+		int nodesPerRow = std::max(1, (int)std::sqrt(double(size)));
+		std::map<int, rtabmap::Transform> poses;
+		std::multimap<int, rtabmap::Link> links;
+		std::map<int, rtabmap::Signature> signatures;
+		for(int i=0; i<size; ++i)
+		{
+			int id = i+1;
+			poses.insert(poses.end(), std::make_pair(id, poseAt(i, nodesPerRow)));
+			if(i > 0)
+			{
+				links.insert(std::make_pair(id-1, rtabmap::Link(id-1, id, rtabmap::Link::kNeighbor, poses.at(id-1).inverse()*poses.at(id))));
+			}
+			int row = i / nodesPerRow;
+			int col = i % nodesPerRow;
+			if(row > 0 && loopClosureEvery_ > 0 && col % loopClosureEvery_ == 0)
+			{
+				// node at the same position on the previous row
+				int to = (row-1)*nodesPerRow + (nodesPerRow-1-col) + 1;
+				links.insert(std::make_pair(id, rtabmap::Link(id, to, rtabmap::Link::kGlobalClosure, poses.at(id).inverse()*poses.at(to))));
+			}
+			// the last node is kept for the incremental update
+			if(i < size-1)
+			{
+				signatures.insert(signatures.end(), std::make_pair(id, rtabmap::Signature(id, 0, 0, double(i)*0.1, "", poses.at(id), rtabmap::Transform(), localGrid(id, rng))));
+			}
+		}
+		double generationTime = timer.ticks();
+		double memoryGraph = processMemoryMB("VmRSS:") - memoryStart;
+
+		std::map<int, rtabmap::Transform> posesWithoutLast(poses.begin(), --poses.end());
+		mapsManager_.updateMapCaches(posesWithoutLast, 0, true, false, signatures);
+		double fullUpdateTime = timer.ticks();
+		mapsManager_.publishMaps(posesWithoutLast, ros::Time::now(), "map");
+		ros::spinOnce();
+		double fullPublishTime = timer.ticks();
+
+		// one more node, like after each map update
+		std::map<int, rtabmap::Signature> last;
+		last.insert(std::make_pair(size, rtabmap::Signature(size, 0, 0, double(size)*0.1, "", poses.at(size), rtabmap::Transform(), localGrid(size, rng))));
+		timer.restart();
+		mapsManager_.updateMapCaches(poses, 0, true, false, last);
+		double incrementalUpdateTime = timer.ticks();
+		mapsManager_.publishMaps(poses, ros::Time::now(), "map");
+		ros::spinOnce();
+		double incrementalPublishTime = timer.ticks();
+
+		rtabmap_msgs::MapGraph graphMsg;
+		rtabmap_conversions::mapGraphToROS(poses, links, rtabmap::Transform::getIdentity(), graphMsg);
+		double graphToROSTime = timer.ticks();
+		double peakMemory = processMemoryMB("VmHWM:");
+
+		double databaseTime = 0.0;
+		if(!databasePrefix_.empty())
+		{
+			std::string path = uFormat("%s_%d.db", databasePrefix_.c_str(), size);
+			signatures.insert(last.begin(), last.end());
+			writeDatabase(path, poses, links, signatures);
+			databaseTime = timer.ticks();
+		}
+
+		ROS_INFO("map_stress_benchmark: %d nodes: updateMapCaches=%fs (+1 node: %fs), publishMaps=%fs (+1 node: %fs), "
+				"mapGraphToROS=%fs, peak memory=%f MB, grid=%d cells",
+				size, fullUpdateTime, incrementalUpdateTime, fullPublishTime, incrementalPublishTime,
+				graphToROSTime, peakMemory, gridCells_);
+
+		std::string json = uFormat("{\"nodes\": %d, \"links\": %d, \"generation_s\": %f, "
+				"\"update_map_caches_s\": %f, \"update_map_caches_incremental_s\": %f, "
+				"\"publish_maps_s\": %f, \"publish_maps_incremental_s\": %f, "
+				"\"map_graph_to_ros_s\": %f, \"grid_cells\": %d, "
+				"\"graph_memory_mb\": %f, \"peak_memory_mb\": %f, \"peak_memory_per_size\": %s",
+				size, (int)links.size(), generationTime,
+				fullUpdateTime, incrementalUpdateTime,
+				fullPublishTime, incrementalPublishTime,
+				graphToROSTime, gridCells_,
+				memoryGraph, peakMemory, peakReset?"true":"false");
+		if(!databasePrefix_.empty())
+		{
+			json += uFormat(", \"database_s\": %f", databaseTime);
+		}
+		return json + "}";
+	}
+
+	void writeDatabase(
+			const std::string & path,
+			const std::map<int, rtabmap::Transform> & poses,
+			const std::multimap<int, rtabmap::Link> & links,
+			const std::map<int, rtabmap::Signature> & signatures) const
+	{
+		ROS_INFO("map_stress_benchmark: writing \"%s\"...", path.c_str());
+		rtabmap::DBDriver * driver = rtabmap::DBDriver::create();
+		if(!driver->openConnection(path, true))
+		{
+			ROS_ERROR("map_stress_benchmark: cannot create database \"%s\"", path.c_str());
+			delete driver;
+			return;
+		}
+		// links are saved with the nodes, in both directions
+		std::multimap<int, rtabmap::Link> allLinks = links;
+		for(std::multimap<int, rtabmap::Link>::const_iterator iter=links.begin(); iter!=links.end(); ++iter)
+		{
+			allLinks.insert(std::make_pair(iter->second.to(), iter->second.inverse()));
+		}
+		for(std::map<int, rtabmap::Signature>::const_iterator iter=signatures.begin(); iter!=signatures.end(); ++iter)
+		{
+			rtabmap::Signature * s = new rtabmap::Signature(iter->second);
+			for(std::multimap<int, rtabmap::Link>::iterator jter=allLinks.find(iter->first); jter!=allLinks.end() && jter->first==iter->first; ++jter)
+			{
+				s->addLink(jter->second);
+			}
+			driver->asyncSave(s); // ownership transferred
+			if(iter->first % 1000 == 0)
+			{
+				driver->emptyTrashes();
+			}
+		}
+		driver->emptyTrashes();
+		driver->saveOptimizedPoses(poses, poses.rbegin()->second);
+		driver->closeConnection(true);
+		delete driver;
+	}
+
+private:
+	std::vector<int> sizes_;
+	std::string outputPath_;
+	std::string databasePrefix_;
+	double nodeSpacing_;
+	double rowSpacing_;
+	int loopClosureEvery_;
+	double gridRange_;
+	int gridGroundCells_;
+	int gridObstacleCells_;
+	int seed_;
+	int gridCells_;
+	rtabmap::ParametersMap parameters_;
+	rtabmap_util::MapsManager mapsManager_;
+	ros::Subscriber gridMapSub_;
+};
+
+int main(int argc, char** argv)
+{
+	ros::init(argc, argv, "map_stress_benchmark");
+	MapStressBenchmark benchmark;
+	benchmark.run();
+	return 0;
+}
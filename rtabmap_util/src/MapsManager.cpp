@@ -41,7 +41,16 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <pcl/search/kdtree.h>
 
+#include <boost/thread.hpp>
+
+#include <fstream>
+#include <algorithm>
+#include <iterator>
+#include <cfloat>
+#include <climits>
+
 #include <nav_msgs/OccupancyGrid.h>
+#include <map_msgs/OccupancyGridUpdate.h>
 #include <ros/ros.h>
 
 #include <pcl_conversions/pcl_conversions.h>
@@ -58,8 +67,15 @@ using namespace rtabmap;
 
 namespace rtabmap_util {
 
+static float logodds(double probability)
+{
+	return (float)log(probability/(1.0-probability));
+}
+
 MapsManager::MapsManager() :
 		cloudOutputVoxelized_(true),
+		cloudVoxelHash_(false),
+		cloudUpdateError_(0.0),
 		cloudSubtractFiltering_(false),
 		cloudSubtractFilteringMinNeighbors_(2),
 		mapFilterRadius_(0.0),
@@ -67,10 +83,30 @@ MapsManager::MapsManager() :
 		mapCacheCleanup_(true),
 		alwaysUpdateMap_(false),
 		scanEmptyRayTracing_(true),
+		mapIncrementalUpdate_(false),
+		mapThreads_(1),
+		gridMapUpdates_(false),
+		gridMapUpdatesTileSize_(64),
 		assembledObstacles_(new pcl::PointCloud<pcl::PointXYZRGB>),
 		assembledGround_(new pcl::PointCloud<pcl::PointXYZRGB>),
+		gridMapLastXMin_(0.0f),
+		gridMapLastYMin_(0.0f),
+		gridMapLastCellSize_(0.0f),
+		gridMapSubscribers_(0),
+		gridPyramidXMin_(0.0f),
+		gridPyramidYMin_(0.0f),
+		gridPyramidRevision_(0),
+		gridProbMapIncremental_(false),
+		gridProbMapUpdateError_(0.01),
+		gridProbHit_(logodds(Parameters::defaultGridGlobalProbHit())),
+		gridProbMiss_(logodds(Parameters::defaultGridGlobalProbMiss())),
+		gridProbClampingMin_(logodds(Parameters::defaultGridGlobalProbClampingMin())),
+		gridProbClampingMax_(logodds(Parameters::defaultGridGlobalProbClampingMax())),
+		gridProbCellXMin_(0),
+		gridProbCellYMin_(0),
 		occupancyGrid_(new OccupancyGrid),
 		gridUpdated_(true),
+		gridRevision_(1),
 #ifdef WITH_OCTOMAP_MSGS
 #ifdef RTABMAP_OCTOMAP
 		octomap_(new OctoMap),
@@ -78,6 +114,16 @@ MapsManager::MapsManager() :
 #endif
 		octomapTreeDepth_(16),
 		octomapUpdated_(true),
+#ifdef WITH_OCTOMAP_MSGS
+		octomapBinaryMsgUpToDate_(false),
+		octomapFullMsgUpToDate_(false),
+#endif
+		octomapIncrementalSpace_(false),
+		octomapSpaceValid_(false),
+		incrementalGraphRevision_(0),
+		incrementalGridCache_(false),
+		incrementalGrid_(false),
+		incrementalOctomap_(false),
 		latching_(true)
 {
 }
@@ -112,6 +158,10 @@ void MapsManager::init(ros::NodeHandle & nh, ros::NodeHandle & pnh, const std::s
 		}
 	}
 	pnh.param("map_empty_ray_tracing", scanEmptyRayTracing_, scanEmptyRayTracing_);
+	pnh.param("map_incremental_update", mapIncrementalUpdate_, mapIncrementalUpdate_);
+	pnh.param("map_threads", mapThreads_, mapThreads_);
+	// same pool as the owner nodelet ("thread_pool" parameter)
+	threadPool_ = rtabmap_conversions::ThreadPool::fromParams(pnh);
 
 	if(pnh.hasParam("scan_output_voxelized"))
 	{
@@ -123,17 +173,55 @@ void MapsManager::init(ros::NodeHandle & nh, ros::NodeHandle & pnh, const std::s
 		}
 	}
 	pnh.param("cloud_output_voxelized", cloudOutputVoxelized_, cloudOutputVoxelized_);
+	pnh.param("cloud_voxel_hash", cloudVoxelHash_, cloudVoxelHash_);
+	pnh.param("cloud_update_error", cloudUpdateError_, cloudUpdateError_);
 	pnh.param("cloud_subtract_filtering", cloudSubtractFiltering_, cloudSubtractFiltering_);
 	pnh.param("cloud_subtract_filtering_min_neighbors", cloudSubtractFilteringMinNeighbors_, cloudSubtractFilteringMinNeighbors_);
+	pnh.param("grid_map_updates", gridMapUpdates_, gridMapUpdates_);
+	pnh.param("grid_map_updates_tile_size", gridMapUpdatesTileSize_, gridMapUpdatesTileSize_);
+	if(gridMapUpdatesTileSize_ <= 0)
+	{
+		ROS_WARN("grid_map_updates_tile_size should be > 0, set to 64 instead");
+		gridMapUpdatesTileSize_ = 64;
+	}
+	pnh.param("grid_prob_map_incremental", gridProbMapIncremental_, gridProbMapIncremental_);
+	pnh.param("grid_prob_map_update_error", gridProbMapUpdateError_, gridProbMapUpdateError_);
+	std::string gridPyramidCellSizes;
+	pnh.param("grid_pyramid_cell_sizes", gridPyramidCellSizes, gridPyramidCellSizes);
+	gridPyramidCellSizes_.clear();
+	std::list<std::string> cellSizes = uSplit(gridPyramidCellSizes, ' ');
+	for(std::list<std::string>::iterator iter=cellSizes.begin(); iter!=cellSizes.end(); ++iter)
+	{
+		if(!iter->empty())
+		{
+			float cellSize = uStr2Float(*iter);
+			if(cellSize <= 0.0f || (!gridPyramidCellSizes_.empty() && cellSize <= gridPyramidCellSizes_.back()))
+			{
+				ROS_ERROR("grid_pyramid_cell_sizes should be positive and in increasing order (\"%s\"), pyramid is disabled.", gridPyramidCellSizes.c_str());
+				gridPyramidCellSizes_.clear();
+				break;
+			}
+			gridPyramidCellSizes_.push_back(cellSize);
+		}
+	}
 
 	ROS_INFO("%s(maps): map_filter_radius          = %f", name.c_str(), mapFilterRadius_);
 	ROS_INFO("%s(maps): map_filter_angle           = %f", name.c_str(), mapFilterAngle_);
 	ROS_INFO("%s(maps): map_cleanup                = %s", name.c_str(), mapCacheCleanup_?"true":"false");
 	ROS_INFO("%s(maps): map_always_update          = %s", name.c_str(), alwaysUpdateMap_?"true":"false");
 	ROS_INFO("%s(maps): map_empty_ray_tracing      = %s", name.c_str(), scanEmptyRayTracing_?"true":"false");
+	ROS_INFO("%s(maps): map_incremental_update     = %s", name.c_str(), mapIncrementalUpdate_?"true":"false");
+	ROS_INFO("%s(maps): map_threads                = %d", name.c_str(), mapThreads_);
 	ROS_INFO("%s(maps): cloud_output_voxelized     = %s", name.c_str(), cloudOutputVoxelized_?"true":"false");
+	ROS_INFO("%s(maps): cloud_voxel_hash           = %s", name.c_str(), cloudVoxelHash_?"true":"false");
+	ROS_INFO("%s(maps): cloud_update_error         = %f", name.c_str(), cloudUpdateError_);
 	ROS_INFO("%s(maps): cloud_subtract_filtering   = %s", name.c_str(), cloudSubtractFiltering_?"true":"false");
 	ROS_INFO("%s(maps): cloud_subtract_filtering_min_neighbors = %d", name.c_str(), cloudSubtractFilteringMinNeighbors_);
+	ROS_INFO("%s(maps): grid_map_updates           = %s", name.c_str(), gridMapUpdates_?"true":"false");
+	ROS_INFO("%s(maps): grid_map_updates_tile_size = %d", name.c_str(), gridMapUpdatesTileSize_);
+	ROS_INFO("%s(maps): grid_pyramid_cell_sizes    = \"%s\"", name.c_str(), gridPyramidCellSizes.c_str());
+	ROS_INFO("%s(maps): grid_prob_map_incremental  = %s", name.c_str(), gridProbMapIncremental_?"true":"false");
+	ROS_INFO("%s(maps): grid_prob_map_update_error = %f", name.c_str(), gridProbMapUpdateError_);
 
 #ifdef WITH_OCTOMAP_MSGS
 #ifdef RTABMAP_OCTOMAP
@@ -149,6 +237,16 @@ void MapsManager::init(ros::NodeHandle & nh, ros::NodeHandle & pnh, const std::s
 		octomapTreeDepth_ = 16;
 	}
 	ROS_INFO("%s(maps): octomap_tree_depth         = %d", name.c_str(), octomapTreeDepth_);
+	// Update octomap_empty_space and octomap_global_frontier_space only around
+	// the new clouds instead of traversing the whole octree, and publish
+	// the added/removed cells on the *_added/*_removed topics.
+	pnh.param("octomap_incremental_space", octomapIncrementalSpace_, octomapIncrementalSpace_);
+	ROS_INFO("%s(maps): octomap_incremental_space  = %s", name.c_str(), octomapIncrementalSpace_?"true":"false");
+	if(octomapIncrementalSpace_ && octomapTreeDepth_ != 0 && octomapTreeDepth_ < 16)
+	{
+		ROS_WARN("octomap_incremental_space is only used at full octomap_tree_depth (16), "
+				"empty and frontier clouds will be created from the whole octree.");
+	}
 #endif
 #endif
 
@@ -170,8 +268,18 @@ void MapsManager::init(ros::NodeHandle & nh, ros::NodeHandle & pnh, const std::s
 	latched_.clear();
 	gridMapPub_ = nht->advertise<nav_msgs::OccupancyGrid>("grid_map", 1, latching_);
 	latched_.insert(std::make_pair((void*)&gridMapPub_, false));
+	if(gridMapUpdates_)
+	{
+		gridMapUpdatesPub_ = nht->advertise<map_msgs::OccupancyGridUpdate>("grid_map_updates", 10);
+	}
 	gridProbMapPub_ = nht->advertise<nav_msgs::OccupancyGrid>("grid_prob_map", 1, latching_);
 	latched_.insert(std::make_pair((void*)&gridProbMapPub_, false));
+	gridPyramidPubs_.resize(gridPyramidCellSizes_.size());
+	for(size_t i=0; i<gridPyramidPubs_.size(); ++i)
+	{
+		gridPyramidPubs_[i] = nht->advertise<nav_msgs::OccupancyGrid>(uFormat("grid_map_level%d", (int)i+1), 1, latching_);
+		latched_.insert(std::make_pair((void*)&gridPyramidPubs_[i], false));
+	}
 	cloudMapPub_ = nht->advertise<sensor_msgs::PointCloud2>("cloud_map", 1, latching_);
 	latched_.insert(std::make_pair((void*)&cloudMapPub_, false));
 	cloudObstaclesPub_ = nht->advertise<sensor_msgs::PointCloud2>("cloud_obstacles", 1, latching_);
@@ -203,6 +311,13 @@ void MapsManager::init(ros::NodeHandle & nh, ros::NodeHandle & pnh, const std::s
 	latched_.insert(std::make_pair((void*)&octoMapEmptySpace_, false));
 	octoMapProj_ = nht->advertise<nav_msgs::OccupancyGrid>("octomap_grid", 1, latching_);
 	latched_.insert(std::make_pair((void*)&octoMapProj_, false));
+	if(octomapIncrementalSpace_)
+	{
+		octoMapFrontierCloudAdded_ = nht->advertise<sensor_msgs::PointCloud2>("octomap_global_frontier_space_added", 10);
+		octoMapFrontierCloudRemoved_ = nht->advertise<sensor_msgs::PointCloud2>("octomap_global_frontier_space_removed", 10);
+		octoMapEmptySpaceAdded_ = nht->advertise<sensor_msgs::PointCloud2>("octomap_empty_space_added", 10);
+		octoMapEmptySpaceRemoved_ = nht->advertise<sensor_msgs::PointCloud2>("octomap_empty_space_removed", 10);
+	}
 #endif
 #endif
 }
@@ -323,6 +438,21 @@ void MapsManager::setParameters(const rtabmap::ParametersMap & parameters)
 {
 	parameters_ = parameters;
 	occupancyGrid_->parseParameters(parameters_);
+	++gridRevision_;
+	resetGridProbMap();
+	double probHit = Parameters::defaultGridGlobalProbHit();
+	double probMiss = Parameters::defaultGridGlobalProbMiss();
+	double probClampingMin = Parameters::defaultGridGlobalProbClampingMin();
+	double probClampingMax = Parameters::defaultGridGlobalProbClampingMax();
+	Parameters::parse(parameters_, Parameters::kGridGlobalProbHit(), probHit);
+	Parameters::parse(parameters_, Parameters::kGridGlobalProbMiss(), probMiss);
+	Parameters::parse(parameters_, Parameters::kGridGlobalProbClampingMin(), probClampingMin);
+	Parameters::parse(parameters_, Parameters::kGridGlobalProbClampingMax(), probClampingMax);
+	gridProbHit_ = logodds(probHit);
+	gridProbMiss_ = logodds(probMiss);
+	gridProbClampingMin_ = logodds(probClampingMin);
+	gridProbClampingMax_ = logodds(probClampingMax);
+	resetIncrementalPoses();
 
 #ifdef WITH_OCTOMAP_MSGS
 #ifdef RTABMAP_OCTOMAP
@@ -333,9 +463,50 @@ void MapsManager::setParameters(const rtabmap::ParametersMap & parameters)
 	}
 	octomap_ = new OctoMap(parameters_);
 #endif
+	octomapBinaryMsgUpToDate_ = false;
+	octomapFullMsgUpToDate_ = false;
+	resetOctomapSpace(true);
 #endif
 }
 
+// Keep only the first point of each voxel, points falling in voxels
+// already in the assembled cloud are not added.
+static void appendVoxelized(
+		const pcl::PointCloud<pcl::PointXYZRGB> & cloud,
+		float voxelSize,
+		boost::unordered_set<long long> & voxels,
+		pcl::PointCloud<pcl::PointXYZRGB> & assembled)
+{
+	assembled.reserve(assembled.size() + cloud.size());
+	for(size_t i=0; i<cloud.size(); ++i)
+	{
+		const pcl::PointXYZRGB & pt = cloud.points[i];
+		long long x = (long long)std::floor(pt.x/voxelSize) & 0x1FFFFF;
+		long long y = (long long)std::floor(pt.y/voxelSize) & 0x1FFFFF;
+		long long z = (long long)std::floor(pt.z/voxelSize) & 0x1FFFFF;
+		if(voxels.insert((x << 42) | (y << 21) | z).second)
+		{
+			assembled.push_back(pt);
+		}
+	}
+}
+
+void MapsManager::appendToAssembledCloud(
+		const pcl::PointCloud<pcl::PointXYZRGB> & cloud,
+		pcl::PointCloud<pcl::PointXYZRGB> & assembled,
+		boost::unordered_set<long long> & voxels) const
+{
+	if(cloudOutputVoxelized_ && cloudVoxelHash_)
+	{
+		UASSERT(occupancyGrid_->getCellSize() > 0.0);
+		appendVoxelized(cloud, occupancyGrid_->getCellSize(), voxels, assembled);
+	}
+	else
+	{
+		assembled += cloud;
+	}
+}
+
 void MapsManager::set2DMap(
 		const cv::Mat & map,
 		float xMin,
@@ -345,6 +516,8 @@ void MapsManager::set2DMap(
 		const rtabmap::Memory * memory)
 {
 	occupancyGrid_->setMap(map, xMin, yMin, cellSize, poses);
+	++gridRevision_;
+	resetIncrementalPoses();
 	//update cache in case the map should be updated
 	if(memory)
 	{
@@ -384,6 +557,271 @@ void MapsManager::set2DMap(
 	}
 }
 
+static const uint32_t kCacheSnapshotMagic = 0x434D5452; // "RTMC"
+static const uint32_t kCacheSnapshotVersion = 1;
+
+// Local grids depend only on the "Grid/" parameters, keep them in
+// the snapshot to detect when the cache should be regenerated.
+static std::string gridParametersString(const ParametersMap & parameters)
+{
+	std::string str;
+	for(ParametersMap::const_iterator iter=parameters.begin(); iter!=parameters.end(); ++iter)
+	{
+		if(iter->first.find("Grid/") == 0)
+		{
+			str += iter->first + "=" + iter->second + ";";
+		}
+	}
+	return str;
+}
+
+static void writeMat(std::ofstream & file, const cv::Mat & mat)
+{
+	cv::Mat m = mat.isContinuous()?mat:mat.clone();
+	int32_t header[3] = {m.rows, m.cols, m.type()};
+	file.write((const char *)header, sizeof(header));
+	if(!m.empty())
+	{
+		file.write((const char *)m.data, m.total()*m.elemSize());
+	}
+}
+
+// Local grid cells are 2D (xy), 2D with color/3D (xyz) or 3D with color (xyzrgb)
+static bool isLocalGridType(int type)
+{
+	return type == CV_32FC2 || type == CV_32FC3 || type == CV_32FC4;
+}
+
+// The header is not trusted: rows and cols should fit in the
+// remaining bytes of the file (fileSize) before allocating the matrix.
+static bool readMat(std::ifstream & file, std::streamoff fileSize, cv::Mat & mat)
+{
+	int32_t header[3] = {0};
+	if(!file.read((char *)header, sizeof(header)) || header[0] < 0 || header[1] < 0)
+	{
+		return false;
+	}
+	if(header[0] == 0 || header[1] == 0)
+	{
+		mat = cv::Mat();
+		return true;
+	}
+	if(!isLocalGridType(header[2]))
+	{
+		return false;
+	}
+	std::streamoff position = file.tellg();
+	if(position < 0 || position > fileSize)
+	{
+		return false;
+	}
+	uint64_t remaining = fileSize - position;
+	uint64_t elemSize = CV_ELEM_SIZE(header[2]);
+	if((uint64_t)header[1] > remaining / elemSize / (uint64_t)header[0])
+	{
+		return false;
+	}
+	mat = cv::Mat(header[0], header[1], header[2]);
+	return (bool)file.read((char *)mat.data, mat.total()*mat.elemSize());
+}
+
+bool MapsManager::saveCache(const std::string & path) const
+{
+	UTimer timer;
+	std::ofstream file(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if(!file.is_open())
+	{
+		ROS_ERROR("Cannot open \"%s\" to save the maps cache.", path.c_str());
+		return false;
+	}
+	std::string params = gridParametersString(parameters_);
+	uint32_t header[4] = {kCacheSnapshotMagic, kCacheSnapshotVersion, (uint32_t)params.size(), (uint32_t)gridMaps_.size()};
+	file.write((const char *)header, sizeof(header));
+	file.write(params.data(), params.size());
+	for(std::map<int, std::pair< std::pair<cv::Mat, cv::Mat>, cv::Mat> >::const_iterator iter=gridMaps_.begin(); iter!=gridMaps_.end(); ++iter)
+	{
+		int32_t id = iter->first;
+		cv::Point3f viewPoint(0,0,0);
+		std::map<int, cv::Point3f>::const_iterator jter = gridMapsViewpoints_.find(iter->first);
+		if(jter != gridMapsViewpoints_.end())
+		{
+			viewPoint = jter->second;
+		}
+		file.write((const char *)&id, sizeof(id));
+		file.write((const char *)&viewPoint, sizeof(viewPoint));
+		writeMat(file, iter->second.first.first);
+		writeMat(file, iter->second.first.second);
+		writeMat(file, iter->second.second);
+	}
+	if(!file.good())
+	{
+		ROS_ERROR("Failed to write maps cache \"%s\".", path.c_str());
+		return false;
+	}
+	ROS_INFO("Saved maps cache of %d nodes to \"%s\" (%fs).", (int)gridMaps_.size(), path.c_str(), timer.ticks());
+	return true;
+}
+
+bool MapsManager::loadCache(const std::string & path, const std::map<int, rtabmap::Transform> & poses)
+{
+	UTimer timer;
+	std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+	if(!file.is_open())
+	{
+		return false;
+	}
+	file.seekg(0, std::ios::end);
+	std::streamoff fileSize = file.tellg();
+	file.seekg(0, std::ios::beg);
+	uint32_t header[4] = {0};
+	if(!file.read((char *)header, sizeof(header)) ||
+	   header[0] != kCacheSnapshotMagic ||
+	   header[1] != kCacheSnapshotVersion)
+	{
+		ROS_WARN("Maps cache \"%s\" has an unsupported format, it is ignored.", path.c_str());
+		return false;
+	}
+	if(fileSize < 0 || (uint64_t)header[2] > (uint64_t)fileSize)
+	{
+		ROS_WARN("Maps cache \"%s\" is truncated, it is ignored.", path.c_str());
+		return false;
+	}
+	std::string params(header[2], '\0');
+	if(!file.read(&params[0], params.size()) || params.compare(gridParametersString(parameters_)) != 0)
+	{
+		ROS_INFO("Grid parameters changed since maps cache \"%s\" was saved, it is ignored.", path.c_str());
+		return false;
+	}
+
+	std::map<int, std::pair< std::pair<cv::Mat, cv::Mat>, cv::Mat> > gridMaps;
+	std::map<int, cv::Point3f> gridMapsViewpoints;
+	for(uint32_t i=0; i<header[3]; ++i)
+	{
+		int32_t id = 0;
+		cv::Point3f viewPoint;
+		cv::Mat ground, obstacles, emptyCells;
+		if(!file.read((char *)&id, sizeof(id)) ||
+		   !file.read((char *)&viewPoint, sizeof(viewPoint)) ||
+		   !readMat(file, fileSize, ground) ||
+		   !readMat(file, fileSize, obstacles) ||
+		   !readMat(file, fileSize, emptyCells))
+		{
+			ROS_WARN("Maps cache \"%s\" is truncated or corrupted, it is ignored.", path.c_str());
+			return false;
+		}
+		// only keep nodes still in the graph
+		if(id > 0 && poses.find(id) != poses.end())
+		{
+			gridMaps.insert(std::make_pair(id, std::make_pair(std::make_pair(ground, obstacles), emptyCells)));
+			gridMapsViewpoints.insert(std::make_pair(id, viewPoint));
+		}
+	}
+	gridMaps_.swap(gridMaps);
+	gridMapsViewpoints_.swap(gridMapsViewpoints);
+	ROS_INFO("Loaded maps cache of %d nodes from \"%s\" (%fs).", (int)gridMaps_.size(), path.c_str(), timer.ticks());
+	return true;
+}
+
+std::map<std::string, unsigned long> MapsManager::getMemoryUsage() const
+{
+	std::map<std::string, unsigned long> usage;
+
+	unsigned long bytes = 0;
+	for(std::map<int, std::pair< std::pair<cv::Mat, cv::Mat>, cv::Mat> >::const_iterator iter=gridMaps_.begin(); iter!=gridMaps_.end(); ++iter)
+	{
+		bytes += sizeof(int) + sizeof(cv::Point3f) +
+				iter->second.first.first.total()*iter->second.first.first.elemSize() +
+				iter->second.first.second.total()*iter->second.first.second.elemSize() +
+				iter->second.second.total()*iter->second.second.elemSize();
+	}
+	usage.insert(std::make_pair("LocalGrids", bytes));
+
+	bytes = 0;
+	for(std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr >::const_iterator iter=groundClouds_.begin();iter!=groundClouds_.end();++iter)
+	{
+		bytes += sizeof(int) + iter->second->points.size()*sizeof(pcl::PointXYZRGB);
+	}
+	for(std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr >::const_iterator iter=obstacleClouds_.begin();iter!=obstacleClouds_.end();++iter)
+	{
+		bytes += sizeof(int) + iter->second->points.size()*sizeof(pcl::PointXYZRGB);
+	}
+	usage.insert(std::make_pair("LocalClouds", bytes));
+
+	bytes = (assembledGround_->size() + assembledObstacles_->size()) *sizeof(pcl::PointXYZRGB);
+	bytes += (assembledGroundPoses_.size() + assembledObstaclePoses_.size()) * 13*sizeof(float);
+	bytes += assembledGroundIndex_.indexedFeatures()*assembledGroundIndex_.featuresDim() * sizeof(float);
+	bytes += assembledObstacleIndex_.indexedFeatures()*assembledObstacleIndex_.featuresDim() * sizeof(float);
+	bytes += (assembledGroundVoxels_.size() + assembledObstacleVoxels_.size()) * 2*sizeof(long long); // with bucket overhead
+	usage.insert(std::make_pair("AssembledClouds", bytes));
+
+	bytes = gridMap_.total()*gridMap_.elemSize() + gridMapLastPublished_.total()*gridMapLastPublished_.elemSize();
+	for(size_t i=0; i<gridPyramid_.size(); ++i)
+	{
+		bytes += gridPyramid_[i].total()*gridPyramid_[i].elemSize();
+	}
+	bytes += gridProbLogOdds_.total()*(gridProbLogOdds_.elemSize() + gridProbUpdates_.elemSize() + gridProbPixels_.elemSize());
+	bytes += gridProbNodes_.size() * 13*sizeof(float);
+	usage.insert(std::make_pair("GridMap", bytes));
+
+	bytes = 0;
+#ifdef WITH_OCTOMAP_MSGS
+#ifdef RTABMAP_OCTOMAP
+	if(octomap_)
+	{
+		bytes += octomap_->octree()->memoryUsage();
+	}
+#endif
+	bytes += octomapBinaryMsg_.data.size() + octomapFullMsg_.data.size();
+	for(std::map<unsigned long long, std::pair<std::vector<unsigned long long>, std::vector<unsigned long long> > >::const_iterator iter=octomapSpaceBlocks_.begin(); iter!=octomapSpaceBlocks_.end(); ++iter)
+	{
+		bytes += (1 + iter->second.first.size() + iter->second.second.size()) * sizeof(unsigned long long);
+	}
+#endif
+	usage.insert(std::make_pair("OctoMap", bytes));
+
+	return usage;
+}
+
+unsigned long MapsManager::trimCaches(unsigned long maxBytes)
+{
+	std::map<std::string, unsigned long> usage = getMemoryUsage();
+	unsigned long total = 0;
+	for(std::map<std::string, unsigned long>::iterator iter=usage.begin(); iter!=usage.end(); ++iter)
+	{
+		total += iter->second;
+	}
+	unsigned long released = 0;
+	if(total > maxBytes && (usage.at("LocalClouds") || usage.at("AssembledClouds")))
+	{
+		// Same as map_cache_cleanup, clouds are re-assembled from the local grids if needed
+		released += usage.at("LocalClouds") + usage.at("AssembledClouds");
+		assembledGround_->clear();
+		assembledObstacles_->clear();
+		assembledGroundPoses_.clear();
+		assembledObstaclePoses_.clear();
+		assembledGroundIndex_.release();
+		assembledObstacleIndex_.release();
+		assembledGroundVoxels_.clear();
+		assembledObstacleVoxels_.clear();
+		groundClouds_.clear();
+		obstacleClouds_.clear();
+	}
+	if(total - released > maxBytes && !gridPyramid_.empty())
+	{
+		for(size_t i=0; i<gridPyramid_.size(); ++i)
+		{
+			released += gridPyramid_[i].total()*gridPyramid_[i].elemSize();
+		}
+		gridPyramid_.clear();
+	}
+	if(released)
+	{
+		ROS_WARN("MapsManager: memory budget exceeded (%ld MB > %ld MB), released %ld MB of caches.",
+				total/1048576, maxBytes/1048576, released/1048576);
+	}
+	return released;
+}
+
 void MapsManager::clear()
 {
 	gridMaps_.clear();
@@ -394,14 +832,25 @@ void MapsManager::clear()
 	assembledObstaclePoses_.clear();
 	assembledGroundIndex_.release();
 	assembledObstacleIndex_.release();
+	assembledGroundVoxels_.clear();
+	assembledObstacleVoxels_.clear();
 	groundClouds_.clear();
 	obstacleClouds_.clear();
 	occupancyGrid_->clear();
+	++gridRevision_;
+	gridPyramid_.clear();
+	gridMapLastPublished_ = cv::Mat();
+	gridMapSubscribers_ = 0;
+	resetGridProbMap();
 #ifdef WITH_OCTOMAP_MSGS
 #ifdef RTABMAP_OCTOMAP
 	octomap_->clear();
 #endif
+	octomapBinaryMsgUpToDate_ = false;
+	octomapFullMsgUpToDate_ = false;
+	resetOctomapSpace(true);
 #endif
+	resetIncrementalPoses();
 	for(std::map<void*, bool>::iterator iter=latched_.begin(); iter!=latched_.end(); ++iter)
 	{
 		iter->second = false;
@@ -416,6 +865,7 @@ bool MapsManager::hasSubscribers() const
 			projMapPub_.getNumSubscribers() != 0 ||
 			gridMapPub_.getNumSubscribers() != 0 ||
 			gridProbMapPub_.getNumSubscribers() != 0 ||
+			gridPyramidHasSubscribers() ||
 			scanMapPub_.getNumSubscribers() != 0 ||
 			octoMapPubBin_.getNumSubscribers() != 0 ||
 			octoMapPubFull_.getNumSubscribers() != 0 ||
@@ -424,6 +874,10 @@ bool MapsManager::hasSubscribers() const
 			octoMapObstacleCloud_.getNumSubscribers() != 0 ||
 			octoMapGroundCloud_.getNumSubscribers() != 0 ||
 			octoMapEmptySpace_.getNumSubscribers() != 0 ||
+			octoMapFrontierCloudAdded_.getNumSubscribers() != 0 ||
+			octoMapFrontierCloudRemoved_.getNumSubscribers() != 0 ||
+			octoMapEmptySpaceAdded_.getNumSubscribers() != 0 ||
+			octoMapEmptySpaceRemoved_.getNumSubscribers() != 0 ||
 			octoMapProj_.getNumSubscribers() != 0;
 }
 
@@ -436,7 +890,20 @@ bool MapsManager::isMapUpdated() const
 	return gridUpdated_ ||
 			(projMapPub_.getNumSubscribers() == 0 &&
 			gridMapPub_.getNumSubscribers() == 0 &&
-			gridProbMapPub_.getNumSubscribers() == 0);
+			gridProbMapPub_.getNumSubscribers() == 0 &&
+			!gridPyramidHasSubscribers());
+}
+
+bool MapsManager::gridPyramidHasSubscribers() const
+{
+	for(size_t i=0; i<gridPyramidPubs_.size(); ++i)
+	{
+		if(gridPyramidPubs_[i].getNumSubscribers() != 0)
+		{
+			return true;
+		}
+	}
+	return false;
 }
 
 std::map<int, Transform> MapsManager::getFilteredPoses(const std::map<int, Transform> & poses)
@@ -450,13 +917,170 @@ std::map<int, Transform> MapsManager::getFilteredPoses(const std::map<int, Trans
 	return std::map<int, Transform>();
 }
 
-std::map<int, rtabmap::Transform> MapsManager::updateMapCaches(
+bool MapsManager::getIncrementalPoses(
+		const std::map<int, rtabmap::Transform> & poses,
+		std::map<int, rtabmap::Transform> & addedPoses,
+		unsigned long graphRevision)
+{
+	// Returns true only if the graph has grown since last
+	// update: no nodes removed and no poses moved more than
+	// the grid update error (e.g., after a loop closure).
+	// Ids of new nodes are always greater than the known ones.
+	// If the graph revision is known and didn't change since
+	// last update, poses of the known nodes are not compared,
+	// so that only new nodes are visited. poses should not
+	// contain landmarks.
+	if(incrementalInputPoses_.empty())
+	{
+		return false;
+	}
+	std::map<int, Transform>::const_iterator addedIter = poses.upper_bound(incrementalInputPoses_.rbegin()->first);
+	size_t knownNodes = poses.size() - std::distance(addedIter, poses.end()) - poses.count(0);
+	if(knownNodes != incrementalInputPoses_.size())
+	{
+		// nodes removed or retrieved
+		return false;
+	}
+
+	if(graphRevision == 0 || graphRevision != incrementalGraphRevision_)
+	{
+		// Graph may have been optimized, compare all known nodes
+		float updateErrorSqr = occupancyGrid_->getUpdateError()*occupancyGrid_->getUpdateError();
+		std::map<int, Transform>::const_iterator iter = poses.lower_bound(1);
+		for(std::map<int, Transform>::const_iterator jter=incrementalInputPoses_.begin(); jter!=incrementalInputPoses_.end(); ++jter, ++iter)
+		{
+			if(iter == addedIter || iter->first != jter->first)
+			{
+				// node removed
+				return false;
+			}
+			if(iter->second.isNull() || iter->second.getDistanceSquared(jter->second) > updateErrorSqr)
+			{
+				// graph optimized
+				return false;
+			}
+		}
+		incrementalGraphRevision_ = graphRevision;
+	}
+	addedPoses.insert(addedIter, poses.end());
+	return true;
+}
+
+void MapsManager::resetIncrementalPoses()
+{
+	incrementalInputPoses_.clear();
+	incrementalFilteredIndex_.clear();
+	incrementalGraphRevision_ = 0;
+}
+
+namespace {
+
+// Lock a mutex (if not null) only while memory is accessed
+class MemoryLock
+{
+public:
+	MemoryLock(boost::mutex * mutex) : mutex_(mutex)
+	{
+		if(mutex_)
+		{
+			mutex_->lock();
+		}
+	}
+	~MemoryLock()
+	{
+		unlock();
+	}
+	void unlock()
+	{
+		if(mutex_)
+		{
+			mutex_->unlock();
+			mutex_ = 0;
+		}
+	}
+private:
+	boost::mutex * mutex_;
+};
+
+struct LocalGridJob
+{
+	int id;
+	Transform pose;
+	SensorData data;
+	cv::Mat ground;
+	cv::Mat obstacles;
+	cv::Mat emptyCells;
+	cv::Point3f viewPoint;
+};
+
+void createLocalGrids(
+		const ParametersMap & parameters,
+		std::vector<LocalGridJob> * jobs,
+		int threadIndex,
+		int threads)
+{
+	// Each thread has its own occupancy grid to create local maps
+	OccupancyGrid grid(parameters);
+	for(size_t i=threadIndex; i<jobs->size(); i+=threads)
+	{
+		LocalGridJob & job = jobs->at(i);
+		cv::Mat rgb, depth;
+		LaserScan scan;
+		bool generateGrid = job.data.gridCellSize() == 0.0f;
+		job.data.uncompressData(
+				grid.isGridFromDepth() && generateGrid?&rgb:0,
+				grid.isGridFromDepth() && generateGrid?&depth:0,
+				!grid.isGridFromDepth() && generateGrid?&scan:0,
+				0,
+				generateGrid?0:&job.ground,
+				generateGrid?0:&job.obstacles,
+				generateGrid?0:&job.emptyCells);
+		if(generateGrid)
+		{
+			Signature tmp(job.data);
+			tmp.setPose(job.pose);
+			grid.createLocalMap(tmp, job.ground, job.obstacles, job.emptyCells, job.viewPoint);
+		}
+		else
+		{
+			job.viewPoint = job.data.gridViewPoint();
+		}
+		job.data = SensorData(); // release raw data
+	}
+}
+
+} // namespace
+
+// On incremental updates, only new nodes are given to OccupancyGrid/OctoMap
+// update(), with the latest node already in the map: if none of the
+// given nodes were in the map, it would be cleared and regenerated
+// from the new nodes only.
+static std::map<int, Transform> incrementalMapPoses(
+		const std::map<int, Transform> & addedPoses,
+		const std::map<int, Transform> & mapNodes)
+{
+	std::map<int, Transform> poses = addedPoses;
+	for(std::map<int, Transform>::const_reverse_iterator iter=mapNodes.rbegin(); iter!=mapNodes.rend() && iter->first>0; ++iter)
+	{
+		if(addedPoses.find(iter->first) == addedPoses.end())
+		{
+			poses.insert(*iter);
+			break;
+		}
+	}
+	return poses;
+}
+
+const std::map<int, rtabmap::Transform> & MapsManager::updateMapCaches(
 		const std::map<int, rtabmap::Transform> & posesIn,
 		const rtabmap::Memory * memory,
 		bool updateGrid,
 		bool updateOctomap,
-		const std::map<int, rtabmap::Signature> & signatures)
+		const std::map<int, rtabmap::Signature> & signatures,
+		boost::mutex * memoryMutex,
+		unsigned long graphRevision)
 {
+	static const std::map<int, rtabmap::Transform> kNoPoses;
 	bool updateGridCache = updateGrid || updateOctomap;
 	if(!updateGrid && !updateOctomap)
 	{
@@ -469,11 +1093,16 @@ std::map<int, rtabmap::Transform> MapsManager::updateMapCaches(
 				octoMapObstacleCloud_.getNumSubscribers() != 0 ||
 				octoMapGroundCloud_.getNumSubscribers() != 0 ||
 				octoMapEmptySpace_.getNumSubscribers() != 0 ||
+				octoMapFrontierCloudAdded_.getNumSubscribers() != 0 ||
+				octoMapFrontierCloudRemoved_.getNumSubscribers() != 0 ||
+				octoMapEmptySpaceAdded_.getNumSubscribers() != 0 ||
+				octoMapEmptySpaceRemoved_.getNumSubscribers() != 0 ||
 				octoMapProj_.getNumSubscribers() != 0;
 
 		updateGrid = projMapPub_.getNumSubscribers() != 0 ||
 				gridMapPub_.getNumSubscribers() != 0 ||
-				gridProbMapPub_.getNumSubscribers() != 0;
+				gridProbMapPub_.getNumSubscribers() != 0 ||
+				gridPyramidHasSubscribers();
 
 		updateGridCache = updateOctomap || updateGrid ||
 				cloudMapPub_.getNumSubscribers() != 0 ||
@@ -498,7 +1127,7 @@ std::map<int, rtabmap::Transform> MapsManager::updateMapCaches(
 	if(!memory && signatures.size() == 0)
 	{
 		ROS_ERROR("Memory and signatures should not be both null!?");
-		return std::map<int, rtabmap::Transform>();
+		return kNoPoses;
 	}
 
 	// process only nodes (exclude landmarks)
@@ -511,76 +1140,226 @@ std::map<int, rtabmap::Transform> MapsManager::updateMapCaches(
 	{
 		poses = posesIn;
 	}
-	std::map<int, rtabmap::Transform> filteredPoses;
 
 	// update cache
 	if(updateGridCache)
 	{
+		// In incremental mode, if the graph only grew since last
+		// update, only new nodes (and latest data) are processed.
+		std::map<int, rtabmap::Transform> addedPoses;
+		bool incremental = mapIncrementalUpdate_ &&
+				incrementalGridCache_ == updateGridCache &&
+				incrementalGrid_ == updateGrid &&
+				incrementalOctomap_ == updateOctomap &&
+				getIncrementalPoses(poses, addedPoses, graphRevision);
+		std::map<int, rtabmap::Transform> incrementalPoses;
+
 		// filter nodes
-		if(mapFilterRadius_ > 0.0)
+		if(incremental)
+		{
+			UDEBUG("Incremental update (%d new nodes)...", (int)addedPoses.size());
+			// filteredPoses_ are the filtered poses of the previous update
+			filteredPoses_.erase(0);
+			double angle = mapFilterAngle_ == 0.0?CV_PI+0.1:mapFilterAngle_*CV_PI/180.0;
+			for(std::map<int, rtabmap::Transform>::iterator iter=addedPoses.begin(); iter!=addedPoses.end(); ++iter)
+			{
+				incrementalInputPoses_.insert(*iter);
+				bool keep = true;
+				if(mapFilterRadius_ > 0.0)
+				{
+					// Same criterion than graph::radiusPosesFiltering(), but
+					// keeping the oldest node to avoid regenerating the map.
+					std::map<int, float> nearest = incrementalFilteredIndex_.radiusSearch(iter->second.x(), iter->second.y(), iter->second.z(), mapFilterRadius_);
+					for(std::map<int, float>::iterator jter=nearest.begin(); jter!=nearest.end(); ++jter)
+					{
+						if(angle >= CV_PI || fabs(iter->second.getAngle(filteredPoses_.at(jter->first))) <= angle)
+						{
+							keep = false;
+							break;
+						}
+					}
+				}
+				if(keep)
+				{
+					filteredPoses_.insert(*iter);
+					incrementalFilteredIndex_.add(iter->first, iter->second.x(), iter->second.y(), iter->second.z());
+					incrementalPoses.insert(*iter);
+				}
+			}
+			if(poses.find(0) != poses.end())
+			{
+				// make sure to keep latest data
+				filteredPoses_.insert(*poses.find(0));
+				incrementalPoses.insert(*poses.find(0));
+			}
+		}
+		else if(mapFilterRadius_ > 0.0)
 		{
 			UDEBUG("Filter nodes...");
 			double angle = mapFilterAngle_ == 0.0?CV_PI+0.1:mapFilterAngle_*CV_PI/180.0;
-			filteredPoses = rtabmap::graph::radiusPosesFiltering(poses, mapFilterRadius_, angle);
+			filteredPoses_ = rtabmap::graph::radiusPosesFiltering(poses, mapFilterRadius_, angle);
 			if(poses.find(0) != poses.end())
 			{
 				// make sure to keep latest data
-				filteredPoses.insert(*poses.find(0));
+				filteredPoses_.insert(*poses.find(0));
 			}
 		}
 		else
 		{
-			filteredPoses = poses;
+			filteredPoses_ = poses;
 		}
 
 		if(!alwaysUpdateMap_)
 		{
-			filteredPoses.erase(0);
+			filteredPoses_.erase(0);
+			incrementalPoses.erase(0);
+		}
+
+		if(mapIncrementalUpdate_ && !incremental)
+		{
+			// Reference for next incremental update
+			incrementalInputPoses_.clear();
+			incrementalInputPoses_.insert(poses.lower_bound(1), poses.end());
+			incrementalGraphRevision_ = graphRevision;
+			incrementalFilteredIndex_ = PoseGridIndex(mapFilterRadius_ > 0.0?(float)mapFilterRadius_:1.0f);
+			if(mapFilterRadius_ > 0.0)
+			{
+				incrementalFilteredIndex_.update(filteredPoses_);
+			}
+			incrementalGridCache_ = updateGridCache;
+			incrementalGrid_ = updateGrid;
+			incrementalOctomap_ = updateOctomap;
 		}
 
 		bool longUpdate = false;
 		UTimer longUpdateTimer;
-		if(filteredPoses.size() > 20)
+		if(filteredPoses_.size() > 20)
 		{
 			if(updateGridCache && gridMaps_.size() < 5)
 			{
-				ROS_WARN("Many occupancy grids should be loaded (~%d), this may take a while to update the map(s)...", int(filteredPoses.size()-gridMaps_.size()));
+				ROS_WARN("Many occupancy grids should be loaded (~%d), this may take a while to update the map(s)...", int(filteredPoses_.size()-gridMaps_.size()));
 				longUpdate = true;
 			}
 #ifdef WITH_OCTOMAP_MSGS
 #ifdef RTABMAP_OCTOMAP
 			if(updateOctomap && octomap_->addedNodes().size() < 5)
 			{
-				ROS_WARN("Many clouds should be added to octomap (~%d), this may take a while to update the map(s)...", int(filteredPoses.size()-octomap_->addedNodes().size()));
+				ROS_WARN("Many clouds should be added to octomap (~%d), this may take a while to update the map(s)...", int(filteredPoses_.size()-octomap_->addedNodes().size()));
 				longUpdate = true;
 			}
 #endif
 #endif
 		}
 
-		bool occupancySavedInDB = memory && uStrNumCmp(memory->getDatabaseVersion(), "0.11.10")>=0?true:false;
+		bool occupancySavedInDB = false;
+		if(memory)
+		{
+			MemoryLock memoryLock(memoryMutex);
+			occupancySavedInDB = uStrNumCmp(memory->getDatabaseVersion(), "0.11.10")>=0?true:false;
+		}
+
+		const std::map<int, rtabmap::Transform> & posesToProcess = incremental?incrementalPoses:filteredPoses_;
 
-		for(std::map<int, rtabmap::Transform>::iterator iter=filteredPoses.begin(); iter!=filteredPoses.end(); ++iter)
+		if(mapThreads_ != 1 || threadPool_.get())
 		{
-			if(!iter->second.isNull())
+			// Load data of the nodes not already in the cache (memory
+			// access is sequential), then uncompress and create their
+			// local grids in parallel. Nodes are processed by batches
+			// so that only a few nodes have their data loaded at the
+			// same time. The latest data (id=0) is still processed below.
+			int threads = threadPool_.get()?threadPool_->size():mapThreads_>0?mapThreads_:(int)boost::thread::hardware_concurrency();
+			threads = std::max(1, threads);
+			size_t batchSize = threads*8;
+			int created = 0;
+			UTimer timer;
+			std::map<int, rtabmap::Transform>::const_iterator iter=posesToProcess.lower_bound(1);
+			while(iter!=posesToProcess.end())
 			{
-				rtabmap::SensorData data;
-				if(updateGridCache && (iter->first == 0 || !uContains(gridMaps_, iter->first)))
+				std::vector<LocalGridJob> jobs;
+				jobs.reserve(batchSize);
+				MemoryLock memoryLock(memoryMutex);
+				for(; iter!=posesToProcess.end() && jobs.size()<batchSize; ++iter)
 				{
-					ROS_DEBUG("Data required for %d", iter->first);
-					std::map<int, rtabmap::Signature>::const_iterator findIter = signatures.find(iter->first);
-					if(findIter != signatures.end())
+					if(!iter->second.isNull() && !uContains(gridMaps_, iter->first))
 					{
-						data = findIter->second.sensorData();
+						jobs.push_back(LocalGridJob());
+						LocalGridJob & job = jobs.back();
+						job.id = iter->first;
+						job.pose = iter->second;
+						std::map<int, rtabmap::Signature>::const_iterator findIter = signatures.find(iter->first);
+						if(findIter != signatures.end())
+						{
+							job.data = findIter->second.sensorData();
+						}
+						else if(memory)
+						{
+							job.data = memory->getNodeData(iter->first, occupancyGrid_->isGridFromDepth() && !occupancySavedInDB, !occupancyGrid_->isGridFromDepth() && !occupancySavedInDB, false, true);
+							if(occupancySavedInDB && job.data.gridCellSize() == 0.0f)
+							{
+								// old nodes without occupancy grid, reload with sensor data to regenerate it
+								job.data = memory->getNodeData(iter->first, occupancyGrid_->isGridFromDepth(), !occupancyGrid_->isGridFromDepth(), false, false);
+							}
+						}
 					}
-					else if(memory)
+				}
+				memoryLock.unlock();
+				if(jobs.empty())
+				{
+					continue;
+				}
+
+				if(threadPool_.get())
+				{
+					threadPool_->parallelFor((int)jobs.size(), boost::bind(&createLocalGrids, boost::cref(parameters_), &jobs, boost::placeholders::_1, boost::placeholders::_2));
+				}
+				else
+				{
+					int batchThreads = std::min(threads, (int)jobs.size());
+					boost::thread_group workers;
+					for(int i=1; i<batchThreads; ++i)
 					{
-						data = memory->getNodeData(iter->first, occupancyGrid_->isGridFromDepth() && !occupancySavedInDB, !occupancyGrid_->isGridFromDepth() && !occupancySavedInDB, false, true);
+						workers.create_thread(boost::bind(&createLocalGrids, boost::cref(parameters_), &jobs, i, batchThreads));
 					}
+					createLocalGrids(parameters_, &jobs, 0, batchThreads);
+					workers.join_all();
+				}
 
-					ROS_DEBUG("Adding grid map %d to cache...", iter->first);
-					cv::Point3f viewPoint;
-					cv::Mat ground, obstacles, emptyCells;
+				// merge in id order
+				for(size_t i=0; i<jobs.size(); ++i)
+				{
+					uInsert(gridMaps_, std::make_pair(jobs[i].id, std::make_pair(std::make_pair(jobs[i].ground, jobs[i].obstacles), jobs[i].emptyCells)));
+					uInsert(gridMapsViewpoints_, std::make_pair(jobs[i].id, jobs[i].viewPoint));
+				}
+				created += (int)jobs.size();
+			}
+			if(created)
+			{
+				ROS_DEBUG("Created %d local grids with %d threads (%fs)", created, threads, timer.ticks());
+			}
+		}
+
+		for(std::map<int, rtabmap::Transform>::const_iterator iter=posesToProcess.begin(); iter!=posesToProcess.end(); ++iter)
+		{
+			if(!iter->second.isNull())
+			{
+				rtabmap::SensorData data;
+				if(updateGridCache && (iter->first == 0 || !uContains(gridMaps_, iter->first)))
+				{
+					ROS_DEBUG("Data required for %d", iter->first);
+					std::map<int, rtabmap::Signature>::const_iterator findIter = signatures.find(iter->first);
+					if(findIter != signatures.end())
+					{
+						data = findIter->second.sensorData();
+					}
+					else if(memory)
+					{
+						MemoryLock memoryLock(memoryMutex);
+						data = memory->getNodeData(iter->first, occupancyGrid_->isGridFromDepth() && !occupancySavedInDB, !occupancyGrid_->isGridFromDepth() && !occupancySavedInDB, false, true);
+					}
+
+					ROS_DEBUG("Adding grid map %d to cache...", iter->first);
+					cv::Point3f viewPoint;
+					cv::Mat ground, obstacles, emptyCells;
 					if(iter->first > 0)
 					{
 						cv::Mat rgb, depth;
@@ -604,6 +1383,7 @@ std::map<int, rtabmap::Transform> MapsManager::updateMapCaches(
 						{
 							// if we are here, it is because we loaded a database with old nodes not having occupancy grid set
 							// try reload again
+							MemoryLock memoryLock(memoryMutex);
 							data = memory->getNodeData(iter->first, occupancyGrid_->isGridFromDepth(), !occupancyGrid_->isGridFromDepth(), false, false);
 						}
 						data.uncompressData(
@@ -731,7 +1511,15 @@ std::map<int, rtabmap::Transform> MapsManager::updateMapCaches(
 
 		if(updateGrid)
 		{
-			gridUpdated_ = occupancyGrid_->update(filteredPoses);
+			gridUpdated_ = occupancyGrid_->update(incremental?incrementalMapPoses(incrementalPoses, occupancyGrid_->addedNodes()):filteredPoses_);
+			if(gridUpdated_)
+			{
+				++gridRevision_;
+			}
+			if(gridProbMapIncremental_)
+			{
+				updateGridProbMap(incremental?incrementalPoses:filteredPoses_, incremental);
+			}
 		}
 
 #ifdef WITH_OCTOMAP_MSGS
@@ -739,79 +1527,226 @@ std::map<int, rtabmap::Transform> MapsManager::updateMapCaches(
 		if(updateOctomap)
 		{
 			UTimer time;
-			octomapUpdated_ = octomap_->update(filteredPoses);
+			std::map<int, Transform> previousAddedNodes;
+			if(octomapIncrementalSpace_ && octomapSpaceValid_)
+			{
+				previousAddedNodes = octomap_->addedNodes();
+			}
+			// Ray casting and insertion of the cached local grids are done
+			// inside OctoMap::update() (rtabmap core library), node by node
+			// in a single thread. The octree is not thread-safe and its
+			// insertion API is not exposed per ray, so this cannot be
+			// parallelized from here.
+			octomapUpdated_ = octomap_->update(incremental?incrementalMapPoses(incrementalPoses, octomap_->addedNodes()):filteredPoses_);
+			if(octomapUpdated_)
+			{
+				octomapBinaryMsgUpToDate_ = false;
+				octomapFullMsgUpToDate_ = false;
+				if(octomapIncrementalSpace_)
+				{
+					markOctomapSpaceChanged(previousAddedNodes);
+				}
+			}
 			ROS_INFO("Octomap update time = %fs", time.ticks());
 		}
 #endif
 #endif
-		for(std::map<int, std::pair<std::pair<cv::Mat, cv::Mat>, cv::Mat> >::iterator iter=gridMaps_.begin();
-			iter!=gridMaps_.end();)
+		if(incremental)
 		{
-			if(!uContains(poses, iter->first))
+			// no nodes removed, only latest data could be outdated
+			if(poses.find(0) == poses.end() && gridMaps_.erase(0) != 0)
 			{
-				UASSERT(gridMapsViewpoints_.erase(iter->first) != 0);
-				gridMaps_.erase(iter++);
+				UASSERT(gridMapsViewpoints_.erase(0) != 0);
 			}
-			else
+		}
+		else
+		{
+			for(std::map<int, std::pair<std::pair<cv::Mat, cv::Mat>, cv::Mat> >::iterator iter=gridMaps_.begin();
+				iter!=gridMaps_.end();)
 			{
-				++iter;
+				if(!uContains(poses, iter->first))
+				{
+					UASSERT(gridMapsViewpoints_.erase(iter->first) != 0);
+					gridMaps_.erase(iter++);
+				}
+				else
+				{
+					++iter;
+				}
 			}
-		}
 
-		for(std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr >::iterator iter=groundClouds_.begin();
-			iter!=groundClouds_.end();)
-		{
-			if(!uContains(poses, iter->first))
+			for(std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr >::iterator iter=groundClouds_.begin();
+				iter!=groundClouds_.end();)
 			{
-				groundClouds_.erase(iter++);
+				if(!uContains(poses, iter->first))
+				{
+					groundClouds_.erase(iter++);
+				}
+				else
+				{
+					++iter;
+				}
 			}
-			else
+
+			for(std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr >::iterator iter=obstacleClouds_.begin();
+				iter!=obstacleClouds_.end();)
 			{
-				++iter;
+				if(!uContains(poses, iter->first))
+				{
+					obstacleClouds_.erase(iter++);
+				}
+				else
+				{
+					++iter;
+				}
 			}
 		}
 
-		for(std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr >::iterator iter=obstacleClouds_.begin();
-			iter!=obstacleClouds_.end();)
+		if(longUpdate)
 		{
-			if(!uContains(poses, iter->first))
-			{
-				obstacleClouds_.erase(iter++);
-			}
-			else
+			ROS_WARN("Map(s) updated! (%f s)", longUpdateTimer.ticks());
+		}
+		return filteredPoses_;
+	}
+
+	return kNoPoses;
+}
+
+bool MapsManager::publishGridMapUpdate(
+		const cv::Mat & pixels,
+		float xMin,
+		float yMin,
+		float gridCellSize,
+		const ros::Time & stamp,
+		const std::string & mapFrameId)
+{
+	// Returns false if the full map should be published instead
+	if(gridMapLastPublished_.empty() ||
+		gridMapLastPublished_.cols != pixels.cols ||
+		gridMapLastPublished_.rows != pixels.rows ||
+		gridMapLastPublished_.type() != pixels.type() ||
+		gridMapLastXMin_ != xMin ||
+		gridMapLastYMin_ != yMin ||
+		gridMapLastCellSize_ != gridCellSize)
+	{
+		return false;
+	}
+
+	// Find the region covering all tiles that changed
+	int minX = pixels.cols;
+	int minY = pixels.rows;
+	int maxX = -1;
+	int maxY = -1;
+	int dirtyTiles = 0;
+	for(int ty=0; ty<pixels.rows; ty+=gridMapUpdatesTileSize_)
+	{
+		int h = std::min(gridMapUpdatesTileSize_, pixels.rows-ty);
+		for(int tx=0; tx<pixels.cols; tx+=gridMapUpdatesTileSize_)
+		{
+			int w = std::min(gridMapUpdatesTileSize_, pixels.cols-tx);
+			for(int y=ty; y<ty+h; ++y)
 			{
-				++iter;
+				if(memcmp(pixels.ptr<char>(y)+tx, gridMapLastPublished_.ptr<char>(y)+tx, w) != 0)
+				{
+					minX = std::min(minX, tx);
+					minY = std::min(minY, ty);
+					maxX = std::max(maxX, tx+w-1);
+					maxY = std::max(maxY, ty+h-1);
+					++dirtyTiles;
+					break;
+				}
 			}
 		}
+	}
 
-		if(longUpdate)
+	if(dirtyTiles)
+	{
+		map_msgs::OccupancyGridUpdatePtr update(new map_msgs::OccupancyGridUpdate);
+		update->header.frame_id = mapFrameId;
+		update->header.stamp = stamp;
+		update->x = minX;
+		update->y = minY;
+		update->width = maxX - minX + 1;
+		update->height = maxY - minY + 1;
+		update->data.resize(update->width * update->height);
+		for(unsigned int y=0; y<update->height; ++y)
 		{
-			ROS_WARN("Map(s) updated! (%f s)", longUpdateTimer.ticks());
+			memcpy(update->data.data()+y*update->width, pixels.ptr<char>(update->y+y)+update->x, update->width);
 		}
+		gridMapUpdatesPub_.publish(update);
+		ROS_DEBUG("Published grid map update (%d dirty tiles, x=%d y=%d %dx%d)",
+				dirtyTiles, update->x, update->y, update->width, update->height);
 	}
+	return true;
+}
 
-	return filteredPoses;
+static void subtractFilteringSearch(
+		const cv::Mat * query,
+		int from,
+		int to,
+		const rtabmap::FlannIndex * substractCloudIndex,
+		float radiusSearch,
+		int minNeighborsInRadius,
+		std::vector<unsigned char> * keep)
+{
+	std::vector<std::vector<size_t> > kIndices;
+	std::vector<std::vector<float> > kDistances;
+	substractCloudIndex->radiusSearch(query->rowRange(from, to), kIndices, kDistances, radiusSearch, minNeighborsInRadius, 32, 0, false);
+	UASSERT((int)kIndices.size() == to-from);
+	for(int i=0; i<to-from; ++i)
+	{
+		(*keep)[from+i] = (int)kIndices[i].size() < minNeighborsInRadius?1:0;
+	}
 }
 
 pcl::PointCloud<pcl::PointXYZRGB>::Ptr subtractFiltering(
 		const pcl::PointCloud<pcl::PointXYZRGB>::Ptr & cloud,
 		const rtabmap::FlannIndex & substractCloudIndex,
 		float radiusSearch,
-		int minNeighborsInRadius)
+		int minNeighborsInRadius,
+		int threads = 1)
 {
 	UASSERT(minNeighborsInRadius > 0);
 	UASSERT(substractCloudIndex.indexedFeatures());
 
 	pcl::PointCloud<pcl::PointXYZRGB>::Ptr output(new pcl::PointCloud<pcl::PointXYZRGB>);
+	if(cloud->empty())
+	{
+		return output;
+	}
+
+	// All points are searched in batch, split between the threads
+	cv::Mat query(cloud->size(), 3, CV_32FC1);
+	for(unsigned int i=0; i<cloud->size(); ++i)
+	{
+		float * row = query.ptr<float>(i);
+		row[0] = cloud->at(i).x;
+		row[1] = cloud->at(i).y;
+		row[2] = cloud->at(i).z;
+	}
+	std::vector<unsigned char> keep(cloud->size(), 0);
+	if(threads <= 0)
+	{
+		threads = (int)boost::thread::hardware_concurrency();
+	}
+	// not worth it to start threads for small clouds
+	threads = std::max(1, std::min(threads, (int)cloud->size()/1000));
+	int chunk = (int)cloud->size()/threads;
+	boost::thread_group workers;
+	for(int t=1; t<threads; ++t)
+	{
+		int from = t*chunk;
+		int to = t==threads-1?(int)cloud->size():from+chunk;
+		workers.create_thread(boost::bind(&subtractFilteringSearch, &query, from, to, &substractCloudIndex, radiusSearch, minNeighborsInRadius, &keep));
+	}
+	subtractFilteringSearch(&query, 0, threads>1?chunk:(int)cloud->size(), &substractCloudIndex, radiusSearch, minNeighborsInRadius, &keep);
+	workers.join_all();
+
 	output->resize(cloud->size());
 	int oi = 0; // output iterator
 	for(unsigned int i=0; i<cloud->size(); ++i)
 	{
-		std::vector<std::vector<size_t> > kIndices;
-		std::vector<std::vector<float> > kDistances;
-		cv::Mat pt = (cv::Mat_<float>(1, 3) << cloud->at(i).x, cloud->at(i).y, cloud->at(i).z);
-		substractCloudIndex.radiusSearch(pt, kIndices, kDistances, radiusSearch, minNeighborsInRadius, 32, 0, false);
-		if(kIndices.size() == 1 && kIndices[0].size() < minNeighborsInRadius)
+		if(keep[i])
 		{
 			output->at(oi++) = cloud->at(i);
 		}
@@ -820,6 +1755,148 @@ pcl::PointCloud<pcl::PointXYZRGB>::Ptr subtractFiltering(
 	return output;
 }
 
+#ifdef WITH_OCTOMAP_MSGS
+#ifdef RTABMAP_OCTOMAP
+// Empty and frontier cells are grouped by aligned blocks of
+// 2^kOctomapBlockBits cells per axis. A cell is packed as <depth,key>.
+static const unsigned int kOctomapBlockBits = 4;
+
+static unsigned long long packOctomapCell(const octomap::OcTreeKey & key, unsigned int depth)
+{
+	return ((unsigned long long)depth << 48) |
+			((unsigned long long)key[0] << 32) |
+			((unsigned long long)key[1] << 16) |
+			(unsigned long long)key[2];
+}
+
+static void unpackOctomapCell(unsigned long long cell, octomap::OcTreeKey & key, unsigned int & depth)
+{
+	depth = (unsigned int)(cell >> 48);
+	key[0] = (octomap::key_type)((cell >> 32) & 0xFFFF);
+	key[1] = (octomap::key_type)((cell >> 16) & 0xFFFF);
+	key[2] = (octomap::key_type)(cell & 0xFFFF);
+}
+
+static unsigned long long octomapBlockId(const octomap::OcTreeKey & key)
+{
+	return ((unsigned long long)(key[0] >> kOctomapBlockBits) << 32) |
+			((unsigned long long)(key[1] >> kOctomapBlockBits) << 16) |
+			(unsigned long long)(key[2] >> kOctomapBlockBits);
+}
+
+// An empty cell is a frontier if one of its 6 face neighbors is unknown
+static bool isOctomapFrontierCell(const RtabmapColorOcTree * octree, const octomap::OcTreeKey & key, unsigned int depth)
+{
+	int span = 1 << (octree->getTreeDepth() - depth);
+	for(int i=0; i<3; ++i)
+	{
+		int minKey = span==1?key[i]:key[i] - span/2;
+		int neighbors[2] = {minKey-1, minKey+span};
+		for(int j=0; j<2; ++j)
+		{
+			if(neighbors[j] >= 0 && neighbors[j] <= 0xFFFF)
+			{
+				octomap::OcTreeKey neighbor = key;
+				neighbor[i] = (octomap::key_type)neighbors[j];
+				if(octree->search(neighbor) == 0)
+				{
+					return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+// Sorted empty and frontier cells of a block. Pruned nodes larger
+// than the block are cut to the block.
+static void computeOctomapBlock(
+		const RtabmapColorOcTree * octree,
+		unsigned long long blockId,
+		std::vector<unsigned long long> & empty,
+		std::vector<unsigned long long> & frontier)
+{
+	unsigned int blockDepth = octree->getTreeDepth() - kOctomapBlockBits;
+	int span = 1 << kOctomapBlockBits;
+	octomap::OcTreeKey minKey(
+			(octomap::key_type)(((blockId >> 32) & 0xFFFF) << kOctomapBlockBits),
+			(octomap::key_type)(((blockId >> 16) & 0xFFFF) << kOctomapBlockBits),
+			(octomap::key_type)((blockId & 0xFFFF) << kOctomapBlockBits));
+	octomap::OcTreeKey maxKey(minKey[0]+span-1, minKey[1]+span-1, minKey[2]+span-1);
+	for(RtabmapColorOcTree::leaf_bbx_iterator iter=octree->begin_leafs_bbx(minKey, maxKey), end=octree->end_leafs_bbx(); iter!=end; ++iter)
+	{
+		if(octree->isNodeOccupied(*iter))
+		{
+			continue;
+		}
+		unsigned int depth = iter.getDepth();
+		octomap::OcTreeKey key = iter.getKey();
+		if(depth < blockDepth)
+		{
+			depth = blockDepth;
+			key = octree->adjustKeyAtDepth(minKey, blockDepth);
+		}
+		unsigned long long cell = packOctomapCell(key, depth);
+		empty.push_back(cell);
+		if(isOctomapFrontierCell(octree, key, depth))
+		{
+			frontier.push_back(cell);
+		}
+	}
+	std::sort(empty.begin(), empty.end());
+	std::sort(frontier.begin(), frontier.end());
+}
+
+// Net changes since the last publication: a cell added then removed is not published
+static void accumulateOctomapDelta(
+		const std::vector<unsigned long long> & previous,
+		const std::vector<unsigned long long> & current,
+		boost::unordered_set<unsigned long long> & added,
+		boost::unordered_set<unsigned long long> & removed)
+{
+	std::vector<unsigned long long> diff;
+	std::set_difference(current.begin(), current.end(), previous.begin(), previous.end(), std::back_inserter(diff));
+	for(size_t i=0; i<diff.size(); ++i)
+	{
+		if(removed.erase(diff[i]) == 0)
+		{
+			added.insert(diff[i]);
+		}
+	}
+	diff.clear();
+	std::set_difference(previous.begin(), previous.end(), current.begin(), current.end(), std::back_inserter(diff));
+	for(size_t i=0; i<diff.size(); ++i)
+	{
+		if(added.erase(diff[i]) == 0)
+		{
+			removed.insert(diff[i]);
+		}
+	}
+}
+
+template<typename Iterator>
+static void appendOctomapCells(
+		const RtabmapColorOcTree * octree,
+		Iterator begin,
+		Iterator end,
+		pcl::PointCloud<pcl::PointXYZRGB> & cloud)
+{
+	for(Iterator iter=begin; iter!=end; ++iter)
+	{
+		octomap::OcTreeKey key;
+		unsigned int depth;
+		unpackOctomapCell(*iter, key, depth);
+		octomap::point3d pt = octree->keyToCoord(key, depth);
+		pcl::PointXYZRGB p;
+		p.x = pt.x();
+		p.y = pt.y();
+		p.z = pt.z();
+		cloud.push_back(p);
+	}
+}
+#endif
+#endif
+
 void MapsManager::publishMaps(
 		const std::map<int, rtabmap::Transform> & poses,
 		const ros::Time & stamp,
@@ -864,7 +1941,9 @@ void MapsManager::publishMaps(
 				   cloudObstaclesPub_.getNumSubscribers();
 		bool graphGroundChanged = updateGround;
 		bool graphObstacleChanged = updateObstacles;
-		float updateErrorSqr = occupancyGrid_->getUpdateError()*occupancyGrid_->getUpdateError();
+		// The assembled clouds are rebuilt only if a node moved more than this error
+		float updateError = cloudUpdateError_>0.0?cloudUpdateError_:occupancyGrid_->getUpdateError();
+		float updateErrorSqr = updateError*updateError;
 		for(std::map<int, Transform>::const_iterator iter=poses.lower_bound(1); iter!=poses.end(); ++iter)
 		{
 			std::map<int, Transform>::const_iterator jter;
@@ -906,6 +1985,7 @@ void MapsManager::publishMaps(
 			assembledGround_->reserve(previousSize);
 			assembledGroundPoses_.clear();
 			assembledGroundIndex_.release();
+			assembledGroundVoxels_.clear();
 		}
 		if(graphObstacleOptimized || graphObstacleChanged )
 		{
@@ -914,6 +1994,7 @@ void MapsManager::publishMaps(
 			assembledObstacles_->reserve(previousSize);
 			assembledObstaclePoses_.clear();
 			assembledObstacleIndex_.release();
+			assembledObstacleVoxels_.clear();
 		}
 
 		if(graphGroundOptimized || graphObstacleOptimized)
@@ -932,7 +2013,7 @@ void MapsManager::publishMaps(
 					{
 						assembledGroundPoses_.insert(*iter);
 						pcl::PointCloud<pcl::PointXYZRGB>::Ptr transformed = util3d::transformPointCloud(kter->second, iter->second);
-						*assembledGround_+=*transformed;
+						appendToAssembledCloud(*transformed, *assembledGround_, assembledGroundVoxels_);
 						if(cloudSubtractFiltering_)
 						{
 							for(unsigned int i=0; i<transformed->size(); ++i)
@@ -960,7 +2041,7 @@ void MapsManager::publishMaps(
 					{
 						assembledObstaclePoses_.insert(*iter);
 						pcl::PointCloud<pcl::PointXYZRGB>::Ptr transformed = util3d::transformPointCloud(kter->second, iter->second);
-						*assembledObstacles_+=*transformed;
+						appendToAssembledCloud(*transformed, *assembledObstacles_, assembledObstacleVoxels_);
 						if(cloudSubtractFiltering_)
 						{
 							for(unsigned int i=0; i<transformed->size(); ++i)
@@ -1020,7 +2101,7 @@ void MapsManager::publishMaps(
 					{
 						if(assembledGroundIndex_.indexedFeatures())
 						{
-							subtractedCloud = subtractFiltering(transformed, assembledGroundIndex_, occupancyGrid_->getCellSize(), cloudSubtractFilteringMinNeighbors_);
+							subtractedCloud = subtractFiltering(transformed, assembledGroundIndex_, occupancyGrid_->getCellSize(), cloudSubtractFilteringMinNeighbors_, mapThreads_);
 						}
 						if(subtractedCloud->size())
 						{
@@ -1048,7 +2129,7 @@ void MapsManager::publishMaps(
 					}
 					if(subtractedCloud->size())
 					{
-						*assembledGround_+=*subtractedCloud;
+						appendToAssembledCloud(*subtractedCloud, *assembledGround_, assembledGroundVoxels_);
 					}
 					++countGrounds;
 				}
@@ -1067,7 +2148,7 @@ void MapsManager::publishMaps(
 					{
 						if(assembledObstacleIndex_.indexedFeatures())
 						{
-							subtractedCloud = subtractFiltering(transformed, assembledObstacleIndex_, occupancyGrid_->getCellSize(), cloudSubtractFilteringMinNeighbors_);
+							subtractedCloud = subtractFiltering(transformed, assembledObstacleIndex_, occupancyGrid_->getCellSize(), cloudSubtractFilteringMinNeighbors_, mapThreads_);
 						}
 						if(subtractedCloud->size())
 						{
@@ -1095,14 +2176,14 @@ void MapsManager::publishMaps(
 					}
 					if(subtractedCloud->size())
 					{
-						*assembledObstacles_+=*subtractedCloud;
+						appendToAssembledCloud(*subtractedCloud, *assembledObstacles_, assembledObstacleVoxels_);
 					}
 					++countObstacles;
 				}
 			}
 		}
 
-		if(cloudOutputVoxelized_)
+		if(cloudOutputVoxelized_ && !cloudVoxelHash_)
 		{
 			UASSERT(occupancyGrid_->getCellSize() > 0.0);
 			if(countGrounds && assembledGround_->size())
@@ -1147,9 +2228,22 @@ void MapsManager::publishMaps(
 			}
 			if(cloudMapPub_.getNumSubscribers() || scanMapPub_.getNumSubscribers())
 			{
-				pcl::PointCloud<pcl::PointXYZRGB> cloud = *assembledObstacles_ + *assembledGround_;
+				// Serialize both clouds directly in the message instead of
+				// concatenating them in a temporary cloud first
 				sensor_msgs::PointCloud2::Ptr cloudMsg(new sensor_msgs::PointCloud2);
-				pcl::toROSMsg(cloud, *cloudMsg);
+				pcl::toROSMsg(*assembledObstacles_, *cloudMsg);
+				if(!assembledGround_->empty())
+				{
+					// same raw layout as in pcl::toROSMsg()
+					UASSERT(cloudMsg->point_step == sizeof(pcl::PointXYZRGB));
+					size_t obstaclesBytes = cloudMsg->data.size();
+					cloudMsg->data.resize(obstaclesBytes + assembledGround_->size()*cloudMsg->point_step);
+					memcpy(&cloudMsg->data[obstaclesBytes], assembledGround_->points.data(), assembledGround_->size()*cloudMsg->point_step);
+					cloudMsg->width += assembledGround_->size();
+					cloudMsg->height = 1;
+					cloudMsg->row_step = cloudMsg->width*cloudMsg->point_step;
+					cloudMsg->is_dense = cloudMsg->is_dense && assembledGround_->is_dense;
+				}
 				cloudMsg->header.stamp = stamp;
 				cloudMsg->header.frame_id = mapFrameId;
 
@@ -1170,19 +2264,8 @@ void MapsManager::publishMaps(
 	{
 		if(!groundClouds_.empty() || !obstacleClouds_.empty())
 		{
-			size_t totalBytes = 0;
-			for(std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr >::iterator iter=groundClouds_.begin();iter!=groundClouds_.end();++iter)
-			{
-				totalBytes += sizeof(int) + iter->second->points.size()*sizeof(pcl::PointXYZRGB);
-			}
-			for(std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr >::iterator iter=obstacleClouds_.begin();iter!=obstacleClouds_.end();++iter)
-			{
-				totalBytes += sizeof(int) + iter->second->points.size()*sizeof(pcl::PointXYZRGB);
-			}
-			totalBytes += (assembledGround_->size() + assembledObstacles_->size()) *sizeof(pcl::PointXYZRGB);
-			totalBytes += (assembledGroundPoses_.size() + assembledObstaclePoses_.size()) * 13*sizeof(float);
-			totalBytes += assembledGroundIndex_.indexedFeatures()*assembledGroundIndex_.featuresDim() * sizeof(float);
-			totalBytes += assembledObstacleIndex_.indexedFeatures()*assembledObstacleIndex_.featuresDim() * sizeof(float);
+			std::map<std::string, unsigned long> usage = getMemoryUsage();
+			size_t totalBytes = usage.at("LocalClouds") + usage.at("AssembledClouds");
 			ROS_INFO("MapsManager: cleanup point clouds (%ld points, %ld cached clouds, ~%ld MB)...",
 					assembledGround_->size()+assembledObstacles_->size(),
 					groundClouds_.size()+obstacleClouds_.size(),
@@ -1194,6 +2277,8 @@ void MapsManager::publishMaps(
 		assembledObstaclePoses_.clear();
 		assembledGroundIndex_.release();
 		assembledObstacleIndex_.release();
+		assembledGroundVoxels_.clear();
+		assembledObstacleVoxels_.clear();
 		groundClouds_.clear();
 		obstacleClouds_.clear();
 	}
@@ -1227,36 +2312,100 @@ void MapsManager::publishMaps(
 		(octoMapEmptySpace_.getNumSubscribers() && !latched_.at(&octoMapEmptySpace_)) ||
 		(octoMapProj_.getNumSubscribers() && !latched_.at(&octoMapProj_)))
 	{
+		updateOctomapMsgs(octoMapPubBin_.getNumSubscribers()>0, octoMapPubFull_.getNumSubscribers()>0);
 		if(octoMapPubBin_.getNumSubscribers())
 		{
-			octomap_msgs::Octomap msg;
-			octomap_msgs::binaryMapToMsg(*octomap_->octree(), msg);
-			msg.header.frame_id = mapFrameId;
-			msg.header.stamp = stamp;
-			octoMapPubBin_.publish(msg);
+			octomapBinaryMsg_.header.frame_id = mapFrameId;
+			octomapBinaryMsg_.header.stamp = stamp;
+			octoMapPubBin_.publish(octomapBinaryMsg_);
 			latched_.at(&octoMapPubBin_) = true;
 		}
 		if(octoMapPubFull_.getNumSubscribers())
 		{
-			octomap_msgs::Octomap msg;
-			octomap_msgs::fullMapToMsg(*octomap_->octree(), msg);
-			msg.header.frame_id = mapFrameId;
-			msg.header.stamp = stamp;
-			octoMapPubFull_.publish(msg);
+			octomapFullMsg_.header.frame_id = mapFrameId;
+			octomapFullMsg_.header.stamp = stamp;
+			octoMapPubFull_.publish(octomapFullMsg_);
 			latched_.at(&octoMapPubFull_) = true;
 		}
+		// With octomap_incremental_space, empty and frontier cells are
+		// updated only in the blocks touched by the new clouds
+		bool incrementalSpace = octomapIncrementalSpace_ &&
+				(octomapTreeDepth_ == 0 || octomapTreeDepth_ >= (int)octomap_->octree()->getTreeDepth());
+		if(incrementalSpace &&
+			(octoMapFrontierCloud_.getNumSubscribers() ||
+			 octoMapEmptySpace_.getNumSubscribers() ||
+			 octoMapFrontierCloudAdded_.getNumSubscribers() ||
+			 octoMapFrontierCloudRemoved_.getNumSubscribers() ||
+			 octoMapEmptySpaceAdded_.getNumSubscribers() ||
+			 octoMapEmptySpaceRemoved_.getNumSubscribers()))
+		{
+			updateOctomapSpace();
+
+			sensor_msgs::PointCloud2 msg;
+			const RtabmapColorOcTree * octree = octomap_->octree();
+			pcl::PointCloud<pcl::PointXYZRGB> cloudFrontier;
+			pcl::PointCloud<pcl::PointXYZRGB> cloudEmptySpace;
+			if(octoMapFrontierCloud_.getNumSubscribers() || octoMapEmptySpace_.getNumSubscribers())
+			{
+				for(std::map<unsigned long long, std::pair<std::vector<unsigned long long>, std::vector<unsigned long long> > >::const_iterator iter=octomapSpaceBlocks_.begin();
+					iter!=octomapSpaceBlocks_.end();
+					++iter)
+				{
+					if(octoMapEmptySpace_.getNumSubscribers())
+					{
+						appendOctomapCells(octree, iter->second.first.begin(), iter->second.first.end(), cloudEmptySpace);
+					}
+					if(octoMapFrontierCloud_.getNumSubscribers())
+					{
+						appendOctomapCells(octree, iter->second.second.begin(), iter->second.second.end(), cloudFrontier);
+					}
+				}
+			}
+			if(octoMapFrontierCloud_.getNumSubscribers())
+			{
+				pcl::toROSMsg(cloudFrontier, msg);
+				msg.header.frame_id = mapFrameId;
+				msg.header.stamp = stamp;
+				octoMapFrontierCloud_.publish(msg);
+				latched_.at(&octoMapFrontierCloud_) = true;
+			}
+			if(octoMapEmptySpace_.getNumSubscribers())
+			{
+				pcl::toROSMsg(cloudEmptySpace, msg);
+				msg.header.frame_id = mapFrameId;
+				msg.header.stamp = stamp;
+				octoMapEmptySpace_.publish(msg);
+				latched_.at(&octoMapEmptySpace_) = true;
+			}
+
+			// deltas since the last publication
+			ros::Publisher * deltaPubs[4] = {&octoMapFrontierCloudAdded_, &octoMapFrontierCloudRemoved_, &octoMapEmptySpaceAdded_, &octoMapEmptySpaceRemoved_};
+			boost::unordered_set<unsigned long long> * deltas[4] = {&octomapFrontierAdded_, &octomapFrontierRemoved_, &octomapEmptyAdded_, &octomapEmptyRemoved_};
+			for(int i=0; i<4; ++i)
+			{
+				if(deltaPubs[i]->getNumSubscribers() && !deltas[i]->empty())
+				{
+					pcl::PointCloud<pcl::PointXYZRGB> cloudDelta;
+					appendOctomapCells(octree, deltas[i]->begin(), deltas[i]->end(), cloudDelta);
+					pcl::toROSMsg(cloudDelta, msg);
+					msg.header.frame_id = mapFrameId;
+					msg.header.stamp = stamp;
+					deltaPubs[i]->publish(msg);
+				}
+				deltas[i]->clear();
+			}
+		}
 		if(octoMapCloud_.getNumSubscribers() ||
-			octoMapFrontierCloud_.getNumSubscribers() ||
 			octoMapObstacleCloud_.getNumSubscribers() ||
 			octoMapGroundCloud_.getNumSubscribers() ||
-			octoMapEmptySpace_.getNumSubscribers())
+			(!incrementalSpace && (octoMapFrontierCloud_.getNumSubscribers() || octoMapEmptySpace_.getNumSubscribers())))
 		{
 			sensor_msgs::PointCloud2 msg;
 			pcl::IndicesPtr obstacleIndices(new std::vector<int>);
 			pcl::IndicesPtr frontierIndices(new std::vector<int>);
 			pcl::IndicesPtr emptyIndices(new std::vector<int>);
 			pcl::IndicesPtr groundIndices(new std::vector<int>);
-			pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud = octomap_->createCloud(octomapTreeDepth_, obstacleIndices.get(), emptyIndices.get(), groundIndices.get(), true, frontierIndices.get(),0);
+			pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud = octomap_->createCloud(octomapTreeDepth_, obstacleIndices.get(), incrementalSpace?(std::vector<int>*)0:emptyIndices.get(), groundIndices.get(), true, incrementalSpace?(std::vector<int>*)0:frontierIndices.get(),0);
 
 			if(octoMapCloud_.getNumSubscribers())
 			{
@@ -1269,7 +2418,7 @@ void MapsManager::publishMaps(
 				octoMapCloud_.publish(msg);
 				latched_.at(&octoMapCloud_) = true;
 			}
-			if(octoMapFrontierCloud_.getNumSubscribers())
+			if(!incrementalSpace && octoMapFrontierCloud_.getNumSubscribers())
 			{
 				pcl::PointCloud<pcl::PointXYZRGB> cloudFrontier;
 				pcl::copyPointCloud(*cloud, *frontierIndices, cloudFrontier);
@@ -1299,7 +2448,7 @@ void MapsManager::publishMaps(
 				octoMapGroundCloud_.publish(msg);
 				latched_.at(&octoMapGroundCloud_) = true;
 			}
-			if(octoMapEmptySpace_.getNumSubscribers())
+			if(!incrementalSpace && octoMapEmptySpace_.getNumSubscribers())
 			{
 				pcl::PointCloud<pcl::PointXYZRGB> cloudEmptySpace;
 				pcl::copyPointCloud(*cloud, *emptyIndices, cloudEmptySpace);
@@ -1362,6 +2511,10 @@ void MapsManager::publishMaps(
 		octoMapObstacleCloud_.getNumSubscribers() == 0 &&
 		octoMapGroundCloud_.getNumSubscribers() == 0 &&
 		octoMapEmptySpace_.getNumSubscribers() == 0 &&
+		octoMapFrontierCloudAdded_.getNumSubscribers() == 0 &&
+		octoMapFrontierCloudRemoved_.getNumSubscribers() == 0 &&
+		octoMapEmptySpaceAdded_.getNumSubscribers() == 0 &&
+		octoMapEmptySpaceRemoved_.getNumSubscribers() == 0 &&
 		octoMapProj_.getNumSubscribers() == 0)
 	{
 		if(octomap_->octree()->getNumLeafNodes()>0)
@@ -1371,6 +2524,10 @@ void MapsManager::publishMaps(
 					octomap_->octree()->memoryUsage()/1048576);
 		}
 		octomap_->clear();
+		octomapBinaryMsgUpToDate_ = false;
+		octomapFullMsgUpToDate_ = false;
+		resetOctomapSpace(false);
+		resetIncrementalPoses();
 	}
 
 	if(octoMapPubBin_.getNumSubscribers() == 0)
@@ -1409,11 +2566,17 @@ void MapsManager::publishMaps(
 #endif
 #endif
 
+	bool gridPyramidNotLatched = false;
+	for(size_t i=0; i<gridPyramidPubs_.size(); ++i)
+	{
+		gridPyramidNotLatched = gridPyramidNotLatched || (gridPyramidPubs_[i].getNumSubscribers() && !latched_.at(&gridPyramidPubs_[i]));
+	}
 	if( gridUpdated_ ||
 		!latching_ ||
 		(gridMapPub_.getNumSubscribers() && !latched_.at(&gridMapPub_)) ||
 		(projMapPub_.getNumSubscribers() && !latched_.at(&projMapPub_)) ||
-		(gridProbMapPub_.getNumSubscribers() && !latched_.at(&gridProbMapPub_)))
+		(gridProbMapPub_.getNumSubscribers() && !latched_.at(&gridProbMapPub_)) ||
+		gridPyramidNotLatched)
 	{
 		if(projMapPub_.getNumSubscribers())
 		{
@@ -1472,7 +2635,7 @@ void MapsManager::publishMaps(
 				ROS_WARN("Grid map is empty! (local maps=%d)", (int)gridMaps_.size());
 			}
 		}
-		if(gridMapPub_.getNumSubscribers() || projMapPub_.getNumSubscribers())
+		if(gridMapPub_.getNumSubscribers() || projMapPub_.getNumSubscribers() || gridPyramidHasSubscribers())
 		{
 			// create the grid map
 			float xMin=0.0f, yMin=0.0f, gridCellSize = 0.05f;
@@ -1504,14 +2667,52 @@ void MapsManager::publishMaps(
 
 				if(gridMapPub_.getNumSubscribers())
 				{
-					gridMapPub_.publish(map);
-					latched_.at(&gridMapPub_) = true;
+					// Send only the changed region if the grid map is
+					// already latched by the current subscribers
+					if(!gridMapUpdates_ ||
+						!latching_ ||
+						!latched_.at(&gridMapPub_) ||
+						gridMapPub_.getNumSubscribers() > gridMapSubscribers_ ||
+						!publishGridMapUpdate(pixels, xMin, yMin, gridCellSize, stamp, mapFrameId))
+					{
+						gridMapPub_.publish(map);
+						latched_.at(&gridMapPub_) = true;
+					}
+					gridMapSubscribers_ = gridMapPub_.getNumSubscribers();
+					if(gridMapUpdates_)
+					{
+						// copy, the returned map may share data with the occupancy grid
+						gridMapLastPublished_ = pixels.clone();
+						gridMapLastXMin_ = xMin;
+						gridMapLastYMin_ = yMin;
+						gridMapLastCellSize_ = gridCellSize;
+					}
 				}
 				if(projMapPub_.getNumSubscribers())
 				{
 					projMapPub_.publish(map);
 					latched_.at(&projMapPub_) = true;
 				}
+				if(gridPyramidHasSubscribers())
+				{
+					updateGridPyramid(pixels, xMin, yMin, gridCellSize);
+					for(size_t i=0; i<gridPyramidPubs_.size(); ++i)
+					{
+						if(gridPyramidPubs_[i].getNumSubscribers() && !gridPyramid_[i].empty())
+						{
+							nav_msgs::OccupancyGrid level;
+							level.header = map.header;
+							level.info = map.info;
+							level.info.resolution = gridPyramidActualCellSizes_[i];
+							level.info.width = gridPyramid_[i].cols;
+							level.info.height = gridPyramid_[i].rows;
+							level.data.resize(level.info.width * level.info.height);
+							memcpy(level.data.data(), gridPyramid_[i].data, level.info.width * level.info.height);
+							gridPyramidPubs_[i].publish(level);
+							latched_.at(&gridPyramidPubs_[i]) = true;
+						}
+					}
+				}
 			}
 			else if(poses.size())
 			{
@@ -1523,6 +2724,8 @@ void MapsManager::publishMaps(
 	if(gridMapPub_.getNumSubscribers() == 0)
 	{
 		latched_.at(&gridMapPub_) = false;
+		gridMapLastPublished_ = cv::Mat();
+		gridMapSubscribers_ = 0;
 	}
 	if(projMapPub_.getNumSubscribers() == 0)
 	{
@@ -1532,6 +2735,13 @@ void MapsManager::publishMaps(
 	{
 		latched_.at(&gridProbMapPub_) = false;
 	}
+	for(size_t i=0; i<gridPyramidPubs_.size(); ++i)
+	{
+		if(gridPyramidPubs_[i].getNumSubscribers() == 0)
+		{
+			latched_.at(&gridPyramidPubs_[i]) = false;
+		}
+	}
 
 	if(!this->hasSubscribers() && mapCacheCleanup_)
 	{
@@ -1550,6 +2760,7 @@ void MapsManager::publishMaps(
 		}
 		gridMaps_.clear();
 		gridMapsViewpoints_.clear();
+		resetIncrementalPoses();
 	}
 }
 
@@ -1568,8 +2779,591 @@ cv::Mat MapsManager::getGridProbMap(
 		float & gridCellSize)
 {
 	gridCellSize = occupancyGrid_->getCellSize();
+	if(gridProbMapIncremental_)
+	{
+		xMin = gridProbCellXMin_*gridCellSize;
+		yMin = gridProbCellYMin_*gridCellSize;
+		return gridProbPixels_;
+	}
 	return occupancyGrid_->getProbMap(xMin, yMin);
 }
 
+cv::Mat MapsManager::getGridMap(
+		float & xMin,
+		float & yMin,
+		float & gridCellSize,
+		float resolution)
+{
+	cv::Mat pixels = getGridMap(xMin, yMin, gridCellSize);
+	if(gridPyramidCellSizes_.empty() || resolution <= gridCellSize || pixels.empty())
+	{
+		return pixels;
+	}
+	updateGridPyramid(pixels, xMin, yMin, gridCellSize);
+	size_t best = 0;
+	for(size_t i=1; i<gridPyramid_.size(); ++i)
+	{
+		if(fabs(gridPyramidActualCellSizes_[i]-resolution) < fabs(gridPyramidActualCellSizes_[best]-resolution))
+		{
+			best = i;
+		}
+	}
+	if(gridPyramid_.empty() || fabs(gridPyramidActualCellSizes_[best]-resolution) >= fabs(gridCellSize-resolution))
+	{
+		return pixels;
+	}
+	xMin = gridPyramidXMin_;
+	yMin = gridPyramidYMin_;
+	gridCellSize = gridPyramidActualCellSizes_[best];
+	return gridPyramid_[best];
+}
+
+void MapsManager::updateGridProbMap(const std::map<int, rtabmap::Transform> & poses, bool incremental)
+{
+	UTimer time;
+	int removed = 0;
+	int added = 0;
+	float updateErrorSqr = gridProbMapUpdateError_*gridProbMapUpdateError_;
+	if(incremental)
+	{
+		// Only new nodes are given, known nodes didn't move
+		std::map<int, std::pair<Transform, std::pair< std::pair<cv::Mat, cv::Mat>, cv::Mat> > >::iterator iter=gridProbNodes_.find(0);
+		if(iter != gridProbNodes_.end())
+		{
+			fuseGridProbNode(iter->second.first, iter->second.second, -1);
+			gridProbNodes_.erase(iter);
+			++removed;
+		}
+	}
+	else
+	{
+		for(std::map<int, std::pair<Transform, std::pair< std::pair<cv::Mat, cv::Mat>, cv::Mat> > >::iterator iter=gridProbNodes_.begin(); iter!=gridProbNodes_.end();)
+		{
+			std::map<int, Transform>::const_iterator jter = poses.find(iter->first);
+			// Node 0 is the latest local grid, not yet in the graph
+			if(iter->first == 0 ||
+			   jter == poses.end() ||
+			   iter->second.first.getDistanceSquared(jter->second) > updateErrorSqr ||
+			   fabs((iter->second.first.inverse()*jter->second).theta()) > gridProbMapUpdateError_)
+			{
+				fuseGridProbNode(iter->second.first, iter->second.second, -1);
+				gridProbNodes_.erase(iter++);
+				++removed;
+			}
+			else
+			{
+				++iter;
+			}
+		}
+	}
+	for(std::map<int, Transform>::const_iterator iter=poses.begin(); iter!=poses.end(); ++iter)
+	{
+		if(gridProbNodes_.find(iter->first) == gridProbNodes_.end())
+		{
+			std::map<int, std::pair< std::pair<cv::Mat, cv::Mat>, cv::Mat> >::const_iterator mter = gridMaps_.find(iter->first);
+			if(mter != gridMaps_.end() && !iter->second.isNull())
+			{
+				// cv::Mat headers share the local grid data
+				fuseGridProbNode(iter->second, mter->second, 1);
+				gridProbNodes_.insert(std::make_pair(iter->first, std::make_pair(iter->second, mter->second)));
+				++added;
+			}
+		}
+	}
+	if(removed || added)
+	{
+		ROS_DEBUG("Probabilistic grid update time = %fs (removed=%d added=%d nodes=%d)",
+				time.ticks(), removed, added, (int)gridProbNodes_.size());
+	}
+}
+
+void MapsManager::fuseGridProbNode(
+		const rtabmap::Transform & pose,
+		const std::pair< std::pair<cv::Mat, cv::Mat>, cv::Mat> & cells,
+		int sign)
+{
+	float cellSize = occupancyGrid_->getCellSize();
+	// <ground, obstacles, empty cells>, in global cell coordinates so that
+	// a node removed after the grid has grown falls in the same cells
+	const cv::Mat * mats[3] = {&cells.first.first, &cells.first.second, &cells.second};
+	std::vector<cv::Point> points[3];
+	int minX = INT_MAX, minY = INT_MAX, maxX = INT_MIN, maxY = INT_MIN;
+	for(int k=0; k<3; ++k)
+	{
+		const cv::Mat & m = *mats[k];
+		if(m.empty())
+		{
+			continue;
+		}
+		UASSERT(m.depth() == CV_32F && m.channels() >= 2);
+		points[k].reserve(m.total());
+		for(int i=0; i<m.rows; ++i)
+		{
+			const float * row = m.ptr<float>(i);
+			for(int j=0; j<m.cols; ++j)
+			{
+				const float * pt = row + j*m.channels();
+				float z = m.channels() > 2?pt[2]:0.0f;
+				cv::Point p(
+						(int)floor((pose.r11()*pt[0] + pose.r12()*pt[1] + pose.r13()*z + pose.x())/cellSize),
+						(int)floor((pose.r21()*pt[0] + pose.r22()*pt[1] + pose.r23()*z + pose.y())/cellSize));
+				minX = std::min(minX, p.x);
+				minY = std::min(minY, p.y);
+				maxX = std::max(maxX, p.x);
+				maxY = std::max(maxY, p.y);
+				points[k].push_back(p);
+			}
+		}
+	}
+	if(minX > maxX)
+	{
+		return;
+	}
+
+	// Grow the grid with a margin (only when adding, removed
+	// cells have been added inside the current bounds)
+	if(sign > 0)
+	{
+		const int margin = 50;
+		int addLeft = 0, addBottom = 0, addRight = 0, addTop = 0;
+		if(gridProbLogOdds_.empty())
+		{
+			gridProbCellXMin_ = minX - margin;
+			gridProbCellYMin_ = minY - margin;
+			addRight = maxX - minX + 1 + 2*margin;
+			addTop = maxY - minY + 1 + 2*margin;
+		}
+		else
+		{
+			if(minX < gridProbCellXMin_)
+			{
+				addLeft = gridProbCellXMin_ - minX + margin;
+			}
+			if(minY < gridProbCellYMin_)
+			{
+				addBottom = gridProbCellYMin_ - minY + margin;
+			}
+			if(maxX >= gridProbCellXMin_ + gridProbLogOdds_.cols)
+			{
+				addRight = maxX - (gridProbCellXMin_ + gridProbLogOdds_.cols) + 1 + margin;
+			}
+			if(maxY >= gridProbCellYMin_ + gridProbLogOdds_.rows)
+			{
+				addTop = maxY - (gridProbCellYMin_ + gridProbLogOdds_.rows) + 1 + margin;
+			}
+		}
+		if(addLeft || addBottom || addRight || addTop)
+		{
+			cv::Mat logOdds(gridProbLogOdds_.rows+addBottom+addTop, gridProbLogOdds_.cols+addLeft+addRight, CV_32FC1, cv::Scalar(0.0f));
+			cv::Mat updates(logOdds.size(), CV_32SC1, cv::Scalar(0));
+			cv::Mat pixels(logOdds.size(), CV_8SC1, cv::Scalar(-1));
+			if(!gridProbLogOdds_.empty())
+			{
+				cv::Rect roi(addLeft, addBottom, gridProbLogOdds_.cols, gridProbLogOdds_.rows);
+				gridProbLogOdds_.copyTo(logOdds(roi));
+				gridProbUpdates_.copyTo(updates(roi));
+				gridProbPixels_.copyTo(pixels(roi));
+			}
+			gridProbLogOdds_ = logOdds;
+			gridProbUpdates_ = updates;
+			gridProbPixels_ = pixels;
+			gridProbCellXMin_ -= addLeft;
+			gridProbCellYMin_ -= addBottom;
+		}
+	}
+	else if(gridProbLogOdds_.empty())
+	{
+		return;
+	}
+
+	// ground and empty cells are free, obstacles are occupied
+	float values[3] = {gridProbMiss_, gridProbHit_, gridProbMiss_};
+	for(int k=0; k<3; ++k)
+	{
+		float value = sign*values[k];
+		for(size_t i=0; i<points[k].size(); ++i)
+		{
+			int x = points[k][i].x - gridProbCellXMin_;
+			int y = points[k][i].y - gridProbCellYMin_;
+			if(x < 0 || y < 0 || x >= gridProbLogOdds_.cols || y >= gridProbLogOdds_.rows)
+			{
+				continue;
+			}
+			float & logOdds = gridProbLogOdds_.at<float>(y, x);
+			int & updates = gridProbUpdates_.at<int>(y, x);
+			logOdds += value;
+			updates += sign;
+			if(updates <= 0)
+			{
+				// unknown again, reset accumulated rounding errors
+				logOdds = 0.0f;
+				updates = 0;
+				gridProbPixels_.at<signed char>(y, x) = -1;
+			}
+			else
+			{
+				// Clamping is applied on output to keep the updates reversible
+				float l = std::max(gridProbClampingMin_, std::min(gridProbClampingMax_, logOdds));
+				gridProbPixels_.at<signed char>(y, x) = (signed char)(100.0f * (1.0f - 1.0f/(1.0f+exp(l))));
+			}
+		}
+	}
+}
+
+void MapsManager::resetGridProbMap()
+{
+	gridProbLogOdds_ = cv::Mat();
+	gridProbUpdates_ = cv::Mat();
+	gridProbPixels_ = cv::Mat();
+	gridProbCellXMin_ = 0;
+	gridProbCellYMin_ = 0;
+	gridProbNodes_.clear();
+}
+
+// A coarse cell is occupied if any of its fine cells is occupied, otherwise
+// free if any is free, otherwise unknown (-1 < 0 < 100 in the grid).
+static cv::Mat downsampleGrid(const cv::Mat & grid, int factor)
+{
+	UASSERT(grid.type() == CV_8SC1 && factor > 1);
+	cv::Mat out((grid.rows+factor-1)/factor, (grid.cols+factor-1)/factor, CV_8SC1, cv::Scalar(-1));
+	for(int i=0; i<grid.rows; ++i)
+	{
+		const signed char * row = grid.ptr<signed char>(i);
+		signed char * outRow = out.ptr<signed char>(i/factor);
+		for(int j=0; j<grid.cols; ++j)
+		{
+			signed char & value = outRow[j/factor];
+			if(row[j] > value)
+			{
+				value = row[j];
+			}
+		}
+	}
+	return out;
+}
+
+void MapsManager::updateGridPyramid(const cv::Mat & pixels, float xMin, float yMin, float gridCellSize)
+{
+	if(gridPyramidRevision_ == gridRevision_ && gridPyramid_.size() == gridPyramidCellSizes_.size())
+	{
+		return;
+	}
+	// Each level is computed from the previous one
+	gridPyramid_.resize(gridPyramidCellSizes_.size());
+	gridPyramidActualCellSizes_.resize(gridPyramidCellSizes_.size());
+	const cv::Mat * previous = &pixels;
+	float previousCellSize = gridCellSize;
+	for(size_t i=0; i<gridPyramidCellSizes_.size(); ++i)
+	{
+		int factor = (int)(gridPyramidCellSizes_[i]/previousCellSize + 0.5f);
+		if(factor > 1)
+		{
+			gridPyramid_[i] = downsampleGrid(*previous, factor);
+			gridPyramidActualCellSizes_[i] = previousCellSize * float(factor);
+		}
+		else
+		{
+			ROS_WARN_ONCE("grid_pyramid_cell_sizes: level %d (%f m) is not coarser than "
+					"the previous level (%f m), using the previous level instead.",
+					(int)i+1, gridPyramidCellSizes_[i], previousCellSize);
+			gridPyramid_[i] = *previous;
+			gridPyramidActualCellSizes_[i] = previousCellSize;
+		}
+		if(fabs(gridPyramidActualCellSizes_[i] - gridPyramidCellSizes_[i]) > 0.0001f)
+		{
+			ROS_WARN_ONCE("grid_pyramid_cell_sizes: level %d (%f m) is not a multiple of "
+					"the previous level, using %f m instead.",
+					(int)i+1, gridPyramidCellSizes_[i], gridPyramidActualCellSizes_[i]);
+		}
+		previous = &gridPyramid_[i];
+		previousCellSize = gridPyramidActualCellSizes_[i];
+	}
+	gridPyramidXMin_ = xMin;
+	gridPyramidYMin_ = yMin;
+	gridPyramidRevision_ = gridRevision_;
+}
+
+#ifdef WITH_OCTOMAP_MSGS
+#ifdef RTABMAP_OCTOMAP
+static void serializeFullOctomap(const OctoMap * octomap, octomap_msgs::Octomap * msg)
+{
+	if(!octomap_msgs::fullMapToMsg(*octomap->octree(), *msg))
+	{
+		msg->data.clear();
+	}
+}
+#endif
+
+void MapsManager::updateOctomapMsgs(bool binary, bool full)
+{
+#ifdef RTABMAP_OCTOMAP
+	binary = binary && !octomapBinaryMsgUpToDate_;
+	full = full && !octomapFullMsgUpToDate_;
+	if(!binary && !full)
+	{
+		return;
+	}
+
+	UTimer time;
+	// Both serializations only read the tree, do them in parallel
+	boost::thread * fullThread = 0;
+	if(full)
+	{
+		if(binary)
+		{
+			fullThread = new boost::thread(boost::bind(&serializeFullOctomap, octomap_, &octomapFullMsg_));
+		}
+		else
+		{
+			serializeFullOctomap(octomap_, &octomapFullMsg_);
+		}
+		octomapFullMsgUpToDate_ = true;
+	}
+	if(binary)
+	{
+		if(!octomap_msgs::binaryMapToMsg(*octomap_->octree(), octomapBinaryMsg_))
+		{
+			octomapBinaryMsg_.data.clear();
+		}
+		octomapBinaryMsgUpToDate_ = true;
+	}
+	if(fullThread)
+	{
+		fullThread->join();
+		delete fullThread;
+	}
+	ROS_DEBUG("Octomap serialization time = %fs (binary=%d full=%d)", time.ticks(), binary?1:0, full?1:0);
+#endif
+}
+
+void MapsManager::markOctomapSpaceChanged(const std::map<int, rtabmap::Transform> & previousAddedNodes)
+{
+#ifdef RTABMAP_OCTOMAP
+	if(!octomapSpaceValid_)
+	{
+		// all blocks will be recomputed
+		return;
+	}
+	const std::map<int, Transform> & addedNodes = octomap_->addedNodes();
+	for(std::map<int, Transform>::const_iterator iter=previousAddedNodes.begin(); iter!=previousAddedNodes.end(); ++iter)
+	{
+		std::map<int, Transform>::const_iterator jter = addedNodes.find(iter->first);
+		if(jter == addedNodes.end() || jter->second != iter->second)
+		{
+			// The octree has been regenerated (graph changed)
+			octomapSpaceValid_ = false;
+			return;
+		}
+	}
+
+	const RtabmapColorOcTree * octree = octomap_->octree();
+	float padding = octree->getResolution(); // for frontier of the neighbor cells
+	for(std::map<int, Transform>::const_iterator iter=addedNodes.begin(); iter!=addedNodes.end(); ++iter)
+	{
+		if(previousAddedNodes.find(iter->first) != previousAddedNodes.end())
+		{
+			continue;
+		}
+		std::map<int, std::pair<std::pair<cv::Mat, cv::Mat>, cv::Mat> >::const_iterator mter = gridMaps_.find(iter->first);
+		std::map<int, cv::Point3f>::const_iterator pter = gridMapsViewpoints_.find(iter->first);
+		if(mter == gridMaps_.end() || pter == gridMapsViewpoints_.end())
+		{
+			octomapSpaceValid_ = false;
+			return;
+		}
+
+		// Bounding box of the rays, in local frame
+		cv::Point3f minPt = pter->second;
+		cv::Point3f maxPt = pter->second;
+		const cv::Mat * cells[3] = {&mter->second.first.first, &mter->second.first.second, &mter->second.second};
+		for(int k=0; k<3; ++k)
+		{
+			const cv::Mat & m = *cells[k];
+			if(m.empty() || m.channels() < 3)
+			{
+				continue;
+			}
+			for(int i=0; i<m.rows; ++i)
+			{
+				const float * row = m.ptr<float>(i);
+				for(int j=0; j<m.cols; ++j)
+				{
+					const float * pt = row + j*m.channels();
+					minPt.x = std::min(minPt.x, pt[0]);
+					minPt.y = std::min(minPt.y, pt[1]);
+					minPt.z = std::min(minPt.z, pt[2]);
+					maxPt.x = std::max(maxPt.x, pt[0]);
+					maxPt.y = std::max(maxPt.y, pt[1]);
+					maxPt.z = std::max(maxPt.z, pt[2]);
+				}
+			}
+		}
+
+		octomap::point3d boxMin(FLT_MAX, FLT_MAX, FLT_MAX);
+		octomap::point3d boxMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		for(int c=0; c<8; ++c)
+		{
+			cv::Point3f corner = util3d::transformPoint(cv::Point3f(
+					c&1?maxPt.x:minPt.x,
+					c&2?maxPt.y:minPt.y,
+					c&4?maxPt.z:minPt.z), iter->second);
+			boxMin = octomap::point3d(std::min(boxMin.x(), corner.x), std::min(boxMin.y(), corner.y), std::min(boxMin.z(), corner.z));
+			boxMax = octomap::point3d(std::max(boxMax.x(), corner.x), std::max(boxMax.y(), corner.y), std::max(boxMax.z(), corner.z));
+		}
+		boxMin -= octomap::point3d(padding, padding, padding);
+		boxMax += octomap::point3d(padding, padding, padding);
+
+		octomap::OcTreeKey minKey, maxKey;
+		if(!octree->coordToKeyChecked(boxMin, minKey) || !octree->coordToKeyChecked(boxMax, maxKey))
+		{
+			octomapSpaceValid_ = false;
+			return;
+		}
+		for(int x=minKey[0]>>kOctomapBlockBits; x<=maxKey[0]>>kOctomapBlockBits; ++x)
+		{
+			for(int y=minKey[1]>>kOctomapBlockBits; y<=maxKey[1]>>kOctomapBlockBits; ++y)
+			{
+				for(int z=minKey[2]>>kOctomapBlockBits; z<=maxKey[2]>>kOctomapBlockBits; ++z)
+				{
+					octomapSpaceChangedBlocks_.insert(((unsigned long long)x << 32) | ((unsigned long long)y << 16) | (unsigned long long)z);
+				}
+			}
+		}
+	}
+#endif
+}
+
+void MapsManager::updateOctomapSpace()
+{
+#ifdef RTABMAP_OCTOMAP
+	UTimer time;
+	const RtabmapColorOcTree * octree = octomap_->octree();
+	if(!octomapSpaceValid_)
+	{
+		// Recompute the blocks of the whole octree, the old ones
+		// not in the octree anymore are published as removed
+		octomapSpaceChangedBlocks_.clear();
+		for(std::map<unsigned long long, std::pair<std::vector<unsigned long long>, std::vector<unsigned long long> > >::const_iterator iter=octomapSpaceBlocks_.begin();
+			iter!=octomapSpaceBlocks_.end();
+			++iter)
+		{
+			octomapSpaceChangedBlocks_.insert(iter->first);
+		}
+		unsigned int treeDepth = octree->getTreeDepth();
+		unsigned int blockDepth = treeDepth - kOctomapBlockBits;
+		int blockSpan = 1 << kOctomapBlockBits;
+		for(RtabmapColorOcTree::leaf_iterator iter=octree->begin_leafs(), end=octree->end_leafs(); iter!=end; ++iter)
+		{
+			if(iter.getDepth() >= blockDepth)
+			{
+				octomapSpaceChangedBlocks_.insert(octomapBlockId(iter.getKey()));
+			}
+			else
+			{
+				// pruned node covering many blocks
+				int span = 1 << (treeDepth - iter.getDepth());
+				int blocks = span / blockSpan;
+				const octomap::OcTreeKey & key = iter.getKey();
+				for(int x=0; x<blocks; ++x)
+				{
+					for(int y=0; y<blocks; ++y)
+					{
+						for(int z=0; z<blocks; ++z)
+						{
+							octomapSpaceChangedBlocks_.insert(octomapBlockId(octomap::OcTreeKey(
+									key[0] - span/2 + x*blockSpan,
+									key[1] - span/2 + y*blockSpan,
+									key[2] - span/2 + z*blockSpan)));
+						}
+					}
+				}
+			}
+		}
+		octomapSpaceValid_ = true;
+	}
+
+	int updatedBlocks = (int)octomapSpaceChangedBlocks_.size();
+	std::vector<unsigned long long> noCells;
+	for(std::set<unsigned long long>::iterator iter=octomapSpaceChangedBlocks_.begin(); iter!=octomapSpaceChangedBlocks_.end(); ++iter)
+	{
+		std::vector<unsigned long long> empty;
+		std::vector<unsigned long long> frontier;
+		computeOctomapBlock(octree, *iter, empty, frontier);
+		std::map<unsigned long long, std::pair<std::vector<unsigned long long>, std::vector<unsigned long long> > >::iterator jter = octomapSpaceBlocks_.find(*iter);
+		accumulateOctomapDelta(jter!=octomapSpaceBlocks_.end()?jter->second.first:noCells, empty, octomapEmptyAdded_, octomapEmptyRemoved_);
+		accumulateOctomapDelta(jter!=octomapSpaceBlocks_.end()?jter->second.second:noCells, frontier, octomapFrontierAdded_, octomapFrontierRemoved_);
+		if(empty.empty())
+		{
+			if(jter != octomapSpaceBlocks_.end())
+			{
+				octomapSpaceBlocks_.erase(jter);
+			}
+		}
+		else
+		{
+			std::pair<std::vector<unsigned long long>, std::vector<unsigned long long> > & block = octomapSpaceBlocks_[*iter];
+			block.first.swap(empty);
+			block.second.swap(frontier);
+		}
+	}
+	octomapSpaceChangedBlocks_.clear();
+	ROS_DEBUG("Octomap empty/frontier space update time = %fs (%d/%d blocks updated)",
+			time.ticks(), updatedBlocks, (int)octomapSpaceBlocks_.size());
+#endif
+}
+
+void MapsManager::resetOctomapSpace(bool notifyRemoved)
+{
+	octomapSpaceValid_ = false;
+	octomapSpaceChangedBlocks_.clear();
+	if(!notifyRemoved)
+	{
+		octomapSpaceBlocks_.clear();
+		octomapEmptyAdded_.clear();
+		octomapEmptyRemoved_.clear();
+		octomapFrontierAdded_.clear();
+		octomapFrontierRemoved_.clear();
+	}
+	// else the cells of the current blocks not in the new
+	// octree will be published as removed on next update
+}
+
+bool MapsManager::getOctomapBinaryMsg(octomap_msgs::Octomap & msg)
+{
+#ifdef RTABMAP_OCTOMAP
+	if(octomap_->octree()->size())
+	{
+		updateOctomapMsgs(true, false);
+		if(!octomapBinaryMsg_.data.empty())
+		{
+			std_msgs::Header header = msg.header;
+			msg = octomapBinaryMsg_;
+			msg.header = header;
+			return true;
+		}
+	}
+#endif
+	return false;
+}
+
+bool MapsManager::getOctomapFullMsg(octomap_msgs::Octomap & msg)
+{
+#ifdef RTABMAP_OCTOMAP
+	if(octomap_->octree()->size())
+	{
+		updateOctomapMsgs(false, true);
+		if(!octomapFullMsg_.data.empty())
+		{
+			std_msgs::Header header = msg.header;
+			msg = octomapFullMsg_;
+			msg.header = header;
+			return true;
+		}
+	}
+#endif
+	return false;
+}
+#endif
+
 }  // namespace rtabmap_ros
 
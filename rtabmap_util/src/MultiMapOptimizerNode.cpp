@@ -0,0 +1,415 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <ros/ros.h>
+#include <ros/callback_queue.h>
+#include "rtabmap_msgs/MapData.h"
+#include "rtabmap_msgs/MapGraph.h"
+#include "rtabmap_msgs/Link.h"
+#include "rtabmap_conversions/MsgConversion.h"
+#include "rtabmap_util/MapsManager.h"
+#include <rtabmap/core/Graph.h>
+#include <rtabmap/core/Optimizer.h>
+#include <rtabmap/core/Parameters.h>
+#include <rtabmap/utilite/ULogger.h>
+#include <rtabmap/utilite/UTimer.h>
+#include <rtabmap/utilite/UStl.h>
+#include <rtabmap/utilite/UConversion.h>
+#include <tf/transform_listener.h>
+#include <boost/thread.hpp>
+
+using namespace rtabmap;
+
+/**
+ * Merge the graphs of multiple robots in a single optimized graph.
+ * Each robot mapData stream has its own callback queue and spinner, so
+ * a slow or large stream doesn't delay the others. Callbacks only
+ * update the robot's cache, the merged graph is optimized at a fixed
+ * rate in its own thread.
+ *
+ * Node ids of robot i are remapped to i*id_offset+id. Robots are placed
+ * in map_frame_id with TF (map_frame_id -> <robot>/map by default) and
+ * are connected by links received on "inter_robot_links", using
+ * remapped ids (e.g., from an external inter-robot loop closure detector).
+ */
+class MultiMapOptimizer
+{
+	struct Robot
+	{
+		Robot() : updated(false) {}
+		std::string ns;
+		std::string mapFrameId;
+		ros::CallbackQueue queue;
+		boost::shared_ptr<ros::AsyncSpinner> spinner;
+		ros::Subscriber sub;
+
+		boost::mutex mutex;
+		bool updated;
+		std::map<int, Transform> poses;       // in robot's map frame, remapped ids
+		std::multimap<int, Link> links;       // remapped ids
+		std::map<int, Signature> newNodes;    // not yet moved to the merged cache
+	};
+
+public:
+	MultiMapOptimizer(int & argc, char** argv) :
+		mapFrameId_("map"),
+		idOffset_(100000),
+		rate_(1.0),
+		interRobotLinksUpdated_(false),
+		running_(true),
+		optimizationThread_(0)
+	{
+		ros::NodeHandle nh;
+		ros::NodeHandle pnh("~");
+
+		std::vector<std::string> robots;
+		int strategy = 0; // 0=TORO, 1=g2o, 2=GTSAM
+		int iterations = 100;
+		bool robust = true;
+		bool slam2d = false;
+		std::string robotMapFrameId = "map";
+		pnh.param("robots", robots, robots);
+		pnh.param("map_frame_id", mapFrameId_, mapFrameId_);
+		pnh.param("robot_map_frame_id", robotMapFrameId, robotMapFrameId);
+		pnh.param("id_offset", idOffset_, idOffset_);
+		pnh.param("rate", rate_, rate_);
+		pnh.param("strategy", strategy, strategy);
+		pnh.param("iterations", iterations, iterations);
+		pnh.param("robust", robust, robust);
+		pnh.param("slam_2d", slam2d, slam2d);
+
+		ROS_INFO("multi_map_optimizer: robots             = %d", (int)robots.size());
+		ROS_INFO("multi_map_optimizer: map_frame_id       = %s", mapFrameId_.c_str());
+		ROS_INFO("multi_map_optimizer: robot_map_frame_id = %s", robotMapFrameId.c_str());
+		ROS_INFO("multi_map_optimizer: id_offset          = %d", idOffset_);
+		ROS_INFO("multi_map_optimizer: rate               = %f Hz", rate_);
+		if(robots.empty())
+		{
+			ROS_ERROR("multi_map_optimizer: \"robots\" parameter should be set with the robot namespaces!");
+		}
+		UASSERT(iterations > 0);
+		UASSERT(idOffset_ > 0);
+
+		ParametersMap parameters;
+		parameters.insert(ParametersPair(Parameters::kOptimizerStrategy(), uNumber2Str(strategy)));
+		parameters.insert(ParametersPair(Parameters::kOptimizerIterations(), uNumber2Str(iterations)));
+		parameters.insert(ParametersPair(Parameters::kOptimizerRobust(), uBool2Str(robust)));
+		parameters.insert(ParametersPair(Parameters::kRegForce3DoF(), uBool2Str(slam2d)));
+		optimizer_ = Optimizer::create(parameters);
+
+		// grid parameters for the merged map
+		ParametersMap gridParameters;
+		uInsert(gridParameters, Parameters::getDefaultParameters("Grid"));
+		uInsert(gridParameters, Parameters::getDefaultParameters("GridGlobal"));
+		for(ParametersMap::iterator iter=gridParameters.begin(); iter!=gridParameters.end(); ++iter)
+		{
+			std::string vStr;
+			bool vBool;
+			int vInt;
+			double vDouble;
+			if(pnh.getParam(iter->first, vStr))
+			{
+				iter->second = vStr;
+			}
+			else if(pnh.getParam(iter->first, vBool))
+			{
+				iter->second = uBool2Str(vBool);
+			}
+			else if(pnh.getParam(iter->first, vDouble))
+			{
+				iter->second = uNumber2Str(vDouble);
+			}
+			else if(pnh.getParam(iter->first, vInt))
+			{
+				iter->second = uNumber2Str(vInt);
+			}
+		}
+		uInsert(gridParameters, Parameters::parseArguments(argc, argv));
+		mapsManager_.init(nh, pnh, ros::this_node::getName(), false);
+		mapsManager_.backwardCompatibilityParameters(pnh, gridParameters);
+		mapsManager_.setParameters(gridParameters);
+
+		robots_.resize(robots.size());
+		for(size_t i=0; i<robots.size(); ++i)
+		{
+			robots_[i].reset(new Robot);
+			Robot & robot = *robots_[i];
+			robot.ns = robots[i];
+			robot.mapFrameId = robot.ns + "/" + robotMapFrameId;
+			ros::NodeHandle robotNh(robot.ns);
+			robotNh.setCallbackQueue(&robot.queue);
+			robot.sub = robotNh.subscribe<rtabmap_msgs::MapData>("mapData", 1,
+					boost::bind(&MultiMapOptimizer::mapDataReceivedCallback, this, boost::placeholders::_1, (int)i));
+			robot.spinner.reset(new ros::AsyncSpinner(1, &robot.queue));
+			robot.spinner->start();
+			ROS_INFO("multi_map_optimizer: robot %d: %s (frame %s, ids %d to %d)",
+					(int)i, robot.sub.getTopic().c_str(), robot.mapFrameId.c_str(), (int)i*idOffset_, (int)(i+1)*idOffset_-1);
+		}
+
+		interRobotLinksSub_ = nh.subscribe("inter_robot_links", 100, &MultiMapOptimizer::interRobotLinkCallback, this);
+		mapGraphPub_ = nh.advertise<rtabmap_msgs::MapGraph>("mapGraph", 1);
+
+		optimizationThread_ = new boost::thread(boost::bind(&MultiMapOptimizer::optimizationLoop, this));
+	}
+
+	~MultiMapOptimizer()
+	{
+		running_ = false;
+		updateCondition_.notify_one();
+		if(optimizationThread_)
+		{
+			optimizationThread_->join();
+			delete optimizationThread_;
+		}
+		for(size_t i=0; i<robots_.size(); ++i)
+		{
+			robots_[i]->spinner->stop();
+		}
+		delete optimizer_;
+	}
+
+	void mapDataReceivedCallback(const rtabmap_msgs::MapDataConstPtr & msg, int robotIndex)
+	{
+		UASSERT(msg->graph.posesId.size() == msg->graph.poses.size());
+		const int offset = robotIndex*idOffset_;
+
+		// conversion done outside the lock
+		std::map<int, Transform> localPoses;
+		std::multimap<int, Link> localLinks;
+		Transform mapToOdom;
+		rtabmap_conversions::mapGraphFromROS(msg->graph, localPoses, localLinks, mapToOdom);
+
+		std::map<int, Transform> poses;
+		for(std::map<int, Transform>::iterator iter=localPoses.begin(); iter!=localPoses.end(); ++iter)
+		{
+			poses.insert(poses.end(), std::make_pair(iter->first+offset, iter->second));
+		}
+		std::multimap<int, Link> links;
+		for(std::multimap<int, Link>::iterator iter=localLinks.begin(); iter!=localLinks.end(); ++iter)
+		{
+			const Link & l = iter->second;
+			links.insert(std::make_pair(l.from()+offset, Link(l.from()+offset, l.to()+offset, l.type(), l.transform(), l.infMatrix())));
+		}
+		std::map<int, Signature> nodes;
+		for(unsigned int i=0; i<msg->nodes.size(); ++i)
+		{
+			Signature s = rtabmap_conversions::nodeDataFromROS(msg->nodes[i]);
+			int id = s.id()+offset;
+			SensorData data = s.sensorData();
+			data.setId(id);
+			nodes.insert(std::make_pair(id, Signature(id, s.mapId(), s.getWeight(), s.getStamp(), s.getLabel(), s.getPose(), s.getGroundTruthPose(), data)));
+		}
+
+		Robot & robot = *robots_[robotIndex];
+		{
+			boost::mutex::scoped_lock lock(robot.mutex);
+			robot.poses.swap(poses);
+			robot.links.swap(links);
+			for(std::map<int, Signature>::iterator iter=nodes.begin(); iter!=nodes.end(); ++iter)
+			{
+				uInsert(robot.newNodes, *iter);
+			}
+			robot.updated = true;
+		}
+		updateCondition_.notify_one();
+	}
+
+	void interRobotLinkCallback(const rtabmap_msgs::LinkConstPtr & msg)
+	{
+		Link link = rtabmap_conversions::linkFromROS(*msg);
+		if(link.from()/idOffset_ == link.to()/idOffset_)
+		{
+			ROS_WARN("multi_map_optimizer: Link %d->%d is not between two different robots, ignored.", link.from(), link.to());
+			return;
+		}
+		{
+			boost::mutex::scoped_lock lock(interRobotLinksMutex_);
+			interRobotLinks_.insert(std::make_pair(link.from(), link));
+			interRobotLinksUpdated_ = true;
+		}
+		updateCondition_.notify_one();
+	}
+
+	void optimizationLoop()
+	{
+		while(running_ && ros::ok())
+		{
+			{
+				boost::mutex::scoped_lock lock(updateMutex_);
+				updateCondition_.timed_wait(lock, boost::posix_time::milliseconds(rate_>0.0?int(1000.0/rate_):100));
+			}
+			if(!running_)
+			{
+				break;
+			}
+
+			// Snapshot the caches, each robot is locked only while copying its graph
+			bool updated = false;
+			std::map<int, Transform> poses;
+			std::multimap<int, Link> links;
+			for(size_t i=0; i<robots_.size(); ++i)
+			{
+				Robot & robot = *robots_[i];
+				Transform worldToMap = getRobotTransform(robot);
+				boost::mutex::scoped_lock lock(robot.mutex);
+				updated = updated || robot.updated;
+				robot.updated = false;
+				for(std::map<int, Transform>::iterator iter=robot.poses.begin(); iter!=robot.poses.end(); ++iter)
+				{
+					poses.insert(poses.end(), std::make_pair(iter->first, worldToMap*iter->second));
+				}
+				links.insert(robot.links.begin(), robot.links.end());
+				for(std::map<int, Signature>::iterator iter=robot.newNodes.begin(); iter!=robot.newNodes.end(); ++iter)
+				{
+					uInsert(nodes_, *iter);
+				}
+				robot.newNodes.clear();
+			}
+			{
+				boost::mutex::scoped_lock lock(interRobotLinksMutex_);
+				updated = updated || interRobotLinksUpdated_;
+				interRobotLinksUpdated_ = false;
+				links.insert(interRobotLinks_.begin(), interRobotLinks_.end());
+			}
+			if(!updated || poses.empty())
+			{
+				continue;
+			}
+
+			UTimer timer;
+			std::map<int, Transform> optimizedPoses = optimize(poses, links);
+			double optimizationTime = timer.ticks();
+
+			ros::Time stamp = ros::Time::now();
+			if(mapGraphPub_.getNumSubscribers())
+			{
+				rtabmap_msgs::MapGraph msg;
+				rtabmap_conversions::mapGraphToROS(optimizedPoses, links, Transform::getIdentity(), msg);
+				msg.header.stamp = stamp;
+				msg.header.frame_id = mapFrameId_;
+				mapGraphPub_.publish(msg);
+			}
+
+			if(mapsManager_.hasSubscribers())
+			{
+				std::map<int, Transform> filteredPoses = mapsManager_.updateMapCaches(optimizedPoses, 0, false, false, nodes_);
+				mapsManager_.publishMaps(filteredPoses, stamp, mapFrameId_);
+			}
+
+			ROS_INFO("multi_map_optimizer: %d robots, %d nodes, %d links, optimization=%fs, maps=%fs",
+					(int)robots_.size(), (int)poses.size(), (int)links.size(), optimizationTime, timer.ticks());
+		}
+	}
+
+private:
+	Transform getRobotTransform(const Robot & robot)
+	{
+		try
+		{
+			tf::StampedTransform tmp;
+			tfListener_.lookupTransform(mapFrameId_, robot.mapFrameId, ros::Time(0), tmp);
+			return rtabmap_conversions::transformFromTF(tmp);
+		}
+		catch(tf::TransformException & ex)
+		{
+			ROS_WARN_THROTTLE(10, "multi_map_optimizer: %s (robot \"%s\" is placed at the origin of %s)",
+					ex.what(), robot.ns.c_str(), mapFrameId_.c_str());
+		}
+		return Transform::getIdentity();
+	}
+
+	// Optimize each connected component independently, with its lowest id
+	// fixed. Robots not connected to others keep their TF placement.
+	std::map<int, Transform> optimize(const std::map<int, Transform> & poses, const std::multimap<int, Link> & links)
+	{
+		std::map<int, Transform> optimizedPoses;
+		for(std::map<int, Transform>::const_iterator iter=poses.begin(); iter!=poses.end(); ++iter)
+		{
+			if(optimizedPoses.find(iter->first) != optimizedPoses.end())
+			{
+				continue;
+			}
+			std::map<int, Transform> posesOut;
+			std::multimap<int, Link> linksOut;
+			optimizer_->getConnectedGraph(iter->first, poses, links, posesOut, linksOut);
+			std::map<int, Transform> component;
+			if(posesOut.size() > 1 && linksOut.size())
+			{
+				component = optimizer_->optimize(iter->first, posesOut, linksOut);
+			}
+			if(component.empty())
+			{
+				if(posesOut.size() > 1)
+				{
+					ROS_WARN("multi_map_optimizer: optimization of graph starting from node %d failed, "
+							"keeping input poses.", iter->first);
+				}
+				component = posesOut;
+				component.insert(*iter);
+			}
+			optimizedPoses.insert(component.begin(), component.end());
+		}
+		return optimizedPoses;
+	}
+
+private:
+	std::string mapFrameId_;
+	int idOffset_;
+	double rate_;
+	Optimizer * optimizer_;
+
+	std::vector<boost::shared_ptr<Robot> > robots_;
+
+	boost::mutex interRobotLinksMutex_;
+	std::multimap<int, Link> interRobotLinks_;
+	bool interRobotLinksUpdated_;
+
+	boost::mutex updateMutex_;
+	boost::condition_variable updateCondition_;
+	bool running_;
+	boost::thread * optimizationThread_;
+
+	// only accessed by optimization thread
+	rtabmap_util::MapsManager mapsManager_;
+	std::map<int, Signature> nodes_;
+
+	tf::TransformListener tfListener_;
+	ros::Subscriber interRobotLinksSub_;
+	ros::Publisher mapGraphPub_;
+};
+
+
+int main(int argc, char** argv)
+{
+	ULogger::setLevel(ULogger::kError);
+	ULogger::setType(ULogger::kTypeConsole);
+
+	ros::init(argc, argv, "multi_map_optimizer");
+	MultiMapOptimizer optimizer(argc, argv);
+	ros::spin();
+	return 0;
+}
@@ -0,0 +1,413 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <ros/ros.h>
+#include <nodelet/loader.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <topic_tools/shape_shifter.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/LaserScan.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/CameraInfo.h>
+#include <nav_msgs/Odometry.h>
+#include <tf2_msgs/TFMessage.h>
+#include <rtabmap/utilite/UStl.h>
+#include <rtabmap/utilite/UConversion.h>
+#include <rtabmap/utilite/UMath.h>
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <map>
+#include <set>
+#include <cstdlib>
+#include <new>
+
+// Allocations made by the whole process (nodelet, roscpp, ...) are
+// counted with replaced global new operators.
+static std::atomic<unsigned long> g_allocations(0);
+static std::atomic<unsigned long> g_allocatedBytes(0);
+
+void * operator new(std::size_t size)
+{
+	++g_allocations;
+	g_allocatedBytes += size;
+	void * p = malloc(size?size:1);
+	if(!p)
+	{
+		throw std::bad_alloc();
+	}
+	return p;
+}
+void * operator new[](std::size_t size) {return operator new(size);}
+void operator delete(void * p) noexcept {free(p);}
+void operator delete[](void * p) noexcept {free(p);}
+void operator delete(void * p, std::size_t) noexcept {free(p);}
+void operator delete[](void * p, std::size_t) noexcept {free(p);}
+
+// Replay a bag through a nodelet loaded in this process and report, for
+// each message of "trigger_topic", the time and the allocations until
+// all "outputs" (sensor_msgs/PointCloud2 with the same stamp) are
+// received. The replay waits for the outputs of a trigger before sending
+// the next one, so the timings don't depend on the bag rate. Publishers
+// and subscribers are in the same process, so the messages are passed
+// by pointer (a master is still required for the registration and the
+// parameters). Examples:
+//   nodelet_benchmark _bag:=clouds.bag _nodelet:=rtabmap_util/obstacles_detection
+//        _trigger_topic:=/cloud _outputs:="ground obstacles" cloud:=/cloud
+//   nodelet_benchmark _bag:=clouds.bag _nodelet:=rtabmap_util/point_cloud_assembler
+//        _trigger_topic:=/cloud _outputs:=assembled_cloud cloud:=/cloud
+//        _benchmarked/circular_buffer:=true _benchmarked/max_clouds:=10
+class NodeletBenchmark
+{
+public:
+	NodeletBenchmark() :
+		nodeletName_("benchmarked"),
+		outputPath_("nodelet_benchmark.json"),
+		outputTimeout_(1.0),
+		warmup_(5),
+		maxTriggers_(0),
+		triggers_(0),
+		timeouts_(0),
+		pending_(false),
+		allocations_(0),
+		allocatedBytes_(0),
+		duration_(0.0)
+	{
+		ros::NodeHandle pnh("~");
+		std::string outputs;
+		pnh.param("bag", bagPath_, bagPath_);
+		pnh.param("nodelet", nodeletType_, nodeletType_);
+		pnh.param("nodelet_name", nodeletName_, nodeletName_);
+		pnh.param("trigger_topic", triggerTopic_, triggerTopic_);
+		pnh.param("outputs", outputs, outputs); // space-separated
+		pnh.param("output", outputPath_, outputPath_);
+		pnh.param("output_timeout", outputTimeout_, outputTimeout_);
+		pnh.param("warmup", warmup_, warmup_);
+		pnh.param("max_triggers", maxTriggers_, maxTriggers_);
+		outputs_ = uListToVector(uSplit(outputs, ' '));
+		outputs_.erase(std::remove(outputs_.begin(), outputs_.end(), std::string()), outputs_.end());
+
+		ROS_INFO("nodelet_benchmark: bag            = %s", bagPath_.c_str());
+		ROS_INFO("nodelet_benchmark: nodelet        = %s (%s)", nodeletType_.c_str(), nodeletName_.c_str());
+		ROS_INFO("nodelet_benchmark: trigger_topic  = %s", triggerTopic_.c_str());
+		ROS_INFO("nodelet_benchmark: outputs        = %s", outputs.c_str());
+		ROS_INFO("nodelet_benchmark: output         = %s", outputPath_.c_str());
+		ROS_INFO("nodelet_benchmark: output_timeout = %f s", outputTimeout_);
+		ROS_INFO("nodelet_benchmark: warmup         = %d", warmup_);
+		ROS_INFO("nodelet_benchmark: max_triggers   = %d", maxTriggers_);
+	}
+
+	bool run()
+	{
+		if(bagPath_.empty() || nodeletType_.empty() || triggerTopic_.empty() || outputs_.empty())
+		{
+			ROS_ERROR("nodelet_benchmark: \"bag\", \"nodelet\", \"trigger_topic\" and \"outputs\" parameters are required.");
+			return false;
+		}
+
+		rosbag::Bag bag;
+		try
+		{
+			bag.open(bagPath_, rosbag::bagmode::Read);
+		}
+		catch(const rosbag::BagException & e)
+		{
+			ROS_ERROR("nodelet_benchmark: cannot open \"%s\": %s", bagPath_.c_str(), e.what());
+			return false;
+		}
+		rosbag::View view(bag);
+
+		ros::NodeHandle nh;
+		for(size_t i=0; i<outputs_.size(); ++i)
+		{
+			outputSubs_.push_back(nh.subscribe<sensor_msgs::PointCloud2>(outputs_[i], 1,
+					boost::bind(&NodeletBenchmark::outputCallback, this, boost::placeholders::_1, outputs_[i])));
+		}
+
+		nodelet::Loader loader(false);
+		nodelet::M_string remappings;
+		nodelet::V_string argv;
+		if(!loader.load(nodeletName_, nodeletType_, remappings, argv))
+		{
+			ROS_ERROR("nodelet_benchmark: cannot load nodelet \"%s\".", nodeletType_.c_str());
+			return false;
+		}
+
+		// Advertise all topics of the bag before the replay
+		std::vector<const rosbag::ConnectionInfo *> connections = view.getConnections();
+		for(size_t i=0; i<connections.size(); ++i)
+		{
+			const rosbag::ConnectionInfo * c = connections[i];
+			if(publishers_.find(c->topic) == publishers_.end())
+			{
+				bool latch = c->header.get() && c->header->find("latching") != c->header->end() && c->header->at("latching") == "1";
+				publishers_.insert(std::make_pair(c->topic, advertise(nh, c->topic, c->datatype, c->md5sum, c->msg_def, latch)));
+			}
+		}
+		if(publishers_.find(triggerTopic_) == publishers_.end())
+		{
+			ROS_ERROR("nodelet_benchmark: topic \"%s\" not found in the bag.", triggerTopic_.c_str());
+			return false;
+		}
+		ros::WallTime start = ros::WallTime::now();
+		while(publishers_.at(triggerTopic_).getNumSubscribers() == 0 && (ros::WallTime::now()-start).toSec() < 5.0)
+		{
+			ros::WallDuration(0.01).sleep();
+		}
+		if(publishers_.at(triggerTopic_).getNumSubscribers() == 0)
+		{
+			ROS_WARN("nodelet_benchmark: nothing subscribed to \"%s\", is the nodelet input remapped?", triggerTopic_.c_str());
+		}
+
+		ros::AsyncSpinner spinner(1);
+		spinner.start();
+
+		start = ros::WallTime::now();
+		for(rosbag::View::iterator iter=view.begin(); iter!=view.end() && ros::ok(); ++iter)
+		{
+			if(iter->getTopic() == triggerTopic_)
+			{
+				waitOutputs();
+				if(maxTriggers_ > 0 && triggers_ >= maxTriggers_+warmup_)
+				{
+					break;
+				}
+			}
+			publish(*iter, iter->getTopic() == triggerTopic_);
+		}
+		waitOutputs();
+		duration_ = (ros::WallTime::now() - start).toSec();
+		spinner.stop();
+		loader.unload(nodeletName_);
+		bag.close();
+		return true;
+	}
+
+	void write()
+	{
+		FILE * file = fopen(outputPath_.c_str(), "w");
+		if(!file)
+		{
+			ROS_ERROR("nodelet_benchmark: cannot write \"%s\"", outputPath_.c_str());
+			return;
+		}
+		fprintf(file, "{\n");
+		fprintf(file, "  \"nodelet\": \"%s\",\n", nodeletType_.c_str());
+		fprintf(file, "  \"bag\": \"%s\",\n", bagPath_.c_str());
+		fprintf(file, "  \"triggers\": %d,\n", triggers_);
+		fprintf(file, "  \"warmup\": %d,\n", warmup_);
+		fprintf(file, "  \"timeouts\": %d,\n", timeouts_);
+		fprintf(file, "  \"wall_duration_s\": %f,\n", duration_);
+		fprintf(file, "  \"time_ms\": %s,\n", statsToJson(timesMs_).c_str());
+		fprintf(file, "  \"allocations\": %s,\n", statsToJson(allocationsPerCall_).c_str());
+		fprintf(file, "  \"allocated_kb\": %s\n", statsToJson(allocatedKbPerCall_).c_str());
+		fprintf(file, "}\n");
+		fclose(file);
+		ROS_INFO("nodelet_benchmark: %d triggers (%d timeouts), mean=%fms, report written to \"%s\"",
+				triggers_, timeouts_, timesMs_.empty()?0.0:uMean(timesMs_), outputPath_.c_str());
+	}
+
+private:
+	template<class T>
+	ros::Publisher advertiseTyped(ros::NodeHandle & nh, const std::string & topic, bool latch)
+	{
+		return nh.advertise<T>(topic, 10, latch);
+	}
+
+	ros::Publisher advertise(ros::NodeHandle & nh, const std::string & topic, const std::string & datatype, const std::string & md5, const std::string & definition, bool latch)
+	{
+		// Common types are published typed, so they are passed by pointer to the nodelet
+		if(datatype == "sensor_msgs/PointCloud2") return advertiseTyped<sensor_msgs::PointCloud2>(nh, topic, latch);
+		if(datatype == "sensor_msgs/LaserScan") return advertiseTyped<sensor_msgs::LaserScan>(nh, topic, latch);
+		if(datatype == "sensor_msgs/Image") return advertiseTyped<sensor_msgs::Image>(nh, topic, latch);
+		if(datatype == "sensor_msgs/CameraInfo") return advertiseTyped<sensor_msgs::CameraInfo>(nh, topic, latch);
+		if(datatype == "nav_msgs/Odometry") return advertiseTyped<nav_msgs::Odometry>(nh, topic, latch);
+		if(datatype == "tf2_msgs/TFMessage") return advertiseTyped<tf2_msgs::TFMessage>(nh, topic, latch);
+		ros::AdvertiseOptions opts(topic, 10, md5, datatype, definition);
+		opts.latch = latch;
+		return nh.advertise(opts);
+	}
+
+	template<class T>
+	bool publishTyped(const rosbag::MessageInstance & m, bool trigger)
+	{
+		boost::shared_ptr<T> msg = m.instantiate<T>();
+		if(msg.get())
+		{
+			if(trigger)
+			{
+				startTrigger(msg->header.stamp);
+			}
+			publishers_.at(m.getTopic()).publish(msg);
+			return true;
+		}
+		return false;
+	}
+
+	void startTrigger(const ros::Time & stamp)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		pending_ = true;
+		received_.clear();
+		triggerStamp_ = stamp;
+		++triggers_;
+		allocations_ = g_allocations;
+		allocatedBytes_ = g_allocatedBytes;
+		startTime_ = ros::WallTime::now();
+	}
+
+	void publish(const rosbag::MessageInstance & m, bool trigger)
+	{
+		bool published =
+				publishTyped<sensor_msgs::PointCloud2>(m, trigger) ||
+				publishTyped<sensor_msgs::LaserScan>(m, trigger) ||
+				publishTyped<sensor_msgs::Image>(m, trigger) ||
+				publishTyped<sensor_msgs::CameraInfo>(m, trigger) ||
+				publishTyped<nav_msgs::Odometry>(m, trigger);
+		if(!published)
+		{
+			boost::shared_ptr<tf2_msgs::TFMessage> tf = m.instantiate<tf2_msgs::TFMessage>();
+			if(trigger)
+			{
+				ROS_ERROR("nodelet_benchmark: type \"%s\" of the trigger topic is not supported.", m.getDataType().c_str());
+				ros::shutdown();
+			}
+			else if(tf.get())
+			{
+				publishers_.at(m.getTopic()).publish(tf);
+			}
+			else
+			{
+				publishers_.at(m.getTopic()).publish(m.instantiate<topic_tools::ShapeShifter>());
+			}
+		}
+	}
+
+	void outputCallback(const sensor_msgs::PointCloud2ConstPtr & msg, const std::string & topic)
+	{
+		ros::WallTime now = ros::WallTime::now();
+		unsigned long allocations = g_allocations;
+		unsigned long allocatedBytes = g_allocatedBytes;
+		boost::mutex::scoped_lock lock(mutex_);
+		// late outputs of a previous trigger are ignored
+		if(!pending_ || msg->header.stamp != triggerStamp_)
+		{
+			return;
+		}
+		received_.insert(topic);
+		if(received_.size() == outputs_.size())
+		{
+			pending_ = false;
+			if(triggers_ > warmup_)
+			{
+				timesMs_.push_back((now - startTime_).toSec()*1000.0);
+				allocationsPerCall_.push_back(double(allocations - allocations_));
+				allocatedKbPerCall_.push_back(double(allocatedBytes - allocatedBytes_)/1024.0);
+			}
+			condition_.notify_all();
+		}
+	}
+
+	void waitOutputs()
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		if(pending_ && !condition_.timed_wait(lock, boost::posix_time::milliseconds(int(outputTimeout_*1000.0)), boost::bind(&NodeletBenchmark::isDone, this)))
+		{
+			ROS_WARN("nodelet_benchmark: no outputs after %f s for trigger %d (stamp=%f)", outputTimeout_, triggers_, triggerStamp_.toSec());
+			pending_ = false;
+			++timeouts_;
+		}
+	}
+
+	bool isDone() const {return !pending_;}
+
+	static std::string statsToJson(std::vector<double> values)
+	{
+		if(values.empty())
+		{
+			return "{\"count\": 0}";
+		}
+		std::sort(values.begin(), values.end());
+		return uFormat("{\"count\": %d, \"mean\": %g, \"min\": %g, \"p50\": %g, \"p90\": %g, \"p99\": %g, \"max\": %g}",
+				(int)values.size(),
+				uMean(values),
+				values.front(),
+				percentile(values, 0.5),
+				percentile(values, 0.9),
+				percentile(values, 0.99),
+				values.back());
+	}
+
+	static double percentile(const std::vector<double> & sorted, double p)
+	{
+		size_t index = std::min(sorted.size()-1, size_t(p*double(sorted.size()-1) + 0.5));
+		return sorted[index];
+	}
+
+private:
+	std::string bagPath_;
+	std::string nodeletType_;
+	std::string nodeletName_;
+	std::string triggerTopic_;
+	std::vector<std::string> outputs_;
+	std::string outputPath_;
+	double outputTimeout_;
+	int warmup_;
+	int maxTriggers_;
+
+	std::map<std::string, ros::Publisher> publishers_;
+	std::vector<ros::Subscriber> outputSubs_;
+
+	boost::mutex mutex_;
+	boost::condition_variable condition_;
+	int triggers_;
+	int timeouts_;
+	bool pending_;
+	std::set<std::string> received_;
+	ros::Time triggerStamp_;
+	ros::WallTime startTime_;
+	unsigned long allocations_;
+	unsigned long allocatedBytes_;
+	double duration_;
+	std::vector<double> timesMs_;
+	std::vector<double> allocationsPerCall_;
+	std::vector<double> allocatedKbPerCall_;
+};
+
+int main(int argc, char** argv)
+{
+	ros::init(argc, argv, "nodelet_benchmark");
+	NodeletBenchmark benchmark;
+	if(!benchmark.run())
+	{
+		return 1;
+	}
+	benchmark.write();
+	return 0;
+}
@@ -27,7 +27,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <ros/ros.h>
 #include <nav_msgs/Odometry.h>
-#include <tf2_ros/transform_broadcaster.h>
+#include <tf2_msgs/TFMessage.h>
 #include <rtabmap_conversions/MsgConversion.h>
 
 class OdomMsgToTF
@@ -36,13 +36,30 @@ class OdomMsgToTF
 public:
 	OdomMsgToTF() :
 		frameId_(""),
-		odomFrameId_("")
+		odomFrameId_(""),
+		decimation_(1),
+		batchSize_(1),
+		count_(0)
 	{
 		ros::NodeHandle pnh("~");
 		pnh.param("frame_id", frameId_, frameId_);
 		pnh.param("odom_frame_id", odomFrameId_, odomFrameId_);
+		pnh.param("decimation", decimation_, decimation_);
+		pnh.param("tf_batch_size", batchSize_, batchSize_);
+		if(decimation_ < 1)
+		{
+			decimation_ = 1;
+		}
+		if(batchSize_ < 1)
+		{
+			batchSize_ = 1;
+		}
 
 		ros::NodeHandle nh;
+		// Transforms are accumulated in the same message that is re-used
+		// between publications, then published together on /tf.
+		tfMsg_.transforms.reserve(batchSize_);
+		tfPub_ = nh.advertise<tf2_msgs::TFMessage>("/tf", 100);
 		odomTopic_ = nh.subscribe("odom", 1, &OdomMsgToTF::odomReceivedCallback, this);
 	}
 
@@ -50,6 +67,10 @@ public:
 
 	void odomReceivedCallback(const nav_msgs::OdometryConstPtr & msg)
 	{
+		if(count_++ % decimation_ != 0)
+		{
+			return;
+		}
 		if(frameId_.empty())
 		{
 			frameId_ = msg->child_frame_id;
@@ -58,7 +79,6 @@ public:
 		{
 			odomFrameId_ = msg->header.frame_id;
 		}
-		geometry_msgs::TransformStamped t;
 		rtabmap::Transform pose = rtabmap_conversions::transformFromPoseMsg(msg->pose.pose);
 		if(pose.isNull())
 		{
@@ -66,11 +86,17 @@ public:
 		}
 		else
 		{
+			tfMsg_.transforms.resize(tfMsg_.transforms.size()+1);
+			geometry_msgs::TransformStamped & t = tfMsg_.transforms.back();
 			t.child_frame_id = frameId_;
 			t.header.frame_id = odomFrameId_;
 			t.header.stamp = msg->header.stamp;
 			rtabmap_conversions::transformToGeometryMsg(pose, t.transform);
-			tfBroadcaster_.sendTransform(t);
+			if((int)tfMsg_.transforms.size() >= batchSize_)
+			{
+				tfPub_.publish(tfMsg_);
+				tfMsg_.transforms.clear();
+			}
 		}
 	}
 
@@ -78,8 +104,13 @@ private:
 	std::string frameId_;
 	std::string odomFrameId_;
 
+	int decimation_;
+	int batchSize_;
+	unsigned int count_;
+
 	ros::Subscriber odomTopic_;
-	tf2_ros::TransformBroadcaster tfBroadcaster_;
+	ros::Publisher tfPub_;
+	tf2_msgs::TFMessage tfMsg_;
 };
 
 
@@ -43,7 +43,12 @@ namespace rtabmap_util
 class DisparityToDepth : public nodelet::Nodelet
 {
 public:
-	DisparityToDepth() {}
+	DisparityToDepth() :
+		useLut_(true),
+		lutT_(0.0f),
+		lutF_(0.0f),
+		lutDelta_(0.0f)
+	{}
 
 	virtual ~DisparityToDepth(){}
 
@@ -53,6 +58,9 @@ private:
 		ros::NodeHandle & nh = getNodeHandle();
 		ros::NodeHandle & pnh = getPrivateNodeHandle();
 
+		pnh.param("use_lut", useLut_, useLut_);
+		NODELET_INFO("disparity_to_depth: use_lut=%s", useLut_?"true":"false");
+
 		image_transport::ImageTransport it(nh);
 		pub32f_ = it.advertise("depth", 1);
 		pub16u_ = it.advertise("depth_raw", 1);
@@ -85,22 +93,44 @@ private:
 			{
 				depth16u = cv::Mat::zeros(disparity.rows, disparity.cols, CV_16U);
 			}
+			const float minDisparity = disparityMsg->min_disparity;
+			const float maxDisparity = disparityMsg->max_disparity;
+			const float Tf = disparityMsg->T * disparityMsg->f;
+
+			// Disparities from block matching are multiples of delta_d, use
+			// a lookup table indexed by disparity/delta_d in that case.
+			bool lut = useLut_ && updateLut(disparityMsg->T, disparityMsg->f, disparityMsg->delta_d, maxDisparity);
+			const float invDelta = lut?1.0f/lutDelta_:0.0f;
+			const int lutSize = (int)lutDepth32f_.size();
+
 			for (int i = 0; i < disparity.rows; i++)
 			{
+				const float * in = disparity.ptr<float>(i);
+				float * out32f = publish32f?depth32f.ptr<float>(i):0;
+				unsigned short * out16u = publish16u?depth16u.ptr<unsigned short>(i):0;
 				for (int j = 0; j < disparity.cols; j++)
 				{
-					float disparity_value = disparity.at<float>(i,j);
-					if (disparity_value > disparityMsg->min_disparity && disparity_value < disparityMsg->max_disparity)
+					const float disparity_value = in[j];
+					if (disparity_value > minDisparity && disparity_value < maxDisparity)
 					{
-						// baseline * focal / disparity
-						float depth = disparityMsg->T * disparityMsg->f / disparity_value;
-						if(publish32f)
+						float depth;
+						int k = lut?int(disparity_value*invDelta+0.5f):-1;
+						if(k>0 && k<lutSize && float(k)*lutDelta_ == disparity_value)
+						{
+							depth = lutDepth32f_[k];
+						}
+						else
 						{
-							depth32f.at<float>(i,j) = depth;
+							// baseline * focal / disparity
+							depth = Tf / disparity_value;
 						}
-						if(publish16u)
+						if(out32f)
 						{
-							depth16u.at<unsigned short>(i,j) = (unsigned short)(depth*1000.0f);
+							out32f[j] = depth;
+						}
+						if(out16u)
+						{
+							out16u[j] = (unsigned short)(depth*1000.0f);
 						}
 					}
 				}
@@ -130,10 +160,39 @@ private:
 		}
 }
 
+	// Rebuild the lookup table if the calibration changed
+	bool updateLut(float T, float f, float delta, float maxDisparity)
+	{
+		if(delta <= 0.0f || maxDisparity/delta > 65536.0f)
+		{
+			return false;
+		}
+		int size = int(maxDisparity/delta)+1;
+		if(T != lutT_ || f != lutF_ || delta != lutDelta_ || size != (int)lutDepth32f_.size())
+		{
+			lutT_ = T;
+			lutF_ = f;
+			lutDelta_ = delta;
+			lutDepth32f_.resize(size);
+			lutDepth32f_[0] = 0.0f;
+			for(int k=1; k<size; ++k)
+			{
+				lutDepth32f_[k] = T * f / (float(k)*delta);
+			}
+		}
+		return true;
+	}
+
 private:
 	image_transport::Publisher pub32f_;
 	image_transport::Publisher pub16u_;
 	ros::Subscriber sub_;
+
+	bool useLut_;
+	float lutT_;
+	float lutF_;
+	float lutDelta_;
+	std::vector<float> lutDepth32f_;
 };
 
 PLUGINLIB_EXPORT_CLASS(rtabmap_util::DisparityToDepth, nodelet::Nodelet);
@@ -29,9 +29,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <pluginlib/class_list_macros.hpp>
 #include <nodelet/nodelet.h>
 #include <sensor_msgs/Imu.h>
-#include <tf/transform_broadcaster.h>
 #include <tf/LinearMath/Matrix3x3.h>
 #include <tf/transform_listener.h>
+#include <tf2_msgs/TFMessage.h>
 
 namespace rtabmap_util
 {
@@ -41,7 +41,12 @@ class ImuToTF : public nodelet::Nodelet
 public:
 	ImuToTF() :
 		fixedFrameId_("odom"),
-		waitForTransformDuration_(0.1)
+		waitForTransformDuration_(0.1),
+		decimation_(1),
+		batchSize_(1),
+		staticBaseTransform_(false),
+		baseTransformCached_(false),
+		count_(0)
 	{}
 
 	virtual ~ImuToTF()
@@ -57,14 +62,38 @@ private:
 		pnh.param("fixed_frame_id", fixedFrameId_, fixedFrameId_);
 		pnh.param("base_frame_id", baseFrameId_, baseFrameId_);
 		pnh.param("wait_for_transform_duration", waitForTransformDuration_, waitForTransformDuration_);
+		pnh.param("decimation", decimation_, decimation_);
+		pnh.param("tf_batch_size", batchSize_, batchSize_);
+		pnh.param("static_base_transform", staticBaseTransform_, staticBaseTransform_);
+		if(decimation_ < 1)
+		{
+			decimation_ = 1;
+		}
+		if(batchSize_ < 1)
+		{
+			batchSize_ = 1;
+		}
 		NODELET_INFO("fixed_frame_id: %s", fixedFrameId_.c_str());
 		NODELET_INFO("base_frame_id: %s", baseFrameId_.c_str());
+		NODELET_INFO("decimation: %d", decimation_);
+		NODELET_INFO("tf_batch_size: %d", batchSize_);
+		NODELET_INFO("static_base_transform: %s", staticBaseTransform_?"true":"false");
+
+		// Transforms are accumulated in the same message that is re-used
+		// between publications, then published together on /tf.
+		tfMsg_.transforms.reserve(batchSize_);
+		tfPub_ = nh.advertise<tf2_msgs::TFMessage>("/tf", 100);
 
 		sub_ = nh.subscribe<sensor_msgs::Imu>("imu/data", 1, &ImuToTF::imuCallback, this);
 	}
 
 	void imuCallback(const sensor_msgs::ImuConstPtr & msg)
 	{
+		if(count_++ % decimation_ != 0)
+		{
+			return;
+		}
+
 		tf::Quaternion q;
 		tf::quaternionMsgToTF(msg->orientation, q);
 		tf::StampedTransform st;
@@ -76,27 +105,30 @@ private:
 		if(!baseFrameId_.empty() &&
 			baseFrameId_.compare(msg->header.frame_id) != 0)
 		{
-			try
+			if(!staticBaseTransform_ || !baseTransformCached_)
 			{
-				std::string errorMsg;
-				if(!tfListener_.waitForTransform(baseFrameId_, msg->header.frame_id, msg->header.stamp, ros::Duration(waitForTransformDuration_), ros::Duration(0.01), &errorMsg))
+				try
 				{
-					NODELET_ERROR("Could not get transform from %s to %s after %f seconds (for stamp=%f)! Error=\"%s\".",
-							baseFrameId_.c_str(), msg->header.frame_id.c_str(), 0.1, msg->header.stamp.toSec(), errorMsg.c_str());
+					std::string errorMsg;
+					if(!tfListener_.waitForTransform(baseFrameId_, msg->header.frame_id, msg->header.stamp, ros::Duration(waitForTransformDuration_), ros::Duration(0.01), &errorMsg))
+					{
+						NODELET_ERROR("Could not get transform from %s to %s after %f seconds (for stamp=%f)! Error=\"%s\".",
+								baseFrameId_.c_str(), msg->header.frame_id.c_str(), 0.1, msg->header.stamp.toSec(), errorMsg.c_str());
+						return;
+					}
+
+					tfListener_.lookupTransform(msg->header.frame_id, baseFrameId_, msg->header.stamp, baseToImu_);
+					baseTransformCached_ = true;
+				}
+				catch(tf::TransformException & ex)
+				{
+					NODELET_ERROR("(getting transform %s -> %s) %s", baseFrameId_.c_str(), msg->header.frame_id.c_str(), ex.what());
 					return;
 				}
-
-				tf::StampedTransform tmp;
-				tfListener_.lookupTransform(msg->header.frame_id, baseFrameId_, msg->header.stamp, tmp);
-				tf::Transform t = tmp.inverse()*st*tmp;
-				st.setRotation(t.getRotation());
-				st.child_frame_id_ = baseFrameId_;
-			}
-			catch(tf::TransformException & ex)
-			{
-				NODELET_ERROR("(getting transform %s -> %s) %s", baseFrameId_.c_str(), msg->header.frame_id.c_str(), ex.what());
-				return;
 			}
+			tf::Transform t = baseToImu_.inverse()*st*baseToImu_;
+			st.setRotation(t.getRotation());
+			st.child_frame_id_ = baseFrameId_;
 		}
 		else
 		{
@@ -104,16 +136,29 @@ private:
 		}
 		st.setOrigin(tf::Vector3(0,0,0));
 
-		pub_.sendTransform(st);
+		tfMsg_.transforms.resize(tfMsg_.transforms.size()+1);
+		tf::transformStampedTFToMsg(st, tfMsg_.transforms.back());
+		if((int)tfMsg_.transforms.size() >= batchSize_)
+		{
+			tfPub_.publish(tfMsg_);
+			tfMsg_.transforms.clear();
+		}
 	}
 
 private:
 	ros::Subscriber sub_;
-	tf::TransformBroadcaster pub_;
+	ros::Publisher tfPub_;
+	tf2_msgs::TFMessage tfMsg_;
 	std::string fixedFrameId_;
 	std::string baseFrameId_;
 	tf::TransformListener tfListener_;
 	double waitForTransformDuration_;
+	int decimation_;
+	int batchSize_;
+	bool staticBaseTransform_;
+	bool baseTransformCached_;
+	tf::StampedTransform baseToImu_;
+	unsigned int count_;
 };
 
 
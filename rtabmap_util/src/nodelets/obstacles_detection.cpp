@@ -33,6 +33,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <pcl/point_types.h>
 #include <pcl_conversions/pcl_conversions.h>
 #include <pcl/filters/filter.h>
+#include <pcl/common/centroid.h>
+#include <pcl/common/eigen.h>
 
 #include <tf/transform_listener.h>
 
@@ -41,6 +43,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap_conversions/MsgConversion.h>
 
 #include "rtabmap/core/OccupancyGrid.h"
+#include "rtabmap/core/util3d_filtering.h"
+#include "rtabmap/core/util3d_transforms.h"
 #include "rtabmap/utilite/UStl.h"
 
 namespace rtabmap_util
@@ -53,12 +57,23 @@ public:
 		frameId_("base_link"),
 		waitForTransform_(false),
 		mapFrameProjection_(rtabmap::Parameters::defaultGridMapFrameProjection()),
-		warned_(false)
+		cellSize_(rtabmap::Parameters::defaultGridCellSize()),
+		maxObstacleHeight_(rtabmap::Parameters::defaultGridMaxObstacleHeight()),
+		maxGroundAngle_(rtabmap::Parameters::defaultGridMaxGroundAngle()*M_PI/180.0),
+		groundReuse_(false),
+		groundReuseDistance_(0.05),
+		groundReuseMaxFrames_(10),
+		groundReuseMinInliersRatio_(0.8),
+		groundFramesReused_(0),
+		groundInliersRatio_(0.0f),
+		groundPlane_(Eigen::Vector4f::Zero())
 	{}
 
 	virtual ~ObstaclesDetection()
 	{}
 
+	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
 private:
 
 	void parameterMoved(
@@ -118,6 +133,17 @@ private:
 		pnh.param("frame_id", frameId_, frameId_);
 		pnh.param("map_frame_id", mapFrameId_, mapFrameId_);
 		pnh.param("wait_for_transform", waitForTransform_, waitForTransform_);
+		pnh.param("ground_reuse", groundReuse_, groundReuse_);
+		pnh.param("ground_reuse_distance", groundReuseDistance_, groundReuseDistance_);
+		pnh.param("ground_reuse_max_frames", groundReuseMaxFrames_, groundReuseMaxFrames_);
+		pnh.param("ground_reuse_min_inliers_ratio", groundReuseMinInliersRatio_, groundReuseMinInliersRatio_);
+		NODELET_INFO("obstacles_detection: ground_reuse=%s (distance=%fm, max_frames=%d, min_inliers_ratio=%f)",
+				groundReuse_?"true":"false", groundReuseDistance_, groundReuseMaxFrames_, groundReuseMinInliersRatio_);
+		if(groundReuse_ && mapFrameId_.empty())
+		{
+			NODELET_WARN("obstacles_detection: ground_reuse is true but map_frame_id is not set, "
+					"the ground plane will be reused in %s frame without motion compensation.", frameId_.c_str());
+		}
 
 		if(pnh.hasParam("optimize_for_close_objects"))
 		{
@@ -227,6 +253,10 @@ private:
 		}
 
 		grid_.parseParameters(parameters);
+		rtabmap::Parameters::parse(parameters, rtabmap::Parameters::kGridCellSize(), cellSize_);
+		rtabmap::Parameters::parse(parameters, rtabmap::Parameters::kGridMaxObstacleHeight(), maxObstacleHeight_);
+		rtabmap::Parameters::parse(parameters, rtabmap::Parameters::kGridMaxGroundAngle(), maxGroundAngle_);
+		maxGroundAngle_ *= M_PI/180.0;
 
 		cloudSub_ = nh.subscribe("cloud", 1, &ObstaclesDetection::callback, this);
 
@@ -295,23 +325,10 @@ private:
 		UASSERT_MSG(cloudMsg->data.size() == cloudMsg->row_step*cloudMsg->height,
 				uFormat("data=%d row_step=%d height=%d", cloudMsg->data.size(), cloudMsg->row_step, cloudMsg->height).c_str());
 
-		pcl::PointCloud<pcl::PointXYZ>::Ptr inputCloud(new pcl::PointCloud<pcl::PointXYZ>);
-		pcl::fromROSMsg(*cloudMsg, *inputCloud);
-		if(inputCloud->isOrganized())
-		{
-			std::vector<int> indices;
-			pcl::removeNaNFromPointCloud(*inputCloud, *inputCloud, indices);
-		}
-		else if(!inputCloud->is_dense && inputCloud->height == 1)
+		pcl::PointCloud<pcl::PointXYZ>::Ptr inputCloud = cloudFromMsg(*cloudMsg, localTransform);
+		if(!inputCloud)
 		{
-			if(!warned_)
-			{
-				NODELET_WARN("Detected possible wrong format of point cloud \"%s\", it is "
-						"indicated that it is not dense, but there is only one row. "
-						"Assuming it is dense... This message will only appear once.", cloudSub_.getTopic().c_str());
-				warned_ = true;
-			}
-			inputCloud->is_dense = true;
+			return;
 		}
 
 		//Common variables for all strategies
@@ -322,17 +339,27 @@ private:
 
 		if(inputCloud->size())
 		{
-			inputCloud = rtabmap::util3d::transformPointCloud(inputCloud, localTransform);
-
 			pcl::IndicesPtr flatObstacles(new std::vector<int>);
-			pcl::PointCloud<pcl::PointXYZ>::Ptr cloud = grid_.segmentCloud<pcl::PointXYZ>(
-					inputCloud,
-					pcl::IndicesPtr(new std::vector<int>),
-					pose,
-					cv::Point3f(localTransform.x(), localTransform.y(), localTransform.z()),
-					ground,
-					obstacles,
-					&flatObstacles);
+			pcl::PointCloud<pcl::PointXYZ>::Ptr cloud;
+			if(groundReuse_ && !groundPlane_.isZero())
+			{
+				cloud = segmentFromPreviousGround(inputCloud, pose, ground, obstacles);
+			}
+			if(!cloud)
+			{
+				cloud = grid_.segmentCloud<pcl::PointXYZ>(
+						inputCloud,
+						pcl::IndicesPtr(new std::vector<int>),
+						pose,
+						cv::Point3f(localTransform.x(), localTransform.y(), localTransform.z()),
+						ground,
+						obstacles,
+						&flatObstacles);
+				if(groundReuse_)
+				{
+					updateGroundModel(cloud, ground, pose);
+				}
+			}
 
 			if(cloud->size() && ((ground.get() && ground->size()) || (obstacles.get() && obstacles->size())))
 			{
@@ -346,10 +373,14 @@ private:
 						obstacles.get() && obstacles->size())
 				{
 					// remove flat obstacles from obstacles
-					std::set<int> flatObstaclesSet;
-					if(projObstaclesPub_.getNumSubscribers())
+					std::vector<bool> flatObstaclesMask;
+					if(projObstaclesPub_.getNumSubscribers() && flatObstacles->size())
 					{
-						flatObstaclesSet.insert(flatObstacles->begin(), flatObstacles->end());
+						flatObstaclesMask.resize(cloud->size(), false);
+						for(unsigned int i=0; i<flatObstacles->size(); ++i)
+						{
+							flatObstaclesMask[flatObstacles->at(i)] = true;
+						}
 					}
 
 					obstaclesCloud->resize(obstacles->size());
@@ -359,8 +390,7 @@ private:
 					for(unsigned int i=0; i<obstacles->size(); ++i)
 					{
 						obstaclesCloud->points[i] = cloud->at(obstacles->at(i));
-						if(flatObstaclesSet.size() == 0 ||
-						   flatObstaclesSet.find(obstacles->at(i))==flatObstaclesSet.end())
+						if(flatObstaclesMask.empty() || !flatObstaclesMask[obstacles->at(i)])
 						{
 							obstaclesCloudWithoutFlatSurfaces->points[oi] = obstaclesCloud->points[i];
 							obstaclesCloudWithoutFlatSurfaces->points[oi].z = 0;
@@ -436,6 +466,170 @@ private:
 		NODELET_DEBUG("Obstacles segmentation time = %f s", (ros::WallTime::now() - time).toSec());
 	}
 
+	// Transform used by OccupancyGrid::segmentCloud() for its output cloud
+	rtabmap::Transform segmentationFrame(const rtabmap::Transform & pose) const
+	{
+		float roll, pitch, yaw;
+		pose.getEulerAngles(roll, pitch, yaw);
+		return rtabmap::Transform(0,0, mapFrameProjection_?pose.z():0, roll, pitch, 0);
+	}
+
+	// ground plane (a,b,c,d) from segmentation frame to fixed frame
+	static Eigen::Vector4f transformPlane(const Eigen::Vector4f & plane, const rtabmap::Transform & t)
+	{
+		// points p' = R*p + T, so n'= R*n and d' = d - n'.T
+		Eigen::Matrix4f m = t.toEigen4f();
+		Eigen::Vector3f n = m.block<3,3>(0,0) * plane.head<3>();
+		return Eigen::Vector4f(n[0], n[1], n[2], plane[3] - n.dot(m.block<3,1>(0,3)));
+	}
+
+	/**
+	 * Fit a plane on the ground of the last full segmentation and keep it
+	 * in fixed frame (map_frame_id) so that it can be reused on the next
+	 * frames after motion compensation.
+	 */
+	void updateGroundModel(
+			const pcl::PointCloud<pcl::PointXYZ>::Ptr & cloud,
+			const pcl::IndicesPtr & ground,
+			const rtabmap::Transform & pose)
+	{
+		groundPlane_.setZero();
+		groundFramesReused_ = 0;
+		if(!cloud->size() || !ground.get() || ground->size() < 3)
+		{
+			return;
+		}
+		EIGEN_ALIGN16 Eigen::Matrix3f covariance;
+		Eigen::Vector4f centroid;
+		if(pcl::computeMeanAndCovarianceMatrix(*cloud, *ground, covariance, centroid) == 0)
+		{
+			return;
+		}
+		EIGEN_ALIGN16 Eigen::Vector3f::Scalar eigenValue;
+		EIGEN_ALIGN16 Eigen::Vector3f normal;
+		pcl::eigen33(covariance, eigenValue, normal);
+		if(normal[2] < 0)
+		{
+			normal = -normal;
+		}
+		if(std::acos(std::min(1.0f, normal[2])) > maxGroundAngle_)
+		{
+			// not really a plane (e.g., stairs, ramps), don't reuse it
+			return;
+		}
+		Eigen::Vector4f plane(normal[0], normal[1], normal[2], -normal.dot(centroid.head<3>()));
+		groundPlane_ = transformPlane(plane, pose*segmentationFrame(pose).inverse());
+		groundInliersRatio_ = float(ground->size())/float(cloud->size());
+	}
+
+	/**
+	 * Segment the cloud with the ground plane of a previous frame. Returns
+	 * a null cloud if the plane doesn't fit anymore, so that the full
+	 * segmentation is done.
+	 */
+	pcl::PointCloud<pcl::PointXYZ>::Ptr segmentFromPreviousGround(
+			const pcl::PointCloud<pcl::PointXYZ>::Ptr & inputCloud,
+			const rtabmap::Transform & pose,
+			pcl::IndicesPtr & ground,
+			pcl::IndicesPtr & obstacles)
+	{
+		if(groundFramesReused_ >= groundReuseMaxFrames_)
+		{
+			return pcl::PointCloud<pcl::PointXYZ>::Ptr();
+		}
+
+		rtabmap::Transform t = segmentationFrame(pose);
+		pcl::PointCloud<pcl::PointXYZ>::Ptr cloud = rtabmap::util3d::transformPointCloud(
+				cellSize_>0.0f?rtabmap::util3d::voxelize(inputCloud, cellSize_):inputCloud, t);
+		Eigen::Vector4f plane = transformPlane(groundPlane_, (pose*t.inverse()).inverse());
+
+		ground.reset(new std::vector<int>);
+		obstacles.reset(new std::vector<int>);
+		ground->reserve(cloud->size());
+		obstacles->reserve(cloud->size());
+		for(unsigned int i=0; i<cloud->size(); ++i)
+		{
+			const pcl::PointXYZ & pt = cloud->at(i);
+			float d = plane[0]*pt.x + plane[1]*pt.y + plane[2]*pt.z + plane[3];
+			if(std::fabs(d) <= groundReuseDistance_)
+			{
+				ground->push_back(i);
+			}
+			else if(d > 0.0f && (maxObstacleHeight_ <= 0.0f || pt.z < maxObstacleHeight_))
+			{
+				obstacles->push_back(i);
+			}
+		}
+
+		if(cloud->empty() || float(ground->size())/float(cloud->size()) < groundInliersRatio_*groundReuseMinInliersRatio_)
+		{
+			NODELET_DEBUG("obstacles_detection: previous ground doesn't fit anymore (%d/%d inliers), doing full segmentation.",
+					(int)ground->size(), (int)cloud->size());
+			ground.reset();
+			obstacles.reset();
+			return pcl::PointCloud<pcl::PointXYZ>::Ptr();
+		}
+		++groundFramesReused_;
+		return cloud;
+	}
+
+	/**
+	 * Convert the cloud in frame_id (transformed by localTransform) in a
+	 * single pass over the message buffer, invalid points are removed.
+	 */
+	pcl::PointCloud<pcl::PointXYZ>::Ptr cloudFromMsg(const sensor_msgs::PointCloud2 & cloudMsg, const rtabmap::Transform & localTransform)
+	{
+		int offsets[3] = {-1, -1, -1};
+		const char * names[3] = {"x", "y", "z"};
+		for(size_t i=0; i<cloudMsg.fields.size(); ++i)
+		{
+			for(int k=0; k<3; ++k)
+			{
+				if(cloudMsg.fields[i].name.compare(names[k]) == 0 && cloudMsg.fields[i].datatype == sensor_msgs::PointField::FLOAT32)
+				{
+					offsets[k] = cloudMsg.fields[i].offset;
+				}
+			}
+		}
+		if(offsets[0] < 0 || offsets[1] < 0 || offsets[2] < 0)
+		{
+			NODELET_ERROR("obstacles_detection: Input cloud \"%s\" should have float x, y and z fields!", cloudSub_.getTopic().c_str());
+			return pcl::PointCloud<pcl::PointXYZ>::Ptr();
+		}
+
+		const Eigen::Matrix4f m = localTransform.toEigen4f();
+		const bool identity = localTransform.isIdentity();
+		const size_t total = size_t(cloudMsg.width) * size_t(cloudMsg.height);
+		pcl::PointCloud<pcl::PointXYZ>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZ>);
+		cloud->resize(total);
+		size_t n = 0;
+		for(size_t i=0; i<total; ++i)
+		{
+			const unsigned char * in = cloudMsg.data.data() + i*cloudMsg.point_step;
+			const float x = *((const float*)(in+offsets[0]));
+			const float y = *((const float*)(in+offsets[1]));
+			const float z = *((const float*)(in+offsets[2]));
+			if(!std::isfinite(x) || !std::isfinite(y) || !std::isfinite(z))
+			{
+				continue;
+			}
+			pcl::PointXYZ & pt = cloud->at(n++);
+			if(identity)
+			{
+				pt.x = x; pt.y = y; pt.z = z;
+			}
+			else
+			{
+				pt.x = m(0,0)*x + m(0,1)*y + m(0,2)*z + m(0,3);
+				pt.y = m(1,0)*x + m(1,1)*y + m(1,2)*z + m(1,3);
+				pt.z = m(2,0)*x + m(2,1)*y + m(2,2)*z + m(2,3);
+			}
+		}
+		cloud->resize(n);
+		cloud->is_dense = true;
+		return cloud;
+	}
+
 private:
 	std::string frameId_;
 	std::string mapFrameId_;
@@ -443,7 +637,18 @@ private:
 
 	rtabmap::OccupancyGrid grid_;
 	bool mapFrameProjection_;
-	bool warned_;
+	float cellSize_;
+	float maxObstacleHeight_;
+	float maxGroundAngle_;
+
+	// ground_reuse
+	bool groundReuse_;
+	double groundReuseDistance_;
+	int groundReuseMaxFrames_;
+	double groundReuseMinInliersRatio_;
+	int groundFramesReused_;
+	float groundInliersRatio_;
+	Eigen::Vector4f groundPlane_; // in map_frame_id
 
 	tf::TransformListener tfListener_;
 
@@ -51,6 +51,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/utilite/UConversion.h>
 #include <rtabmap/core/util3d_filtering.h>
 
+#include <boost/thread.hpp>
+#include <cmath>
+
 namespace rtabmap_util
 {
 
@@ -231,183 +234,225 @@ private:
 		ROS_ASSERT(cloudMsgs.size() > 1);
 		if(cloudPub_.getNumSubscribers())
 		{
-			pcl::PCLPointCloud2::Ptr output(new pcl::PCLPointCloud2);
-
 			std::string frameId = frameId_;
-			if(!frameId.empty() && frameId.compare(cloudMsgs[0]->header.frame_id) != 0)
-			{
-				sensor_msgs::PointCloud2 tmp;
-				pcl_ros::transformPointCloud(frameId, *cloudMsgs[0], tmp, tfListener_);
-				pcl_conversions::toPCL(tmp, *output);
-			}
-			else
+			if(frameId.empty())
 			{
-				pcl_conversions::toPCL(*cloudMsgs[0], *output);
 				frameId = cloudMsgs[0]->header.frame_id;
 			}
 
-			if(xyzOutput_ && !output->data.empty())
+			// Output layout: XYZ or same fields than the first cloud
+			sensor_msgs::PointCloud2 rosCloud;
+			if(xyzOutput_)
 			{
-				// convert only if not already XYZ cloud
-				bool hasField[4] = {false};
-				for(size_t i=0; i<output->fields.size(); ++i)
-				{
-					if(output->fields[i].name.compare("x") == 0)
-					{
-						hasField[0] = true;
-					}
-					else if(output->fields[i].name.compare("y") == 0)
-					{
-						hasField[1] = true;
-					}
-					else if(output->fields[i].name.compare("z") == 0)
-					{
-						hasField[2] = true;
-					}
-					else
-					{
-						hasField[3] = true; // other
-						break;
-					}
-				}
-				if(hasField[0] && hasField[1] && hasField[2] && !hasField[3])
-				{
-					// do nothing, already XYZ
-				}
-				else
+				rosCloud.fields.resize(3);
+				const char * names[3] = {"x", "y", "z"};
+				for(size_t i=0; i<3; ++i)
 				{
-					pcl::PointCloud<pcl::PointXYZ> cloudxyz;
-					pcl::fromPCLPointCloud2(*output, cloudxyz);
-					pcl::toPCLPointCloud2(cloudxyz, *output);
+					rosCloud.fields[i].name = names[i];
+					rosCloud.fields[i].offset = i*sizeof(float);
+					rosCloud.fields[i].datatype = sensor_msgs::PointField::FLOAT32;
+					rosCloud.fields[i].count = 1;
 				}
+				rosCloud.point_step = 3*sizeof(float);
+			}
+			else
+			{
+				rosCloud.fields = cloudMsgs[0]->fields;
+				rosCloud.point_step = cloudMsgs[0]->point_step;
 			}
 
-			for(unsigned int i=1; i<cloudMsgs.size(); ++i)
+			// Each cloud is transformed directly at its offset in the output buffer
+			std::vector<size_t> offsets(cloudMsgs.size(), 0);
+			size_t totalPoints = 0;
+			for(size_t i=0; i<cloudMsgs.size(); ++i)
 			{
-				rtabmap::Transform cloudDisplacement;
-				if(!fixedFrameId_.empty() &&
-				   cloudMsgs[0]->header.stamp != cloudMsgs[i]->header.stamp)
-				{
-					// approx sync
-					cloudDisplacement = rtabmap_conversions::getTransform(
-							frameId, //sourceTargetFrame
-							fixedFrameId_, //fixedFrame
-							cloudMsgs[i]->header.stamp, //stampSource
-							cloudMsgs[0]->header.stamp, //stampTarget
-							tfListener_,
-							waitForTransformDuration_);
-				}
+				offsets[i] = totalPoints;
+				totalPoints += size_t(cloudMsgs[i]->width) * size_t(cloudMsgs[i]->height);
+			}
+			rosCloud.data.resize(totalPoints * rosCloud.point_step);
 
-				pcl::PCLPointCloud2::Ptr cloud2(new pcl::PCLPointCloud2);
-				if(frameId.compare(cloudMsgs[i]->header.frame_id) != 0)
-				{
-					sensor_msgs::PointCloud2 tmp;
-					pcl_ros::transformPointCloud(frameId, *cloudMsgs[i], tmp, tfListener_);
-					if(!cloudDisplacement.isNull())
-					{
-						sensor_msgs::PointCloud2 tmp2;
-						pcl_ros::transformPointCloud(cloudDisplacement.toEigen4f(), tmp, tmp2);
-						pcl_conversions::toPCL(tmp2, *cloud2);
-					}
-					else
-					{
-						pcl_conversions::toPCL(tmp, *cloud2);
-					}
+			std::vector<size_t> counts(cloudMsgs.size(), 0);
+			boost::thread_group threads;
+			for(size_t i=1; i<cloudMsgs.size(); ++i)
+			{
+				threads.create_thread(boost::bind(&PointCloudAggregator::transformCloud, this,
+						cloudMsgs[i], cloudMsgs[0]->header.stamp, frameId, i+1,
+						boost::cref(rosCloud), rosCloud.data.data() + offsets[i]*rosCloud.point_step, &counts[i]));
+			}
+			transformCloud(cloudMsgs[0], cloudMsgs[0]->header.stamp, frameId, 1,
+					rosCloud, rosCloud.data.data(), &counts[0]);
+			threads.join_all();
 
-				}
-				else
+			// remove gaps left by invalid points or skipped clouds
+			size_t total = counts[0];
+			for(size_t i=1; i<cloudMsgs.size(); ++i)
+			{
+				if(counts[i] && total != offsets[i])
 				{
-					if(!cloudDisplacement.isNull())
-					{
-						sensor_msgs::PointCloud2 tmp;
-						pcl_ros::transformPointCloud(cloudDisplacement.toEigen4f(), *cloudMsgs[i], tmp);
-						pcl_conversions::toPCL(tmp, *cloud2);
-					}
-					else
-					{
-						pcl_conversions::toPCL(*cloudMsgs[i], *cloud2);
-					}
+					memmove(rosCloud.data.data() + total*rosCloud.point_step,
+							rosCloud.data.data() + offsets[i]*rosCloud.point_step,
+							counts[i]*rosCloud.point_step);
 				}
+				total += counts[i];
+			}
+			rosCloud.data.resize(total*rosCloud.point_step);
+			rosCloud.height = 1;
+			rosCloud.width = total;
+			rosCloud.row_step = rosCloud.width * rosCloud.point_step;
+			rosCloud.is_bigendian = false;
+			rosCloud.is_dense = true;
+			rosCloud.header.stamp = cloudMsgs[0]->header.stamp;
+			rosCloud.header.frame_id = frameId;
+			cloudPub_.publish(rosCloud);
+		}
+	}
 
-				if(!cloud2->is_dense)
-				{
-					// remove nans
-					cloud2 = rtabmap::util3d::removeNaNFromPointCloud(cloud2);
-				}
+	/**
+	 * Transform the valid points of "cloudMsg" in "frameId" (at the time of
+	 * "targetStamp" if fixed_frame_id is set) and write them in "output" with
+	 * the fields of "outputLayout".
+	 */
+	void transformCloud(
+			const sensor_msgs::PointCloud2ConstPtr & cloudMsg,
+			const ros::Time & targetStamp,
+			const std::string & frameId,
+			size_t cloudIndex,
+			const sensor_msgs::PointCloud2 & outputLayout,
+			unsigned char * output,
+			size_t * count)
+	{
+		*count = 0;
+		if(cloudMsg->data.empty())
+		{
+			return;
+		}
 
-				if(xyzOutput_ && !cloud2->data.empty())
+		int inputFields[6] = {-1,-1,-1,-1,-1,-1}; // x,y,z,normal_x,normal_y,normal_z
+		const char * names[6] = {"x", "y", "z", "normal_x", "normal_y", "normal_z"};
+		for(size_t i=0; i<cloudMsg->fields.size(); ++i)
+		{
+			for(int j=0; j<6; ++j)
+			{
+				if(cloudMsg->fields[i].name.compare(names[j]) == 0 && cloudMsg->fields[i].datatype == sensor_msgs::PointField::FLOAT32)
 				{
-					// convert only if not already XYZ cloud
-					bool hasField[4] = {false};
-					for(size_t i=0; i<cloud2->fields.size(); ++i)
-					{
-						if(cloud2->fields[i].name.compare("x") == 0)
-						{
-							hasField[0] = true;
-						}
-						else if(cloud2->fields[i].name.compare("y") == 0)
-						{
-							hasField[1] = true;
-						}
-						else if(cloud2->fields[i].name.compare("z") == 0)
-						{
-							hasField[2] = true;
-						}
-						else
-						{
-							hasField[3] = true; // other
-							break;
-						}
-					}
-					if(hasField[0] && hasField[1] && hasField[2] && !hasField[3])
-					{
-						// do nothing, already XYZ
-					}
-					else
-					{
-						pcl::PointCloud<pcl::PointXYZ> cloudxyz;
-						pcl::fromPCLPointCloud2(*cloud2, cloudxyz);
-						pcl::toPCLPointCloud2(cloudxyz, *cloud2);
-					}
+					inputFields[j] = cloudMsg->fields[i].offset;
 				}
+			}
+		}
+		if(inputFields[0]<0 || inputFields[1]<0 || inputFields[2]<0)
+		{
+			ROS_ERROR("%s: cloud%d doesn't have float x, y and z fields, it is ignored.", getName().c_str(), (int)cloudIndex);
+			return;
+		}
+		bool hasNormals = !xyzOutput_ && inputFields[3]>=0 && inputFields[4]>=0 && inputFields[5]>=0;
 
-				if(output->data.empty())
-				{
-					output = cloud2;
-				}
-				else if(!cloud2->data.empty())
-				{
+		if(!xyzOutput_)
+		{
+			bool sameLayout = cloudMsg->point_step == outputLayout.point_step && cloudMsg->fields.size() == outputLayout.fields.size();
+			for(size_t i=0; sameLayout && i<cloudMsg->fields.size(); ++i)
+			{
+				sameLayout = cloudMsg->fields[i].name == outputLayout.fields[i].name &&
+						cloudMsg->fields[i].offset == outputLayout.fields[i].offset &&
+						cloudMsg->fields[i].datatype == outputLayout.fields[i].datatype &&
+						cloudMsg->fields[i].count == outputLayout.fields[i].count;
+			}
+			if(!sameLayout)
+			{
+				ROS_WARN("%s: Input topics don't have all the "
+						"same fields (cloud1=%d fields, cloud%d=%d fields), cloud%d is ignored. "
+						"You can enable \"xyz_output\" option "
+						"to convert all inputs to XYZ.",
+						getName().c_str(),
+						(int)outputLayout.fields.size(),
+						(int)cloudIndex,
+						(int)cloudMsg->fields.size(),
+						(int)cloudIndex);
+				return;
+			}
+		}
 
-					if(output->fields.size() != cloud2->fields.size())
+		rtabmap::Transform t = rtabmap::Transform::getIdentity();
+		if(frameId.compare(cloudMsg->header.frame_id) != 0)
+		{
+			t = rtabmap_conversions::getTransform(
+					frameId, //fromFrame
+					cloudMsg->header.frame_id, //toFrame
+					cloudMsg->header.stamp,
+					tfListener_,
+					waitForTransformDuration_);
+			if(t.isNull())
+			{
+				ROS_ERROR("%s: Cannot transform cloud%d from \"%s\" to \"%s\", it is ignored.",
+						getName().c_str(), (int)cloudIndex, cloudMsg->header.frame_id.c_str(), frameId.c_str());
+				return;
+			}
+		}
+		if(!fixedFrameId_.empty() && targetStamp != cloudMsg->header.stamp)
+		{
+			// approx sync
+			rtabmap::Transform cloudDisplacement = rtabmap_conversions::getTransform(
+					frameId, //sourceTargetFrame
+					fixedFrameId_, //fixedFrame
+					cloudMsg->header.stamp, //stampSource
+					targetStamp, //stampTarget
+					tfListener_,
+					waitForTransformDuration_);
+			if(!cloudDisplacement.isNull())
+			{
+				t = cloudDisplacement * t;
+			}
+		}
+		const Eigen::Matrix4f m = t.toEigen4f();
+
+		const size_t total = size_t(cloudMsg->width) * size_t(cloudMsg->height);
+		const size_t inputStep = cloudMsg->point_step;
+		const size_t outputStep = outputLayout.point_step;
+		size_t n = 0;
+		for(size_t i=0; i<total; ++i)
+		{
+			const unsigned char * in = cloudMsg->data.data() + i*inputStep;
+			float p[3];
+			memcpy(&p[0], in+inputFields[0], sizeof(float));
+			memcpy(&p[1], in+inputFields[1], sizeof(float));
+			memcpy(&p[2], in+inputFields[2], sizeof(float));
+			if(!std::isfinite(p[0]) || !std::isfinite(p[1]) || !std::isfinite(p[2]))
+			{
+				continue;
+			}
+			unsigned char * out = output + n*outputStep;
+			float q[3];
+			for(int k=0; k<3; ++k)
+			{
+				q[k] = m(k,0)*p[0] + m(k,1)*p[1] + m(k,2)*p[2] + m(k,3);
+			}
+			if(xyzOutput_)
+			{
+				memcpy(out, q, 3*sizeof(float));
+			}
+			else
+			{
+				memcpy(out, in, outputStep);
+				memcpy(out+inputFields[0], &q[0], sizeof(float));
+				memcpy(out+inputFields[1], &q[1], sizeof(float));
+				memcpy(out+inputFields[2], &q[2], sizeof(float));
+				if(hasNormals)
+				{
+					float nIn[3], nOut[3];
+					memcpy(&nIn[0], in+inputFields[3], sizeof(float));
+					memcpy(&nIn[1], in+inputFields[4], sizeof(float));
+					memcpy(&nIn[2], in+inputFields[5], sizeof(float));
+					for(int k=0; k<3; ++k)
 					{
-						ROS_WARN("%s: Input topics don't have all the "
-								"same number of fields (cloud1=%d, cloud%d=%d), concatenation "
-								"may fails. You can enable \"xyz_output\" option "
-								"to convert all inputs to XYZ.",
-								getName().c_str(),
-								(int)output->fields.size(),
-								i+1,
-								(int)output->fields.size());
+						nOut[k] = m(k,0)*nIn[0] + m(k,1)*nIn[1] + m(k,2)*nIn[2];
 					}
-
-					pcl::PCLPointCloud2::Ptr tmp_output(new pcl::PCLPointCloud2);
-#if PCL_VERSION_COMPARE(>=, 1, 10, 0)
-					pcl::concatenate(*output, *cloud2, *tmp_output);
-#else
-					pcl::concatenatePointCloud(*output, *cloud2, *tmp_output);
-#endif
-					//Make sure row_step is the sum of both
-					tmp_output->row_step = tmp_output->width * tmp_output->point_step;
-					output = tmp_output;
+					memcpy(out+inputFields[3], &nOut[0], sizeof(float));
+					memcpy(out+inputFields[4], &nOut[1], sizeof(float));
+					memcpy(out+inputFields[5], &nOut[2], sizeof(float));
 				}
 			}
-
-			sensor_msgs::PointCloud2 rosCloud;
-			pcl_conversions::moveFromPCL(*output, rosCloud);
-			rosCloud.header.stamp = cloudMsgs[0]->header.stamp;
-			rosCloud.header.frame_id = frameId;
-			cloudPub_.publish(rosCloud);
+			++n;
 		}
+		*count = n;
 	}
 
 	void warningLoop(const std::string & subscribedTopicsMsg, bool approxSync)
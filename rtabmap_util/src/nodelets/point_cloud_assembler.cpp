@@ -53,6 +53,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/core/util3d_filtering.h>
 #include <rtabmap/core/Version.h>
 
+#include <unordered_map>
+#include <cmath>
+
 namespace rtabmap_util
 {
 
@@ -63,6 +66,10 @@ namespace rtabmap_util
  * If fixed_frame_id is set to "" (empty), the nodelet will subscribe to
  * an odom topic that should have the exact same stamp than to input cloud.
  * The output cloud has the same stamp and frame than the last assembled cloud.
+ * If voxel_hash is true, the clouds are accumulated in a voxel hash map
+ * (voxel_size) in fixed_frame_id, keeping the latest point per voxel, and
+ * the map is published after each cloud. Voxels are removed when older than
+ * voxel_hash_max_age or farther than voxel_hash_max_range from the sensor.
  */
 class PointCloudAssembler : public nodelet::Nodelet
 {
@@ -86,8 +93,12 @@ public:
 		noiseRadius_(0),
 		noiseMinNeighbors_(5),
 		removeZ_(false),
+		voxelHash_(false),
+		voxelHashMaxAge_(0),
+		voxelHashMaxRange_(0),
 		fixedFrameId_("odom"),
-		frameId_("")
+		frameId_(""),
+		voxelPointStep_(0)
 	{}
 
 	virtual ~PointCloudAssembler()
@@ -129,7 +140,15 @@ private:
 		pnh.param("noise_min_neighbors", noiseMinNeighbors_, noiseMinNeighbors_);
 		pnh.param("remove_z", removeZ_, removeZ_);
 		pnh.param("subscribe_odom_info", subscribeOdomInfo, subscribeOdomInfo);
-		ROS_ASSERT(maxClouds_>0 || assemblingTime_ >0.0);
+		pnh.param("voxel_hash", voxelHash_, voxelHash_);
+		pnh.param("voxel_hash_max_age", voxelHashMaxAge_, voxelHashMaxAge_);
+		pnh.param("voxel_hash_max_range", voxelHashMaxRange_, voxelHashMaxRange_);
+		if(voxelHash_ && voxelSize_ <= 0.0)
+		{
+			ROS_ERROR("%s: voxel_hash requires voxel_size to be set, voxel_hash is disabled.", getName().c_str());
+			voxelHash_ = false;
+		}
+		ROS_ASSERT(maxClouds_>0 || assemblingTime_ >0.0 || voxelHash_);
 
 		ROS_INFO("%s: queue_size=%d", getName().c_str(), queueSize);
 		ROS_INFO("%s: fixed_frame_id=%s", getName().c_str(), fixedFrameId_.c_str());
@@ -147,8 +166,11 @@ private:
 		ROS_INFO("%s: noise_radius=%fm", getName().c_str(), noiseRadius_);
 		ROS_INFO("%s: noise_min_neighbors=%d", getName().c_str(), noiseMinNeighbors_);
 		ROS_INFO("%s: remove_z=%s", getName().c_str(), removeZ_?"true":"false");
+		ROS_INFO("%s: voxel_hash=%s", getName().c_str(), voxelHash_?"true":"false");
+		ROS_INFO("%s: voxel_hash_max_age=%fs", getName().c_str(), voxelHashMaxAge_);
+		ROS_INFO("%s: voxel_hash_max_range=%fm", getName().c_str(), voxelHashMaxRange_);
 
-		if(maxClouds_==0 && assemblingTime_ ==0.0)
+		if(maxClouds_==0 && assemblingTime_ ==0.0 && !voxelHash_)
 		{
 			ROS_ERROR("point_cloud_assembler: max_cloud or assembling_time parameters should be set!");
 			exit(-1);
@@ -213,6 +235,7 @@ private:
 		{
 			NODELET_WARN("Reseting point cloud assembler as null odometry has been received.");
 			clouds_.clear();
+			clearVoxelHash();
 		}
 	}
 
@@ -239,6 +262,7 @@ private:
 		{
 			NODELET_WARN("Reseting point cloud assembler as null odometry has been received.");
 			clouds_.clear();
+			clearVoxelHash();
 		}
 	}
 
@@ -308,6 +332,7 @@ private:
 				{
 					ROS_ERROR("Cloud not transform all clouds! Resetting...");
 					clouds_.clear();
+					clearVoxelHash();
 					return;
 				}
 
@@ -353,6 +378,22 @@ private:
 					newCloud = rtabmap::util3d::removeNaNFromPointCloud(newCloud);
 				}
 
+				if(voxelHash_)
+				{
+					if(isMoving || voxelKeys_.empty())
+					{
+						insertInVoxelHash(*newCloud, cloudMsg->header.stamp.toSec());
+						previousPose_ = pose;
+					}
+					pcl::PCLPointCloud2Ptr assembled = assembleVoxelHash(cloudMsg->header.stamp.toSec(), pose);
+					assembled->header.stamp = newCloud->header.stamp;
+					if(assembled->data.size() && !publishAssembled(assembled, pose, cloudMsg->header))
+					{
+						clearVoxelHash();
+					}
+					return;
+				}
+
 				clouds_.push_back(newCloud);
 
 #if PCL_VERSION_COMPARE(>=, 1, 10, 0)
@@ -390,7 +431,6 @@ private:
 						}
 					}
 
-					sensor_msgs::PointCloud2 rosCloud;
 					if(voxelSize_>0.0)
 					{
 						// estimate if there would be an overflow
@@ -440,48 +480,12 @@ private:
 							assembled = output;
 						}
 					}
-					if(noiseRadius_>0.0 && noiseMinNeighbors_>0)
+					if(!publishAssembled(assembled, pose, cloudMsg->header))
 					{
-						pcl::RadiusOutlierRemoval<pcl::PCLPointCloud2> filter;
-						filter.setRadiusSearch(noiseRadius_);
-						filter.setMinNeighborsInRadius(noiseMinNeighbors_);
-						filter.setInputCloud(assembled);
-						pcl::PCLPointCloud2Ptr output(new pcl::PCLPointCloud2);
-						filter.filter(*output);
-						assembled = output;
-					}
-
-					pcl_conversions::moveFromPCL(*assembled, rosCloud);
-					rtabmap::Transform t = pose;
-					if(!frameId_.empty())
-					{
-						// transform in target frame_id instead of sensor frame
-						t = rtabmap_conversions::getTransform(
-								fixedFrameId_, //fromFrame
-								frameId_, //toFrame
-								cloudMsg->header.stamp,
-								tfListener_,
-								waitForTransformDuration_);
-						if(t.isNull())
-						{
-							ROS_ERROR("Cloud not transform back assembled clouds in target frame \"%s\"! Resetting...", frameId_.c_str());
-							clouds_.clear();
-							return;
-						}
-					}
-					pcl_ros::transformPointCloud(t.toEigen4f().inverse(), rosCloud, rosCloud);
-
-					if(removeZ_)
-					{
-						rosCloud = removeField(rosCloud, "z");
+						clouds_.clear();
+						return;
 					}
 
-					rosCloud.header = cloudMsg->header;
-					if(!frameId_.empty())
-					{
-						rosCloud.header.frame_id = frameId_;
-					}
-					cloudPub_.publish(rosCloud);
 					if(circularBuffer_)
 					{
 						if(!isMoving)
@@ -519,6 +523,192 @@ private:
 		}
 	}
 
+	bool publishAssembled(pcl::PCLPointCloud2Ptr & assembled, const rtabmap::Transform & pose, const std_msgs::Header & header)
+	{
+		sensor_msgs::PointCloud2 rosCloud;
+		if(noiseRadius_>0.0 && noiseMinNeighbors_>0)
+		{
+			pcl::RadiusOutlierRemoval<pcl::PCLPointCloud2> filter;
+			filter.setRadiusSearch(noiseRadius_);
+			filter.setMinNeighborsInRadius(noiseMinNeighbors_);
+			filter.setInputCloud(assembled);
+			pcl::PCLPointCloud2Ptr output(new pcl::PCLPointCloud2);
+			filter.filter(*output);
+			assembled = output;
+		}
+
+		pcl_conversions::moveFromPCL(*assembled, rosCloud);
+		rtabmap::Transform t = pose;
+		if(!frameId_.empty())
+		{
+			// transform in target frame_id instead of sensor frame
+			t = rtabmap_conversions::getTransform(
+					fixedFrameId_, //fromFrame
+					frameId_, //toFrame
+					header.stamp,
+					tfListener_,
+					waitForTransformDuration_);
+			if(t.isNull())
+			{
+				ROS_ERROR("Cloud not transform back assembled clouds in target frame \"%s\"! Resetting...", frameId_.c_str());
+				return false;
+			}
+		}
+		pcl_ros::transformPointCloud(t.toEigen4f().inverse(), rosCloud, rosCloud);
+
+		if(removeZ_)
+		{
+			rosCloud = removeField(rosCloud, "z");
+		}
+
+		rosCloud.header = header;
+		if(!frameId_.empty())
+		{
+			rosCloud.header.frame_id = frameId_;
+		}
+		cloudPub_.publish(rosCloud);
+		return true;
+	}
+
+	void clearVoxelHash()
+	{
+		voxels_.clear();
+		voxelKeys_.clear();
+		voxelData_.clear();
+		voxelStamps_.clear();
+	}
+
+	void insertInVoxelHash(const pcl::PCLPointCloud2 & cloud, double stamp)
+	{
+		int x_idx=-1, y_idx=-1, z_idx=-1;
+		for (std::size_t d = 0; d < cloud.fields.size (); ++d)
+		{
+			if (cloud.fields[d].name.compare("x")==0)
+				x_idx = d;
+			if (cloud.fields[d].name.compare("y")==0)
+				y_idx = d;
+			if (cloud.fields[d].name.compare("z")==0)
+				z_idx = d;
+		}
+		if(x_idx<0 || y_idx<0 || z_idx<0 ||
+		   cloud.fields[x_idx].datatype != pcl::PCLPointField::FLOAT32 ||
+		   cloud.fields[y_idx].datatype != pcl::PCLPointField::FLOAT32 ||
+		   cloud.fields[z_idx].datatype != pcl::PCLPointField::FLOAT32)
+		{
+			NODELET_ERROR("Cloud should have float x, y and z fields to be added to voxel hash.");
+			return;
+		}
+
+		bool sameLayout = voxelPointStep_ == cloud.point_step && voxelFields_.size() == cloud.fields.size();
+		for(size_t i=0; sameLayout && i<cloud.fields.size(); ++i)
+		{
+			sameLayout = voxelFields_[i].name == cloud.fields[i].name &&
+					voxelFields_[i].offset == cloud.fields[i].offset &&
+					voxelFields_[i].datatype == cloud.fields[i].datatype &&
+					voxelFields_[i].count == cloud.fields[i].count;
+		}
+		if(!sameLayout)
+		{
+			if(!voxelKeys_.empty())
+			{
+				NODELET_WARN("Point fields have changed, clearing voxel hash.");
+			}
+			clearVoxelHash();
+			voxelFields_ = cloud.fields;
+			voxelPointStep_ = cloud.point_step;
+			voxelOffsets_[0] = cloud.fields[x_idx].offset;
+			voxelOffsets_[1] = cloud.fields[y_idx].offset;
+			voxelOffsets_[2] = cloud.fields[z_idx].offset;
+		}
+
+		const float inverseVoxelSize = 1.0f/voxelSize_;
+		const size_t total = size_t(cloud.width) * size_t(cloud.height);
+		for(size_t i=0; i<total; ++i)
+		{
+			const unsigned char * pt = &cloud.data[i*cloud.point_step];
+			float x,y,z;
+			memcpy(&x, pt + voxelOffsets_[0], sizeof(float));
+			memcpy(&y, pt + voxelOffsets_[1], sizeof(float));
+			memcpy(&z, pt + voxelOffsets_[2], sizeof(float));
+			if(!std::isfinite(x) || !std::isfinite(y) || !std::isfinite(z))
+			{
+				continue;
+			}
+			VoxelKey key(
+					int(floor(x*inverseVoxelSize)),
+					int(floor(y*inverseVoxelSize)),
+					int(floor(z*inverseVoxelSize)));
+			std::pair<std::unordered_map<VoxelKey, size_t, VoxelKeyHash>::iterator, bool> inserted =
+					voxels_.insert(std::make_pair(key, voxelKeys_.size()));
+			size_t index = inserted.first->second;
+			if(inserted.second)
+			{
+				voxelKeys_.push_back(key);
+				voxelStamps_.push_back(stamp);
+				voxelData_.resize(voxelData_.size() + voxelPointStep_);
+			}
+			// keep latest point of the voxel
+			memcpy(&voxelData_[index*voxelPointStep_], pt, voxelPointStep_);
+			voxelStamps_[index] = stamp;
+		}
+	}
+
+	pcl::PCLPointCloud2Ptr assembleVoxelHash(double stamp, const rtabmap::Transform & pose)
+	{
+		// time and spatial eviction
+		if(voxelHashMaxAge_ > 0.0 || voxelHashMaxRange_ > 0.0)
+		{
+			const float maxRangeSqr = voxelHashMaxRange_*voxelHashMaxRange_;
+			size_t i=0;
+			while(i<voxelKeys_.size())
+			{
+				bool remove = voxelHashMaxAge_ > 0.0 && stamp - voxelStamps_[i] > voxelHashMaxAge_;
+				if(!remove && voxelHashMaxRange_ > 0.0)
+				{
+					const unsigned char * pt = &voxelData_[i*voxelPointStep_];
+					float x,y,z;
+					memcpy(&x, pt + voxelOffsets_[0], sizeof(float));
+					memcpy(&y, pt + voxelOffsets_[1], sizeof(float));
+					memcpy(&z, pt + voxelOffsets_[2], sizeof(float));
+					x -= pose.x();
+					y -= pose.y();
+					z -= pose.z();
+					remove = x*x + y*y + z*z > maxRangeSqr;
+				}
+				if(remove)
+				{
+					// move last voxel at this index
+					size_t last = voxelKeys_.size()-1;
+					voxels_.erase(voxelKeys_[i]);
+					if(i != last)
+					{
+						voxelKeys_[i] = voxelKeys_[last];
+						voxelStamps_[i] = voxelStamps_[last];
+						memcpy(&voxelData_[i*voxelPointStep_], &voxelData_[last*voxelPointStep_], voxelPointStep_);
+						voxels_[voxelKeys_[i]] = i;
+					}
+					voxelKeys_.pop_back();
+					voxelStamps_.pop_back();
+					voxelData_.resize(last*voxelPointStep_);
+				}
+				else
+				{
+					++i;
+				}
+			}
+		}
+
+		pcl::PCLPointCloud2Ptr assembled(new pcl::PCLPointCloud2);
+		assembled->fields = voxelFields_;
+		assembled->point_step = voxelPointStep_;
+		assembled->height = 1;
+		assembled->width = voxelKeys_.size();
+		assembled->row_step = assembled->width * assembled->point_step;
+		assembled->is_dense = true;
+		assembled->data = voxelData_;
+		return assembled;
+	}
+
 	void warningLoop(const std::string & subscribedTopicsMsg)
 	{
 		ros::Duration r(5.0);
@@ -565,12 +755,37 @@ private:
 	double noiseRadius_;
 	int noiseMinNeighbors_;
 	bool removeZ_;
+	bool voxelHash_;
+	double voxelHashMaxAge_;
+	double voxelHashMaxRange_;
 	std::string fixedFrameId_;
 	std::string frameId_;
 	tf::TransformListener tfListener_;
 	rtabmap::Transform previousPose_;
 
 	std::list<pcl::PCLPointCloud2::Ptr> clouds_;
+
+	struct VoxelKey
+	{
+		VoxelKey(int x, int y, int z) : x(x), y(y), z(z) {}
+		bool operator==(const VoxelKey & k) const {return x==k.x && y==k.y && z==k.z;}
+		int x, y, z;
+	};
+	struct VoxelKeyHash
+	{
+		size_t operator()(const VoxelKey & k) const
+		{
+			return (size_t(k.x) * 73856093) ^ (size_t(k.y) * 19349663) ^ (size_t(k.z) * 83492791);
+		}
+	};
+	// Voxel data are stored contiguously, the map gives the index of each voxel
+	std::unordered_map<VoxelKey, size_t, VoxelKeyHash> voxels_;
+	std::vector<VoxelKey> voxelKeys_;
+	std::vector<unsigned char> voxelData_;
+	std::vector<double> voxelStamps_;
+	std::vector<pcl::PCLPointField> voxelFields_;
+	unsigned int voxelPointStep_;
+	unsigned int voxelOffsets_[3];
 };
 
 PLUGINLIB_EXPORT_CLASS(rtabmap_util::PointCloudAssembler, nodelet::Nodelet);
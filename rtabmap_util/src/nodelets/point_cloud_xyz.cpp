@@ -53,6 +53,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <cv_bridge/cv_bridge.h>
 #include <opencv2/highgui/highgui.hpp>
 
+#include "rtabmap_util/DepthToCloud.h"
+
 #include "rtabmap/core/util2d.h"
 #include "rtabmap/core/util3d.h"
 #include "rtabmap/core/util3d_filtering.h"
@@ -75,6 +77,9 @@ public:
 		noiseFilterMinNeighbors_(5),
 		normalK_(0),
 		normalRadius_(0.0),
+		normalFastOrganized_(false),
+		normalMaxDepthChange_(0.02),
+		normalSmoothingSize_(10.0),
 		filterNaNs_(false),
 		approxSyncDepth_(0),
 		approxSyncDisparity_(0),
@@ -115,6 +120,9 @@ private:
 		pnh.param("noise_filter_min_neighbors", noiseFilterMinNeighbors_, noiseFilterMinNeighbors_);
 		pnh.param("normal_k", normalK_, normalK_);
 		pnh.param("normal_radius", normalRadius_, normalRadius_);
+		pnh.param("normal_fast_organized", normalFastOrganized_, normalFastOrganized_);
+		pnh.param("normal_max_depth_change", normalMaxDepthChange_, normalMaxDepthChange_);
+		pnh.param("normal_smoothing_size", normalSmoothingSize_, normalSmoothingSize_);
 		pnh.param("filter_nans", filterNaNs_, filterNaNs_);
 		pnh.param("roi_ratios", roiStr, roiStr);
 
@@ -273,6 +281,17 @@ private:
 				}
 			}
 
+			sensor_msgs::PointCloud2 rosCloud;
+			if(!filtersEnabled() &&
+			   rtabmap_util::depthToPointCloud2(depth, cv::Mat(), model, decimation_, maxDepth_, minDepth_, filterNaNs_, rosCloud))
+			{
+				rosCloud.header.stamp = depthMsg->header.stamp;
+				rosCloud.header.frame_id = depthMsg->header.frame_id;
+				cloudPub_.publish(rosCloud);
+				NODELET_DEBUG("point_cloud_xyz from depth time = %f s", (ros::WallTime::now() - time).toSec());
+				return;
+			}
+
 			pcl::IndicesPtr indices(new std::vector<int>);
 			pclCloud = rtabmap::util3d::cloudFromDepth(
 					depth,
@@ -333,6 +352,14 @@ private:
 		}
 	}
 
+	// Voxel, noise and normal filtering require a pcl cloud
+	bool filtersEnabled() const
+	{
+		return voxelSize_ > 0.0 ||
+			(noiseFilterRadius_ > 0.0 && noiseFilterMinNeighbors_ > 0) ||
+			normalK_ > 0 || normalRadius_ > 0.0;
+	}
+
 	void processAndPublish(pcl::PointCloud<pcl::PointXYZ>::Ptr & pclCloud, pcl::IndicesPtr & indices, const std_msgs::Header & header)
 	{
 		if(indices->size() && voxelSize_ > 0.0)
@@ -361,7 +388,17 @@ private:
 		if(!pclCloud->empty() && (pclCloud->is_dense || !indices->empty()) && (normalK_ > 0 || normalRadius_ > 0.0f))
 		{
 			//compute normals
-			pcl::PointCloud<pcl::Normal>::Ptr normals = rtabmap::util3d::computeNormals(pclCloud, normalK_, normalRadius_);
+			pcl::PointCloud<pcl::Normal>::Ptr normals;
+			if(normalFastOrganized_ && pclCloud->isOrganized())
+			{
+				// integral images, a lot faster than kd-tree search but only
+				// possible if the cloud is still organized (no voxel or noise filtering)
+				normals = rtabmap::util3d::computeFastOrganizedNormals(pclCloud, normalMaxDepthChange_, normalSmoothingSize_);
+			}
+			else
+			{
+				normals = rtabmap::util3d::computeNormals(pclCloud, normalK_, normalRadius_);
+			}
 			pcl::PointCloud<pcl::PointNormal>::Ptr pclCloudNormal(new pcl::PointCloud<pcl::PointNormal>);
 			pcl::concatenateFields(*pclCloud, *normals, *pclCloudNormal);
 			if(filterNaNs_)
@@ -395,6 +432,9 @@ private:
 	int noiseFilterMinNeighbors_;
 	int normalK_;
 	double normalRadius_;
+	bool normalFastOrganized_;
+	double normalMaxDepthChange_;
+	double normalSmoothingSize_;
 	bool filterNaNs_;
 	std::vector<float> roiRatios_;
 
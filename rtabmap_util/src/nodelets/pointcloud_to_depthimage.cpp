@@ -52,9 +52,98 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <message_filters/sync_policies/exact_time.h>
 #include <message_filters/subscriber.h>
 
+#include <boost/thread.hpp>
+
 namespace rtabmap_util
 {
 
+// Shared by the worker threads, each thread projects the points
+// offset, offset+step, ... in its own z-buffer.
+struct CloudProjectionJob
+{
+	const sensor_msgs::PointCloud2 * cloud;
+	int xOffset;
+	int yOffset;
+	int zOffset;
+	float t[12]; // camera <- cloud, 3x4 row-major
+	float fx, fy, cx, cy;
+	std::vector<cv::Mat> depths;
+};
+
+static void projectCloudThread(CloudProjectionJob * job, int offset, int step)
+{
+	cv::Mat & depth = job->depths[offset];
+	const int width = depth.cols;
+	const int height = depth.rows;
+	const float * t = job->t;
+	const size_t total = size_t(job->cloud->width) * size_t(job->cloud->height);
+	const size_t pointStep = job->cloud->point_step;
+	const unsigned char * data = job->cloud->data.data();
+	for(size_t i=offset; i<total; i+=step)
+	{
+		const unsigned char * pt = data + i*pointStep;
+		const float x = *((const float*)(pt+job->xOffset));
+		const float y = *((const float*)(pt+job->yOffset));
+		const float z = *((const float*)(pt+job->zOffset));
+		const float cz = t[8]*x + t[9]*y + t[10]*z + t[11];
+		if(!(cz > 0.0f)) // also rejects NaN
+		{
+			continue;
+		}
+		const float invZ = 1.0f/cz;
+		const int dx = (job->fx*(t[0]*x + t[1]*y + t[2]*z + t[3]))*invZ + job->cx;
+		const int dy = (job->fy*(t[4]*x + t[5]*y + t[6]*z + t[7]))*invZ + job->cy;
+		if(dx>=0 && dx<width && dy>=0 && dy<height)
+		{
+			float & zReg = depth.at<float>(dy, dx);
+			if(zReg == 0.0f || cz < zReg)
+			{
+				zReg = cz;
+			}
+		}
+	}
+}
+
+// Horizontal bands of the depth image processed independently. Each
+// band is extended by "margin" rows on both sides so that the result
+// of the interior rows is the same as processing the full image.
+struct DepthTileJob
+{
+	cv::Mat input;
+	cv::Mat output;
+	int tiles;
+	int margin;
+	int fillHolesSize;
+	double fillHolesError;
+	int fillIterations;
+	int upscale;
+	double upscaleDepthErrorRatio;
+};
+
+static void depthTileThread(DepthTileJob * job, int offset, int step)
+{
+	const int rows = job->input.rows;
+	const int factor = job->upscale>1?job->upscale:1;
+	for(int i=offset; i<job->tiles; i+=step)
+	{
+		int start = rows*i/job->tiles;
+		int end = rows*(i+1)/job->tiles;
+		int startMargin = std::max(0, start-job->margin);
+		int endMargin = std::min(rows, end+job->margin);
+		cv::Mat tile = job->input.rowRange(startMargin, endMargin).clone();
+		for(int j=0; j<job->fillIterations; ++j)
+		{
+			tile = rtabmap::util2d::fillDepthHoles(tile, job->fillHolesSize, job->fillHolesError);
+		}
+		if(factor > 1)
+		{
+			tile = rtabmap::util2d::interpolate(tile, factor, job->upscaleDepthErrorRatio);
+		}
+		tile.rowRange((start-startMargin)*factor, (end-startMargin)*factor).copyTo(
+				job->output.rowRange(start*factor, end*factor));
+	}
+}
+
 class PointCloudToDepthImage : public nodelet::Nodelet
 {
 public:
@@ -67,6 +156,7 @@ public:
 		decimation_(1),
 		upscale_(false),
 		upscaleDepthErrorRatio_(0.02),
+		numThreads_(1),
 		approxSync_(0),
 		exactSync_(0)
 			{}
@@ -104,6 +194,15 @@ private:
 		pnh.param("approx", approx, approx);
 		pnh.param("upscale", upscale_, upscale_);
 		pnh.param("upscale_depth_error_ratio", upscaleDepthErrorRatio_, upscaleDepthErrorRatio_);
+		pnh.param("num_threads", numThreads_, numThreads_);
+		if(numThreads_ <= 0)
+		{
+			numThreads_ = boost::thread::hardware_concurrency();
+			if(numThreads_ <= 0)
+			{
+				numThreads_ = 1;
+			}
+		}
 
 		if(fixedFrameId_.empty() && approx)
 		{
@@ -123,6 +222,7 @@ private:
 		ROS_INFO("  fill_iterations=%d", fillIterations_);
 		ROS_INFO("  decimation=%d", decimation_);
 		ROS_INFO("  upscale=%s (upscale_depth_error_ratio=%f)", upscale_?"true":"false", upscaleDepthErrorRatio_);
+		ROS_INFO("  num_threads=%d", numThreads_);
 
 		image_transport::ImageTransport it(nh);
 		depthImage16Pub_ = it.advertise("image_raw", 1); // 16 bits unsigned in mm
@@ -211,21 +311,50 @@ private:
 			UASSERT_MSG(pointCloud2Msg->data.size() == pointCloud2Msg->row_step*pointCloud2Msg->height,
 					uFormat("data=%d row_step=%d height=%d", pointCloud2Msg->data.size(), pointCloud2Msg->row_step, pointCloud2Msg->height).c_str());
 
-			pcl::PCLPointCloud2::Ptr cloud(new pcl::PCLPointCloud2);
-			pcl_conversions::toPCL(*pointCloud2Msg, *cloud);
-
 			cv_bridge::CvImage depthImage;
+			bool upscaled = false;
 
-			if(cloud->data.empty())
+			if(pointCloud2Msg->data.empty())
 			{
 				ROS_WARN("Received an empty cloud on topic \"%s\"! A depth image with all zeros is returned.", pointCloudSub_.getTopic().c_str());
 				depthImage.image = cv::Mat::zeros(model.imageSize(), CV_32FC1);
 			}
 			else
 			{
-				depthImage.image = rtabmap::util3d::projectCloudToCamera(model.imageSize(), model.K(), cloud, model.localTransform());
+				if(!projectCloud(*pointCloud2Msg, model, depthImage.image))
+				{
+					return;
+				}
 
-				if(fillHolesSize_ > 0 && fillIterations_ > 0)
+				bool fill = fillHolesSize_ > 0 && fillIterations_ > 0;
+				bool upscale = decimation_>1 && upscale_;
+				if(numThreads_ > 1 && (fill || upscale))
+				{
+					// Tiled fill/upscale, margin is large enough to not see the
+					// tile borders: a hole can be filled from fillHolesSize_ rows
+					// away per iteration, interpolation looks at next row.
+					DepthTileJob job;
+					job.input = depthImage.image;
+					job.tiles = std::min(numThreads_*2, std::max(1, depthImage.image.rows/16));
+					job.margin = (fill?fillHolesSize_*fillIterations_:0) + 2;
+					job.fillHolesSize = fillHolesSize_;
+					job.fillHolesError = fillHolesError_;
+					job.fillIterations = fill?fillIterations_:0;
+					job.upscale = upscale?decimation_:1;
+					job.upscaleDepthErrorRatio = upscaleDepthErrorRatio_;
+					job.output = cv::Mat(depthImage.image.rows*job.upscale, depthImage.image.cols*job.upscale, CV_32FC1);
+					boost::thread_group workers;
+					int threads = std::min(numThreads_, job.tiles);
+					for(int i=1; i<threads; ++i)
+					{
+						workers.create_thread(boost::bind(&depthTileThread, &job, i, threads));
+					}
+					depthTileThread(&job, 0, threads);
+					workers.join_all();
+					depthImage.image = job.output;
+					upscaled = upscale;
+				}
+				else if(fill)
 				{
 					for(int i=0; i<fillIterations_;++i)
 					{
@@ -244,7 +373,7 @@ private:
 
 			depthImage.header = cameraInfoMsg->header;
 
-			if(decimation_>1 && upscale_)
+			if(decimation_>1 && upscale_ && !upscaled)
 			{
 				depthImage.image = rtabmap::util2d::interpolate(depthImage.image, decimation_, upscaleDepthErrorRatio_);
 			}
@@ -283,6 +412,69 @@ private:
 		}
 	}
 
+	/**
+	 * Project the cloud directly from the message buffer without
+	 * intermediate PCL conversion. Every thread accumulates in its own
+	 * z-buffer, which are then merged by keeping the closest depth.
+	 */
+	bool projectCloud(const sensor_msgs::PointCloud2 & cloudMsg, const rtabmap::CameraModel & model, cv::Mat & depth)
+	{
+		CloudProjectionJob job;
+		job.cloud = &cloudMsg;
+		job.xOffset = job.yOffset = job.zOffset = -1;
+		for(size_t i=0; i<cloudMsg.fields.size(); ++i)
+		{
+			if(cloudMsg.fields[i].datatype == sensor_msgs::PointField::FLOAT32)
+			{
+				if(cloudMsg.fields[i].name.compare("x") == 0) job.xOffset = cloudMsg.fields[i].offset;
+				else if(cloudMsg.fields[i].name.compare("y") == 0) job.yOffset = cloudMsg.fields[i].offset;
+				else if(cloudMsg.fields[i].name.compare("z") == 0) job.zOffset = cloudMsg.fields[i].offset;
+			}
+		}
+		if(job.xOffset < 0 || job.yOffset < 0 || job.zOffset < 0)
+		{
+			ROS_ERROR("Input cloud on topic \"%s\" should have float x, y and z fields!", pointCloudSub_.getTopic().c_str());
+			return false;
+		}
+		rtabmap::Transform t = model.localTransform().inverse();
+		memcpy(job.t, t.data(), 12*sizeof(float));
+		job.fx = model.fx();
+		job.fy = model.fy();
+		job.cx = model.cx();
+		job.cy = model.cy();
+
+		size_t total = size_t(cloudMsg.width) * size_t(cloudMsg.height);
+		int threads = std::max(1, std::min(numThreads_, int(total/10000)));
+		job.depths.resize(threads);
+		for(int i=0; i<threads; ++i)
+		{
+			job.depths[i] = cv::Mat::zeros(model.imageSize(), CV_32FC1);
+		}
+		boost::thread_group workers;
+		for(int i=1; i<threads; ++i)
+		{
+			workers.create_thread(boost::bind(&projectCloudThread, &job, i, threads));
+		}
+		projectCloudThread(&job, 0, threads);
+		workers.join_all();
+
+		depth = job.depths[0];
+		for(int i=1; i<threads; ++i)
+		{
+			// min reduction ignoring zeros (no depth)
+			const float * in = job.depths[i].ptr<float>();
+			float * out = depth.ptr<float>();
+			for(size_t j=0; j<depth.total(); ++j)
+			{
+				if(in[j] > 0.0f && (out[j] == 0.0f || in[j] < out[j]))
+				{
+					out[j] = in[j];
+				}
+			}
+		}
+		return true;
+	}
+
 private:
 	image_transport::Publisher depthImage16Pub_;
 	image_transport::Publisher depthImage32Pub_;
@@ -300,6 +492,7 @@ private:
 	int decimation_;
 	bool upscale_;
 	double upscaleDepthErrorRatio_;
+	int numThreads_;
 
 	typedef message_filters::sync_policies::ApproximateTime<sensor_msgs::PointCloud2, sensor_msgs::CameraInfo> MyApproxSyncPolicy;
 	message_filters::Synchronizer<MyApproxSyncPolicy> * approxSync_;
@@ -60,7 +60,8 @@ class RGBDRelay : public nodelet::Nodelet
 public:
 	RGBDRelay() :
 		compress_(false),
-		uncompress_(false)
+		uncompress_(false),
+		depthCompressedFormat_("png")
 	{}
 
 	virtual ~RGBDRelay()
@@ -78,8 +79,10 @@ private:
 		pnh.param("queue_size", queueSize, queueSize);
 		pnh.param("compress", compress_, compress_);
 		pnh.param("uncompress", uncompress_, uncompress_);
+		pnh.param("depth_compressed_format", depthCompressedFormat_, depthCompressedFormat_);
 
 		NODELET_INFO("%s: queue_size  = %d", getName().c_str(), queueSize);
+		NODELET_INFO("%s: depth_compressed_format = %s", getName().c_str(), depthCompressedFormat_.c_str());
 
 		rgbdImageSub_ = nh.subscribe("rgbd_image", 1, &RGBDRelay::callback, this);
 		rgbdImagePub_ = nh.advertise<rtabmap_msgs::RGBDImage>(nh.resolveName("rgbd_image") + "_relay", 1);
@@ -89,14 +92,20 @@ private:
 	{
 		if(rgbdImagePub_.getNumSubscribers())
 		{
-			if(!compress_ && !uncompress_)
+			bool hasRaw = !input->rgb.data.empty() || !input->depth.data.empty();
+			bool hasCompressed = !input->rgb_compressed.data.empty() || !input->depth_compressed.data.empty();
+			if((!compress_ && !uncompress_) ||
+			   (compress_ && !uncompress_ && !hasRaw) ||
+			   (uncompress_ && !compress_ && !hasCompressed))
 			{
-				//just republish it
+				// nothing to convert, just republish it (no copy when
+				// subscribers are in the same nodelet manager)
 				rgbdImagePub_.publish(input);
 				return;
 			}
 
-			rtabmap_msgs::RGBDImage output;
+			rtabmap_msgs::RGBDImagePtr outputPtr(new rtabmap_msgs::RGBDImage);
+			rtabmap_msgs::RGBDImage & output = *outputPtr;
 			output.header = input->header;
 			output.rgb_camera_info = input->rgb_camera_info;
 			output.depth_camera_info = input->depth_camera_info;
@@ -141,8 +150,7 @@ private:
 					{
 						// depth image
 						cv_bridge::CvImageConstPtr imageDepthPtr = cv_bridge::toCvShare(input->depth, input);
-						output.depth_compressed.data = rtabmap::compressImage(imageDepthPtr->image, ".png");
-						output.depth_compressed.format = "png";
+						rtabmap_conversions::compressDepth(imageDepthPtr->image, depthCompressedFormat_, output.depth_compressed);
 					}
 				}
 			}
@@ -181,14 +189,15 @@ private:
 					// depth image
 					cv_bridge::CvImagePtr ptr = boost::make_shared<cv_bridge::CvImage>();
 					ptr->header = input->depth_compressed.header;
-					ptr->image = rtabmap::uncompressImage(input->depth_compressed.data);
+					ptr->image = rtabmap_conversions::uncompressDepth(input->depth_compressed);
 					ROS_ASSERT(ptr->image.empty() || ptr->image.type() == CV_32FC1 || ptr->image.type() == CV_16UC1);
 					ptr->encoding = ptr->image.empty()?"":ptr->image.type() == CV_32FC1?sensor_msgs::image_encodings::TYPE_32FC1:sensor_msgs::image_encodings::TYPE_16UC1;
 					ptr->toImageMsg(output.depth);
 				}
 			}
 
-			rgbdImagePub_.publish(output);
+			// publish as pointer to avoid serialization with intra-process subscribers
+			rgbdImagePub_.publish(outputPtr);
 		}
 	}
 
@@ -196,6 +205,7 @@ private:
 
 	bool compress_;
 	bool uncompress_;
+	std::string depthCompressedFormat_;
 	ros::Subscriber rgbdImageSub_;
 	ros::Publisher rgbdImagePub_;
 };
@@ -91,51 +91,77 @@ private:
 	{
 		if(rgbPub_.getNumSubscribers())
 		{
-			sensor_msgs::Image outputImage;
-			sensor_msgs::CameraInfo outputCameraInfo;
-			outputImage.header = outputCameraInfo.header = input->header;
-			outputCameraInfo = input->rgb_camera_info;
-
-			if(!input->rgb.data.empty())
+			// camera info is forwarded as is, sharing the input message
+			sensor_msgs::CameraInfoConstPtr outputCameraInfo(input, &input->rgb_camera_info);
+			if(!input->rgb.data.empty() && sameHeader(input->rgb.header, input->header))
 			{
-				// already raw, just copy pointer
-				outputImage = input->rgb;
+				// already raw, just forward a pointer referencing the input message
+				rgbPub_.publish(sensor_msgs::ImageConstPtr(input, &input->rgb), outputCameraInfo);
 			}
-			else if(!input->rgb_compressed.data.empty())
+			else
 			{
+				sensor_msgs::ImagePtr outputImage(new sensor_msgs::Image);
+				if(!input->rgb.data.empty())
+				{
+					*outputImage = input->rgb;
+				}
+				else if(!input->rgb_compressed.data.empty())
+				{
 #ifdef CV_BRIDGE_HYDRO
-				ROS_ERROR("Unsupported compressed image copy, please upgrade at least to ROS Indigo to use this.");
+					ROS_ERROR("Unsupported compressed image copy, please upgrade at least to ROS Indigo to use this.");
 #else
-				cv_bridge::toCvCopy(input->rgb_compressed)->toImageMsg(outputImage);
+					cv_bridge::toCvCopy(input->rgb_compressed)->toImageMsg(*outputImage);
 #endif
+				}
+				outputImage->header = input->header;
+				rgbPub_.publish(outputImage, outputCameraInfo);
 			}
-			rgbPub_.publish(outputImage, outputCameraInfo);
 		}
 
 		if(depthPub_.getNumSubscribers())
 		{
-			sensor_msgs::Image outputImage;
-			sensor_msgs::CameraInfo outputCameraInfo;
-			outputCameraInfo = input->depth_camera_info;
-
-			if(!input->depth.data.empty())
+			if(!input->depth.data.empty() &&
+				sameHeader(input->depth.header, input->header) &&
+				sameHeader(input->depth_camera_info.header, input->header))
 			{
-				// already raw, just copy pointer
-				outputImage = input->depth;
+				// already raw, just forward pointers referencing the input message
+				depthPub_.publish(
+						sensor_msgs::ImageConstPtr(input, &input->depth),
+						sensor_msgs::CameraInfoConstPtr(input, &input->depth_camera_info));
 			}
-			else if(!input->depth_compressed.data.empty())
+			else
 			{
+				sensor_msgs::ImagePtr outputImage(new sensor_msgs::Image);
+				sensor_msgs::CameraInfoPtr outputCameraInfo(new sensor_msgs::CameraInfo(input->depth_camera_info));
+				if(!input->depth.data.empty())
+				{
+					*outputImage = input->depth;
+				}
+				else if(input->depth_compressed.format.compare("rvl")==0)
+				{
+					cv_bridge::CvImage cvImg(input->depth_compressed.header, sensor_msgs::image_encodings::TYPE_16UC1,
+							rtabmap_conversions::uncompressDepth(input->depth_compressed));
+					cvImg.toImageMsg(*outputImage);
+				}
+				else if(!input->depth_compressed.data.empty())
+				{
 #ifdef CV_BRIDGE_HYDRO
-				ROS_ERROR("Unsupported compressed image copy, please upgrade at least to ROS Indigo to use this.");
+					ROS_ERROR("Unsupported compressed image copy, please upgrade at least to ROS Indigo to use this.");
 #else
-				cv_bridge::toCvCopy(input->depth_compressed)->toImageMsg(outputImage);
+					cv_bridge::toCvCopy(input->depth_compressed)->toImageMsg(*outputImage);
 #endif
+				}
+				outputImage->header = outputCameraInfo->header = input->header;
+				depthPub_.publish(outputImage, outputCameraInfo);
 			}
-			outputImage.header = outputCameraInfo.header = input->header;
-			depthPub_.publish(outputImage, outputCameraInfo);
 		}
 	}
 
+	static bool sameHeader(const std_msgs::Header & a, const std_msgs::Header & b)
+	{
+		return a.stamp == b.stamp && a.frame_id.compare(b.frame_id) == 0;
+	}
+
 private:
 	ros::Subscriber rgbdImageSub_;
 	image_transport::CameraPublisher rgbPub_;
@@ -0,0 +1,219 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <ros/ros.h>
+#include <pluginlib/class_list_macros.hpp>
+#include <nodelet/nodelet.h>
+
+#include <topic_tools/shape_shifter.h>
+#include <std_msgs/Header.h>
+#include <nav_msgs/Odometry.h>
+
+#include <boost/thread.hpp>
+
+#include <rtabmap_conversions/MsgConversion.h>
+#include <rtabmap/utilite/UConversion.h>
+
+#include <list>
+
+namespace rtabmap_util
+{
+
+/**
+ * Throttle any stamped topics without deserializing them. Only the
+ * header is read from the serialized buffer to decide if a message is
+ * kept, messages sharing the same stamp are kept or dropped together
+ * (e.g., image/depth/camera_info of the same frame). Frames can also
+ * be dropped when the robot didn't move enough according to odometry.
+ */
+class TopicThrottle : public nodelet::Nodelet
+{
+public:
+	TopicThrottle() :
+		rate_(0.0),
+		minLinearUpdate_(0.0),
+		minAngularUpdate_(0.0),
+		odomReceived_(false)
+	{}
+
+	virtual ~TopicThrottle() {}
+
+private:
+	virtual void onInit()
+	{
+		ros::NodeHandle & nh = getNodeHandle();
+		ros::NodeHandle & pnh = getPrivateNodeHandle();
+
+		int queueSize = 1;
+		std::vector<std::string> topics;
+		topics.push_back("rgb/image");
+		topics.push_back("depth/image");
+		topics.push_back("rgb/camera_info");
+		pnh.param("rate", rate_, rate_);
+		pnh.param("queue_size", queueSize, queueSize);
+		pnh.param("topics", topics, topics);
+		pnh.param("min_linear_update", minLinearUpdate_, minLinearUpdate_);
+		pnh.param("min_angular_update", minAngularUpdate_, minAngularUpdate_);
+
+		NODELET_INFO("%s: rate               = %f Hz", getName().c_str(), rate_);
+		NODELET_INFO("%s: queue_size         = %d", getName().c_str(), queueSize);
+		NODELET_INFO("%s: min_linear_update  = %f m", getName().c_str(), minLinearUpdate_);
+		NODELET_INFO("%s: min_angular_update = %f rad", getName().c_str(), minAngularUpdate_);
+
+		if(minLinearUpdate_ > 0.0 || minAngularUpdate_ > 0.0)
+		{
+			odomSub_ = nh.subscribe("odom", 1, &TopicThrottle::odomCallback, this);
+		}
+
+		std::string subscribedTopicsMsg = uFormat("\n%s subscribed to:", getName().c_str());
+		topics_.resize(topics.size());
+		for(size_t i=0; i<topics.size(); ++i)
+		{
+			topics_[i].outputName = nh.resolveName(topics[i]+"_out");
+			topics_[i].sub = nh.subscribe<topic_tools::ShapeShifter>(topics[i]+"_in", queueSize,
+					boost::bind(&TopicThrottle::callback, this, boost::placeholders::_1, i));
+			subscribedTopicsMsg += uFormat("\n   %s -> %s", topics_[i].sub.getTopic().c_str(), topics_[i].outputName.c_str());
+		}
+		if(odomSub_)
+		{
+			subscribedTopicsMsg += uFormat("\n   %s", odomSub_.getTopic().c_str());
+		}
+		NODELET_INFO("%s", subscribedTopicsMsg.c_str());
+	}
+
+	void odomCallback(const nav_msgs::OdometryConstPtr & odomMsg)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		odomPose_ = rtabmap_conversions::transformFromPoseMsg(odomMsg->pose.pose);
+		odomReceived_ = true;
+	}
+
+	void callback(const topic_tools::ShapeShifter::ConstPtr & msg, size_t index)
+	{
+		// Only the header at the beginning of the buffer is deserialized
+		std_msgs::Header header;
+		try
+		{
+			header = *msg->instantiate<std_msgs::Header>();
+		}
+		catch(ros::Exception & e)
+		{
+			NODELET_ERROR("%s: topic \"%s\" (%s) should have a header! (%s)",
+					getName().c_str(), topics_[index].sub.getTopic().c_str(), msg->getDataType().c_str(), e.what());
+			return;
+		}
+
+		if(!accept(header.stamp))
+		{
+			return;
+		}
+
+		Topic & topic = topics_[index];
+		if(!topic.pub)
+		{
+			// type is known only on first message received
+			ros::NodeHandle & nh = getNodeHandle();
+			topic.pub = msg->advertise(nh, topic.outputName, 1);
+		}
+		topic.pub.publish(msg);
+	}
+
+	bool accept(const ros::Time & stamp)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		for(std::list<ros::Time>::iterator iter=acceptedStamps_.begin(); iter!=acceptedStamps_.end(); ++iter)
+		{
+			if(*iter == stamp)
+			{
+				return true;
+			}
+		}
+		if(!acceptedStamps_.empty())
+		{
+			const ros::Time & last = acceptedStamps_.back();
+			if(stamp < last)
+			{
+				// older than a frame already kept
+				return false;
+			}
+			if(rate_ > 0.0 && (stamp-last).toSec() < 1.0/rate_)
+			{
+				return false;
+			}
+		}
+		if(minLinearUpdate_ > 0.0 || minAngularUpdate_ > 0.0)
+		{
+			if(!odomReceived_)
+			{
+				return false;
+			}
+			if(!lastAcceptedOdomPose_.isNull())
+			{
+				rtabmap::Transform motion = lastAcceptedOdomPose_.inverse() * odomPose_;
+				float x,y,z,roll,pitch,yaw;
+				motion.getTranslationAndEulerAngles(x,y,z,roll,pitch,yaw);
+				bool moved =
+						(minLinearUpdate_ > 0.0 && motion.getNorm() >= minLinearUpdate_) ||
+						(minAngularUpdate_ > 0.0 && (fabs(roll) >= minAngularUpdate_ || fabs(pitch) >= minAngularUpdate_ || fabs(yaw) >= minAngularUpdate_));
+				if(!moved)
+				{
+					return false;
+				}
+			}
+			lastAcceptedOdomPose_ = odomPose_;
+		}
+		acceptedStamps_.push_back(stamp);
+		if(acceptedStamps_.size() > 10)
+		{
+			acceptedStamps_.pop_front();
+		}
+		return true;
+	}
+
+private:
+	struct Topic
+	{
+		ros::Subscriber sub;
+		ros::Publisher pub;
+		std::string outputName;
+	};
+	std::vector<Topic> topics_;
+	ros::Subscriber odomSub_;
+
+	double rate_;
+	double minLinearUpdate_;
+	double minAngularUpdate_;
+
+	boost::mutex mutex_;
+	std::list<ros::Time> acceptedStamps_;
+	rtabmap::Transform odomPose_;
+	rtabmap::Transform lastAcceptedOdomPose_;
+	bool odomReceived_;
+};
+
+PLUGINLIB_EXPORT_CLASS(rtabmap_util::TopicThrottle, nodelet::Nodelet);
+}
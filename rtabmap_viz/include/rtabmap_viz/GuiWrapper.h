@@ -35,6 +35,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap_msgs/Goal.h"
 #include "rtabmap/utilite/UEventsHandler.h"
 #include "rtabmap/core/Transform.h"
+#include "rtabmap/core/Statistics.h"
 
 #include <tf/transform_listener.h>
 
@@ -42,7 +43,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <nav_msgs/Path.h>
 #include <std_msgs/Bool.h>
 
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
 #include <rtabmap_sync/CommonDataSubscriber.h>
+#include <rtabmap_sync/ShmRingBuffer.h>
 
 namespace rtabmap
 {
@@ -114,6 +119,13 @@ private:
 
 	void processRequestedMap(const rtabmap_msgs::MapData & map);
 
+	void postStatistics(const rtabmap::Statistics & stat);
+	void flushStatistics();
+	void flushStatisticsCallback(const ros::WallTimerEvent & event);
+
+	void subscribeInfoMap(ros::NodeHandle & nh);
+	void shmInfoMapThread();
+
 private:
 	rtabmap::PreferencesDialog * prefDialog_;
 	rtabmap::MainWindow * mainWindow_;
@@ -130,6 +142,20 @@ private:
 	double maxOdomUpdateRate_;
 	tf::TransformListener tfListener_;
 
+	// statistics not yet sent to the GUI, coalesced when max_map_update_rate>0
+	double maxMapUpdateRate_;
+	double lastMapUpdateTime_;
+	rtabmap::Statistics pendingStats_;
+	int pendingStatsCount_;
+	boost::mutex pendingStatsMutex_;
+	ros::WallTimer pendingStatsTimer_;
+
+	// nodes with data already sent to the GUI, with requested_map_incremental
+	// only new nodes of a requested map are converted and sent
+	bool requestedMapIncremental_;
+	std::set<int> nodesSent_;
+	boost::mutex nodesSentMutex_;
+
 	ros::Publisher republishNodeDataPub_;
 
 	message_filters::Subscriber<rtabmap_msgs::Info> infoTopic_;
@@ -145,6 +171,11 @@ private:
 			rtabmap_msgs::MapData> MyInfoMapSyncPolicy;
 	message_filters::Synchronizer<MyInfoMapSyncPolicy> * infoMapSync_;
 
+	// info and mapData read from shared memory when rtabmap is on the same host
+	rtabmap_sync::ShmRingBuffer shmInfoMapData_;
+	boost::thread * shmInfoMapThread_;
+	bool shmInfoMapThreadRunning_;
+
 	typedef message_filters::sync_policies::ExactTime<
 			rtabmap_msgs::Goal,
 			nav_msgs::Path> MyGoalPathSyncPolicy;
@@ -75,7 +75,14 @@ GuiWrapper::GuiWrapper(int & argc, char** argv) :
 		maxOdomUpdateRate_(10),
 		cameraNodeName_(""),
 		lastOdomInfoUpdateTime_(0),
-		rtabmapNodeName_("rtabmap")
+		rtabmapNodeName_("rtabmap"),
+		maxMapUpdateRate_(0),
+		lastMapUpdateTime_(0),
+		pendingStatsCount_(0),
+		requestedMapIncremental_(false),
+		infoMapSync_(0),
+		shmInfoMapThread_(0),
+		shmInfoMapThreadRunning_(false)
 {
 	ros::NodeHandle nh;
 	ros::NodeHandle pnh("~");
@@ -119,6 +126,10 @@ GuiWrapper::GuiWrapper(int & argc, char** argv) :
 	pnh.param("wait_for_transform_duration",  waitForTransformDuration_, waitForTransformDuration_);
 	pnh.param("odom_sensor_sync", odomSensorSync_, odomSensorSync_);
 	pnh.param("max_odom_update_rate", maxOdomUpdateRate_, maxOdomUpdateRate_);
+	pnh.param("max_map_update_rate", maxMapUpdateRate_, maxMapUpdateRate_); // 0=send all map updates to the GUI
+	pnh.param("requested_map_incremental", requestedMapIncremental_, requestedMapIncremental_); // send only nodes not already sent to the GUI on map download
+	bool shmTransport = true;
+	pnh.param("shm_transport", shmTransport, shmTransport); // use shared memory for info/mapData if rtabmap has shm_transport enabled on this host
 	pnh.param("camera_node_name", cameraNodeName_, cameraNodeName_); // used to pause the rtabmap_conversions/camera when pausing the process
 	pnh.param("subscribe_info_only", subscribeInfoOnly, subscribeInfoOnly);
 	pnh.param("init_cache_path", initCachePath, initCachePath);
@@ -164,15 +175,15 @@ GuiWrapper::GuiWrapper(int & argc, char** argv) :
 		ROS_INFO("subscribe_info_only=true");
 		infoOnlyTopic_ = nh.subscribe("info", 1, &GuiWrapper::infoCallback, this);
 	}
+	else if(shmTransport && shmInfoMapData_.open(rtabmap_sync::ShmRingBuffer::segmentName(nh.resolveName("info"))))
+	{
+		ROS_INFO("rtabmap_viz: Receiving info and mapData through shared memory \"%s\"", shmInfoMapData_.name().c_str());
+		shmInfoMapThreadRunning_ = true;
+		shmInfoMapThread_ = new boost::thread(boost::bind(&GuiWrapper::shmInfoMapThread, this));
+	}
 	else
 	{
-		infoTopic_.subscribe(nh, "info", 1);
-		mapDataTopic_.subscribe(nh, "mapData", 1);
-		infoMapSync_ = new message_filters::Synchronizer<MyInfoMapSyncPolicy>(
-				MyInfoMapSyncPolicy(this->getQueueSize()),
-				infoTopic_,
-				mapDataTopic_);
-		infoMapSync_->registerCallback(boost::bind(&GuiWrapper::infoMapCallback, this, boost::placeholders::_1, boost::placeholders::_2));
+		subscribeInfoMap(nh);
 	}
 
 	goalTopic_.subscribe(nh, "goal_node", 1);
@@ -184,6 +195,12 @@ GuiWrapper::GuiWrapper(int & argc, char** argv) :
 	goalPathSync_->registerCallback(boost::bind(&GuiWrapper::goalPathCallback, this, boost::placeholders::_1, boost::placeholders::_2));
 	goalReachedTopic_ = nh.subscribe("goal_reached", 1, &GuiWrapper::goalReachedCallback, this);
 
+	if(maxMapUpdateRate_ > 0.0)
+	{
+		ROS_INFO("rtabmap_viz: max_map_update_rate=%f Hz (map updates received while the GUI is busy are merged)", maxMapUpdateRate_);
+		pendingStatsTimer_ = nh.createWallTimer(ros::WallDuration(1.0/maxMapUpdateRate_), &GuiWrapper::flushStatisticsCallback, this);
+	}
+
 	setupCallbacks(nh, pnh, ros::this_node::getName()); // do it at the end
 }
 
@@ -191,10 +208,60 @@ GuiWrapper::~GuiWrapper()
 {
 	UDEBUG("");
 
+	if(shmInfoMapThread_)
+	{
+		shmInfoMapThreadRunning_ = false;
+		shmInfoMapThread_->join();
+		delete shmInfoMapThread_;
+	}
+
 	delete infoMapSync_;
 	delete mainWindow_;
 }
 
+void GuiWrapper::subscribeInfoMap(ros::NodeHandle & nh)
+{
+	infoTopic_.subscribe(nh, "info", 1);
+	mapDataTopic_.subscribe(nh, "mapData", 1);
+	infoMapSync_ = new message_filters::Synchronizer<MyInfoMapSyncPolicy>(
+			MyInfoMapSyncPolicy(this->getQueueSize()),
+			infoTopic_,
+			mapDataTopic_);
+	infoMapSync_->registerCallback(boost::bind(&GuiWrapper::infoMapCallback, this, boost::placeholders::_1, boost::placeholders::_2));
+}
+
+void GuiWrapper::shmInfoMapThread()
+{
+	std::vector<uint8_t> buffer;
+	while(shmInfoMapThreadRunning_)
+	{
+		unsigned int dropped = 0;
+		if(shmInfoMapData_.read(buffer, 0.5, &dropped))
+		{
+			if(dropped)
+			{
+				ROS_WARN("rtabmap_viz: %d info/mapData messages overwritten in shared memory before being read.", dropped);
+			}
+			rtabmap_msgs::InfoPtr infoMsg(new rtabmap_msgs::Info);
+			rtabmap_msgs::MapDataPtr mapMsg(new rtabmap_msgs::MapData);
+			size_t offset = 0;
+			if(rtabmap_sync::ShmRingBuffer::deserialize(buffer, offset, *infoMsg) &&
+			   rtabmap_sync::ShmRingBuffer::deserialize(buffer, offset, *mapMsg))
+			{
+				infoMapCallback(infoMsg, mapMsg);
+			}
+		}
+		else if(!shmInfoMapData_.isWriterAlive())
+		{
+			ROS_WARN("rtabmap_viz: rtabmap closed shared memory \"%s\", subscribing to info and mapData topics.", shmInfoMapData_.name().c_str());
+			shmInfoMapData_.close();
+			ros::NodeHandle nh;
+			subscribeInfoMap(nh);
+			break;
+		}
+	}
+}
+
 void GuiWrapper::infoMapCallback(
 		const rtabmap_msgs::InfoConstPtr & infoMsg,
 		const rtabmap_msgs::MapDataConstPtr & mapMsg)
@@ -220,7 +287,7 @@ void GuiWrapper::infoMapCallback(
 	stat.setSignaturesData(signatures);
 	stat.setConstraints(links);
 
-	this->post(new RtabmapEvent(stat));
+	postStatistics(stat);
 }
 
 void GuiWrapper::infoCallback(
@@ -250,7 +317,70 @@ void GuiWrapper::infoCallback(
 		stat.setMapCorrection(mapToOdom);
 	}
 
-	this->post(new RtabmapEvent(stat));
+	postStatistics(stat);
+}
+
+void GuiWrapper::postStatistics(const rtabmap::Statistics & stat)
+{
+	if(requestedMapIncremental_ && !stat.getSignaturesData().empty())
+	{
+		boost::mutex::scoped_lock lock(nodesSentMutex_);
+		for(std::map<int, Signature>::const_iterator iter=stat.getSignaturesData().begin(); iter!=stat.getSignaturesData().end(); ++iter)
+		{
+			nodesSent_.insert(nodesSent_.end(), iter->first);
+		}
+	}
+
+	if(maxMapUpdateRate_ <= 0.0)
+	{
+		this->post(new RtabmapEvent(stat));
+		return;
+	}
+
+	{
+		boost::mutex::scoped_lock lock(pendingStatsMutex_);
+		if(pendingStatsCount_ > 0)
+		{
+			// Keep latest statistics and graph, but accumulate the node
+			// data so that the GUI doesn't miss any cloud.
+			std::map<int, Signature> signatures = pendingStats_.getSignaturesData();
+			for(std::map<int, Signature>::const_iterator iter=stat.getSignaturesData().begin(); iter!=stat.getSignaturesData().end(); ++iter)
+			{
+				signatures[iter->first] = iter->second;
+			}
+			pendingStats_ = stat;
+			pendingStats_.setSignaturesData(signatures);
+		}
+		else
+		{
+			pendingStats_ = stat;
+		}
+		++pendingStatsCount_;
+	}
+	flushStatistics();
+}
+
+void GuiWrapper::flushStatistics()
+{
+	boost::mutex::scoped_lock lock(pendingStatsMutex_);
+	if(pendingStatsCount_ > 0 &&
+	   UTimer::now() - lastMapUpdateTime_ >= 1.0/maxMapUpdateRate_ &&
+	   !mainWindow_->isProcessingStatistics())
+	{
+		if(pendingStatsCount_ > 1)
+		{
+			ROS_DEBUG("rtabmap_viz: %d map updates merged (GUI busy or max_map_update_rate=%f Hz reached)", pendingStatsCount_, maxMapUpdateRate_);
+		}
+		lastMapUpdateTime_ = UTimer::now();
+		this->post(new RtabmapEvent(pendingStats_));
+		pendingStats_ = rtabmap::Statistics();
+		pendingStatsCount_ = 0;
+	}
+}
+
+void GuiWrapper::flushStatisticsCallback(const ros::WallTimerEvent & event)
+{
+	flushStatistics();
 }
 
 void GuiWrapper::goalPathCallback(
@@ -286,7 +416,32 @@ void GuiWrapper::processRequestedMap(const rtabmap_msgs::MapData & map)
 	std::multimap<int, rtabmap::Link> constraints;
 	Transform mapToOdom;
 
-	rtabmap_conversions::mapDataFromROS(map, poses, constraints, signatures, mapToOdom);
+	rtabmap_conversions::mapGraphFromROS(map.graph, poses, constraints, mapToOdom);
+
+	if(requestedMapIncremental_)
+	{
+		// The GUI keeps the nodes already received, only send the new ones
+		// with the updated graph. If the GUI lost some of them, it will
+		// ask to republish their data.
+		std::vector<rtabmap_msgs::NodeData> newNodes;
+		{
+			boost::mutex::scoped_lock lock(nodesSentMutex_);
+			for(size_t i=0; i<map.nodes.size(); ++i)
+			{
+				if(nodesSent_.insert(map.nodes[i].id).second)
+				{
+					newNodes.push_back(map.nodes[i]);
+				}
+			}
+		}
+		ROS_INFO("rtabmap_viz: Requested map: %d/%d new nodes sent to the GUI (%d poses)",
+				(int)newNodes.size(), (int)map.nodes.size(), (int)poses.size());
+		rtabmap_conversions::nodesDataFromROS(newNodes, signatures);
+	}
+	else
+	{
+		rtabmap_conversions::nodesDataFromROS(map.nodes, signatures);
+	}
 
 	RtabmapEvent3DMap e(signatures,
 				poses,
@@ -336,6 +491,8 @@ bool GuiWrapper::handleEvent(UEvent * anEvent)
 			{
 				ROS_ERROR("Can't call \"reset\" service");
 			}
+			boost::mutex::scoped_lock lock(nodesSentMutex_);
+			nodesSent_.clear();
 		}
 		else if(cmd == rtabmap::RtabmapEventCmd::kCmdPause)
 		{